@@ -0,0 +1,476 @@
+#include "devices/block.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "intrinsic.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/rgroup.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* The code in this file is the block layer between the file
+   system, swap and the disk drivers.  Drivers register their disks
+   as block devices; requests to any device go through
+   block_submit(), which checks and counts them, and come back
+   through block_request_complete(). */
+
+/* All block devices, in registration order. */
+static struct list devices;
+static int device_cnt;
+
+/* Devices by role, and the names asked for on the command line. */
+static struct block_device *roles[BLOCK_ROLE_CNT];
+static const char *role_names[BLOCK_ROLE_CNT];
+
+/* Devices used for each role when none is asked for.  These are
+   the disks Pintos has always used:
+0:0 - boot loader, command line args, and operating system kernel
+0:1 - file system
+1:0 - scratch
+1:1 - swap
+*/
+static const char *default_names[BLOCK_ROLE_CNT] = {
+	[BLOCK_FILESYS] = "hd0:1",
+	[BLOCK_SCRATCH] = "hd1:0",
+	[BLOCK_SWAP] = "hd1:1",
+};
+
+static void scan_partitions (struct block_device *);
+static void transfer_multiple (struct block_device *, disk_sector_t,
+		size_t cnt, void *buffer, bool write);
+static void stat_add (struct block_device *, size_t idx, uint64_t);
+static size_t log2_bucket (uint64_t, size_t cnt);
+static void print_block_stats (const struct block_device *);
+
+/* Initializes the block layer to no devices. */
+void
+block_init (void) {
+	list_init (&devices);
+}
+
+/* Registers a block device NAME of SIZE sectors, on which OPS
+   carries out requests, with AUX for the driver's use and BLOCK_*
+   FLAGS, and returns it. */
+struct block_device *
+block_register (const char *name, disk_sector_t size,
+		const struct block_operations *ops, void *aux, unsigned flags) {
+	struct block_device *dev = calloc (1, sizeof *dev);
+
+	if (dev == NULL)
+		PANIC ("%s: out of memory for block device", name);
+	strlcpy (dev->name, name, sizeof dev->name);
+	dev->size = size;
+	dev->ops = ops;
+	dev->aux = aux;
+	dev->flags = flags;
+	dev->idx = device_cnt++;
+	list_push_back (&devices, &dev->elem);
+	return dev;
+}
+
+/* Registers partition PART_NO of DISK, the SIZE sectors at START,
+   as a block device named after DISK, and returns it. */
+struct block_device *
+block_register_partition (struct block_device *disk, int part_no,
+		disk_sector_t start, disk_sector_t size) {
+	char name[sizeof disk->name + 16];  /* Cut to fit by block_register(). */
+	struct block_device *dev;
+
+	ASSERT (disk->parent == NULL);
+	ASSERT (start < disk->size && size <= disk->size - start);
+	snprintf (name, sizeof name, "%sp%d", disk->name, part_no);
+	dev = block_register (name, size, disk->ops, disk->aux, 0);
+	dev->parent = disk;
+	dev->start = start;
+	return dev;
+}
+
+/* Makes the device named NAME fill ROLE, once block_assign_roles()
+   runs.  For the kernel command line, which is parsed before any
+   device is registered. */
+void
+block_set_role_name (enum block_role role, const char *name) {
+	ASSERT (role < BLOCK_ROLE_CNT);
+	role_names[role] = name;
+}
+
+/* Reads the partition tables of the disks and gives each role its
+   device: the one named on the command line, else the default disk,
+   else the first device flagged BLOCK_FALLBACK not in another role.
+   Called once all drivers have registered their disks. */
+void
+block_assign_roles (void) {
+	struct list_elem *e;
+	int role;
+
+	for (e = list_begin (&devices); e != list_end (&devices); e = list_next (e)) {
+		struct block_device *dev = list_entry (e, struct block_device, elem);
+
+		if (dev->parent == NULL && !(dev->flags & BLOCK_BOOT))
+			scan_partitions (dev);
+	}
+
+	for (role = 0; role < BLOCK_ROLE_CNT; role++) {
+		if (role_names[role] != NULL) {
+			roles[role] = block_get_by_name (role_names[role]);
+			if (roles[role] == NULL)
+				PANIC ("%s: no such block device", role_names[role]);
+		} else
+			roles[role] = block_get_by_name (default_names[role]);
+	}
+
+	for (role = 0; role < BLOCK_ROLE_CNT; role++)
+		if (roles[role] == NULL)
+			for (e = list_begin (&devices); e != list_end (&devices);
+					e = list_next (e)) {
+				struct block_device *dev = list_entry (e, struct block_device,
+						elem);
+				int r;
+
+				if (!(dev->flags & BLOCK_FALLBACK))
+					continue;
+				for (r = 0; r < BLOCK_ROLE_CNT; r++)
+					if (roles[r] == dev)
+						break;
+				if (r == BLOCK_ROLE_CNT) {
+					roles[role] = dev;
+					break;
+				}
+			}
+}
+
+/* Returns the device filling ROLE, or a null pointer if none
+   does. */
+struct block_device *
+block_get_role (enum block_role role) {
+	ASSERT (role < BLOCK_ROLE_CNT);
+	return roles[role];
+}
+
+/* Returns the device named NAME, or a null pointer if there is no
+   such device. */
+struct block_device *
+block_get_by_name (const char *name) {
+	struct list_elem *e;
+
+	for (e = list_begin (&devices); e != list_end (&devices); e = list_next (e)) {
+		struct block_device *dev = list_entry (e, struct block_device, elem);
+
+		if (!strcmp (dev->name, name))
+			return dev;
+	}
+	return NULL;
+}
+
+/* Returns the size of DEV, measured in DISK_SECTOR_SIZE-byte
+   sectors. */
+disk_sector_t
+block_size (struct block_device *dev) {
+	ASSERT (dev != NULL);
+
+	return dev->size;
+}
+
+/* Returns DEV's name. */
+const char *
+block_name (struct block_device *dev) {
+	return dev->name;
+}
+
+/* Reads sector SEC_NO from DEV into BUFFER, which must have room
+   for DISK_SECTOR_SIZE bytes.
+   Drivers synchronize accesses to their disks, so external
+   per-device locking is unneeded. */
+void
+block_read (struct block_device *dev, disk_sector_t sec_no, void *buffer) {
+	struct block_request req;
+
+	block_request_init (&req, dev, sec_no, 1, buffer, false);
+	block_submit (&req);
+	block_wait (&req);
+}
+
+/* Write sector SEC_NO to DEV from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has acknowledged
+   receiving the data.
+   Drivers synchronize accesses to their disks, so external
+   per-device locking is unneeded. */
+void
+block_write (struct block_device *dev, disk_sector_t sec_no,
+		const void *buffer) {
+	struct block_request req;
+
+	block_request_init (&req, dev, sec_no, 1, (void *) buffer, true);
+	block_submit (&req);
+	block_wait (&req);
+}
+
+/* Reads CNT contiguous sectors starting at SEC_NO from DEV into
+   BUFFER, which must have room for CNT * DISK_SECTOR_SIZE bytes.
+   Runs longer than DISK_REQUEST_MAX_SECTORS are split into several
+   requests, all of which are queued before waiting on any. */
+void
+block_read_multiple (struct block_device *dev, disk_sector_t sec_no,
+		size_t cnt, void *buffer) {
+	transfer_multiple (dev, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT contiguous sectors starting at SEC_NO to DEV from
+   BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged all of the data. */
+void
+block_write_multiple (struct block_device *dev, disk_sector_t sec_no,
+		size_t cnt, const void *buffer) {
+	transfer_multiple (dev, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Common part of block_read_multiple() and block_write_multiple(). */
+static void
+transfer_multiple (struct block_device *dev, disk_sector_t sec_no,
+		size_t cnt, void *buffer_, bool write) {
+	enum { BATCH = 4 };
+	struct block_request reqs[BATCH];
+	uint8_t *buffer = buffer_;
+
+	while (cnt > 0) {
+		size_t req_cnt = 0;
+		size_t i;
+
+		for (; cnt > 0 && req_cnt < BATCH; req_cnt++) {
+			size_t n = cnt < DISK_REQUEST_MAX_SECTORS
+				? cnt : DISK_REQUEST_MAX_SECTORS;
+
+			block_request_init (&reqs[req_cnt], dev, sec_no, n, buffer, write);
+			block_submit (&reqs[req_cnt]);
+			sec_no += n;
+			buffer += n * DISK_SECTOR_SIZE;
+			cnt -= n;
+		}
+		for (i = 0; i < req_cnt; i++)
+			block_wait (&reqs[i]);
+	}
+}
+
+/* Initializes REQ as a request to transfer the CNT sectors of DEV
+   starting at SEC_NO to BUFFER, or from BUFFER if WRITE is true.
+   CNT must be between 1 and DISK_REQUEST_MAX_SECTORS.  REQ has no
+   callback; the caller may set one before submitting it. */
+void
+block_request_init (struct block_request *req, struct block_device *dev,
+		disk_sector_t sec_no, size_t cnt, void *buffer, bool write) {
+	ASSERT (req != NULL);
+	ASSERT (dev != NULL);
+	ASSERT (buffer != NULL);
+	ASSERT (cnt >= 1 && cnt <= DISK_REQUEST_MAX_SECTORS);
+	ASSERT (sec_no < dev->size && cnt <= dev->size - sec_no);
+
+	req->dev = dev;
+	req->sec_no = sec_no;
+	req->sec_cnt = cnt;
+	req->sec_done = 0;
+	req->buffer = buffer;
+	req->write = write;
+	sema_init (&req->done, 0);
+	req->callback = NULL;
+	req->aux = NULL;
+}
+
+/* Ticks a read or a write may wait in a driver's queue before it
+   goes ahead of requests of higher priority or nearer the head. */
+#define READ_EXPIRE (TIMER_FREQ / 4)
+#define WRITE_EXPIRE (TIMER_FREQ * 2)
+
+/* Hands REQ to its device's driver and returns without waiting for
+   the transfer.  Several requests may be outstanding at once.
+   Requests for the same sector complete in submission order.  A
+   request to a partition has its sector turned into the disk's.
+   REQ takes the running thread's priority, resource group and a
+   deadline, for drivers that queue requests to pick the next by. */
+void
+block_submit (struct block_request *req) {
+	struct block_device *dev = req->dev;
+	enum intr_level old_level;
+
+	trace (TRACE_DISK, dev->idx | (req->write ? TRACE_DISK_WRITE : 0),
+			req->sec_no, req->sec_cnt);
+	req->priority = thread_get_priority ();
+	req->deadline = timer_ticks () + (req->write ? WRITE_EXPIRE : READ_EXPIRE);
+	req->rgroup = thread_current ()->rgroup;
+	old_level = intr_disable ();
+	if (rgroup_active ())
+		rgroup_io_submitted (req->rgroup);
+	req->submit_tsc = rdtsc ();
+	stat_add (dev, req->write ? DISK_STAT_WRITES : DISK_STAT_READS, 1);
+	stat_add (dev, req->write ? DISK_STAT_WRITE_BYTES : DISK_STAT_READ_BYTES,
+			req->sec_cnt * DISK_SECTOR_SIZE);
+	stat_add (dev, req->sec_no == dev->next_sec
+			? DISK_STAT_SEQUENTIAL : DISK_STAT_RANDOM, 1);
+	dev->next_sec = req->sec_no + req->sec_cnt;
+	stat_add (dev, DISK_STAT_DEPTH_HIST
+			+ log2_bucket (++dev->depth, DISK_STAT_DEPTH_HIST_CNT), 1);
+
+	req->sec_no += dev->start;
+	dev->ops->submit (req);
+	intr_set_level (old_level);
+}
+
+/* Waits until REQ, which must have been submitted, completes.
+   REQ gets the waiting thread's priority if that is higher, so that
+   a request does not wait in the queue, for another thread's, behind
+   requests of threads of lower priority than its waiter. */
+void
+block_wait (struct block_request *req) {
+	enum intr_level old_level = intr_disable ();
+	int priority = thread_get_priority ();
+
+	if (req->priority < priority)
+		req->priority = priority;
+	intr_set_level (old_level);
+	sema_down (&req->done);
+}
+
+/* Completes REQ, which its driver has carried out in full: counts
+   its latency, then wakes its waiter and calls its callback.
+   Called by drivers with interrupts off, usually from their
+   interrupt handlers. */
+void
+block_request_complete (struct block_request *req) {
+	struct block_device *dev = req->dev;
+	uint64_t cycles = rdtsc () - req->submit_tsc;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	req->sec_done = req->sec_cnt;
+	dev->depth--;
+	stat_add (dev, DISK_STAT_CYCLES, cycles);
+	stat_add (dev, DISK_STAT_LAT_HIST
+			+ log2_bucket (cycles >> 11, DISK_STAT_LAT_HIST_CNT), 1);
+	if (cycles > dev->stats[DISK_STAT_MAX_CYCLES])
+		dev->stats[DISK_STAT_MAX_CYCLES] = cycles;
+
+	sema_up (&req->done);
+	if (req->callback != NULL)
+		req->callback (req);
+}
+
+/* Counts HIT_CNT sectors of DEV found in the buffer cache and
+   MISS_CNT that were not. */
+void
+block_count_cache (struct block_device *dev, size_t hit_cnt,
+		size_t miss_cnt) {
+	enum intr_level old_level = intr_disable ();
+
+	stat_add (dev, DISK_STAT_CACHE_HITS, hit_cnt);
+	stat_add (dev, DISK_STAT_CACHE_MISSES, miss_cnt);
+	intr_set_level (old_level);
+}
+
+/* Stores in STATS the statistics, DISK_STAT_*, of the device named
+   NAME.  Returns false if there is no such device. */
+bool
+block_read_stats (const char *name, uint64_t stats[DISK_STAT_CNT]) {
+	struct block_device *dev = block_get_by_name (name);
+	enum intr_level old_level;
+
+	if (dev == NULL)
+		return false;
+	old_level = intr_disable ();
+	memcpy (stats, dev->stats, DISK_STAT_CNT * sizeof *stats);
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Prints the statistics of each block device that had requests. */
+void
+block_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&devices); e != list_end (&devices); e = list_next (e))
+		print_block_stats (list_entry (e, struct block_device, elem));
+}
+
+/* Prints DEV's statistics, if it had requests: totals on one line,
+   then the nonzero buckets of each histogram, as bound and count. */
+static void
+print_block_stats (const struct block_device *dev) {
+	const uint64_t *stats = dev->stats;
+	uint64_t reqs = stats[DISK_STAT_READS] + stats[DISK_STAT_WRITES];
+	size_t b;
+
+	if (reqs == 0)
+		return;
+	printf ("%s: %"PRIu64" requests, %"PRIu64" bytes read, %"PRIu64
+			" written, %"PRIu64" sequential, %"PRIu64" random, "
+			"%"PRIu64" average and %"PRIu64" maximum cycles",
+			dev->name, reqs, stats[DISK_STAT_READ_BYTES],
+			stats[DISK_STAT_WRITE_BYTES], stats[DISK_STAT_SEQUENTIAL],
+			stats[DISK_STAT_RANDOM], stats[DISK_STAT_CYCLES] / reqs,
+			stats[DISK_STAT_MAX_CYCLES]);
+	if (stats[DISK_STAT_CACHE_HITS] + stats[DISK_STAT_CACHE_MISSES] != 0)
+		printf (", %"PRIu64" cache hits, %"PRIu64" misses",
+				stats[DISK_STAT_CACHE_HITS], stats[DISK_STAT_CACHE_MISSES]);
+	printf ("\n   latency");
+	for (b = 0; b < DISK_STAT_LAT_HIST_CNT; b++)
+		if (stats[DISK_STAT_LAT_HIST + b] != 0)
+			printf (" %s%zu:%"PRIu64, b == DISK_STAT_LAT_HIST_CNT - 1 ? ">" : "<",
+					b == DISK_STAT_LAT_HIST_CNT - 1 ? 11 + b : 12 + b,
+					stats[DISK_STAT_LAT_HIST + b]);
+	printf ("\n   depth");
+	for (b = 0; b < DISK_STAT_DEPTH_HIST_CNT; b++)
+		if (stats[DISK_STAT_DEPTH_HIST + b] != 0)
+			printf (" %s%zu:%"PRIu64,
+					b == DISK_STAT_DEPTH_HIST_CNT - 1 ? ">=" : "<",
+					(size_t) 1 << (b == DISK_STAT_DEPTH_HIST_CNT - 1 ? b : b + 1),
+					stats[DISK_STAT_DEPTH_HIST + b]);
+	printf ("\n");
+}
+
+/* Registers the primary partitions in DISK's MBR partition table,
+   if sector 0 holds one.  Empty and extended entries, and ones that
+   do not fit on DISK, are skipped. */
+static void
+scan_partitions (struct block_device *disk) {
+	uint8_t mbr[DISK_SECTOR_SIZE];
+	int i;
+
+	block_read (disk, 0, mbr);
+	if (mbr[510] != 0x55 || mbr[511] != 0xaa)
+		return;
+	for (i = 0; i < 4; i++) {
+		const uint8_t *e = mbr + 446 + 16 * i;
+		uint8_t type = e[4];
+		disk_sector_t start, size;
+
+		memcpy (&start, e + 8, sizeof start);
+		memcpy (&size, e + 12, sizeof size);
+		if (type == 0 || type == 0x05 || type == 0x0f || type == 0x85
+				|| start == 0 || size == 0 || start >= disk->size
+				|| size > disk->size - start)
+			continue;
+		printf ("%s: partition %d, %'"PRDSNu" sectors at %"PRDSNu
+				", type %#"PRIx8"\n", disk->name, i + 1, size, start, type);
+		block_register_partition (disk, i + 1, start, size);
+	}
+}
+
+/* Adds V to statistic IDX of DEV.  Interrupts must be off. */
+static void
+stat_add (struct block_device *dev, size_t idx, uint64_t v) {
+	dev->stats[idx] += v;
+}
+
+/* Returns the bucket of V in a histogram of CNT buckets by powers of
+   two: 0 for V under 2, I for V from 2**I up to 2**(I+1), the last
+   for all larger V. */
+static size_t
+log2_bucket (uint64_t v, size_t cnt) {
+	size_t bucket = 0;
+
+	while (v > 1 && bucket < cnt - 1) {
+		v >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
@@ -3,13 +3,20 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "devices/block.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/rgroup.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  Each disk found
+   is registered with the block layer, through which all of its
+   requests come. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +35,27 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE register port addresses, from the channel's part
+   of the controller's I/O space.  See [IDE-BM]. */
+#define reg_bm_cmd(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2) /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)   /* PRD table address. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start/stop the transfer. */
+#define BM_CMD_READ 0x08        /* Transfer direction: 1=to memory. */
+
+/* Bus master Status Register bits.  IRQ and ERR are cleared by
+   writing 1s. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERR 0x02         /* Transfer failed. */
+#define BM_STA_IRQ 0x04         /* Device raised its interrupt. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +71,27 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* A physical region descriptor: one physically contiguous part of
+   a DMA transfer's buffer, which must not cross a 64 kB boundary.
+   The table of a transfer ends with an entry flagged PRD_EOT. */
+struct prd {
+	uint32_t addr;              /* Physical address, even. */
+	uint16_t size;              /* Bytes, even; 0 means 64 kB. */
+	uint16_t flags;             /* PRD_EOT, or 0. */
+} __attribute__ ((packed));
+
+#define PRD_EOT 0x8000          /* Last entry of the table. */
+#define PRDT_CNT (PGSIZE / sizeof (struct prd))
+
+/* If true, disk data always moves by port I/O, even when the
+   controller can do bus-master DMA. */
+bool disk_pio;
 
 /* An ATA device. */
 struct disk {
@@ -56,6 +101,10 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	int multiple_cnt;           /* Sectors per interrupt for READ/WRITE
+								   MULTIPLE, or 0 if not supported. */
+	bool dma;                   /* True if READ/WRITE DMA is supported. */
+	struct block_device *block; /* Block device, if is_ata. */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
@@ -68,10 +117,27 @@ struct channel {
 	uint16_t reg_base;          /* Base I/O port. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+	struct intr_work work;      /* Deferred work of the interrupt. */
+
+	uint16_t bm_base;           /* Bus master registers, or 0 if none. */
+	struct prd *prdt;           /* PRD table, a page, if BM_BASE. */
+	bool dma;                   /* True if the active request is DMA. */
+
+	/* Request queue, protected by disabling interrupts.
+	   Pending requests are kept sorted by disk and sector.  Those of
+	   the highest rank, by priority and then reads before writes, are
+	   served in one-way elevator (C-LOOK) order, so that requests to
+	   adjacent sectors go out back to back, unless one has waited
+	   past its deadline; see start_next_request(). */
+	struct list queue;          /* Pending struct block_requests. */
+	struct block_request *active;   /* Request in flight, if any. */
+	int head_dev;               /* Device of the last dispatched request. */
+	disk_sector_t head_sec;     /* Sector of the last dispatched request. */
+
+	long long expired_cnt;      /* Requests started past their deadline. */
 
 	struct disk devices[2];     /* The devices on this channel. */
 };
@@ -84,21 +150,45 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void set_multiple_mode (struct disk *, int max_cnt);
+
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
+static bool poll_while_busy (const struct disk *);
 static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
+static bool request_less (const struct list_elem *,
+		const struct list_elem *, void *aux);
+static void start_next_request (struct channel *);
+static size_t block_sectors (const struct block_request *);
+static void output_block (struct channel *);
+static void request_interrupt (struct channel *);
+
 static void interrupt_handler (struct intr_frame *);
+static void channel_work (void *c_);
+
+static uint16_t find_bus_master (void);
+static bool build_prdt (struct channel *, const struct block_request *);
+static void start_dma (struct channel *);
+static void finish_dma (struct channel *);
+
+static void ata_submit (struct block_request *);
+static struct disk *ata_disk (const struct block_request *);
+
+static const struct block_operations ata_ops = {
+	.submit = ata_submit,
+};
 
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
+	uint16_t bm_base = disk_pio ? 0 : find_bus_master ();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -119,9 +209,23 @@ disk_init (void) {
 			default:
 				NOT_REACHED ();
 		}
-		lock_init (&c->lock);
 		c->expecting_interrupt = false;
 		sema_init (&c->completion_wait, 0);
+		intr_work_init (&c->work, channel_work, c);
+		list_init (&c->queue);
+		c->active = NULL;
+		c->head_dev = 0;
+		c->head_sec = 0;
+		c->expired_cnt = 0;
+		c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+		c->prdt = NULL;
+		c->dma = false;
+		if (c->bm_base != 0) {
+			c->prdt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+			ASSERT (vtop (c->prdt) <= UINT32_MAX);
+			printf ("%s: bus-master DMA at port %#"PRIx16"\n",
+					c->name, c->bm_base);
+		}
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -132,6 +236,9 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->multiple_cnt = 0;
+			d->dma = false;
+			d->block = NULL;
 
 			d->read_cnt = d->write_cnt = 0;
 		}
@@ -150,6 +257,16 @@ disk_init (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device (&c->devices[dev_no]);
+
+		/* Hand the disks to the block layer.  hd0:0 is the disk
+		   booted from. */
+		for (dev_no = 0; dev_no < 2; dev_no++) {
+			struct disk *d = &c->devices[dev_no];
+
+			if (d->is_ata)
+				d->block = block_register (d->name, d->capacity, &ata_ops, d,
+						chan_no == 0 && dev_no == 0 ? BLOCK_BOOT : 0);
+		}
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -164,6 +281,10 @@ disk_print_stats (void) {
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
 		int dev_no;
 
+		if (channels[chan_no].expired_cnt > 0)
+			printf ("%s: %lld requests past their deadline\n",
+					channels[chan_no].name, channels[chan_no].expired_cnt);
+
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
 			if (d != NULL && d->is_ata)
@@ -176,12 +297,7 @@ disk_print_stats (void) {
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
    slave, respectively--within the channel numbered CHAN_NO.
 
-   Pintos uses disks this way:
-0:0 - boot loader, command line args, and operating system kernel
-0:1 - file system
-1:0 - scratch
-1:1 - swap
-*/
+   The block layer, not this, says what each disk is used for. */
 struct disk *
 disk_get (int chan_no, int dev_no) {
 	ASSERT (dev_no == 0 || dev_no == 1);
@@ -194,62 +310,344 @@ disk_get (int chan_no, int dev_no) {
 	return NULL;
 }
 
-/* Returns the size of disk D, measured in DISK_SECTOR_SIZE-byte
-   sectors. */
-disk_sector_t
-disk_size (struct disk *d) {
-	ASSERT (d != NULL);
+/* Queues REQ, for an ATA disk, on the disk's channel.  The
+   interrupt handler starts each request as the previous one
+   finishes. */
+static void
+ata_submit (struct block_request *req) {
+	struct channel *c = ata_disk (req)->channel;
 
-	return d->capacity;
+	list_insert_ordered (&c->queue, &req->elem, request_less, NULL);
+	if (c->active == NULL)
+		start_next_request (c);
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for DISK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-void
-disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
+/* Returns the ATA disk of REQ, whose device may be a partition of
+   it. */
+static struct disk *
+ata_disk (const struct block_request *req) {
+	return req->dev->aux;
+}
 
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+/* Orders requests by device, then by sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct block_request *a = list_entry (a_, struct block_request, elem);
+	const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+	if (ata_disk (a)->dev_no != ata_disk (b)->dev_no)
+		return ata_disk (a)->dev_no < ata_disk (b)->dev_no;
+	return a->sec_no < b->sec_no;
+}
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
-}
-
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+/* Returns REQ's rank: its priority first, then reads, which a
+   thread usually waits for, above writes, which are often written
+   back in the background. */
+static int
+request_rank (const struct block_request *req) {
+	return req->priority * 2 + !req->write;
+}
 
-	ASSERT (d != NULL);
-	ASSERT (buffer != NULL);
+/* Returns the resource group furthest behind in its share of the
+   disks among those with requests of the highest rank queued on
+   channel C, which must have some. */
+static struct rgroup *
+queue_rgroup (struct channel *c) {
+	struct rgroup *group = NULL;
+	int rank = 0;
+	struct list_elem *e;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct block_request *r = list_entry (e, struct block_request, elem);
+		int r_rank = request_rank (r);
+
+		if (group == NULL || r_rank > rank
+				|| (r_rank == rank && rgroup_io_before (r->rgroup, group))) {
+			group = r->rgroup;
+			rank = r_rank;
+		}
+	}
+	return group;
+}
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+/* Starts the next request queued on channel C, if any.  That is the
+   one whose deadline passed first, if any did, so that none starves.
+   Otherwise it is, among requests of the highest rank, of the
+   resource group furthest behind if there are groups, the first one
+   at or past the position of the last dispatched request, or the
+   lowest one once the head has swept past the end.  Runs with
+   interrupts off, from thread context or from the interrupt
+   handler, so it must not sleep. */
+static void
+start_next_request (struct channel *c) {
+	struct block_request *req = NULL, *first = NULL, *expired = NULL;
+	struct rgroup *group = NULL;
+	int64_t now = timer_ticks ();
+	int rank = 0;
+	struct list_elem *e;
+	struct disk *d;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (c->active == NULL);
+
+	if (list_empty (&c->queue))
+		return;
+	if (rgroup_active ())
+		group = queue_rgroup (c);
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct block_request *r = list_entry (e, struct block_request, elem);
+		int r_rank = request_rank (r);
+
+		if (r->deadline <= now
+				&& (expired == NULL || r->deadline < expired->deadline))
+			expired = r;
+		if (group != NULL && r->rgroup != group)
+			continue;
+		if (first == NULL || r_rank > rank) {
+			/* A higher rank: start over among its requests. */
+			first = r;
+			req = NULL;
+			rank = r_rank;
+		} else if (r_rank < rank)
+			continue;
+		if (req == NULL && (ata_disk (r)->dev_no > c->head_dev
+					|| (ata_disk (r)->dev_no == c->head_dev
+						&& r->sec_no >= c->head_sec)))
+			req = r;
+	}
+	if (expired != NULL) {
+		req = expired;
+		c->expired_cnt++;
+	} else if (req == NULL)
+		req = first;
+
+	/* Requests for the same sectors go out in submission order. */
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct block_request *r = list_entry (e, struct block_request, elem);
+
+		if (r->submit_tsc < req->submit_tsc && ata_disk (r) == ata_disk (req)
+				&& r->sec_no < req->sec_no + req->sec_cnt
+				&& req->sec_no < r->sec_no + r->sec_cnt) {
+			req = r;
+			e = list_head (&c->queue);
+		}
+	}
+	list_remove (&req->elem);
+	rgroup_io_charge (req->rgroup, req->sec_cnt);
+
+	d = ata_disk (req);
+	c->active = req;
+	c->head_dev = d->dev_no;
+	c->head_sec = req->sec_no;
+
+	/* With DMA the disk interrupts once the whole request is done.
+	   Without, it interrupts once per block of MULTIPLE_CNT sectors
+	   with multiple mode, otherwise once per sector. */
+	c->dma = d->dma && c->prdt != NULL && build_prdt (c, req);
+	if (c->dma) {
+		start_dma (c);
+		return;
+	}
+	select_sector (d, req->sec_no, req->sec_cnt);
+	c->expecting_interrupt = true;
+	if (!req->write)
+		outb (reg_command (c), d->multiple_cnt > 0
+				? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+	else {
+		outb (reg_command (c), d->multiple_cnt > 0
+				? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+		output_block (c);
+	}
 }
-
+
+/* Returns the number of sectors of REQ moved by its next data
+   transfer block. */
+static size_t
+block_sectors (const struct block_request *req) {
+	struct disk *d = ata_disk (req);
+	size_t left = req->sec_cnt - req->sec_done;
+	size_t block = d->multiple_cnt > 0 ? d->multiple_cnt : 1;
+
+	return left < block ? left : block;
+}
+
+/* Waits for channel C's active write request to ask for data and
+   sends it the next block. */
+static void
+output_block (struct channel *c) {
+	struct block_request *req = c->active;
+	struct disk *d = ata_disk (req);
+	size_t n = block_sectors (req);
+	size_t i;
+
+	if (!poll_while_busy (d))
+		PANIC ("%s: disk write failed, sector=%"PRDSNu,
+				d->name, req->sec_no + (disk_sector_t) req->sec_done);
+	for (i = 0; i < n; i++)
+		output_sector (c, (uint8_t *) req->buffer
+				+ (req->sec_done + i) * DISK_SECTOR_SIZE);
+	req->sec_done += n;
+	d->write_cnt += n;
+}
+
+/* Handles an interrupt for channel C's active request.  For a read,
+   the interrupt means a block is ready to be read in; for a write,
+   that the previous block has been taken.  Once the whole request
+   is done, completes it and starts the next one.  Runs as the
+   interrupt's deferred work, moving data with interrupts on: no
+   thread runs meanwhile to touch the request or the channel, and
+   only the hand-off to the next request turns interrupts off. */
+static void
+request_interrupt (struct channel *c) {
+	struct block_request *req = c->active;
+	struct disk *d = ata_disk (req);
+	enum intr_level old_level;
+
+	if (c->dma)
+		finish_dma (c);
+	else if (!req->write) {
+		size_t n = block_sectors (req);
+		size_t i;
+
+		if (!poll_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu,
+					d->name, req->sec_no + (disk_sector_t) req->sec_done);
+		for (i = 0; i < n; i++)
+			input_sector (c, (uint8_t *) req->buffer
+					+ (req->sec_done + i) * DISK_SECTOR_SIZE);
+		req->sec_done += n;
+		d->read_cnt += n;
+	}
+
+	/* More blocks to go: the next interrupt will be for this
+	   request too. */
+	if (req->sec_done < req->sec_cnt) {
+		c->expecting_interrupt = true;
+		if (req->write)
+			output_block (c);
+		return;
+	}
+
+	old_level = intr_disable ();
+	c->active = NULL;
+	start_next_request (c);
+	block_request_complete (req);
+	intr_set_level (old_level);
+}
+
+/* Fills in channel C's PRD table for REQ's buffer, merging
+   physically contiguous pages.  Returns false if the buffer cannot
+   be described to the controller: odd, above 4 GB, or in too many
+   pieces.  Channel C must not have a DMA transfer in progress. */
+static bool
+build_prdt (struct channel *c, const struct block_request *req) {
+	uint8_t *p = req->buffer;
+	size_t left = req->sec_cnt * DISK_SECTOR_SIZE;
+	size_t n = 0;
+	size_t size = 0;            /* Of entry N - 1, in bytes. */
+
+	if ((uintptr_t) p & 1)
+		return false;
+	while (left > 0) {
+		uint64_t pa = vtop (p);
+		size_t chunk = PGSIZE - pg_ofs (p);
+
+		if (chunk > left)
+			chunk = left;
+		if (pa + chunk - 1 > UINT32_MAX)
+			return false;
+
+		if (n > 0 && c->prdt[n - 1].addr + size == pa
+				&& (pa + chunk - 1) >> 16 == c->prdt[n - 1].addr >> 16)
+			size += chunk;
+		else {
+			if (n == PRDT_CNT)
+				return false;
+			c->prdt[n].addr = pa;
+			c->prdt[n].flags = 0;
+			size = chunk;
+			n++;
+		}
+		c->prdt[n - 1].size = size & 0xffff;
+		p += chunk;
+		left -= chunk;
+	}
+	c->prdt[n - 1].flags = PRD_EOT;
+	return true;
+}
+
+/* Starts channel C's active request as a DMA transfer, with its PRD
+   table built. */
+static void
+start_dma (struct channel *c) {
+	struct block_request *req = c->active;
+
+	outl (reg_bm_prdt (c), vtop (c->prdt));
+	outb (reg_bm_cmd (c), req->write ? 0 : BM_CMD_READ);
+	outb (reg_bm_status (c),
+			inb (reg_bm_status (c)) | BM_STA_IRQ | BM_STA_ERR);
+	select_sector (ata_disk (req), req->sec_no, req->sec_cnt);
+	c->expecting_interrupt = true;
+	outb (reg_command (c), req->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb (reg_bm_cmd (c), inb (reg_bm_cmd (c)) | BM_CMD_START);
+}
+
+/* Stops the DMA transfer of channel C's active request, which the
+   disk has just signaled is done, and marks all of it
+   transferred. */
+static void
+finish_dma (struct channel *c) {
+	struct block_request *req = c->active;
+	struct disk *d = ata_disk (req);
+	uint8_t status = inb (reg_bm_status (c));
+
+	outb (reg_bm_cmd (c), inb (reg_bm_cmd (c)) & ~BM_CMD_START);
+	outb (reg_bm_status (c), status | BM_STA_IRQ | BM_STA_ERR);
+	if ((status & BM_STA_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+		PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+				d->name, req->write ? "write" : "read", req->sec_no);
+
+	req->sec_done = req->sec_cnt;
+	if (req->write)
+		d->write_cnt += req->sec_cnt;
+	else
+		d->read_cnt += req->sec_cnt;
+}
+
+/* Returns the base I/O port of the bus master registers of the
+   first IDE controller on PCI bus 0 that can do bus-master DMA with
+   both channels at the legacy ports, turning on its bus mastering.
+   Returns 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void) {
+	struct pci_func f = PCI_START;
+
+	while (pci_next (&f)) {
+		uint32_t class = pci_read_config (&f, PCI_REG_CLASS);
+		uint32_t bar4;
+
+		/* Class 1 (mass storage), subclass 1 (IDE), with the bus
+		   master bit and no native-mode channel in the programming
+		   interface. */
+		if ((class >> 16) != 0x0101 || !(class & 0x8000)
+				|| (class & 0x0500))
+			continue;
+		bar4 = pci_read_config (&f, PCI_REG_BAR4);
+		if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+			continue;
+
+		pci_write_config (&f, PCI_REG_COMMAND,
+				pci_read_config (&f, PCI_REG_COMMAND)
+				| PCI_CMD_IO | PCI_CMD_MASTER);
+		return bar4 & 0xfffc;
+	}
+	return 0;
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -380,6 +778,37 @@ identify_ata_device (struct disk *d) {
 	printf ("\", serial \"");
 	print_ata_string ((char *) &id[10], 20);
 	printf ("\"\n");
+
+	/* Word 47 holds the largest block size READ/WRITE MULTIPLE
+	   supports, or 0 if they are not supported. */
+	set_multiple_mode (d, id[47] & 0xff);
+
+	/* Bit 8 of word 49 tells whether READ/WRITE DMA are supported. */
+	d->dma = (id[49] & 0x0100) != 0;
+}
+
+/* Enables multiple mode on disk D with the largest power-of-2 block
+   size up to MAX_CNT sectors, and records it in D's multiple_cnt.
+   Leaves multiple mode off if MAX_CNT is 0 or the disk rejects the
+   command. */
+static void
+set_multiple_mode (struct disk *d, int max_cnt) {
+	struct channel *c = d->channel;
+	int cnt;
+
+	d->multiple_cnt = 0;
+	if (max_cnt <= 1)
+		return;
+	for (cnt = 1; cnt * 2 <= max_cnt; cnt *= 2)
+		continue;
+
+	select_device_wait (d);
+	outb (reg_nsect (c), cnt);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	wait_while_busy (d);
+	if (!(inb (reg_alt_status (c)) & STA_ERR))
+		d->multiple_cnt = cnt;
 }
 
 /* Prints STRING, which consists of SIZE bytes in a funky format:
@@ -402,17 +831,18 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and sector
+   count registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
 	ASSERT (sec_no < d->capacity);
 	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt >= 1 && cnt <= DISK_REQUEST_MAX_SECTORS);
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_REQUEST_MAX_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -421,7 +851,8 @@ select_sector (struct disk *d, disk_sector_t sec_no) {
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt.  Used only for commands that bypass the
+   request queue. */
 static void
 issue_pio_command (struct channel *c, uint8_t command) {
 	/* Interrupts must be enabled or our semaphore will never be
@@ -460,7 +891,7 @@ wait_until_idle (const struct disk *d) {
 	for (i = 0; i < 1000; i++) {
 		if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
 			return;
-		timer_usleep (10);
+		timer_udelay (10);
 	}
 
 	printf ("%s: idle timeout\n", d->name);
@@ -490,6 +921,25 @@ wait_while_busy (const struct disk *d) {
 	return false;
 }
 
+/* Like wait_while_busy(), but spins instead of sleeping, for use
+   with interrupts off.  Gives up after about 10 ms, which is far
+   longer than a disk that has just raised an interrupt or accepted
+   a command takes to clear BSY. */
+static bool
+poll_while_busy (const struct disk *d) {
+	struct channel *c = d->channel;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		if (!(inb (reg_alt_status (c)) & STA_BSY))
+			return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
+		timer_udelay (10);
+	}
+
+	printf ("%s: busy timeout\n", d->name);
+	return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct disk *d) {
@@ -499,7 +949,7 @@ select_device (const struct disk *d) {
 		dev |= DEV_DEV;
 	outb (reg_device (c), dev);
 	inb (reg_alt_status (c));
-	timer_nsleep (400);
+	timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -520,7 +970,8 @@ interrupt_handler (struct intr_frame *f) {
 		if (f->vec_no == c->irq) {
 			if (c->expecting_interrupt) {
 				inb (reg_status (c));               /* Acknowledge interrupt. */
-				sema_up (&c->completion_wait);      /* Wake up waiter. */
+				c->expecting_interrupt = false;
+				intr_defer (&c->work);              /* Do the rest later. */
 			} else
 				printf ("%s: unexpected interrupt\n", c->name);
 			return;
@@ -529,6 +980,19 @@ interrupt_handler (struct intr_frame *f) {
 	NOT_REACHED ();
 }
 
+/* Deferred work of channel C's interrupt: carries on with the active
+   request, or wakes the thread waiting for a command outside of
+   one. */
+static void
+channel_work (void *c_) {
+	struct channel *c = c_;
+
+	if (c->active != NULL)
+		request_interrupt (c);          /* Chain to next request. */
+	else
+		sema_up (&c->completion_wait);  /* Wake up waiter. */
+}
+
 static void
 inspect_read_cnt (struct intr_frame *f) {
 	struct disk * d = disk_get (f->R.rdx, f->R.rcx);
@@ -2,14 +2,32 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/waitq.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* Line discipline.  A reader of a line sleeps until the buffer has a
+   whole line, or as many keys as it asked for, and is woken once
+   then, rather than for every key.  Interrupts must be off to use
+   these. */
+static size_t line_ends;            /* Line-ending keys in buffer. */
+static struct thread *reader;       /* Thread waiting for a line. */
+static size_t reader_want;          /* Keys it asked for. */
+static struct lock reader_lock;     /* Lets only one thread wait. */
+static struct waitq pollers;        /* Woken as keys arrive, for poll(). */
+
+static bool is_line_end (uint8_t key);
+static void keys_added (const uint8_t *keys, size_t size);
+
 /* Initializes the input buffer. */
 void
 input_init (void) {
 	intq_init (&buffer);
+	lock_init (&reader_lock);
+	waitq_init (&pollers);
 }
 
 /* Adds a key to the input buffer.
@@ -20,6 +38,21 @@ input_putc (uint8_t key) {
 	ASSERT (!intq_full (&buffer));
 
 	intq_putc (&buffer, key);
+	keys_added (&key, 1);
+	serial_notify ();
+}
+
+/* Adds the SIZE keys in KEYS to the input buffer.
+   Interrupts must be off and the buffer must have room for them. */
+void
+input_putbuf (const uint8_t *keys, size_t size) {
+	size_t cnt;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	cnt = intq_put_bulk (&buffer, keys, size);
+	ASSERT (cnt == size);
+	keys_added (keys, size);
 	serial_notify ();
 }
 
@@ -32,12 +65,52 @@ input_getc (void) {
 
 	old_level = intr_disable ();
 	key = intq_getc (&buffer);
+	if (is_line_end (key))
+		line_ends--;
 	serial_notify ();
 	intr_set_level (old_level);
 
 	return key;
 }
 
+/* Retrieves a line of at most SIZE keys from the input buffer into
+   KEYS and returns the number retrieved.  Waits until the buffer
+   holds a line-ending key or SIZE keys, or is full, then takes the
+   keys through the first line ending, or SIZE keys if there is no
+   line ending among them. */
+size_t
+input_getline (uint8_t *keys, size_t size) {
+	enum intr_level old_level;
+	size_t cnt = 0;
+
+	if (size == 0)
+		return 0;
+
+	lock_acquire (&reader_lock);
+	old_level = intr_disable ();
+	while (line_ends == 0 && INTQ_BUFSIZE - 1 - intq_room (&buffer) < size
+			&& !intq_full (&buffer)) {
+		reader = thread_current ();
+		reader_want = size;
+		thread_block ();
+	}
+
+	if (line_ends == 0)
+		cnt = intq_get_bulk (&buffer, keys, size);
+	else {
+		do
+			keys[cnt] = intq_getc (&buffer);
+		while (!is_line_end (keys[cnt++]) && cnt < size);
+		if (is_line_end (keys[cnt - 1]))
+			line_ends--;
+	}
+	serial_notify ();
+	intr_set_level (old_level);
+	lock_release (&reader_lock);
+
+	return cnt;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
@@ -46,3 +119,54 @@ input_full (void) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	return intq_full (&buffer);
 }
+
+/* Returns the number of keys the input buffer has room for.
+   Interrupts must be off. */
+size_t
+input_room (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	return intq_room (&buffer);
+}
+
+/* Returns true if input_getline() would not wait, as the buffer
+   holds a whole line or is full.  If E is not null, first adds it,
+   for P, to the wait queue woken as keys arrive. */
+bool
+input_poll (struct poller *p, struct waitq_entry *e) {
+	enum intr_level old_level = intr_disable ();
+	bool ready;
+
+	if (e != NULL)
+		poller_add (p, e, &pollers);
+	ready = line_ends > 0 || intq_full (&buffer);
+	intr_set_level (old_level);
+	return ready;
+}
+
+/* Returns true if KEY ends a line: newline or return from the serial
+   port or keyboard, or the null key that ends input. */
+static bool
+is_line_end (uint8_t key) {
+	return key == '\n' || key == '\r' || key == '\0';
+}
+
+/* Accounts for the SIZE keys in KEYS just added to the buffer, and
+   wakes the waiting reader if it now has what it waits for. */
+static void
+keys_added (const uint8_t *keys, size_t size) {
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (is_line_end (keys[i]))
+			line_ends++;
+
+	if (line_ends > 0 || intq_full (&buffer))
+		waitq_wake (&pollers);
+	if (reader != NULL
+			&& (line_ends > 0
+				|| INTQ_BUFSIZE - 1 - intq_room (&buffer) >= reader_want
+				|| intq_full (&buffer))) {
+		thread_unblock (reader);
+		reader = NULL;
+	}
+}
@@ -1,5 +1,6 @@
 #include "devices/intq.h"
 #include <debug.h>
+#include <string.h>
 #include "threads/thread.h"
 
 static int next (int pos);
@@ -28,6 +29,14 @@ intq_full (const struct intq *q) {
 	return next (q->head) == q->tail;
 }
 
+/* Returns the number of bytes that may be added to Q before it is
+   full. */
+size_t
+intq_room (const struct intq *q) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	return (q->tail - q->head - 1 + INTQ_BUFSIZE) % INTQ_BUFSIZE;
+}
+
 /* Removes a byte from Q and returns it.
    Q must not be empty if called from an interrupt handler.
    Otherwise, if Q is empty, first sleeps until a byte is
@@ -69,6 +78,57 @@ intq_putc (struct intq *q, uint8_t byte) {
 	signal (q, &q->not_empty);
 }
 
+/* Removes up to SIZE bytes from Q into BUF, without sleeping, and
+   returns the number removed, which is 0 if Q is empty.  May be
+   called from an interrupt handler. */
+size_t
+intq_get_bulk (struct intq *q, void *buf_, size_t size) {
+	uint8_t *buf = buf_;
+	size_t cnt = 0;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	while (cnt < size && !intq_empty (q)) {
+		/* Bytes from the tail up to the head or the buffer's end. */
+		size_t run = (q->head > q->tail ? q->head : INTQ_BUFSIZE) - q->tail;
+
+		if (run > size - cnt)
+			run = size - cnt;
+		memcpy (buf + cnt, q->buf + q->tail, run);
+		q->tail = (q->tail + run) % INTQ_BUFSIZE;
+		cnt += run;
+	}
+	if (cnt > 0)
+		signal (q, &q->not_full);
+	return cnt;
+}
+
+/* Adds as many of the SIZE bytes in BUF to the end of Q as fit,
+   without sleeping, and returns the number added, which is 0 if Q is
+   full.  May be called from an interrupt handler. */
+size_t
+intq_put_bulk (struct intq *q, const void *buf_, size_t size) {
+	const uint8_t *buf = buf_;
+	size_t cnt = 0;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	while (cnt < size && !intq_full (q)) {
+		/* Free bytes from the head up to the tail, less the one
+		   that tells a full queue from an empty one, or up to the
+		   buffer's end. */
+		size_t run = q->tail > q->head ? q->tail - 1 - q->head
+			: INTQ_BUFSIZE - q->head - (q->tail == 0);
+
+		if (run > size - cnt)
+			run = size - cnt;
+		memcpy (q->buf + q->head, buf + cnt, run);
+		q->head = (q->head + run) % INTQ_BUFSIZE;
+		cnt += run;
+	}
+	if (cnt > 0)
+		signal (q, &q->not_empty);
+	return cnt;
+}
+
 /* Returns the position after POS within an intq. */
 static int
 next (int pos) {
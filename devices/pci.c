@@ -0,0 +1,49 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* The code in this file reads and writes the configuration space
+   of PCI functions through configuration mechanism #1 [PCI]. */
+
+/* Configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+static void select_config (const struct pci_func *, int reg);
+
+/* Advances F to the next function present on bus 0, or to the
+   first one if F is PCI_START.  Returns false if there are no more
+   functions. */
+bool
+pci_next (struct pci_func *f) {
+	for (;;) {
+		if (++f->func == 8) {
+			f->func = 0;
+			if (++f->dev == 32)
+				return false;
+		}
+		if ((pci_read_config (f, PCI_REG_ID) & 0xffff) != 0xffff)
+			return true;
+	}
+}
+
+/* Returns the 32-bit register REG of F's configuration space. */
+uint32_t
+pci_read_config (const struct pci_func *f, int reg) {
+	select_config (f, reg);
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register REG of F's configuration
+   space. */
+void
+pci_write_config (const struct pci_func *f, int reg, uint32_t value) {
+	select_config (f, reg);
+	outl (PCI_CONFIG_DATA, value);
+}
+
+/* Points the configuration data port at register REG of F. */
+static void
+select_config (const struct pci_func *f, int reg) {
+	outl (PCI_CONFIG_ADDR, 0x80000000u | f->dev << 11 | f->func << 8
+			| (reg & 0xfc));
+}
@@ -0,0 +1,74 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk: a block device "ram0" kept in kernel pool pages,
+   which may stand in for a missing disk in any role.  Its contents
+   are zero at boot and lost at shutdown.  It takes requests
+   synchronously, completing each one as it is submitted. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Size of the RAM disk in MB, or 0 for none. */
+size_t ramdisk_mb;
+
+static uint8_t **pages;         /* Pages holding the disk's contents. */
+static size_t page_cnt;
+
+static void ramdisk_submit (struct block_request *);
+
+static const struct block_operations ramdisk_ops = {
+	.submit = ramdisk_submit,
+};
+
+/* Makes the RAM disk of ramdisk_mb MB, if any, and registers it
+   with the block layer.  Panics if there is not enough memory. */
+void
+ramdisk_init (void) {
+	size_t i;
+
+	if (ramdisk_mb == 0)
+		return;
+
+	page_cnt = ramdisk_mb * (1024 * 1024 / PGSIZE);
+	pages = calloc (page_cnt, sizeof *pages);
+	if (pages == NULL)
+		PANIC ("ramdisk: out of memory for %zu MB", ramdisk_mb);
+	for (i = 0; i < page_cnt; i++) {
+		pages[i] = palloc_get_page (PAL_ZERO);
+		if (pages[i] == NULL)
+			PANIC ("ramdisk: out of memory for %zu MB", ramdisk_mb);
+	}
+
+	block_register ("ram0", page_cnt * SECTORS_PER_PAGE, &ramdisk_ops, NULL,
+			BLOCK_FALLBACK);
+	printf ("ram0: %zu MB RAM disk\n", ramdisk_mb);
+}
+
+/* Moves REQ's sectors between its buffer and the pages, then
+   completes it. */
+static void
+ramdisk_submit (struct block_request *req) {
+	uint8_t *buffer = req->buffer;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	for (; req->sec_done < req->sec_cnt; req->sec_done++) {
+		disk_sector_t sec_no = req->sec_no + req->sec_done;
+		uint8_t *sector = pages[sec_no / SECTORS_PER_PAGE]
+			+ sec_no % SECTORS_PER_PAGE * DISK_SECTOR_SIZE;
+		uint8_t *data = buffer + req->sec_done * DISK_SECTOR_SIZE;
+
+		if (req->write)
+			memcpy (sector, data, DISK_SECTOR_SIZE);
+		else
+			memcpy (data, sector, DISK_SECTOR_SIZE);
+	}
+	block_request_complete (req);
+}
@@ -33,6 +33,13 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable the FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear the receive and transmit FIFOs. */
+
+/* Bytes each FIFO holds. */
+#define FIFO_SIZE 16
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -86,6 +93,8 @@ serial_init_queue (void) {
 	ASSERT (mode == POLL);
 
 	intr_register_ext (0x20 + 4, serial_interrupt, "serial");
+	/* Each transmit interrupt then sends a FIFO's worth of bytes. */
+	outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);
 	mode = QUEUE;
 	old_level = intr_disable ();
 	write_ier ();
@@ -95,27 +104,48 @@ serial_init_queue (void) {
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) {
+	serial_putbuf (&byte, 1);
+}
+
+/* Sends the SIZE bytes in BUFFER to the serial port. */
+void
+serial_putbuf (const void *buffer, size_t size) {
+	const uint8_t *buf = buffer;
 	enum intr_level old_level = intr_disable ();
 
 	if (mode != QUEUE) {
 		/* If we're not set up for interrupt-driven I/O yet,
-		   use dumb polling to transmit a byte. */
+		   use dumb polling to transmit the bytes. */
 		if (mode == UNINIT)
 			init_poll ();
-		putc_poll (byte);
+		while (size-- > 0)
+			putc_poll (*buf++);
 	} else {
-		/* Otherwise, queue a byte and update the interrupt enable
-		   register. */
-		if (old_level == INTR_OFF && intq_full (&txq)) {
-			/* Interrupts are off and the transmit queue is full.
-			   If we wanted to wait for the queue to empty,
-			   we'd have to reenable interrupts.
-			   That's impolite, so we'll send a character via
-			   polling instead. */
-			putc_poll (intq_getc (&txq));
+		/* Otherwise, queue as much as fits at a time, and update
+		   the interrupt enable register once it is all in. */
+		while (size > 0) {
+			size_t cnt = intq_put_bulk (&txq, buf, size);
+
+			buf += cnt;
+			size -= cnt;
+			if (size == 0)
+				break;
+
+			if (old_level == INTR_OFF) {
+				/* Interrupts are off and the transmit queue is full.
+				   If we wanted to wait for the queue to empty,
+				   we'd have to reenable interrupts.
+				   That's impolite, so we'll send a character via
+				   polling instead. */
+				putc_poll (intq_getc (&txq));
+			} else {
+				/* Let the interrupt handler drain the queue while
+				   we wait for room for the next byte. */
+				write_ier ();
+				intq_putc (&txq, *buf++);
+				size--;
+			}
 		}
-
-		intq_putc (&txq, byte);
 		write_ier ();
 	}
 
@@ -200,15 +230,27 @@ serial_interrupt (struct intr_frame *f UNUSED) {
 	   occasionally miss an interrupt running under QEMU. */
 	inb (IIR_REG);
 
+	uint8_t burst[FIFO_SIZE];
+	size_t cnt;
+
 	/* As long as we have room to receive a byte, and the hardware
-	   has a byte for us, receive a byte.  */
-	while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
-		input_putc (inb (RBR_REG));
-
-	/* As long as we have a byte to transmit, and the hardware is
-	   ready to accept a byte for transmission, transmit a byte. */
-	while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
-		outb (THR_REG, intq_getc (&txq));
+	   has a byte for us, receive a byte, handing them to the input
+	   buffer a FIFO's worth at a time.  */
+	do {
+		cnt = 0;
+		while (cnt < FIFO_SIZE && input_room () > cnt
+				&& (inb (LSR_REG) & LSR_DR) != 0)
+			burst[cnt++] = inb (RBR_REG);
+		if (cnt > 0)
+			input_putbuf (burst, cnt);
+	} while (cnt == FIFO_SIZE);
+
+	/* If the hardware is ready to accept bytes for transmission,
+	   fill its FIFO from the ones we have. */
+	if ((inb (LSR_REG) & LSR_THRE) != 0) {
+		cnt = intq_get_bulk (&txq, burst, FIFO_SIZE);
+		outsb (THR_REG, burst, cnt);
+	}
 
 	/* Update interrupt enable register based on queue status. */
 	write_ier ();
@@ -3,8 +3,11 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "intrinsic.h"
+#include "threads/apic.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -20,32 +23,115 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* 8254 input cycles per timer tick, rounded to nearest. */
+#define PIT_HZ 1193180
+#define PIT_PERIOD ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Dynamic ticks: while the idle thread waits with no event due, the
+   PIT is set to interrupt only when the next one is, and the ticks
+   skipped are accounted for on wake.  Set with -tickless. */
+bool timer_tickless;
+
+/* Nonzero while counter 0 is not programmed for PIT_PERIOD: the
+   count remaining then ends TICKLESS_TICKS ticks.  The first tick of
+   them ends TICKLESS_FIRST cycles after TICKLESS_COUNT was written,
+   the others PIT_PERIOD cycles apart. */
+static int tickless_ticks;
+
+/* Drive the timer with the local APIC rather than the 8254, if it
+   has x2APIC mode.  Dynamic ticks then stay off, as they program the
+   8254.  Set with -apic. */
+bool timer_apic;
+static unsigned tickless_first;
+static unsigned tickless_count;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+#define NS_PER_TICK (1000000000 / TIMER_FREQ)
+
+/* Time-stamp counter cycles per second, read from CPUID or else
+   measured against the PIT by timer_calibrate(), or 0 before or if
+   the CPU has no TSC.
+   timer_ns() was TSC_BASE_NS when the TSC read TSC_BASE, and the
+   last tick began when it read TICK_TSC. */
+#define TSC_CALIBRATE_TICKS 4
+static uint64_t tsc_hz;
+static uint64_t tsc_base;
+static int64_t tsc_base_ns;
+static uint64_t tick_tsc;
+
+/* Hierarchical timer wheel holding the pending timer_events.
+   Slot S of level L holds the events due in the tick range whose
+   bits WHEEL_BITS * L and up select S, so level 0 has one slot per
+   tick for the next WHEEL_SIZE ticks, level 1 one slot per
+   WHEEL_SIZE ticks, and so on.  Each time a level's index wraps,
+   the current slot of the level above is cascaded down.  Adding
+   and canceling an event take constant time, and a tick only
+   touches the events that fire or cascade on it, however many
+   are pending. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Last tick the wheel has processed.  The timer interrupt only
+   counts ticks and leaves the wheel to deferred work, which goes
+   through it an event at a time: CASCADE holds the events of the
+   slots being cascaded down, and the level 0 slot of WHEEL_TICKS
+   those left to fire.  So interrupts are never off for longer than
+   filing or firing a single event takes. */
+static int64_t wheel_ticks;
+static struct list cascade;
+static struct intr_work wheel_work;
+
+/* Events timer_event_add_slack() put off past their deadline, to
+   fire together with others. */
+static unsigned long long slack_deferred;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
+static unsigned tsc_loops_per_tick (void);
+static uint64_t tsc_hz_cpuid (void);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void real_time_delay (int64_t num, int32_t denom);
+static void tsc_calibrate (void);
+static void apic_timer_start (void);
+static int64_t tsc_to_ns (uint64_t cycles);
+static void tsc_spin_until (int64_t ns);
+static void tsc_sleep (int64_t ns);
+static void wheel_insert (struct timer_event *, int64_t expires);
+static bool wheel_step (void);
+static void wheel_run (void *aux UNUSED);
+static void timer_tick (void);
+static void pit_program (unsigned count);
+static unsigned pit_read (void);
+static bool pit_irq_pending (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void
 timer_init (void) {
-	/* 8254 input frequency divided by TIMER_FREQ, rounded to
-	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+	int level, slot;
 
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		for (slot = 0; slot < WHEEL_SIZE; slot++)
+			list_init (&wheel[level][slot]);
+	list_init (&cascade);
+	intr_work_init (&wheel_work, wheel_run, NULL);
+
+	pit_program (PIT_PERIOD);
 
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   the TSC.  With the TSC's rate known, a few short loops timed on it
+   give loops_per_tick; only without a TSC does it take the search
+   below, which spins for some 20 timer ticks. */
 void
 timer_calibrate (void) {
 	unsigned high_bit, test_bit;
@@ -53,21 +139,142 @@ timer_calibrate (void) {
 	ASSERT (intr_get_level () == INTR_ON);
 	printf ("Calibrating timer...  ");
 
-	/* Approximate loops_per_tick as the largest power-of-two
-	   still less than one timer tick. */
-	loops_per_tick = 1u << 10;
-	while (!too_many_loops (loops_per_tick << 1)) {
-		loops_per_tick <<= 1;
-		ASSERT (loops_per_tick != 0);
-	}
+	tsc_calibrate ();
+	if (tsc_hz != 0)
+		loops_per_tick = tsc_loops_per_tick ();
+	else {
+		/* Approximate loops_per_tick as the largest power-of-two
+		   still less than one timer tick. */
+		loops_per_tick = 1u << 10;
+		while (!too_many_loops (loops_per_tick << 1)) {
+			loops_per_tick <<= 1;
+			ASSERT (loops_per_tick != 0);
+		}
 
-	/* Refine the next 8 bits of loops_per_tick. */
-	high_bit = loops_per_tick;
-	for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-		if (!too_many_loops (high_bit | test_bit))
-			loops_per_tick |= test_bit;
+		/* Refine the next 8 bits of loops_per_tick. */
+		high_bit = loops_per_tick;
+		for (test_bit = high_bit >> 1; test_bit != high_bit >> 10;
+				test_bit >>= 1)
+			if (!too_many_loops (high_bit | test_bit))
+				loops_per_tick |= test_bit;
+	}
 
 	printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+	if (timer_apic)
+		apic_timer_start ();
+}
+
+/* Moves the timer interrupt from the 8254 to the local APIC timer,
+   set to the rate of the 8254's ticks as measured over
+   TSC_CALIBRATE_TICKS of them. */
+static void
+apic_timer_start (void) {
+	enum intr_level old_level;
+	uint32_t count;
+	int64_t start;
+
+	if (!apic_init ()) {
+		printf ("No x2APIC: timer stays on the 8254.\n");
+		return;
+	}
+
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	apic_timer_oneshot (UINT32_MAX);
+	start = ticks;
+	while (ticks - start < TSC_CALIBRATE_TICKS)
+		barrier ();
+	count = (UINT32_MAX - apic_timer_count ()) / TSC_CALIBRATE_TICKS;
+	if (count == 0) {
+		printf ("Local APIC timer does not count: timer stays on the 8254.\n");
+		return;
+	}
+
+	old_level = intr_disable ();
+	timer_tickless = false;
+	intr_mask_ext (0x20);
+	apic_timer_active = true;
+	apic_timer_periodic (0x20, count);
+	intr_set_level (old_level);
+	printf ("Timer on the local APIC, %'"PRIu32" counts per tick.\n", count);
+}
+
+/* Sets tsc_hz, from CPUID if it tells, or else measured over
+   TSC_CALIBRATE_TICKS timer ticks, and anchors the TSC on a tick so
+   that timer_ns() goes on from timer_ticks(). */
+static void
+tsc_calibrate (void) {
+	uint32_t eax, ebx, ecx, edx;
+	uint64_t start_tsc, end_tsc, hz;
+	enum intr_level old_level;
+	int64_t start;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (!(edx & (1 << 4)))
+		return;
+
+	hz = tsc_hz_cpuid ();
+	if (hz != 0) {
+		/* TICK_TSC is when the last tick came, once one has. */
+		while (ticks == 0)
+			barrier ();
+		old_level = intr_disable ();
+		tsc_base = tick_tsc;
+		tsc_base_ns = ticks * NS_PER_TICK;
+		barrier ();
+		tsc_hz = hz;
+		intr_set_level (old_level);
+		return;
+	}
+
+	start = ticks;
+	while (ticks == start)
+		barrier ();
+	start_tsc = rdtsc ();
+	start = ticks;
+	while (ticks - start < TSC_CALIBRATE_TICKS)
+		barrier ();
+	end_tsc = rdtsc ();
+
+	tsc_base = end_tsc;
+	tsc_base_ns = (start + TSC_CALIBRATE_TICKS) * NS_PER_TICK;
+	barrier ();
+	tsc_hz = (end_tsc - start_tsc) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+}
+
+/* Returns the TSC's rate in Hz as CPUID reports it, or 0 if it does
+   not: leaf 0x15 gives it as a ratio to the crystal clock, leaf 0x16
+   the processor's base frequency, which the TSC runs at on the
+   processors that have it, and hypervisors that follow VMware's
+   convention, as KVM and QEMU can, put it at leaf 0x40000010. */
+static uint64_t
+tsc_hz_cpuid (void) {
+	uint32_t max, eax, ebx, ecx, edx;
+
+	cpuid (0, &max, &ebx, &ecx, &edx);
+	if (max >= 0x15) {
+		cpuid (0x15, &eax, &ebx, &ecx, &edx);
+		if (eax != 0 && ebx != 0 && ecx != 0)
+			return (uint64_t) ecx * ebx / eax;
+	}
+	if (max >= 0x16) {
+		cpuid (0x16, &eax, &ebx, &ecx, &edx);
+		if ((eax & 0xffff) != 0)
+			return (uint64_t) (eax & 0xffff) * 1000000;
+	}
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (ecx & (1u << 31)) {
+		cpuid (0x40000000, &max, &ebx, &ecx, &edx);
+		if (max >= 0x40000010) {
+			cpuid (0x40000010, &eax, &ebx, &ecx, &edx);
+			if (eax != 0)
+				return (uint64_t) eax * 1000;
+		}
+	}
+	return 0;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -91,6 +298,29 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds since the OS booted, read from
+   the TSC once timer_calibrate() has run.  Until then, or without a
+   TSC, it only has the resolution of timer_ticks(). */
+int64_t
+timer_ns (void) {
+	if (tsc_hz == 0)
+		return timer_ticks () * NS_PER_TICK;
+	return tsc_base_ns + tsc_to_ns (rdtsc () - tsc_base);
+}
+
+/* Converts CYCLES of the TSC to nanoseconds. */
+static int64_t
+tsc_to_ns (uint64_t cycles) {
+	return cycles / tsc_hz * 1000000000 + cycles % tsc_hz * 1000000000 / tsc_hz;
+}
+
+/* Returns CYCLES of the TSC in nanoseconds, or -1 before
+   timer_calibrate() or without a TSC. */
+int64_t
+timer_tsc_to_ns (uint64_t cycles) {
+	return tsc_hz != 0 ? tsc_to_ns (cycles) : -1;
+}
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void
 timer_sleep (int64_t ticks) {
@@ -128,21 +358,300 @@ timer_nsleep (int64_t ns) {
 	real_time_sleep (ns, 1000 * 1000 * 1000);
 }
 
+/* Busy-waits for approximately US microseconds.  Unlike
+   timer_usleep(), may be called with interrupts disabled, e.g. from
+   an interrupt handler. */
+void
+timer_udelay (int64_t us) {
+	real_time_delay (us, 1000 * 1000);
+}
+
+/* Busy-waits for approximately NS nanoseconds.  Unlike
+   timer_nsleep(), may be called with interrupts disabled. */
+void
+timer_ndelay (int64_t ns) {
+	real_time_delay (ns, 1000 * 1000 * 1000);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) {
-	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+	printf ("Timer: %"PRId64" ticks, %llu events deferred by slack\n",
+			timer_ticks (), slack_deferred);
 }
 
-/* Timer interrupt handler. */
+/* Initializes EVENT to call FUNC (AUX) when it fires. */
+void
+timer_event_init (struct timer_event *event, timer_func *func, void *aux) {
+	ASSERT (event != NULL && func != NULL);
+
+	event->func = func;
+	event->aux = aux;
+	event->pending = false;
+}
+
+/* Makes EVENT fire on the first timer tick at or after DEADLINE,
+   which is compared against timer_ticks().  A DEADLINE already
+   passed fires on the next tick.  EVENT must not be pending.
+   May be called from an interrupt handler, including from a
+   timer_func. */
+void
+timer_event_add (struct timer_event *event, int64_t deadline) {
+	enum intr_level old_level = intr_disable ();
+
+	ASSERT (!event->pending);
+	event->deadline = deadline;
+	event->pending = true;
+	wheel_insert (event, deadline > wheel_ticks ? deadline : wheel_ticks + 1);
+	intr_set_level (old_level);
+}
+
+/* Like timer_event_add(), but lets EVENT fire up to SLACK ticks after
+   DEADLINE.  It fires on the tick in that window whose number ends in
+   the most zero bits, so that events with deadlines near each other
+   land on the same tick, and the ticks in between, with nothing to
+   wake, can be skipped by dynamic ticks. */
+void
+timer_event_add_slack (struct timer_event *event, int64_t deadline,
+		int64_t slack) {
+	enum intr_level old_level = intr_disable ();
+	int64_t limit;
+
+	if (deadline <= wheel_ticks)
+		deadline = wheel_ticks + 1;
+	limit = deadline + (slack > 0 ? slack : 0);
+	if (limit > deadline) {
+		/* Clear the bits below the highest one DEADLINE and LIMIT
+		   differ in: that stays at or above DEADLINE. */
+		int64_t mask = deadline ^ limit;
+		int bit = 63 - __builtin_clzll (mask);
+
+		limit &= ~(((int64_t) 1 << bit) - 1);
+		if (limit != deadline)
+			slack_deferred++;
+	}
+	timer_event_add (event, limit);
+	intr_set_level (old_level);
+}
+
+/* Keeps EVENT from firing.  Returns true if it was pending, false
+   if it had already fired or was never added. */
+bool
+timer_event_cancel (struct timer_event *event) {
+	enum intr_level old_level = intr_disable ();
+	bool was_pending = event->pending;
+
+	if (was_pending) {
+		list_remove (&event->elem);
+		event->pending = false;
+	}
+	intr_set_level (old_level);
+	return was_pending;
+}
+
+/* Files EVENT in the wheel slot for tick EXPIRES, which must not
+   be before wheel_ticks.  Events beyond the wheel's reach go in the
+   farthest slot and are filed again when it cascades. */
+static void
+wheel_insert (struct timer_event *event, int64_t expires) {
+	int64_t delta = expires - wheel_ticks;
+	int level;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (delta >= 0);
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (delta < (int64_t) WHEEL_SIZE << (WHEEL_BITS * level))
+			break;
+	if (delta >= (int64_t) WHEEL_SIZE << (WHEEL_BITS * level))
+		expires = wheel_ticks + ((int64_t) WHEEL_SIZE << (WHEEL_BITS * level)) - 1;
+	list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+			& (WHEEL_SIZE - 1)], &event->elem);
+}
+
+/* Does the next bit of the wheel's work: files again an event being
+   cascaded, or else fires an event of tick wheel_ticks, or else moves
+   on to tick wheel_ticks + 1, if it has been counted, taking the slots
+   that come due in the levels above 0 to cascade.  Returns false if
+   there was nothing to do.  Interrupts must be off. */
+static bool
+wheel_step (void) {
+	struct list *slot = &wheel[0][wheel_ticks & (WHEEL_SIZE - 1)];
+	int level;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (!list_empty (&cascade)) {
+		struct timer_event *e = list_entry (list_pop_front (&cascade),
+				struct timer_event, elem);
+
+		wheel_insert (e, e->deadline > wheel_ticks ? e->deadline : wheel_ticks);
+		return true;
+	}
+	if (!list_empty (slot)) {
+		struct timer_event *e = list_entry (list_pop_front (slot),
+				struct timer_event, elem);
+
+		ASSERT (e->deadline <= wheel_ticks);
+		e->pending = false;
+		e->func (e->aux);
+		return true;
+	}
+	if (wheel_ticks >= ticks)
+		return false;
+
+	wheel_ticks++;
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		/* Level LEVEL moves on only when every level below wraps. */
+		if ((wheel_ticks & (((int64_t) 1 << (WHEEL_BITS * level)) - 1)) != 0)
+			break;
+		slot = &wheel[level][(wheel_ticks >> (WHEEL_BITS * level))
+				& (WHEEL_SIZE - 1)];
+		list_splice (list_end (&cascade), list_begin (slot), list_end (slot));
+	}
+	return true;
+}
+
+/* Deferred work of the timer interrupt: catches the wheel up with
+   the ticks counted, letting interrupts in between steps. */
+static void
+wheel_run (void *aux UNUSED) {
+	enum intr_level old_level = intr_disable ();
+
+	while (wheel_step ()) {
+		intr_set_level (old_level);
+		intr_disable ();
+	}
+	intr_set_level (old_level);
+}
+
+/* Called by the idle thread, with interrupts off, right before it
+   waits for an interrupt.  With -tickless, sets the PIT to skip the
+   coming ticks on which no timer_event fires, as many as the 8254's
+   16-bit counter can span. */
+void
+timer_idle_enter (void) {
+	int64_t limit, next;
+	unsigned first;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (!timer_tickless || tickless_ticks != 0)
+		return;
+
+	/* Reading the counter before checking for a pending interrupt
+	   means FIRST cannot belong to a period already over.  Leave
+	   a margin too, for the time until the count is written. */
+	first = pit_read ();
+	if (first < PIT_PERIOD / 4 || pit_irq_pending ())
+		return;
+
+	/* Wheel slots above level 0 cascade every WHEEL_SIZE ticks, and
+	   their events may fire on the tick after, so wake up for that. */
+	limit = ticks + 1 + (0xffff - first) / PIT_PERIOD;
+	if (limit > (ticks | (WHEEL_SIZE - 1)) + 1)
+		limit = (ticks | (WHEEL_SIZE - 1)) + 1;
+	for (next = ticks + 1; next < limit; next++)
+		if (!list_empty (&wheel[0][next & (WHEEL_SIZE - 1)]))
+			break;
+	if (next - ticks < 2)
+		return;
+
+	tickless_ticks = next - ticks;
+	tickless_first = first;
+	tickless_count = first + (tickless_ticks - 1) * PIT_PERIOD;
+	pit_program (tickless_count);
+}
+
+/* Called by the idle thread once an interrupt wakes it.  If it was
+   not the timer's, accounts for the ticks skipped so far and sets
+   the PIT to interrupt at the end of the tick under way, so that a
+   thread the interrupt woke is scheduled and timed as usual. */
+void
+timer_idle_exit (void) {
+	enum intr_level old_level = intr_disable ();
+	unsigned elapsed, next;
+	int passed;
+
+	if (tickless_ticks == 0)
+		goto done;
+	elapsed = tickless_count - pit_read ();
+	if (pit_irq_pending ())
+		goto done;              /* timer_interrupt() accounts for all. */
+
+	passed = elapsed < tickless_first ? 0
+		: 1 + (elapsed - tickless_first) / PIT_PERIOD;
+	if (passed > tickless_ticks - 1)
+		passed = tickless_ticks - 1;
+	while (passed-- > 0) {
+		timer_tick ();
+		tickless_first += PIT_PERIOD;
+	}
+	next = tickless_first > elapsed ? tickless_first - elapsed : 1;
+	if (next < PIT_PERIOD)
+		tick_tsc = rdtsc () - (uint64_t) (PIT_PERIOD - next) * tsc_hz / PIT_HZ;
+
+	tickless_ticks = 1;
+	tickless_first = tickless_count = next;
+	pit_program (next);
+done:
+	intr_set_level (old_level);
+}
+
+/* Counts one timer tick. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED) {
+timer_tick (void) {
 	ticks++;
+	tick_tsc = rdtsc ();
 	thread_tick ();
-	// 매 tick 마다 sleep_list에서 깨울 thread가 있는지 확인
-	if (get_next_tick_to_awake() <= ticks) {
-		thread_awake(ticks);
+	if (intr_context ())
+		intr_defer (&wheel_work);
+	else
+		while (wheel_step ())
+			continue;
+}
+
+/* Timer interrupt handler. */
+static void
+timer_interrupt (struct intr_frame *args) {
+	int cnt = 1;
+
+	if (profile_enabled)
+		profile_sample (args);
+
+	if (tickless_ticks != 0) {
+		cnt = tickless_ticks;
+		tickless_ticks = 0;
+		pit_program (PIT_PERIOD);
 	}
+	while (cnt-- > 0)
+		timer_tick ();
+}
+
+/* Makes counter 0 interrupt every COUNT cycles, from now on. */
+static void
+pit_program (unsigned count) {
+	ASSERT (count > 0 && count <= 0xffff);
+
+	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Returns the cycles left before counter 0 next interrupts. */
+static unsigned
+pit_read (void) {
+	uint8_t lo, hi;
+
+	outb (0x43, 0x00);    /* CW: latch counter 0. */
+	lo = inb (0x40);
+	hi = inb (0x40);
+	return lo | (hi << 8);
+}
+
+/* Returns true if the PIT has raised an interrupt not yet handled. */
+static bool
+pit_irq_pending (void) {
+	outb (0x20, 0x0a);    /* OCW3: read master PIC's IRR. */
+	return inb (0x20) & 1;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -163,6 +672,31 @@ too_many_loops (unsigned loops) {
 	return start != ticks;
 }
 
+/* Returns loops_per_tick as timed on the TSC: the fastest of a few
+   runs of TSC_LOOPS loops, with interrupts off, scaled to a tick.
+   Less than a millisecond in all. */
+#define TSC_LOOPS (1 << 16)
+#define TSC_LOOP_RUNS 4
+static unsigned
+tsc_loops_per_tick (void) {
+	uint64_t best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < TSC_LOOP_RUNS; i++) {
+		enum intr_level old_level = intr_disable ();
+		uint64_t start = rdtsc ();
+
+		busy_wait (TSC_LOOPS);
+		start = rdtsc () - start;
+		intr_set_level (old_level);
+		if (start != 0 && start < best)
+			best = start;
+	}
+	if (best == UINT64_MAX)
+		best = 1;
+	return (uint64_t) TSC_LOOPS * (tsc_hz / TIMER_FREQ) / best;
+}
+
 /* Iterates through a simple loop LOOPS times, for implementing
    brief delays.
 
@@ -176,7 +710,34 @@ busy_wait (int64_t loops) {
 		barrier ();
 }
 
-/* Sleep for approximately NUM/DENOM seconds. */
+/* Busy-waits until timer_ns() reaches NS. */
+static void
+tsc_spin_until (int64_t ns) {
+	while (timer_ns () < ns)
+		barrier ();
+}
+
+/* Sleeps for NS nanoseconds, measured on the TSC: blocks until the
+   last timer tick before the deadline, found from how far into the
+   current tick the TSC is, then busy-waits only for the part of a
+   tick left. */
+static void
+tsc_sleep (int64_t ns) {
+	int64_t deadline = timer_ns () + ns;
+	enum intr_level old_level = intr_disable ();
+	int64_t to_tick = NS_PER_TICK - tsc_to_ns (rdtsc () - tick_tsc);
+
+	/* Ticks come TO_TICK and then every NS_PER_TICK from now. */
+	if (to_tick < 0)
+		to_tick = 0;
+	if (ns >= to_tick)
+		thread_sleep (ticks + 1 + (ns - to_tick) / NS_PER_TICK);
+	intr_set_level (old_level);
+	tsc_spin_until (deadline);
+}
+
+/* Sleep for approximately NUM/DENOM seconds, precisely if the CPU
+   has a TSC. */
 static void
 real_time_sleep (int64_t num, int32_t denom) {
 	/* Convert NUM/DENOM seconds into timer ticks, rounding down.
@@ -188,7 +749,9 @@ real_time_sleep (int64_t num, int32_t denom) {
 	int64_t ticks = num * TIMER_FREQ / denom;
 
 	ASSERT (intr_get_level () == INTR_ON);
-	if (ticks > 0) {
+	if (tsc_hz != 0)
+		tsc_sleep (num * (1000000000 / denom));
+	else if (ticks > 0) {
 		/* We're waiting for at least one full timer tick.  Use
 		   timer_sleep() because it will yield the CPU to other
 		   processes. */
@@ -201,3 +764,17 @@ real_time_sleep (int64_t num, int32_t denom) {
 		busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
 	}
 }
+
+/* Busy-wait for approximately NUM/DENOM seconds. */
+static void
+real_time_delay (int64_t num, int32_t denom) {
+	if (tsc_hz != 0) {
+		tsc_spin_until (timer_ns () + num * (1000000000 / denom));
+		return;
+	}
+
+	/* Scale the numerator and denominator down by 1000 to avoid
+	   the possibility of overflow. */
+	ASSERT (denom % 1000 == 0);
+	busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+}
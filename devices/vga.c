@@ -21,10 +21,29 @@ static size_t cx, cy;
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
-   The character at (x,y) is fb[y][x][0].
-   The attribute at (x,y) is fb[y][x][1]. */
+   Video memory holds RING_ROWS rows, of which the CRTC shows the
+   ROW_CNT from row TOP on.  The screen scrolls by moving TOP down a
+   row and setting the CRTC start address to it, rather than by
+   moving every row up, until the rows shown would run past the end.
+   Only then are they copied back to the first rows, once every
+   RING_ROWS - ROW_CNT lines.  The character at (x,y) is
+   fb[top + y][x][0], its attribute fb[top + y][x][1]. */
+#define RING_ROWS (0x8000 / (COL_CNT * 2))
 static uint8_t (*fb)[COL_CNT][2];
+static size_t top;
 
+/* Copy of the screen in RAM, from which the rows are copied back,
+   since video memory is slow to read.  Row Y of the screen is
+   shadow[(shadow_top + Y) % ROW_CNT], so that scrolling it moves
+   nothing either. */
+static uint8_t shadow[ROW_CNT][COL_CNT][2];
+static size_t shadow_top;
+
+/* Row TOP as the CRTC was last told, to set it only on change. */
+static size_t crtc_top;
+
+static void putc_no_cursor (int c);
+static void put_cell (size_t x, size_t y, uint8_t c);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -37,8 +56,12 @@ init (void) {
 	/* Already initialized? */
 	static bool inited;
 	if (!inited) {
+		size_t y;
+
 		fb = ptov (0xb8000);
 		find_cursor (&cx, &cy);
+		for (y = 0; y < ROW_CNT; y++)
+			memcpy (shadow[y], fb[y], sizeof shadow[y]);
 		inited = true;
 	}
 }
@@ -52,7 +75,33 @@ vga_putc (int c) {
 	enum intr_level old_level = intr_disable ();
 
 	init ();
+	putc_no_cursor (c);
+
+	/* Update cursor position. */
+	move_cursor ();
+
+	intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would one at a time, but moves the hardware cursor
+   only once at the end. */
+void
+vga_putbuf (const char *buffer, size_t n) {
+	enum intr_level old_level = intr_disable ();
+
+	init ();
+	while (n-- > 0)
+		putc_no_cursor (*buffer++);
+	move_cursor ();
+
+	intr_set_level (old_level);
+}
 
+/* Writes C to the framebuffer and advances (cx,cy), without moving
+   the hardware cursor. */
+static void
+putc_no_cursor (int c) {
 	switch (c) {
 		case '\n':
 			newline ();
@@ -78,24 +127,28 @@ vga_putc (int c) {
 			break;
 
 		default:
-			fb[cy][cx][0] = c;
-			fb[cy][cx][1] = GRAY_ON_BLACK;
+			put_cell (cx, cy, c);
 			if (++cx >= COL_CNT)
 				newline ();
 			break;
 	}
-
-	/* Update cursor position. */
-	move_cursor ();
-
-	intr_set_level (old_level);
 }
 
+/* Writes character C, gray on black, at (X,Y) on the screen. */
+static void
+put_cell (size_t x, size_t y, uint8_t c) {
+	uint8_t *cell = shadow[(shadow_top + y) % ROW_CNT][x];
+
+	cell[0] = fb[top + y][x][0] = c;
+	cell[1] = fb[top + y][x][1] = GRAY_ON_BLACK;
+}
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void) {
 	size_t y;
 
+	top = shadow_top = 0;
 	for (y = 0; y < ROW_CNT; y++)
 		clear_row (y);
 
@@ -103,16 +156,13 @@ cls (void) {
 	move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y of the screen to spaces. */
 static void
 clear_row (size_t y) {
 	size_t x;
 
 	for (x = 0; x < COL_CNT; x++)
-	{
-		fb[y][x][0] = ' ';
-		fb[y][x][1] = GRAY_ON_BLACK;
-	}
+		put_cell (x, y, ' ');
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -125,16 +175,37 @@ newline (void) {
 	if (cy >= ROW_CNT)
 	{
 		cy = ROW_CNT - 1;
-		memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+		shadow_top = (shadow_top + 1) % ROW_CNT;
+		if (top + ROW_CNT < RING_ROWS)
+			top++;
+		else {
+			/* Out of rows below: start over from the first. */
+			size_t y;
+
+			top = 0;
+			for (y = 0; y < ROW_CNT - 1; y++)
+				memcpy (fb[y], shadow[(shadow_top + y) % ROW_CNT],
+						sizeof fb[y]);
+		}
 		clear_row (ROW_CNT - 1);
 	}
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Moves the hardware cursor to (cx,cy), and the start of the
+   display to row TOP if it moved. */
 static void
 move_cursor (void) {
-	/* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-	uint16_t cp = cx + COL_CNT * cy;
+	/* See [FREEVGA] under "Manipulating the Text-mode Cursor"
+	   and "CRTC Registers" for the start address. */
+	uint16_t cp = cx + COL_CNT * (top + cy);
+
+	if (top != crtc_top) {
+		uint16_t start = COL_CNT * top;
+
+		outw (0x3d4, 0x0c | (start & 0xff00));
+		outw (0x3d4, 0x0d | (start << 8));
+		crtc_top = top;
+	}
 	outw (0x3d4, 0x0e | (cp & 0xff00));
 	outw (0x3d4, 0x0f | (cp << 8));
 }
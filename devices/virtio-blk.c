@@ -0,0 +1,374 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices through the
+   legacy virtio PCI interface, with one split virtqueue per device
+   [VIRTIO].  Each device is registered with the block layer as
+   "vd0", "vd1" and so on, and may stand in for a missing ATA disk
+   in any of its roles. */
+
+/* PCI IDs of a transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio register port addresses. */
+#define reg_guest_features(VB) ((VB)->io_base + 0x04)   /* 32 bits. */
+#define reg_queue_pfn(VB) ((VB)->io_base + 0x08)        /* 32 bits. */
+#define reg_queue_size(VB) ((VB)->io_base + 0x0c)       /* 16 bits. */
+#define reg_queue_select(VB) ((VB)->io_base + 0x0e)     /* 16 bits. */
+#define reg_queue_notify(VB) ((VB)->io_base + 0x10)     /* 16 bits. */
+#define reg_status(VB) ((VB)->io_base + 0x12)           /* 8 bits. */
+#define reg_isr(VB) ((VB)->io_base + 0x13)              /* 8 bits. */
+#define reg_capacity(VB) ((VB)->io_base + 0x14)         /* 64 bits. */
+
+/* Device Status Register bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest can drive the device. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* ISR Status Register bits, cleared by reading it. */
+#define ISR_QUEUE 0x01          /* Used ring was updated. */
+
+/* A virtqueue descriptor: one buffer of a request, chained by NEXT. */
+struct vring_desc {
+	uint64_t addr;              /* Physical address. */
+	uint32_t len;               /* Bytes. */
+	uint16_t flags;             /* VRING_DESC_F_*. */
+	uint16_t next;              /* Next descriptor, with F_NEXT. */
+};
+
+#define VRING_DESC_F_NEXT 0x01  /* Chained to NEXT. */
+#define VRING_DESC_F_WRITE 0x02 /* Device writes the buffer. */
+
+/* Ring of descriptor chains the driver offers the device. */
+struct vring_avail {
+	uint16_t flags;
+	uint16_t idx;               /* Where the next entry goes, mod size. */
+	uint16_t ring[];
+};
+
+/* Ring of descriptor chains the device is done with. */
+struct vring_used_elem {
+	uint32_t id;                /* Head of the chain. */
+	uint32_t len;               /* Bytes written to it. */
+};
+
+struct vring_used {
+	uint16_t flags;             /* VRING_USED_F_*. */
+	uint16_t idx;               /* Where the next entry goes, mod size. */
+	struct vring_used_elem ring[];
+};
+
+#define VRING_USED_F_NO_NOTIFY 0x01     /* Device polls, do not kick. */
+
+/* What a request tells the device first. */
+struct virtio_blk_hdr {
+	uint32_t type;              /* VIRTIO_BLK_T_*. */
+	uint32_t reserved;
+	uint64_t sector;            /* First 512-byte sector. */
+};
+
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Status of a request that worked. */
+
+/* The memory a request in flight shares with the device, besides
+   its data.  Slot I uses descriptors 3 * I to 3 * I + 2: header,
+   data, status. */
+struct vblk_slot {
+	struct virtio_blk_hdr hdr;  /* Read by the device. */
+	uint8_t status;             /* Written by the device. */
+	struct block_request *req;   /* Request in flight, or null. */
+	int next_free;              /* Next free slot, or -1. */
+};
+
+/* A virtio block device. */
+struct virtio_blk {
+	char name[8];               /* Name, e.g. "vd0". */
+	uint16_t io_base;           /* Base I/O port of the registers. */
+	uint8_t irq;                /* Interrupt in use. */
+	uint64_t capacity;          /* Capacity in sectors. */
+	struct block_device *block; /* As registered. */
+
+	/* Virtqueue 0, and the slots for its requests.  Protected by
+	   disabling interrupts. */
+	uint16_t queue_size;        /* Entries in each ring. */
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+	uint16_t last_used;         /* USED's idx when last looked at. */
+	struct vblk_slot *slots;    /* SLOT_CNT slots, in one page. */
+	size_t slot_cnt;
+	int free_slot;              /* First free slot, or -1. */
+	struct list pending;        /* struct block_requests not issued yet,
+	                               in submission order. */
+	struct intr_work work;      /* Deferred work of the interrupt. */
+};
+
+/* Most virtio block devices driven. */
+#define VBLK_MAX 4
+static struct virtio_blk devices[VBLK_MAX];
+static size_t device_cnt;
+
+static bool probe (struct virtio_blk *, const struct pci_func *);
+static bool conflicts (const struct virtio_blk *,
+		const struct block_request *);
+static void start_pending (struct virtio_blk *);
+static void issue (struct virtio_blk *, struct block_request *);
+static void interrupt_handler (struct intr_frame *);
+static void complete_used (void *vb_);
+static void virtio_blk_submit (struct block_request *);
+
+static const struct block_operations virtio_blk_ops = {
+	.submit = virtio_blk_submit,
+};
+
+/* Finds and sets up the virtio block devices on the PCI bus, and
+   registers them with the block layer. */
+void
+virtio_blk_init (void) {
+	struct pci_func f = PCI_START;
+
+	while (device_cnt < VBLK_MAX && pci_next (&f))
+		if (pci_read_config (&f, PCI_REG_ID)
+				== (VIRTIO_BLK_DEVICE << 16 | VIRTIO_VENDOR)
+				&& probe (&devices[device_cnt], &f)) {
+			struct virtio_blk *vb = &devices[device_cnt++];
+
+			vb->block = block_register (vb->name, vb->capacity < UINT32_MAX
+					? vb->capacity : UINT32_MAX, &virtio_blk_ops, vb,
+					BLOCK_FALLBACK);
+		}
+}
+
+/* Hands REQ to its device, issuing it at once if a slot is free and
+   no request in flight overlaps it, which keeps requests for the
+   same sector in submission order.  Completion comes later, from
+   the interrupt handler. */
+static void
+virtio_blk_submit (struct block_request *req) {
+	struct virtio_blk *vb = req->dev->aux;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	list_push_back (&vb->pending, &req->elem);
+	start_pending (vb);
+}
+
+/* Sets up VB as the virtio block device F: resets it, gives it a
+   virtqueue and tells it the driver is ready.  Returns false,
+   leaving the device failed, if that cannot be done. */
+static bool
+probe (struct virtio_blk *vb, const struct pci_func *f) {
+	uint32_t bar0 = pci_read_config (f, PCI_REG_BAR0);
+	uint8_t irq = pci_read_config (f, PCI_REG_IRQ) & 0xff;
+	size_t ring_bytes, used_bytes, i;
+	uint8_t *queue;
+
+	if (!(bar0 & 1) || irq >= 16)
+		return false;
+	snprintf (vb->name, sizeof vb->name, "vd%zu", device_cnt);
+	vb->io_base = bar0 & 0xfffc;
+	vb->irq = 0x20 + irq;
+	pci_write_config (f, PCI_REG_COMMAND,
+			pci_read_config (f, PCI_REG_COMMAND)
+			| PCI_CMD_IO | PCI_CMD_MASTER);
+
+	outb (reg_status (vb), 0);
+	outb (reg_status (vb), STATUS_ACKNOWLEDGE);
+	outb (reg_status (vb), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+	outl (reg_guest_features (vb), 0);
+
+	/* The legacy interface fixes the queue's size and wants the
+	   rings in physically contiguous pages: descriptors and the
+	   available ring, then the used ring on a page boundary. */
+	outw (reg_queue_select (vb), 0);
+	vb->queue_size = inw (reg_queue_size (vb));
+	ring_bytes = ROUND_UP (vb->queue_size * sizeof *vb->desc
+			+ sizeof *vb->avail + vb->queue_size * sizeof *vb->avail->ring
+			+ sizeof (uint16_t), PGSIZE);
+	used_bytes = ROUND_UP (sizeof *vb->used
+			+ vb->queue_size * sizeof *vb->used->ring + sizeof (uint16_t),
+			PGSIZE);
+	queue = vb->queue_size != 0
+		? palloc_get_multiple (PAL_ZERO, (ring_bytes + used_bytes) / PGSIZE)
+		: NULL;
+	vb->slots = queue != NULL ? palloc_get_page (PAL_ZERO) : NULL;
+	if (vb->slots == NULL) {
+		if (queue != NULL)
+			palloc_free_multiple (queue, (ring_bytes + used_bytes) / PGSIZE);
+		outb (reg_status (vb), STATUS_FAILED);
+		return false;
+	}
+	vb->desc = (struct vring_desc *) queue;
+	vb->avail = (struct vring_avail *) (vb->desc + vb->queue_size);
+	vb->used = (struct vring_used *) (queue + ring_bytes);
+	vb->last_used = 0;
+	outl (reg_queue_pfn (vb), vtop (queue) >> PGBITS);
+
+	vb->slot_cnt = vb->queue_size / 3;
+	if (vb->slot_cnt > PGSIZE / sizeof *vb->slots)
+		vb->slot_cnt = PGSIZE / sizeof *vb->slots;
+	for (i = 0; i < vb->slot_cnt; i++)
+		vb->slots[i].next_free = i + 1 < vb->slot_cnt ? (int) i + 1 : -1;
+	vb->free_slot = 0;
+	list_init (&vb->pending);
+	intr_work_init (&vb->work, complete_used, vb);
+
+	vb->capacity = inl (reg_capacity (vb))
+		| (uint64_t) inl (reg_capacity (vb) + 4) << 32;
+
+	/* Devices may share an interrupt line. */
+	for (i = 0; i < device_cnt; i++)
+		if (devices[i].irq == vb->irq)
+			break;
+	if (i == device_cnt)
+		intr_register_ext (vb->irq, interrupt_handler, "virtio-blk");
+	outb (reg_status (vb),
+			STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+	printf ("%s: detected %'"PRIu64" sector virtio-blk disk, "
+			"%zu requests in flight\n", vb->name, vb->capacity, vb->slot_cnt);
+	return true;
+}
+
+/* Returns true if REQ must wait for a request in flight on VB: one
+   of them writes sectors the other also touches. */
+static bool
+conflicts (const struct virtio_blk *vb, const struct block_request *req) {
+	size_t i;
+
+	for (i = 0; i < vb->slot_cnt; i++) {
+		const struct block_request *r = vb->slots[i].req;
+
+		if (r != NULL && (r->write || req->write)
+				&& r->sec_no < req->sec_no + req->sec_cnt
+				&& req->sec_no < r->sec_no + r->sec_cnt)
+			return true;
+	}
+	return false;
+}
+
+/* Issues VB's pending requests, in order, while slots are free and
+   the oldest one does not conflict with one in flight.  Tells the
+   device once about all the requests issued, unless it is polling
+   the ring anyway. */
+static void
+start_pending (struct virtio_blk *vb) {
+	bool issued = false;
+
+	while (!list_empty (&vb->pending) && vb->free_slot != -1) {
+		struct block_request *req = list_entry (list_front (&vb->pending),
+				struct block_request, elem);
+
+		if (conflicts (vb, req))
+			break;
+		list_pop_front (&vb->pending);
+		issue (vb, req);
+		issued = true;
+	}
+
+	if (issued) {
+		barrier ();
+		if (!(vb->used->flags & VRING_USED_F_NO_NOTIFY))
+			outw (reg_queue_notify (vb), 0);
+	}
+}
+
+/* Puts REQ in a free slot of VB and offers it in the available
+   ring. */
+static void
+issue (struct virtio_blk *vb, struct block_request *req) {
+	int i = vb->free_slot;
+	struct vblk_slot *slot = &vb->slots[i];
+	struct vring_desc *d = &vb->desc[3 * i];
+
+	vb->free_slot = slot->next_free;
+	slot->req = req;
+	slot->hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	slot->hdr.reserved = 0;
+	slot->hdr.sector = req->sec_no;
+	slot->status = 0xff;
+
+	/* The buffer is kernel memory, so physically contiguous. */
+	d[0] = (struct vring_desc) {
+		.addr = vtop (&slot->hdr),
+		.len = sizeof slot->hdr,
+		.flags = VRING_DESC_F_NEXT,
+		.next = 3 * i + 1,
+	};
+	d[1] = (struct vring_desc) {
+		.addr = vtop (req->buffer),
+		.len = req->sec_cnt * DISK_SECTOR_SIZE,
+		.flags = VRING_DESC_F_NEXT | (req->write ? 0 : VRING_DESC_F_WRITE),
+		.next = 3 * i + 2,
+	};
+	d[2] = (struct vring_desc) {
+		.addr = vtop (&slot->status),
+		.len = sizeof slot->status,
+		.flags = VRING_DESC_F_WRITE,
+	};
+
+	vb->avail->ring[vb->avail->idx % vb->queue_size] = 3 * i;
+	barrier ();
+	vb->avail->idx++;
+}
+
+/* Acknowledges the interrupt of each device on the interrupting
+   line that has put requests in its used ring, leaving their
+   completion to deferred work. */
+static void
+interrupt_handler (struct intr_frame *f) {
+	size_t n;
+
+	for (n = 0; n < device_cnt; n++) {
+		struct virtio_blk *vb = &devices[n];
+
+		if (vb->irq == f->vec_no && (inb (reg_isr (vb)) & ISR_QUEUE))
+			intr_defer (&vb->work);
+	}
+}
+
+/* Completes the requests device VB has put in its used ring, then
+   issues what it can of the pending ones.  Runs as deferred work of
+   the interrupt, with interrupts turned off only for each request,
+   so that other devices' interrupts get in between. */
+static void
+complete_used (void *vb_) {
+	struct virtio_blk *vb = vb_;
+	enum intr_level old_level;
+
+	for (;;) {
+		struct vblk_slot *slot;
+		struct block_request *req;
+		int i;
+
+		old_level = intr_disable ();
+		barrier ();
+		if (vb->last_used == vb->used->idx) {
+			start_pending (vb);
+			intr_set_level (old_level);
+			break;
+		}
+		i = vb->used->ring[vb->last_used++ % vb->queue_size].id / 3;
+		slot = &vb->slots[i];
+		req = slot->req;
+		if (slot->status != VIRTIO_BLK_S_OK)
+			PANIC ("%s: disk %s failed, sector=%"PRDSNu, vb->name,
+					req->write ? "write" : "read", req->sec_no);
+		slot->req = NULL;
+		slot->next_free = vb->free_slot;
+		vb->free_slot = i;
+		block_request_complete (req);
+		intr_set_level (old_level);
+	}
+}
@@ -0,0 +1,323 @@
+/* buffer_cache.c: Sector-granular write-back cache in front of the
+ * file system disk. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/page_cache.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A cached copy of one disk sector. */
+struct buffer_cache_entry {
+	disk_sector_t sector;               /* Cached sector, if VALID. */
+	bool valid;                         /* True if DATA holds SECTOR. */
+	bool dirty;                         /* True if DATA differs from disk. */
+	bool accessed;                      /* Reference bit for the clock. */
+	bool held;                          /* Metadata not yet committed by
+	                                       the journal: kept off disk. */
+	uint8_t *data;                      /* DISK_SECTOR_SIZE bytes. */
+};
+
+/* Pages of bounce buffer for buffer_cache_read_multiple(). */
+#define BOUNCE_PAGES 8
+#define BOUNCE_SECTORS (BOUNCE_PAGES * PGSIZE / DISK_SECTOR_SIZE)
+
+static struct buffer_cache_entry cache[BUFFER_CACHE_SIZE];
+static size_t clock_hand;               /* Next slot the clock inspects. */
+static size_t dirty_cnt;                /* Number of dirty slots. */
+static uint8_t *bounce;                 /* BOUNCE_SECTORS sectors. */
+static struct lock cache_lock;          /* Protects all of the above. */
+
+static struct buffer_cache_entry *lookup (disk_sector_t);
+static struct buffer_cache_entry *select_victim (void);
+static struct buffer_cache_entry *load (disk_sector_t, bool fill);
+static void flush_entry (struct buffer_cache_entry *);
+static void read_sectors (disk_sector_t, size_t cnt, void *, bool direct);
+static void write_slot (disk_sector_t, const void *, int sector_ofs,
+		int size, bool hold);
+
+/* Initializes the buffer cache.  Slot data lives in whole pages from
+ * the kernel pool so that no slot straddles a page boundary. */
+void
+buffer_cache_init (void) {
+	size_t page_cnt = DIV_ROUND_UP (BUFFER_CACHE_SIZE * DISK_SECTOR_SIZE,
+			PGSIZE);
+	uint8_t *base = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, page_cnt);
+	size_t i;
+
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		cache[i].valid = false;
+		cache[i].dirty = false;
+		cache[i].accessed = false;
+		cache[i].held = false;
+		cache[i].data = base + i * DISK_SECTOR_SIZE;
+	}
+	clock_hand = 0;
+	dirty_cnt = 0;
+	bounce = palloc_get_multiple (PAL_ASSERT, BOUNCE_PAGES);
+	lock_init (&cache_lock);
+}
+
+/* Writes every dirty slot back to disk.  Called at shutdown. */
+void
+buffer_cache_done (void) {
+	buffer_cache_flush ();
+}
+
+/* Copies SIZE bytes starting at byte SECTOR_OFS of sector SECTOR
+ * into BUFFER, going to disk only on a cache miss. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int sector_ofs,
+		int size) {
+	struct buffer_cache_entry *e;
+
+	ASSERT (sector_ofs >= 0 && size >= 0);
+	ASSERT (sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = lookup (sector);
+	block_count_cache (filesys_disk, e != NULL, e == NULL);
+	if (e == NULL)
+		e = load (sector, true);
+	memcpy (buffer, e->data + sector_ofs, size);
+	e->accessed = true;
+	lock_release (&cache_lock);
+}
+
+/* Copies the CNT whole sectors starting at SECTOR into BUFFER.
+ * Cached sectors are copied from the cache, which may hold newer
+ * data than the disk.  Runs of uncached sectors are read with
+ * multi-sector transfers, without filling the cache.  They go through
+ * a kernel bounce buffer, since BUFFER may be user memory that must
+ * not fault inside the disk interrupt handler. */
+void
+buffer_cache_read_multiple (disk_sector_t sector, size_t cnt, void *buffer) {
+	read_sectors (sector, cnt, buffer, false);
+}
+
+/* Like buffer_cache_read_multiple(), but reads runs of uncached
+ * sectors straight into BUFFER, which must be kernel memory, such as
+ * the frame of a pinned user page. */
+void
+buffer_cache_read_direct (disk_sector_t sector, size_t cnt, void *buffer) {
+	read_sectors (sector, cnt, buffer, true);
+}
+
+/* Writes the CNT whole sectors at BUFFER, which must be kernel
+ * memory, straight to the disk starting at SECTOR, without going
+ * through the cache.  Copies of them in the cache are updated, so
+ * that a later write-back of one writes the same data. */
+void
+buffer_cache_write_direct (disk_sector_t sector, size_t cnt,
+		const void *buffer_) {
+	const uint8_t *buffer = buffer_;
+	size_t i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < cnt; i++) {
+		struct buffer_cache_entry *e = lookup (sector + i);
+
+		ASSERT (e == NULL || !e->held);
+		if (e != NULL)
+			memcpy (e->data, buffer + i * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE);
+	}
+	block_write_multiple (filesys_disk, sector, cnt, buffer);
+	lock_release (&cache_lock);
+}
+
+/* Does the work of buffer_cache_read_multiple(), reading uncached
+ * sectors straight into BUFFER if DIRECT. */
+static void
+read_sectors (disk_sector_t sector, size_t cnt, void *buffer_, bool direct) {
+	uint8_t *buffer = buffer_;
+	size_t i = 0;
+
+	lock_acquire (&cache_lock);
+	while (i < cnt) {
+		struct buffer_cache_entry *e = lookup (sector + i);
+		size_t run;
+
+		if (e != NULL) {
+			memcpy (buffer + i * DISK_SECTOR_SIZE, e->data, DISK_SECTOR_SIZE);
+			e->accessed = true;
+			block_count_cache (filesys_disk, 1, 0);
+			i++;
+			continue;
+		}
+		for (run = 1; i + run < cnt && (direct || run < BOUNCE_SECTORS)
+				&& lookup (sector + i + run) == NULL; run++)
+			continue;
+		block_count_cache (filesys_disk, 0, run);
+		if (direct)
+			block_read_multiple (filesys_disk, sector + i, run,
+					buffer + i * DISK_SECTOR_SIZE);
+		else {
+			block_read_multiple (filesys_disk, sector + i, run, bounce);
+			memcpy (buffer + i * DISK_SECTOR_SIZE, bounce, run * DISK_SECTOR_SIZE);
+		}
+		i += run;
+	}
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into sector SECTOR at byte
+ * SECTOR_OFS.  The data reaches the disk when the slot is evicted
+ * or flushed.  A write covering the whole sector skips reading the
+ * old contents. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, int sector_ofs,
+		int size) {
+	write_slot (sector, buffer, sector_ofs, size, false);
+}
+
+/* Like buffer_cache_write(), but also keeps SECTOR cached and off
+ * the disk until buffer_cache_release_held(), for the journal. */
+void
+buffer_cache_write_held (disk_sector_t sector, const void *buffer,
+		int sector_ofs, int size) {
+	write_slot (sector, buffer, sector_ofs, size, true);
+}
+
+/* Lets SECTOR, held by buffer_cache_write_held(), be written back
+ * and evicted again. */
+void
+buffer_cache_release_held (disk_sector_t sector) {
+	struct buffer_cache_entry *e;
+
+	lock_acquire (&cache_lock);
+	e = lookup (sector);
+	ASSERT (e != NULL && e->held);
+	e->held = false;
+	lock_release (&cache_lock);
+}
+
+/* Does the work of buffer_cache_write(), holding the slot if
+ * HOLD. */
+static void
+write_slot (disk_sector_t sector, const void *buffer, int sector_ofs,
+		int size, bool hold) {
+	struct buffer_cache_entry *e;
+
+	ASSERT (sector_ofs >= 0 && size >= 0);
+	ASSERT (sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = lookup (sector);
+	block_count_cache (filesys_disk, e != NULL, e == NULL);
+	if (e == NULL)
+		e = load (sector, size != DISK_SECTOR_SIZE);
+	memcpy (e->data + sector_ofs, buffer, size);
+	e->accessed = true;
+	e->held |= hold;
+	if (!e->dirty) {
+		e->dirty = true;
+		/* Let the daemon start its write-back timer, or flush at
+		   once if the cache is filling up with dirty slots. */
+		if (++dirty_cnt == 1 || dirty_cnt == BUFFER_CACHE_SIZE / 2)
+			page_cache_kick ();
+	}
+	lock_release (&cache_lock);
+}
+
+/* Brings up to CNT sectors starting at SECTOR into the cache
+ * without copying them anywhere.  Sectors past the end of the disk
+ * and sectors already cached are skipped. */
+void
+buffer_cache_prefetch (disk_sector_t sector, size_t cnt) {
+	disk_sector_t end = sector + cnt;
+
+	if (end > block_size (filesys_disk) || end < sector)
+		end = block_size (filesys_disk);
+	for (; sector < end; sector++) {
+		lock_acquire (&cache_lock);
+		if (lookup (sector) == NULL)
+			load (sector, true);
+		lock_release (&cache_lock);
+	}
+}
+
+/* Returns the number of dirty slots. */
+size_t
+buffer_cache_dirty_cnt (void) {
+	return dirty_cnt;
+}
+
+/* Writes all dirty slots but held ones back to disk, keeping them
+ * cached.
+ * The lock is dropped between slots so that readers are not held
+ * up for the whole flush. */
+void
+buffer_cache_flush (void) {
+	size_t i;
+
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		lock_acquire (&cache_lock);
+		flush_entry (&cache[i]);
+		lock_release (&cache_lock);
+	}
+}
+
+/* Returns the slot caching SECTOR, or a null pointer if SECTOR is
+ * not cached. */
+static struct buffer_cache_entry *
+lookup (disk_sector_t sector) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++)
+		if (cache[i].valid && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Picks a slot to reuse with the clock algorithm: empty slots are
+ * taken immediately, recently used slots get a second chance.  Held
+ * slots are passed over; the journal holds few enough that some
+ * slot is always free to go. */
+static struct buffer_cache_entry *
+select_victim (void) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	for (;;) {
+		struct buffer_cache_entry *e = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % BUFFER_CACHE_SIZE;
+
+		if (e->held)
+			continue;
+		if (!e->valid || !e->accessed)
+			return e;
+		e->accessed = false;
+	}
+}
+
+/* Evicts a slot and makes it cache SECTOR.  If FILL is true, the
+ * current contents of SECTOR are read from disk; otherwise the
+ * caller is about to overwrite the whole slot. */
+static struct buffer_cache_entry *
+load (disk_sector_t sector, bool fill) {
+	struct buffer_cache_entry *e = select_victim ();
+
+	flush_entry (e);
+	e->valid = false;
+	if (fill)
+		block_read (filesys_disk, sector, e->data);
+	e->sector = sector;
+	e->valid = true;
+	e->dirty = false;
+	e->accessed = false;
+	return e;
+}
+
+/* Writes E back to disk if it is dirty and not held. */
+static void
+flush_entry (struct buffer_cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	if (e->valid && e->dirty && !e->held) {
+		block_write (filesys_disk, e->sector, e->data);
+		e->dirty = false;
+		dirty_cnt--;
+	}
+}
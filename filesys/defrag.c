@@ -0,0 +1,111 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Online defragmentation daemon.
+ *
+ * Files that grow a little at a time, or next to other growing
+ * files, end up in many extents scattered over the disk.  While the
+ * system is idle, this daemon walks the root directory a batch of
+ * files at a time and has inode_defrag() move the scattered data of
+ * each into a contiguous run of free sectors.  It runs on the work
+ * queue at the lowest priority, so any thread that wants the CPU
+ * comes first, and moves a bounded number of sectors per pass.
+ * Started only with filesys_defrag. */
+
+/* Set by the -defrag option. */
+bool filesys_defrag;
+
+/* Files looked at, and most sectors moved, per pass. */
+#define DEFRAG_BATCH 16
+#define DEFRAG_PASS_SECTORS 256
+
+/* Pause between passes. */
+#define DEFRAG_SLEEP_MS 1000
+
+static struct work defrag_work;
+static bool defrag_stopping;
+static off_t defrag_cursor;             /* Where in the root directory the
+                                           next pass starts. */
+
+/* Statistics. */
+static uint64_t defrag_passes;          /* # of passes. */
+static uint64_t defrag_files;           /* # of times a file was moved. */
+static uint64_t defrag_sectors;         /* # of sectors moved. */
+
+static void defrag_run (void *aux);
+
+/* Starts the daemon, if filesys_defrag. */
+void
+defrag_init (void) {
+	if (!filesys_defrag)
+		return;
+	work_init (&defrag_work, defrag_run, NULL, PRI_MIN);
+	work_queue_delayed (&defrag_work,
+			DIV_ROUND_UP (DEFRAG_SLEEP_MS * TIMER_FREQ, 1000));
+}
+
+/* Stops the daemon, waiting for a pass under way to end. */
+void
+defrag_done (void) {
+	if (!filesys_defrag)
+		return;
+	defrag_stopping = true;
+	work_cancel (&defrag_work);
+	work_flush (&defrag_work);
+	work_cancel (&defrag_work);
+}
+
+/* Prints defragmentation statistics. */
+void
+defrag_print_stats (void) {
+	if (!filesys_defrag)
+		return;
+	printf ("Defrag: %"PRIu64" passes, %"PRIu64" files moved, %"PRIu64
+			" sectors moved\n", defrag_passes, defrag_files, defrag_sectors);
+}
+
+/* One pass: moves the scattered data of the next batch of files,
+ * then queues itself again for after a pause. */
+static void
+defrag_run (void *aux UNUSED) {
+	struct dir_info entries[DEFRAG_BATCH];
+	size_t budget = DEFRAG_PASS_SECTORS;
+	struct dir *dir = dir_open_root ();
+	size_t cnt, i;
+
+	if (dir != NULL) {
+		dir_seek (dir, defrag_cursor);
+		cnt = dir_read_entries (dir, entries, DEFRAG_BATCH);
+		defrag_cursor = cnt < DEFRAG_BATCH ? 0 : dir_tell (dir);
+		for (i = 0; i < cnt && budget > 0 && !defrag_stopping; i++) {
+			struct inode *inode;
+			size_t moved;
+
+			/* Looked up by name, for the file may have been removed
+			 * since its entry was read. */
+			if (!dir_lookup (dir, entries[i].name, &inode))
+				continue;
+			moved = inode_defrag (inode, budget);
+			inode_close (inode);
+			if (moved > 0) {
+				defrag_files++;
+				defrag_sectors += moved;
+				budget -= moved;
+			}
+		}
+		dir_close (dir);
+	}
+	defrag_passes++;
+
+	if (!defrag_stopping)
+		work_queue_delayed (&defrag_work,
+				DIV_ROUND_UP (DEFRAG_SLEEP_MS * TIMER_FREQ, 1000));
+}
@@ -0,0 +1,223 @@
+/* dentry.c: Cache of name lookups in directories.
+ *
+ * Maps a directory's inode sector and a name in it to the inode
+ * sector the name refers to, or records that the name is absent, so
+ * that resolving a name seen lately reads neither the directory nor
+ * its index.  The cache holds DENTRY_CNT entries, reused least
+ * recently used first.
+ *
+ * The directory code keeps the cache right: it fills it from lookups
+ * with the directory's inode lock held for reading, and updates it
+ * with the lock held for writing in dir_add() and dir_remove().  A
+ * directory created in a sector drops whatever was cached for the
+ * sector's earlier owner.
+ *
+ * A name found to be a symbolic link also keeps the path the link
+ * points to, so that a lookup following it opens no inode and reads
+ * nothing.  Whatever else is recorded for the name later forgets it. */
+
+#include "filesys/dentry.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+
+struct dentry {
+	struct hash_elem elem;      /* Element in dentries, if in use. */
+	struct list_elem lru_elem;  /* Element in lru. */
+	bool in_use;
+	disk_sector_t dir;          /* Directory's inode sector. */
+	char name[NAME_MAX + 1];
+	bool absent;                /* Name known not to be in DIR? */
+	disk_sector_t sector;       /* Otherwise, its inode sector. */
+	bool is_link;               /* A symbolic link to LINK? */
+	char link[SYMLINK_MAX + 1];
+};
+
+static struct dentry pool[DENTRY_CNT];
+static struct hash dentries;    /* In-use entries, by DIR and NAME. */
+static struct list lru;         /* All entries, least recently used last. */
+static struct lock dentry_lock; /* Protects all the above. */
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, elem);
+
+	return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, elem);
+
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the dentry cache. */
+void
+dentry_init (void) {
+	size_t i;
+
+	if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+		PANIC ("dentry cache initialization failed");
+	list_init (&lru);
+	lock_init (&dentry_lock);
+	for (i = 0; i < DENTRY_CNT; i++)
+		list_push_back (&lru, &pool[i].lru_elem);
+}
+
+/* Returns the entry for NAME in DIR, marking it recently used, or a
+ * null pointer if there is none.  Must be called with dentry_lock
+ * held. */
+static struct dentry *
+dentry_find (disk_sector_t dir, const char *name) {
+	struct dentry key, *d;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.elem);
+	if (e == NULL)
+		return NULL;
+
+	d = hash_entry (e, struct dentry, elem);
+	list_remove (&d->lru_elem);
+	list_push_front (&lru, &d->lru_elem);
+	return d;
+}
+
+/* Frees D for reuse.  Must be called with dentry_lock held. */
+static void
+dentry_drop (struct dentry *d) {
+	hash_delete (&dentries, &d->elem);
+	d->in_use = false;
+	list_remove (&d->lru_elem);
+	list_push_back (&lru, &d->lru_elem);
+}
+
+/* Looks NAME up in DIR.  Returns DENTRY_FOUND, setting *SECTOR to
+ * its inode sector, if the name is known to be in the directory, and
+ * DENTRY_ABSENT if it is known not to be.  Returns DENTRY_UNKNOWN
+ * otherwise. */
+enum dentry_result
+dentry_lookup (disk_sector_t dir, const char *name, disk_sector_t *sector) {
+	enum dentry_result result = DENTRY_UNKNOWN;
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return DENTRY_UNKNOWN;
+
+	lock_acquire (&dentry_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL) {
+		result = d->absent ? DENTRY_ABSENT : DENTRY_FOUND;
+		*sector = d->sector;
+	}
+	lock_release (&dentry_lock);
+	return result;
+}
+
+/* Records that NAME in DIR is absent if ABSENT, or else refers to
+ * the inode in SECTOR. */
+static void
+dentry_set (disk_sector_t dir, const char *name, bool absent,
+		disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dentry_lock);
+	d = dentry_find (dir, name);
+	if (d == NULL) {
+		d = list_entry (list_back (&lru), struct dentry, lru_elem);
+		if (d->in_use)
+			dentry_drop (d);
+		d->in_use = true;
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->elem);
+		list_remove (&d->lru_elem);
+		list_push_front (&lru, &d->lru_elem);
+	}
+	d->absent = absent;
+	d->sector = sector;
+	d->is_link = false;
+	lock_release (&dentry_lock);
+}
+
+/* Looks NAME up in DIR.  Returns true, storing the path it points to
+ * in TARGET, if NAME is known to be a symbolic link, and false if
+ * that is not known. */
+bool
+dentry_lookup_link (disk_sector_t dir, const char *name,
+		char target[SYMLINK_MAX + 1]) {
+	struct dentry *d;
+	bool found = false;
+
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	lock_acquire (&dentry_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL && d->is_link) {
+		strlcpy (target, d->link, SYMLINK_MAX + 1);
+		found = true;
+	}
+	lock_release (&dentry_lock);
+	return found;
+}
+
+/* Records that NAME in DIR, if the cache has it referring to the
+ * inode in SECTOR, is a symbolic link to TARGET.  The caller must
+ * hold that inode open, so that the sector cannot have been reused
+ * by another file of the same name since the cache was filled. */
+void
+dentry_mark_link (disk_sector_t dir, const char *name,
+		disk_sector_t sector, const char *target) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dentry_lock);
+	d = dentry_find (dir, name);
+	if (d != NULL && !d->absent && d->sector == sector) {
+		d->is_link = true;
+		strlcpy (d->link, target, sizeof d->link);
+	}
+	lock_release (&dentry_lock);
+}
+
+/* Records that NAME in DIR refers to the inode in SECTOR. */
+void
+dentry_insert (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	dentry_set (dir, name, false, sector);
+}
+
+/* Records that NAME is not in DIR. */
+void
+dentry_insert_absent (disk_sector_t dir, const char *name) {
+	dentry_set (dir, name, true, 0);
+}
+
+/* Forgets every name cached for DIR, which is about to be reused for
+ * a new directory.  Takes time in the size of the cache, so it is
+ * left for the rare event of a directory's creation. */
+void
+dentry_invalidate_dir (disk_sector_t dir) {
+	size_t i;
+
+	lock_acquire (&dentry_lock);
+	for (i = 0; i < DENTRY_CNT; i++)
+		if (pool[i].in_use && pool[i].dir == dir)
+			dentry_drop (&pool[i]);
+	lock_release (&dentry_lock);
+}
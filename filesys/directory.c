@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dentry.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,10 +22,224 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* In-memory index of a directory's entries, so that looking up a
+ * name or finding a slot for a new one does not scan the directory.
+ * The directory on disk keeps the plain array of dir_entry's; an
+ * index is built from it with one pass over the array the first time
+ * it is needed, and kept in step by dir_add() and dir_remove(), the
+ * only writers of a directory.  Indexes outlive the opens of their
+ * directory, so one directory opened by every path lookup keeps its
+ * index, and are dropped least recently used first. */
+struct dir_index {
+	disk_sector_t sector;               /* Directory's inode sector. */
+	struct hash names;                  /* index_entry's, by name. */
+	off_t *free_slots;                  /* Offsets of unused entries. */
+	size_t free_cnt, free_cap;
+	off_t end;                          /* Offset past the last entry. */
+	struct list_elem lru_elem;          /* Element in dir_indexes. */
+};
+
+/* An in-use entry of a directory, in its dir_index. */
+struct index_entry {
+	struct hash_elem elem;
+	off_t ofs;                          /* Offset of the dir_entry. */
+	disk_sector_t inode_sector;
+	char name[NAME_MAX + 1];
+};
+
+/* Maximum number of directories indexed at once. */
+#define DIR_INDEX_MAX 16
+
+/* Indexes, most recently used first.  DIR_INDEX_LOCK protects the
+ * list and every index in it; the directory's inode lock, taken
+ * first, orders a lookup against changes to the directory. */
+static struct list dir_indexes;
+static size_t dir_index_cnt;
+static struct lock dir_index_lock;
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	list_init (&dir_indexes);
+	lock_init (&dir_index_lock);
+	dentry_init ();
+}
+
+static uint64_t
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return strcmp (hash_entry (a, struct index_entry, elem)->name,
+			hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+static void
+index_entry_free (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Frees INDEX, which must not be in dir_indexes. */
+static void
+dir_index_destroy (struct dir_index *index) {
+	hash_destroy (&index->names, index_entry_free);
+	free (index->free_slots);
+	free (index);
+}
+
+/* Adds an entry for NAME, whose inode is in INODE_SECTOR, at OFS to
+ * INDEX.  Returns false if memory runs out. */
+static bool
+dir_index_insert (struct dir_index *index, const char *name,
+		disk_sector_t inode_sector, off_t ofs) {
+	struct index_entry *ie = malloc (sizeof *ie);
+
+	if (ie == NULL)
+		return false;
+	ie->ofs = ofs;
+	ie->inode_sector = inode_sector;
+	strlcpy (ie->name, name, sizeof ie->name);
+	if (hash_insert (&index->names, &ie->elem) != NULL)
+		free (ie);
+	return true;
+}
+
+/* Remembers OFS in INDEX as an unused slot.  Returns false if memory
+ * runs out. */
+static bool
+dir_index_push_free (struct dir_index *index, off_t ofs) {
+	if (index->free_cnt == index->free_cap) {
+		size_t cap = index->free_cap > 0 ? 2 * index->free_cap : 8;
+		off_t *slots = realloc (index->free_slots, cap * sizeof *slots);
+
+		if (slots == NULL)
+			return false;
+		index->free_slots = slots;
+		index->free_cap = cap;
+	}
+	index->free_slots[index->free_cnt++] = ofs;
+	return true;
+}
+
+/* Returns INDEX's entry for NAME, or a null pointer if there is none. */
+static struct index_entry *
+dir_index_find (struct dir_index *index, const char *name) {
+	struct index_entry key;
+	struct hash_elem *e;
+
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&index->names, &key.elem);
+	return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Entries read at a time while building an index: a whole number of
+ * sectors, so that each read but the last fills its sectors. */
+#define INDEX_CHUNK_ENTRIES (DISK_SECTOR_SIZE * 5 / sizeof (struct dir_entry))
+
+/* Builds an index of DIR from its entries on disk.  Returns a null
+ * pointer if memory runs out. */
+static struct dir_index *
+dir_index_build (const struct dir *dir) {
+	struct dir_index *index = calloc (1, sizeof *index);
+	struct dir_entry *chunk = malloc (INDEX_CHUNK_ENTRIES * sizeof *chunk);
+	off_t ofs = 0;
+
+	if (index == NULL || chunk == NULL
+			|| !hash_init (&index->names, index_entry_hash, index_entry_less,
+				NULL)) {
+		free (chunk);
+		free (index);
+		return NULL;
+	}
+	index->sector = inode_get_inumber (dir->inode);
+
+	for (;;) {
+		off_t n = inode_read_at (dir->inode, chunk,
+				INDEX_CHUNK_ENTRIES * sizeof *chunk, ofs);
+		size_t i;
+
+		for (i = 0; i < n / sizeof *chunk; i++, ofs += sizeof *chunk) {
+			struct dir_entry *e = &chunk[i];
+			bool ok = e->in_use
+				? dir_index_insert (index, e->name, e->inode_sector, ofs)
+				: dir_index_push_free (index, ofs);
+
+			if (!ok) {
+				free (chunk);
+				dir_index_destroy (index);
+				return NULL;
+			}
+		}
+		if ((size_t) n < INDEX_CHUNK_ENTRIES * sizeof *chunk)
+			break;
+	}
+	index->end = ofs;
+	free (chunk);
+	return index;
+}
+
+/* Returns the index of DIR, building it if it is not indexed, or a
+ * null pointer if memory runs out.  Must be called with
+ * dir_index_lock held. */
+static struct dir_index *
+dir_index_get (const struct dir *dir) {
+	disk_sector_t sector = inode_get_inumber (dir->inode);
+	struct dir_index *index;
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&dir_index_lock));
+	for (e = list_begin (&dir_indexes); e != list_end (&dir_indexes);
+			e = list_next (e)) {
+		index = list_entry (e, struct dir_index, lru_elem);
+		if (index->sector == sector) {
+			list_remove (e);
+			list_push_front (&dir_indexes, e);
+			return index;
+		}
+	}
+
+	index = dir_index_build (dir);
+	if (index == NULL)
+		return NULL;
+	list_push_front (&dir_indexes, &index->lru_elem);
+	if (++dir_index_cnt > DIR_INDEX_MAX) {
+		dir_index_destroy (list_entry (list_pop_back (&dir_indexes),
+					struct dir_index, lru_elem));
+		dir_index_cnt--;
+	}
+	return index;
+}
+
+/* Drops the index of the directory in SECTOR, if there is one: the
+ * sector is about to hold a new directory. */
+static void
+dir_index_invalidate (disk_sector_t sector) {
+	struct list_elem *e;
+
+	lock_acquire (&dir_index_lock);
+	for (e = list_begin (&dir_indexes); e != list_end (&dir_indexes);
+			e = list_next (e)) {
+		struct dir_index *index = list_entry (e, struct dir_index, lru_elem);
+
+		if (index->sector == sector) {
+			list_remove (e);
+			dir_index_destroy (index);
+			dir_index_cnt--;
+			break;
+		}
+	}
+	lock_release (&dir_index_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
+	dir_index_invalidate (sector);
+	dentry_invalidate_dir (sector);
 	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
 }
 
@@ -32,6 +249,7 @@ struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
+		inode_set_journaled (inode);
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
@@ -79,12 +297,33 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	struct dir_index *index;
 	struct dir_entry e;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	lock_acquire (&dir_index_lock);
+	index = dir_index_get (dir);
+	if (index != NULL) {
+		struct index_entry *ie = dir_index_find (index, name);
+
+		if (ie != NULL) {
+			if (ep != NULL) {
+				ep->inode_sector = ie->inode_sector;
+				strlcpy (ep->name, ie->name, sizeof ep->name);
+				ep->in_use = true;
+			}
+			if (ofsp != NULL)
+				*ofsp = ie->ofs;
+		}
+		lock_release (&dir_index_lock);
+		return ie != NULL;
+	}
+	lock_release (&dir_index_lock);
+
+	/* Out of memory for an index: scan the entries. */
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -104,15 +343,32 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector, sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	dir_sector = inode_get_inumber (dir->inode);
+	inode_acquire_read (dir->inode);
+	switch (dentry_lookup (dir_sector, name, &sector)) {
+		case DENTRY_FOUND:
+			*inode = inode_open (sector);
+			break;
+		case DENTRY_ABSENT:
+			*inode = NULL;
+			break;
+		case DENTRY_UNKNOWN:
+			if (lookup (dir, name, &e, NULL)) {
+				dentry_insert (dir_sector, name, e.inode_sector);
+				*inode = inode_open (e.inode_sector);
+			} else {
+				dentry_insert_absent (dir_sector, name);
+				*inode = NULL;
+			}
+			break;
+	}
+	inode_release_read (dir->inode);
 
 	return *inode != NULL;
 }
@@ -125,6 +381,7 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_index *index;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -137,20 +394,28 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 		return false;
 
 	/* Check that NAME is not in use. */
+	inode_acquire_write (dir->inode);
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
 
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
+	/* Set OFS to offset of free slot, taken from the index if there
+	 * is one.  If there are no free slots, then it will be set to the
 	 * current end-of-file.
 
 	 * inode_read_at() will only return a short read at end of file.
 	 * Otherwise, we'd need to verify that we didn't get a short
 	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
+	lock_acquire (&dir_index_lock);
+	index = dir_index_get (dir);
+	if (index != NULL)
+		ofs = index->free_cnt > 0
+			? index->free_slots[index->free_cnt - 1] : index->end;
+	else
+		for (ofs = 0;
+				inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+				ofs += sizeof e)
+			if (!e.in_use)
+				break;
 
 	/* Write slot. */
 	e.in_use = true;
@@ -158,7 +423,24 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+	/* Record it in the index, or drop an index that cannot. */
+	if (success && index != NULL) {
+		if (index->free_cnt > 0 && index->free_slots[index->free_cnt - 1] == ofs)
+			index->free_cnt--;
+		else
+			index->end = ofs + sizeof e;
+		if (!dir_index_insert (index, name, inode_sector, ofs)) {
+			list_remove (&index->lru_elem);
+			dir_index_destroy (index);
+			dir_index_cnt--;
+		}
+	}
+	lock_release (&dir_index_lock);
+	if (success)
+		dentry_insert (inode_get_inumber (dir->inode), name, inode_sector);
+
 done:
+	inode_release_write (dir->inode);
 	return success;
 }
 
@@ -167,6 +449,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_index *index;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -176,6 +459,7 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
+	inode_acquire_write (dir->inode);
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
 
@@ -189,28 +473,105 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
+	/* Update the index.  It need not hold the free slot, so memory
+	 * running out just loses the slot to dir_add() until the index is
+	 * rebuilt. */
+	lock_acquire (&dir_index_lock);
+	index = dir_index_get (dir);
+	if (index != NULL) {
+		struct index_entry *ie = dir_index_find (index, name);
+
+		if (ie != NULL) {
+			hash_delete (&index->names, &ie->elem);
+			free (ie);
+		}
+		dir_index_push_free (index, ofs);
+	}
+	lock_release (&dir_index_lock);
+
+	dentry_insert_absent (inode_get_inumber (dir->inode), name);
+
 	/* Remove inode. */
 	inode_remove (inode);
 	success = true;
 
 done:
+	inode_release_write (dir->inode);
 	inode_close (inode);
 	return success;
 }
 
+/* Entries dir_read_entries() reads from the directory at a time:
+ * as many whole ones as DIR_READ_SECTORS sectors hold. */
+#define DIR_READ_SECTORS 4
+#define DIR_READ_CNT (DIR_READ_SECTORS * DISK_SECTOR_SIZE \
+		/ sizeof (struct dir_entry))
+
+/* Stores in INFOS the names and inode numbers of the next CNT entries
+ * in use in DIR, or as many as there are, and returns how many it
+ * stored: 0 once DIR has no more.  Unlike dir_readdir(), which reads
+ * one entry at a time, reads DIR_READ_CNT entries with each read of
+ * the directory, so that listing a large directory costs a read per
+ * few sectors. */
+size_t
+dir_read_entries (struct dir *dir, struct dir_info *infos, size_t cnt) {
+	struct dir_entry *buf = malloc (DIR_READ_CNT * sizeof *buf);
+	size_t n = 0;
+
+	if (buf == NULL)
+		return 0;
+	inode_acquire_read (dir->inode);
+	while (n < cnt) {
+		off_t got = inode_read_at (dir->inode, buf, DIR_READ_CNT * sizeof *buf,
+				dir->pos);
+		size_t i, read_cnt = got / sizeof *buf;
+
+		if (read_cnt == 0)
+			break;
+		for (i = 0; i < read_cnt && n < cnt; i++)
+			if (buf[i].in_use) {
+				infos[n].inumber = buf[i].inode_sector;
+				strlcpy (infos[n].name, buf[i].name, sizeof infos[n].name);
+				n++;
+			}
+		dir->pos += i * sizeof *buf;
+	}
+	inode_release_read (dir->inode);
+	free (buf);
+	return n;
+}
+
+/* Sets the position in DIR, where dir_readdir() and
+ * dir_read_entries() read next, to POS, a value of dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos) {
+	ASSERT (pos >= 0);
+	dir->pos = pos;
+}
+
+/* Returns the position in DIR, for dir_seek(). */
+off_t
+dir_tell (struct dir *dir) {
+	return dir->pos;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
  * NAME.  Returns true if successful, false if the directory
  * contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
+	inode_acquire_read (dir->inode);
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
+			break;
 		}
 	}
-	return false;
+	inode_release_read (dir->inode);
+	return found;
 }
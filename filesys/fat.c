@@ -1,5 +1,6 @@
 #include "filesys/fat.h"
-#include "devices/disk.h"
+#include <bitmap.h>
+#include "devices/block.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
@@ -16,20 +17,30 @@ struct fat_boot {
 	unsigned int root_dir_cluster;
 };
 
-/* FAT FS */
+/* FAT FS.  The whole FAT is kept in memory, from fat_open() or
+ * fat_create() on, and written back sector by sector, only those
+ * changed since, by fat_flush(). */
 struct fat_fs {
 	struct fat_boot bs;
 	unsigned int *fat;
-	unsigned int fat_length;
-	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	unsigned int fat_length;             /* Entries in FAT; cluster 0 is
+	                                        not one, as 0 marks a free entry. */
+	disk_sector_t data_start;            /* Sector of cluster 1. */
+	cluster_t last_clst;                 /* Where allocation looks first. */
+	struct bitmap *free_clusters;        /* Set for each free cluster. */
+	struct bitmap *dirty;                /* Set for each changed FAT sector. */
+	struct lock write_lock;              /* Protects all the members above. */
 };
 
+/* FAT entries in a sector. */
+#define ENTRIES_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_tables_init (bool all_dirty);
+static void fat_set (cluster_t clst, cluster_t val);
 
 void
 fat_init (void) {
@@ -41,7 +52,7 @@ fat_init (void) {
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	block_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
 	free (bounce);
 
@@ -65,19 +76,20 @@ fat_open (void) {
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_read;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
+			block_read (filesys_disk, fat_fs->bs.fat_start + i,
 			           buffer + bytes_read);
 			bytes_read += DISK_SECTOR_SIZE;
 		} else {
 			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
 			if (bounce == NULL)
 				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+			block_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
 			memcpy (buffer + bytes_read, bounce, bytes_left);
 			bytes_read += bytes_left;
 			free (bounce);
 		}
 	}
+	fat_tables_init (false);
 }
 
 void
@@ -87,30 +99,44 @@ fat_close (void) {
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
 	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	block_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	fat_flush ();
+}
+
+/* Writes the FAT sectors changed since the last flush back to disk.
+ * Called by fat_close() and, along with the buffer cache, by the page
+ * cache daemon. */
+void
+fat_flush (void) {
+	const size_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
+	uint8_t *bounce = NULL;
+	size_t i;
+
+	if (fat_fs == NULL || fat_fs->dirty == NULL)
+		return;
+	lock_acquire (&fat_fs->write_lock);
+	for (i = 0; (i = bitmap_scan (fat_fs->dirty, i, 1, true)) != BITMAP_ERROR;
+			i++) {
+		size_t ofs = i * DISK_SECTOR_SIZE;
+
+		bitmap_reset (fat_fs->dirty, i);
+		if (ofs + DISK_SECTOR_SIZE <= fat_size_in_bytes)
+			block_write (filesys_disk, fat_fs->bs.fat_start + i, buffer + ofs);
+		else {
+			/* The last sector, of which the FAT fills only part. */
 			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
+				bounce = calloc (1, DISK_SECTOR_SIZE);
+			if (bounce == NULL)
+				PANIC ("FAT flush failed");
+			memcpy (bounce, buffer + ofs, fat_size_in_bytes - ofs);
+			block_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
 		}
 	}
+	lock_release (&fat_fs->write_lock);
+	free (bounce);
 }
 
 void
@@ -123,6 +149,7 @@ fat_create (void) {
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_tables_init (true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -131,19 +158,19 @@ fat_create (void) {
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	block_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
 	free (buf);
 }
 
 void
 fat_boot_create (void) {
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
+	    (block_size (filesys_disk) - 1)
 	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
 	fat_fs->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
 	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
-	    .total_sectors = disk_size (filesys_disk),
+	    .total_sectors = block_size (filesys_disk),
 	    .fat_start = 1,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
@@ -152,42 +179,215 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	size_t clusters;
+
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	clusters = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER;
+	fat_fs->fat_length = clusters + 1;
+	if (fat_fs->fat_length > fat_fs->bs.fat_sectors * ENTRIES_PER_SECTOR)
+		fat_fs->fat_length = fat_fs->bs.fat_sectors * ENTRIES_PER_SECTOR;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* Sets up the free cluster and dirty sector bitmaps of the FAT just
+ * loaded or created, marking every FAT sector dirty if ALL_DIRTY. */
+static void
+fat_tables_init (bool all_dirty) {
+	cluster_t clst;
+
+	bitmap_destroy (fat_fs->free_clusters);
+	bitmap_destroy (fat_fs->dirty);
+	fat_fs->free_clusters = bitmap_create (fat_fs->fat_length);
+	fat_fs->dirty = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->free_clusters == NULL || fat_fs->dirty == NULL)
+		PANIC ("FAT tables allocation failed");
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] == 0)
+			bitmap_mark (fat_fs->free_clusters, clst);
+	bitmap_set_all (fat_fs->dirty, all_dirty);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Takes a free cluster for a chain whose tail is CLST, or for a new
+ * chain if CLST is 0: the one right after CLST if it is free, so that
+ * the chain stays contiguous, and otherwise the next free one from
+ * last_clst on.  Returns 0 if no cluster is free.  The caller must
+ * hold write_lock. */
+static cluster_t
+take_cluster (cluster_t clst) {
+	size_t nclst;
+
+	if (clst != 0 && clst + 1 < fat_fs->fat_length
+			&& bitmap_test (fat_fs->free_clusters, clst + 1)) {
+		nclst = clst + 1;
+		bitmap_reset (fat_fs->free_clusters, nclst);
+	} else {
+		nclst = bitmap_scan_and_flip_next_fit (fat_fs->free_clusters,
+				fat_fs->last_clst, 1, true);
+		if (nclst == BITMAP_ERROR)
+			return 0;
+	}
+	fat_fs->last_clst = nclst + 1 < fat_fs->fat_length ? nclst + 1 : 1;
+	return nclst;
+}
+
+/* Links NCLST, taken, to the end of the chain whose tail is CLST, or
+ * makes it a chain of its own if CLST is 0.  The caller must hold
+ * write_lock. */
+static void
+link_cluster (cluster_t clst, cluster_t nclst) {
+	fat_set (nclst, EOChain);
+	if (clst != 0)
+		fat_set (clst, nclst);
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
- * Returns 0 if fails to allocate a new cluster. */
+ * Returns 0 if fails to allocate a new cluster.
+ * CLST's chain gets the cluster right after it if that is free, and
+ * otherwise the next free one from the last one allocated. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t nclst;
+
+	lock_acquire (&fat_fs->write_lock);
+	nclst = take_cluster (clst);
+	if (nclst != 0)
+		link_cluster (clst, nclst);
+	lock_release (&fat_fs->write_lock);
+	return nclst;
+}
+
+/* Like fat_create_chain(), but takes the cluster from WINDOW,
+ * clusters set aside for CLST's chain, filling WINDOW first with up
+ * to FAT_WINDOW_SIZE clusters running on from the new one if it is
+ * empty.  Files growing at once then each grow into runs of their
+ * own instead of taking turns at the next free cluster.  The window
+ * must be given back with fat_window_release() once its chain stops
+ * growing, as when its file is closed. */
+cluster_t
+fat_create_chain_window (cluster_t clst, struct fat_window *window) {
+	cluster_t nclst;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (window->cnt > 0 && (clst == 0 || window->next == clst + 1)) {
+		nclst = window->next++;
+		window->cnt--;
+	} else {
+		/* The window does not follow CLST: give it back and start
+		 * a new one after the cluster taken. */
+		bitmap_set_multiple (fat_fs->free_clusters, window->next,
+				window->cnt, true);
+		window->cnt = 0;
+		nclst = take_cluster (clst);
+		if (nclst != 0) {
+			window->next = nclst + 1;
+			while (window->cnt < FAT_WINDOW_SIZE
+					&& window->next + window->cnt < fat_fs->fat_length
+					&& bitmap_test (fat_fs->free_clusters,
+						window->next + window->cnt)) {
+				bitmap_reset (fat_fs->free_clusters, window->next + window->cnt);
+				window->cnt++;
+			}
+		}
+	}
+	if (nclst != 0)
+		link_cluster (clst, nclst);
+	lock_release (&fat_fs->write_lock);
+	return nclst;
+}
+
+/* Gives back the clusters WINDOW still sets aside. */
+void
+fat_window_release (struct fat_window *window) {
+	if (window->cnt == 0)
+		return;
+	lock_acquire (&fat_fs->write_lock);
+	bitmap_set_multiple (fat_fs->free_clusters, window->next, window->cnt,
+			true);
+	window->cnt = 0;
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_set (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_fs->fat[clst];
+
+		fat_set (clst, 0);
+		bitmap_mark (fat_fs->free_clusters, clst);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
+}
+
+/* Sets CLST's entry to VAL, marking its sector dirty.  The caller
+ * must hold write_lock. */
+static void
+fat_set (cluster_t clst, cluster_t val) {
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
+	bitmap_mark (fat_fs->dirty, clst / ENTRIES_PER_SECTOR);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	fat_set (clst, val);
+	if (val != 0)
+		bitmap_reset (fat_fs->free_clusters, clst);
+	else
+		bitmap_mark (fat_fs->free_clusters, clst);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Returns the cluster N clusters into the chain starting at START,
+ * or 0 if the chain is shorter.  CURSOR remembers the cluster found,
+ * so a walk down the same chain, like reading a file sequentially,
+ * goes on from there instead of from START: O(1) per step rather
+ * than O(N).  A chain's clusters only change by growing at the end
+ * or by it being removed along with its file, so a cursor stays
+ * valid for as long as its chain does. */
+cluster_t
+fat_cursor_seek (struct fat_cursor *cursor, cluster_t start, size_t n) {
+	cluster_t clst = start;
+	size_t i = 0;
+
+	if (cursor->start == start && cursor->clst != 0 && cursor->idx <= n) {
+		clst = cursor->clst;
+		i = cursor->idx;
+	}
+	for (; i < n && clst != 0 && clst != EOChain; i++)
+		clst = fat_get (clst);
+	if (clst == 0 || clst == EOChain)
+		return 0;
+	cursor->start = start;
+	cursor->clst = clst;
+	cursor->idx = n;
+	return clst;
 }
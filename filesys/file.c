@@ -1,31 +1,89 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <round.h>
+#include "devices/block.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/inode.h"
+#include "filesys/pipe.h"
 #include "threads/malloc.h"
+#include "threads/waitq.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* Bounds of a file's read-ahead window, in sectors.  The window
+ * opens at READAHEAD_MIN on a sequential read, doubles with each
+ * further one up to READAHEAD_MAX, and closes on a seek. */
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX (BUFFER_CACHE_SIZE / 4)
 
 /* An open file. */
 struct file {
 	struct inode *inode;        /* File's inode. */
 	off_t pos;                  /* Current position. */
 	bool deny_write;            /* Has file_deny_write() been called? */
+	unsigned ref_cnt;           /* Number of file_close() calls to come. */
+	struct pipe *pipe;          /* Pipe of which this is an end, or null. */
+	bool pipe_writer;           /* Write end of PIPE? */
+	off_t ra_next;              /* Where a sequential read would start. */
+	off_t ra_end;               /* End of the bytes read ahead so far. */
+	size_t ra_window;           /* Read-ahead window, in sectors. */
+	bool direct;                /* Bypasses the buffer cache for whole
+	                               sectors?  See file_set_direct(). */
 };
 
+/* Object cache of open files. */
+static struct kmem_cache *file_slab;
+
+/* Initializes the file module. */
+void
+file_init (void) {
+	file_slab = kmem_cache_create ("file", sizeof (struct file), NULL);
+	if (file_slab == NULL)
+		PANIC ("file_init: out of memory");
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
  * allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) {
-	struct file *file = calloc (1, sizeof *file);
+	struct file *file = kmem_cache_alloc (file_slab);
 	if (inode != NULL && file != NULL) {
 		file->inode = inode;
 		file->pos = 0;
 		file->deny_write = false;
+		file->ref_cnt = 1;
+		file->pipe = NULL;
+		file->ra_next = file->ra_end = 0;
+		file->ra_window = 0;
+		file->direct = false;
 		return file;
 	} else {
 		inode_close (inode);
-		free (file);
+		kmem_cache_free (file_slab, file);
+		return NULL;
+	}
+}
+
+/* Opens a file for an end of PIPE, the write end if WRITER, else the
+ * read end, of which it takes ownership, and returns the new file.
+ * Returns a null pointer, closing the end, if an allocation fails. */
+struct file *
+file_open_pipe (struct pipe *pipe, bool writer) {
+	struct file *file = kmem_cache_alloc (file_slab);
+	if (file == NULL) {
+		pipe_close (pipe, writer);
 		return NULL;
 	}
+	file->inode = NULL;
+	file->pos = 0;
+	file->deny_write = false;
+	file->ref_cnt = 1;
+	file->pipe = pipe;
+	file->pipe_writer = writer;
+	file->direct = false;
+	return file;
 }
 
 /* Opens and returns a new file for the same inode as FILE.
@@ -39,22 +97,89 @@ file_reopen (struct file *file) {
  * same inode as FILE. Returns a null pointer if unsuccessful. */
 struct file *
 file_duplicate (struct file *file) {
-	struct file *nfile = file_open (inode_reopen (file->inode));
+	struct file *nfile;
+
+	if (file->pipe != NULL) {
+		pipe_open (file->pipe, file->pipe_writer);
+		return file_open_pipe (file->pipe, file->pipe_writer);
+	}
+	nfile = file_open (inode_reopen (file->inode));
 	if (nfile) {
 		nfile->pos = file->pos;
+		nfile->direct = file->direct;
 		if (file->deny_write)
 			file_deny_write (nfile);
 	}
 	return nfile;
 }
 
-/* Closes FILE. */
+/* Returns FILE, to be closed once more before it really closes,
+ * so that it may be shared by several file descriptors, which then
+ * share its position too. */
+struct file *
+file_dup (struct file *file) {
+	file->ref_cnt++;
+	return file;
+}
+
+/* Makes reads and writes of whole sectors of FILE go straight between
+ * the disk and the caller's buffer if DIRECT, bypassing the buffer
+ * cache.  Buffers passed to FILE must then be kernel memory, as the
+ * disk transfers to them. */
+void
+file_set_direct (struct file *file, bool direct) {
+	file->direct = direct;
+}
+
+/* Returns true if FILE bypasses the buffer cache. */
+bool
+file_is_direct (struct file *file) {
+	return file->direct;
+}
+
+/* Returns the number of file_close() calls to come for FILE: one,
+ * plus one for each file_dup() of it. */
+unsigned
+file_ref_cnt (struct file *file) {
+	return file->ref_cnt;
+}
+
+/* Returns true if FILE was shared with file_dup() and is not yet
+ * closed as many times. */
+bool
+file_is_shared (struct file *file) {
+	return file->ref_cnt > 1;
+}
+
+/* Returns true if FILE is an end of a pipe, which has no inode or
+ * position: only file_read(), file_write() and closing apply. */
+bool
+file_is_pipe (struct file *file) {
+	return file->pipe != NULL;
+}
+
+/* Returns the POLL* events of FILE that are ready.  An end of a pipe
+ * is ready as pipe_poll() says, adding E, if not null, for P, to the
+ * pipe's wait queue; any other file is always ready to be read and
+ * written, so E is not added anywhere. */
+int
+file_poll (struct file *file, struct poller *p, struct waitq_entry *e) {
+	if (file->pipe != NULL)
+		return pipe_poll (file->pipe, file->pipe_writer, p, e);
+	return POLLIN | POLLOUT;
+}
+
+/* Closes FILE, unless it is shared and has to be closed again. */
 void
 file_close (struct file *file) {
-	if (file != NULL) {
-		file_allow_write (file);
-		inode_close (file->inode);
-		free (file);
+	if (file != NULL && --file->ref_cnt == 0) {
+		if (file->pipe != NULL)
+			pipe_close (file->pipe, file->pipe_writer);
+		else {
+			file_allow_write (file);
+			inode_close (file->inode);
+		}
+		kmem_cache_free (file_slab, file);
 	}
 }
 
@@ -64,6 +189,37 @@ file_get_inode (struct file *file) {
 	return file->inode;
 }
 
+/* Notes that SIZE bytes of FILE were just read at POS.  A read
+ * starting where the previous one ended grows FILE's read-ahead
+ * window and asks for the part of the window past the bytes already
+ * read ahead to be prefetched; any other read closes the window. */
+static void
+readahead (struct file *file, off_t pos, off_t size) {
+	off_t start, end;
+
+	if (size == 0)
+		return;
+	if (pos != file->ra_next) {
+		file->ra_window = 0;
+		file->ra_end = 0;
+		file->ra_next = pos + size;
+		return;
+	}
+	if (file->ra_window == 0)
+		file->ra_window = READAHEAD_MIN;
+	else if (file->ra_window < READAHEAD_MAX)
+		file->ra_window *= 2;
+	file->ra_next = pos + size;
+
+	start = file->ra_end > file->ra_next ? file->ra_end : file->ra_next;
+	end = ROUND_UP (file->ra_next, DISK_SECTOR_SIZE)
+		+ (off_t) file->ra_window * DISK_SECTOR_SIZE;
+	if (start < end) {
+		inode_readahead (file->inode, start, end - start);
+		file->ra_end = end;
+	}
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
  * starting at the file's current position.
  * Returns the number of bytes actually read,
@@ -71,7 +227,13 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
-	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	off_t bytes_read;
+
+	if (file->pipe != NULL)
+		return file->pipe_writer ? 0 : pipe_read (file->pipe, buffer, size);
+	bytes_read = file_read_at (file, buffer, size, file->pos);
+	if (!file->direct)
+		readahead (file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,19 +245,31 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_read = file->direct
+		? inode_read_direct (file->inode, buffer, size, file_ofs)
+		: inode_read_at (file->inode, buffer, size, file_ofs);
+
+#ifdef VM
+	/* Mapped pages of the file may be newer than its sectors. */
+	vm_file_cache_read (inode_get_inumber (file->inode), buffer, bytes_read,
+			file_ofs);
+#endif
+	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at the file's current position.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
-	off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+	off_t bytes_written;
+
+	if (file->pipe != NULL)
+		return file->pipe_writer ? pipe_write (file->pipe, buffer, size) : 0;
+	bytes_written = file_write_at (file, buffer, size, file->pos);
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -103,14 +277,21 @@ file_write (struct file *file, const void *buffer, off_t size) {
 /* Writes SIZE bytes from BUFFER into FILE,
  * starting at offset FILE_OFS in the file.
  * Returns the number of bytes actually written,
- * which may be less than SIZE if end of file is reached.
- * (Normally we'd grow the file in that case, but file growth is
- * not yet implemented.)
+ * which may be less than SIZE if the disk fills up.
+ * Writing past end of file grows the file.
  * The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
 		off_t file_ofs) {
-	return inode_write_at (file->inode, buffer, size, file_ofs);
+	off_t bytes_written = file->direct
+		? inode_write_direct (file->inode, buffer, size, file_ofs)
+		: inode_write_at (file->inode, buffer, size, file_ofs);
+
+#ifdef VM
+	vm_file_cache_write (inode_get_inumber (file->inode), buffer,
+			bytes_written, file_ofs);
+#endif
+	return bytes_written;
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -149,6 +330,8 @@ void
 file_seek (struct file *file, off_t new_pos) {
 	ASSERT (file != NULL);
 	ASSERT (new_pos >= 0);
+	if (file->inode != NULL && new_pos != file->pos)
+		inode_flush_combined (file->inode);
 	file->pos = new_pos;
 }
 
@@ -2,14 +2,21 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/defrag.h"
+#include "filesys/dentry.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
-#include "devices/disk.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
+#include "filesys/procfs.h"
+#include "filesys/tmpfs.h"
+#include "devices/block.h"
 
-/* The disk that contains the file system. */
-struct disk *filesys_disk;
+/* The block device that contains the file system. */
+struct block_device *filesys_disk;
 
 static void do_format (void);
 
@@ -17,11 +24,16 @@ static void do_format (void);
  * If FORMAT is true, reformats the file system. */
 void
 filesys_init (bool format) {
-	filesys_disk = disk_get (0, 1);
+	filesys_disk = block_get_role (BLOCK_FILESYS);
 	if (filesys_disk == NULL)
-		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
+		PANIC ("No file system device found, can't initialize file system.");
 
+	buffer_cache_init ();
 	inode_init ();
+	file_init ();
+	dir_init ();
+	tmpfs_init ();
+	procfs_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -33,70 +45,177 @@ filesys_init (bool format) {
 #else
 	/* Original FS */
 	free_map_init ();
+	journal_init ();
 
 	if (format)
 		do_format ();
+	else if (!journal_open ())
+		printf ("filesys: no journal, metadata is written unlogged\n");
 
 	free_map_open ();
 #endif
+
+	/* Start the write-back and read-ahead daemon. */
+	pagecache_init ();
+#ifndef EFILESYS
+	defrag_init ();
+#endif
 }
 
 /* Shuts down the file system module, writing any unwritten data
  * to disk. */
 void
 filesys_done (void) {
+	defrag_done ();
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
 	free_map_close ();
 #endif
+	inode_flush_all ();
+	journal_done ();
+	buffer_cache_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
  * Returns true if successful, false otherwise.
  * Fails if a file named NAME already exists,
- * or if internal memory allocation fails. */
+ * or if internal memory allocation fails.
+ * A NAME in a mounted tmpfs makes a file of the tmpfs; one in the
+ * procfs fails, as it is read-only. */
 bool
 filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
+	struct dir *dir;
+	bool success;
+
+	if (procfs_owns (name))
+		return false;
+	if (tmpfs_owns (name))
+		return tmpfs_create (name, initial_size);
+
+	/* The inode goes to the emptiest allocation group, whose room
+	 * its data will take. */
+	dir = dir_open_root ();
+	journal_begin ();
+	success = (dir != NULL
+			&& free_map_allocate_near (free_map_emptiest_group (), 1,
+				&inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
+	journal_end ();
+	dir_close (dir);
+
+	return success;
+}
+
+/* Creates a symbolic link named LINKPATH that points to TARGET.
+ * TARGET need not exist; it is looked up whenever the link is
+ * opened.  Fails if TARGET is empty or longer than SYMLINK_MAX, if
+ * LINKPATH already exists or is in a tmpfs or the procfs, or if
+ * memory or disk space runs out. */
+bool
+filesys_symlink (const char *target, const char *linkpath) {
+	disk_sector_t inode_sector = 0;
+	struct dir *dir;
+	bool success;
+
+	if (*target == '\0' || strlen (target) > SYMLINK_MAX
+			|| tmpfs_owns (linkpath) || procfs_owns (linkpath))
+		return false;
+
+	dir = dir_open_root ();
+	journal_begin ();
+	success = (dir != NULL
+			&& free_map_allocate_near (ROOT_DIR_SECTOR, 1, &inode_sector)
+			&& inode_create_symlink (inode_sector, target)
+			&& dir_add (dir, linkpath, inode_sector));
+	if (!success && inode_sector != 0)
+		free_map_release (inode_sector, 1);
+	journal_end ();
 	dir_close (dir);
 
 	return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the inode NAME refers to, following symbolic links, at most
+ * SYMLOOP_MAX of them, to the file at the end.  A link found on the
+ * way is remembered in the dentry cache along with its target, so
+ * that following it again costs neither an inode open nor a read.
+ * Returns a null pointer if a name is missing or the links loop. */
+static struct inode *
+lookup_follow (const char *name) {
+	char path[SYMLINK_MAX + 1];
+	struct inode *inode;
+	struct dir *dir;
+	int depth;
+
+	for (depth = 0; ; depth++) {
+		const char *target;
+
+		if (tmpfs_owns (name))
+			return tmpfs_open (name);
+		if (procfs_owns (name))
+			return procfs_open (name);
+		if (depth > SYMLOOP_MAX)
+			return NULL;
+		if (dentry_lookup_link (ROOT_DIR_SECTOR, name, path)) {
+			name = path;
+			continue;
+		}
+
+		inode = NULL;
+		dir = dir_open_root ();
+		if (dir != NULL)
+			dir_lookup (dir, name, &inode);
+		dir_close (dir);
+		if (inode == NULL || !inode_is_symlink (inode))
+			return inode;
+
+		target = inode_readlink (inode);
+		if (target == NULL) {
+			inode_close (inode);
+			return NULL;
+		}
+		dentry_mark_link (ROOT_DIR_SECTOR, name, inode_get_inumber (inode),
+				target);
+		strlcpy (path, target, sizeof path);
+		inode_close (inode);
+		name = path;
+	}
+}
+
+/* Opens the file with the given NAME, following symbolic links.
  * Returns the new file if successful or a null pointer
  * otherwise.
- * Fails if no file named NAME exists,
+ * Fails if no file named NAME exists, if symbolic links loop,
  * or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name) {
-	struct dir *dir = dir_open_root ();
-	struct inode *inode = NULL;
-
-	if (dir != NULL)
-		dir_lookup (dir, name, &inode);
-	dir_close (dir);
-
-	return file_open (inode);
+	return file_open (lookup_follow (name));
 }
 
 /* Deletes the file named NAME.
  * Returns true if successful, false on failure.
- * Fails if no file named NAME exists,
+ * Fails if no file named NAME exists, if it is in the procfs,
  * or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) {
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	struct dir *dir;
+	bool success;
+
+	if (procfs_owns (name))
+		return false;
+	if (tmpfs_owns (name))
+		return tmpfs_remove (name);
+
+	dir = dir_open_root ();
+	journal_begin ();
+	success = dir != NULL && dir_remove (dir, name);
+	journal_end ();
 	dir_close (dir);
 
 	return success;
@@ -112,6 +231,7 @@ do_format (void) {
 	fat_create ();
 	fat_close ();
 #else
+	journal_create ();
 	free_map_create ();
 	if (!dir_create (ROOT_DIR_SECTOR, 16))
 		PANIC ("root directory creation failed");
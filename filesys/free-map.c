@@ -1,21 +1,71 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Allocation groups: the disk is divided into groups of
+ * FREE_MAP_GROUP_SECTORS sectors, as in FFS, and a file's data is
+ * allocated in the group of its inode when there is room, so that
+ * reading a file after its inode seeks little.  New files' inodes
+ * go to the group with the most free sectors, which spreads files
+ * that grow side by side over the disk rather than interleaving
+ * them.
+ *
+ * The free map, one bit per disk sector, is kept a group at a time:
+ * a group's bits are read from the free map file the first time they
+ * are looked at, so that mounting a large disk reads none of them
+ * and memory holds the bits of the groups in use alone.  GROUP_FREE,
+ * the number of free sectors in each group, is small and kept whole,
+ * both in memory and in the free map file after the bits.  It is
+ * what allocation looks at first, so that full groups are skipped
+ * without their bits being read, and all-free groups need not be
+ * read at all.  Each change is written through to the file, the
+ * bytes of the bits changed and the counts of their groups only. */
+#define FREE_MAP_GROUP_SECTORS 1024
 
 static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct lock free_map_lock;    /* Protects all below and the file. */
+static size_t sector_cnt;            /* Sectors on the disk. */
+static size_t group_cnt;             /* Groups on the disk. */
+static struct bitmap **group_bits;   /* Each group's bits, or null until
+                                        they are read. */
+static uint16_t *group_free;         /* Free sectors in each group. */
+static off_t group_free_ofs;         /* Where GROUP_FREE is in the file. */
+
+static size_t group_size (size_t g);
+static struct bitmap *group_load (size_t g);
+static bool mark (disk_sector_t, size_t cnt, bool in_use);
+static void flip (disk_sector_t, size_t cnt, bool in_use);
+static bool write_bits (disk_sector_t, size_t cnt);
+static void group_account (disk_sector_t, size_t cnt, bool allocated);
+static disk_sector_t scan_run (size_t g, size_t cnt);
+static bool write_all (struct file *);
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
-	free_map = bitmap_create (disk_size (filesys_disk));
-	if (free_map == NULL)
-		PANIC ("bitmap creation failed--disk is too large");
-	bitmap_mark (free_map, FREE_MAP_SECTOR);
-	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	size_t g;
+
+	lock_init (&free_map_lock);
+	sector_cnt = block_size (filesys_disk);
+	group_cnt = DIV_ROUND_UP (sector_cnt, FREE_MAP_GROUP_SECTORS);
+	group_free_ofs = ROUND_UP (DIV_ROUND_UP (sector_cnt, 8), DISK_SECTOR_SIZE);
+	group_bits = calloc (group_cnt, sizeof *group_bits);
+	group_free = malloc (group_cnt * sizeof *group_free);
+	if (group_bits == NULL || group_free == NULL)
+		PANIC ("free map creation failed--disk is too large");
+	for (g = 0; g < group_cnt; g++)
+		group_free[g] = group_size (g);
+	if (!mark (FREE_MAP_SECTOR, 1, true) || !mark (ROOT_DIR_SECTOR, 1, true)
+			|| !mark (JOURNAL_SECTOR, JOURNAL_SECTORS, true))
+		PANIC ("free map creation failed");
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,37 +74,119 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
+	return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* Like free_map_allocate(), but prefers sectors in the allocation
+ * group of GOAL, then in the groups after it, before taking the
+ * first run there is anywhere.  A run may start in one group and
+ * end in the next. */
+bool
+free_map_allocate_near (disk_sector_t goal, size_t cnt,
+		disk_sector_t *sectorp) {
+	size_t g = goal < sector_cnt ? goal / FREE_MAP_GROUP_SECTORS : 0;
+	disk_sector_t sector;
+
+	lock_acquire (&free_map_lock);
+	sector = scan_run (g, cnt);
+	if (sector == BITMAP_ERROR && g > 0)
+		sector = scan_run (0, cnt);
+	if (sector != BITMAP_ERROR && !mark (sector, cnt, true))
 		sector = BITMAP_ERROR;
-	}
+	lock_release (&free_map_lock);
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Returns the first sector of the allocation group with the most
+ * free sectors, the lowest of those with as many, as the GOAL of
+ * free_map_allocate_near() for a new file's inode. */
+disk_sector_t
+free_map_emptiest_group (void) {
+	size_t g, best = 0;
+
+	lock_acquire (&free_map_lock);
+	for (g = 1; g < group_cnt; g++)
+		if (group_free[g] > group_free[best])
+			best = g;
+	lock_release (&free_map_lock);
+	return best * FREE_MAP_GROUP_SECTORS;
+}
+
+/* Allocates up to CNT consecutive sectors starting at SECTOR, as
+ * many as are free there, so that a file's last run of sectors may
+ * grow in place.
+ * Returns the number of sectors allocated, which is 0 if SECTOR is
+ * in use or past the end of the disk. */
+size_t
+free_map_allocate_at (disk_sector_t sector, size_t cnt) {
+	size_t free_cnt = 0;
+
+	lock_acquire (&free_map_lock);
+	if (sector >= sector_cnt) {
+		lock_release (&free_map_lock);
+		return 0;
+	}
+	if (cnt > sector_cnt - sector)
+		cnt = sector_cnt - sector;
+	while (free_cnt < cnt) {
+		size_t at = sector + free_cnt;
+		size_t g = at / FREE_MAP_GROUP_SECTORS;
+		size_t ofs = at % FREE_MAP_GROUP_SECTORS;
+		struct bitmap *b = group_load (g);
+		size_t end;
+
+		if (b == NULL)
+			break;
+		end = bitmap_scan (b, ofs, 1, true);
+		if (end == BITMAP_ERROR)
+			end = group_size (g);
+		free_cnt += end - ofs;
+		if (end < group_size (g))
+			break;
+	}
+	if (free_cnt > cnt)
+		free_cnt = cnt;
+	if (free_cnt > 0 && !mark (sector, free_cnt, true))
+		free_cnt = 0;
+	lock_release (&free_map_lock);
+	return free_cnt;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.  The
+ * journal forgets what it logged of them, as they may come to hold
+ * data. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
-	ASSERT (bitmap_all (free_map, sector, cnt));
-	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	lock_acquire (&free_map_lock);
+	journal_revoke (sector, cnt);
+	if (!mark (sector, cnt, false))
+		PANIC ("free_map_release: can't update free map");
+	lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Opens the free map file and reads the free counts of the groups
+ * from it.  The groups' bits are read as they are needed. */
 void
 free_map_open (void) {
+	off_t size = group_cnt * sizeof *group_free;
+	size_t g;
+
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
-	if (!bitmap_read (free_map, free_map_file))
+	inode_set_journaled (file_get_inode (free_map_file));
+	/* Forget what free_map_init() or do_format() left in memory. */
+	for (g = 0; g < group_cnt; g++) {
+		bitmap_destroy (group_bits[g]);
+		group_bits[g] = NULL;
+	}
+	if (file_read_at (free_map_file, group_free, size, group_free_ofs) != size)
 		PANIC ("can't read free map");
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file, which is up to date already. */
 void
 free_map_close (void) {
 	file_close (free_map_file);
@@ -64,14 +196,220 @@ free_map_close (void) {
  * it. */
 void
 free_map_create (void) {
+	struct file *file;
+
 	/* Create inode. */
-	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+	if (!inode_create (FREE_MAP_SECTOR,
+				group_free_ofs + group_cnt * sizeof *group_free))
 		PANIC ("free map creation failed");
 
-	/* Write bitmap to file. */
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-	if (free_map_file == NULL)
+	/* Write the free map to the file twice: first while free_map_file
+	 * is null, which gives the file all of its sectors without the
+	 * sectors' allocation writing to the file itself, and then with
+	 * those allocations in it, after which every change is written
+	 * through in place. */
+	file = file_open (inode_open (FREE_MAP_SECTOR));
+	if (file == NULL)
 		PANIC ("can't open free map");
-	if (!bitmap_write (free_map, free_map_file))
+	inode_set_journaled (file_get_inode (file));
+	if (!write_all (file))
+		PANIC ("can't write free map");
+	free_map_file = file;
+	if (!write_all (file))
 		PANIC ("can't write free map");
 }
+
+/* Returns the number of sectors in group G, which is
+ * FREE_MAP_GROUP_SECTORS but for the last group. */
+static size_t
+group_size (size_t g) {
+	size_t left = sector_cnt - g * FREE_MAP_GROUP_SECTORS;
+
+	return left < FREE_MAP_GROUP_SECTORS ? left : FREE_MAP_GROUP_SECTORS;
+}
+
+/* Returns the bits of group G, reading them from the free map file
+ * if they are not in memory yet.  A group with no sector in use is
+ * not read, as its bits are all zeros.  Returns a null pointer if
+ * memory runs out or the bits cannot be read. */
+static struct bitmap *
+group_load (size_t g) {
+	struct bitmap *b = group_bits[g];
+
+	ASSERT (g < group_cnt);
+	if (b != NULL)
+		return b;
+	b = bitmap_create (group_size (g));
+	if (b == NULL)
+		return NULL;
+	if (free_map_file != NULL && group_free[g] != group_size (g)
+			&& !bitmap_read_at (b, free_map_file,
+				g * (FREE_MAP_GROUP_SECTORS / 8))) {
+		bitmap_destroy (b);
+		return NULL;
+	}
+	group_bits[g] = b;
+	return b;
+}
+
+/* Marks the CNT sectors starting at SECTOR, none of which may be
+ * IN_USE yet, as IN_USE, in memory and in the free map file if it is
+ * open.  Returns false, changing nothing in memory, if memory runs
+ * out or the file cannot be written. */
+static bool
+mark (disk_sector_t sector, size_t cnt, bool in_use) {
+	size_t g;
+
+	ASSERT (cnt > 0 && sector + cnt <= sector_cnt);
+	for (g = sector / FREE_MAP_GROUP_SECTORS;
+			g <= (sector + cnt - 1) / FREE_MAP_GROUP_SECTORS; g++)
+		if (group_load (g) == NULL)
+			return false;
+	flip (sector, cnt, in_use);
+	if (free_map_file != NULL && !write_bits (sector, cnt)) {
+		flip (sector, cnt, !in_use);
+		return false;
+	}
+	group_account (sector, cnt, in_use);
+	return true;
+}
+
+/* Sets the CNT bits starting at SECTOR, whose groups must be in
+ * memory, to IN_USE, asserting that none was already. */
+static void
+flip (disk_sector_t sector, size_t cnt, bool in_use) {
+	while (cnt > 0) {
+		struct bitmap *b = group_bits[sector / FREE_MAP_GROUP_SECTORS];
+		size_t ofs = sector % FREE_MAP_GROUP_SECTORS;
+		size_t n = FREE_MAP_GROUP_SECTORS - ofs < cnt
+			? FREE_MAP_GROUP_SECTORS - ofs : cnt;
+
+		ASSERT (in_use ? bitmap_none (b, ofs, n) : bitmap_all (b, ofs, n));
+		bitmap_set_multiple (b, ofs, n, in_use);
+		sector += n;
+		cnt -= n;
+	}
+}
+
+/* Writes the bytes holding the CNT bits starting at SECTOR to the
+ * free map file.  Returns true if successful. */
+static bool
+write_bits (disk_sector_t sector, size_t cnt) {
+	while (cnt > 0) {
+		size_t g = sector / FREE_MAP_GROUP_SECTORS;
+		size_t ofs = sector % FREE_MAP_GROUP_SECTORS;
+		size_t n = FREE_MAP_GROUP_SECTORS - ofs < cnt
+			? FREE_MAP_GROUP_SECTORS - ofs : cnt;
+
+		if (!bitmap_write_range_at (group_bits[g], free_map_file,
+					g * (FREE_MAP_GROUP_SECTORS / 8), ofs, n))
+			return false;
+		sector += n;
+		cnt -= n;
+	}
+	return true;
+}
+
+/* Updates GROUP_FREE for the CNT sectors starting at SECTOR having
+ * been ALLOCATED or released, and writes the counts that changed to
+ * the free map file if it is open. */
+static void
+group_account (disk_sector_t sector, size_t cnt, bool allocated) {
+	size_t first = sector / FREE_MAP_GROUP_SECTORS;
+	size_t last = (sector + cnt - 1) / FREE_MAP_GROUP_SECTORS;
+	size_t g;
+
+	for (g = first; g <= last; g++) {
+		size_t start = g == first ? sector % FREE_MAP_GROUP_SECTORS : 0;
+		size_t end = g == last
+			? (sector + cnt - 1) % FREE_MAP_GROUP_SECTORS + 1
+			: FREE_MAP_GROUP_SECTORS;
+
+		if (allocated)
+			group_free[g] -= end - start;
+		else
+			group_free[g] += end - start;
+	}
+	if (free_map_file != NULL) {
+		off_t size = (last - first + 1) * sizeof *group_free;
+		file_write_at (free_map_file, &group_free[first], size,
+				group_free_ofs + first * sizeof *group_free);
+	}
+}
+
+/* Returns the first sector of the first run of CNT free sectors
+ * that starts in group G or after, or BITMAP_ERROR if there is
+ * none.  Full groups are passed over and all-free groups counted
+ * whole, without their bits being read. */
+static disk_sector_t
+scan_run (size_t g, size_t cnt) {
+	disk_sector_t start = 0;
+	size_t run = 0;
+
+	for (; g < group_cnt; g++) {
+		size_t size = group_size (g);
+		struct bitmap *b;
+		size_t i;
+
+		if (group_free[g] == size) {
+			if (run == 0)
+				start = g * FREE_MAP_GROUP_SECTORS;
+			run += size;
+			if (run >= cnt)
+				return start;
+			continue;
+		}
+		if (group_free[g] == 0 || (b = group_load (g)) == NULL) {
+			run = 0;
+			continue;
+		}
+
+		/* Take the free bits as they come: start a run at the next
+		 * free bit, and end it at the next one in use, unless the
+		 * group ends first and the run goes on into the next. */
+		for (i = 0; i < size; ) {
+			size_t end;
+
+			if (run == 0) {
+				i = bitmap_scan (b, i, 1, false);
+				if (i == BITMAP_ERROR)
+					break;
+				start = g * FREE_MAP_GROUP_SECTORS + i;
+			}
+			end = bitmap_scan (b, i, 1, true);
+			if (end == BITMAP_ERROR)
+				end = size;
+			run += end - i;
+			if (run >= cnt)
+				return start;
+			if (end < size)
+				run = 0;
+			i = end;
+		}
+	}
+	return BITMAP_ERROR;
+}
+
+/* Writes the whole free map to FILE: each group's bits, zeros for
+ * the groups not read, and the free counts.  Called while formatting
+ * alone, without FREE_MAP_LOCK, as the writes may allocate sectors.
+ * Returns true if successful. */
+static bool
+write_all (struct file *file) {
+	static uint8_t zeros[FREE_MAP_GROUP_SECTORS / 8];
+	off_t size = group_cnt * sizeof *group_free;
+	bool ok = true;
+	size_t g;
+
+	for (g = 0; ok && g < group_cnt; g++) {
+		off_t ofs = g * sizeof zeros;
+
+		if (group_bits[g] != NULL)
+			ok = bitmap_write_at (group_bits[g], file, ofs);
+		else {
+			off_t bytes = DIV_ROUND_UP (group_size (g), 8);
+			ok = file_write_at (file, zeros, bytes, ofs) == bytes;
+		}
+	}
+	return ok && file_write_at (file, group_free, size, group_free_ofs) == size;
+}
@@ -1,12 +1,13 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
-#include "devices/disk.h"
+#include "devices/block.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -62,7 +63,46 @@ fsutil_rm (char **argv) {
 		PANIC ("%s: delete failed\n", file_name);
 }
 
-/* Copies from the "scratch" disk, hdc or hd1:0 to file ARGV[1]
+/* Sectors fsutil_put() and fsutil_get() move at a time.  They keep
+ * two chunks of this size going, one between a buffer and the
+ * scratch disk with an asynchronous request, the other between a
+ * buffer and the file, which bypasses the buffer cache: the data is
+ * only passing through. */
+#define CHUNK_SECTORS 128
+#define CHUNK_SIZE (CHUNK_SECTORS * DISK_SECTOR_SIZE)
+
+/* Allocates the two chunk buffers of fsutil_put() or fsutil_get()
+ * into BUFFERS. */
+static void
+chunks_alloc (uint8_t *buffers[2]) {
+	buffers[0] = palloc_get_multiple (0, CHUNK_SIZE / PGSIZE);
+	buffers[1] = palloc_get_multiple (0, CHUNK_SIZE / PGSIZE);
+	if (buffers[0] == NULL || buffers[1] == NULL)
+		PANIC ("couldn't allocate buffer");
+}
+
+/* Frees what chunks_alloc() allocated. */
+static void
+chunks_free (uint8_t *buffers[2]) {
+	palloc_free_multiple (buffers[0], CHUNK_SIZE / PGSIZE);
+	palloc_free_multiple (buffers[1], CHUNK_SIZE / PGSIZE);
+}
+
+/* Submits REQ to transfer the next up to CHUNK_SECTORS of the
+ * *LEFT sectors from *SECTOR on of the scratch disk DEV, to BUFFER,
+ * or from it if WRITE, and advances *SECTOR and *LEFT past them. */
+static void
+chunk_submit (struct block_request *req, struct block_device *dev,
+		disk_sector_t *sector, size_t *left, void *buffer, bool write) {
+	size_t cnt = *left < CHUNK_SECTORS ? *left : CHUNK_SECTORS;
+
+	block_request_init (req, dev, *sector, cnt, buffer, write);
+	block_submit (req);
+	*sector += cnt;
+	*left -= cnt;
+}
+
+/* Copies from the "scratch" device, hd1:0 by default, to file ARGV[1]
  * in the file system.
  *
  * The current sector on the scratch disk must begin with the
@@ -79,51 +119,62 @@ fsutil_put (char **argv) {
 	static disk_sector_t sector = 0;
 
 	const char *file_name = argv[1];
-	struct disk *src;
+	struct block_device *src;
+	struct block_request req;
 	struct file *dst;
+	uint8_t *buffers[2];
+	size_t left;
 	off_t size;
-	void *buffer;
+	int cur = 0;
 
 	printf ("Putting '%s' into the file system...\n", file_name);
-
-	/* Allocate buffer. */
-	buffer = malloc (DISK_SECTOR_SIZE);
-	if (buffer == NULL)
-		PANIC ("couldn't allocate buffer");
+	chunks_alloc (buffers);
 
 	/* Open source disk and read file size. */
-	src = disk_get (1, 0);
+	src = block_get_role (BLOCK_SCRATCH);
 	if (src == NULL)
-		PANIC ("couldn't open source disk (hdc or hd1:0)");
+		PANIC ("couldn't open scratch device");
 
 	/* Read file size. */
-	disk_read (src, sector++, buffer);
-	if (memcmp (buffer, "PUT", 4))
+	block_read (src, sector++, buffers[0]);
+	if (memcmp (buffers[0], "PUT", 4))
 		PANIC ("%s: missing PUT signature on scratch disk", file_name);
-	size = ((int32_t *) buffer)[1];
+	size = ((int32_t *) buffers[0])[1];
 	if (size < 0)
 		PANIC ("%s: invalid file size %d", file_name, size);
+	left = DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+	if (left > block_size (src) - sector)
+		PANIC ("%s: file runs past the end of the scratch disk", file_name);
 
-	/* Create destination file. */
+	/* Create destination file, of its full size, so that it gets its
+	 * sectors together as they are written. */
 	if (!filesys_create (file_name, size))
 		PANIC ("%s: create failed", file_name);
 	dst = filesys_open (file_name);
 	if (dst == NULL)
 		PANIC ("%s: open failed", file_name);
+	file_set_direct (dst, true);
 
-	/* Do copy. */
+	/* Do copy: each chunk is written to the file while the next is
+	 * read from the scratch disk. */
+	if (left > 0)
+		chunk_submit (&req, src, &sector, &left, buffers[cur], false);
 	while (size > 0) {
-		int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-		disk_read (src, sector++, buffer);
-		if (file_write (dst, buffer, chunk_size) != chunk_size)
+		int chunk_size = size > CHUNK_SIZE ? CHUNK_SIZE : size;
+
+		block_wait (&req);
+		if (left > 0)
+			chunk_submit (&req, src, &sector, &left, buffers[!cur], false);
+		if (file_write (dst, buffers[cur], chunk_size) != chunk_size)
 			PANIC ("%s: write failed with %"PROTd" bytes unwritten",
 					file_name, size);
 		size -= chunk_size;
+		cur = !cur;
 	}
 
 	/* Finish up. */
 	file_close (dst);
-	free (buffer);
+	chunks_free (buffers);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch disk.
@@ -142,48 +193,59 @@ fsutil_get (char **argv) {
 	static disk_sector_t sector = 0;
 
 	const char *file_name = argv[1];
-	void *buffer;
+	struct block_request req;
 	struct file *src;
-	struct disk *dst;
+	struct block_device *dst;
+	uint8_t *buffers[2];
+	bool pending = false;
+	size_t left;
 	off_t size;
+	int cur = 0;
 
 	printf ("Getting '%s' from the file system...\n", file_name);
-
-	/* Allocate buffer. */
-	buffer = malloc (DISK_SECTOR_SIZE);
-	if (buffer == NULL)
-		PANIC ("couldn't allocate buffer");
+	chunks_alloc (buffers);
 
 	/* Open source file. */
 	src = filesys_open (file_name);
 	if (src == NULL)
 		PANIC ("%s: open failed", file_name);
+	file_set_direct (src, true);
 	size = file_length (src);
 
 	/* Open target disk. */
-	dst = disk_get (1, 0);
+	dst = block_get_role (BLOCK_SCRATCH);
 	if (dst == NULL)
-		PANIC ("couldn't open target disk (hdc or hd1:0)");
+		PANIC ("couldn't open scratch device");
+	left = DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+	if (sector >= block_size (dst) || left > block_size (dst) - sector - 1)
+		PANIC ("%s: out of space on scratch disk", file_name);
 
 	/* Write size to sector 0. */
-	memset (buffer, 0, DISK_SECTOR_SIZE);
-	memcpy (buffer, "GET", 4);
-	((int32_t *) buffer)[1] = size;
-	disk_write (dst, sector++, buffer);
+	memset (buffers[0], 0, DISK_SECTOR_SIZE);
+	memcpy (buffers[0], "GET", 4);
+	((int32_t *) buffers[0])[1] = size;
+	block_write (dst, sector++, buffers[0]);
 
-	/* Do copy. */
+	/* Do copy: each chunk is read from the file while the one before
+	 * is written to the scratch disk. */
 	while (size > 0) {
-		int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-		if (sector >= disk_size (dst))
-			PANIC ("%s: out of space on scratch disk", file_name);
-		if (file_read (src, buffer, chunk_size) != chunk_size)
+		int chunk_size = size > CHUNK_SIZE ? CHUNK_SIZE : size;
+
+		if (file_read (src, buffers[cur], chunk_size) != chunk_size)
 			PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-		memset (buffer + chunk_size, 0, DISK_SECTOR_SIZE - chunk_size);
-		disk_write (dst, sector++, buffer);
+		memset (buffers[cur] + chunk_size, 0,
+				ROUND_UP (chunk_size, DISK_SECTOR_SIZE) - chunk_size);
+		if (pending)
+			block_wait (&req);
+		chunk_submit (&req, dst, &sector, &left, buffers[cur], true);
+		pending = true;
 		size -= chunk_size;
+		cur = !cur;
 	}
+	if (pending)
+		block_wait (&req);
 
 	/* Finish up. */
 	file_close (src);
-	free (buffer);
+	chunks_free (buffers);
 }
@@ -1,24 +1,107 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
+#include <crc32c.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#ifdef EFILESYS
+#include "filesys/fat.h"
+#endif
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
+#include "filesys/tmpfs.h"
 #include "threads/malloc.h"
+#include "threads/scratch.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/exec_cache.h"
+#endif
 
-/* Identifies an inode. */
+/* Identifies an inode, and one of a symbolic link, whose data is
+ * the path it points to. */
 #define INODE_MAGIC 0x494e4f44
+#define SYMLINK_MAGIC 0x534c4e4b
+
+/* A run of consecutive sectors of a file: data sectors next to
+ * each other on disk, or a hole. */
+struct extent {
+	disk_sector_t start;                /* First sector, or HOLE. */
+	uint32_t count;                     /* Number of sectors. */
+};
+
+/* START of an extent of sectors never written, which read as zeros
+ * and take no disk space.  Sector 0 holds the free map's inode, so
+ * it never is a data sector. */
+#define HOLE 0
+
+/* Returned by byte_to_sector() for a sector written but not yet
+ * given a disk sector; see delalloc_split(). */
+#define PENDING ((disk_sector_t) -2)
+
+/* Most sectors of a file's end kept in memory before they get disk
+ * sectors. */
+#define DELALLOC_SECTORS 8
+
+/* Extents kept in the inode's own sector and in each indirect block. */
+#define DIRECT_EXTENTS 61
+#define INDIRECT_EXTENTS 63
+
+/* Most bytes of data kept in the inode's own sector, in place of
+ * its extents. */
+#define INLINE_MAX (DIRECT_EXTENTS * (off_t) sizeof (struct extent))
+
+/* INDIRECT of an inode whose data is inline. */
+#define INLINE ((disk_sector_t) -1)
 
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The file's data is its extents' sectors in order, the first
+ * DIRECT_EXTENTS extents here and the rest in a chain of indirect
+ * blocks.  A file of at most INLINE_MAX bytes has no extents and
+ * keeps its data here instead, so that opening and reading it takes
+ * one sector; it gets data sectors once it grows past that.  Its
+ * INDIRECT is then INLINE.  CHECKSUM, like that of an indirect block,
+ * is the CRC-32C of the rest of the sector, checked whenever it is
+ * read, so that a corrupt sector is noticed before it is used. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents. */
+	disk_sector_t indirect;             /* First indirect block, 0, or
+	                                       INLINE. */
+	union {
+		struct extent extents[DIRECT_EXTENTS]; /* First extents. */
+		uint8_t inline_data[INLINE_MAX];    /* Data, if INLINE. */
+	};
+	uint32_t checksum;                  /* See sector_checksum(). */
+	uint32_t unused;                    /* Not used. */
+};
+
+/* Indirect block: the next INDIRECT_EXTENTS extents of a file.
+ * Must be exactly DISK_SECTOR_SIZE bytes long.  Sector 0 never is
+ * one, so it ends the chain. */
+struct indirect_block {
+	disk_sector_t next;                 /* Next indirect block, or 0. */
+	uint32_t checksum;                  /* See sector_checksum(). */
+	struct extent extents[INDIRECT_EXTENTS]; /* Extents. */
 };
 
+/* A sector's worth of zeros, for zeroing new sectors. */
+static char zeros[DISK_SECTOR_SIZE];
+
+/* Group commit; see inode_commit().  Tickets are handed out in
+ * order, and every ticket up to COMMIT_DONE is durable. */
+static struct lock commit_lock;
+static struct condition commit_cond;    /* Signaled when a commit ends. */
+static unsigned commit_next;            /* Last ticket handed out. */
+static unsigned commit_done;            /* Last ticket made durable. */
+static bool committing;                 /* A commit under way? */
+
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
 static inline size_t
@@ -26,114 +109,1210 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* Returns the CRC-32C of the DISK_SECTOR_SIZE bytes of SECTOR but
+ * for the checksum kept among them, the uint32_t at offset OFS. */
+static uint32_t
+sector_checksum (const void *sector, size_t ofs) {
+	const uint8_t *p = sector;
+	size_t end = ofs + sizeof (uint32_t);
+
+	return crc32c (crc32c (0, p, ofs), p + end, DISK_SECTOR_SIZE - end);
+}
+
+/* Stores in on-disk inode D its checksum, before it is written. */
+static void
+inode_seal (struct inode_disk *d) {
+	d->checksum = sector_checksum (d, offsetof (struct inode_disk, checksum));
+}
+
+/* Returns the checksum indirect block SECTOR, as the buffer cache
+ * has it, should have, reading it a piece at a time rather than
+ * needing a sector's worth of buffer. */
+static uint32_t
+indirect_checksum (disk_sector_t sector) {
+	const size_t skip = offsetof (struct indirect_block, checksum);
+	uint8_t piece[64];
+	uint32_t crc;
+	size_t ofs, n;
+
+	buffer_cache_read (sector, piece, 0, skip);
+	crc = crc32c (0, piece, skip);
+	for (ofs = skip + sizeof (uint32_t); ofs < DISK_SECTOR_SIZE; ofs += n) {
+		n = DISK_SECTOR_SIZE - ofs < sizeof piece
+			? DISK_SECTOR_SIZE - ofs : sizeof piece;
+		buffer_cache_read (sector, piece, ofs, n);
+		crc = crc32c (crc, piece, n);
+	}
+	return crc;
+}
+
+/* Stores in indirect block SECTOR, just changed, its checksum. */
+static void
+indirect_seal (disk_sector_t sector) {
+	uint32_t crc = indirect_checksum (sector);
+
+	journal_write (sector, &crc, offsetof (struct indirect_block, checksum),
+			sizeof crc);
+}
+
+/* Returns true if indirect block SECTOR holds the checksum of the
+ * rest of it, and otherwise reports it corrupt. */
+static bool
+indirect_valid (disk_sector_t sector) {
+	uint32_t crc;
+
+	buffer_cache_read (sector, &crc, offsetof (struct indirect_block, checksum),
+			sizeof crc);
+	if (crc == indirect_checksum (sector))
+		return true;
+	printf ("inode: indirect block %"PRDSNu" is corrupt\n", sector);
+	return false;
+}
+
+/* Returns the number of indirect blocks holding extents past the
+ * first DIRECT_EXTENTS of EXTENT_CNT. */
+static inline size_t
+indirect_cnt (size_t extent_cnt) {
+	return extent_cnt > DIRECT_EXTENTS
+		? DIV_ROUND_UP (extent_cnt - DIRECT_EXTENTS, INDIRECT_EXTENTS) : 0;
+}
+
+/* An extent of an open inode, with its place in the file. */
+struct inode_extent {
+	size_t first;                       /* File sector of its first sector. */
+	struct extent ext;
+};
+
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
+	bool journaled;                     /* Data is metadata; see
+	                                       inode_set_journaled(). */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	bool defrag;                        /* Being moved by inode_defrag(). */
+	struct rwlock lock;                 /* See inode_acquire_read(). */
+
+	/* Protected by extent_lock; see inode_write_at(). */
+	struct lock extent_lock;
 	struct inode_disk data;             /* Inode content. */
+	struct inode_extent *extents;       /* All DATA.extent_cnt extents. */
+	size_t extent_cap;                  /* Room in EXTENTS. */
+	disk_sector_t *indirect;            /* Sectors of the indirect blocks. */
+	size_t sector_cnt;                  /* Sectors in all extents. */
+	bool dirty;                         /* DATA changed since written? */
+	uint8_t *pending;                   /* Sectors written at the end of
+	                                       the file but not allocated,
+	                                       or null. */
+	size_t pending_first;               /* File sector PENDING starts at. */
+	size_t pending_cnt;                 /* Sectors of PENDING in use. */
+	uint8_t *combine;                   /* Bytes of small sequential
+	                                       writes to one data sector,
+	                                       or null; see combine_write(). */
+	disk_sector_t combine_sector;       /* Sector COMBINE is for. */
+	int combine_ofs;                    /* First byte of it in COMBINE. */
+	int combine_len;                    /* Bytes from there; 0 if none. */
+	struct tmpfs_data *tmp;             /* Data of a tmpfs file, which has
+	                                       no sectors, or null. */
+	char *link;                         /* Target of a symbolic link, once
+	                                       read, or null; see
+	                                       inode_readlink(). */
 };
 
+static bool inode_load_extents (struct inode *);
+static void inode_release_data (struct inode *);
+static bool splice_extents (struct inode *, size_t i, size_t del,
+		const struct extent *, size_t cnt);
+static off_t inode_allocate (struct inode *, off_t offset, off_t end,
+		bool *changed);
+static bool append_hole (struct inode *, size_t cnt);
+static off_t tmpfs_write_at (struct inode *, const void *, off_t size,
+		off_t offset);
+static off_t read_at (struct inode *, void *, off_t size, off_t offset,
+		bool direct);
+static off_t write_at (struct inode *, const void *, off_t size,
+		off_t offset, bool direct);
+static void combine_flush (struct inode *);
+static void combine_flush_sectors (struct inode *, disk_sector_t sector,
+		size_t cnt);
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
- * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * INODE's sectors, or HOLE if POS is in a hole, and stores in *RUN
+ * the number of sectors from there to the end of its extent, which
+ * lie next to each other on disk.
+ * Returns -1 if INODE has no sector for a byte at offset POS.
+ * Costs O(log n) in the number of extents.  The caller must hold
+ * INODE's extent_lock. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+lookup_sector (struct inode *inode, off_t pos, size_t *run) {
+	size_t sector = pos / DISK_SECTOR_SIZE;
+	disk_sector_t result = -1;
+
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	if (pos >= 0 && sector < inode->sector_cnt) {
+		size_t lo = 0, hi = inode->data.extent_cnt;
+		const struct inode_extent *e;
+
+		/* Find the last extent starting at or before SECTOR. */
+		while (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (inode->extents[mid].first <= sector)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		e = &inode->extents[lo];
+		result = e->ext.start == HOLE ? HOLE
+			: e->ext.start + (sector - e->first);
+		*run = e->ext.count - (sector - e->first);
+	}
+	return result;
+}
+
+/* Like lookup_sector(), but returns PENDING, with *RUN set to 1, for
+ * a sector whose data is still in INODE's PENDING, and copies the
+ * sector to COPY if it is not null.  COPY must not be user memory. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos, size_t *run, void *copy) {
+	size_t sector = pos / DISK_SECTOR_SIZE;
+	disk_sector_t result;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
-		return -1;
+	lock_acquire (&inode->extent_lock);
+	result = lookup_sector (inode, pos, run);
+	if (result == HOLE && inode->pending_cnt > 0) {
+		size_t first = inode->pending_first;
+
+		if (sector >= first && sector - first < inode->pending_cnt) {
+			result = PENDING;
+			*run = 1;
+			if (copy != NULL)
+				memcpy (copy, inode->pending
+						+ (sector - first) * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE);
+		} else if (sector < first && *run > first - sector)
+			*run = first - sector;
+	}
+	lock_release (&inode->extent_lock);
+	return result;
+}
+
+/* Open inodes, hashed by sector, so that opening a single inode
+ * twice returns the same `struct inode'.  Protected by
+ * open_inodes_lock, along with the open_cnt, removed and
+ * deny_write_cnt of each. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Signaled, with open_inodes_lock, when inode_defrag() is done
+ * with an inode, which inode_open() waits for. */
+static struct condition defrag_cond;
+
+/* Sectors inode_defrag() copies at a time. */
+#define DEFRAG_CHUNK 8
+
+/* Hash of an inode at SECTOR, for inode_hash() and
+ * open_inodes_lookup(). */
+static uint64_t
+sector_hash (disk_sector_t sector) {
+	return hash_u64 (sector);
+}
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return sector_hash (hash_entry (e, struct inode, elem)->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
+
+/* open_inodes_lookup (&open_inodes, sector): the open inode at
+ * SECTOR, with inode_hash() and inode_less() inlined. */
+HASH_FIND_DEFINE (open_inodes_lookup, struct inode, elem, disk_sector_t,
+		sector, sector_hash)
+
+/* Object cache of in-memory inodes. */
+static struct kmem_cache *inode_slab;
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	lock_init (&open_inodes_lock);
+	lock_init (&commit_lock);
+	cond_init (&commit_cond);
+	cond_init (&defrag_cond);
+	inode_slab = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+	if (inode_slab == NULL
+			|| !hash_init (&open_inodes, inode_hash, inode_less, NULL))
+		PANIC ("inode_init: out of memory");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * disk.
+ * disk.  The data is a hole: it reads as zeros, and sectors for it
+ * are allocated only as it is written, or, up to INLINE_MAX bytes,
+ * is kept inline.
  * Returns true if successful.
- * Returns false if memory or disk allocation fails. */
+ * Returns false if memory allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
 	struct inode_disk *disk_inode = NULL;
-	bool success = false;
 
 	ASSERT (length >= 0);
 
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
 	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct indirect_block) == DISK_SECTOR_SIZE);
 
 	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	if (disk_inode == NULL)
+		return false;
+	disk_inode->length = length;
+	disk_inode->magic = INODE_MAGIC;
+	if (length <= INLINE_MAX)
+		disk_inode->indirect = INLINE;
+	else {
+		disk_inode->extent_cnt = 1;
+		disk_inode->extents[0].start = HOLE;
+		disk_inode->extents[0].count = bytes_to_sectors (length);
 	}
+	inode_seal (disk_inode);
+	journal_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+	free (disk_inode);
+	return true;
+}
+
+/* Makes sector SECTOR the inode of a symbolic link to TARGET, a
+ * path of at most SYMLINK_MAX bytes, which is its data.  Like a
+ * directory's, the data goes through the journal.  Returns false if
+ * memory or disk space runs out. */
+bool
+inode_create_symlink (disk_sector_t sector, const char *target) {
+	off_t len = strlen (target);
+	struct inode *inode;
+	bool success;
+
+	ASSERT (len > 0 && len <= SYMLINK_MAX);
+	if (!inode_create (sector, 0))
+		return false;
+	inode = inode_open (sector);
+	if (inode == NULL)
+		return false;
+	inode_set_journaled (inode);
+	lock_acquire (&inode->extent_lock);
+	inode->data.magic = SYMLINK_MAGIC;
+	inode->dirty = true;
+	lock_release (&inode->extent_lock);
+	success = inode_write_at (inode, target, len, 0) == len;
+	if (!success)
+		inode_remove (inode);
+	inode_close (inode);
 	return success;
 }
 
+/* Returns true if INODE is a symbolic link's. */
+bool
+inode_is_symlink (const struct inode *inode) {
+	return inode->data.magic == SYMLINK_MAGIC;
+}
+
+/* Stores in *LENGTH the length of the inode at SECTOR and in *SYMLINK
+ * whether it is a symbolic link's, without opening it: from the open
+ * inode if there is one, else from the head of its disk inode in the
+ * buffer cache, with no inode allocated and no extents loaded.
+ * Returns false if SECTOR holds no inode. */
+bool
+inode_stat (disk_sector_t sector, off_t *length, bool *symlink) {
+	struct inode *inode;
+	unsigned magic;
+	bool success = true;
+
+	/* Keeps an inode from being closed, and written back, meanwhile. */
+	lock_acquire (&open_inodes_lock);
+	inode = open_inodes_lookup (&open_inodes, sector);
+	if (inode != NULL) {
+		*length = inode->data.length;
+		*symlink = inode->data.magic == SYMLINK_MAGIC;
+	} else {
+		buffer_cache_read (sector, length,
+				offsetof (struct inode_disk, length), sizeof *length);
+		buffer_cache_read (sector, &magic,
+				offsetof (struct inode_disk, magic), sizeof magic);
+		*symlink = magic == SYMLINK_MAGIC;
+		success = magic == INODE_MAGIC || magic == SYMLINK_MAGIC;
+	}
+	lock_release (&open_inodes_lock);
+	return success;
+}
+
+/* Returns the path INODE, a symbolic link's, points to, or a null
+ * pointer if memory runs out.  The path is read once and kept with
+ * INODE for as long as it is open, for following the link again
+ * reads nothing. */
+const char *
+inode_readlink (struct inode *inode) {
+	off_t len = inode_length (inode);
+	char *link;
+
+	ASSERT (inode_is_symlink (inode));
+	if (inode->link != NULL)
+		return inode->link;
+	if (len > SYMLINK_MAX || (link = malloc (len + 1)) == NULL)
+		return NULL;
+	if (inode_read_at (inode, link, len, 0) != len) {
+		free (link);
+		return NULL;
+	}
+	link[len] = '\0';
+
+	/* Another thread may have read it meanwhile. */
+	lock_acquire (&inode->extent_lock);
+	if (inode->link == NULL) {
+		inode->link = link;
+		link = NULL;
+	}
+	lock_release (&inode->extent_lock);
+	free (link);
+	return inode->link;
+}
+
 /* Reads an inode from SECTOR
  * and returns a `struct inode' that contains it.
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	/* Check whether this inode is already open.  One being moved by
+	 * inode_defrag() is not handed out until it is done. */
+	lock_acquire (&open_inodes_lock);
+	while ((inode = open_inodes_lookup (&open_inodes, sector)) != NULL
+			&& inode->defrag)
+		cond_wait (&defrag_cond, &open_inodes_lock);
+	if (inode != NULL) {
+		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	inode = kmem_cache_alloc (inode_slab);
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->defrag = false;
+	inode->dirty = false;
+	inode->journaled = false;
+	inode->pending = NULL;
+	inode->pending_cnt = 0;
+	inode->combine = NULL;
+	inode->combine_len = 0;
+	inode->tmp = NULL;
+	inode->link = NULL;
+	rwlock_init (&inode->lock);
+	lock_init (&inode->extent_lock);
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->data.checksum != sector_checksum (&inode->data,
+				offsetof (struct inode_disk, checksum))) {
+		printf ("inode: inode %"PRDSNu" is corrupt\n", sector);
+		kmem_cache_free (inode_slab, inode);
+		lock_release (&open_inodes_lock);
+		return NULL;
+	}
+	if (!inode_load_extents (inode)) {
+		kmem_cache_free (inode_slab, inode);
+		lock_release (&open_inodes_lock);
+		return NULL;
+	}
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
+/* Makes an inode numbered INUMBER, LENGTH bytes of zeros, whose data
+ * is kept in memory by the tmpfs module rather than on disk, and
+ * returns it open.  Returns a null pointer if memory allocation
+ * fails. */
+struct inode *
+inode_create_tmpfs (disk_sector_t inumber, off_t length) {
+	struct inode *inode;
+
+	ASSERT (length >= 0);
+	inode = kmem_cache_alloc (inode_slab);
+	if (inode == NULL)
+		return NULL;
+	inode->tmp = tmpfs_data_create ();
+	if (inode->tmp == NULL) {
+		kmem_cache_free (inode_slab, inode);
+		return NULL;
+	}
+
+	inode->sector = inumber;
+	inode->open_cnt = 1;
+	inode->deny_write_cnt = 0;
+	inode->removed = false;
+	inode->defrag = false;
+	inode->dirty = false;
+	inode->journaled = false;
+	inode->pending = NULL;
+	inode->pending_cnt = 0;
+	inode->combine = NULL;
+	inode->combine_len = 0;
+	inode->link = NULL;
+	inode->extents = NULL;
+	inode->indirect = NULL;
+	inode->extent_cap = 0;
+	inode->sector_cnt = 0;
+	memset (&inode->data, 0, sizeof inode->data);
+	inode->data.length = length;
+	inode->data.magic = INODE_MAGIC;
+	rwlock_init (&inode->lock);
+	lock_init (&inode->extent_lock);
+
+	lock_acquire (&open_inodes_lock);
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
+	return inode;
+}
+
+/* Makes room for CNT extents in INODE's EXTENTS, and for the indirect
+ * blocks they need in its INDIRECT.  Returns false if memory runs
+ * out. */
+static bool
+reserve_extents (struct inode *inode, size_t cnt) {
+	struct inode_extent *extents;
+	disk_sector_t *indirect;
+	size_t cap = inode->extent_cap;
+
+	if (cnt <= cap)
+		return true;
+	while (cap < cnt)
+		cap = cap < DIRECT_EXTENTS ? DIRECT_EXTENTS : cap * 2;
+	extents = realloc (inode->extents, cap * sizeof *extents);
+	if (extents == NULL)
+		return false;
+	inode->extents = extents;
+	if (indirect_cnt (cap) > 0) {
+		indirect = realloc (inode->indirect,
+				indirect_cnt (cap) * sizeof *indirect);
+		if (indirect == NULL)
+			return false;
+		inode->indirect = indirect;
+	}
+	inode->extent_cap = cap;
+	return true;
+}
+
+/* Reads the extents of INODE, whose DATA is read, into its EXTENTS,
+ * following the chain of indirect blocks.  Returns false if memory
+ * runs out or an indirect block is corrupt. */
+static bool
+inode_load_extents (struct inode *inode) {
+	disk_sector_t block = inode->data.indirect;
+	size_t i;
+
+	inode->extents = NULL;
+	inode->indirect = NULL;
+	inode->extent_cap = 0;
+	inode->sector_cnt = 0;
+	if (!reserve_extents (inode, inode->data.extent_cnt)) {
+		free (inode->extents);
+		free (inode->indirect);
+		return false;
+	}
+
+	for (i = 0; i < inode->data.extent_cnt; i++) {
+		struct inode_extent *e = &inode->extents[i];
+
+		if (i < DIRECT_EXTENTS)
+			e->ext = inode->data.extents[i];
+		else {
+			size_t slot = (i - DIRECT_EXTENTS) % INDIRECT_EXTENTS;
+
+			if (slot == 0) {
+				/* Moving to the next block, from BLOCK, the one
+				 * before it, or the inode if it is the first. */
+				if (i > DIRECT_EXTENTS)
+					buffer_cache_read (block, &block,
+							offsetof (struct indirect_block, next),
+							sizeof block);
+				inode->indirect[(i - DIRECT_EXTENTS) / INDIRECT_EXTENTS] = block;
+				if (!indirect_valid (block)) {
+					free (inode->extents);
+					free (inode->indirect);
+					return false;
+				}
+			}
+			buffer_cache_read (block, &e->ext,
+					offsetof (struct indirect_block, extents[slot]),
+					sizeof e->ext);
+		}
+		e->first = inode->sector_cnt;
+		inode->sector_cnt += e->ext.count;
+	}
+	return true;
+}
+
+/* Delayed allocation.  Sectors written at the end of a file, past
+ * all its data, are kept in memory, in PENDING, while their extents
+ * stay a hole, and get disk sectors only when the inode is flushed
+ * or more than DELALLOC_SECTORS gather.  All of them then get one
+ * run, so a file written in small appends is laid out as one written
+ * at once, and the run can follow the file's last extent.  Metadata
+ * is not delayed: the journal must know its sectors. */
+
+/* Gives INODE's pending sectors disk sectors and writes them there.
+ * Returns false if the disk fills up, keeping the sectors that got
+ * none pending.  The caller must hold INODE's extent_lock. */
+static bool
+delalloc_flush (struct inode *inode) {
+	off_t start = (off_t) inode->pending_first * DISK_SECTOR_SIZE;
+	off_t end = start + (off_t) inode->pending_cnt * DISK_SECTOR_SIZE;
+	bool changed = false;
+	size_t done;
+	off_t got;
+
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	if (inode->pending_cnt == 0)
+		return true;
+
+	got = inode_allocate (inode, start, end, &changed);
+	if (changed)
+		inode->dirty = true;
+	for (done = 0; start + (off_t) done * DISK_SECTOR_SIZE < got; done++) {
+		size_t run;
+		disk_sector_t sector = lookup_sector (inode,
+				start + done * DISK_SECTOR_SIZE, &run);
+
+		ASSERT (sector != HOLE && sector != (disk_sector_t) -1);
+		buffer_cache_write (sector, inode->pending + done * DISK_SECTOR_SIZE,
+				0, DISK_SECTOR_SIZE);
+	}
+
+	if (done < inode->pending_cnt) {
+		memmove (inode->pending, inode->pending + done * DISK_SECTOR_SIZE,
+				(inode->pending_cnt - done) * DISK_SECTOR_SIZE);
+		memset (inode->pending + (inode->pending_cnt - done) * DISK_SECTOR_SIZE,
+				0, done * DISK_SECTOR_SIZE);
+		inode->pending_first += done;
+		inode->pending_cnt -= done;
+		return false;
+	}
+	free (inode->pending);
+	inode->pending = NULL;
+	inode->pending_cnt = 0;
+	return true;
+}
+
+/* Sets *SPLIT to the offset from which on the write of the bytes
+ * from OFFSET up to END may go to INODE's pending sectors, or to END
+ * if none of it may.  Flushes the pending sectors first if the write
+ * would take too many, and returns false if that fills the disk, as
+ * the write must then not allocate the pending sectors itself.  The
+ * caller must hold INODE's extent_lock. */
+static bool
+delalloc_split (struct inode *inode, off_t offset, off_t end, off_t *split) {
+	size_t end_sector = bytes_to_sectors (end);
+	size_t first, s;
+
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	*split = end;
+	if (inode->journaled)
+		return true;
+	if (inode->pending_cnt > 0
+			&& end_sector - inode->pending_first > DELALLOC_SECTORS
+			&& !delalloc_flush (inode))
+		return false;
+
+	/* The window begins with the pending sectors or, if there are
+	 * none, with the first sector past the file's data. */
+	if (inode->pending_cnt > 0)
+		first = inode->pending_first;
+	else {
+		first = inode_length (inode) / DISK_SECTOR_SIZE;
+		for (s = first; s < inode->sector_cnt && s < end_sector; s++) {
+			size_t run;
+
+			if (lookup_sector (inode, (off_t) s * DISK_SECTOR_SIZE, &run)
+					!= HOLE)
+				first = s + 1;
+		}
+	}
+	if (end_sector <= first || end_sector - first > DELALLOC_SECTORS)
+		return true;
+
+	if (inode->pending == NULL) {
+		inode->pending = calloc (DELALLOC_SECTORS, DISK_SECTOR_SIZE);
+		if (inode->pending == NULL)
+			return true;
+	}
+	if (inode->pending_cnt == 0)
+		inode->pending_first = first;
+	*split = (off_t) first * DISK_SECTOR_SIZE > offset
+		? (off_t) first * DISK_SECTOR_SIZE : offset;
+	return true;
+}
+
+/* Copies the SIZE bytes at BUFFER to offset OFFSET of INODE's
+ * pending sectors, which delalloc_split() found has room for them.
+ * Returns the number of bytes copied, 0 if the extents cannot grow to
+ * cover them.  The caller must hold INODE's extent_lock. */
+static off_t
+delalloc_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	size_t end_sector = bytes_to_sectors (offset + size);
+	size_t ofs = offset - (off_t) inode->pending_first * DISK_SECTOR_SIZE;
+
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	ASSERT (end_sector - inode->pending_first <= DELALLOC_SECTORS);
+	if (inode->sector_cnt < end_sector) {
+		if (!append_hole (inode, end_sector - inode->sector_cnt))
+			return 0;
+		inode->dirty = true;
+	}
+	memcpy (inode->pending + ofs, buffer, size);
+	if (inode->pending_cnt < end_sector - inode->pending_first)
+		inode->pending_cnt = end_sector - inode->pending_first;
+	return size;
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, one of INODE's data
+ * sectors, at byte SECTOR_OFS. */
+static void
+write_sector (struct inode *inode, disk_sector_t sector, const void *buffer,
+		int sector_ofs, int size) {
+	if (inode->journaled)
+		journal_write (sector, buffer, sector_ofs, size);
+	else
+		buffer_cache_write (sector, buffer, sector_ofs, size);
+}
+
+/* Writes SIZE bytes from BUFFER, which must be kernel memory, into
+ * SECTOR, one of INODE's data sectors, at byte SECTOR_OFS, SIZE being
+ * less than a sector.  Such writes following one another in a sector
+ * gather in INODE's COMBINE rather than each reading the sector into
+ * the buffer cache, if it was not there, and changing it there; once
+ * they fill the sector, it is written whole, without being read.
+ * Bytes that do not fill a sector stay until combine_flush(), which
+ * is called for a write elsewhere, a read or a write of the sector
+ * by other means, a seek, and whatever flushes INODE.  Returns false,
+ * writing nothing, if memory runs out. */
+static bool
+combine_write (struct inode *inode, disk_sector_t sector,
+		const void *buffer, int sector_ofs, int size) {
+	ASSERT (size < DISK_SECTOR_SIZE);
+	lock_acquire (&inode->extent_lock);
+	if (inode->combine_len > 0 && (sector != inode->combine_sector
+				|| sector_ofs != inode->combine_ofs + inode->combine_len))
+		combine_flush (inode);
+	if (inode->combine == NULL) {
+		inode->combine = malloc (DISK_SECTOR_SIZE);
+		if (inode->combine == NULL) {
+			lock_release (&inode->extent_lock);
+			return false;
+		}
+	}
+	if (inode->combine_len == 0) {
+		inode->combine_sector = sector;
+		inode->combine_ofs = sector_ofs;
+	}
+	memcpy (inode->combine + sector_ofs, buffer, size);
+	inode->combine_len += size;
+	if (inode->combine_ofs + inode->combine_len == DISK_SECTOR_SIZE)
+		combine_flush (inode);
+	lock_release (&inode->extent_lock);
+	return true;
+}
+
+/* Writes the bytes gathered in INODE's COMBINE, if any, into the
+ * buffer cache. */
+static void
+combine_flush (struct inode *inode) {
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	if (inode->combine_len == 0)
+		return;
+	buffer_cache_write (inode->combine_sector,
+			inode->combine + inode->combine_ofs, inode->combine_ofs,
+			inode->combine_len);
+	inode->combine_len = 0;
+}
+
+/* Flushes INODE's COMBINE if it is for one of the CNT sectors from
+ * SECTOR on, before they are read or written by other means.  Looks
+ * without the lock first, for COMBINE is empty most of the time. */
+static void
+combine_flush_sectors (struct inode *inode, disk_sector_t sector,
+		size_t cnt) {
+	if (inode->combine_len == 0)
+		return;
+	lock_acquire (&inode->extent_lock);
+	if (inode->combine_len > 0 && inode->combine_sector >= sector
+			&& inode->combine_sector - sector < cnt)
+		combine_flush (inode);
+	lock_release (&inode->extent_lock);
+}
+
+/* Writes INODE's extent I, changed, to where it is kept on disk.
+ * Extents in the inode itself are written by inode_flush(). */
+static void
+store_extent (struct inode *inode, size_t i) {
+	const struct extent *ext = &inode->extents[i].ext;
+
+	if (i < DIRECT_EXTENTS)
+		inode->data.extents[i] = *ext;
+	else {
+		size_t slot = (i - DIRECT_EXTENTS) % INDIRECT_EXTENTS;
+
+		journal_write (inode->indirect[(i - DIRECT_EXTENTS)
+					/ INDIRECT_EXTENTS], ext,
+				offsetof (struct indirect_block, extents[slot]), sizeof *ext);
+	}
+}
+
+/* Points the indirect block before block B of INODE, or the inode
+ * itself if B is 0, at SECTOR. */
+static void
+link_indirect (struct inode *inode, size_t b, disk_sector_t sector) {
+	if (b == 0)
+		inode->data.indirect = sector;
+	else
+		journal_write (inode->indirect[b - 1], &sector,
+				offsetof (struct indirect_block, next), sizeof sector);
+}
+
+/* Replaces the DEL extents of INODE starting at I with the CNT
+ * extents in EXTS, which cover as many sectors, getting or freeing
+ * indirect blocks as the number of extents changes, and stores the
+ * extents from I on.  Returns false, changing nothing, if memory or
+ * disk space for indirect blocks runs out. */
+static bool
+splice_extents (struct inode *inode, size_t i, size_t del,
+		const struct extent *exts, size_t cnt) {
+	size_t old_cnt = inode->data.extent_cnt;
+	size_t new_cnt = old_cnt - del + cnt;
+	size_t old_blocks = indirect_cnt (old_cnt);
+	size_t new_blocks = indirect_cnt (new_cnt);
+	size_t first, b, j;
+
+	ASSERT (i + del <= old_cnt);
+	if (!reserve_extents (inode, new_cnt))
+		return false;
+	for (b = old_blocks; b < new_blocks; b++) {
+		disk_sector_t block;
+
+		if (!free_map_allocate_near (inode->sector, 1, &block)) {
+			while (b-- > old_blocks)
+				free_map_release (inode->indirect[b], 1);
+			link_indirect (inode, old_blocks, 0);
+			if (old_blocks > 0)
+				indirect_seal (inode->indirect[old_blocks - 1]);
+			return false;
+		}
+		journal_write (block, zeros, 0, DISK_SECTOR_SIZE);
+		link_indirect (inode, b, block);
+		inode->indirect[b] = block;
+	}
+	for (b = new_blocks; b < old_blocks; b++)
+		free_map_release (inode->indirect[b], 1);
+	if (new_blocks < old_blocks)
+		link_indirect (inode, new_blocks, 0);
+
+	first = i < old_cnt ? inode->extents[i].first : inode->sector_cnt;
+	memmove (&inode->extents[i + cnt], &inode->extents[i + del],
+			(old_cnt - i - del) * sizeof *inode->extents);
+	for (j = 0; j < cnt; j++)
+		inode->extents[i + j].ext = exts[j];
+	inode->data.extent_cnt = new_cnt;
+	for (j = i; j < new_cnt; j++) {
+		inode->extents[j].first = first;
+		first += inode->extents[j].ext.count;
+		store_extent (inode, j);
+	}
+	inode->sector_cnt = first;
+
+	/* Reseal the indirect blocks changed: that of extent I and those
+	 * after it, and the one before, whose NEXT may have changed. */
+	b = i < DIRECT_EXTENTS ? 0 : (i - DIRECT_EXTENTS) / INDIRECT_EXTENTS;
+	for (b = b > 0 ? b - 1 : 0; b < new_blocks; b++)
+		indirect_seal (inode->indirect[b]);
+	return true;
+}
+
+/* Appends CNT sectors of hole to INODE, growing its last extent if
+ * that is a hole too.  Returns false if that takes an indirect block
+ * and none is available. */
+static bool
+append_hole (struct inode *inode, size_t cnt) {
+	size_t n = inode->data.extent_cnt;
+	struct extent hole = { HOLE, cnt };
+
+	if (n > 0 && inode->extents[n - 1].ext.start == HOLE) {
+		hole.count += inode->extents[n - 1].ext.count;
+		return splice_extents (inode, n - 1, 1, &hole, 1);
+	}
+	return splice_extents (inode, n, 0, &hole, 1);
+}
+
+/* Fills up to CNT sectors of extent I of INODE, a hole, with data
+ * sectors, starting at sector OFS of the hole.  Prefers the sectors
+ * right after those of the extent before, which then just grows.
+ * Returns the number of sectors filled, 0 if the disk is full, and
+ * stores the first in *START. */
+static size_t
+fill_hole (struct inode *inode, size_t i, size_t ofs, size_t cnt,
+		disk_sector_t *start) {
+	struct extent hole = inode->extents[i].ext;
+	struct extent exts[3];
+	size_t got = 0, n = 0, at = i, del = 1;
+
+	ASSERT (hole.start == HOLE && ofs + cnt <= hole.count);
+	if (ofs == 0 && i > 0 && inode->extents[i - 1].ext.start != HOLE) {
+		struct extent *prev = &inode->extents[i - 1].ext;
+
+		*start = prev->start + prev->count;
+		got = free_map_allocate_at (*start, cnt);
+		if (got > 0) {
+			at = i - 1;
+			del = 2;
+			exts[n].start = prev->start;
+			exts[n++].count = prev->count + got;
+		}
+	}
+	if (got == 0) {
+		/* Take the largest run, halving the request, so that a
+		 * fragmented disk still fills up, in the allocation group of
+		 * the inode if there is room. */
+		for (got = cnt; got > 0; got /= 2)
+			if (free_map_allocate_near (inode->sector, got, start))
+				break;
+		if (got == 0)
+			return 0;
+		if (ofs > 0) {
+			exts[n].start = HOLE;
+			exts[n++].count = ofs;
+		}
+		exts[n].start = *start;
+		exts[n++].count = got;
+	}
+	if (ofs + got < hole.count) {
+		exts[n].start = HOLE;
+		exts[n++].count = hole.count - ofs - got;
+	}
+	if (!splice_extents (inode, at, del, exts, n)) {
+		free_map_release (*start, got);
+		return 0;
+	}
+	return got;
+}
+
+/* Gives INODE data sectors for the bytes from OFFSET up to END,
+ * leaving any sectors between its old end and OFFSET a hole.
+ * New data sectors are zeroed unless a write of the bytes from
+ * OFFSET to END is about to cover them whole.  Returns the offset
+ * up to which INODE has data sectors from OFFSET on, which is less
+ * than END if the disk fills up, and sets *CHANGED if INODE's own
+ * sector has to be written back.  The caller must hold
+ * INODE's extent_lock. */
+static off_t
+inode_allocate (struct inode *inode, off_t offset, off_t end,
+		bool *changed) {
+	size_t sector = offset / DISK_SECTOR_SIZE;
+	size_t end_sector = bytes_to_sectors (end);
+
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	if (inode->sector_cnt < end_sector) {
+		if (!append_hole (inode, end_sector - inode->sector_cnt))
+			return offset;
+		*changed = true;
+	}
+
+	while (sector < end_sector) {
+		size_t lo = 0, hi = inode->data.extent_cnt;
+		struct inode_extent *e;
+		disk_sector_t start;
+		size_t ofs, cnt, got, j;
+
+		while (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (inode->extents[mid].first <= sector)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		e = &inode->extents[lo];
+		ofs = sector - e->first;
+		cnt = e->ext.count - ofs;
+		if (cnt > end_sector - sector)
+			cnt = end_sector - sector;
+		if (e->ext.start != HOLE) {
+			sector += cnt;
+			continue;
+		}
+
+		got = fill_hole (inode, lo, ofs, cnt, &start);
+		if (got == 0)
+			break;
+		*changed = true;
+		for (j = 0; j < got; j++) {
+			off_t ofs = (off_t) (sector + j) * DISK_SECTOR_SIZE;
+
+			if (ofs < offset || ofs + DISK_SECTOR_SIZE > end) {
+				write_sector (inode, start + j, zeros, 0, DISK_SECTOR_SIZE);
+				thread_resched ();
+			}
+		}
+		sector += got;
+	}
+	return sector * DISK_SECTOR_SIZE < (size_t) end
+		? (off_t) (sector * DISK_SECTOR_SIZE) : end;
+}
+
+/* Writes the inline data of INODE, just changed, through the
+ * journal if it is metadata, and otherwise when INODE is flushed.
+ * The caller must hold INODE's extent_lock. */
+static void
+inline_store (struct inode *inode) {
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	if (inode->journaled) {
+		inode_seal (&inode->data);
+		journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+		inode->dirty = false;
+	} else
+		inode->dirty = true;
+}
+
+/* Moves the inline data of INODE to data sectors, so that it may
+ * grow past INLINE_MAX bytes.  Returns false, leaving INODE as it
+ * was, if memory or disk space runs out.  The caller must hold
+ * INODE's extent_lock. */
+static bool
+inline_migrate (struct inode *inode) {
+	off_t length = inode->data.length;
+	bool changed = false;
+	uint8_t *copy;
+	off_t ofs;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&inode->extent_lock));
+	ASSERT (inode->data.indirect == INLINE && inode->data.extent_cnt == 0);
+	copy = malloc (INLINE_MAX);
+	if (copy == NULL)
+		return false;
+	memcpy (copy, inode->data.inline_data, INLINE_MAX);
+	memset (inode->data.extents, 0, sizeof inode->data.extents);
+	inode->data.indirect = 0;
+	inode->dirty = true;
+
+	if (length > 0 && inode_allocate (inode, 0, length, &changed) < length) {
+		for (i = 0; i < inode->data.extent_cnt; i++)
+			if (inode->extents[i].ext.start != HOLE)
+				free_map_release (inode->extents[i].ext.start,
+						inode->extents[i].ext.count);
+		inode->data.extent_cnt = 0;
+		inode->sector_cnt = 0;
+		inode->data.indirect = INLINE;
+		memcpy (inode->data.inline_data, copy, INLINE_MAX);
+		free (copy);
+		return false;
+	}
+	for (ofs = 0; ofs < length; ofs += DISK_SECTOR_SIZE) {
+		size_t run;
+		disk_sector_t sector = lookup_sector (inode, ofs, &run);
+		int chunk = length - ofs < DISK_SECTOR_SIZE
+			? length - ofs : DISK_SECTOR_SIZE;
+
+		write_sector (inode, sector, copy + ofs, 0, chunk);
+	}
+	free (copy);
+	return true;
+}
+
+/* Reads what INODE keeps inline of the SIZE bytes at OFFSET into
+ * BUFFER and stores the number of bytes read in *READ, returning
+ * true, if INODE's data is inline, and otherwise returns false. */
+static bool
+inline_read (struct inode *inode, void *buffer, off_t size, off_t offset,
+		off_t *read) {
+	bool done = false;
+
+	/* Data once moved to sectors never comes back inline, so a look
+	 * without the lock that finds it there suffices. */
+	if (inode->data.indirect != INLINE)
+		return false;
+	lock_acquire (&inode->extent_lock);
+	if (inode->data.indirect == INLINE) {
+		off_t left = offset >= 0 ? inode->data.length - offset : 0;
+
+		*read = size < left ? size : left;
+		if (*read < 0)
+			*read = 0;
+		memcpy (buffer, inode->data.inline_data + offset, *read);
+		done = true;
+	}
+	lock_release (&inode->extent_lock);
+	return done;
+}
+
+/* Writes the SIZE bytes at BUFFER, which must be kernel memory, to
+ * INODE at OFFSET and stores the number of bytes written in
+ * *WRITTEN, returning true, if INODE's data is inline and stays so.
+ * Moves the data to sectors, for the write to go there, and returns
+ * false if it does not fit inline; if that fails, stores 0 in
+ * *WRITTEN and returns true. */
+static bool
+inline_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset, off_t *written) {
+	bool done = false;
+
+	if (inode->data.indirect != INLINE)
+		return false;
+	lock_acquire (&inode->extent_lock);
+	if (inode->data.indirect == INLINE) {
+		*written = 0;
+		if (offset + size <= INLINE_MAX) {
+			memcpy (inode->data.inline_data + offset, buffer, size);
+			if (offset + size > inode->data.length)
+				inode->data.length = offset + size;
+			inline_store (inode);
+			*written = size;
+			done = true;
+		} else
+			done = !inline_migrate (inode);
+	}
+	lock_release (&inode->extent_lock);
+	return done;
+}
+
+/* Gives INODE's pending sectors disk sectors, and writes its own
+ * sector, with its length and extents, to the buffer cache if it
+ * changed.  Changes are otherwise kept in memory until the inode is
+ * closed, so that a run of appends costs one write of the sector
+ * rather than one each. */
+void
+inode_flush (struct inode *inode) {
+	if (inode->tmp != NULL)
+		return;
+	lock_acquire (&inode->extent_lock);
+	combine_flush (inode);
+	delalloc_flush (inode);
+	if (inode->dirty) {
+		inode_seal (&inode->data);
+		journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+		inode->dirty = false;
+	}
+	lock_release (&inode->extent_lock);
+}
+
+/* Writes the bytes of small writes to INODE gathered in memory into
+ * the buffer cache, as for a seek, after which the next write is
+ * unlikely to follow on from the last. */
+void
+inode_flush_combined (struct inode *inode) {
+	if (inode->tmp != NULL || inode->combine_len == 0)
+		return;
+	lock_acquire (&inode->extent_lock);
+	combine_flush (inode);
+	lock_release (&inode->extent_lock);
+}
+
+/* Flushes every open inode, as by inode_flush(). */
+void
+inode_flush_all (void) {
+	struct hash_iterator i;
+
+	lock_acquire (&open_inodes_lock);
+	hash_first (&i, &open_inodes);
+	while (hash_next (&i))
+		inode_flush (hash_entry (hash_cur (&i), struct inode, elem));
+	lock_release (&open_inodes_lock);
+}
+
+/* Makes INODE's data and metadata durable: flushes the inode and
+ * writes every dirty sector of the buffer cache to disk, which does
+ * not know the sectors of each file. */
+void
+inode_sync (struct inode *inode) {
+	if (inode->tmp != NULL)
+		return;
+	inode_flush (inode);
+	inode_commit ();
+}
+
+/* Commits the journal and writes every dirty sector of the buffer
+ * cache and the FAT to disk, returning once whatever was in the
+ * cache on entry is durable.
+ * Callers share commits: one that comes while another's commit is
+ * under way waits for it to end, then the first of those waiting
+ * commits once for all of them, since each commit covers every
+ * ticket handed out before it began.  Many threads syncing at once
+ * thus cost a commit or two rather than one each. */
+void
+inode_commit (void) {
+	unsigned ticket;
+
+	lock_acquire (&commit_lock);
+	ticket = ++commit_next;
+	while ((int) (commit_done - ticket) < 0) {
+		unsigned batch;
+
+		if (committing) {
+			cond_wait (&commit_cond, &commit_lock);
+			continue;
+		}
+		batch = commit_next;
+		committing = true;
+		lock_release (&commit_lock);
+
+		journal_commit ();
+		buffer_cache_flush ();
+#ifdef EFILESYS
+		fat_flush ();
+#endif
+
+		lock_acquire (&commit_lock);
+		committing = false;
+		commit_done = batch;
+		cond_broadcast (&commit_cond, &commit_lock);
+	}
+	lock_release (&commit_lock);
+}
+
+/* Frees INODE's data sectors and indirect blocks. */
+static void
+inode_release_data (struct inode *inode) {
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++)
+		if (inode->extents[i].ext.start != HOLE)
+			free_map_release (inode->extents[i].ext.start,
+					inode->extents[i].ext.count);
+	for (i = 0; i < indirect_cnt (inode->data.extent_cnt); i++)
+		free_map_release (inode->indirect[i], 1);
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -153,19 +1332,166 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
+	lock_acquire (&open_inodes_lock);
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+		/* Remove from the open inodes. */
+		hash_delete (&open_inodes, &inode->elem);
 
 		/* Deallocate blocks if removed. */
-		if (inode->removed) {
+		if (inode->tmp != NULL) {
+#ifdef USERPROG
+			exec_cache_invalidate (inode->sector);
+#endif
+			tmpfs_data_destroy (inode->tmp);
+		} else if (inode->removed) {
+#ifdef USERPROG
+			exec_cache_invalidate (inode->sector);
+#endif
+			journal_begin ();
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			inode_release_data (inode);
+			journal_end ();
+		} else
+			inode_flush (inode);
+
+		/* Pending sectors the disk had no room for are lost, and so
+		 * are the gathered bytes of a removed inode. */
+		free (inode->pending);
+		free (inode->combine);
+		free (inode->link);
+		free (inode->extents);
+		free (inode->indirect);
+		kmem_cache_free (inode_slab, inode); 
+	}
+	lock_release (&open_inodes_lock);
+}
+
+/* Finds the first run of data extents of INODE that lie apart on
+ * disk, no holes between them, and has at most MAX_SECTORS sectors
+ * of them.  Stores the first extent in *FIRST and returns the number
+ * of extents, or 0 if every run of data is contiguous already. */
+static size_t
+find_fragments (struct inode *inode, size_t max_sectors, size_t *first) {
+	size_t i, n = inode->data.extent_cnt;
+
+	for (i = 0; i + 1 < n; i++) {
+		const struct extent *a = &inode->extents[i].ext;
+		const struct extent *b = &inode->extents[i + 1].ext;
+		size_t j, sectors;
+
+		if (a->start == HOLE || b->start == HOLE
+				|| a->start + a->count == b->start
+				|| a->count + b->count > max_sectors)
+			continue;
+		sectors = a->count;
+		for (j = i + 1; j < n && inode->extents[j].ext.start != HOLE
+				&& sectors + inode->extents[j].ext.count <= max_sectors; j++)
+			sectors += inode->extents[j].ext.count;
+		*first = i;
+		return j - i;
+	}
+	return 0;
+}
+
+/* Online defragmentation: moves the data of up to MAX_SECTORS
+ * sectors of INODE whose extents lie apart on disk into one run of
+ * free sectors, so that reading them sequentially needs no seeks,
+ * and returns the number of sectors moved.  Only a file that just
+ * the caller has open is moved, and it cannot be opened meanwhile,
+ * so no read or write of it can see the sectors change; any other
+ * file, and metadata, is left alone, returning 0.
+ * The data goes to the new sectors straight to disk, then the
+ * extents are changed in one transaction, which is committed before
+ * the old sectors are freed: after a crash the file has either its
+ * old sectors or its new ones, the same data in both. */
+size_t
+inode_defrag (struct inode *inode, size_t max_sectors) {
+	struct extent *old = NULL;
+	struct extent moved;
+	size_t first, cnt = 0, i;
+	uint8_t *buffer = NULL;
+
+	if (inode->tmp != NULL || inode->journaled
+			|| inode->data.magic != INODE_MAGIC)
+		return 0;
+	lock_acquire (&open_inodes_lock);
+	if (inode->open_cnt != 1 || inode->removed || inode->deny_write_cnt > 0) {
+		lock_release (&open_inodes_lock);
+		return 0;
+	}
+	inode->defrag = true;
+	lock_release (&open_inodes_lock);
+
+	inode_flush (inode);
+	lock_acquire (&inode->extent_lock);
+	cnt = find_fragments (inode, max_sectors, &first);
+	if (cnt > 0)
+		old = malloc (cnt * sizeof *old);
+	if (old != NULL)
+		for (i = 0; i < cnt; i++)
+			old[i] = inode->extents[first + i].ext;
+	lock_release (&inode->extent_lock);
+	buffer = malloc (DEFRAG_CHUNK * DISK_SECTOR_SIZE);
+	moved.count = 0;
+	if (old == NULL || buffer == NULL)
+		goto done;
+	for (i = 0; i < cnt; i++)
+		moved.count += old[i].count;
+	if (!free_map_allocate_near (inode->sector, moved.count, &moved.start)) {
+		moved.count = 0;
+		goto done;
+	}
+
+	/* Copy, through the buffer cache, which may be newer than the
+	 * disk. */
+	{
+		disk_sector_t to = moved.start;
+
+		for (i = 0; i < cnt; i++) {
+			size_t ofs, n;
+
+			for (ofs = 0; ofs < old[i].count; ofs += n) {
+				n = old[i].count - ofs < DEFRAG_CHUNK
+					? old[i].count - ofs : DEFRAG_CHUNK;
+				buffer_cache_read_multiple (old[i].start + ofs, n, buffer);
+				buffer_cache_write_direct (to, n, buffer);
+				to += n;
+			}
 		}
+	}
+
+	journal_begin ();
+	lock_acquire (&inode->extent_lock);
+	if (splice_extents (inode, first, cnt, &moved, 1)) {
+		inode_seal (&inode->data);
+		journal_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+		inode->dirty = false;
+	} else {
+		free_map_release (moved.start, moved.count);
+		moved.count = 0;
+	}
+	lock_release (&inode->extent_lock);
+	journal_end ();
+
+done:
+	lock_acquire (&open_inodes_lock);
+	inode->defrag = false;
+	cond_broadcast (&defrag_cond, &open_inodes_lock);
+	lock_release (&open_inodes_lock);
 
-		free (inode); 
+	/* The commit waits for running operations, which may have been
+	 * waiting to open INODE, so it comes once INODE may be opened.
+	 * Nothing refers to the old sectors any more meanwhile. */
+	if (moved.count > 0) {
+		inode_commit ();
+		journal_begin ();
+		for (i = 0; i < cnt; i++)
+			free_map_release (old[i].start, old[i].count);
+		journal_end ();
 	}
+	free (buffer);
+	free (old);
+	return moved.count;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -173,23 +1499,94 @@ inode_close (struct inode *inode) {
 void
 inode_remove (struct inode *inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&open_inodes_lock);
 	inode->removed = true;
+	lock_release (&open_inodes_lock);
+}
+
+/* Asks the page cache daemon to bring the data sectors of the SIZE
+ * bytes of INODE starting at OFFSET into the buffer cache, without
+ * waiting for them.  Holes, pending sectors and bytes past the end
+ * of INODE are skipped. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end;
+
+	if (inode->tmp != NULL)
+		return;
+	lock_acquire (&inode->extent_lock);
+	end = inode_length (inode);
+	if (size < end - offset)
+		end = offset + size;
+	offset = ROUND_DOWN (offset, DISK_SECTOR_SIZE);
+	while (offset < end) {
+		size_t run, cnt = DIV_ROUND_UP (end - offset, DISK_SECTOR_SIZE);
+		disk_sector_t sector = lookup_sector (inode, offset, &run);
+
+		if (sector == (disk_sector_t) -1)
+			break;
+		if (run > cnt)
+			run = cnt;
+		if (sector != HOLE)
+			page_cache_request_readahead (sector, run);
+		offset += run * DISK_SECTOR_SIZE;
+	}
+	lock_release (&inode->extent_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	return read_at (inode, buffer, size, offset, false);
+}
+
+/* Like inode_read_at(), but reads whole sectors that are not cached
+ * straight into BUFFER, which must be kernel memory, rather than
+ * through a bounce buffer. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+		off_t offset) {
+	return read_at (inode, buffer, size, offset, true);
+}
+
+/* Does the work of inode_read_at(), reading directly if DIRECT. */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+		bool direct) {
 	uint8_t *buffer = buffer_;
-	off_t bytes_read = 0;
 	uint8_t *bounce = NULL;
+	off_t bytes_read = 0;
+
+	if (inode->tmp != NULL) {
+		off_t left = offset >= 0 ? inode_length (inode) - offset : 0;
+
+		return tmpfs_data_read (inode->tmp, buffer, size < left ? size : left,
+				offset);
+	}
+
+	if (inline_read (inode, buffer, size, offset, &bytes_read))
+		return bytes_read;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		size_t run;
+		disk_sector_t sector_idx = byte_to_sector (inode, offset, &run, bounce);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
+		/* A pending sector is copied out of the inode under its lock,
+		 * so it needs somewhere to go: the thread's scratch arena, or
+		 * the heap if that is full. */
+		if (sector_idx == PENDING && bounce == NULL) {
+			bounce = scratch_alloc (DISK_SECTOR_SIZE);
+			if (bounce == NULL)
+				bounce = malloc (DISK_SECTOR_SIZE);
+			if (bounce == NULL)
+				break;
+			continue;
+		}
+
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
 		off_t inode_left = inode_length (inode) - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
@@ -197,22 +1594,43 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 
 		/* Number of bytes to actually copy out of this sector. */
 		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+		if (chunk_size <= 0 || sector_idx == (disk_sector_t) -1)
 			break;
 
+		/* A sector-aligned read spanning several whole sectors
+		 * of one extent, which lie next to each other on disk, is
+		 * done in one multi-sector transfer. */
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
+			off_t whole = (size < inode_left ? size : inode_left)
+				/ DISK_SECTOR_SIZE;
+
+			if (run > (size_t) whole)
+				run = whole;
+		} else
+			run = 1;
+
+		/* Bytes of small writes still gathered in memory go to the
+		 * buffer cache first. */
+		if (sector_idx != PENDING && sector_idx != HOLE)
+			combine_flush_sectors (inode, sector_idx, run);
+
+		if (sector_idx == PENDING)
 			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+		else if (sector_idx == HOLE) {
+			/* Never written: zeros, without touching the disk. */
+			if (run > 1)
+				chunk_size = run * DISK_SECTOR_SIZE;
+			memset (buffer + bytes_read, 0, chunk_size);
+		} else if (direct && chunk_size == DISK_SECTOR_SIZE) {
+			buffer_cache_read_direct (sector_idx, run, buffer + bytes_read);
+			chunk_size = run * DISK_SECTOR_SIZE;
+		} else if (run > 1) {
+			buffer_cache_read_multiple (sector_idx, run, buffer + bytes_read);
+			chunk_size = run * DISK_SECTOR_SIZE;
+		} else {
+			/* Copy the chunk out of the buffer cache. */
+			buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
 		}
 
 		/* Advance. */
@@ -220,70 +1638,155 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
+	if (scratch_owns (bounce))
+		scratch_free (bounce);
+	else
+		free (bounce);
 	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past the end of file extends the inode, the bytes
+ * between the old end and OFFSET becoming a hole that reads as
+ * zeros.  Only the sectors written get disk space.  The new length
+ * is set once the bytes are written, so that a reader never sees
+ * a length covering bytes not yet there. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
 		off_t offset) {
+	return write_at (inode, buffer, size, offset, false);
+}
+
+/* Like inode_write_at(), but writes whole sectors of data straight
+ * from BUFFER, which must be kernel memory, to the disk rather than
+ * into the buffer cache.  Bytes at the end of the file that wait in
+ * memory for disk sectors still do. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	return write_at (inode, buffer, size, offset, true);
+}
+
+/* Does the work of inode_write_at(), writing directly if DIRECT. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset, bool direct) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
+#ifdef USERPROG
+	exec_cache_invalidate (inode->sector);
+#endif
+	if (size <= 0 || offset < 0)
+		return 0;
+	if (size > INT32_MAX - offset)
+		size = INT32_MAX - offset;
+	if (inode->tmp != NULL)
+		return tmpfs_write_at (inode, buffer, size, offset);
 
+	journal_begin ();
+	if (inline_write (inode, buffer, size, offset, &bytes_written)) {
+		journal_end ();
+		return bytes_written;
+	}
 	while (size > 0) {
-		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
-		int sector_ofs = offset % DISK_SECTOR_SIZE;
+		bool changed = false;
+		off_t split, limit;
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
-		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
+		/* Bytes at the end of the file may wait in memory for disk
+		 * sectors; the rest, holes and bytes past the end included,
+		 * get data sectors first. */
+		lock_acquire (&inode->extent_lock);
+		if (!delalloc_split (inode, offset, offset + size, &split)) {
+			lock_release (&inode->extent_lock);
+			break;
+		}
+		if (split == offset) {
+			off_t n = delalloc_write (inode, buffer + bytes_written, size, offset);
 
-		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+			lock_release (&inode->extent_lock);
+			offset += n;
+			bytes_written += n;
 			break;
+		}
+		limit = inode_allocate (inode, offset, split, &changed);
+		if (changed)
+			inode->dirty = true;
+		lock_release (&inode->extent_lock);
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
+		while (offset < limit) {
+			/* Sector to write, starting byte offset within sector. */
+			size_t run;
+			disk_sector_t sector_idx = byte_to_sector (inode, offset, &run, NULL);
+			int sector_ofs = offset % DISK_SECTOR_SIZE;
+
+			/* Bytes left to write here, bytes left in sector, lesser
+			 * of the two. */
+			off_t inode_left = limit - offset;
+			int sector_left = DISK_SECTOR_SIZE - sector_ofs;
+			int chunk_size = inode_left < sector_left ? inode_left : sector_left;
+
+			ASSERT (sector_idx != (disk_sector_t) -1 && sector_idx != HOLE
+					&& sector_idx != PENDING);
+
+			if (direct && !inode->journaled && sector_ofs == 0
+					&& inode_left >= DISK_SECTOR_SIZE) {
+				/* Whole sectors of one extent, in one transfer. */
+				if (run > (size_t) (inode_left / DISK_SECTOR_SIZE))
+					run = inode_left / DISK_SECTOR_SIZE;
+				combine_flush_sectors (inode, sector_idx, run);
+				buffer_cache_write_direct (sector_idx, run,
+						buffer + bytes_written);
+				chunk_size = run * DISK_SECTOR_SIZE;
+			} else if (inode->journaled || chunk_size == DISK_SECTOR_SIZE
+					|| !combine_write (inode, sector_idx, buffer + bytes_written,
+						sector_ofs, chunk_size)) {
+				/* Write the chunk into the buffer cache.  A partial sector is
+				   merged with the cached copy of the rest of the sector. */
+				if (!inode->journaled)
+					combine_flush_sectors (inode, sector_idx, 1);
+				write_sector (inode, sector_idx, buffer + bytes_written,
+						sector_ofs, chunk_size);
 			}
 
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
+			/* Advance. */
+			size -= chunk_size;
+			offset += chunk_size;
+			bytes_written += chunk_size;
 		}
+		if (limit < split)
+			break;
+	}
 
-		/* Advance. */
-		size -= chunk_size;
-		offset += chunk_size;
-		bytes_written += chunk_size;
+	if (offset > inode_length (inode)) {
+		lock_acquire (&inode->extent_lock);
+		if (offset > inode->data.length) {
+			inode->data.length = offset;
+			inode->dirty = true;
+		}
+		lock_release (&inode->extent_lock);
 	}
-	free (bounce);
+	journal_end ();
+	return bytes_written;
+}
 
+/* Writes SIZE bytes from BUFFER into INODE, a tmpfs file, starting
+ * at OFFSET, and returns the number of bytes written, as
+ * inode_write_at(). */
+static off_t
+tmpfs_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	off_t bytes_written = tmpfs_data_write (inode->tmp, buffer, size, offset);
+
+	lock_acquire (&inode->extent_lock);
+	if (offset + bytes_written > inode->data.length)
+		inode->data.length = offset + bytes_written;
+	lock_release (&inode->extent_lock);
 	return bytes_written;
 }
 
@@ -292,8 +1795,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	lock_acquire (&open_inodes_lock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	lock_release (&open_inodes_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +1806,18 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	lock_acquire (&open_inodes_lock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	lock_release (&open_inodes_lock);
+}
+
+/* Makes INODE's data metadata, like a directory's, so that it is
+ * written through the journal. */
+void
+inode_set_journaled (struct inode *inode) {
+	inode->journaled = true;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -311,3 +1825,32 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Locks INODE's contents for reading.  Inode data is not locked by
+ * inode_read_at() and inode_write_at() themselves: they lock only
+ * its extents and length, which grow under extent_lock, the buffer
+ * cache keeps each sector consistent, and file reads and writes copy straight to user memory,
+ * whose page faults may write back a page of the same inode.  Callers
+ * whose contents span several sectors, like directories, lock here. */
+void
+inode_acquire_read (struct inode *inode) {
+	rwlock_acquire_read (&inode->lock);
+}
+
+/* Unlocks INODE's contents, locked for reading. */
+void
+inode_release_read (struct inode *inode) {
+	rwlock_release_read (&inode->lock);
+}
+
+/* Locks INODE's contents for writing. */
+void
+inode_acquire_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->lock);
+}
+
+/* Unlocks INODE's contents, locked for writing. */
+void
+inode_release_write (struct inode *inode) {
+	rwlock_release_write (&inode->lock);
+}
@@ -0,0 +1,400 @@
+/* journal.c: Write-ahead log of file system metadata.
+ *
+ * Metadata sectors, that is inodes, indirect blocks, directories and
+ * the free map, are written with journal_write() instead of straight
+ * into the buffer cache.  Their changes gather in a running
+ * transaction whose sectors stay pinned in the cache.  Committing the
+ * transaction appends, to the JOURNAL_SECTORS sectors of the log, a
+ * descriptor naming the sectors, the sectors' new contents and a
+ * commit record with a checksum, and unpins the sectors.  From then
+ * on they reach their home on disk by the cache's write-back as
+ * usual, however many operations changed them meanwhile.
+ *
+ * A transaction commits when it fills up, and otherwise when the
+ * write-behind daemon, fsync() or shutdown asks, once no operation
+ * bracketed by journal_begin() and journal_end() is running, so that
+ * an operation is on disk whole or not at all.  When the log fills,
+ * the cache is flushed, after which the log may start over.
+ *
+ * journal_open() replays the committed transactions left in the log.
+ * A sector freed after being logged is revoked, so that replay does
+ * not write its old contents over what it came to hold later, as
+ * data, which goes to disk without passing through the log. */
+
+#include "filesys/journal.h"
+#include <debug.h>
+#include <crc32c.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Identify the sectors of the log. */
+#define JOURNAL_MAGIC 0x4c4e524a
+#define DESC_MAGIC 0x4353444a
+#define COMMIT_MAGIC 0x544d434a
+
+/* First sector of the log, after the superblock, and the sector past
+ * its end. */
+#define LOG_START (JOURNAL_SECTOR + 1)
+#define LOG_END (JOURNAL_SECTOR + JOURNAL_SECTORS)
+
+/* The log's first sector.  Replay starts at LOG_START with the
+ * transaction numbered SEQ. */
+struct journal_super {
+	uint32_t magic;
+	uint32_t seq;
+	uint8_t unused[DISK_SECTOR_SIZE - 8];
+};
+
+/* Sector numbers a descriptor has room for. */
+#define DESC_ENTRIES ((DISK_SECTOR_SIZE - 16) / sizeof (disk_sector_t))
+
+/* Most sectors one transaction revokes.  A sector is revoked at most
+ * once per transaction, and only if it is in the log or in the
+ * transaction, so this is never reached. */
+#define JOURNAL_REVOKE_MAX (DESC_ENTRIES - JOURNAL_TX_MAX)
+
+/* First sector of a transaction in the log.  It is followed by the
+ * contents of its CNT sectors and by its journal_commit. */
+struct journal_desc {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t cnt;               /* Sectors logged. */
+	uint32_t revoke_cnt;        /* Sectors revoked. */
+	disk_sector_t sectors[DESC_ENTRIES]; /* CNT logged, then revoked. */
+};
+
+/* Last sector of a transaction: it is committed only if this is
+ * there and CHECKSUM matches. */
+struct journal_commit {
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t checksum;          /* CRC-32C of the descriptor and contents. */
+	uint8_t unused[DISK_SECTOR_SIZE - 16];
+};
+
+static bool enabled;            /* False without a log on disk. */
+static struct lock journal_lock; /* Protects all the below. */
+static struct condition idle;   /* Signaled when ACTIVE drops to 0. */
+static int active;              /* Operations running. */
+static uint32_t seq;            /* Number of the running transaction. */
+static disk_sector_t head;      /* Next sector of the log to write. */
+
+/* The running transaction. */
+static struct journal_desc *desc;
+static disk_sector_t revoked[JOURNAL_REVOKE_MAX];
+
+/* Sectors logged since the log last started over, which must be
+ * revoked if freed.  Each took a sector of the log, so there are
+ * fewer than JOURNAL_SECTORS, which is small enough for all of them
+ * and a whole transaction to be revoked at once. */
+static disk_sector_t logged[JOURNAL_SECTORS];
+static size_t logged_cnt;
+
+static uint8_t *block;          /* A sector's worth of scratch. */
+
+static void commit (void);
+static void restart (void);
+
+/* Initializes the journal, disabled until journal_create() or
+ * journal_open(). */
+void
+journal_init (void) {
+	lock_init (&journal_lock);
+	cond_init (&idle);
+	desc = malloc (sizeof *desc);
+	block = malloc (DISK_SECTOR_SIZE);
+	if (desc == NULL || block == NULL)
+		PANIC ("journal_init: out of memory");
+	ASSERT (sizeof *desc == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct journal_super) == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct journal_commit) == DISK_SECTOR_SIZE);
+	ASSERT (JOURNAL_SECTORS + JOURNAL_TX_MAX <= JOURNAL_REVOKE_MAX);
+}
+
+/* Returns the checksum of D and of the contents of its sectors,
+ * which follow it in the log from sector AT. */
+static uint32_t
+checksum (const struct journal_desc *d, disk_sector_t at) {
+	uint32_t sum = crc32c (0, d, sizeof *d);
+	size_t i;
+
+	for (i = 0; i < d->cnt; i++) {
+		block_read (filesys_disk, at + i, block);
+		sum = crc32c (sum, block, DISK_SECTOR_SIZE);
+	}
+	return sum;
+}
+
+/* Reads the transaction numbered S at sector AT of the log into D.
+ * Returns true if it is there and committed. */
+static bool
+read_transaction (disk_sector_t at, uint32_t s, struct journal_desc *d) {
+	struct journal_commit *c = (struct journal_commit *) block;
+	uint32_t sum;
+
+	if (at >= LOG_END)
+		return false;
+	block_read (filesys_disk, at, d);
+	if (d->magic != DESC_MAGIC || d->seq != s || d->cnt > JOURNAL_TX_MAX
+			|| d->revoke_cnt > JOURNAL_REVOKE_MAX
+			|| d->cnt + 2 > LOG_END - at)
+		return false;
+	sum = checksum (d, at + 1);
+	block_read (filesys_disk, at + 1 + d->cnt, c);
+	return c->magic == COMMIT_MAGIC && c->seq == s && c->checksum == sum;
+}
+
+/* Returns true if a transaction of TXS after the Ith revokes
+ * SECTOR, or the Ith does. */
+static bool
+is_revoked (struct journal_desc *txs, size_t cnt, size_t i,
+		disk_sector_t sector) {
+	for (; i < cnt; i++) {
+		const struct journal_desc *d = &txs[i];
+		size_t j;
+
+		for (j = 0; j < d->revoke_cnt; j++)
+			if (d->sectors[d->cnt + j] == sector)
+				return true;
+	}
+	return false;
+}
+
+/* Writes the contents logged by the committed transactions of the
+ * log, starting with the one numbered FIRST, to their homes.  Returns
+ * the number of the first transaction not found. */
+static uint32_t
+replay (uint32_t first) {
+	size_t max = (JOURNAL_SECTORS - 1) / 2;
+	struct journal_desc *txs = malloc (max * sizeof *txs);
+	disk_sector_t at = LOG_START;
+	size_t cnt, i, j;
+
+	if (txs == NULL)
+		PANIC ("journal: out of memory for replay");
+	for (cnt = 0; cnt < max
+			&& read_transaction (at, first + cnt, &txs[cnt]); cnt++)
+		at += txs[cnt].cnt + 2;
+
+	at = LOG_START;
+	for (i = 0; i < cnt; i++) {
+		for (j = 0; j < txs[i].cnt; j++)
+			if (!is_revoked (txs, cnt, i, txs[i].sectors[j])) {
+				block_read (filesys_disk, at + 1 + j, block);
+				block_write (filesys_disk, txs[i].sectors[j], block);
+			}
+		at += txs[i].cnt + 2;
+	}
+	if (cnt > 0)
+		printf ("journal: replayed %zu transactions\n", cnt);
+	free (txs);
+	return first + cnt;
+}
+
+/* Creates an empty log on a disk being formatted, and starts
+ * journaling.  Numbers continue from any log of an earlier file
+ * system, so that none of its transactions pass for new ones. */
+void
+journal_create (void) {
+	struct journal_super *sb = (struct journal_super *) block;
+
+	block_read (filesys_disk, JOURNAL_SECTOR, sb);
+	seq = sb->magic == JOURNAL_MAGIC ? sb->seq + JOURNAL_SECTORS : 1;
+	restart ();
+	desc->cnt = desc->revoke_cnt = 0;
+	enabled = true;
+}
+
+/* Replays the log and starts journaling.  Returns false, leaving
+ * journaling off, if the disk has no log. */
+bool
+journal_open (void) {
+	struct journal_super *sb = (struct journal_super *) block;
+
+	block_read (filesys_disk, JOURNAL_SECTOR, sb);
+	if (sb->magic != JOURNAL_MAGIC)
+		return false;
+	seq = replay (sb->seq);
+	restart ();
+	desc->cnt = desc->revoke_cnt = 0;
+	enabled = true;
+	return true;
+}
+
+/* Commits the running transaction and leaves the log empty, with
+ * all metadata at home on disk.  Called at shutdown. */
+void
+journal_done (void) {
+	if (!enabled)
+		return;
+	journal_commit ();
+	lock_acquire (&journal_lock);
+	buffer_cache_flush ();
+	restart ();
+	lock_release (&journal_lock);
+}
+
+/* Starts the log over, empty, at transaction SEQ.  Everything logged
+ * must be at home on disk. */
+static void
+restart (void) {
+	struct journal_super *sb = (struct journal_super *) block;
+
+	memset (sb, 0, sizeof *sb);
+	sb->magic = JOURNAL_MAGIC;
+	sb->seq = seq;
+	block_write (filesys_disk, JOURNAL_SECTOR, sb);
+	head = LOG_START;
+	logged_cnt = 0;
+}
+
+/* Marks the start of an operation whose metadata changes should
+ * commit together.  Operations nest. */
+void
+journal_begin (void) {
+	if (!enabled)
+		return;
+	lock_acquire (&journal_lock);
+	active++;
+	lock_release (&journal_lock);
+}
+
+/* Marks the end of an operation started with journal_begin(). */
+void
+journal_end (void) {
+	if (!enabled)
+		return;
+	lock_acquire (&journal_lock);
+	ASSERT (active > 0);
+	if (--active == 0)
+		cond_broadcast (&idle, &journal_lock);
+	lock_release (&journal_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into metadata sector SECTOR at byte
+ * SECTOR_OFS, as part of the running transaction. */
+void
+journal_write (disk_sector_t sector, const void *buffer, int sector_ofs,
+		int size) {
+	size_t i;
+
+	if (!enabled) {
+		buffer_cache_write (sector, buffer, sector_ofs, size);
+		return;
+	}
+
+	lock_acquire (&journal_lock);
+	for (i = 0; i < desc->cnt; i++)
+		if (desc->sectors[i] == sector)
+			break;
+	if (i == desc->cnt) {
+		if (desc->cnt == JOURNAL_TX_MAX)
+			commit ();
+		desc->sectors[desc->cnt++] = sector;
+	}
+	/* Reused since it was revoked: the new contents must replay. */
+	for (i = 0; i < desc->revoke_cnt; i++)
+		if (revoked[i] == sector) {
+			revoked[i] = revoked[--desc->revoke_cnt];
+			break;
+		}
+	buffer_cache_write_held (sector, buffer, sector_ofs, size);
+	lock_release (&journal_lock);
+}
+
+/* Revokes the logged ones of the CNT sectors from SECTOR, which are
+ * being freed. */
+void
+journal_revoke (disk_sector_t sector, size_t cnt) {
+	size_t i;
+
+	if (!enabled)
+		return;
+	lock_acquire (&journal_lock);
+	for (i = 0; i < logged_cnt + desc->cnt; i++) {
+		disk_sector_t s = i < logged_cnt ? logged[i] : desc->sectors[i - logged_cnt];
+		size_t j;
+
+		if (s < sector || s - sector >= cnt)
+			continue;
+		for (j = 0; j < desc->revoke_cnt; j++)
+			if (revoked[j] == s)
+				break;
+		if (j == desc->revoke_cnt) {
+			ASSERT (desc->revoke_cnt < JOURNAL_REVOKE_MAX);
+			revoked[desc->revoke_cnt++] = s;
+		}
+	}
+	lock_release (&journal_lock);
+}
+
+/* Commits the running transaction once no operation is running. */
+void
+journal_commit (void) {
+	if (!enabled)
+		return;
+	lock_acquire (&journal_lock);
+	while (active > 0)
+		cond_wait (&idle, &journal_lock);
+	commit ();
+	lock_release (&journal_lock);
+}
+
+/* Appends the running transaction to the log, unpins its sectors and
+ * starts the next one.  Must be called with journal_lock held. */
+static void
+commit (void) {
+	struct journal_commit *c;
+	uint32_t sum;
+	size_t i, j;
+
+	ASSERT (lock_held_by_current_thread (&journal_lock));
+	if (desc->cnt == 0 && desc->revoke_cnt == 0)
+		return;
+
+	/* Start the log over when it has no room; the homes of all it
+	 * holds must be written first. */
+	if (desc->cnt + 2 > LOG_END - head) {
+		buffer_cache_flush ();
+		restart ();
+	}
+
+	desc->magic = DESC_MAGIC;
+	desc->seq = seq;
+	memcpy (&desc->sectors[desc->cnt], revoked,
+			desc->revoke_cnt * sizeof *revoked);
+	memset (&desc->sectors[desc->cnt + desc->revoke_cnt], 0,
+			(DESC_ENTRIES - desc->cnt - desc->revoke_cnt) * sizeof *revoked);
+	block_write (filesys_disk, head, desc);
+	sum = crc32c (0, desc, sizeof *desc);
+	for (i = 0; i < desc->cnt; i++) {
+		disk_sector_t sector = desc->sectors[i];
+
+		buffer_cache_read (sector, block, 0, DISK_SECTOR_SIZE);
+		block_write (filesys_disk, head + 1 + i, block);
+		sum = crc32c (sum, block, DISK_SECTOR_SIZE);
+		for (j = 0; j < logged_cnt; j++)
+			if (logged[j] == sector)
+				break;
+		if (j == logged_cnt)
+			logged[logged_cnt++] = sector;
+	}
+
+	c = (struct journal_commit *) block;
+	memset (c, 0, sizeof *c);
+	c->magic = COMMIT_MAGIC;
+	c->seq = seq;
+	c->checksum = sum;
+	block_write (filesys_disk, head + 1 + desc->cnt, c);
+
+	for (i = 0; i < desc->cnt; i++)
+		buffer_cache_release_held (desc->sectors[i]);
+	head += desc->cnt + 2;
+	seq++;
+	desc->cnt = desc->revoke_cnt = 0;
+}
@@ -1,9 +1,30 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
 #include "vm/vm.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Dirty data older than this many ticks is written back. */
+#define PAGE_CACHE_FLUSH_INTERVAL TIMER_FREQ
+/* Flush immediately once this many cache slots are dirty. */
+#define PAGE_CACHE_DIRTY_HIGH (BUFFER_CACHE_SIZE / 2)
+/* Maximum number of queued read-ahead requests. */
+#define READAHEAD_QUEUE_SIZE 16
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_work_run (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -13,38 +34,161 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
-tid_t page_cache_workerd;
+/* Serves read-ahead and writes the buffer cache back, on the work
+ * queue.  Queued once page_cache_ready. */
+static struct work page_cache_work;
+static bool page_cache_ready;
+
+/* A request to bring CNT sectors starting at SECTOR into the cache. */
+struct readahead_request {
+	disk_sector_t sector;
+	size_t cnt;
+};
+
+/* Ring of pending read-ahead requests, consumed by the daemon. */
+static struct readahead_request readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head;           /* Index of oldest request. */
+static size_t readahead_cnt;            /* Number of queued requests. */
+static struct lock readahead_lock;
 
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	/* Both filesys_init() and vm_init() may get here. */
+	if (page_cache_ready)
+		return;
+
+	lock_init (&readahead_lock);
+	readahead_head = readahead_cnt = 0;
+	work_init (&page_cache_work, page_cache_work_run, NULL, PRI_DEFAULT);
+	page_cache_ready = true;
+}
+
+/* Queues the page cache work to run now.  Called when a cache slot
+ * first becomes dirty, when too many slots are dirty, and on
+ * read-ahead requests.  Does nothing before pagecache_init(). */
+void
+page_cache_kick (void) {
+	if (page_cache_ready)
+		work_queue (&page_cache_work);
+}
+
+/* Asks the daemon to prefetch CNT sectors starting at SECTOR.
+ * The request is dropped if the queue is full: read-ahead is only a
+ * hint. */
+void
+page_cache_request_readahead (disk_sector_t sector, size_t cnt) {
+	if (!page_cache_ready || cnt == 0)
+		return;
+
+	lock_acquire (&readahead_lock);
+	if (readahead_cnt < READAHEAD_QUEUE_SIZE) {
+		size_t tail = (readahead_head + readahead_cnt) % READAHEAD_QUEUE_SIZE;
+		readahead_queue[tail].sector = sector;
+		readahead_queue[tail].cnt = cnt;
+		readahead_cnt++;
+	}
+	lock_release (&readahead_lock);
+	page_cache_kick ();
+}
+
+/* Removes the oldest read-ahead request into *REQ.
+ * Returns false if the queue is empty. */
+static bool
+readahead_pop (struct readahead_request *req) {
+	bool success = false;
+
+	lock_acquire (&readahead_lock);
+	if (readahead_cnt > 0) {
+		*req = readahead_queue[readahead_head];
+		readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+		readahead_cnt--;
+		success = true;
+	}
+	lock_release (&readahead_lock);
+	return success;
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
-
+	return true;
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
-page_cache_readahead (struct page *page, void *kva) {
+page_cache_readahead (struct page *page UNUSED, void *kva UNUSED) {
+#ifdef EFILESYS
+	struct page_cache *page_cache = &page->page_cache;
+	size_t i;
+
+	for (i = 0; i < SECTORS_PER_PAGE; i++)
+		buffer_cache_read (page_cache->sector + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE, 0, DISK_SECTOR_SIZE);
+	return true;
+#else
+	return false;
+#endif
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool
-page_cache_writeback (struct page *page) {
+page_cache_writeback (struct page *page UNUSED) {
+#ifdef EFILESYS
+	struct page_cache *page_cache = &page->page_cache;
+	size_t i;
+
+	ASSERT (page->frame != NULL);
+	for (i = 0; i < SECTORS_PER_PAGE; i++)
+		buffer_cache_write (page_cache->sector + i,
+				(uint8_t *) page->frame->kva + i * DISK_SECTOR_SIZE, 0,
+				DISK_SECTOR_SIZE);
+	return true;
+#else
+	return false;
+#endif
 }
 
 /* Destory the page_cache. */
 static void
-page_cache_destroy (struct page *page) {
+page_cache_destroy (struct page *page UNUSED) {
 }
 
-/* Worker thread for page cache */
+/* Page cache work.
+ * Serves read-ahead requests, and writes dirty buffer cache slots
+ * back once they have stayed dirty for PAGE_CACHE_FLUSH_INTERVAL
+ * ticks or once more than PAGE_CACHE_DIRTY_HIGH slots are dirty, so
+ * that writers seldom have to wait for a write-back on eviction.
+ * While dirty data is left, runs again when the oldest of it comes
+ * due, so an idle system with dirty slots takes no ticks in between;
+ * otherwise waits for page_cache_kick(). */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_work_run (void *aux UNUSED) {
+	static int64_t dirty_since;
+	static bool was_dirty;
+	struct readahead_request req;
+	size_t dirty_cnt;
+
+	while (readahead_pop (&req))
+		buffer_cache_prefetch (req.sector, req.cnt);
+
+	dirty_cnt = buffer_cache_dirty_cnt ();
+	if (dirty_cnt > 0 && !was_dirty)
+		dirty_since = timer_ticks ();
+	if (dirty_cnt >= PAGE_CACHE_DIRTY_HIGH
+			|| (dirty_cnt > 0
+				&& timer_elapsed (dirty_since) >= PAGE_CACHE_FLUSH_INTERVAL)) {
+		inode_flush_all ();
+		inode_commit ();
+		dirty_cnt = buffer_cache_dirty_cnt ();
+		dirty_since = timer_ticks ();
+	}
+	was_dirty = dirty_cnt > 0;
+
+	if (was_dirty)
+		work_queue_delayed (&page_cache_work,
+				PAGE_CACHE_FLUSH_INTERVAL - timer_elapsed (dirty_since));
 }
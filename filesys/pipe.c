@@ -0,0 +1,191 @@
+/* pipe.c: Pipes, one-way byte channels between processes.
+ *
+ * A pipe is a ring buffer of PIPE_SIZE bytes with a read end and a
+ * write end, each opened as a struct file (see file_open_pipe()) and
+ * so reached through file descriptors like any file.  A reader waits
+ * while the pipe is empty and a writer while it is full, unless all
+ * ends of the other kind are closed.  Pollers wait on its wait queue
+ * for either.  The pipe is freed when its last end is. */
+
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/waitq.h"
+
+struct pipe {
+	struct lock lock;           /* Protects all the members below. */
+	struct condition not_empty; /* Signaled when data or EOF arrives. */
+	struct condition not_full;  /* Signaled when space frees up. */
+	struct waitq waitq;         /* Woken on either, for poll(). */
+	uint8_t *buf;               /* PIPE_SIZE bytes. */
+	size_t head;                /* Bytes written in total. */
+	size_t tail;                /* Bytes read in total. */
+	int readers;                /* Open read ends. */
+	int writers;                /* Open write ends. */
+};
+
+/* Returns a new pipe with one read end and one write end open, or a
+ * null pointer if memory runs out. */
+struct pipe *
+pipe_create (void) {
+	struct pipe *pipe = malloc (sizeof *pipe);
+
+	ASSERT (PIPE_SIZE <= PGSIZE);
+	if (pipe == NULL)
+		return NULL;
+	pipe->buf = palloc_get_page (0);
+	if (pipe->buf == NULL) {
+		free (pipe);
+		return NULL;
+	}
+	lock_init (&pipe->lock);
+	cond_init (&pipe->not_empty);
+	cond_init (&pipe->not_full);
+	waitq_init (&pipe->waitq);
+	pipe->head = pipe->tail = 0;
+	pipe->readers = pipe->writers = 1;
+	return pipe;
+}
+
+/* Opens another read end of PIPE, or write end if WRITER. */
+void
+pipe_open (struct pipe *pipe, bool writer) {
+	lock_acquire (&pipe->lock);
+	if (writer)
+		pipe->writers++;
+	else
+		pipe->readers++;
+	lock_release (&pipe->lock);
+}
+
+/* Closes a read end of PIPE, or write end if WRITER.  Waiters of the
+ * other kind wake up to see it if it was the last, and PIPE is freed
+ * if it was its last end of all. */
+void
+pipe_close (struct pipe *pipe, bool writer) {
+	bool last;
+
+	lock_acquire (&pipe->lock);
+	if (writer) {
+		ASSERT (pipe->writers > 0);
+		if (--pipe->writers == 0)
+			cond_broadcast (&pipe->not_empty, &pipe->lock);
+	} else {
+		ASSERT (pipe->readers > 0);
+		if (--pipe->readers == 0)
+			cond_broadcast (&pipe->not_full, &pipe->lock);
+	}
+	last = pipe->readers == 0 && pipe->writers == 0;
+	if (!last)
+		waitq_wake (&pipe->waitq);
+	lock_release (&pipe->lock);
+
+	if (last) {
+		/* A thread of a poller's process may have closed the last end
+		 * while it slept. */
+		waitq_destroy (&pipe->waitq);
+		palloc_free_page (pipe->buf);
+		free (pipe);
+	}
+}
+
+/* Reads up to SIZE bytes from PIPE into BUFFER, waiting until there
+ * is at least one unless SIZE is 0 or no write end is open.  Returns
+ * the number of bytes read, which is 0 at end of file. */
+off_t
+pipe_read (struct pipe *pipe, void *buffer_, off_t size) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+
+	if (size <= 0)
+		return 0;
+	lock_acquire (&pipe->lock);
+	while (pipe->head == pipe->tail && pipe->writers > 0)
+		cond_wait (&pipe->not_empty, &pipe->lock);
+
+	/* Copy out at most two runs, before and after the wrap. */
+	while (bytes_read < size && pipe->head != pipe->tail) {
+		size_t ofs = pipe->tail % PIPE_SIZE;
+		size_t chunk = pipe->head - pipe->tail;
+
+		if (chunk > PIPE_SIZE - ofs)
+			chunk = PIPE_SIZE - ofs;
+		if (chunk > (size_t) (size - bytes_read))
+			chunk = size - bytes_read;
+		memcpy (buffer + bytes_read, pipe->buf + ofs, chunk);
+		pipe->tail += chunk;
+		bytes_read += chunk;
+	}
+	if (bytes_read > 0) {
+		cond_broadcast (&pipe->not_full, &pipe->lock);
+		waitq_wake (&pipe->waitq);
+	}
+	lock_release (&pipe->lock);
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into PIPE, waiting for space as
+ * needed.  Returns the number of bytes written, which is less than
+ * SIZE only if every read end is closed before all are written. */
+off_t
+pipe_write (struct pipe *pipe, const void *buffer_, off_t size) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+
+	lock_acquire (&pipe->lock);
+	while (bytes_written < size) {
+		size_t ofs = pipe->head % PIPE_SIZE;
+		size_t chunk;
+
+		while (pipe->head - pipe->tail == PIPE_SIZE && pipe->readers > 0)
+			cond_wait (&pipe->not_full, &pipe->lock);
+		if (pipe->readers == 0)
+			break;
+
+		chunk = PIPE_SIZE - (pipe->head - pipe->tail);
+		if (chunk > PIPE_SIZE - ofs)
+			chunk = PIPE_SIZE - ofs;
+		if (chunk > (size_t) (size - bytes_written))
+			chunk = size - bytes_written;
+		memcpy (pipe->buf + ofs, buffer + bytes_written, chunk);
+		pipe->head += chunk;
+		bytes_written += chunk;
+		cond_broadcast (&pipe->not_empty, &pipe->lock);
+		waitq_wake (&pipe->waitq);
+	}
+	lock_release (&pipe->lock);
+	return bytes_written;
+}
+
+/* Returns the POLL* events of the read end of PIPE, or of the write
+ * end if WRITER, that are ready: POLLIN if reading would not wait,
+ * and POLLHUP if no write end is open; or POLLOUT if writing would
+ * not wait, and POLLERR if no read end is open.  If E is not null,
+ * first adds it, for P, to PIPE's wait queue, which is woken when
+ * these may change. */
+int
+pipe_poll (struct pipe *pipe, bool writer, struct poller *p,
+		struct waitq_entry *e) {
+	int events = 0;
+
+	lock_acquire (&pipe->lock);
+	if (e != NULL)
+		poller_add (p, e, &pipe->waitq);
+	if (writer) {
+		if (pipe->readers == 0)
+			events |= POLLERR;
+		else if (pipe->head - pipe->tail < PIPE_SIZE)
+			events |= POLLOUT;
+	} else {
+		if (pipe->head != pipe->tail)
+			events |= POLLIN;
+		if (pipe->writers == 0)
+			events |= POLLHUP;
+	}
+	lock_release (&pipe->lock);
+	return events;
+}
@@ -0,0 +1,283 @@
+/* procfs.c: A read-only file system of kernel statistics.
+ *
+ * mount() with MOUNT_PROCFS mounts it at a name of the root directory,
+ * the mount point, and its file NAME is then opened as "POINT/NAME"
+ * and read like any other.  Each file shows live statistics of one
+ * part of the kernel, as text printed by the very functions that
+ * print them at shutdown, captured with console_capture().
+ *
+ * The text is rendered when the file is opened, into a fresh tmpfs
+ * inode that cannot be written and goes away when it is closed, so
+ * the reads of one open all see the same snapshot, however small;
+ * reopening the file gets a new one. */
+
+#include "filesys/procfs.h"
+#include <console.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/disk.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "filesys/tmpfs.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pmu.h"
+#include "threads/rgroup.h"
+#include "threads/scratch.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#ifdef USERPROG
+#include "userprog/exception.h"
+#include "userprog/syscall.h"
+#endif
+#ifdef VM
+#include "vm/vm.h"
+#include "vm/zswap.h"
+#endif
+
+/* Most bytes of a file's text; the rest is cut off. */
+#define PROCFS_TEXT_MAX (16 * 1024)
+
+/* A procfs file. */
+struct procfs_file {
+	const char *name;
+	void (*show) (void);        /* Prints the file's text. */
+};
+
+static void show_sched (void);
+static void show_memory (void);
+static void show_disk (void);
+static void show_self (void);
+#ifdef USERPROG
+static void show_syscalls (void);
+#endif
+
+static const struct procfs_file files[] = {
+	{"sched", show_sched},
+	{"memory", show_memory},
+	{"disk", show_disk},
+	{"self", show_self},
+	{"pmu", pmu_print_stats},
+	{"rgroups", rgroup_print_stats},
+#ifdef USERPROG
+	{"syscalls", show_syscalls},
+#endif
+#ifdef LOCKSTAT
+	{"locks", lockstat_print_stats},
+#endif
+};
+
+/* The mount point, empty if the procfs is not mounted, and the inode
+ * number of the next file opened.  Locked before any inode's lock;
+ * held while a file is rendered, so that one thread at a time
+ * captures the console. */
+static char mount_point[NAME_MAX + 1];
+static disk_sector_t next_inumber = PROCFS_INUMBER_BASE;
+static struct lock procfs_lock;
+
+static const struct procfs_file *resolve (const char *path);
+
+/* Initializes the procfs module. */
+void
+procfs_init (void) {
+	lock_init (&procfs_lock);
+}
+
+/* Mounts the procfs at POINT, a name of the root directory, with or
+ * without a leading slash.  Fails if the procfs is mounted already,
+ * or if POINT is not a valid name, names a file on disk or has a
+ * tmpfs mounted.  The tmpfs is asked before procfs_lock is taken,
+ * as tmpfs_mount() asks the procfs before taking its own lock. */
+bool
+procfs_mount (const char *point) {
+	char probe[NAME_MAX + 3];
+	struct inode *inode = NULL;
+	struct dir *root;
+	size_t len;
+
+	while (*point == '/')
+		point++;
+	len = strlen (point);
+	if (len == 0 || len > NAME_MAX || strchr (point, '/') != NULL)
+		return false;
+	snprintf (probe, sizeof probe, "%s/", point);
+	if (tmpfs_owns (probe))
+		return false;
+
+	lock_acquire (&procfs_lock);
+	root = dir_open_root ();
+	if (root != NULL)
+		dir_lookup (root, point, &inode);
+	dir_close (root);
+	if (root == NULL || inode != NULL || mount_point[0] != '\0') {
+		inode_close (inode);
+		lock_release (&procfs_lock);
+		return false;
+	}
+	strlcpy (mount_point, point, sizeof mount_point);
+	lock_release (&procfs_lock);
+	return true;
+}
+
+/* Unmounts the procfs from POINT.  Files still open stay readable
+ * until closed.  Returns false if the procfs is not mounted there. */
+bool
+procfs_umount (const char *point) {
+	bool success;
+
+	while (*point == '/')
+		point++;
+	lock_acquire (&procfs_lock);
+	success = mount_point[0] != '\0' && !strcmp (point, mount_point);
+	if (success)
+		mount_point[0] = '\0';
+	lock_release (&procfs_lock);
+	return success;
+}
+
+/* Returns true if PATH is in the mounted procfs, that is, of the
+ * form "POINT/..." for its mount point POINT. */
+bool
+procfs_owns (const char *path) {
+	size_t len;
+	bool owned;
+
+	while (*path == '/')
+		path++;
+	lock_acquire (&procfs_lock);
+	len = strlen (mount_point);
+	owned = len != 0 && !memcmp (path, mount_point, len)
+		&& path[len] == '/';
+	lock_release (&procfs_lock);
+	return owned;
+}
+
+/* Opens the procfs file PATH, rendering its text now, and returns
+ * its inode, or a null pointer if there is no such file or memory
+ * runs out. */
+struct inode *
+procfs_open (const char *path) {
+	const struct procfs_file *file;
+	struct inode *inode = NULL;
+	char *text;
+	size_t len;
+
+	text = malloc (PROCFS_TEXT_MAX);
+	if (text == NULL)
+		return NULL;
+
+	lock_acquire (&procfs_lock);
+	file = resolve (path);
+	if (file != NULL) {
+		console_capture (text, PROCFS_TEXT_MAX);
+		file->show ();
+		len = console_capture_end ();
+
+		inode = inode_create_tmpfs (next_inumber, 0);
+		if (inode != NULL) {
+			next_inumber++;
+			if (inode_write_at (inode, text, len, 0) != (off_t) len) {
+				inode_close (inode);
+				inode = NULL;
+			} else
+				inode_deny_write (inode);
+		}
+	}
+	lock_release (&procfs_lock);
+	free (text);
+	return inode;
+}
+
+/* Returns the file PATH names in the mounted procfs, or a null
+ * pointer if there is none.  The caller holds procfs_lock. */
+static const struct procfs_file *
+resolve (const char *path) {
+	size_t len = strlen (mount_point);
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&procfs_lock));
+	while (*path == '/')
+		path++;
+	if (len == 0 || memcmp (path, mount_point, len) || path[len] != '/')
+		return NULL;
+	path += len + 1;
+	for (i = 0; i < sizeof files / sizeof *files; i++)
+		if (!strcmp (path, files[i].name))
+			return &files[i];
+	return NULL;
+}
+
+/* "sched": processors, interrupts, timer, threads and work queues. */
+static void
+show_sched (void) {
+	cpu_print_stats ();
+	intr_print_stats ();
+	timer_print_stats ();
+	thread_print_stats ();
+	workqueue_print_stats ();
+	fpu_print_stats ();
+}
+
+/* "memory": the page allocator, malloc() and object caches, and with
+ * VM, page faults, page merging and compressed swap. */
+static void
+show_memory (void) {
+	palloc_print_stats ();
+	malloc_print_stats ();
+	kmem_cache_print_stats ();
+	scratch_print_stats ();
+#ifdef VM
+	vm_print_fault_stats ();
+	vm_print_ksm_stats ();
+	vm_print_compact_stats ();
+	zswap_print_stats ();
+#endif
+}
+
+/* "disk": the disks, with their latency histograms, and the block
+ * devices and buffer cache hits. */
+static void
+show_disk (void) {
+	disk_print_stats ();
+	block_print_stats ();
+}
+
+/* "self": the thread reading it, and with VM, its process's memory
+ * and page faults. */
+static void
+show_self (void) {
+	uint64_t stats[SCHED_STAT_CNT];
+	struct thread *t = thread_current ();
+
+	thread_sched_stats (0, stats);
+	printf ("Thread %d (%s): %llu cycles running, %llu ready, "
+			"%llu blocked on locks, %llu blocked otherwise\n",
+			t->tid, t->name, (unsigned long long) stats[SCHED_RUN],
+			(unsigned long long) stats[SCHED_READY],
+			(unsigned long long) stats[SCHED_LOCK],
+			(unsigned long long) stats[SCHED_BLOCK]);
+	printf ("Thread %d (%s): %llu voluntary, %llu involuntary switches, "
+			"%llu wakeups\n", t->tid, t->name,
+			(unsigned long long) stats[SCHED_VOLUNTARY],
+			(unsigned long long) stats[SCHED_INVOLUNTARY],
+			(unsigned long long) stats[SCHED_WAKEUPS]);
+#ifdef VM
+	vm_print_process_stats ();
+#endif
+}
+
+#ifdef USERPROG
+/* "syscalls": exceptions and system calls. */
+static void
+show_syscalls (void) {
+	exception_print_stats ();
+	syscall_print_stats ();
+}
+#endif
@@ -3,6 +3,13 @@ filesys_SRC += filesys/fat.c		# FAT.
 filesys_SRC += filesys/free-map.c	# Free sector bitmap.
 filesys_SRC += filesys/file.c		# Files.
 filesys_SRC += filesys/directory.c	# Directories.
+filesys_SRC += filesys/dentry.c		# Name lookup cache.
 filesys_SRC += filesys/inode.c		# File headers.
+filesys_SRC += filesys/buffer_cache.c	# Buffer cache.
+filesys_SRC += filesys/journal.c		# Metadata journal.
 filesys_SRC += filesys/fsutil.c		# Utilities.
 filesys_SRC += filesys/page_cache.c		# Page cache.
+filesys_SRC += filesys/pipe.c		# Pipes.
+filesys_SRC += filesys/tmpfs.c		# Memory-backed file systems.
+filesys_SRC += filesys/procfs.c		# Kernel statistics file system.
+filesys_SRC += filesys/defrag.c		# Online defragmentation.
@@ -0,0 +1,480 @@
+/* tmpfs.c: Memory-backed file systems for scratch files.
+ *
+ * mount() with MOUNT_TMPFS makes an empty tmpfs at a name of the root
+ * directory, the mount point, and the file NAME in it is then reached
+ * as "POINT/NAME" by create(), open() and remove().  A tmpfs file is
+ * an inode, numbered from TMPFS_INUMBER_BASE, whose data lives in
+ * pages of the user pool instead of disk sectors, so its I/O runs at
+ * memory speed and goes away at shutdown.  Under memory pressure the
+ * least recently used pages go to swap, if there is one, to be read
+ * back on the next access.
+ *
+ * Each tmpfs holds its files' inodes open while they are linked, so
+ * that their data outlives the files being closed.  Removing a file
+ * or unmounting its tmpfs drops that hold; a file still open stays
+ * usable until it is closed. */
+
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "filesys/procfs.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* A mounted tmpfs. */
+struct tmpfs {
+	char point[NAME_MAX + 1];   /* Mount point. */
+	struct list files;          /* Its files, struct tmpfs_file. */
+	struct list_elem elem;      /* Element in mounts. */
+};
+
+/* A file of a tmpfs. */
+struct tmpfs_file {
+	char name[NAME_MAX + 1];
+	struct inode *inode;        /* Held open while linked. */
+	struct list_elem elem;      /* Element in its tmpfs's files. */
+};
+
+/* A page of a tmpfs file's data. */
+struct tmpfs_page {
+	void *kva;                  /* Frame holding the page, or null. */
+	size_t slot;                /* Swap slot holding it, if not in a
+	                               frame. */
+	struct list_elem lru_elem;  /* Element in resident, while in a frame. */
+};
+
+/* The data of a tmpfs file, by page. */
+struct tmpfs_data {
+	struct tmpfs_page **pages;  /* Null for a page never written. */
+	size_t page_cnt;            /* Number of PAGES. */
+};
+
+/* Mounted tmpfs's and the inode number of the next file.  Locked
+ * before any inode's lock. */
+static struct list mounts;
+static disk_sector_t next_inumber = TMPFS_INUMBER_BASE;
+static struct lock mount_lock;
+
+/* Pages of all tmpfs files in frames, least recently used first.
+ * DATA_LOCK protects it and every struct tmpfs_data; it is locked
+ * after any inode's lock. */
+static struct list resident;
+static struct lock data_lock;
+
+static struct tmpfs *find_mount (const char *point, size_t len);
+static struct tmpfs *resolve (const char *path, const char **name);
+static struct tmpfs_file *find_file (struct tmpfs *, const char *name);
+static void unlink_file (struct tmpfs_file *);
+static struct tmpfs_page *get_page (struct tmpfs_data *, size_t idx,
+		bool create);
+static void *get_frame (void);
+static void *evict (void);
+
+/* Initializes the tmpfs module. */
+void
+tmpfs_init (void) {
+	list_init (&mounts);
+	lock_init (&mount_lock);
+	list_init (&resident);
+	lock_init (&data_lock);
+}
+
+/* Mounts an empty tmpfs at POINT, a name of the root directory, with
+ * or without a leading slash.  Fails if POINT is not a valid name,
+ * has a tmpfs or the procfs mounted already or names a file on
+ * disk. */
+bool
+tmpfs_mount (const char *point) {
+	struct tmpfs *fs;
+	struct dir *root;
+	char probe[NAME_MAX + 3];
+	struct inode *inode = NULL;
+	size_t len;
+
+	while (*point == '/')
+		point++;
+	len = strlen (point);
+	if (len == 0 || len > NAME_MAX || strchr (point, '/') != NULL)
+		return false;
+	snprintf (probe, sizeof probe, "%s/", point);
+	if (procfs_owns (probe))
+		return false;
+
+	lock_acquire (&mount_lock);
+	root = dir_open_root ();
+	if (root != NULL)
+		dir_lookup (root, point, &inode);
+	dir_close (root);
+	if (root == NULL || inode != NULL || find_mount (point, len) != NULL
+			|| (fs = malloc (sizeof *fs)) == NULL) {
+		inode_close (inode);
+		lock_release (&mount_lock);
+		return false;
+	}
+	strlcpy (fs->point, point, sizeof fs->point);
+	list_init (&fs->files);
+	list_push_back (&mounts, &fs->elem);
+	lock_release (&mount_lock);
+	return true;
+}
+
+/* Unmounts the tmpfs at POINT, removing its files.  Returns false if
+ * no tmpfs is mounted there. */
+bool
+tmpfs_umount (const char *point) {
+	struct tmpfs *fs;
+
+	while (*point == '/')
+		point++;
+	lock_acquire (&mount_lock);
+	fs = find_mount (point, strlen (point));
+	if (fs != NULL) {
+		list_remove (&fs->elem);
+		while (!list_empty (&fs->files))
+			unlink_file (list_entry (list_front (&fs->files),
+						struct tmpfs_file, elem));
+		free (fs);
+	}
+	lock_release (&mount_lock);
+	return fs != NULL;
+}
+
+/* Returns true if PATH is in a mounted tmpfs, that is, of the form
+ * "POINT/..." for its mount point POINT. */
+bool
+tmpfs_owns (const char *path) {
+	const char *name;
+	bool owned;
+
+	lock_acquire (&mount_lock);
+	owned = resolve (path, &name) != NULL;
+	lock_release (&mount_lock);
+	return owned;
+}
+
+/* Creates the tmpfs file PATH, INITIAL_SIZE bytes of zeros.  Returns
+ * true if successful, false if PATH is not a valid name in a mounted
+ * tmpfs, exists already, or memory runs out. */
+bool
+tmpfs_create (const char *path, off_t initial_size) {
+	struct tmpfs_file *file;
+	const char *name;
+	struct tmpfs *fs;
+	bool success = false;
+
+	lock_acquire (&mount_lock);
+	fs = resolve (path, &name);
+	if (fs != NULL && *name != '\0' && strlen (name) <= NAME_MAX
+			&& strchr (name, '/') == NULL && find_file (fs, name) == NULL
+			&& (file = malloc (sizeof *file)) != NULL) {
+		file->inode = inode_create_tmpfs (next_inumber, initial_size);
+		if (file->inode != NULL) {
+			next_inumber++;
+			strlcpy (file->name, name, sizeof file->name);
+			list_push_back (&fs->files, &file->elem);
+			success = true;
+		} else
+			free (file);
+	}
+	lock_release (&mount_lock);
+	return success;
+}
+
+/* Opens the tmpfs file PATH and returns its inode, or a null pointer
+ * if there is no such file. */
+struct inode *
+tmpfs_open (const char *path) {
+	struct inode *inode = NULL;
+	struct tmpfs_file *file;
+	const char *name;
+	struct tmpfs *fs;
+
+	lock_acquire (&mount_lock);
+	fs = resolve (path, &name);
+	if (fs != NULL && (file = find_file (fs, name)) != NULL)
+		inode = inode_reopen (file->inode);
+	lock_release (&mount_lock);
+	return inode;
+}
+
+/* Removes the tmpfs file PATH.  Returns false if there is no such
+ * file. */
+bool
+tmpfs_remove (const char *path) {
+	struct tmpfs_file *file = NULL;
+	const char *name;
+	struct tmpfs *fs;
+
+	lock_acquire (&mount_lock);
+	fs = resolve (path, &name);
+	if (fs != NULL && (file = find_file (fs, name)) != NULL)
+		unlink_file (file);
+	lock_release (&mount_lock);
+	return file != NULL;
+}
+
+/* Returns the tmpfs mounted at the LEN bytes of POINT, or a null
+ * pointer if there is none.  The caller holds mount_lock. */
+static struct tmpfs *
+find_mount (const char *point, size_t len) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&mount_lock));
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e)) {
+		struct tmpfs *fs = list_entry (e, struct tmpfs, elem);
+
+		if (strlen (fs->point) == len && !memcmp (fs->point, point, len))
+			return fs;
+	}
+	return NULL;
+}
+
+/* Returns the tmpfs PATH is in, storing in *NAME the rest of PATH
+ * past its mount point and slash, or a null pointer if PATH is not
+ * in one.  The caller holds mount_lock. */
+static struct tmpfs *
+resolve (const char *path, const char **name) {
+	const char *slash;
+	struct tmpfs *fs;
+
+	while (*path == '/')
+		path++;
+	slash = strchr (path, '/');
+	if (slash == NULL)
+		return NULL;
+	fs = find_mount (path, slash - path);
+	*name = slash + 1;
+	return fs;
+}
+
+/* Returns FS's file NAME, or a null pointer if there is none. */
+static struct tmpfs_file *
+find_file (struct tmpfs *fs, const char *name) {
+	struct list_elem *e;
+
+	for (e = list_begin (&fs->files); e != list_end (&fs->files);
+			e = list_next (e)) {
+		struct tmpfs_file *file = list_entry (e, struct tmpfs_file, elem);
+
+		if (!strcmp (file->name, name))
+			return file;
+	}
+	return NULL;
+}
+
+/* Removes FILE from its tmpfs and drops the tmpfs's hold on its
+ * inode, freeing the data unless the file is open.  The caller
+ * holds mount_lock. */
+static void
+unlink_file (struct tmpfs_file *file) {
+	list_remove (&file->elem);
+	inode_remove (file->inode);
+	inode_close (file->inode);
+	free (file);
+}
+
+/* Returns new, empty data for a tmpfs file, or a null pointer if
+ * memory runs out. */
+struct tmpfs_data *
+tmpfs_data_create (void) {
+	return calloc (1, sizeof (struct tmpfs_data));
+}
+
+/* Frees DATA and its pages. */
+void
+tmpfs_data_destroy (struct tmpfs_data *data) {
+	size_t i;
+
+	lock_acquire (&data_lock);
+	for (i = 0; i < data->page_cnt; i++) {
+		struct tmpfs_page *page = data->pages[i];
+
+		if (page == NULL)
+			continue;
+		if (page->kva != NULL) {
+			list_remove (&page->lru_elem);
+			palloc_free_page (page->kva);
+		}
+#ifdef VM
+		else
+			anon_slot_free (page->slot);
+#endif
+		free (page);
+	}
+	lock_release (&data_lock);
+	free (data->pages);
+	free (data);
+}
+
+/* Reads the SIZE bytes of DATA at OFFSET into BUFFER, zeros for pages
+ * never written, and returns the number of bytes read, which is less
+ * than SIZE only if memory runs out.  The caller keeps SIZE within
+ * the file. */
+off_t
+tmpfs_data_read (struct tmpfs_data *data, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+
+	lock_acquire (&data_lock);
+	while (bytes_read < size) {
+		size_t idx = (offset + bytes_read) / PGSIZE;
+		size_t page_ofs = (offset + bytes_read) % PGSIZE;
+		size_t chunk = PGSIZE - page_ofs;
+		struct tmpfs_page *page;
+
+		if (chunk > (size_t) (size - bytes_read))
+			chunk = size - bytes_read;
+		if (idx < data->page_cnt && data->pages[idx] != NULL) {
+			page = get_page (data, idx, false);
+			if (page == NULL)
+				break;
+			memcpy (buffer + bytes_read, (uint8_t *) page->kva + page_ofs, chunk);
+		} else
+			memset (buffer + bytes_read, 0, chunk);
+		bytes_read += chunk;
+	}
+	lock_release (&data_lock);
+	return bytes_read;
+}
+
+/* Writes the SIZE bytes of BUFFER into DATA at OFFSET and returns the
+ * number of bytes written, which is less than SIZE only if memory
+ * and swap run out. */
+off_t
+tmpfs_data_write (struct tmpfs_data *data, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+
+	lock_acquire (&data_lock);
+	while (bytes_written < size) {
+		size_t idx = (offset + bytes_written) / PGSIZE;
+		size_t page_ofs = (offset + bytes_written) % PGSIZE;
+		size_t chunk = PGSIZE - page_ofs;
+		struct tmpfs_page *page = get_page (data, idx, true);
+
+		if (page == NULL)
+			break;
+		if (chunk > (size_t) (size - bytes_written))
+			chunk = size - bytes_written;
+		memcpy ((uint8_t *) page->kva + page_ofs, buffer + bytes_written, chunk);
+		bytes_written += chunk;
+	}
+	lock_release (&data_lock);
+	return bytes_written;
+}
+
+/* Gives one page of tmpfs data, the least recently used in a frame,
+ * to swap and frees its frame, for the frame table to take when it
+ * has nothing to evict.  Returns false if there is no such page, swap
+ * is full, or the tmpfs data is busy. */
+bool
+tmpfs_reclaim (void) {
+	void *kva;
+
+	if (lock_held_by_current_thread (&data_lock)
+			|| !lock_try_acquire (&data_lock))
+		return false;
+	kva = evict ();
+	lock_release (&data_lock);
+	if (kva != NULL)
+		palloc_free_page (kva);
+	return kva != NULL;
+}
+
+/* Returns page IDX of DATA in a frame, marked most recently used,
+ * reading it back from swap if it was evicted and making it, zeroed,
+ * if it was never written and CREATE is true.  Returns a null
+ * pointer if memory runs out.  The caller holds data_lock. */
+static struct tmpfs_page *
+get_page (struct tmpfs_data *data, size_t idx, bool create) {
+	struct tmpfs_page *page;
+
+	ASSERT (lock_held_by_current_thread (&data_lock));
+	if (idx >= data->page_cnt) {
+		size_t cnt = data->page_cnt * 2 > idx + 1 ? data->page_cnt * 2 : idx + 1;
+		struct tmpfs_page **pages;
+
+		ASSERT (create);
+		pages = realloc (data->pages, cnt * sizeof *pages);
+		if (pages == NULL)
+			return NULL;
+		memset (pages + data->page_cnt, 0,
+				(cnt - data->page_cnt) * sizeof *pages);
+		data->pages = pages;
+		data->page_cnt = cnt;
+	}
+
+	page = data->pages[idx];
+	if (page == NULL) {
+		ASSERT (create);
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			return NULL;
+		page->kva = get_frame ();
+		if (page->kva == NULL) {
+			free (page);
+			return NULL;
+		}
+		memset (page->kva, 0, PGSIZE);
+		data->pages[idx] = page;
+	} else if (page->kva != NULL)
+		list_remove (&page->lru_elem);
+	else {
+		page->kva = get_frame ();
+		if (page->kva == NULL)
+			return NULL;
+#ifdef VM
+		anon_slot_read (page->slot, page->kva);
+		anon_slot_free (page->slot);
+#endif
+	}
+	list_push_back (&resident, &page->lru_elem);
+	return page;
+}
+
+/* Returns a frame for tmpfs data, evicting the least recently used
+ * page of it if the user pool is empty, or a null pointer if that
+ * fails too.  The caller holds data_lock. */
+static void *
+get_frame (void) {
+	void *kva = palloc_get_page (PAL_USER);
+
+	return kva != NULL ? kva : evict ();
+}
+
+/* Writes the least recently used page of tmpfs data in a frame to
+ * swap and returns its frame, or a null pointer if there is no such
+ * page or no room in swap.  The caller holds data_lock. */
+static void *
+evict (void) {
+#ifdef VM
+	struct tmpfs_page *page;
+	void *kva;
+
+	ASSERT (lock_held_by_current_thread (&data_lock));
+	if (list_empty (&resident))
+		return NULL;
+	page = list_entry (list_front (&resident), struct tmpfs_page, lru_elem);
+	page->slot = anon_slot_alloc ();
+	if (page->slot == INVALID_SLOT_IDX)
+		return NULL;
+	anon_slot_write (page->slot, page->kva);
+	list_remove (&page->lru_elem);
+	kva = page->kva;
+	page->kva = NULL;
+	return kva;
+#else
+	return NULL;
+#endif
+}
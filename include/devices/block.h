@@ -0,0 +1,156 @@
+#ifndef DEVICES_BLOCK_H
+#define DEVICES_BLOCK_H
+
+#include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+struct rgroup;
+
+/* Size of a disk sector in bytes. */
+#define DISK_SECTOR_SIZE 512
+
+/* Index of a disk sector within a block device.
+ * Good enough for disks up to 2 TB. */
+typedef uint32_t disk_sector_t;
+
+/* Format specifier for printf(), e.g.:
+ * printf ("sector=%"PRDSNu"\n", sector); */
+#define PRDSNu PRIu32
+
+/* Most sectors a single request can move.  Drivers take requests
+ * of up to this many sectors whole, in one command if they can. */
+#define DISK_REQUEST_MAX_SECTORS 256
+
+/* Statistics of a block device, indices in what block_read_stats()
+ * reports; the same as in lib/user/syscall.h.  A request is counted
+ * once, however many sectors it moves.  DISK_STAT_LAT_HIST_CNT
+ * buckets from DISK_STAT_LAT_HIST count requests by the TSC cycles
+ * from submission to completion: the first under 2**12, each next
+ * one up to twice as many, the last all slower ones.
+ * DISK_STAT_DEPTH_HIST_CNT buckets from DISK_STAT_DEPTH_HIST count
+ * requests by the number the device had queued or in flight once
+ * they were submitted, counting themselves: bucket I from 2**I up to
+ * 2**(I+1) requests, the last all deeper queues. */
+#define DISK_STAT_READS 0           /* Read requests. */
+#define DISK_STAT_WRITES 1          /* Write requests. */
+#define DISK_STAT_READ_BYTES 2      /* Bytes read. */
+#define DISK_STAT_WRITE_BYTES 3     /* Bytes written. */
+#define DISK_STAT_SEQUENTIAL 4      /* Requests starting where the device's
+                                       previous one ended. */
+#define DISK_STAT_RANDOM 5          /* Other requests. */
+#define DISK_STAT_CYCLES 6          /* Latency of all requests, summed. */
+#define DISK_STAT_MAX_CYCLES 7      /* Latency of the slowest request. */
+#define DISK_STAT_CACHE_HITS 8      /* Buffer cache hits, in sectors. */
+#define DISK_STAT_CACHE_MISSES 9    /* Buffer cache misses, in sectors. */
+#define DISK_STAT_LAT_HIST 10
+#define DISK_STAT_LAT_HIST_CNT 16
+#define DISK_STAT_DEPTH_HIST (DISK_STAT_LAT_HIST + DISK_STAT_LAT_HIST_CNT)
+#define DISK_STAT_DEPTH_HIST_CNT 8
+#define DISK_STAT_CNT (DISK_STAT_DEPTH_HIST + DISK_STAT_DEPTH_HIST_CNT)
+
+/* What the kernel uses a block device for. */
+enum block_role {
+	BLOCK_FILESYS,              /* File system. */
+	BLOCK_SCRATCH,              /* Files put into and got from the
+	                               file system by `pintos -p/-g'. */
+	BLOCK_SWAP,                 /* Swap. */
+	BLOCK_ROLE_CNT
+};
+
+/* Flags for block_register(). */
+#define BLOCK_BOOT 0x01         /* Holds the loader and kernel: has no
+                                   partition table and no role. */
+#define BLOCK_FALLBACK 0x02     /* May take a role whose default device
+                                   is missing. */
+
+struct block_request;
+
+/* What a driver does for its block devices.  SUBMIT starts REQ,
+ * already counted and checked against the device, with interrupts
+ * off and without sleeping.  REQ's sector is the whole disk's, even
+ * for a partition.  Once the transfer is done the driver calls
+ * block_request_complete(), with interrupts off. */
+struct block_operations {
+	void (*submit) (struct block_request *req);
+};
+
+/* A block device: a disk of some driver, or a partition of one.
+ * A partition shares its disk's operations and AUX. */
+struct block_device {
+	char name[16];              /* Name, e.g. "hd0:1" or "hd1:0p1". */
+	disk_sector_t size;         /* Size in sectors. */
+	const struct block_operations *ops;
+	void *aux;                  /* Driver's own device. */
+	unsigned flags;             /* BLOCK_* flags. */
+	struct block_device *parent;    /* Disk of a partition, or null. */
+	disk_sector_t start;        /* First sector within PARENT. */
+	int idx;                    /* Number, in registration order. */
+	struct list_elem elem;      /* Element in the list of devices. */
+
+	/* Statistics, protected by disabling interrupts. */
+	size_t depth;               /* Requests queued or in flight. */
+	disk_sector_t next_sec;     /* Sector past the last request's. */
+	uint64_t stats[DISK_STAT_CNT];  /* DISK_STAT_*. */
+};
+
+/* An asynchronous transfer of a run of contiguous sectors.
+ * Fill it in with block_request_init(), hand it to block_submit(),
+ * and keep it and its buffer alive until it completes.  The buffer
+ * must be kernel memory, since drivers copy into it from interrupt
+ * handlers or hand its physical address to the device.  Completion
+ * ups DONE and then calls CALLBACK, if any, from the driver's
+ * interrupt handler. */
+struct block_request {
+	struct list_elem elem;      /* For the driver's queue. */
+	struct block_device *dev;   /* Device to transfer to or from. */
+	disk_sector_t sec_no;       /* First sector to transfer. */
+	size_t sec_cnt;             /* Number of sectors to transfer. */
+	size_t sec_done;            /* Sectors transferred so far. */
+	void *buffer;               /* SEC_CNT * DISK_SECTOR_SIZE bytes. */
+	bool write;                 /* True to write BUFFER to the disk. */
+	struct semaphore done;      /* Up'd on completion. */
+	void (*callback) (struct block_request *);  /* Optional. */
+	void *aux;                  /* For CALLBACK's use. */
+	uint64_t submit_tsc;        /* When submitted, for the statistics. */
+	int priority;               /* Submitter's effective priority, or
+	                               the highest of a thread waiting. */
+	int64_t deadline;           /* Timer tick by which to start it. */
+	struct rgroup *rgroup;      /* Submitter's resource group. */
+};
+
+void block_init (void);
+struct block_device *block_register (const char *name, disk_sector_t size,
+		const struct block_operations *, void *aux, unsigned flags);
+struct block_device *block_register_partition (struct block_device *disk,
+		int part_no, disk_sector_t start, disk_sector_t size);
+void block_set_role_name (enum block_role, const char *name);
+void block_assign_roles (void);
+
+struct block_device *block_get_role (enum block_role);
+struct block_device *block_get_by_name (const char *name);
+disk_sector_t block_size (struct block_device *);
+const char *block_name (struct block_device *);
+
+void block_read (struct block_device *, disk_sector_t, void *);
+void block_write (struct block_device *, disk_sector_t, const void *);
+void block_read_multiple (struct block_device *, disk_sector_t, size_t cnt,
+		void *);
+void block_write_multiple (struct block_device *, disk_sector_t, size_t cnt,
+		const void *);
+
+void block_request_init (struct block_request *, struct block_device *,
+		disk_sector_t, size_t cnt, void *buffer, bool write);
+void block_submit (struct block_request *);
+void block_wait (struct block_request *);
+void block_request_complete (struct block_request *);
+
+void block_count_cache (struct block_device *, size_t hit_cnt,
+		size_t miss_cnt);
+bool block_read_stats (const char *name, uint64_t stats[DISK_STAT_CNT]);
+void block_print_stats (void);
+
+#endif /* devices/block.h */
@@ -2,11 +2,19 @@
 #define DEVICES_INPUT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+struct poller;
+struct waitq_entry;
+
 void input_init (void);
 void input_putc (uint8_t);
+void input_putbuf (const uint8_t *, size_t);
 uint8_t input_getc (void);
+size_t input_getline (uint8_t *, size_t);
 bool input_full (void);
+size_t input_room (void);
+bool input_poll (struct poller *, struct waitq_entry *);
 
 #endif /* devices/input.h */
@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -17,8 +18,9 @@
    protect kernel threads from one another, not from interrupt
    handlers. */
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
+/* Queue buffer size, in bytes: a page, so that a burst of console
+   output or input fits without a thread waiting. */
+#define INTQ_BUFSIZE 4096
 
 /* A circular queue of bytes. */
 struct intq {
@@ -36,7 +38,10 @@ struct intq {
 void intq_init (struct intq *);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
+size_t intq_room (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+size_t intq_get_bulk (struct intq *, void *, size_t);
+size_t intq_put_bulk (struct intq *, const void *, size_t);
 
 #endif /* devices/intq.h */
@@ -0,0 +1,32 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Configuration space registers, common to all functions. */
+#define PCI_REG_ID 0x00         /* Vendor ID, then device ID. */
+#define PCI_REG_COMMAND 0x04    /* Command, then status. */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_BAR0 0x10       /* First of six base address registers. */
+#define PCI_REG_BAR4 0x20
+#define PCI_REG_IRQ 0x3c        /* Interrupt line, then pin. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x01         /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x04     /* Act as a bus master. */
+
+/* A function of a device on PCI bus 0, the only bus we look at. */
+struct pci_func {
+	int dev;                    /* Device, 0...31. */
+	int func;                   /* Function, 0...7. */
+};
+
+/* Position before the first function, to start pci_next() at. */
+#define PCI_START ((struct pci_func) { 0, -1 })
+
+bool pci_next (struct pci_func *);
+uint32_t pci_read_config (const struct pci_func *, int reg);
+void pci_write_config (const struct pci_func *, int reg, uint32_t);
+
+#endif /* devices/pci.h */
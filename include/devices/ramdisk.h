@@ -0,0 +1,11 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include <stddef.h>
+
+/* Size of the RAM disk in MB, from the -ramdisk option; 0 for none. */
+extern size_t ramdisk_mb;
+
+void ramdisk_init (void);
+
+#endif /* devices/ramdisk.h */
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -12,12 +14,46 @@ void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_ns (void);
+int64_t timer_tsc_to_ns (uint64_t cycles);
 
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_udelay (int64_t microseconds);
+void timer_ndelay (int64_t nanoseconds);
+
 void timer_print_stats (void);
 
+extern bool timer_tickless;
+extern bool timer_apic;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* How late a sleeping thread may be woken by default, in
+   nanoseconds, so that nearby wakeups can share a tick.  Less than a
+   tick leaves wakeups exact. */
+#define TIMER_SLACK_DEFAULT_NS 50000
+
+/* Kernel timer: calls FUNC (AUX) from the timer interrupt's deferred
+   work once timer_ticks() reaches DEADLINE.  FUNC runs with
+   interrupts off, in interrupt context, and must not sleep. */
+typedef void timer_func (void *aux);
+
+struct timer_event {
+	int64_t deadline;           /* Tick to fire at. */
+	timer_func *func;
+	void *aux;
+	bool pending;               /* Added and not yet fired or canceled. */
+	struct list_elem elem;      /* Element in a timer wheel slot. */
+};
+
+void timer_event_init (struct timer_event *, timer_func *, void *aux);
+void timer_event_add (struct timer_event *, int64_t deadline);
+void timer_event_add_slack (struct timer_event *, int64_t deadline,
+		int64_t slack);
+bool timer_event_cancel (struct timer_event *);
+
 #endif /* devices/timer.h */
@@ -0,0 +1,26 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sector-sized slots in the buffer cache. */
+#define BUFFER_CACHE_SIZE 64
+
+void buffer_cache_init (void);
+void buffer_cache_done (void);
+
+void buffer_cache_read (disk_sector_t, void *, int sector_ofs, int size);
+void buffer_cache_read_multiple (disk_sector_t, size_t cnt, void *);
+void buffer_cache_read_direct (disk_sector_t, size_t cnt, void *);
+void buffer_cache_write_direct (disk_sector_t, size_t cnt, const void *);
+void buffer_cache_write (disk_sector_t, const void *, int sector_ofs, int size);
+void buffer_cache_write_held (disk_sector_t, const void *, int sector_ofs,
+		int size);
+void buffer_cache_release_held (disk_sector_t);
+void buffer_cache_prefetch (disk_sector_t, size_t cnt);
+void buffer_cache_flush (void);
+size_t buffer_cache_dirty_cnt (void);
+
+#endif /* filesys/buffer_cache.h */
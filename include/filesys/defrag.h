@@ -0,0 +1,12 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+#include <stdbool.h>
+
+extern bool filesys_defrag;
+
+void defrag_init (void);
+void defrag_done (void);
+void defrag_print_stats (void);
+
+#endif /* filesys/defrag.h */
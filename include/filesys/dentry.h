@@ -0,0 +1,29 @@
+#ifndef FILESYS_DENTRY_H
+#define FILESYS_DENTRY_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/filesys.h"
+
+/* Number of names the dentry cache remembers. */
+#define DENTRY_CNT 512
+
+/* What the dentry cache knows about a name in a directory. */
+enum dentry_result {
+	DENTRY_UNKNOWN,             /* Not cached; look in the directory. */
+	DENTRY_FOUND,               /* The name is in the directory. */
+	DENTRY_ABSENT,              /* The name is not in the directory. */
+};
+
+void dentry_init (void);
+enum dentry_result dentry_lookup (disk_sector_t dir, const char *name,
+		disk_sector_t *sector);
+void dentry_insert (disk_sector_t dir, const char *name, disk_sector_t sector);
+void dentry_insert_absent (disk_sector_t dir, const char *name);
+bool dentry_lookup_link (disk_sector_t dir, const char *name,
+		char target[SYMLINK_MAX + 1]);
+void dentry_mark_link (disk_sector_t dir, const char *name,
+		disk_sector_t sector, const char *target);
+void dentry_invalidate_dir (disk_sector_t dir);
+
+#endif /* filesys/dentry.h */
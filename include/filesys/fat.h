@@ -1,7 +1,7 @@
 #ifndef FILESYS_FAT_H
 #define FILESYS_FAT_H
 
-#include "devices/disk.h"
+#include "devices/block.h"
 #include "filesys/file.h"
 #include <inttypes.h>
 #include <stdbool.h>
@@ -23,6 +23,7 @@ void fat_open (void);
 void fat_close (void);
 void fat_create (void);
 void fat_close (void);
+void fat_flush (void);
 
 cluster_t fat_create_chain (
     cluster_t clst /* Cluster # to stretch, 0: Create a new chain */
@@ -32,7 +33,32 @@ void fat_remove_chain (
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
 );
 cluster_t fat_get (cluster_t clst);
+
+/* Clusters set aside for a growing chain, kept by its writer, like
+ * an open file, for fat_create_chain_window().  Zero-initialize
+ * before use.  Set-aside clusters are free in the FAT itself, so a
+ * crash never leaks them. */
+struct fat_window {
+	cluster_t next;              /* First set-aside cluster. */
+	size_t cnt;                  /* Number set aside. */
+};
+
+/* Most clusters a window sets aside at once. */
+#define FAT_WINDOW_SIZE 16
+
+cluster_t fat_create_chain_window (cluster_t clst, struct fat_window *);
+void fat_window_release (struct fat_window *);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
 
+/* Position in a cluster chain, kept by a walker of the chain, like
+ * an open file, for fat_cursor_seek().  Zero-initialize before use. */
+struct fat_cursor {
+	cluster_t start;             /* First cluster of the chain. */
+	cluster_t clst;              /* Cluster IDX clusters in, or 0. */
+	size_t idx;
+};
+
+cluster_t fat_cursor_seek (struct fat_cursor *, cluster_t start, size_t n);
+
 #endif /* filesys/fat.h */
@@ -1,14 +1,28 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct pipe;
+struct poller;
+struct waitq_entry;
+
+void file_init (void);
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
+struct file *file_open_pipe (struct pipe *, bool writer);
 struct file *file_reopen (struct file *);
 struct file *file_duplicate (struct file *file);
+struct file *file_dup (struct file *);
+bool file_is_shared (struct file *);
+unsigned file_ref_cnt (struct file *);
+void file_set_direct (struct file *, bool direct);
+bool file_is_direct (struct file *);
+bool file_is_pipe (struct file *);
+int file_poll (struct file *, struct poller *, struct waitq_entry *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
 
@@ -7,14 +7,21 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* First sector of the metadata log. */
 
-/* Disk used for file system. */
-extern struct disk *filesys_disk;
+/* Longest path a symbolic link may point to, and most links one
+ * lookup follows before it gives up on a loop. */
+#define SYMLINK_MAX 64
+#define SYMLOOP_MAX 8
+
+/* Block device used for file system. */
+extern struct block_device *filesys_disk;
 
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_symlink (const char *target, const char *linkpath);
 
 #endif /* filesys/filesys.h */
@@ -3,7 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-#include "devices/disk.h"
+#include "devices/block.h"
 
 void free_map_init (void);
 void free_map_read (void);
@@ -12,6 +12,9 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate_near (disk_sector_t goal, size_t, disk_sector_t *);
+disk_sector_t free_map_emptiest_group (void);
+size_t free_map_allocate_at (disk_sector_t, size_t);
 void free_map_release (disk_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
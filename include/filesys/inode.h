@@ -2,22 +2,43 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
-#include "devices/disk.h"
+#include "devices/block.h"
 
 struct bitmap;
 
 void inode_init (void);
 bool inode_create (disk_sector_t, off_t);
+bool inode_create_symlink (disk_sector_t, const char *target);
 struct inode *inode_open (disk_sector_t);
+bool inode_is_symlink (const struct inode *);
+bool inode_stat (disk_sector_t, off_t *length, bool *symlink);
+const char *inode_readlink (struct inode *);
+struct inode *inode_create_tmpfs (disk_sector_t inumber, off_t length);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+		off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_set_journaled (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_flush (struct inode *);
+void inode_flush_combined (struct inode *);
+void inode_flush_all (void);
+void inode_sync (struct inode *);
+void inode_commit (void);
+void inode_readahead (struct inode *, off_t offset, off_t size);
+size_t inode_defrag (struct inode *, size_t max_sectors);
+void inode_acquire_read (struct inode *);
+void inode_release_read (struct inode *);
+void inode_acquire_write (struct inode *);
+void inode_release_write (struct inode *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Sectors of the log, starting at JOURNAL_SECTOR. */
+#define JOURNAL_SECTORS 64
+
+/* Most metadata sectors one transaction changes.  Sectors of the
+ * running transaction are pinned in the buffer cache, so this must
+ * leave most of the cache for everything else. */
+#define JOURNAL_TX_MAX 30
+
+void journal_init (void);
+void journal_create (void);
+bool journal_open (void);
+void journal_done (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_write (disk_sector_t, const void *, int sector_ofs, int size);
+void journal_revoke (disk_sector_t, size_t cnt);
+void journal_commit (void);
+
+#endif /* filesys/journal.h */
@@ -1,12 +1,18 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
+#include <stddef.h>
+#include "devices/block.h"
 #include "vm/vm.h"
 
 struct page;
 enum vm_type;
 
-struct page_cache {};
+struct page_cache {
+	disk_sector_t sector;       /* First of the page's disk sectors. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+void page_cache_kick (void);
+void page_cache_request_readahead (disk_sector_t sector, size_t cnt);
 #endif
@@ -0,0 +1,22 @@
+#ifndef FILESYS_PIPE_H
+#define FILESYS_PIPE_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+/* Bytes a pipe holds that have been written but not yet read. */
+#define PIPE_SIZE 4096
+
+struct pipe;
+struct poller;
+struct waitq_entry;
+
+struct pipe *pipe_create (void);
+void pipe_open (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+off_t pipe_read (struct pipe *, void *, off_t size);
+off_t pipe_write (struct pipe *, const void *, off_t size);
+int pipe_poll (struct pipe *, bool writer, struct poller *,
+		struct waitq_entry *);
+
+#endif /* filesys/pipe.h */
@@ -0,0 +1,23 @@
+#ifndef FILESYS_PROCFS_H
+#define FILESYS_PROCFS_H
+
+#include <stdbool.h>
+
+/* CHAN_NO of mount() that mounts the procfs; the same as in
+ * lib/user/syscall.h. */
+#define MOUNT_PROCFS -2
+
+/* Inode numbers of procfs files start here, past any sector of the
+ * file system disk and any tmpfs file. */
+#define PROCFS_INUMBER_BASE 0xe0000000
+
+struct inode;
+
+void procfs_init (void);
+bool procfs_mount (const char *point);
+bool procfs_umount (const char *point);
+
+bool procfs_owns (const char *path);
+struct inode *procfs_open (const char *path);
+
+#endif /* filesys/procfs.h */
@@ -0,0 +1,36 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+/* CHAN_NO of mount() that mounts a tmpfs rather than a disk; the
+ * same as in lib/user/syscall.h. */
+#define MOUNT_TMPFS -1
+
+/* Inode numbers of tmpfs files start here, past any sector of the
+ * file system disk, so that caches keyed by inode number keep the
+ * two apart. */
+#define TMPFS_INUMBER_BASE 0xc0000000
+
+struct inode;
+struct tmpfs_data;
+
+void tmpfs_init (void);
+bool tmpfs_mount (const char *point);
+bool tmpfs_umount (const char *point);
+
+bool tmpfs_owns (const char *path);
+bool tmpfs_create (const char *path, off_t initial_size);
+struct inode *tmpfs_open (const char *path);
+bool tmpfs_remove (const char *path);
+
+struct tmpfs_data *tmpfs_data_create (void);
+void tmpfs_data_destroy (struct tmpfs_data *);
+off_t tmpfs_data_read (struct tmpfs_data *, void *, off_t size,
+		off_t offset);
+off_t tmpfs_data_write (struct tmpfs_data *, const void *, off_t size,
+		off_t offset);
+bool tmpfs_reclaim (void);
+
+#endif /* filesys/tmpfs.h */
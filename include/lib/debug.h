@@ -1,6 +1,8 @@
 #ifndef __LIB_DEBUG_H
 #define __LIB_DEBUG_H
 
+#include <stdbool.h>
+
 /* GCC lets us add "attributes" to functions, function
  * parameters, etc. to indicate their properties.
  * See the GCC manual for details. */
@@ -17,6 +19,21 @@ void debug_panic (const char *file, int line, const char *function,
 		const char *message, ...) PRINTF_FORMAT (4, 5) NO_RETURN;
 void debug_backtrace (void);
 
+/* Classes of kernel consistency checks too costly to make on every
+   call of a hot primitive.  DEBUG_ASSERT() makes those of a class
+   only while its bit is set in debug_checks, by the -check kernel
+   option; otherwise it costs a load and a branch that is always
+   taken the same way. */
+#define DEBUG_LIST 0x01         /* lib/kernel/list.c. */
+#define DEBUG_HASH 0x02         /* lib/kernel/hash.c. */
+#define DEBUG_SYNCH 0x04        /* threads/synch.c. */
+#define DEBUG_MALLOC 0x08       /* Arenas in threads/malloc.c. */
+#define DEBUG_THREAD 0x10       /* thread_current(). */
+#define DEBUG_ALL 0x1f
+
+extern unsigned debug_checks;
+bool debug_checks_parse (const char *);
+
 #endif
 
 
@@ -24,6 +41,7 @@ void debug_backtrace (void);
 /* This is outside the header guard so that debug.h may be
  * included multiple times with different settings of NDEBUG. */
 #undef ASSERT
+#undef DEBUG_ASSERT
 #undef NOT_REACHED
 
 #ifndef NDEBUG
@@ -31,8 +49,14 @@ void debug_backtrace (void);
 	if ((CONDITION)) { } else {                             \
 		PANIC ("assertion `%s' failed.", #CONDITION);   \
 	}
+#define DEBUG_ASSERT(CLASS, CONDITION)                          \
+	if (__builtin_expect (!(debug_checks & (CLASS)), 1)     \
+			|| (CONDITION)) { } else {              \
+		PANIC ("assertion `%s' failed.", #CONDITION);   \
+	}
 #define NOT_REACHED() PANIC ("executed an unreachable statement");
 #else
 #define ASSERT(CONDITION) ((void) 0)
+#define DEBUG_ASSERT(CLASS, CONDITION) ((void) 0)
 #define NOT_REACHED() for (;;)
 #endif /* lib/debug.h */
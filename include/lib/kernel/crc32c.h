@@ -0,0 +1,15 @@
+#ifndef __LIB_KERNEL_CRC32C_H
+#define __LIB_KERNEL_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC-32C (Castagnoli), as used by iSCSI and ext4, for catching
+   corruption of data read back from disk.
+
+   crc32c (0, buf, size) is the CRC of BUF; passing it back in as
+   CRC for the next buffer extends it, so that a CRC over several
+   pieces equals the one over their concatenation. */
+uint32_t crc32c (uint32_t crc, const void *, size_t);
+
+#endif /* lib/kernel/crc32c.h */
@@ -6,28 +6,38 @@
  * This data structure is thoroughly documented in the Tour of
  * Pintos for Project 3.
  *
- * This is a standard hash table with chaining.  To locate an
- * element in the table, we compute a hash function over the
- * element's data and use that as an index into an array of
- * doubly linked lists, then linearly search the list.
+ * This is an open-addressing hash table with Robin Hood linear
+ * probing.  The table is an array of slots, each holding an
+ * element's hash value next to a pointer to the element.  To
+ * locate an element we compute a hash function over its data, use
+ * that as an index into the array, and scan forward.  Slots whose
+ * hash value differs are skipped without touching their elements,
+ * and Robin Hood insertion keeps every element close to its home
+ * slot, so a lookup usually reads one or two cache lines of slots
+ * plus the element found.
  *
- * The chain lists do not use dynamic allocation.  Instead, each
- * structure that can potentially be in a hash must embed a
- * struct hash_elem member.  All of the hash functions operate on
- * these `struct hash_elem's.  The hash_entry macro allows
- * conversion from a struct hash_elem back to a structure object
- * that contains it.  This is the same technique used in the
- * linked list implementation.  Refer to lib/kernel/list.h for a
- * detailed explanation. */
+ * A large table is resized incrementally: the new array of slots
+ * is installed next to the old one, and each later insertion or
+ * deletion moves a few of the old slots' elements over, so that no
+ * single operation pays for moving the whole table.
+ *
+ * The elements themselves are not allocated by the table.
+ * Instead, each structure that can potentially be in a hash must
+ * embed a struct hash_elem member.  All of the hash functions
+ * operate on these `struct hash_elem's.  The hash_entry macro
+ * allows conversion from a struct hash_elem back to a structure
+ * object that contains it.  This is the same technique used in
+ * the linked list implementation.  Refer to lib/kernel/list.h for
+ * a detailed explanation. */
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
-#include "list.h"
 
-/* Hash element. */
+/* Hash element.  Its address is all the table stores; the member
+ * only marks where the element is embedded. */
 struct hash_elem {
-	struct list_elem list_elem;
+	uint8_t unused;
 };
 
 /* Converts pointer to hash element HASH_ELEM into a pointer to
@@ -36,8 +46,8 @@ struct hash_elem {
  * of the hash element.  See the big comment at the top of the
  * file for an example. */
 #define hash_entry(HASH_ELEM, STRUCT, MEMBER)                   \
-	((STRUCT *) ((uint8_t *) &(HASH_ELEM)->list_elem        \
-		- offsetof (STRUCT, MEMBER.list_elem)))
+	((STRUCT *) ((uint8_t *) (HASH_ELEM)                    \
+		- offsetof (STRUCT, MEMBER)))
 
 /* Computes and returns the hash value for hash element E, given
  * auxiliary data AUX. */
@@ -54,11 +64,25 @@ typedef bool hash_less_func (const struct hash_elem *a,
  * data AUX. */
 typedef void hash_action_func (struct hash_elem *e, void *aux);
 
+/* A slot of a hash table: empty if ELEM is null. */
+struct hash_slot {
+	uint64_t hash;              /* Hash value of ELEM. */
+	struct hash_elem *elem;
+};
+
 /* Hash table. */
 struct hash {
 	size_t elem_cnt;            /* Number of elements in table. */
-	size_t bucket_cnt;          /* Number of buckets, a power of 2. */
-	struct list *buckets;       /* Array of `bucket_cnt' lists. */
+	size_t slot_cnt;            /* Number of slots, a power of 2. */
+	struct hash_slot *slots;    /* Array of `slot_cnt' slots. */
+
+	/* While a resize is under way, the slots being moved from, else
+	 * null.  Slots before `migrate' are empty already. */
+	struct hash_slot *old_slots;
+	size_t old_slot_cnt;        /* Number of old slots. */
+	size_t old_elem_cnt;        /* Elements still in old slots. */
+	size_t migrate;             /* Next old slot to move. */
+
 	hash_hash_func *hash;       /* Hash function. */
 	hash_less_func *less;       /* Comparison function. */
 	void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -67,8 +91,9 @@ struct hash {
 /* A hash table iterator. */
 struct hash_iterator {
 	struct hash *hash;          /* The hash table. */
-	struct list *bucket;        /* Current bucket. */
-	struct hash_elem *elem;     /* Current hash element in current bucket. */
+	size_t slot;                /* Index of current slot, counting the
+	                               old slots, if any, first. */
+	struct hash_elem *elem;     /* Current hash element. */
 };
 
 /* Basic life cycle. */
@@ -91,10 +116,55 @@ struct hash_elem *hash_cur (struct hash_iterator *);
 /* Information. */
 size_t hash_size (struct hash *);
 bool hash_empty (struct hash *);
+size_t hash_probe_total (struct hash *);
+
+/* Type-specialized lookups, for hot paths.
+
+   hash_find() calls the table's hash and less functions through
+   pointers.  HASH_FIND_DEFINE (NAME, STRUCT, MEMBER, KEY_TYPE, KEY,
+   HASH) instead defines, for tables of STRUCT hashed through MEMBER
+   by their field KEY, of type KEY_TYPE, alone,
+
+     static inline STRUCT *NAME (struct hash *, KEY_TYPE key);
+
+   which returns the element whose KEY equals KEY, or a null pointer,
+   as hash_find() would.  HASH (KEY) must return the same value as
+   the table's hash function does for an element with that KEY, and
+   the table's less function must compare KEY alone; keys are
+   compared with ==, in place, so no element needs to be made up
+   for the lookup either.  Insertion and deletion stay with the
+   generic functions. */
+#define HASH_FIND_DEFINE(NAME, STRUCT, MEMBER, KEY_TYPE, KEY, HASH)      \
+static inline STRUCT *                                                  \
+NAME (struct hash *h_, KEY_TYPE key_) {                                 \
+	uint64_t hash_ = HASH (key_);                                       \
+	struct hash_slot *slots_ = h_->slots;                               \
+	size_t cnt_ = h_->slot_cnt;                                         \
+                                                                        \
+	for (;;) {                                                          \
+		size_t mask_ = cnt_ - 1, idx_ = hash_ & mask_, dist_;           \
+                                                                        \
+		for (dist_ = 0; dist_ < cnt_; dist_++, idx_ = (idx_ + 1) & mask_) { \
+			struct hash_slot *s_ = &slots_[idx_];                       \
+                                                                        \
+			if (s_->elem == NULL || ((idx_ - s_->hash) & mask_) < dist_) \
+				break;                                                  \
+			if (s_->hash == hash_                                       \
+					&& hash_entry (s_->elem, STRUCT, MEMBER)->KEY == key_) \
+				return hash_entry (s_->elem, STRUCT, MEMBER);           \
+		}                                                               \
+		if (slots_ != h_->slots || h_->old_slots == NULL)               \
+			return NULL;                                                \
+		slots_ = h_->old_slots;                                         \
+		cnt_ = h_->old_slot_cnt;                                        \
+	}                                                                   \
+}
 
 /* Sample hash functions. */
 uint64_t hash_bytes (const void *, size_t);
 uint64_t hash_string (const char *);
 uint64_t hash_int (int);
+uint64_t hash_u64 (uint64_t);
+uint64_t hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
@@ -160,4 +160,55 @@ void list_unique (struct list *, struct list *duplicates,
 struct list_elem *list_max (struct list *, list_less_func *, void *aux);
 struct list_elem *list_min (struct list *, list_less_func *, void *aux);
 
+/* Type-specialized ordered lists, for hot paths.
+
+   list_insert_ordered() and list_sort() call their list_less_func
+   through a pointer for every element they pass, which nothing can
+   inline.  LIST_ORDERED_DEFINE (NAME, STRUCT, MEMBER, LESS) instead
+   defines, for lists of STRUCT linked through MEMBER,
+
+     static inline void NAME_insert_ordered (struct list *, STRUCT *);
+     static inline void NAME_sort (struct list *);
+
+   which order as those two do given a function returning LESS (A, B),
+   LESS being a macro taking two `const STRUCT *' that is expanded in
+   place.  NAME_insert_ordered() puts an element after those equal to
+   it.  NAME_sort() is an insertion sort, stable like list_sort(),
+   whose cost is linear in the length of a list out of order in a
+   few places, as the lists of waiters it is meant for are after a
+   priority changes; it is quadratic for a list in reverse order. */
+#define LIST_ORDERED_DEFINE(NAME, STRUCT, MEMBER, LESS)                  \
+static inline void                                                      \
+NAME##_insert_ordered (struct list *list_, STRUCT *new_) {              \
+	struct list_elem *e_;                                               \
+                                                                        \
+	for (e_ = list_->head.next; e_ != &list_->tail; e_ = e_->next)      \
+		if (LESS ((const STRUCT *) new_,                                \
+					(const STRUCT *) list_entry (e_, STRUCT, MEMBER)))  \
+			break;                                                      \
+	list_insert (e_, &new_->MEMBER);                                    \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+NAME##_sort (struct list *list_) {                                      \
+	struct list_elem *e_ = list_->head.next;                            \
+                                                                        \
+	if (e_ == &list_->tail)                                             \
+		return;                                                         \
+	for (e_ = e_->next; e_ != &list_->tail; ) {                         \
+		struct list_elem *next_ = e_->next;                             \
+		struct list_elem *p_ = e_->prev;                                \
+		const STRUCT *x_ = list_entry (e_, STRUCT, MEMBER);             \
+                                                                        \
+		while (p_ != &list_->head                                       \
+				&& LESS (x_, (const STRUCT *) list_entry (p_, STRUCT, MEMBER))) \
+			p_ = p_->prev;                                              \
+		if (p_ != e_->prev) {                                           \
+			list_remove (e_);                                           \
+			list_insert (p_->next, e_);                                 \
+		}                                                               \
+		e_ = next_;                                                     \
+	}                                                                   \
+}
+
 #endif /* lib/kernel/list.h */
@@ -29,13 +29,57 @@ enum {
 	SYS_READDIR,                /* Reads a directory entry. */
 	SYS_ISDIR,                  /* Tests if a fd represents a directory. */
 	SYS_INUMBER,                /* Returns the inode number for a fd. */
-	SYS_SYMLINK,                /* Returns the inode number for a fd. */
+	SYS_SYMLINK,                /* Creates a symbolic link. */
 
 	/* Extra for Project 2 */
 	SYS_DUP2,                   /* Duplicate the file descriptor */
 
-	SYS_MOUNT,
-	SYS_UMOUNT,
+	SYS_MOUNT,                  /* Mount a file system. */
+	SYS_UMOUNT,                 /* Unmount a file system. */
+
+	SYS_CLOCK_NS,               /* Nanoseconds since boot. */
+
+	SYS_PREAD,                  /* Read from a file at an offset. */
+	SYS_PWRITE,                 /* Write to a file at an offset. */
+	SYS_READV,                  /* Read from a file into buffers. */
+	SYS_WRITEV,                 /* Write to a file from buffers. */
+	SYS_SPAWN,                  /* Start a new process. */
+	SYS_STACK_LIMIT,            /* Set the most the stack may grow to. */
+	SYS_WAIT_ANY,               /* Wait for any child process to die. */
+	SYS_SYSCALL_STATS,          /* Read system call statistics. */
+	SYS_SENDFILE,               /* Copy between file descriptors. */
+	SYS_PIPE,                   /* Create a pipe. */
+	SYS_FSYNC,                  /* Write a file's changes to disk. */
+	SYS_SHMAT,                  /* Attach a shared memory segment. */
+	SYS_SHMDT,                  /* Detach a shared memory segment. */
+	SYS_MADVISE,                /* Advise on the use of memory. */
+	SYS_FRAME_QUOTA,            /* Set the frames to keep and to hold. */
+	SYS_RSS,                    /* Number of frames resident. */
+	SYS_FAULT_STATS,            /* Read page fault statistics. */
+	SYS_IO_SETUP,               /* Map an I/O ring. */
+	SYS_IO_ENTER,               /* Run operations queued in the I/O ring. */
+	SYS_PMU_STATS,              /* Read performance counters. */
+	SYS_SCHED_STATS,            /* Read scheduling statistics. */
+	SYS_DISK_STATS,             /* Read disk statistics. */
+	SYS_FUTEX_WAIT,             /* Sleep on a word of memory. */
+	SYS_FUTEX_WAKE,             /* Wake sleepers on a word of memory. */
+	SYS_UTHREAD_CREATE,         /* Start a thread in the current process. */
+	SYS_SCHED_DEADLINE,         /* Join or leave the deadline class. */
+	SYS_SBRK,                   /* Grow or shrink the heap. */
+	SYS_OPEN_FLAGS,             /* Open a file with flags. */
+	SYS_TEMPLATE_CREATE,        /* Freeze the process as a template. */
+	SYS_TEMPLATE_SPAWN,         /* Start a worker from a template. */
+	SYS_TEMPLATE_DESTROY,       /* End a template. */
+	SYS_GETDENTS,               /* Read many directory entries. */
+	SYS_POLL,                   /* Wait for file descriptors to be ready. */
+	SYS_MREMAP,                 /* Resize or move a memory mapping. */
+	SYS_TIMER_SLACK,            /* Set how late sleeps may end. */
+	SYS_RGROUP_CREATE,          /* Make or set a resource group. */
+	SYS_RGROUP_JOIN,            /* Move the process to a resource group. */
+	SYS_RGROUP_STATS,           /* Read resource group statistics. */
+	SYS_DIRSTAT,                /* Read many directory entries with their metadata. */
+
+	SYS_CNT                     /* Number of system call numbers. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -4,4 +4,29 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered output streams.
+
+   A stream collects output for a file handle in a buffer of BUFSIZ
+   bytes and writes it with one system call when the buffer fills,
+   on fflush(), or on exit().  stdout, which printf(), putchar() and
+   puts() write to, is line buffered: it is also written on every
+   new-line, and before reading from the console.  Streams from
+   fdopen() are fully buffered.  Streams are not safe to use from
+   several threads of a process at once. */
+#define BUFSIZ 512
+#define FOPEN_MAX 8             /* Streams open at once, with stdout. */
+#define EOF (-1)
+
+typedef struct FILE FILE;
+extern FILE *stdout;
+
+FILE *fdopen (int handle);
+int fclose (FILE *);
+int fflush (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
 #endif /* lib/user/stdio.h */
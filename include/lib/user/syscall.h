@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -13,9 +14,240 @@ typedef int pid_t;
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
 
+/* Flags of mmap(), or'd into WRITABLE, whose bit 0 makes the mapping
+ * writable. */
+#define MAP_POPULATE 0x2        /* Load every page now, not on first touch. */
+
+/* Flags of mremap(). */
+#define MREMAP_MAYMOVE 0x1      /* Move the mapping if it cannot grow in
+                                   place. */
+
+/* FD of mmap() for an anonymous mapping: zeros, kept in swap rather
+ * than a file when evicted.  OFFSET must then be 0. */
+#define MAP_ANON_FD -1
+
+/* Flags of open_flags(). */
+#define O_DIRECT 0x1            /* Move whole sectors straight between the
+                                   disk and the caller's buffer, bypassing
+                                   the buffer cache. */
+
+/* Advice to madvise() on how a range of memory will be used. */
+#define MADV_NORMAL 0           /* No particular way. */
+#define MADV_SEQUENTIAL 1       /* In ascending order, once. */
+#define MADV_RANDOM 2           /* In no order. */
+#define MADV_WILLNEED 3         /* Soon: start reading it in. */
+#define MADV_DONTNEED 4         /* Not for now: drop it. */
+
+/* CHAN_NO of mount() that mounts an empty memory-backed file
+ * system, whose files vanish when it is unmounted, rather than a
+ * disk. */
+#define MOUNT_TMPFS -1
+
+/* CHAN_NO of mount() that mounts the read-only file system of live
+ * kernel statistics: files "sched", "memory", "disk", "self", "pmu",
+ * "syscalls" and, in kernels built with LOCKSTAT, "locks".  Each
+ * open of one renders a fresh snapshot. */
+#define MOUNT_PROCFS -2
+
+/* A buffer of readv() or writev(). */
+struct iovec {
+	void *iov_base;             /* First byte. */
+	size_t iov_len;             /* Number of bytes. */
+};
+
+/* Maximum number of buffers given to readv() or writev(). */
+#define IOV_MAX 1024
+
+/* A file descriptor given to poll(), with the events to wait for
+ * and, on return, those that are ready.  A negative FD is skipped. */
+struct pollfd {
+	int fd;
+	short events;               /* POLLIN, POLLOUT. */
+	short revents;              /* Set by poll(). */
+};
+
+/* Events of poll().  POLLERR, POLLHUP and POLLNVAL are reported
+ * whether asked for or not. */
+#define POLLIN 0x01             /* Reading would not block. */
+#define POLLOUT 0x04            /* Writing would not block. */
+#define POLLERR 0x08            /* Write end of a pipe no one reads. */
+#define POLLHUP 0x10            /* Read end of a pipe no one writes. */
+#define POLLNVAL 0x20           /* FD is not open. */
+
+/* Maximum number of file descriptors given to poll(). */
+#define POLL_MAX 256
+
+/* Statistics of a system call, as syscall_stats() reports them.
+ * Calls that do not return, like exit, are counted but not timed. */
+struct syscall_stat {
+	uint64_t count;             /* Number of calls. */
+	uint64_t cycles;            /* TSC cycles spent in them. */
+	uint64_t max_cycles;        /* Longest call, in TSC cycles. */
+};
+
+/* Classes of page faults, as fault_stats() reports them. */
+#define FAULT_ZERO 0            /* Anonymous page filled with zeros. */
+#define FAULT_EXEC 1            /* Executable page loaded lazily. */
+#define FAULT_MMAP 2            /* Mapped file page loaded. */
+#define FAULT_SWAP 3            /* Page read back from swap. */
+#define FAULT_STACK 4           /* Stack grown. */
+#define FAULT_COW 5             /* Copy-on-write page copied. */
+#define FAULT_INVALID 6         /* Bad access, fatal to the process. */
+#define FAULT_CLASS_CNT 7
+
+/* Buckets of a fault latency histogram.  Bucket 0 counts faults
+ * taking under 2**10 TSC cycles, bucket I > 0 those taking at least
+ * 2**(9+I) and under 2**(10+I), and the last also all longer ones. */
+#define FAULT_HIST_CNT 16
+
+/* Statistics of a class of page faults, as fault_stats() reports
+ * them. */
+struct fault_stat {
+	uint64_t count;             /* Number of faults. */
+	uint64_t cycles;            /* TSC cycles spent handling them. */
+	uint64_t max_cycles;        /* Longest fault, in TSC cycles. */
+	uint64_t hist[FAULT_HIST_CNT];  /* Latency histogram. */
+};
+
+/* Events counted by the performance counters, indices in what
+ * pmu_stats() reports. */
+#define PMU_CYCLES 0            /* Core cycles, not halted. */
+#define PMU_INSTRUCTIONS 1      /* Instructions retired. */
+#define PMU_LLC_REFS 2          /* Last-level cache references. */
+#define PMU_LLC_MISSES 3        /* Last-level cache misses. */
+#define PMU_BRANCH_MISSES 4     /* Branches mispredicted. */
+#define PMU_DTLB_MISSES 5       /* Data TLB misses that walked the page table. */
+#define PMU_CNT 6
+
+/* The count of an event the processor cannot count. */
+#define PMU_NONE UINT64_MAX
+
+/* Scheduling statistics of a thread, indices in what sched_stats()
+ * reports.  Times are in TSC cycles.  SCHED_HIST_CNT buckets from
+ * SCHED_HIST count wakeups by the cycles until the thread ran: the
+ * first under 2**10, each next one up to twice as many, the last
+ * all longer waits. */
+#define SCHED_RUN 0             /* Time running. */
+#define SCHED_READY 1           /* Time waiting in a run queue. */
+#define SCHED_LOCK 2            /* Time blocked acquiring a lock. */
+#define SCHED_BLOCK 3           /* Time blocked otherwise: I/O, sleep, ... */
+#define SCHED_VOLUNTARY 4       /* Switches away by blocking, yielding or exiting. */
+#define SCHED_INVOLUNTARY 5     /* Switches away by preemption. */
+#define SCHED_WAKEUPS 6         /* Times unblocked. */
+#define SCHED_HIST 7            /* First bucket of the latency histogram. */
+#define SCHED_HIST_CNT 16
+#define SCHED_STAT_CNT (SCHED_HIST + SCHED_HIST_CNT)
+
+/* Statistics of a block device, indices in what disk_stats()
+ * reports.  A request is counted once, however many sectors it
+ * moves.  DISK_STAT_LAT_HIST_CNT buckets from
+ * DISK_STAT_LAT_HIST count requests by the TSC cycles from
+ * submission to completion: the first under 2**12, each next one
+ * up to twice as many, the last all slower ones.
+ * DISK_STAT_DEPTH_HIST_CNT buckets from DISK_STAT_DEPTH_HIST count
+ * requests by the number the device had queued or in flight once
+ * they were submitted, counting themselves: bucket I from 2**I up to 2**(I+1)
+ * requests, the last all deeper queues. */
+#define DISK_STAT_READS 0           /* Read requests. */
+#define DISK_STAT_WRITES 1          /* Write requests. */
+#define DISK_STAT_READ_BYTES 2      /* Bytes read. */
+#define DISK_STAT_WRITE_BYTES 3     /* Bytes written. */
+#define DISK_STAT_SEQUENTIAL 4      /* Requests starting where the device's
+                                       previous one ended. */
+#define DISK_STAT_RANDOM 5          /* Other requests. */
+#define DISK_STAT_CYCLES 6          /* Latency of all requests, summed. */
+#define DISK_STAT_MAX_CYCLES 7      /* Latency of the slowest request. */
+#define DISK_STAT_CACHE_HITS 8      /* Buffer cache hits, in sectors. */
+#define DISK_STAT_CACHE_MISSES 9    /* Buffer cache misses, in sectors. */
+#define DISK_STAT_LAT_HIST 10
+#define DISK_STAT_LAT_HIST_CNT 16
+#define DISK_STAT_DEPTH_HIST (DISK_STAT_LAT_HIST + DISK_STAT_LAT_HIST_CNT)
+#define DISK_STAT_DEPTH_HIST_CNT 8
+#define DISK_STAT_CNT (DISK_STAT_DEPTH_HIST + DISK_STAT_DEPTH_HIST_CNT)
+
+/* Statistics of a resource group, indices in what rgroup_stats()
+ * reports. */
+#define RGROUP_STAT_CPU_WEIGHT 0    /* Its settings... */
+#define RGROUP_STAT_IO_WEIGHT 1
+#define RGROUP_STAT_FRAME_MAX 2
+#define RGROUP_STAT_THREADS 3       /* Threads in it now. */
+#define RGROUP_STAT_CPU_TICKS 4     /* Timer ticks its threads ran. */
+#define RGROUP_STAT_FRAMES 5        /* Frames resident now. */
+#define RGROUP_STAT_EVICTIONS 6     /* Frames evicted to keep to FRAME_MAX. */
+#define RGROUP_STAT_IO_REQUESTS 7   /* Block requests started. */
+#define RGROUP_STAT_IO_SECTORS 8    /* Sectors they moved. */
+#define RGROUP_STAT_CNT 9
+
+/* Operations of an I/O ring submission, each run as the system
+ * call of the same name would be. */
+#define IORING_OP_READ 0        /* read (fd, buf, len). */
+#define IORING_OP_WRITE 1       /* write (fd, buf, len). */
+#define IORING_OP_PREAD 2       /* pread (fd, buf, len, offset). */
+#define IORING_OP_PWRITE 3      /* pwrite (fd, buf, len, offset). */
+#define IORING_OP_OPEN 4        /* open (buf). */
+#define IORING_OP_CLOSE 5       /* close (fd). */
+
+/* Most entries an I/O ring may have. */
+#define IORING_MAX_ENTRIES 4096
+
+/* An operation queued in an I/O ring. */
+struct io_sqe {
+	int op;                     /* IORING_OP_*. */
+	int fd;
+	void *buf;                  /* Data, or file name for open. */
+	unsigned len;
+	off_t offset;               /* For pread and pwrite. */
+	uint64_t user_data;         /* Copied to the completion. */
+};
+
+/* The result of an operation of an I/O ring. */
+struct io_cqe {
+	uint64_t user_data;         /* From the submission. */
+	int res;                    /* What the system call returns. */
+};
+
+/* An I/O ring, as io_setup() maps it.  Submissions run from sq_head
+ * to sq_tail and completions from cq_head to cq_tail, each index
+ * taken modulo ENTRIES.  The user advances sq_tail and cq_head, the
+ * kernel the others. */
+struct io_ring {
+	unsigned sq_head;
+	unsigned sq_tail;
+	unsigned cq_head;
+	unsigned cq_tail;
+	unsigned entries;           /* Number of each kind of entry. */
+	struct io_sqe *sqes;
+	struct io_cqe *cqes;
+};
+
+/* A function run by a thread of uthread_create(). */
+typedef void uthread_func (void *aux);
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* An entry of a directory, as getdents() stores it. */
+struct dirent {
+	int inumber;                        /* Inode number of the file. */
+	uint8_t type;                       /* DT_*. */
+	char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+};
+
+/* A directory entry with the metadata of its file, as dirstat()
+ * stores it. */
+struct dirstat {
+	int inumber;                        /* Inode number of the file. */
+	uint8_t type;                       /* DT_*. */
+	off_t length;                       /* File size in bytes; of a link,
+	                                       its target's length. */
+	char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+};
+
+/* Types of struct dirent and struct dirstat. */
+#define DT_REG 1                    /* Regular file; so far the file
+                                       system has no subdirectories. */
+#define DT_LNK 2                    /* Symbolic link. */
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -25,10 +257,16 @@ void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t fork (const char *thread_name);
 int exec (const char *file);
+pid_t spawn (const char *cmd_line, const int *fds, int fd_cnt);
+int template_create (const char *name);
+pid_t template_spawn (const char *name);
+bool template_destroy (const char *name);
 int wait (pid_t);
+pid_t wait_any (int *status);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
+int open_flags (const char *file, int flags);
 int filesize (int fd);
 int read (int fd, void *buffer, unsigned length);
 int write (int fd, const void *buffer, unsigned length);
@@ -37,10 +275,43 @@ unsigned tell (int fd);
 void close (int fd);
 
 int dup2(int oldfd, int newfd);
+int pipe (int fds[2]);
+int fsync (int fd);
+int pread (int fd, void *buffer, unsigned length, off_t offset);
+int pwrite (int fd, const void *buffer, unsigned length, off_t offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int sendfile (int out_fd, int in_fd, off_t *offset, unsigned count);
+int poll (struct pollfd *fds, unsigned nfds, int timeout);
+int64_t clock_ns (void);
+int syscall_stats (struct syscall_stat *buf, int cnt);
 
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+void *mremap (void *old, size_t old_len, size_t new_len, int flags);
+int madvise (void *addr, size_t length, int advice);
+void *shmat (void *addr, size_t length, int key);
+void shmdt (void *addr);
+bool stack_limit (size_t size);
+bool frame_quota (size_t min, size_t max);
+size_t rss (void);
+int fault_stats (struct fault_stat *buf, int cnt, bool self);
+struct io_ring *io_setup (void *addr, unsigned entries);
+int io_enter (unsigned to_submit);
+int pmu_stats (uint64_t *buf, int cnt, bool self);
+int sched_stats (pid_t tid, uint64_t *buf, int cnt);
+int disk_stats (const char *name, uint64_t *buf, int cnt);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int n);
+pid_t uthread_create (uthread_func *func, void *aux, void *stack);
+bool sched_deadline (int64_t runtime, int64_t deadline, int64_t period);
+void *sbrk (intptr_t increment);
+int64_t timer_slack (int64_t ns);
+int rgroup_create (const char *name, unsigned cpu_weight, unsigned io_weight,
+		size_t frame_max);
+bool rgroup_join (int id);
+int rgroup_stats (int id, uint64_t *buf, int cnt);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -49,6 +320,12 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
+int mount (const char *path, int chan_no, int dev_no);
+int umount (const char *path);
+int getdents (const char *dir, unsigned *pos, struct dirent *entries,
+		int cnt);
+int dirstat (const char *dir, unsigned *pos, struct dirstat *entries,
+		int cnt);
 
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
@@ -0,0 +1,17 @@
+#ifndef THREADS_APIC_H
+#define THREADS_APIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* True once the local APIC timer delivers the timer interrupt in
+   place of the 8254, whose IRQ is then masked at the 8259. */
+extern bool apic_timer_active;
+
+bool apic_init (void);
+void apic_eoi (void);
+void apic_timer_oneshot (uint32_t count);
+void apic_timer_periodic (uint8_t vec, uint32_t count);
+uint32_t apic_timer_count (void);
+
+#endif /* threads/apic.h */
@@ -0,0 +1,40 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most processors recorded. */
+#define CPU_MAX 16
+
+/* Affinity mask allowing every processor. */
+#define CPU_MASK_ALL ((1u << CPU_MAX) - 1)
+
+/* A processor, as the BIOS's MP configuration table lists it. */
+struct cpu {
+	uint8_t apic_id;            /* Local APIC ID. */
+	bool bsp;                   /* Bootstrap processor? */
+	bool running;               /* Running this kernel? */
+};
+
+/* The processors found, the bootstrap processor first.  Only the
+   bootstrap processor runs the kernel: the others stay halted where
+   the BIOS left them, waiting for a startup IPI. */
+extern struct cpu cpus[CPU_MAX];
+extern size_t cpu_cnt;
+
+/* Physical address of the local APICs, or 0 if not known. */
+extern uint32_t lapic_paddr;
+
+void cpu_init (void);
+void cpu_print_stats (void);
+
+/* Returns the index in cpus[] of the processor running the caller:
+   always the bootstrap processor, cpus[0]. */
+static inline size_t
+cpu_id (void) {
+	return 0;
+}
+
+#endif /* threads/cpu.h */
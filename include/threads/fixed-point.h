@@ -0,0 +1,23 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* 17.14 fixed-point numbers, for the 4.4BSD scheduler's recent_cpu
+   and load_avg.  X and Y are fixed-point numbers, N is an int. */
+typedef int fixed_t;
+
+#define FP_F (1 << 14)                  /* Fixed-point 1. */
+
+#define INT_TO_FP(N) ((N) * FP_F)
+/* Rounds toward zero. */
+#define FP_TO_INT(X) ((X) / FP_F)
+/* Rounds to nearest. */
+#define FP_ROUND(X) ((X) >= 0 ? ((X) + FP_F / 2) / FP_F \
+                              : ((X) - FP_F / 2) / FP_F)
+
+#define FP_ADD_INT(X, N) ((X) + (N) * FP_F)
+#define FP_MUL(X, Y) ((fixed_t) ((int64_t) (X) * (Y) / FP_F))
+#define FP_DIV(X, Y) ((fixed_t) ((int64_t) (X) * FP_F / (Y)))
+
+#endif /* threads/fixed-point.h */
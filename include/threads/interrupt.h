@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -67,11 +68,30 @@ typedef void intr_handler_func (struct intr_frame *);
 
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
+void intr_mask_ext (uint8_t vec);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
 
+/* Work an external interrupt handler leaves for later: FUNC (AUX)
+   runs once the handler has returned and the interrupt has been
+   acknowledged, with interrupts on.  It is still in interrupt
+   context, so it must not sleep, and it turns interrupts off only
+   around what it shares with other handlers. */
+typedef void intr_work_func (void *aux);
+
+struct intr_work {
+	intr_work_func *func;
+	void *aux;
+	bool pending;               /* Deferred and not yet run? */
+	struct list_elem elem;      /* Element in the deferred list. */
+};
+
+void intr_work_init (struct intr_work *, intr_work_func *, void *aux);
+void intr_defer (struct intr_work *);
+
+void intr_print_stats (void);
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
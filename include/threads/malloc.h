@@ -9,5 +9,20 @@ void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_print_stats (void);
+
+struct thread;
+void malloc_thread_init (struct thread *);
+void malloc_thread_exit (void);
+
+/* Object caches. */
+struct kmem_cache;
+typedef void kmem_ctor (void *);
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+		kmem_ctor *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_print_stats (void);
 
 #endif /* threads/malloc.h */
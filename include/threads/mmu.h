@@ -2,23 +2,51 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Pages whose page table entries changed, for invalidating their TLB
+ * entries together.  Beyond TLB_BATCH_MAX pages, the whole TLB is
+ * flushed instead. */
+#define TLB_BATCH_MAX 32
+struct tlb_batch {
+	uint64_t *pml4;
+	size_t cnt;                     /* Pages added, even past VA's end. */
+	uint64_t va[TLB_BATCH_MAX];
+};
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
+bool pml4_for_each_swap (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_enable_pcid (void);
+void pml4_share_kernel (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_set_kernel_huge_page (uint64_t *pml4, uint64_t va, uint64_t pa,
+		bool rw);
+bool pml4_split_huge_page (uint64_t *pml4, void *upage);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
+bool pml4_is_writable (uint64_t *pml4, const void *upage);
+void tlb_batch_init (struct tlb_batch *, uint64_t *pml4);
+void tlb_batch_flush (struct tlb_batch *);
+void pml4_clear_page_batched (struct tlb_batch *, void *upage);
+void pml4_set_dirty_batched (struct tlb_batch *, const void *upage, bool dirty);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
+bool pml4_move_page (struct tlb_batch *, void *from, void *to);
+bool pml4_set_swap (uint64_t *pml4, void *upage, size_t slot, bool rw);
+bool pml4_get_swap (uint64_t *pml4, const void *upage, size_t *slot,
+		bool *rw);
+void pml4_clear_swap (uint64_t *pml4, const void *upage);
 
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
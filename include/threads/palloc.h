@@ -2,6 +2,7 @@
 #define THREADS_PALLOC_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -17,7 +18,19 @@ extern size_t user_page_limit;
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt, size_t align);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_free_pages (void **pages, size_t page_cnt);
+bool palloc_prezero (void);
+void *palloc_user_pool (size_t *page_cnt);
+size_t palloc_user_page_cnt (void);
+size_t palloc_user_free_cnt (void);
+bool palloc_page_is_free (const void *);
+bool palloc_pages_in_pool (const void *pages, size_t page_cnt);
+void palloc_print_stats (void);
+
+void copy_page (void *dst, const void *src);
+void clear_page (void *);
 
 #endif /* threads/palloc.h */
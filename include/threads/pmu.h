@@ -0,0 +1,30 @@
+#ifndef THREADS_PMU_H
+#define THREADS_PMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Events counted, indices in the counts pmu_read() returns.  The
+   same as in lib/user/syscall.h. */
+#define PMU_CYCLES 0            /* Core cycles, not halted. */
+#define PMU_INSTRUCTIONS 1      /* Instructions retired. */
+#define PMU_LLC_REFS 2          /* Last-level cache references. */
+#define PMU_LLC_MISSES 3        /* Last-level cache misses. */
+#define PMU_BRANCH_MISSES 4     /* Branches mispredicted. */
+#define PMU_DTLB_MISSES 5       /* Data TLB misses that walked the page table. */
+#define PMU_CNT 6
+
+/* The count of an event the processor cannot count. */
+#define PMU_NONE UINT64_MAX
+
+/* Set by the -pmu kernel option. */
+extern bool pmu_enabled;
+
+void pmu_init (void);
+void pmu_switch (struct thread *prev);
+bool pmu_read (uint64_t counts[PMU_CNT], bool self);
+void pmu_print_stats (void);
+
+#endif /* threads/pmu.h */
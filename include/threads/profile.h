@@ -0,0 +1,30 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct intr_frame;
+
+/* Return addresses recorded per sample, counting the interrupted
+   instruction's. */
+#define PROFILE_DEPTH 5
+
+/* A sample of where the CPU was at a timer interrupt: 64 bytes. */
+struct profile_sample {
+	uintptr_t pcs[PROFILE_DEPTH];   /* Interrupted rip, then the return
+	                                   addresses of its callers, for
+	                                   kernel code; 0 past the last. */
+	char name[16];                  /* Name of the running thread. */
+	bool user;                      /* Interrupted in user mode? */
+	uint8_t unused[7];
+};
+
+/* Set by the -profile kernel option. */
+extern bool profile_enabled;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_dump (void);
+
+#endif /* threads/profile.h */
@@ -41,5 +41,18 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=2 MB page (PDEs only), 0=page table. */
+#define PTE_G 0x100                      /* 1=global, kept in TLB across CR3 loads. */
+
+/* A PTE that is not present but has PTE_SWAP, one of the PTE_AVL
+   bits, set names the swap slot of a swapped-out anonymous page in
+   its address bits, and whether the page is writable in PTE_W. */
+#define PTE_SWAP 0x200
+#define PTE_SWAP_SLOT(pte) ((uint64_t) (pte) >> PTXSHIFT)
+#define is_swap_pte(pte) (((pte) & (PTE_P | PTE_SWAP)) == PTE_SWAP)
+
+/* A 2 MB page, mapped by a single PDE. */
+#define HPGSIZE (1UL << PDXSHIFT)        /* Bytes in a 2 MB page. */
+#define HPG_CNT (HPGSIZE / PGSIZE)       /* 4 kB pages in a 2 MB page. */
 
 #endif /* threads/pte.h */
@@ -0,0 +1,45 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Read-copy-update: synchronization for data read far more often
+   than it changes.  Readers take no lock: they bracket their reads
+   with rcu_read_lock() and rcu_read_unlock(), which only keep the
+   thread from being preempted, and must not sleep in between.  A
+   writer, serialized with other writers by a lock of its own,
+   publishes a new version with rcu_assign_pointer() and frees the
+   old one with call_rcu(), or after synchronize_rcu(), once every
+   reader that might still see it is done. */
+
+/* Callback of call_rcu(), for HEAD's enclosing object. */
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *head);
+
+/* Embedded in an object to be freed by call_rcu(). */
+struct rcu_head {
+	struct list_elem elem;      /* In the callbacks waiting. */
+	rcu_func *func;
+	uint64_t gp;                /* Grace period to wait for. */
+};
+
+void rcu_init (void);
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_read_lock_held (void);
+void synchronize_rcu (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+void rcu_quiescent (void);
+void rcu_print_stats (void);
+
+/* Loads the pointer P for a reader to follow, once. */
+#define rcu_dereference(P) (*(__typeof__ (P) volatile *) &(P))
+
+/* Publishes V as the new value of the pointer P, after the stores
+   that filled in what V points to. */
+#define rcu_assign_pointer(P, V) \
+	do { barrier (); (P) = (V); } while (0)
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,100 @@
+#ifndef THREADS_RGROUP_H
+#define THREADS_RGROUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Resource groups: processes put together to share the machine with
+   other groups in set proportions.  Every thread is in one, at first
+   its creator's, and rgroup_join() moves a whole process.  A group
+   has a CPU weight, which divides the processor among the ready
+   threads of equal priority by group; a frame limit, which makes a
+   process of a group at it evict one of the group's frames for each
+   it takes; and an I/O weight, which divides each disk among the
+   requests of equal rank by group.  The root group, 0, holds the
+   rest, and while it is the only one nothing is divided. */
+
+/* Most groups, the root group included.  Groups last until shutdown. */
+#define RGROUP_MAX 8
+
+/* Weights, relative to each other.  The root group has the default. */
+#define RGROUP_WEIGHT_DEFAULT 100
+#define RGROUP_WEIGHT_MAX 10000
+
+/* Statistics of a group, indices in what the rgroup_stats() system
+   call reports, the same as in lib/user/syscall.h. */
+#define RGROUP_STAT_CPU_WEIGHT 0    /* Its settings... */
+#define RGROUP_STAT_IO_WEIGHT 1
+#define RGROUP_STAT_FRAME_MAX 2
+#define RGROUP_STAT_THREADS 3       /* Threads in it now. */
+#define RGROUP_STAT_CPU_TICKS 4     /* Timer ticks its threads ran. */
+#define RGROUP_STAT_FRAMES 5        /* Frames resident now. */
+#define RGROUP_STAT_EVICTIONS 6     /* Frames evicted to keep to FRAME_MAX. */
+#define RGROUP_STAT_IO_REQUESTS 7   /* Block requests started. */
+#define RGROUP_STAT_IO_SECTORS 8    /* Sectors they moved. */
+#define RGROUP_STAT_CNT 9
+
+struct rgroup {
+	int id;                     /* Index in the table; 0 is the root. */
+	char name[16];
+	unsigned cpu_weight;
+	unsigned io_weight;
+	size_t frame_max;           /* Most frames resident, or 0. */
+
+	/* Usage, each scaled down by the matching weight, by disabling
+	   interrupts.  The group furthest behind goes first. */
+	uint64_t cpu_vtime;
+	uint64_t io_vtime;
+
+	size_t frames;              /* Resident, by vm.c's clock_lock. */
+	unsigned thread_cnt;        /* By disabling interrupts. */
+	uint64_t cpu_ticks;
+	uint64_t evictions;
+	uint64_t io_requests;
+	uint64_t io_sectors;
+};
+
+extern struct rgroup rgroups[RGROUP_MAX];
+extern int rgroup_cnt;
+
+/* The root group. */
+#define rgroup_root (&rgroups[0])
+
+/* Returns true if resource groups divide anything, which is once a
+   group besides the root has been made. */
+static inline bool
+rgroup_active (void) {
+	return rgroup_cnt > 1;
+}
+
+/* Returns true if group A is further behind in its share of the
+   processor than B, and so should run first. */
+static inline bool
+rgroup_cpu_before (const struct rgroup *a, const struct rgroup *b) {
+	return a->cpu_vtime < b->cpu_vtime;
+}
+
+/* Likewise, in its share of the disks. */
+static inline bool
+rgroup_io_before (const struct rgroup *a, const struct rgroup *b) {
+	return a->io_vtime < b->io_vtime;
+}
+
+int rgroup_create (const char *name, unsigned cpu_weight,
+		unsigned io_weight, size_t frame_max);
+bool rgroup_join (int id);
+bool rgroup_read_stats (int id, uint64_t stats[RGROUP_STAT_CNT]);
+void rgroup_print_stats (void);
+
+/* For the scheduler, the VM and the disk drivers. */
+void rgroup_attach (struct thread *, struct rgroup *);
+void rgroup_cpu_charge (struct rgroup *);
+void rgroup_cpu_picked (struct rgroup *);
+void rgroup_cpu_ready (struct rgroup *);
+void rgroup_io_charge (struct rgroup *, size_t sec_cnt);
+void rgroup_io_submitted (struct rgroup *);
+
+#endif /* threads/rgroup.h */
@@ -0,0 +1,18 @@
+#ifndef THREADS_SCRATCH_H
+#define THREADS_SCRATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Pages of each thread's scratch arena. */
+#define SCRATCH_PAGES 2
+
+void *scratch_alloc (size_t size);
+void scratch_trim (void *, size_t size);
+void scratch_free (void *);
+bool scratch_owns (const void *);
+void scratch_reset (void);
+void scratch_release (void);
+void scratch_print_stats (void);
+
+#endif /* threads/scratch.h */
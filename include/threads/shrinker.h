@@ -0,0 +1,25 @@
+#ifndef THREADS_SHRINKER_H
+#define THREADS_SHRINKER_H
+
+#include <list.h>
+#include <stddef.h>
+
+/* A cache that can give pages back to the page allocator when memory
+   runs short.  COUNT returns how many pages it could free now; SCAN
+   frees up to NR of them and returns how many it freed.  Both are
+   called from the thread whose allocation is failing, which may hold
+   any lock, so they must not wait for one: lock_try_acquire() and
+   giving up is the way. */
+struct shrinker {
+	const char *name;
+	size_t (*count) (void);
+	size_t (*scan) (size_t nr);
+	struct list_elem elem;      /* In the list of shrinkers. */
+	unsigned long long freed;   /* Pages given back, for statistics. */
+};
+
+void shrinker_register (struct shrinker *);
+size_t shrink_caches (size_t page_cnt);
+void shrinker_print_stats (void);
+
+#endif /* threads/shrinker.h */
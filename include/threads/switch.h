@@ -0,0 +1,29 @@
+#ifndef THREADS_SWITCH_H
+#define THREADS_SWITCH_H
+
+#include <stdint.h>
+
+/* switch_threads()'s stack frame: the callee-saved registers, in
+   the order popped, and the address it returns to. */
+struct switch_threads_frame {
+	uint64_t r15;
+	uint64_t r14;
+	uint64_t r13;
+	uint64_t r12;
+	uint64_t rbp;
+	uint64_t rbx;
+	void (*rip) (void);
+};
+
+/* Saves the running thread's callee-saved registers on its stack
+   and the stack pointer in *SAVE_KSP, then switches to the stack at
+   KSP, saved there by an earlier switch_threads() or built by
+   thread_create(), and returns on it. */
+void switch_threads (uintptr_t *save_ksp, uintptr_t ksp);
+
+/* Where a new thread's first switch_threads() returns to: calls
+   the function in RBX, which must not return, with R12 and R13 as
+   its arguments. */
+void switch_entry (void);
+
+#endif /* threads/switch.h */
@@ -3,23 +3,48 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* The priority the waiters of a lock, or of a semaphore with an
+   owner, donate to its holder or owner, in the skew heap of such
+   donations the holder keeps.  Owned by thread.c. */
+struct donation {
+	int max_priority;           /* Highest priority of a waiter, or -1. */
+	struct donation *heap_parent;
+	struct donation *heap_left, *heap_right;
+};
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct list waiters;        /* Waiting threads, by priority. */
+
+	/* For a semaphore used as a completion event, the thread that
+	   is to up it, which its waiters donate priority to, or null. */
+	struct thread *owner;
+	struct donation donation;
 };
 
 void sema_init (struct semaphore *, unsigned value);
+void sema_set_owner (struct semaphore *, struct thread *owner);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
-bool sema_compare_priority(const struct list_elem*, const struct list_elem *, void *);
 /* Lock. */
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
-	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	volatile int state;         /* Free, held, or held with waiters. */
+	struct list waiters;        /* Threads waiting, by priority. */
+
+	struct donation donation;   /* To the holder, from the waiters. */
+
+#ifdef LOCKSTAT
+	struct lock_stat *stat;     /* Of the lock_init() call site. */
+	uint64_t acquire_tsc;       /* When the holder got the lock. */
+#endif
 };
 
 void lock_init (struct lock *);
@@ -28,9 +53,49 @@ bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+#ifdef LOCKSTAT
+/* Lock statistics, built with -DLOCKSTAT.  All the locks initialized
+   at the same line of source share one of these. */
+struct lock_stat {
+	const char *file;           /* Site of lock_init() or rwlock_init(). */
+	int line;
+	uint64_t acquired;          /* Acquisitions. */
+	uint64_t contended;         /* Acquisitions that had to wait. */
+	uint64_t wait_cycles;       /* TSC cycles spent waiting, in all. */
+	uint64_t max_hold_cycles;   /* Longest time held. */
+	uint64_t donations;         /* Priority donations through the lock. */
+};
+
+void lock_init_at (struct lock *, const char *file, int line);
+void lockstat_donated (struct lock *);
+void lockstat_print_stats (void);
+#define lock_init(LOCK) lock_init_at ((LOCK), __FILE__, __LINE__)
+#endif
+
+/* Readers-writer lock. */
+struct rwlock {
+	struct lock lock;           /* Held by the writer, and by readers
+	                               while they get in. */
+	unsigned readers;           /* Readers in. */
+	bool draining;              /* The writer waits for readers to leave. */
+	struct semaphore drained;   /* Upped by the last reader to leave. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+#ifdef LOCKSTAT
+void rwlock_init_at (struct rwlock *, const char *file, int line);
+#define rwlock_init(RW) rwlock_init_at ((RW), __FILE__, __LINE__)
+#endif
+
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct list waiters;        /* Waiting threads, by priority. */
 };
 
 void cond_init (struct condition *);
@@ -2,9 +2,13 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/interrupt.h"
+#include "threads/pmu.h"
 #include "threads/synch.h"
 #ifdef VM
 #include "vm/vm.h"
@@ -30,12 +34,16 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
-/* file descriptor related */
-// #define FDT_ENTRY_MAX 64
-// #define FDT_PAGE_CNT (FDT_ENTRY_MAX + (PGSIZE - 1)) / (PGSIZE)
+/* Thread niceness, for the 4.4BSD scheduler. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0
+#define NICE_MAX 20                     /* Least nice. */
 
-#define FDT_PAGE_CNT 3				
-#define FDT_ENTRY_MAX FDT_PAGE_CNT *(1 << 9)    
+/* file descriptor related */
+#define FDT_INLINE_CNT 8                /* fd 슬롯 중 struct thread 안에 두는 수. */
+#define FDT_ENTRY_MAX 1536              /* 한 process가 가질 수 있는 fd의 수. */
+#define FDT_STDIN ((struct file *) 10)  /* 콘솔 입력을 가리키는 fdt 값 (dummy). */
+#define FDT_STDOUT ((struct file *) 11) /* 콘솔 출력을 가리키는 fdt 값 (dummy). */
 
 /* A kernel thread or user process.
  *
@@ -87,7 +95,33 @@ typedef int tid_t;
  * an assertion failure in thread_current(), which checks that
  * the `magic' member of the running thread's `struct thread' is
  * set to THREAD_MAGIC.  Stack overflow will normally change this
- * value, triggering the assertion. */
+ * value, triggering the assertion, or a panic naming the thread
+ * as it is switched away from.
+ *
+ * With -kstack=PAGES on the kernel command line, each thread
+ * instead gets a block of PAGES pages, aligned to its size, for
+ * deep kernel paths: `struct thread' still sits at the bottom, and
+ * the stack grows down from the top of the block.  The initial
+ * thread keeps the single page the loader gave it. */
+
+/* Pages of each thread's block, a power of two up to
+ * THREAD_STACK_PAGES_MAX.  Set before thread_init(). */
+extern size_t thread_stack_pages;
+#define THREAD_STACK_PAGES_MAX 8
+
+/* Scheduling statistics of a thread, indices in its sched[]; the
+ * same as in lib/user/syscall.h.  Times are in TSC cycles. */
+#define SCHED_RUN 0             /* Time running. */
+#define SCHED_READY 1           /* Time waiting in a run queue. */
+#define SCHED_LOCK 2            /* Time blocked acquiring a lock. */
+#define SCHED_BLOCK 3           /* Time blocked otherwise: I/O, sleep, ... */
+#define SCHED_VOLUNTARY 4       /* Switches away by blocking, yielding or exiting. */
+#define SCHED_INVOLUNTARY 5     /* Switches away by preemption. */
+#define SCHED_WAKEUPS 6         /* Times unblocked. */
+#define SCHED_HIST 7            /* First bucket of the latency histogram. */
+#define SCHED_HIST_CNT 16
+#define SCHED_STAT_CNT (SCHED_HIST + SCHED_HIST_CNT)
+
 /* The `elem' member has a dual purpose.  It can be an element in
  * the run queue (thread.c), or it can be an element in a
  * semaphore wait list (synch.c).  It can be used these two ways
@@ -100,7 +134,27 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
-	int64_t wakeup_tick;				/* 이 thread가 깨어나야 할 시점을 tick으로 저장 */
+	int cpu;                            /* Processor whose run queue it is on or last was. */
+	unsigned affinity;                  /* Processors it may run on, bit I for cpus[I]. */
+	struct timer_event sleep_event;     /* thread_sleep()에서 깨어날 시점에 fire */
+	int64_t timer_slack_ns;             /* How late thread_sleep() may wake it. */
+	struct rgroup *rgroup;              /* Resource group (threads/rgroup.c). */
+	struct list_elem all_elem;          /* List element for all threads list. */
+	struct magazine *magazines;         /* malloc()의 thread별 free block 묶음 */
+
+	/* 4.4BSD scheduler. */
+	int nice;                           /* Niceness, -20...20. */
+	fixed_t recent_cpu;                 /* Recently used CPU time. */
+
+	/* Deadline class, by thread_set_deadline().  Times in timer ticks. */
+	int64_t dl_runtime;                 /* Budget per period, or 0 if not in the class. */
+	int64_t dl_rel_deadline;            /* Deadline, from the start of a period. */
+	int64_t dl_period;
+	int64_t dl_deadline;                /* Current deadline. */
+	int64_t dl_next;                    /* Start of the next period. */
+	int64_t dl_budget;                  /* Budget left before dl_deadline. */
+	bool dl_throttled;                  /* Out of budget until dl_next. */
+	struct timer_event dl_timer;        /* Fires at dl_next while throttled. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -109,57 +163,79 @@ struct thread {
 	int init_priority; 					/* (donate 받는 입장에서) donate 받기 전 최초의 priority를 기록 */
 
 	struct lock *wait_on_lock;          /* (donate 주는 입장에서) donate 주는 이유인 lock을 기록 */
-	struct list donations;				/* (donate 받는 입장에서) 본인에게 donate 준 thread 들을 기록 */
-	struct list_elem donation_elem;		/* (donate 주는 입장에서) donate 받은 thread의 donation list에서 연결 노드로 사용됨 */
+	struct condition *wait_on_cond;     /* cond_wait()으로 기다리는 condition variable */
+	struct semaphore *wait_on_sema;     /* sema_down()으로 기다리는 semaphore */
+	struct donation *donations;         /* (donate 받는 입장에서) 가진 lock들과 맡은 semaphore들의 donation, max_priority 기준 skew heap */
 
 	/* child precess 관련 멤버 */
-	struct list children;				/* (부모 thread 입장에서) 자식 thread들을 담은 list */
-	struct list_elem child_elem;		/* (부모 thread 입장에서) 자식 thread들이 연결되는 노드로 사용됨 */
-
-	/* fork 관련 멤버
-		- parent_if
-			- parent가 fork될 당시의 register 상태를 보관하는 곳 (parent 본인의 parent_if를 업데이트한 뒤 thread_create를 실행)
-			- 이 때, thread_create로 생성된 child가 곧바로 실행될지, 혹은 parent가 계속 진행되다가 child가 실행될지 알 수 없음
-			- 그러므로 child가 처음 실행되는 시점의 parent register 상태는 fork가 요청된 시점의 상태와 다를 수 있음 (그래서 parent_if에 보관해두는 것)
-			- child가 실행될 때 parent의 parent_if에서 보관된 reg 상태 정보를 가저와 본인의 reg 로 업데이트함 (즉 fork된 시점의 reg 상태)
-	 */
+	struct hash children;				/* (부모 thread 입장에서) 자식들의 struct child_info, tid로 찾음 (첫 자식을 만들 때 초기화) */
+	struct list exited_children;		/* 종료되었지만 아직 wait하지 않은 자식들, 종료된 순서대로 */
+	struct semaphore child_exit_sema;	/* 자식이 종료될 때마다 up (wait_any에서 사용) */
+	struct child_info *child_info;		/* parent가 가진 현재 thread의 종료 정보 (userprog/process.h) */
+
+	/* fork될 당시 parent의 register 상태는 fork 동안만 필요하므로 struct thread가 아닌
+		struct fork_aux에 보관 (userprog/process.c) */
 	int exit_status;					/* 종료되었을 때의 상태 정보: parent가 child의 종료 상태를 확인하기 위해 사용 */
-	struct intr_frame parent_if;
-	struct semaphore fork_sema;			/* 현재 thread가 fork 완료되었는지 여부 // Q. 왜 lock이 아닐까? */
-	struct semaphore wait_sema;			/* 현재 thread가 parent에 의해 wait되는지 여부 */
-	struct semaphore free_sema;			/* 현재 thread가 parent에 의해 회수되었는지 여부 (회수 대상은 exit_status) */
 	/* file descriptor 관련 멤버 */
-	struct file** fdt;					/* "'파일의 주소값'들을 담은 배열"에 대한 주소값 */
-	int next_fd;						/* 새로운 파일을 open 시 그 파일에 부여할 fd 값 */
+	struct file** fdt;					/* "'파일의 주소값'들을 담은 배열"에 대한 주소값, fdt_cnt 칸 */
+	size_t fdt_cnt;						/* fdt의 칸 수: 모자라면 두 배로 늘림 */
+	uint64_t *fdt_map;					/* fd마다 1 bit: 사용 중이면 1 (가장 작은 빈 fd 찾기에 활용) */
+	uint64_t *fdt_cow;					/* fd마다 1 bit: 다른 process의 FDT도 가리키는 file이면 1 (처음 쓸 때 duplicate) */
+	struct fdt_share *fdt_share;		/* fork한 process들과 함께 쓰는 FDT, 아니면 NULL (userprog/syscall.c) */
 	int max_fd;							/* 파일이 들어가 있는 fd의 최대값 (fork, exit에서 활용) */
+	struct file *fdt_inline[FDT_INLINE_CNT]; /* 처음 fdt: 파일을 적게 여는 thread는 따로 할당하지 않음 */
+	uint64_t fdt_inline_map;			/* 처음 fdt_map */
+	uint64_t fdt_inline_cow;			/* 처음 fdt_cow */
+	struct lock fdt_lock;				/* fdt를 바꾸거나 읽는 동안 잡음: 같은 process의 thread들이 공유 (uthread_create) */
 	/* executable 관련 멤버 */
 	struct file* running_file;
 
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+
+	/* A process's threads share its address space, files and I/O
+	 * ring, which live in the thread that started the process, its
+	 * leader: see thread_leader().  Only the leader's fdt, spt,
+	 * stack_limit, io_ring and running_file are used. */
+	struct thread *leader;              /* Itself, or the process's leader. */
+	unsigned thread_cnt;                /* Of a leader: its threads, itself
+	                                       included, by disabling interrupts. */
+	bool killed;                        /* Of a leader: each of its threads is
+	                                       to exit(-1) on its way back to user
+	                                       mode (process_kill()). */
+	struct semaphore threads_exited;    /* Of a leader: up'd as one exits. */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
-	uintptr_t saved_sp;
-	
 	/* Saving rsp into struct thread on the initial transition
 	 * from user to kernel mode. */
+	uintptr_t saved_sp;
+	size_t stack_limit;                 /* Most bytes the stack may take. */
+	struct io_ring *io_ring;            /* User address of the I/O ring, or null. */
+	unsigned io_ring_entries;           /* Its size (userprog/ioring.c). */
 #endif
 
+	uint64_t pmu[PMU_CNT];              /* Events counted while running (threads/pmu.c). */
+	void *fpu;                          /* x87/SIMD save area, or null (threads/fpu.c). */
+	uint8_t *scratch;                   /* Scratch arena, or null (threads/scratch.c). */
+	size_t scratch_used;                /* Bytes of it allocated. */
+	size_t scratch_last;                /* Offset of its latest allocation. */
+	uint64_t sched[SCHED_STAT_CNT];     /* Scheduling statistics, SCHED_*. */
+	uint64_t state_tsc;                 /* TSC when status last changed. */
+	bool blocked_on_lock;               /* Blocked in lock_acquire()? */
+	bool woken;                         /* Unblocked and not run since? */
+	bool preempted;                     /* Being switched away by thread_preempt()? */
+	unsigned slice;                     /* Timer ticks in each time slice. */
+	bool boosted;                       /* Woken interactive, not run since? */
+	unsigned rcu_nesting;               /* Depth of RCU read-side sections. */
+	bool rcu_resched;                   /* Preempted in one, to yield at its end? */
+
 	/* Owned by thread.c. */
-	struct intr_frame tf;               /* Information for switching */
+	uintptr_t ksp;                      /* Kernel stack pointer while not
+	                                       running (threads/switch.S). */
 	unsigned magic;                     /* Detects stack overflow. */
-	struct list open_file;
-};
-
-struct thread_file {
-	struct file* file;
-	int fd;
-	struct list_elem elem;
-	//for stdin and stdout
-	int std;
 };
 
 
@@ -168,6 +244,10 @@ struct thread_file {
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, time slices adapt to how threads use them.  Controlled by
+   kernel command-line option "-adaptive". */
+extern bool thread_adaptive;
+
 void thread_init (void);
 void thread_start (void);
 
@@ -184,25 +264,45 @@ struct thread *thread_current (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
+struct thread *thread_running (void);
+#ifdef USERPROG
+struct thread *thread_leader (void);
+#endif
+
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_resched (void);
+bool thread_sched_stats (tid_t tid, uint64_t stats[SCHED_STAT_CNT]);
 
-void thread_sleep(int64_t ticks);
-void thread_awake(int64_t ticks);
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, void *);
 
-int64_t get_next_tick_to_awake(void);
-void update_next_tick_to_awake(int64_t ticks);
+void thread_sleep(int64_t ticks);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+bool thread_set_affinity (unsigned mask);
+bool thread_set_deadline (int64_t runtime, int64_t deadline, int64_t period);
+int64_t thread_set_timer_slack (int64_t ns);
 
 // function for Priority Scheduling 
 void test_max_priority (void);
 bool thread_compare_priority (const struct list_elem *a, const struct list_elem *b, void *aux);
-bool thread_compare_donate_priority (const struct list_elem *a, const struct list_elem *b, void *aux);
 
-void donate_priority (void);
+/* Lists of threads through ELEM by descending priority, as with
+   thread_compare_priority(), but with the comparison inlined:
+   thread_prio_insert_ordered() and thread_prio_sort(), for the
+   waiters of every semaphore, lock and condition. */
+#define THREAD_PRIO_MORE(A, B) ((A)->priority > (B)->priority)
+LIST_ORDERED_DEFINE (thread_prio, struct thread, elem, THREAD_PRIO_MORE)
+
+void donate_priority (struct thread *t);
+void thread_hold_lock (struct thread *t, struct lock *lock);
 void remove_with_lock (struct lock *lock);
+void thread_own_sema (struct thread *t, struct semaphore *sema);
+void thread_disown_sema (struct semaphore *sema);
 void refresh_priority(void);
 
 int thread_get_nice (void);
@@ -0,0 +1,48 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kinds of trace records, and what their ARG, A and B hold. */
+enum trace_event {
+	TRACE_SWITCH,               /* A: tid switched to. */
+	TRACE_LOCK_WAIT,            /* A: lock, B: holder's tid. */
+	TRACE_FAULT,                /* ARG: FAULT_*, A: address, B: cycles. */
+	TRACE_EVICT,                /* A: user page, B: owner's tid. */
+	TRACE_DISK,                 /* ARG: block device number, in
+	                               registration order, plus
+	                               TRACE_DISK_WRITE if writing,
+	                               A: first sector, B: sector count. */
+	TRACE_SYSCALL,              /* ARG: number, A: cycles. */
+	TRACE_EVENT_CNT
+};
+
+#define TRACE_DISK_WRITE 0x100
+
+/* A trace record: 32 bytes, stamped with the TSC and the tid of the
+   running thread. */
+struct trace_rec {
+	uint64_t tsc;
+	uint16_t event;             /* enum trace_event. */
+	uint16_t arg;
+	int32_t tid;
+	uint64_t a;
+	uint64_t b;
+};
+
+/* Set by the -trace kernel option. */
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_event, uint16_t arg, uint64_t a, uint64_t b);
+void trace_dump (void);
+
+/* Records EVENT if tracing, at the cost of a test if not. */
+static inline void
+trace (enum trace_event event, uint16_t arg, uint64_t a, uint64_t b) {
+	if (trace_enabled)
+		trace_record (event, arg, a, b);
+}
+
+#endif /* threads/trace.h */
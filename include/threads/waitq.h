@@ -0,0 +1,58 @@
+#ifndef THREADS_WAITQ_H
+#define THREADS_WAITQ_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Wait queues: waiting for any of several objects to become ready.
+
+   An object that a thread may want to wait on, a pipe or the
+   console input, has a struct waitq and calls waitq_wake() whenever
+   it may have become ready, e.g. when data arrives.  A poller, a
+   thread waiting on some of them at once, adds one struct
+   waitq_entry per object with poller_add(), checks each object,
+   and if none is ready, sleeps in poller_wait() until one of them
+   wakes it or a deadline passes.  A wake between the check and the
+   sleep is not lost, as the entry was added before the check.
+
+   Wait queues may be woken from interrupt handlers; interrupts are
+   off whenever their lists are looked at. */
+
+/* Event bits of a wait, the same as in lib/user/syscall.h. */
+#define POLLIN 0x01             /* Reading would not block. */
+#define POLLOUT 0x04            /* Writing would not block. */
+#define POLLERR 0x08            /* Writing fails: no one reads. */
+#define POLLHUP 0x10            /* No one writes any more. */
+#define POLLNVAL 0x20           /* Not an open file descriptor. */
+
+struct waitq {
+	struct list entries;        /* struct waitq_entry. */
+};
+
+/* A thread waiting on wait queues, on its stack. */
+struct poller {
+	struct thread *thread;      /* Blocked in poller_wait(), or null. */
+	bool woken;                 /* Woken since the last poller_wait(). */
+	bool timed_out;             /* Its deadline passed. */
+	struct timer_event timer;   /* For the deadline. */
+};
+
+/* A poller's place on one wait queue. */
+struct waitq_entry {
+	struct poller *poller;      /* Null if on no queue. */
+	struct list_elem elem;      /* Element in the queue's entries. */
+};
+
+void waitq_init (struct waitq *);
+void waitq_wake (struct waitq *);
+void waitq_destroy (struct waitq *);
+
+void waitq_entry_init (struct waitq_entry *);
+void poller_init (struct poller *);
+void poller_add (struct poller *, struct waitq_entry *, struct waitq *);
+void poller_remove (struct waitq_entry *);
+bool poller_wait (struct poller *, int64_t deadline);
+
+#endif /* threads/waitq.h */
@@ -0,0 +1,50 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+/* Work queue: deferred and background work, run on a fixed pool
+   of kernel worker threads instead of a daemon per subsystem.
+
+   A work item is a function to call, queued with work_queue() or,
+   after a delay, with work_queue_delayed().  Workers take queued
+   items highest priority first, and run each at its priority.  An
+   item is queued at most once: queueing it again while it waits
+   does nothing, and while it runs makes it run once more when it
+   is done, so it never runs on two workers at once.  Items may be
+   queued from interrupt handlers.
+
+   The caller owns struct work, which must not go away while the
+   item is queued, delayed or running: cancel it with
+   work_cancel(), then wait for it with work_flush().  In
+   particular, the function must not free its own item. */
+typedef void work_func (void *aux);
+
+struct work {
+	work_func *func;
+	void *aux;
+	int priority;               /* Thread priority to run at. */
+	struct list_elem elem;      /* Element in the queue, by priority. */
+	bool pending;               /* In the queue. */
+	bool running;               /* Being run by a worker. */
+	bool rerun;                 /* Queued again while running. */
+	struct timer_event timer;   /* Delay of work_queue_delayed(). */
+	unsigned flusher_cnt;       /* Threads waiting in work_flush(). */
+	struct semaphore flushed;   /* Up'd once per flusher when idle. */
+};
+
+void workqueue_init (void);
+void workqueue_print_stats (void);
+
+void work_init (struct work *, work_func *, void *aux, int priority);
+bool work_queue (struct work *);
+bool work_queue_delayed (struct work *, int64_t ticks);
+bool work_cancel (struct work *);
+void work_flush (struct work *);
+bool work_is_busy (const struct work *);
+
+#endif /* threads/workqueue.h */
@@ -0,0 +1,37 @@
+#ifndef USERPROG_EXEC_CACHE_H
+#define USERPROG_EXEC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* Most PT_LOAD segments an image may have to be cached. */
+#define EXEC_SEGMENT_MAX 8
+
+/* A PT_LOAD segment that passed validation, as load_segment() takes
+ * it. */
+struct exec_segment {
+	uint64_t file_page;         /* Page-aligned offset in the file. */
+	uint64_t mem_page;          /* Page-aligned user address. */
+	uint32_t read_bytes;
+	uint32_t zero_bytes;
+	bool writable;
+};
+
+/* What load() learns from an executable's headers. */
+struct exec_image {
+	uintptr_t entry;                    /* Entry point. */
+	size_t stack_size;                  /* PT_STACK's size, or 0. */
+	uintptr_t end;                      /* Page past the highest segment. */
+	size_t segment_cnt;                 /* Number of PT_LOAD segments. */
+	struct exec_segment segments[EXEC_SEGMENT_MAX];
+};
+
+void exec_cache_init (void);
+bool exec_cache_lookup (disk_sector_t, struct exec_image *, uint64_t *gen);
+void exec_cache_insert (disk_sector_t, const struct exec_image *,
+		uint64_t gen);
+void exec_cache_invalidate (disk_sector_t);
+
+#endif /* userprog/exec_cache.h */
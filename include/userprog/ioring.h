@@ -0,0 +1,13 @@
+#ifndef USERPROG_IORING_H
+#define USERPROG_IORING_H
+
+#include <stddef.h>
+
+struct thread;
+
+void *io_ring_setup (void *addr, unsigned entries);
+int io_ring_enter (unsigned to_submit);
+void io_ring_fork (struct thread *child, const struct thread *parent);
+void io_ring_reset (struct thread *);
+
+#endif /* userprog/ioring.h */
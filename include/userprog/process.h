@@ -1,13 +1,49 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <stddef.h>
+#include "threads/synch.h"
 #include "threads/thread.h"
 
+/* parent가 child process마다 가지는 종료 정보
+	- child의 thread page는 child가 종료되면 곧바로 해제되고, 이것만 남음
+	- parent와 child가 하나씩 reference를 가지며, 나중에 놓는 쪽이 해제
+ */
+struct child_info {
+	tid_t tid;
+	int exit_status;                    /* child가 종료될 때 기록 */
+	bool started;                       /* fork 또는 spawn의 load가 성공했는지 여부 */
+	struct semaphore fork_sema;         /* child가 fork 또는 load를 마치면 up */
+	struct semaphore exit_sema;         /* child가 종료되면 up */
+	int ref_cnt;                        /* 0, 1, 2 */
+	struct thread *parent;              /* parent가 종료되면 NULL */
+	struct hash_elem elem;              /* parent의 children에 연결되는 노드 */
+	struct list_elem exit_elem;         /* parent의 exited_children에 연결되는 노드 */
+};
+
+extern size_t process_stack_pages;
+
+void process_child_info_init (void);
+struct child_info *process_child_info_create (void);
+void process_add_child (struct child_info *, struct thread *);
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
+tid_t process_spawn (char *cmd_line, const int *fds, int fd_cnt);
+void process_template_init (void);
+int process_template_create (const char *name, struct intr_frame *if_);
+tid_t process_template_spawn (const char *name);
+bool process_template_destroy (const char *name);
+tid_t process_uthread_create (void *entry, uint64_t arg0, uint64_t arg1,
+		void *stack);
 int process_exec (void *f_name);
 int process_wait (tid_t);
+tid_t process_wait_any (int *status);
 void process_exit (void);
+void process_kill (struct thread *leader);
+void process_exit_if_killed (void);
+bool process_reaping (void);
+void process_reap_flush (void);
+void process_print_reap_stats (void);
 void process_activate (struct thread *next);
 void argument_stack(char **argv, const int argc, struct intr_frame *if_);
 
@@ -2,29 +2,73 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "filesys/off_t.h"
+
+struct iovec;
+struct pollfd;
+struct syscall_stat;
+struct fault_stat;
+struct dirent;
+struct dirstat;
+
 void syscall_init (void);
+void syscall_print_stats (void);
+int _syscall_stats (struct syscall_stat *buf, int cnt);
+int _fault_stats (struct fault_stat *buf, int cnt, bool self);
+int _pmu_stats (uint64_t *buf, int cnt, bool self);
+int _sched_stats (tid_t tid, uint64_t *buf, int cnt);
+int _disk_stats (const char *name, uint64_t *buf, int cnt);
+int _rgroup_create (const char *name, unsigned cpu_weight, unsigned io_weight,
+		size_t frame_max);
+int _rgroup_stats (int id, uint64_t *buf, int cnt);
 
-void check_address(const char *addr);
+char *copy_in_string (const char *ustr);
 int process_add_file (struct file *file);
 struct file *process_get_file (int fd);
-void process_close_file (int fd);
+struct file *process_close_file (int fd);
+int process_next_fd (struct thread *);
+bool process_grow_fdt (size_t cnt);
+void process_free_fdt (struct thread *);
+bool process_share_fdt (struct thread *parent, struct thread *child);
+void process_release_fdt (struct thread *);
 
 void _halt (void);
 void _exit (int status);
 int _wait (tid_t pid);
+tid_t _wait_any (int *status);
 tid_t _fork (const char* thread_name, struct intr_frame *if_);
 int _exec (const char *file);
+tid_t _spawn (const char *cmd_line, const int *fds, int fd_cnt);
+int _template_create (const char *name, struct intr_frame *if_);
+tid_t _template_spawn (const char *name);
+bool _template_destroy (const char *name);
+tid_t _uthread_create (void *entry, uint64_t arg0, uint64_t arg1, void *stack);
 
 bool _create (const char *file_name, unsigned initial_size);
 bool _remove (const char *file_name);
 int _open (const char *file_name);
+int _open_flags (const char *file_name, int flags);
+int _mount (const char *path, int chan_no, int dev_no);
+int _umount (const char *path);
+int _symlink (const char *target, const char *linkpath);
+int _getdents (const char *path, unsigned *pos, struct dirent *entries,
+		int cnt);
+int _dirstat (const char *path, unsigned *pos, struct dirstat *entries,
+		int cnt);
 int _read (int fd, void *buffer, unsigned size);
+int _poll (struct pollfd *fds, unsigned nfds, int timeout);
 int _filesize (int fd);
 int _write (int fd, const void *buffer, unsigned size);
+int _pread (int fd, void *buffer, unsigned size, off_t offset);
+int _pwrite (int fd, const void *buffer, unsigned size, off_t offset);
+int _readv (int fd, const struct iovec *iov, int iovcnt);
+int _writev (int fd, const struct iovec *iov, int iovcnt);
+int _sendfile (int out_fd, int in_fd, off_t *offset, unsigned count);
 void _close (int fd);
+int _dup2 (int oldfd, int newfd);
+int _pipe (int *fds);
+int _fsync (int fd);
 void _seek (int fd, unsigned position);
 unsigned _tell (int fd);
 
-struct lock filesys_lock; // use global lock to avoid race condition on file
-
 #endif /* userprog/syscall.h */
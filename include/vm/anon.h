@@ -4,15 +4,37 @@
 
 #define INVALID_SLOT_IDX SIZE_MAX
 
+/* Most pages swapped out or read around together. */
+#define SWAP_CLUSTER_MAX 8
+
 struct page;
 enum vm_type;
 
 struct anon_page {
     struct thread* owner;
     size_t swap_slot_idx;
+    struct load_info *text;     /* Read-only executable segment the page
+                                   is a copy of, or null; see
+                                   anon_swap_out(). */
+    size_t cache_slot_idx;      /* Slot still holding a copy of the
+                                   resident page, or INVALID_SLOT_IDX;
+                                   see swap_read(). */
+    struct list_elem cache_elem; /* Element in swap_cache. */
 };
 
 void vm_anon_init (void);
+bool vm_swap_add (const char *spec);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+bool anon_swap_copy (struct page *page, void *kva);
+struct load_info *anon_text (struct page *page);
+size_t anon_swap_slot (struct page *page);
+bool anon_swap_cached (struct page *page);
+bool anon_swap_out_cluster (struct page **pages, size_t n);
+void anon_swap_in_cluster (struct page **pages, void **kvas, size_t n);
+size_t anon_slot_alloc (void);
+void anon_slot_write (size_t slot_idx, const void *kva);
+void anon_slot_read (size_t slot_idx, void *kva);
+void anon_slot_free (size_t slot_idx);
+void anon_print_stats (void);
 
 #endif
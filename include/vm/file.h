@@ -18,9 +18,28 @@ struct mmap_info{
 	size_t read_bytes;
 };
 
+/* Object cache of struct mmap_info. */
+extern struct kmem_cache *mmap_info_slab;
+
+/* A region mapped by one mmap() call, removed as a whole by munmap(). */
+struct mmap_region {
+	struct list_elem elem;   /* Element in spt's mmaps. */
+	void *addr;              /* First page. */
+	size_t page_cnt;         /* Number of pages. */
+	struct file *file;       /* Reopened file, shared by the pages, or
+	                            null for an anonymous mapping. */
+	struct vma vma;          /* Area the pages are created from. */
+};
+
+struct supplemental_page_table;
+
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+void *do_mremap (void *old, size_t old_len, size_t new_len, int flags);
+bool mmap_copy (struct supplemental_page_table *src);
+void mmap_region_unmap (struct supplemental_page_table *,
+		struct mmap_region *);
 #endif
@@ -0,0 +1,35 @@
+#ifndef VM_REPLACE_H
+#define VM_REPLACE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct frame;
+
+/* A page replacement policy: decides which frame vm_evict_frame()
+ * reclaims.  The frame table calls every hook with clock_lock held,
+ * and only ever passes frames of the table given to init(). */
+struct replace_policy {
+	const char *name;
+	/* Sets up for the CNT frames of TABLE.  Called once, at boot. */
+	void (*init) (struct frame *table, size_t cnt);
+	/* FRAME now holds a loaded page and may be evicted. */
+	void (*insert) (struct frame *);
+	/* A fault showed FRAME's page in use.  May be null. */
+	void (*access) (struct frame *);
+	/* FRAME may no longer be evicted: its page is being evicted or
+	 * freed. */
+	void (*remove) (struct frame *);
+	/* Returns an evictable frame to reclaim, without removing it, or
+	 * a null pointer if none is found in reasonable time. */
+	struct frame *(*select_victim) (void);
+};
+
+/* Policy in use.  Chosen with -vmrp on the kernel command line. */
+extern const struct replace_policy *replace_policy;
+
+bool replace_policy_select (const char *name);
+bool frame_test_and_clear_accessed (struct frame *);
+bool frame_is_evictable_shared (const struct frame *);
+bool frame_quota_evictable (const struct frame *);
+
+#endif /* vm/replace.h */
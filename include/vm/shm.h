@@ -0,0 +1,49 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+#include <stddef.h>
+#include <list.h>
+#include "threads/synch.h"
+
+struct page;
+struct frame;
+struct supplemental_page_table;
+
+/* An anonymous shared memory segment, named by a key.  Its pages
+ * live in frames of the frame table that every process attaching it
+ * maps, or in swap, and are zero until first written.  It goes away
+ * when the last attachment is detached. */
+struct shm {
+	int key;
+	size_t page_cnt;
+	unsigned attach_cnt;        /* Number of attachments, by shm_lock. */
+	struct list_elem elem;      /* Element in the list of segments. */
+
+	/* Serializes faults on the segment's pages with their eviction.
+	 * Protects the following, one element per page. */
+	struct lock lock;
+	struct frame **frames;      /* Frame holding the page, or null. */
+	size_t *slots;              /* Swap slot holding the page, or
+	                               INVALID_SLOT_IDX. */
+};
+
+/* A page of a segment, as attached by one process. */
+struct shm_page {
+	struct shm *shm;
+	size_t idx;                 /* Page number within SHM. */
+};
+
+/* A segment attached by one process; kept in its spt's shms. */
+struct shm_region {
+	struct list_elem elem;
+	void *addr;                 /* First page. */
+	size_t page_cnt;            /* Number of pages attached. */
+	struct shm *shm;
+};
+
+void vm_shm_init (void);
+void *shm_attach (void *addr, int key, size_t length);
+void shm_detach (void *addr);
+void shm_region_detach (struct supplemental_page_table *,
+		struct shm_region *);
+bool shm_copy (struct supplemental_page_table *src);
+#endif
@@ -2,7 +2,9 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "devices/block.h"
 #include "lib/kernel/hash.h"
+#include "threads/synch.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -13,6 +15,8 @@ enum vm_type {
 	VM_FILE = 2,
 	/* page that hold the page cache, for project 4 */
 	VM_PAGE_CACHE = 3,
+	/* page of an anonymous shared memory segment */
+	VM_SHM = 4,
 
 	/* Bit flags to store state */
 
@@ -27,13 +31,17 @@ enum vm_type {
 
 #include "vm/uninit.h"
 #include "vm/anon.h"
+#include "vm/vma.h"
 #include "vm/file.h"
+#include "vm/shm.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
 
 struct page_operations;
 struct thread;
+struct fault_stat;
+struct rgroup;
 
 #define VM_TYPE(type) ((type) & 7)
 
@@ -49,25 +57,58 @@ struct page {
 	/* Your implementation */
 	struct hash_elem hash_elem;
 	bool writable;
+	struct thread *owner;          /* Thread whose page table maps VA. */
+	struct list_elem frame_elem;   /* Element in frame's reverse map. */
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
 	union {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
+		struct shm_page shm;
 #ifdef EFILESYS
 		struct page_cache page_cache;
 #endif
 	};
 };
 
+/* Names the contents of a read-only executable page: the bytes it
+ * holds of which file. */
+struct text_key {
+	disk_sector_t inumber; /* Executable's inode sector. */
+	off_t ofs;             /* Offset of the page in the executable. */
+	size_t read_bytes;     /* Bytes read from there; the rest is zero. */
+};
+
+/* Names a page of a file: the PGSIZE bytes at page-aligned OFS of
+ * the file whose inode is at sector INUMBER. */
+struct file_key {
+	disk_sector_t inumber; /* File's inode sector. */
+	off_t ofs;             /* Offset of the page in the file. */
+};
+
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
-
-	/* elem for frame_list */
-	struct list_elem elem;
+	struct page *page;     /* Primary mapping, the one to evict. */
+	int ref_cnt;           /* Number of pages mapping KVA. */
+	struct list pages;     /* Reverse map: all pages mapping KVA. */
+	bool evictable;        /* True if the policy may pick this frame. */
+	struct list_elem replace_elem;  /* Element in a policy's queue. */
+	int replace_queue;     /* Policy's queue holding the frame. */
+	bool text;             /* True if in the text cache under TEXT_KEY. */
+	struct text_key text_key;
+	struct hash_elem text_elem;     /* Element in the text cache. */
+	bool cached;           /* True if in the file cache under FILE_KEY. */
+	struct file_key file_key;
+	struct hash_elem file_elem;     /* Element in the file cache. */
+	bool huge;             /* True if mapped by part of a 2 MB page. */
+	bool merged;           /* True if in the stable table of same-page
+	                          merging, and so read-only to every page. */
+	unsigned pin_cnt;      /* Nesting of vm_pin_range(): neither evicted
+	                          nor merged while nonzero. */
+	uint64_t ksm_hash;     /* Hash of the contents when last scanned. */
+	struct hash_elem ksm_elem;      /* Element in the stable table. */
 };
 
 /* The function table for page operations.
@@ -91,34 +132,135 @@ struct page_operations {
  * All designs up to you for this. */
 struct supplemental_page_table {
 	struct hash* page_table;
+	struct list mmaps;     /* Mapped regions, struct mmap_region. */
+	struct list shms;      /* Attached segments, struct shm_region. */
+	struct vma *vma_root;  /* Treap of areas, by address. */
+	struct list vmas;      /* All areas, struct vma. */
+	void *stack_bottom;    /* Lowest page of the stack in page_table. */
+	void *heap_start;      /* Page past the executable, where the heap
+	                          of sbrk() starts. */
+	void *brk;             /* End of the heap, the program break. */
+	struct vma *heap;      /* Area of the heap's pages, or null while
+	                          the heap is empty. */
+
+	/* Serializes the threads of the process on the table: page faults
+	 * take it, and so do the system calls that change the table, with
+	 * vm_lock().  Initialized with the thread, as it outlives exec. */
+	struct lock lock;
+
+	/* Resident set, in frames on the replacement policy whose
+	 * primary mapping is in this table, and its working set estimate.
+	 * Protected by the frame table's lock. */
+	size_t rss;
+	size_t wss;
+	size_t rss_min;        /* Frames kept under memory pressure. */
+	size_t rss_max;        /* Most frames held, or 0 for no limit. */
+
+	/* Eviction exclusion, by the frame table's lock.  No frame mapped
+	 * by a frozen table is picked for eviction; EVICTING counts the
+	 * evictions of this table's unshared frames in flight. */
+	unsigned frozen;       /* Nesting of spt_freeze(). */
+	unsigned evicting;
+
+	/* Pages swapped out since the table was last packed, by
+	 * vm_pack_swapped(), with interrupts off. */
+	size_t swapped;
+
+	/* Page faults taken, FAULT_CLASS_CNT classes, or null. */
+	struct fault_stat *faults;
 };
 
+/* Object caches of struct page and struct load_info.  Objects from
+ * them may also be returned with free(). */
+struct kmem_cache;
+extern struct kmem_cache *page_slab;
+extern struct kmem_cache *load_info_slab;
+
+/* Back large aligned anonymous areas with 2 MB pages.  Set with -vmhp
+ * on the kernel command line. */
+extern bool vm_huge_pages;
+
+/* Keep each process's estimated working set resident under memory
+ * pressure, as if it were its minimum frame quota.  Set with -vmws on
+ * the kernel command line. */
+extern bool vm_working_set;
+
+/* Merge anonymous frames of identical contents in the background.
+ * Set with -vmksm on the kernel command line. */
+extern bool vm_ksm;
+
+/* Stack limit a process starts with, and the most it may set, in
+ * bytes.  The page below the limit is a guard: growing the stack into
+ * it kills the process. */
+#define STACK_LIMIT_DEFAULT (1 << 20)
+#define STACK_LIMIT_MAX (8 << 20)
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src);
+void supplemental_page_table_unmap (struct supplemental_page_table *spt);
 void supplemental_page_table_kill (struct supplemental_page_table *spt);
+bool vm_stack_reserved (const void *addr, size_t length);
+bool vm_set_stack_limit (size_t limit);
+void vm_heap_init (void *start);
+void *vm_sbrk (intptr_t increment);
+bool vm_load_zero (struct page *page, void *aux);
+void vm_populate (void *addr, size_t length);
+bool vm_pin_range (const void *addr, size_t size, bool write);
+void vm_unpin_range (const void *addr, size_t size);
+bool vm_set_frame_quota (size_t min, size_t max);
+size_t vm_rss (void);
+void vm_rgroup_move (struct thread *leader, struct rgroup *);
 struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct page *vm_page_from_swap (struct supplemental_page_table *spt,
+		void *va, size_t slot, bool writable);
+void vm_drop_swapped (void *va);
+void spt_freeze (struct supplemental_page_table *spt);
+void spt_thaw (struct supplemental_page_table *spt);
+bool spt_is_frozen (const struct supplemental_page_table *spt);
+void vm_lock (void);
+void vm_unlock (void);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
+void vm_fault_stats (struct fault_stat *buf, bool self);
+void vm_print_fault_stats (void);
+void vm_print_process_stats (void);
+void vm_print_ksm_stats (void);
+bool vm_compact (unsigned order);
+void vm_print_compact_stats (void);
 
 #define vm_alloc_page(type, upage, writable) \
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
+void vm_free_frame (struct page *page);
+bool frame_test_and_clear_dirty (struct frame *);
 bool vm_claim_page (void *va);
+int vm_madvise (void *addr, size_t length, int advice);
 enum vm_type page_get_type (struct page *page);
+void vm_file_cache_read (disk_sector_t inumber, void *buffer, off_t size,
+		off_t ofs);
+void vm_file_cache_write (disk_sector_t inumber, const void *buffer,
+		off_t size, off_t ofs);
+void vm_text_forget (disk_sector_t inumber);
 
+/* What the not yet loaded pages of an executable segment's area load
+ * from.  One is shared by all such pages of the area and by the area
+ * itself, each holding a reference; only the owning process touches
+ * it. */
 struct load_info{
-	struct file *file;
-	off_t ofs;
-	size_t page_read_bytes;
-	size_t page_zero_bytes;
+	struct file *file;     /* The area's file, shared by file_dup(). */
+	off_t ofs;             /* Offset of START's data in FILE. */
+	void *start;           /* First page of the area. */
+	size_t read_bytes;     /* Bytes of FILE mapped; the rest is zero. */
+	size_t fault_around;   /* Following pages to load on a fault. */
+	unsigned ref_cnt;      /* Number of references. */
 };
 #endif  /* VM_VM_H */
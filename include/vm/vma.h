@@ -0,0 +1,53 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <list.h>
+#include "filesys/off_t.h"
+#include "vm/vm.h"
+
+struct supplemental_page_table;
+struct file;
+
+/* A virtual memory area: a page-aligned range of a process's address
+ * space whose pages are all set up alike, from the same file.  The
+ * struct page of a page in the range is created only when the page is
+ * first touched.  The areas of a process do not overlap. */
+struct vma {
+	void *start;                /* First page. */
+	void *end;                  /* Page past the last one. */
+	enum vm_type type;          /* Type of the pages, VM_ANON or VM_FILE. */
+	bool writable;
+	vm_initializer *init;       /* Loads a page; gets an aux from the
+	                               area's type. */
+	struct file *file;          /* File the pages are loaded from, or null
+	                               if they start out zero, as the heap's. */
+	off_t ofs;                  /* Offset of START's data in FILE. */
+	size_t read_bytes;          /* Bytes of FILE mapped; the rest is zero. */
+	size_t fault_around;        /* For load_info of VM_ANON areas. */
+	struct load_info *li;       /* Of a VM_ANON area, once made. */
+	int advice;                 /* MADV_NORMAL, MADV_SEQUENTIAL or
+	                               MADV_RANDOM, from madvise(). */
+	bool mmap;                  /* Of a region of mmap(), in spt's mmaps. */
+
+	struct list_elem elem;      /* Element in spt's vmas. */
+	struct vma *left, *right;   /* Children in spt's treap, by START. */
+	unsigned long prio;         /* Treap heap priority. */
+};
+
+void vma_tree_init (struct supplemental_page_table *);
+bool vma_insert (struct supplemental_page_table *, struct vma *);
+void vma_remove (struct supplemental_page_table *, struct vma *);
+struct vma *vma_find (struct supplemental_page_table *, void *va);
+bool vma_range_is_free (struct supplemental_page_table *,
+		void *addr, size_t length);
+void *vma_find_gap (struct supplemental_page_table *, void *addr,
+		size_t length);
+struct page *vma_materialize (struct supplemental_page_table *, void *va);
+
+struct load_info *vma_load_info (struct vma *);
+void load_info_release (struct load_info *);
+void load_info_page (const struct load_info *, const void *va,
+		off_t *ofs, size_t *read_bytes);
+
+#endif /* vm/vma.h */
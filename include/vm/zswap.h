@@ -0,0 +1,17 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most memory the compressed swap cache may take, in percent of the
+ * user pool; 0 turns it off.  Set with -zswap on the kernel command
+ * line. */
+extern unsigned zswap_max_percent;
+
+void zswap_init (size_t slot_cnt);
+bool zswap_store (size_t slot_idx, const void *kva);
+bool zswap_load (size_t slot_idx, void *kva);
+void zswap_invalidate (size_t slot_idx);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */
@@ -63,6 +63,57 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type in which the bits corresponding to bits
+   START through END - 1 of the element containing START are set,
+   END being no further than the start of the next element. */
+static inline elem_type
+range_mask (size_t start, size_t end) {
+	size_t lo = start % ELEM_BITS;
+	size_t hi = end - (start - lo);
+
+	ASSERT (start < end && hi <= ELEM_BITS);
+	return (hi == ELEM_BITS ? (elem_type) -1 : ((elem_type) 1 << hi) - 1)
+		& ((elem_type) -1 << lo);
+}
+
+/* Returns the number of set bits in X.  __builtin_popcountl()
+   would call into libgcc, which the kernel does not link, unless
+   built for CPUs with the POPCNT instruction. */
+static inline size_t
+elem_popcount (elem_type x) {
+	x = x - ((x >> 1) & 0x5555555555555555UL);
+	x = (x & 0x3333333333333333UL) + ((x >> 2) & 0x3333333333333333UL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (x * 0x0101010101010101UL) >> 56;
+}
+
+/* Returns the end of the element containing bit START, capped at
+   END. */
+static inline size_t
+elem_end (size_t start, size_t end) {
+	size_t next = (elem_idx (start) + 1) * ELEM_BITS;
+	return next < end ? next : end;
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.  Skips
+   whole elements that hold no such bit. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value) {
+	while (start < end) {
+		size_t stop = elem_end (start, end);
+		elem_type bits = b->bits[elem_idx (start)];
+
+		if (!value)
+			bits = ~bits;
+		bits &= range_mask (start, stop);
+		if (bits != 0)
+			return elem_idx (start) * ELEM_BITS + __builtin_ctzl (bits);
+		start = stop;
+	}
+	return end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -197,47 +248,59 @@ bitmap_set_all (struct bitmap *b, bool value) {
 /* Sets the CNT bits starting at START in B to VALUE. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
+	size_t end = start + cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (start < end) {
+		size_t stop = elem_end (start, end);
+		elem_type mask = range_mask (start, stop);
+		elem_type *elem = &b->bits[elem_idx (start)];
+
+		/* A whole element is stored at once, which is atomic
+		   too; parts of one are set as in bitmap_mark(). */
+		if (mask == (elem_type) -1)
+			*elem = value ? mask : 0;
+		else if (value)
+			asm ("lock orq %1, %0" : "+m" (*elem) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "+m" (*elem) : "r" (~mask) : "cc");
+		start = stop;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t true_cnt = 0;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	while (start < end) {
+		size_t stop = elem_end (start, end);
+
+		true_cnt += elem_popcount (b->bits[elem_idx (start)]
+				& range_mask (start, stop));
+		start = stop;
+	}
+	return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return find_next (b, start, start + cnt, value) != start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -266,22 +329,45 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Each candidate group is tried from the first bit set to VALUE on,
+   and a bit set to !VALUE within it skips past the bit, so that
+   every bit is looked at about once, a whole element at a time. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt == 0)
+		return start;
+	while (cnt <= b->bit_cnt - start) {
+		size_t end;
+
+		start = find_next (b, start, b->bit_cnt - cnt + 1, value);
+		if (start > b->bit_cnt - cnt)
+			break;
+		end = find_next (b, start, start + cnt, !value);
+		if (end == start + cnt)
+			return start;
+		start = end + 1;
 	}
 	return BITMAP_ERROR;
 }
 
+/* Like bitmap_scan(), but if there is no such group at or after
+   START, goes on to look from the start of B, so that a caller
+   passing the end of the group it found last allocates next-fit,
+   spreading its groups over B instead of crowding its start. */
+size_t
+bitmap_scan_next_fit (const struct bitmap *b, size_t start, size_t cnt,
+		bool value) {
+	size_t idx = bitmap_scan (b, start, cnt, value);
+
+	if (idx == BITMAP_ERROR && start > 0)
+		idx = bitmap_scan (b, 0, cnt, value);
+	return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -296,6 +382,17 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value) {
 		bitmap_set_multiple (b, idx, cnt, !value);
 	return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but finds the group as
+   bitmap_scan_next_fit() does. */
+size_t
+bitmap_scan_and_flip_next_fit (struct bitmap *b, size_t start, size_t cnt,
+		bool value) {
+	size_t idx = bitmap_scan_next_fit (b, start, cnt, value);
+	if (idx != BITMAP_ERROR)
+		bitmap_set_multiple (b, idx, cnt, !value);
+	return idx;
+}
 
 /* File input and output. */
 
@@ -310,21 +407,61 @@ bitmap_file_size (const struct bitmap *b) {
    otherwise. */
 bool
 bitmap_read (struct bitmap *b, struct file *file) {
+	return bitmap_read_at (b, file, 0);
+}
+
+/* Writes B to FILE.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write (const struct bitmap *b, struct file *file) {
+	return bitmap_write_at (b, file, 0);
+}
+
+/* Writes to FILE the bytes of B that hold the CNT bits starting at
+   START, which must be in B, so that a change to a few bits does
+   not rewrite all of B.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+		size_t start, size_t cnt) {
+	return bitmap_write_range_at (b, file, 0, start, cnt);
+}
+
+/* Reads B from FILE, starting at byte OFS of FILE, where
+   bitmap_write_at() put it, as bitmap_read() does from the start
+   of FILE.  Several bitmaps may share a file that way. */
+bool
+bitmap_read_at (struct bitmap *b, struct file *file, off_t ofs) {
 	bool success = true;
 	if (b->bit_cnt > 0) {
 		off_t size = byte_cnt (b->bit_cnt);
-		success = file_read_at (file, b->bits, size, 0) == size;
+		success = file_read_at (file, b->bits, size, ofs) == size;
 		b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
 	}
 	return success;
 }
 
-/* Writes B to FILE.  Return true if successful, false
-   otherwise. */
+/* Writes B to FILE, starting at byte OFS of FILE. */
 bool
-bitmap_write (const struct bitmap *b, struct file *file) {
+bitmap_write_at (const struct bitmap *b, struct file *file, off_t ofs) {
 	off_t size = byte_cnt (b->bit_cnt);
-	return file_write_at (file, b->bits, size, 0) == size;
+	return file_write_at (file, b->bits, size, ofs) == size;
+}
+
+/* Like bitmap_write_range(), for B stored at byte OFS of FILE. */
+bool
+bitmap_write_range_at (const struct bitmap *b, struct file *file, off_t ofs,
+		size_t start, size_t cnt) {
+	off_t first, size;
+
+	ASSERT (start <= b->bit_cnt);
+	ASSERT (cnt <= b->bit_cnt - start);
+	if (cnt == 0)
+		return true;
+	first = start / CHAR_BIT;
+	size = DIV_ROUND_UP (start + cnt, CHAR_BIT) - first;
+	return file_write_at (file, (const uint8_t *) b->bits + first, size,
+			ofs + first) == size;
 }
 #endif /* FILESYS */
 
@@ -6,8 +6,10 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 static void vprintf_helper (char, void *);
+static void capture_helper (char, void *);
 static void putchar_have_lock (uint8_t c);
 
 /* The console lock.
@@ -59,6 +61,15 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* While CAPTURE_THREAD is not null, what it prints goes into the
+   CAPTURE_SIZE bytes of CAPTURE_BUF instead of the console, and what
+   does not fit is dropped.  CAPTURE_LEN bytes are there so far.
+   Other threads print as usual.  See console_capture(). */
+static struct thread *capture_thread;
+static char *capture_buf;
+static size_t capture_size;
+static size_t capture_len;
+
 /* Enable console locking. */
 void
 console_init (void) {
@@ -80,6 +91,36 @@ console_print_stats (void) {
 	printf ("Console: %lld characters output\n", write_cnt);
 }
 
+/* Sends what the running thread prints from now on into the SIZE
+   bytes of BUF, until console_capture_end(), so that statistics
+   printed by the usual functions can be shown elsewhere, e.g. in a
+   procfs file.  Only one thread captures at a time; the caller must
+   make sure of that. */
+void
+console_capture (char *buf, size_t size) {
+	ASSERT (capture_thread == NULL);
+	capture_buf = buf;
+	capture_size = size;
+	capture_len = 0;
+	capture_thread = thread_current ();
+}
+
+/* Ends console_capture() and returns the number of bytes stored in
+   its buffer. */
+size_t
+console_capture_end (void) {
+	ASSERT (capture_thread == thread_current ());
+	capture_thread = NULL;
+	return capture_len;
+}
+
+/* Returns true if what the running thread prints is captured. */
+static bool
+capturing (void) {
+	return capture_thread != NULL && !intr_context ()
+		&& capture_thread == thread_current ();
+}
+
 /* Acquires the console lock. */
 	static void
 acquire_console (void) {
@@ -118,6 +159,11 @@ int
 vprintf (const char *format, va_list args) {
 	int char_cnt = 0;
 
+	if (capturing ()) {
+		__vprintf (format, args, capture_helper, &char_cnt);
+		return char_cnt;
+	}
+
 	acquire_console ();
 	__vprintf (format, args, vprintf_helper, &char_cnt);
 	release_console ();
@@ -129,6 +175,14 @@ vprintf (const char *format, va_list args) {
    character. */
 int
 puts (const char *s) {
+	if (capturing ()) {
+		int char_cnt = 0;
+
+		while (*s != '\0')
+			capture_helper (*s++, &char_cnt);
+		capture_helper ('\n', &char_cnt);
+		return 0;
+	}
 	acquire_console ();
 	while (*s != '\0')
 		putchar_have_lock (*s++);
@@ -138,18 +192,27 @@ puts (const char *s) {
 	return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console, handing them
+   to the serial and vga layers all at once rather than one by one. */
 void
 putbuf (const char *buffer, size_t n) {
 	acquire_console ();
-	while (n-- > 0)
-		putchar_have_lock (*buffer++);
+	ASSERT (console_locked_by_current_thread ());
+	write_cnt += n;
+	serial_putbuf (buffer, n);
+	vga_putbuf (buffer, n);
 	release_console ();
 }
 
 /* Writes C to the vga display and serial port. */
 int
 putchar (int c) {
+	if (capturing ()) {
+		int char_cnt = 0;
+
+		capture_helper (c, &char_cnt);
+		return c;
+	}
 	acquire_console ();
 	putchar_have_lock (c);
 	release_console ();
@@ -165,6 +228,15 @@ vprintf_helper (char c, void *char_cnt_) {
 	putchar_have_lock (c);
 }
 
+/* Helper function for vprintf() while capturing. */
+static void
+capture_helper (char c, void *char_cnt_) {
+	int *char_cnt = char_cnt_;
+	(*char_cnt)++;
+	if (capture_len < capture_size)
+		capture_buf[capture_len++] = c;
+}
+
 /* Writes C to the vga display and serial port.
    The caller has already acquired the console lock if
    appropriate. */
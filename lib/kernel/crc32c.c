@@ -0,0 +1,75 @@
+#include "crc32c.h"
+#include <stdbool.h>
+#include "intrinsic.h"
+
+/* CRC-32C.
+
+   With SSE4.2, the crc32 instruction folds 8 bytes a cycle or so
+   into the CRC.  It works on general registers, so it needs none of
+   the SSE state the kernel, built with -mno-sse, never saves.
+   Without it, a table of the CRC of each byte value does a byte at
+   a time, several times faster than working bit by bit still. */
+
+/* Castagnoli's polynomial, bit-reversed. */
+#define CRC32C_POLY 0x82f63b78
+
+#define CPUID_1_ECX_SSE42 (1 << 20)
+
+static int have_sse42 = -1;     /* -1 until looked up. */
+static uint32_t table[256];     /* CRC of each byte, without SSE4.2. */
+
+static bool use_sse42 (void);
+static uint32_t crc_sse42 (uint32_t crc, const uint8_t *, size_t);
+static uint32_t crc_table (uint32_t crc, const uint8_t *, size_t);
+
+/* Returns CRC, the CRC-32C of data before, extended over the SIZE
+   bytes of BUF. */
+uint32_t
+crc32c (uint32_t crc, const void *buf, size_t size) {
+	crc = ~crc;
+	crc = use_sse42 () ? crc_sse42 (crc, buf, size)
+		: crc_table (crc, buf, size);
+	return ~crc;
+}
+
+/* Returns true if the processor has the crc32 instruction, filling
+   in the table the first time if it has not. */
+static bool
+use_sse42 (void) {
+	if (have_sse42 < 0) {
+		uint32_t eax, ebx, ecx, edx;
+		unsigned i, j;
+
+		cpuid (1, &eax, &ebx, &ecx, &edx);
+		if (!(ecx & CPUID_1_ECX_SSE42))
+			for (i = 0; i < 256; i++) {
+				uint32_t c = i;
+
+				for (j = 0; j < 8; j++)
+					c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+				table[i] = c;
+			}
+		have_sse42 = (ecx & CPUID_1_ECX_SSE42) != 0;
+	}
+	return have_sse42;
+}
+
+static uint32_t
+crc_sse42 (uint32_t crc, const uint8_t *p, size_t size) {
+	uint64_t c = crc;
+
+	for (; size > 0 && ((uintptr_t) p & 7) != 0; size--, p++)
+		__asm ("crc32b %1, %k0" : "+r" (c) : "rm" (*p));
+	for (; size >= 8; size -= 8, p += 8)
+		__asm ("crc32q %1, %0" : "+r" (c) : "rm" (*(const uint64_t *) p));
+	for (; size > 0; size--, p++)
+		__asm ("crc32b %1, %k0" : "+r" (c) : "rm" (*p));
+	return c;
+}
+
+static uint32_t
+crc_table (uint32_t crc, const uint8_t *p, size_t size) {
+	while (size-- > 0)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
@@ -42,3 +42,44 @@ debug_panic (const char *file, int line, const char *function,
 		power_off ();
 	for (;;);
 }
+
+/* Classes of DEBUG_ASSERT() checks made, DEBUG_* bits.  Set at boot
+   and only read after. */
+unsigned debug_checks;
+
+/* Enables the classes of checks named in the comma-separated list
+   NAMES: list, hash, synch, malloc, thread, or all.  Returns false,
+   enabling none, if a name is unknown. */
+bool
+debug_checks_parse (const char *names) {
+	static const struct {
+		const char *name;
+		unsigned bits;
+	} classes[] = {
+		{"list", DEBUG_LIST},
+		{"hash", DEBUG_HASH},
+		{"synch", DEBUG_SYNCH},
+		{"malloc", DEBUG_MALLOC},
+		{"thread", DEBUG_THREAD},
+		{"all", DEBUG_ALL},
+	};
+	unsigned bits = 0;
+
+	while (*names != '\0') {
+		size_t len = strcspn (names, ",");
+		size_t i;
+
+		for (i = 0; i < sizeof classes / sizeof *classes; i++)
+			if (strlen (classes[i].name) == len
+					&& !memcmp (classes[i].name, names, len))
+				break;
+		if (i == sizeof classes / sizeof *classes)
+			return false;
+		bits |= classes[i].bits;
+		names += len;
+		if (*names == ',')
+			names++;
+	}
+	debug_checks |= bits;
+	return true;
+}
@@ -9,14 +9,27 @@
 #include "../debug.h"
 #include "threads/malloc.h"
 
-#define list_elem_to_hash_elem(LIST_ELEM)                       \
-	list_entry(LIST_ELEM, struct hash_elem, list_elem)
-
-static struct list *find_bucket (struct hash *, struct hash_elem *);
-static struct hash_elem *find_elem (struct hash *, struct list *,
-		struct hash_elem *);
-static void insert_elem (struct hash *, struct list *, struct hash_elem *);
-static void remove_elem (struct hash *, struct hash_elem *);
+/* Smallest number of slots, a power of 2. */
+#define MIN_SLOTS 8
+
+/* Tables with fewer slots than this are resized in one go; larger
+   ones incrementally, MIGRATE_SLOTS old slots per insertion or
+   deletion.  Moving 8 slots for every element added while growing
+   from N slots empties the old slots before N / 8 more elements
+   arrive, well within the new slots' load bound. */
+#define INCREMENTAL_SLOTS 1024
+#define MIGRATE_SLOTS 8
+
+static struct hash_slot *lookup (struct hash *, uint64_t hash,
+		struct hash_elem *, bool *old);
+static size_t find_slot (struct hash *, struct hash_slot *slots,
+		size_t slot_cnt, uint64_t hash, struct hash_elem *);
+static void insert_slot (struct hash_slot *slots, size_t slot_cnt,
+		uint64_t hash, struct hash_elem *);
+static void remove_slot (struct hash_slot *slots, size_t slot_cnt,
+		size_t idx);
+static void insert_elem (struct hash *, uint64_t hash, struct hash_elem *);
+static void migrate (struct hash *);
 static void rehash (struct hash *);
 
 /* Initializes hash table H to compute hash values using HASH and
@@ -25,17 +38,15 @@ bool
 hash_init (struct hash *h,
 		hash_hash_func *hash, hash_less_func *less, void *aux) {
 	h->elem_cnt = 0;
-	h->bucket_cnt = 4;
-	h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+	h->slot_cnt = MIN_SLOTS;
+	h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+	h->old_slots = NULL;
+	h->old_slot_cnt = h->old_elem_cnt = h->migrate = 0;
 	h->hash = hash;
 	h->less = less;
 	h->aux = aux;
 
-	if (h->buckets != NULL) {
-		hash_clear (h, NULL);
-		return true;
-	} else
-		return false;
+	return h->slots != NULL;
 }
 
 /* Removes all the elements from H.
@@ -51,17 +62,20 @@ void
 hash_clear (struct hash *h, hash_action_func *destructor) {
 	size_t i;
 
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
-
-		if (destructor != NULL)
-			while (!list_empty (bucket)) {
-				struct list_elem *list_elem = list_pop_front (bucket);
-				struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
-				destructor (hash_elem, h->aux);
-			}
+	for (i = 0; i < h->slot_cnt; i++) {
+		struct hash_elem *e = h->slots[i].elem;
 
-		list_init (bucket);
+		h->slots[i].elem = NULL;
+		if (e != NULL && destructor != NULL)
+			destructor (e, h->aux);
+	}
+	if (h->old_slots != NULL) {
+		for (i = h->migrate; i < h->old_slot_cnt; i++)
+			if (h->old_slots[i].elem != NULL && destructor != NULL)
+				destructor (h->old_slots[i].elem, h->aux);
+		free (h->old_slots);
+		h->old_slots = NULL;
+		h->old_elem_cnt = 0;
 	}
 
 	h->elem_cnt = 0;
@@ -81,7 +95,8 @@ void
 hash_destroy (struct hash *h, hash_action_func *destructor) {
 	if (destructor != NULL)
 		hash_clear (h, destructor);
-	free (h->buckets);
+	free (h->old_slots);
+	free (h->slots);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -90,38 +105,47 @@ hash_destroy (struct hash *h, hash_action_func *destructor) {
    without inserting NEW. */
 struct hash_elem *
 hash_insert (struct hash *h, struct hash_elem *new) {
-	struct list *bucket = find_bucket (h, new);
-	struct hash_elem *old = find_elem (h, bucket, new);
+	uint64_t hash = h->hash (new, h->aux);
+	struct hash_slot *s = lookup (h, hash, new, NULL);
 
-	if (old == NULL)
-		insert_elem (h, bucket, new);
+	if (s != NULL)
+		return s->elem;
 
+	insert_elem (h, hash, new);
 	rehash (h);
 
-	return old;
+	return NULL;
 }
 
 /* Inserts NEW into hash table H, replacing any equal element
    already in the table, which is returned. */
 struct hash_elem *
 hash_replace (struct hash *h, struct hash_elem *new) {
-	struct list *bucket = find_bucket (h, new);
-	struct hash_elem *old = find_elem (h, bucket, new);
-
-	if (old != NULL)
-		remove_elem (h, old);
-	insert_elem (h, bucket, new);
+	uint64_t hash = h->hash (new, h->aux);
+	struct hash_slot *s = lookup (h, hash, new, NULL);
+	struct hash_elem *old;
+
+	if (s != NULL) {
+		old = s->elem;
+		s->elem = new;
+		return old;
+	}
 
+	insert_elem (h, hash, new);
 	rehash (h);
 
-	return old;
+	return NULL;
 }
 
 /* Finds and returns an element equal to E in hash table H, or a
-   null pointer if no equal element exists in the table. */
+   null pointer if no equal element exists in the table.  Does not
+   move elements of a resize under way, so that lookups may go on
+   during iteration. */
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) {
-	return find_elem (h, find_bucket (h, e), e);
+	struct hash_slot *s = lookup (h, h->hash (e, h->aux), e, NULL);
+
+	return s != NULL ? s->elem : NULL;
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -133,11 +157,20 @@ hash_find (struct hash *h, struct hash_elem *e) {
    responsibility to deallocate them. */
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e) {
-	struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
-	if (found != NULL) {
-		remove_elem (h, found);
-		rehash (h);
-	}
+	bool old;
+	struct hash_slot *s = lookup (h, h->hash (e, h->aux), e, &old);
+	struct hash_elem *found;
+
+	if (s == NULL)
+		return NULL;
+	found = s->elem;
+	if (old) {
+		remove_slot (h->old_slots, h->old_slot_cnt, s - h->old_slots);
+		h->old_elem_cnt--;
+	} else
+		remove_slot (h->slots, h->slot_cnt, s - h->slots);
+	h->elem_cnt--;
+	rehash (h);
 	return found;
 }
 
@@ -151,17 +184,15 @@ void
 hash_apply (struct hash *h, hash_action_func *action) {
 	size_t i;
 
-	ASSERT (action != NULL);
+	DEBUG_ASSERT (DEBUG_HASH, action != NULL);
 
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
-		struct list_elem *elem, *next;
-
-		for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) {
-			next = list_next (elem);
-			action (list_elem_to_hash_elem (elem), h->aux);
-		}
-	}
+	if (h->old_slots != NULL)
+		for (i = h->migrate; i < h->old_slot_cnt; i++)
+			if (h->old_slots[i].elem != NULL)
+				action (h->old_slots[i].elem, h->aux);
+	for (i = 0; i < h->slot_cnt; i++)
+		if (h->slots[i].elem != NULL)
+			action (h->slots[i].elem, h->aux);
 }
 
 /* Initializes I for iterating hash table H.
@@ -183,12 +214,12 @@ hash_apply (struct hash *h, hash_action_func *action) {
    iterators. */
 void
 hash_first (struct hash_iterator *i, struct hash *h) {
-	ASSERT (i != NULL);
-	ASSERT (h != NULL);
+	DEBUG_ASSERT (DEBUG_HASH, i != NULL);
+	DEBUG_ASSERT (DEBUG_HASH, h != NULL);
 
 	i->hash = h;
-	i->bucket = i->hash->buckets;
-	i->elem = list_elem_to_hash_elem (list_head (i->bucket));
+	i->slot = SIZE_MAX;
+	i->elem = NULL;
 }
 
 /* Advances I to the next element in the hash table and returns
@@ -201,16 +232,23 @@ hash_first (struct hash_iterator *i, struct hash *h) {
    iterators. */
 struct hash_elem *
 hash_next (struct hash_iterator *i) {
-	ASSERT (i != NULL);
-
-	i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
-	while (i->elem == list_elem_to_hash_elem (list_end (i->bucket))) {
-		if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
-			i->elem = NULL;
+	struct hash *h;
+	size_t old_cnt, end;
+
+	DEBUG_ASSERT (DEBUG_HASH, i != NULL);
+
+	h = i->hash;
+	old_cnt = h->old_slots != NULL ? h->old_slot_cnt : 0;
+	end = old_cnt + h->slot_cnt;
+	i->elem = NULL;
+	while (++i->slot < end) {
+		i->elem = i->slot < old_cnt ? h->old_slots[i->slot].elem
+			: h->slots[i->slot - old_cnt].elem;
+		if (i->elem != NULL)
 			break;
-		}
-		i->elem = list_elem_to_hash_elem (list_begin (i->bucket));
 	}
+	if (i->slot >= end)
+		i->slot = end;
 
 	return i->elem;
 }
@@ -235,6 +273,25 @@ hash_empty (struct hash *h) {
 	return h->elem_cnt == 0;
 }
 
+/* Returns how many slots past their home slots the elements of H
+   are, altogether.  Divided by hash_size (H), that is the mean
+   number of extra slots a successful lookup reads, a measure of how
+   well H's hash function spreads its keys. */
+size_t
+hash_probe_total (struct hash *h) {
+	size_t total = 0;
+	size_t i;
+
+	for (i = 0; i < h->slot_cnt; i++)
+		if (h->slots[i].elem != NULL)
+			total += (i - h->slots[i].hash) & (h->slot_cnt - 1);
+	if (h->old_slots != NULL)
+		for (i = h->migrate; i < h->old_slot_cnt; i++)
+			if (h->old_slots[i].elem != NULL)
+				total += (i - h->old_slots[i].hash) & (h->old_slot_cnt - 1);
+	return total;
+}
+
 /* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
 #define FNV_64_PRIME 0x00000100000001B3UL
 #define FNV_64_BASIS 0xcbf29ce484222325UL
@@ -246,7 +303,7 @@ hash_bytes (const void *buf_, size_t size) {
 	const unsigned char *buf = buf_;
 	uint64_t hash;
 
-	ASSERT (buf != NULL);
+	DEBUG_ASSERT (DEBUG_HASH, buf != NULL);
 
 	hash = FNV_64_BASIS;
 	while (size-- > 0)
@@ -261,7 +318,7 @@ hash_string (const char *s_) {
 	const unsigned char *s = (const unsigned char *) s_;
 	uint64_t hash;
 
-	ASSERT (s != NULL);
+	DEBUG_ASSERT (DEBUG_HASH, s != NULL);
 
 	hash = FNV_64_BASIS;
 	while (*s != '\0')
@@ -273,122 +330,241 @@ hash_string (const char *s_) {
 /* Returns a hash of integer I. */
 uint64_t
 hash_int (int i) {
-	return hash_bytes (&i, sizeof i);
+	return hash_u64 ((unsigned) i);
+}
+
+/* 2**64 divided by the golden ratio, odd. */
+#define FIBONACCI_64 0x9e3779b97f4a7c15UL
+
+/* Returns a hash of X.
+
+   Multiplying by FIBONACCI_64 spreads every bit of X over the high
+   bits of the product, but the low bits, which pick the home slot,
+   depend on the low bits of X alone, and those are zero in a
+   page-aligned address.  Folding the high half onto the low half
+   gives them the spread of the high bits, for a multiply, a shift
+   and an exclusive or, where hash_bytes() loops over each byte. */
+uint64_t
+hash_u64 (uint64_t x) {
+	uint64_t h = x * FIBONACCI_64;
+
+	return h ^ (h >> 32);
+}
+
+/* Returns a hash of pointer P. */
+uint64_t
+hash_ptr (const void *p) {
+	return hash_u64 ((uintptr_t) p);
 }
 
-/* Returns the bucket in H that E belongs in. */
-static struct list *
-find_bucket (struct hash *h, struct hash_elem *e) {
-	size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-	return &h->buckets[bucket_idx];
+/* Returns how far slot IDX of the SLOT_CNT SLOTS is from the home
+   slot of the element it holds. */
+static inline size_t
+probe_dist (const struct hash_slot *slots, size_t slot_cnt, size_t idx) {
+	return (idx - slots[idx].hash) & (slot_cnt - 1);
 }
 
-/* Searches BUCKET in H for a hash element equal to E.  Returns
-   it if found or a null pointer otherwise. */
-static struct hash_elem *
-find_elem (struct hash *h, struct list *bucket, struct hash_elem *e) {
-	struct list_elem *i;
+/* Returns the slot of H holding an element equal to E, whose hash
+   value is HASH, or a null pointer if there is none.  If OLD is
+   non-null, stores in *OLD whether the slot is one of the old slots
+   of a resize under way. */
+static struct hash_slot *
+lookup (struct hash *h, uint64_t hash, struct hash_elem *e, bool *old) {
+	size_t idx = find_slot (h, h->slots, h->slot_cnt, hash, e);
 
-	for (i = list_begin (bucket); i != list_end (bucket); i = list_next (i)) {
-		struct hash_elem *hi = list_elem_to_hash_elem (i);
-		if (!h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
-			return hi;
+	if (old != NULL)
+		*old = false;
+	if (idx != SIZE_MAX)
+		return &h->slots[idx];
+	if (h->old_slots == NULL)
+		return NULL;
+	idx = find_slot (h, h->old_slots, h->old_slot_cnt, hash, e);
+	if (idx == SIZE_MAX)
+		return NULL;
+	if (old != NULL)
+		*old = true;
+	return &h->old_slots[idx];
+}
+
+/* Returns the index of the slot among the SLOT_CNT SLOTS of H
+   holding an element equal to E, whose hash value is HASH, or
+   SIZE_MAX if there is none.  The search stops at a slot closer to
+   its home than E would be: Robin Hood insertion would have placed
+   E before it. */
+static size_t
+find_slot (struct hash *h, struct hash_slot *slots, size_t slot_cnt,
+		uint64_t hash, struct hash_elem *e) {
+	size_t mask = slot_cnt - 1;
+	size_t idx = hash & mask;
+	size_t dist;
+
+	for (dist = 0; dist < slot_cnt; dist++, idx = (idx + 1) & mask) {
+		struct hash_slot *s = &slots[idx];
+
+		if (s->elem == NULL || probe_dist (slots, slot_cnt, idx) < dist)
+			break;
+		if (s->hash == hash && !h->less (s->elem, e, h->aux)
+				&& !h->less (e, s->elem, h->aux))
+			return idx;
 	}
-	return NULL;
+	return SIZE_MAX;
 }
 
-/* Returns X with its lowest-order bit set to 1 turned off. */
-static inline size_t
-turn_off_least_1bit (size_t x) {
-	return x & (x - 1);
+/* Inserts E, whose hash value is HASH, into the SLOT_CNT SLOTS,
+   which must include an empty one.  Whenever E would land farther
+   from home than the element in its way, the two trade places and
+   the displaced element continues the search. */
+static void
+insert_slot (struct hash_slot *slots, size_t slot_cnt, uint64_t hash,
+		struct hash_elem *e) {
+	size_t mask = slot_cnt - 1;
+	size_t idx = hash & mask;
+	struct hash_slot cur = { hash, e };
+	size_t dist = 0;
+
+	for (;; idx = (idx + 1) & mask, dist++) {
+		struct hash_slot *s = &slots[idx];
+		size_t s_dist;
+
+		if (s->elem == NULL) {
+			*s = cur;
+			break;
+		}
+		s_dist = probe_dist (slots, slot_cnt, idx);
+		if (s_dist < dist) {
+			struct hash_slot tmp = *s;
+			*s = cur;
+			cur = tmp;
+			dist = s_dist;
+		}
+	}
 }
 
-/* Returns true if X is a power of 2, otherwise false. */
-static inline size_t
-is_power_of_2 (size_t x) {
-	return x != 0 && turn_off_least_1bit (x) == 0;
+/* Empties slot IDX of the SLOT_CNT SLOTS, shifting the elements
+   after it that are away from home back by one so that no search
+   stops early. */
+static void
+remove_slot (struct hash_slot *slots, size_t slot_cnt, size_t idx) {
+	size_t mask = slot_cnt - 1;
+	size_t next = (idx + 1) & mask;
+
+	while (slots[next].elem != NULL
+			&& probe_dist (slots, slot_cnt, next) > 0) {
+		slots[idx] = slots[next];
+		idx = next;
+		next = (next + 1) & mask;
+	}
+	slots[idx].elem = NULL;
 }
 
-/* Element per bucket ratios. */
-#define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
-#define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
-#define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
+/* Inserts E, whose hash value is HASH, into the current slots of
+   H, where new elements always go. */
+static void
+insert_elem (struct hash *h, uint64_t hash, struct hash_elem *e) {
+	DEBUG_ASSERT (DEBUG_HASH, h->elem_cnt - h->old_elem_cnt < h->slot_cnt);
+	insert_slot (h->slots, h->slot_cnt, hash, e);
+	h->elem_cnt++;
+}
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Moves the elements of the next MIGRATE_SLOTS old slots of H, of a
+   resize under way, to its current slots, and ends the resize once
+   none are left.  Each old slot is emptied in turn, by removing its
+   element until the elements after it are at home, so the old slots
+   stay searchable and every old slot before `migrate' stays empty:
+   no element left can have its home there. */
+static void
+migrate (struct hash *h) {
+	size_t n;
+
+	DEBUG_ASSERT (DEBUG_HASH, h->old_slots != NULL);
+	for (n = 0; n < MIGRATE_SLOTS && h->old_elem_cnt > 0
+			&& h->migrate < h->old_slot_cnt; n++, h->migrate++) {
+		struct hash_slot *s = &h->old_slots[h->migrate];
+
+		while (s->elem != NULL) {
+			struct hash_slot moved = *s;
+
+			remove_slot (h->old_slots, h->old_slot_cnt, h->migrate);
+			h->old_elem_cnt--;
+			insert_slot (h->slots, h->slot_cnt, moved.hash, moved.elem);
+		}
+	}
+	if (h->old_elem_cnt == 0) {
+		free (h->old_slots);
+		h->old_slots = NULL;
+	}
+}
+
+/* Load factor bounds, as fractions of the slots in use. */
+#define MAX_LOAD(SLOTS) ((SLOTS) / 4 * 3)   /* More: double the slots. */
+#define MIN_LOAD(SLOTS) ((SLOTS) / 8)       /* Fewer: halve the slots. */
+
+/* Changes the number of slots in hash table H to keep its load
+   between MIN_LOAD and MAX_LOAD, or carries on a resize under way.
+   This function can fail because of an out-of-memory condition,
+   but that'll just make hash accesses less efficient; we can still
+   continue, unless the table is completely full. */
 static void
 rehash (struct hash *h) {
-	size_t old_bucket_cnt, new_bucket_cnt;
-	struct list *new_buckets, *old_buckets;
+	size_t old_slot_cnt, new_slot_cnt;
+	struct hash_slot *new_slots, *old_slots;
 	size_t i;
 
-	ASSERT (h != NULL);
+	DEBUG_ASSERT (DEBUG_HASH, h != NULL);
 
-	/* Save old bucket info for later use. */
-	old_buckets = h->buckets;
-	old_bucket_cnt = h->bucket_cnt;
+	if (h->old_slots != NULL) {
+		migrate (h);
+		return;
+	}
+
+	/* Save old slot info for later use. */
+	old_slots = h->slots;
+	old_slot_cnt = h->slot_cnt;
 
-	/* Calculate the number of buckets to use now.
-	   We want one bucket for about every BEST_ELEMS_PER_BUCKET.
-	   We must have at least four buckets, and the number of
-	   buckets must be a power of 2. */
-	new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
-	if (new_bucket_cnt < 4)
-		new_bucket_cnt = 4;
-	while (!is_power_of_2 (new_bucket_cnt))
-		new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
+	/* Calculate the number of slots to use now. */
+	new_slot_cnt = old_slot_cnt;
+	if (h->elem_cnt > MAX_LOAD (old_slot_cnt))
+		new_slot_cnt *= 2;
+	else if (h->elem_cnt < MIN_LOAD (old_slot_cnt)
+			&& old_slot_cnt > MIN_SLOTS)
+		new_slot_cnt /= 2;
 
-	/* Don't do anything if the bucket count wouldn't change. */
-	if (new_bucket_cnt == old_bucket_cnt)
+	/* Don't do anything if the slot count wouldn't change. */
+	if (new_slot_cnt == old_slot_cnt)
 		return;
 
-	/* Allocate new buckets and initialize them as empty. */
-	new_buckets = malloc (sizeof *new_buckets * new_bucket_cnt);
-	if (new_buckets == NULL) {
+	/* Allocate new slots and initialize them as empty. */
+	new_slots = calloc (new_slot_cnt, sizeof *new_slots);
+	if (new_slots == NULL) {
 		/* Allocation failed.  This means that use of the hash table will
 		   be less efficient.  However, it is still usable, so
-		   there's no reason for it to be an error. */
+		   there's no reason for it to be an error, as long as one
+		   more element fits. */
+		if (h->elem_cnt + 1 >= old_slot_cnt)
+			PANIC ("hash table full and out of memory");
 		return;
 	}
-	for (i = 0; i < new_bucket_cnt; i++)
-		list_init (&new_buckets[i]);
-
-	/* Install new bucket info. */
-	h->buckets = new_buckets;
-	h->bucket_cnt = new_bucket_cnt;
-
-	/* Move each old element into the appropriate new bucket. */
-	for (i = 0; i < old_bucket_cnt; i++) {
-		struct list *old_bucket;
-		struct list_elem *elem, *next;
-
-		old_bucket = &old_buckets[i];
-		for (elem = list_begin (old_bucket);
-				elem != list_end (old_bucket); elem = next) {
-			struct list *new_bucket
-				= find_bucket (h, list_elem_to_hash_elem (elem));
-			next = list_next (elem);
-			list_remove (elem);
-			list_push_front (new_bucket, elem);
-		}
-	}
 
-	free (old_buckets);
-}
+	/* Install new slot info. */
+	h->slots = new_slots;
+	h->slot_cnt = new_slot_cnt;
+
+	/* Keep the old slots around for a large table, and move their
+	   elements a few at a time. */
+	if (old_slot_cnt >= INCREMENTAL_SLOTS && h->elem_cnt > 0) {
+		h->old_slots = old_slots;
+		h->old_slot_cnt = old_slot_cnt;
+		h->old_elem_cnt = h->elem_cnt;
+		h->migrate = 0;
+		migrate (h);
+		return;
+	}
 
-/* Inserts E into BUCKET (in hash table H). */
-static void
-insert_elem (struct hash *h, struct list *bucket, struct hash_elem *e) {
-	h->elem_cnt++;
-	list_push_front (bucket, &e->list_elem);
-}
+	/* Move each old element into the appropriate new slot. */
+	for (i = 0; i < old_slot_cnt; i++)
+		if (old_slots[i].elem != NULL)
+			insert_slot (h->slots, h->slot_cnt, old_slots[i].hash,
+					old_slots[i].elem);
 
-/* Removes E from hash table H. */
-static void
-remove_elem (struct hash *h, struct hash_elem *e) {
-	h->elem_cnt--;
-	list_remove (&e->list_elem);
+	free (old_slots);
 }
-
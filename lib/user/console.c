@@ -3,11 +3,29 @@
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* A buffered output stream. */
+struct FILE {
+	int handle;                 /* File handle written to. */
+	bool in_use;                /* Open, or free for fdopen(). */
+	bool line_buffered;         /* Written on every new-line too. */
+	size_t len;                 /* Bytes in BUF. */
+	char buf[BUFSIZ];
+};
+
+/* Streams, the first of which is stdout. */
+static FILE streams[FOPEN_MAX] = {
+	{ .handle = STDOUT_FILENO, .in_use = true, .line_buffered = true },
+};
+FILE *stdout = &streams[0];
+
+static void stream_init (FILE *, int handle);
+static void stream_add_char (char, void *);
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
 vprintf (const char *format, va_list args) {
-	return vhprintf (STDOUT_FILENO, format, args);
+	return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -27,60 +45,168 @@ hprintf (int handle, const char *format, ...) {
    character. */
 int
 puts (const char *s) {
-	write (STDOUT_FILENO, s, strlen (s));
-	putchar ('\n');
-
+	if (fputs (s, stdout) == EOF || fputc ('\n', stdout) == EOF)
+		return EOF;
 	return 0;
 }
 
 /* Writes C to the console. */
 int
 putchar (int c) {
-	char c2 = c;
-	write (STDOUT_FILENO, &c2, 1);
-	return c;
+	return fputc (c, stdout);
 }
 
-/* Auxiliary data for vhprintf_helper(). */
-struct vhprintf_aux {
-	char buf[64];       /* Character buffer. */
-	char *p;            /* Current position in buffer. */
-	int char_cnt;       /* Total characters written so far. */
-	int handle;         /* Output file handle. */
-};
-
-static void add_char (char, void *);
-static void flush (struct vhprintf_aux *);
-
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to the console goes through stdout; output to
+   any other handle is written before returning, bypassing any
+   stream opened on it. */
 int
 vhprintf (int handle, const char *format, va_list args) {
-	struct vhprintf_aux aux;
-	aux.p = aux.buf;
+	FILE f;
+	int char_cnt;
+
+	if (handle == STDOUT_FILENO)
+		return vfprintf (stdout, format, args);
+	stream_init (&f, handle);
+	char_cnt = vfprintf (&f, format, args);
+	fflush (&f);
+	return char_cnt;
+}
+
+/* Returns a new stream that writes to HANDLE, line buffered if
+   HANDLE is the console and fully buffered otherwise, or a null
+   pointer if FOPEN_MAX streams are open already. */
+FILE *
+fdopen (int handle) {
+	size_t i;
+
+	for (i = 0; i < FOPEN_MAX; i++)
+		if (!streams[i].in_use) {
+			stream_init (&streams[i], handle);
+			streams[i].in_use = true;
+			return &streams[i];
+		}
+	return NULL;
+}
+
+/* Flushes F, closes its handle and frees it.  Returns 0 if
+   successful, EOF if the flush failed. */
+int
+fclose (FILE *f) {
+	int retval = fflush (f);
+
+	close (f->handle);
+	f->in_use = false;
+	return retval;
+}
+
+/* Writes what is buffered in F, or in every open stream if F is
+   a null pointer.  Returns 0 if successful, EOF on a write error,
+   in which case the buffered output is dropped. */
+int
+fflush (FILE *f) {
+	int retval = 0;
+
+	if (f == NULL) {
+		size_t i;
+
+		for (i = 0; i < FOPEN_MAX; i++)
+			if (streams[i].in_use && fflush (&streams[i]) == EOF)
+				retval = EOF;
+		return retval;
+	}
+	if (f->len > 0 && write (f->handle, f->buf, f->len) != (int) f->len)
+		retval = EOF;
+	f->len = 0;
+	return retval;
+}
+
+/* Writes C to F.  Returns C, as an unsigned char, or EOF if a
+   write error occurred. */
+int
+fputc (int c, FILE *f) {
+	f->buf[f->len++] = c;
+	if (f->len == BUFSIZ || (f->line_buffered && c == '\n'))
+		if (fflush (f) == EOF)
+			return EOF;
+	return (unsigned char) c;
+}
+
+/* Writes string S to F, without a new-line.  Returns 0 if
+   successful, EOF on a write error. */
+int
+fputs (const char *s, FILE *f) {
+	size_t len = strlen (s);
+
+	return fwrite (s, 1, len, f) == len ? 0 : EOF;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUFFER to F.
+   Returns CNT if successful, 0 on a write error.  A chunk too big
+   for the buffer is written straight after what is buffered. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *f) {
+	size_t n = size * cnt;
+
+	if (n >= BUFSIZ) {
+		if (fflush (f) == EOF || write (f->handle, buffer, n) != (int) n)
+			return 0;
+		return cnt;
+	}
+	if (f->len + n > BUFSIZ && fflush (f) == EOF)
+		return 0;
+	memcpy (f->buf + f->len, buffer, n);
+	f->len += n;
+	if (f->len == BUFSIZ
+			|| (f->line_buffered && memchr (buffer, '\n', n) != NULL))
+		if (fflush (f) == EOF)
+			return 0;
+	return cnt;
+}
+
+/* Like printf(), but writes output to F. */
+int
+fprintf (FILE *f, const char *format, ...) {
+	va_list args;
+	int retval;
+
+	va_start (args, format);
+	retval = vfprintf (f, format, args);
+	va_end (args);
+
+	return retval;
+}
+
+/* Auxiliary data for stream_add_char(). */
+struct vfprintf_aux {
+	FILE *f;            /* Stream written to. */
+	int char_cnt;       /* Total characters written so far. */
+};
+
+/* Like vprintf(), but writes output to F. */
+int
+vfprintf (FILE *f, const char *format, va_list args) {
+	struct vfprintf_aux aux;
+	aux.f = f;
 	aux.char_cnt = 0;
-	aux.handle = handle;
-	__vprintf (format, args, add_char, &aux);
-	flush (&aux);
+	__vprintf (format, args, stream_add_char, &aux);
 	return aux.char_cnt;
 }
 
-/* Adds C to the buffer in AUX, flushing it if the buffer fills
-   up. */
+/* Makes F an empty stream that writes to HANDLE. */
 static void
-add_char (char c, void *aux_) {
-	struct vhprintf_aux *aux = aux_;
-	*aux->p++ = c;
-	if (aux->p >= aux->buf + sizeof aux->buf)
-		flush (aux);
-	aux->char_cnt++;
+stream_init (FILE *f, int handle) {
+	f->handle = handle;
+	f->in_use = false;
+	f->line_buffered = handle == STDOUT_FILENO;
+	f->len = 0;
 }
 
-/* Flushes the buffer in AUX. */
+/* Adds C to the stream in AUX. */
 static void
-flush (struct vhprintf_aux *aux) {
-	if (aux->p > aux->buf)
-		write (aux->handle, aux->buf, aux->p - aux->buf);
-	aux->p = aux->buf;
+stream_add_char (char c, void *aux_) {
+	struct vfprintf_aux *aux = aux_;
+	fputc (c, aux->f);
+	aux->char_cnt++;
 }
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* malloc() for user programs, on the heap of sbrk().
+
+   It works like the kernel's.  The size of each request is rounded
+   up to a size class, four for each power of 2 (16, 24, 32, 40, 48,
+   56, 64, 80, ...), and assigned to the "descriptor" of that class,
+   which keeps a list of free blocks.  If the list is empty, a page
+   of the heap, called an "arena", is divided into blocks for it.  A
+   freed block goes back on its descriptor's list, and its arena
+   stays with the descriptor.
+
+   Blocks bigger than 2 kB get runs of whole pages, with the page
+   count in the arena header at their start.  Freed runs are kept,
+   coalesced, on a list by address, and later requests take the
+   first run big enough, so that realloc() growth and buffers freed
+   and allocated again do not grow the heap each time.  Once more
+   than TRIM_PAGES free pages sit at the top of the heap, the rest
+   are given back to the kernel.
+
+   The threads of a process share the heap under one lock, a futex
+   that costs no system call unless two threads contend for it.
+   What is done under it is a few pointer updates, unless the heap
+   has to grow.  User threads have no thread-local storage, so
+   there are no per-thread caches of blocks, as in the kernel. */
+
+#define PAGE_SIZE 4096
+
+/* Free pages kept at the top of the heap. */
+#define TRIM_PAGES 16
+
+/* Descriptor. */
+struct desc {
+	size_t block_size;          /* Size of each element in bytes. */
+	size_t blocks_per_arena;    /* Number of blocks in an arena. */
+	struct block *free_list;    /* Free blocks, most recently freed first. */
+};
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena {
+	unsigned magic;             /* Always set to ARENA_MAGIC. */
+	struct desc *desc;          /* Owning descriptor, null for big block. */
+	size_t page_cnt;            /* Pages in big block. */
+};
+
+/* Free block. */
+struct block {
+	struct block *next;         /* Next block in the free list. */
+};
+
+/* A run of free pages, kept in its first page. */
+struct run {
+	size_t page_cnt;            /* Number of pages. */
+	struct run *next;           /* Next run up the heap. */
+};
+
+/* Our set of descriptors, made by the first malloc(). */
+static struct desc descs[32];
+static size_t desc_cnt;
+
+/* Free runs, by ascending address. */
+static struct run *free_runs;
+
+/* The heap's lock: 0 if free, 1 if held, 2 if held and a thread may
+   be waiting for it in futex_wait(). */
+static int heap_lock;
+
+static void malloc_init (void);
+static void *pages_get (size_t page_cnt);
+static void pages_put (void *, size_t page_cnt);
+static struct arena *block_to_arena (void *);
+static void heap_acquire (void);
+static void heap_release (void);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) {
+	struct desc *d;
+	struct block *b;
+	struct arena *a;
+
+	/* A null pointer satisfies a request for 0 bytes. */
+	if (size == 0)
+		return NULL;
+
+	heap_acquire ();
+	if (desc_cnt == 0)
+		malloc_init ();
+
+	/* Find the smallest descriptor that satisfies a SIZE-byte
+	   request. */
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->block_size >= size)
+			break;
+	if (d == descs + desc_cnt) {
+		/* SIZE is too big for any descriptor.
+		   Allocate enough pages to hold SIZE plus an arena. */
+		a = NULL;
+		if (size <= INTPTR_MAX - sizeof *a - PAGE_SIZE) {
+			size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PAGE_SIZE);
+
+			a = pages_get (page_cnt);
+			if (a != NULL) {
+				a->magic = ARENA_MAGIC;
+				a->desc = NULL;
+				a->page_cnt = page_cnt;
+			}
+		}
+		heap_release ();
+		return a != NULL ? a + 1 : NULL;
+	}
+
+	/* If the free list is empty, create a new arena. */
+	if (d->free_list == NULL) {
+		size_t i;
+
+		a = pages_get (1);
+		if (a == NULL) {
+			heap_release ();
+			return NULL;
+		}
+		a->magic = ARENA_MAGIC;
+		a->desc = d;
+		a->page_cnt = 1;
+
+		/* Hand the blocks out from the bottom of the arena up. */
+		for (i = d->blocks_per_arena; i-- > 0; ) {
+			b = (struct block *) ((uint8_t *) (a + 1) + i * d->block_size);
+			b->next = d->free_list;
+			d->free_list = b;
+		}
+	}
+
+	/* Get a block from free list and return it. */
+	b = d->free_list;
+	d->free_list = b->next;
+	heap_release ();
+	return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+	size_t size;
+
+	/* Calculate block size and make sure it fits in size_t. */
+	size = a * b;
+	if (b != 0 && size / b != a)
+		return NULL;
+
+	/* Allocate and zero memory. */
+	p = malloc (size);
+	if (p != NULL)
+		memset (p, 0, size);
+
+	return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   A block that already has room for NEW_SIZE bytes stays put. */
+void *
+realloc (void *old_block, size_t new_size) {
+	struct arena *a;
+	size_t old_size;
+	void *new_block;
+
+	if (new_size == 0) {
+		free (old_block);
+		return NULL;
+	}
+	if (old_block == NULL)
+		return malloc (new_size);
+
+	/* An arena's descriptor and size do not change while its block
+	   is in use, so no lock is needed to look at them. */
+	a = block_to_arena (old_block);
+	old_size = (a->desc != NULL ? a->desc->block_size
+			: a->page_cnt * PAGE_SIZE - sizeof *a);
+	if (new_size <= old_size)
+		return old_block;
+
+	new_block = malloc (new_size);
+	if (new_block != NULL) {
+		memcpy (new_block, old_block, old_size);
+		free (old_block);
+	}
+	return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	struct arena *a;
+
+	if (p == NULL)
+		return;
+
+	a = block_to_arena (p);
+	heap_acquire ();
+	if (a->desc != NULL) {
+		struct block *b = p;
+
+		/* Clear the block to help detect use-after-free bugs. */
+		memset (b, 0xcc, a->desc->block_size);
+		b->next = a->desc->free_list;
+		a->desc->free_list = b;
+	} else
+		pages_put (a, a->page_cnt);
+	heap_release ();
+}
+
+/* Makes the descriptors.  Called under the heap's lock. */
+static void
+malloc_init (void) {
+	size_t block_size, step;
+
+	/* Below 64 bytes the steps are of 8, to keep blocks aligned. */
+	for (block_size = 16; block_size < PAGE_SIZE / 2; block_size += step) {
+		struct desc *d = &descs[desc_cnt++];
+		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+		d->block_size = block_size;
+		d->blocks_per_arena = (PAGE_SIZE - sizeof (struct arena)) / block_size;
+		d->free_list = NULL;
+
+		/* A quarter of the power of 2 at or below BLOCK_SIZE. */
+		for (step = 8; step * 8 <= block_size; step *= 2)
+			continue;
+	}
+}
+
+/* Returns PAGE_CNT contiguous pages, page-aligned, from a free run or
+   else from the top of the heap, or a null pointer if the heap cannot
+   grow that much.  Called under the heap's lock. */
+static void *
+pages_get (size_t page_cnt) {
+	struct run **rp;
+	uint8_t *brk;
+	size_t pad;
+
+	for (rp = &free_runs; *rp != NULL; rp = &(*rp)->next) {
+		struct run *r = *rp;
+
+		if (r->page_cnt == page_cnt)
+			*rp = r->next;
+		else if (r->page_cnt > page_cnt) {
+			struct run *rest = (struct run *) ((uint8_t *) r
+					+ page_cnt * PAGE_SIZE);
+
+			rest->page_cnt = r->page_cnt - page_cnt;
+			rest->next = r->next;
+			*rp = rest;
+		} else
+			continue;
+		return r;
+	}
+
+	/* Grow the heap, from a page boundary in case the program moved
+	   the break itself. */
+	brk = sbrk (0);
+	if (brk == NULL)
+		return NULL;
+	pad = ROUND_UP ((uintptr_t) brk, PAGE_SIZE) - (uintptr_t) brk;
+	if (page_cnt > (INTPTR_MAX - pad) / PAGE_SIZE
+			|| sbrk (pad + page_cnt * PAGE_SIZE) == NULL)
+		return NULL;
+	return brk + pad;
+}
+
+/* Returns the PAGE_CNT pages at P to the free runs, merging them
+   with their neighbors, and gives the top of the heap back to the
+   kernel if too much of it is free.  Called under the heap's lock. */
+static void
+pages_put (void *p, size_t page_cnt) {
+	struct run *r = p, *prev = NULL, *next = free_runs;
+
+	while (next != NULL && next < r) {
+		prev = next;
+		next = next->next;
+	}
+	r->page_cnt = page_cnt;
+	r->next = next;
+	if (next != NULL
+			&& (uint8_t *) r + r->page_cnt * PAGE_SIZE == (uint8_t *) next) {
+		r->page_cnt += next->page_cnt;
+		r->next = next->next;
+	}
+	if (prev != NULL
+			&& (uint8_t *) prev + prev->page_cnt * PAGE_SIZE == (uint8_t *) r) {
+		prev->page_cnt += r->page_cnt;
+		prev->next = r->next;
+		r = prev;
+	} else if (prev != NULL)
+		prev->next = r;
+	else
+		free_runs = r;
+
+	if (r->next == NULL && r->page_cnt > TRIM_PAGES
+			&& (uint8_t *) r + r->page_cnt * PAGE_SIZE == sbrk (0)) {
+		sbrk (-(intptr_t) ((r->page_cnt - TRIM_PAGES) * PAGE_SIZE));
+		r->page_cnt = TRIM_PAGES;
+	}
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (void *b) {
+	struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+	/* Check that the arena is valid. */
+	ASSERT (a != NULL);
+	ASSERT (a->magic == ARENA_MAGIC);
+
+	/* Check that the block is properly aligned for the arena. */
+	ASSERT (a->desc == NULL
+			|| ((uint8_t *) b - (uint8_t *) (a + 1)) % a->desc->block_size == 0);
+	ASSERT (a->desc != NULL || (void *) (a + 1) == b);
+
+	return a;
+}
+
+/* Takes the heap's lock, sleeping on the futex while another thread
+   holds it. */
+static void
+heap_acquire (void) {
+	int c = 0;
+
+	if (__atomic_compare_exchange_n (&heap_lock, &c, 1, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+	if (c != 2)
+		c = __atomic_exchange_n (&heap_lock, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		futex_wait (&heap_lock, 2);
+		c = __atomic_exchange_n (&heap_lock, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+/* Releases the heap's lock, waking a thread that may wait for it. */
+static void
+heap_release (void) {
+	if (__atomic_exchange_n (&heap_lock, 0, __ATOMIC_RELEASE) == 2)
+		futex_wake (&heap_lock, 1);
+}
@@ -1,5 +1,6 @@
 #include <syscall.h>
 #include <stdint.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
 __attribute__((always_inline))
@@ -54,7 +55,7 @@ static __inline int64_t syscall (uint64_t num_, uint64_t a1_, uint64_t a2_,
 			((uint64_t) ARG2), 0, 0, 0))
 
 #define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3) ( \
-		syscall(((uint64_t *) NUMBER), \
+		syscall(((uint64_t) NUMBER), \
 			((uint64_t) ARG0), \
 			((uint64_t) ARG1), \
 			((uint64_t) ARG2), \
@@ -70,31 +71,75 @@ static __inline int64_t syscall (uint64_t num_, uint64_t a1_, uint64_t a2_,
 			0))
 void
 halt (void) {
+	fflush (NULL);
 	syscall0 (SYS_HALT);
 	NOT_REACHED ();
 }
 
 void
 exit (int status) {
+	fflush (NULL);
 	syscall1 (SYS_EXIT, status);
 	NOT_REACHED ();
 }
 
 pid_t
 fork (const char *thread_name){
+	/* Keep the child from writing the parent's output again. */
+	fflush (NULL);
 	return (pid_t) syscall1 (SYS_FORK, thread_name);
 }
 
 int
 exec (const char *file) {
+	fflush (NULL);
 	return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+spawn (const char *cmd_line, const int *fds, int fd_cnt) {
+	return (pid_t) syscall3 (SYS_SPAWN, cmd_line, fds, fd_cnt);
+}
+
+/* Freezes a copy of the current process, as it is now, as the
+ * template NAME, and returns 0, or -1 if a template of that name
+ * exists or memory ran out.  Each worker template_spawn() starts
+ * from it returns from here, with 1, as a child of its caller and
+ * with the template's open files; it shares the template's memory
+ * copy-on-write, so whatever the process set up before is there at
+ * no cost. */
+int
+template_create (const char *name) {
+	/* Keep the workers from writing the creator's output again. */
+	fflush (NULL);
+	return syscall1 (SYS_TEMPLATE_CREATE, name);
+}
+
+/* Starts a worker from the template NAME, as a child of the current
+ * thread, and returns its pid, or PID_ERROR if there is no such
+ * template or the worker cannot be made. */
+pid_t
+template_spawn (const char *name) {
+	return (pid_t) syscall1 (SYS_TEMPLATE_SPAWN, name);
+}
+
+/* Ends the template NAME, leaving its workers running.  Returns
+ * false if there is no such template. */
+bool
+template_destroy (const char *name) {
+	return syscall1 (SYS_TEMPLATE_DESTROY, name);
+}
+
 int
 wait (pid_t pid) {
 	return syscall1 (SYS_WAIT, pid);
 }
 
+pid_t
+wait_any (int *status) {
+	return (pid_t) syscall1 (SYS_WAIT_ANY, status);
+}
+
 bool
 create (const char *file, unsigned initial_size) {
 	return syscall2 (SYS_CREATE, file, initial_size);
@@ -110,6 +155,15 @@ open (const char *file) {
 	return syscall1 (SYS_OPEN, file);
 }
 
+/* Opens FILE like open(), with FLAGS, O_*, applying to the new file
+ * descriptor.  With O_DIRECT, reads and writes of whole sectors move
+ * between the disk and the buffer given, with no copy in the buffer
+ * cache, when the buffer's pages can be held in memory for it. */
+int
+open_flags (const char *file, int flags) {
+	return syscall2 (SYS_OPEN_FLAGS, file, flags);
+}
+
 int
 filesize (int fd) {
 	return syscall1 (SYS_FILESIZE, fd);
@@ -117,6 +171,9 @@ filesize (int fd) {
 
 int
 read (int fd, void *buffer, unsigned size) {
+	/* Show a prompt before waiting for the answer. */
+	if (fd == STDIN_FILENO)
+		fflush (stdout);
 	return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -145,6 +202,64 @@ dup2 (int oldfd, int newfd){
 	return syscall2 (SYS_DUP2, oldfd, newfd);
 }
 
+int
+pread (int fd, void *buffer, unsigned size, off_t offset) {
+	return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, off_t offset) {
+	return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt) {
+	return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt) {
+	return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pipe (int fds[2]) {
+	return syscall1 (SYS_PIPE, fds);
+}
+
+/* Waits until one of the NFDS file descriptors in FDS is ready for
+   the events it asks for, or TIMEOUT milliseconds pass, or forever if
+   TIMEOUT is negative, and sets the REVENTS of each.  A pipe is ready
+   to read when it holds data or has no writers, and to write when it
+   has room or no readers; the console input is ready when it holds a
+   whole line; other files are always ready.  Returns the number of
+   descriptors with events, 0 on timeout, or -1 if NFDS is greater
+   than POLL_MAX. */
+int
+poll (struct pollfd *fds, unsigned nfds, int timeout) {
+	return syscall3 (SYS_POLL, fds, nfds, timeout);
+}
+
+int
+fsync (int fd) {
+	return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+sendfile (int out_fd, int in_fd, off_t *offset, unsigned count) {
+	return syscall4 (SYS_SENDFILE, out_fd, in_fd, offset, count);
+}
+
+int64_t
+clock_ns (void) {
+	return syscall0 (SYS_CLOCK_NS);
+}
+
+int
+syscall_stats (struct syscall_stat *buf, int cnt) {
+	return syscall2 (SYS_SYSCALL_STATS, buf, cnt);
+}
+
 void *
 mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	return (void *) syscall5 (SYS_MMAP, addr, length, writable, fd, offset);
@@ -155,6 +270,160 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+void *
+mremap (void *old, size_t old_len, size_t new_len, int flags) {
+	return (void *) syscall4 (SYS_MREMAP, old, old_len, new_len, flags);
+}
+
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+void *
+shmat (void *addr, size_t length, int key) {
+	return (void *) syscall3 (SYS_SHMAT, addr, length, key);
+}
+
+void
+shmdt (void *addr) {
+	syscall1 (SYS_SHMDT, addr);
+}
+
+bool
+stack_limit (size_t size) {
+	return syscall1 (SYS_STACK_LIMIT, size);
+}
+
+bool
+frame_quota (size_t min, size_t max) {
+	return syscall2 (SYS_FRAME_QUOTA, min, max);
+}
+
+size_t
+rss (void) {
+	return syscall0 (SYS_RSS);
+}
+
+int
+fault_stats (struct fault_stat *buf, int cnt, bool self) {
+	return syscall3 (SYS_FAULT_STATS, buf, cnt, self);
+}
+
+struct io_ring *
+io_setup (void *addr, unsigned entries) {
+	return (struct io_ring *) syscall2 (SYS_IO_SETUP, addr, entries);
+}
+
+int
+io_enter (unsigned to_submit) {
+	return syscall1 (SYS_IO_ENTER, to_submit);
+}
+
+int
+pmu_stats (uint64_t *buf, int cnt, bool self) {
+	return syscall3 (SYS_PMU_STATS, buf, cnt, self);
+}
+
+int
+sched_stats (pid_t tid, uint64_t *buf, int cnt) {
+	return syscall3 (SYS_SCHED_STATS, tid, buf, cnt);
+}
+
+int
+disk_stats (const char *name, uint64_t *buf, int cnt) {
+	return syscall3 (SYS_DISK_STATS, name, buf, cnt);
+}
+
+int
+futex_wait (int *addr, int expected) {
+	return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (int *addr, int n) {
+	return syscall2 (SYS_FUTEX_WAKE, addr, n);
+}
+
+/* Where a thread of uthread_create() starts: runs FUNC (AUX), then
+ * exits the thread if FUNC returns. */
+static void
+uthread_start (uthread_func *func, void *aux) {
+	func (aux);
+	exit (0);
+}
+
+/* Runs FUNC (AUX) in a new thread of the current process, on the
+ * stack whose top is STACK, and returns its tid, which wait() takes
+ * to get the status it passes to exit().  exit() in such a thread
+ * ends only that thread; the process ends with its last thread, with
+ * the status of the first one. */
+pid_t
+uthread_create (uthread_func *func, void *aux, void *stack) {
+	return (pid_t) syscall4 (SYS_UTHREAD_CREATE, uthread_start, func, aux,
+			stack);
+}
+
+/* Puts the calling thread in the deadline class, which runs ahead of
+ * every priority: in each PERIOD timer ticks it runs for up to RUNTIME
+ * ticks, within DEADLINE ticks of the start of the period.  RUNTIME
+ * of 0 takes it out again.  Returns false if the class has no room
+ * for it or unless 0 < RUNTIME <= DEADLINE <= PERIOD. */
+bool
+sched_deadline (int64_t runtime, int64_t deadline, int64_t period) {
+	return syscall3 (SYS_SCHED_DEADLINE, runtime, deadline, period);
+}
+
+/* Moves the end of the heap, which starts out empty right after the
+ * program, by INCREMENT bytes, and returns where it was.  sbrk (0)
+ * thus tells where it is.  The pages the heap grows into are zero
+ * and loaded as they are touched.  Returns a null pointer if the
+ * heap cannot grow that far, or shrink below its start. */
+void *
+sbrk (intptr_t increment) {
+	return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+/* Lets the calling thread's sleeps end up to NS nanoseconds late, so
+ * that the kernel can wake it on the same timer tick as others, and
+ * returns how late they could before.  NS < 0 only returns it.
+ * Threads started afterward inherit the value. */
+int64_t
+timer_slack (int64_t ns) {
+	return syscall1 (SYS_TIMER_SLACK, ns);
+}
+
+/* Makes a resource group named NAME, or sets the one of that name.
+ * Its processes share the processor with other groups' threads of
+ * the same priority in proportion to CPU_WEIGHT, and each disk with
+ * other groups' requests in proportion to IO_WEIGHT, both between 1
+ * and 10000, 100 being the default group's.  Together they keep no
+ * more than FRAME_MAX frames resident, any number if 0.  Returns the
+ * group's id, or -1 on failure. */
+int
+rgroup_create (const char *name, unsigned cpu_weight, unsigned io_weight,
+		size_t frame_max) {
+	return syscall4 (SYS_RGROUP_CREATE, name, cpu_weight, io_weight,
+			frame_max);
+}
+
+/* Moves the calling process, with its threads and the frames it has
+ * resident, into the resource group with id ID, where the processes
+ * it starts go too.  0 is the default group.  Returns false if there
+ * is no such group. */
+bool
+rgroup_join (int id) {
+	return syscall1 (SYS_RGROUP_JOIN, id);
+}
+
+/* Stores in BUF up to CNT statistics of the resource group with id
+ * ID, RGROUP_STAT_*.  Returns the number there are, or -1 if there is
+ * no such group. */
+int
+rgroup_stats (int id, uint64_t *buf, int cnt) {
+	return syscall3 (SYS_RGROUP_STATS, id, buf, cnt);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -180,6 +449,9 @@ inumber (int fd) {
 	return syscall1 (SYS_INUMBER, fd);
 }
 
+/* Creates a symbolic link LINKPATH that points to TARGET, which
+   need not exist.  Opening LINKPATH opens TARGET, following at most
+   eight links in all.  Returns 0 if successful, -1 otherwise. */
 int
 symlink (const char* target, const char* linkpath) {
 	return syscall2 (SYS_SYMLINK, target, linkpath);
@@ -194,3 +466,25 @@ int
 umount (const char *path) {
 	return syscall1 (SYS_UMOUNT, path);
 }
+
+/* Stores in ENTRIES up to CNT entries of the directory DIR, from the
+ * position *POS on, and advances *POS past them.  *POS should start
+ * out 0.  Each entry's type is DT_REG, or DT_LNK for a symbolic link.
+ * Returns the number of entries stored, 0 once there are no more, or
+ * -1 if DIR is not a directory.  Only the root directory,
+ * "/", is one so far.  Many entries come back from each call, read
+ * from the disk several sectors at a time, where readdir() takes a
+ * call per entry. */
+int
+getdents (const char *dir, unsigned *pos, struct dirent *entries, int cnt) {
+	return syscall4 (SYS_GETDENTS, dir, pos, entries, cnt);
+}
+
+/* Like getdents(), but stores with each entry its file's length too;
+ * a symbolic link is not followed.
+ * Listing a directory this way takes one call rather than an open,
+ * filesize() and close() per file, and opens none of them. */
+int
+dirstat (const char *dir, unsigned *pos, struct dirstat *entries, int cnt) {
+	return syscall4 (SYS_DIRSTAT, dir, pos, entries, cnt);
+}
@@ -0,0 +1,30 @@
+/* Times running child-bench, which exits at once: fork(), exec()
+   and wait(). */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 50
+
+void
+test_main (void)
+{
+  int64_t start = bench_now ();
+  int i;
+
+  for (i = 0; i < ITERS; i++)
+    {
+      pid_t pid = fork ("child-bench");
+
+      if (pid == 0)
+        {
+          exec ("child-bench");
+          exit (-1);
+        }
+      if (pid == PID_ERROR || wait (pid) != 0)
+        fail ("exec %d failed", i);
+    }
+  bench_result ("fork_exec_exit", ITERS, bench_now () - start);
+}
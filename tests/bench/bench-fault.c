@@ -0,0 +1,26 @@
+/* Times the page faults taken by writing once to each page of a
+   2 MB array in the BSS, which are filled with zeros on demand, and
+   reports how many frames that left resident. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 512
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  size_t rss_before = rss ();
+  int64_t start = bench_now ();
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+  bench_result ("page_fault", PAGE_CNT, bench_now () - start);
+  bench_value ("page_fault", "rss_pages", (long long) (rss () - rss_before));
+}
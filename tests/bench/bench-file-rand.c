@@ -0,0 +1,47 @@
+/* Times reads and writes of 512 bytes at random sector-aligned
+   offsets in a 128 kB file. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (128 * 1024)
+#define BLOCK_SIZE 512
+#define ITERS 512
+
+static char buf[BLOCK_SIZE];
+
+/* Returns a random offset of a block in the file. */
+static off_t
+random_ofs (void)
+{
+  return random_ulong () % (FILE_SIZE / BLOCK_SIZE) * BLOCK_SIZE;
+}
+
+void
+test_main (void)
+{
+  int64_t start;
+  int fd, i;
+
+  if (!create ("bench.dat", FILE_SIZE) || (fd = open ("bench.dat")) < 0)
+    fail ("create \"bench.dat\" failed");
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    if (pwrite (fd, buf, BLOCK_SIZE, random_ofs ()) != BLOCK_SIZE)
+      fail ("pwrite %d failed", i);
+  fsync (fd);
+  bench_result ("file_rand_write_512", ITERS, bench_now () - start);
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    if (pread (fd, buf, BLOCK_SIZE, random_ofs ()) != BLOCK_SIZE)
+      fail ("pread %d failed", i);
+  bench_result ("file_rand_read_512", ITERS, bench_now () - start);
+
+  close (fd);
+  remove ("bench.dat");
+}
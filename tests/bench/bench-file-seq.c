@@ -0,0 +1,40 @@
+/* Times writing a 128 kB file from start to end, then reading it
+   back, 4 kB at a time. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (128 * 1024)
+#define CHUNK_SIZE 4096
+#define CHUNK_CNT (FILE_SIZE / CHUNK_SIZE)
+
+static char buf[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+  int64_t start;
+  int fd, i;
+
+  if (!create ("bench.dat", 0) || (fd = open ("bench.dat")) < 0)
+    fail ("create \"bench.dat\" failed");
+
+  start = bench_now ();
+  for (i = 0; i < CHUNK_CNT; i++)
+    if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+      fail ("write %d failed", i);
+  fsync (fd);
+  bench_result ("file_seq_write_4k", CHUNK_CNT, bench_now () - start);
+
+  seek (fd, 0);
+  start = bench_now ();
+  for (i = 0; i < CHUNK_CNT; i++)
+    if (read (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+      fail ("read %d failed", i);
+  bench_result ("file_seq_read_4k", CHUNK_CNT, bench_now () - start);
+
+  close (fd);
+  remove ("bench.dat");
+}
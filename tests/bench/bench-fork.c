@@ -0,0 +1,27 @@
+/* Times fork() of a small process whose child exits at once,
+   together with the parent's wait() for it. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 100
+
+void
+test_main (void)
+{
+  int64_t start = bench_now ();
+  int i;
+
+  for (i = 0; i < ITERS; i++)
+    {
+      pid_t pid = fork ("child");
+
+      if (pid == 0)
+        exit (0);
+      if (pid == PID_ERROR || wait (pid) != 0)
+        fail ("fork %d failed", i);
+    }
+  bench_result ("fork_exit", ITERS, bench_now () - start);
+}
@@ -0,0 +1,45 @@
+/* Times small writes to one file by several processes at once, all
+   of which contend for the locks of the file system and of the
+   file's inode. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+#define ITERS 500
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int64_t start;
+  char c = 'x';
+  int fd, i, j;
+
+  if (!create ("bench.dat", CHILD_CNT) || (fd = open ("bench.dat")) < 0)
+    fail ("create \"bench.dat\" failed");
+
+  start = bench_now ();
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      children[i] = fork ("child");
+      if (children[i] == 0)
+        {
+          for (j = 0; j < ITERS; j++)
+            if (pwrite (fd, &c, 1, i) != 1)
+              exit (-1);
+          exit (0);
+        }
+      if (children[i] == PID_ERROR)
+        fail ("fork %d failed", i);
+    }
+  for (i = 0; i < CHILD_CNT; i++)
+    if (wait (children[i]) != 0)
+      fail ("child %d failed", i);
+  bench_result ("contended_write", CHILD_CNT * ITERS, bench_now () - start);
+
+  close (fd);
+  remove ("bench.dat");
+}
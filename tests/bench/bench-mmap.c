@@ -0,0 +1,45 @@
+/* Times reading every word of a 256 kB file through mmap(), counting
+   the faults that bring its pages in. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+#define FILE_SIZE (PAGE_CNT * PAGE_SIZE)
+
+static char page[PAGE_SIZE];
+
+void
+test_main (void)
+{
+  void *map = (void *) 0x10000000;
+  const uint64_t *p;
+  uint64_t sum = 0;
+  int64_t start;
+  int fd, i;
+
+  if (!create ("bench.dat", 0) || (fd = open ("bench.dat")) < 0)
+    fail ("create \"bench.dat\" failed");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      page[0] = i;
+      if (write (fd, page, PAGE_SIZE) != PAGE_SIZE)
+        fail ("write %d failed", i);
+    }
+  if (mmap (map, FILE_SIZE, 0, fd, 0) != map)
+    fail ("mmap \"bench.dat\" failed");
+
+  start = bench_now ();
+  for (p = map; p < (const uint64_t *) ((char *) map + FILE_SIZE); p++)
+    sum += *p;
+  bench_result ("mmap_scan_page", PAGE_CNT, bench_now () - start);
+  if (sum != (uint64_t) PAGE_CNT * (PAGE_CNT - 1) / 2)
+    fail ("wrong data in mapped file");
+
+  munmap (map);
+  close (fd);
+  remove ("bench.dat");
+}
@@ -0,0 +1,41 @@
+/* Times round trips of a byte between two processes over a pair of
+   pipes, each of which switches from one process to the other and
+   back. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 1000
+
+void
+test_main (void)
+{
+  int ping[2], pong[2];
+  int64_t start;
+  pid_t pid;
+  char c = 0;
+  int i;
+
+  if (pipe (ping) < 0 || pipe (pong) < 0)
+    fail ("pipe failed");
+  pid = fork ("child");
+  if (pid == 0)
+    {
+      for (i = 0; i < ITERS; i++)
+        if (read (ping[0], &c, 1) != 1 || write (pong[1], &c, 1) != 1)
+          exit (-1);
+      exit (0);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    if (write (ping[1], &c, 1) != 1 || read (pong[0], &c, 1) != 1)
+      fail ("round trip %d failed", i);
+  bench_result ("pipe_pingpong", ITERS, bench_now () - start);
+  if (wait (pid) != 0)
+    fail ("child failed");
+}
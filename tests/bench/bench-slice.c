@@ -0,0 +1,80 @@
+/* Times round trips of a byte between two processes over a pair of
+   pipes while CPU-bound processes compete with them, and counts how
+   often those were preempted.  Run with and without -adaptive to see
+   what adaptive time slices do for the latency of threads that block
+   and for the switches of threads that do not. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOG_CNT 2
+#define ITERS 100
+#define SHM_ADDR ((void *) 0x10000000)
+#define SHM_KEY 0x51ce
+
+void
+test_main (void)
+{
+  volatile int *stop = shmat (SHM_ADDR, sizeof *stop, SHM_KEY);
+  pid_t hogs[HOG_CNT];
+  uint64_t stats[SCHED_STAT_CNT];
+  long long switches = 0;
+  int ping[2], pong[2];
+  int64_t start, ns;
+  pid_t pid;
+  char c = 0;
+  int i;
+
+  if (stop == NULL)
+    fail ("shmat failed");
+  *stop = 0;
+  for (i = 0; i < HOG_CNT; i++)
+    {
+      hogs[i] = fork ("hog");
+      if (hogs[i] == 0)
+        {
+          while (!*stop)
+            continue;
+          exit (0);
+        }
+      if (hogs[i] == PID_ERROR)
+        fail ("fork %d failed", i);
+    }
+
+  if (pipe (ping) < 0 || pipe (pong) < 0)
+    fail ("pipe failed");
+  pid = fork ("child");
+  if (pid == 0)
+    {
+      for (i = 0; i < ITERS; i++)
+        if (read (ping[0], &c, 1) != 1 || write (pong[1], &c, 1) != 1)
+          exit (-1);
+      exit (0);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    if (write (ping[1], &c, 1) != 1 || read (pong[0], &c, 1) != 1)
+      fail ("round trip %d failed", i);
+  ns = bench_now () - start;
+  bench_result ("slice_pingpong", ITERS, ns);
+
+  for (i = 0; i < HOG_CNT; i++)
+    if (sched_stats (hogs[i], stats, SCHED_STAT_CNT) == SCHED_STAT_CNT)
+      switches += stats[SCHED_INVOLUNTARY];
+  bench_value ("slice_hog", "preemptions", switches);
+  bench_value ("slice_hog", "preemptions_per_sec",
+               switches * 1000000000LL / (ns > 0 ? ns : 1));
+
+  *stop = 1;
+  if (wait (pid) != 0)
+    fail ("child failed");
+  for (i = 0; i < HOG_CNT; i++)
+    if (wait (hogs[i]) != 0)
+      fail ("hog %d failed", i);
+  shmdt ((void *) stop);
+}
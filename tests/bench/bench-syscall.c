@@ -0,0 +1,27 @@
+/* Times system calls that do nothing: clock_ns(), which takes the
+   fast system call path, and a syscall_stats() call that fails its
+   argument check, which takes the full path. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 100000
+
+void
+test_main (void)
+{
+  int64_t start;
+  int i;
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    clock_ns ();
+  bench_result ("null_syscall_fast", ITERS, bench_now () - start);
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    syscall_stats (NULL, -1);
+  bench_result ("null_syscall", ITERS, bench_now () - start);
+}
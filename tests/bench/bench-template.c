@@ -0,0 +1,46 @@
+/* Times starting workers from a template of a process that has set
+   up some memory, together with the wait() for each, to hold against
+   fork_exit and fork_exec_exit. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ITERS 100
+#define INIT_SIZE (64 * 1024)
+
+/* State the template sets up once, for every worker to find. */
+static char table[INIT_SIZE];
+
+void
+test_main (void)
+{
+  int64_t start;
+  int i;
+
+  memset (table, 0x5a, sizeof table);
+  switch (template_create ("worker"))
+    {
+    case 0:
+      break;
+    case 1:
+      exit (table[INIT_SIZE - 1] == 0x5a ? 0 : -1);
+    default:
+      fail ("template_create failed");
+    }
+
+  start = bench_now ();
+  for (i = 0; i < ITERS; i++)
+    {
+      pid_t pid = template_spawn ("worker");
+
+      if (pid == PID_ERROR || wait (pid) != 0)
+        fail ("worker %d failed", i);
+    }
+  bench_result ("template_spawn_exit", ITERS, bench_now () - start);
+
+  if (!template_destroy ("worker"))
+    fail ("template_destroy failed");
+}
@@ -0,0 +1,34 @@
+/* Helpers shared by the benchmarks.  Each result is a line of the
+   form "bench=NAME KEY=VALUE...", which tests/bench/bench.pm checks
+   and tests/bench/bench-compare compares against a baseline. */
+
+#include "tests/bench/bench.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Returns the current time, in nanoseconds since boot. */
+int64_t
+bench_now (void)
+{
+  return clock_ns ();
+}
+
+/* Reports that ITERS operations of benchmark NAME took NS
+   nanoseconds altogether. */
+void
+bench_result (const char *name, long long iters, int64_t ns)
+{
+  if (ns <= 0)
+    ns = 1;
+  msg ("bench=%s iters=%lld ns=%lld ns_per_op=%lld ops_per_sec=%lld",
+       name, iters, (long long) ns, (long long) ns / (iters > 0 ? iters : 1),
+       iters * 1000000000LL / ns);
+}
+
+/* Reports VALUE, under KEY, as a further result of benchmark
+   NAME. */
+void
+bench_value (const char *name, const char *key, long long value)
+{
+  msg ("bench=%s %s=%lld", name, key, value);
+}
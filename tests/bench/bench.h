@@ -0,0 +1,10 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+int64_t bench_now (void);
+void bench_result (const char *name, long long iters, int64_t ns);
+void bench_value (const char *name, const char *key, long long value);
+
+#endif /* tests/bench/bench.h */
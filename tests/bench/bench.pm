@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks that the run of a benchmark went without trouble and
+# reported a well-formed result line for each of the results named
+# in @NAMES, whatever the numbers.
+sub check_bench {
+    my (@names) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+
+    my (@core) = get_core_output ("run", @output);
+    my ($prog) = $test =~ m%([^/]+)$%;
+    fail "missing begin message\n" if !grep (/^\($prog\) begin$/, @core);
+    fail "missing end message\n" if !grep (/^\($prog\) end$/, @core);
+    for my $name (@names) {
+	fail "no result for $name\n"
+	  if !grep (/^\($prog\) bench=$name( \w+=-?\d+)+$/, @core);
+    }
+}
+
+1;
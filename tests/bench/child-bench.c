@@ -0,0 +1,7 @@
+/* Child process of bench-exec: does nothing. */
+
+int
+main (void)
+{
+  return 0;
+}
@@ -0,0 +1,96 @@
+/* Measures how well hash_bytes(), the FNV hash the tables used to
+   use for integer keys, and hash_u64(), its multiplicative
+   replacement, spread the keys of the kernel's tables, and how fast
+   a table finds them with each.  Keys come in two patterns, the
+   page-aligned addresses of a supplemental page table and the
+   consecutive sector numbers of the open inode table.  For each,
+   "probes_per_1000" is the number of slots past their home slots the
+   keys are, per thousand keys, and the rest is the time hash_find()
+   takes. */
+
+#include <stdio.h>
+#include <hash.h>
+#include "tests/threads/tests.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define KEY_CNT 2048
+#define ROUNDS 8
+
+struct key {
+  uint64_t key;
+  struct hash_elem elem;
+};
+
+static struct key keys[KEY_CNT];
+
+static uint64_t
+fnv_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct key *k = hash_entry (e, struct key, elem);
+
+  return hash_bytes (&k->key, sizeof k->key);
+}
+
+static uint64_t
+fib_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_u64 (hash_entry (e, struct key, elem)->key);
+}
+
+static bool
+key_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return hash_entry (a, struct key, elem)->key
+         < hash_entry (b, struct key, elem)->key;
+}
+
+/* Fills a table hashed with HASH with the keys START + I * STRIDE,
+   and reports its spread and lookup times as benchmark NAME. */
+static void
+measure (const char *name, hash_hash_func *hash, uint64_t start,
+         uint64_t stride)
+{
+  struct hash h;
+  struct key probe;
+  int64_t begin, ns;
+  int i, r;
+
+  if (!hash_init (&h, hash, key_less, NULL))
+    fail ("%s: hash_init failed", name);
+  for (i = 0; i < KEY_CNT; i++)
+    {
+      keys[i].key = start + i * stride;
+      if (hash_insert (&h, &keys[i].elem) != NULL)
+        fail ("%s: key %d inserted twice", name, i);
+    }
+
+  begin = timer_ns ();
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < KEY_CNT; i++)
+      {
+        probe.key = start + i * stride;
+        if (hash_find (&h, &probe.elem) != &keys[i].elem)
+          fail ("%s: key %d not found", name, i);
+      }
+  ns = timer_ns () - begin;
+  if (ns <= 0)
+    ns = 1;
+
+  msg ("bench=%s iters=%d ns=%lld ns_per_op=%lld ops_per_sec=%lld "
+       "probes_per_1000=%zu", name, KEY_CNT * ROUNDS, (long long) ns,
+       (long long) ns / (KEY_CNT * ROUNDS),
+       KEY_CNT * ROUNDS * 1000000000LL / ns,
+       hash_probe_total (&h) * 1000 / KEY_CNT);
+  hash_destroy (&h, NULL);
+}
+
+void
+test_hash_spread (void)
+{
+  measure ("hash_page_fnv", fnv_hash, 0x400000, PGSIZE);
+  measure ("hash_page_fib", fib_hash, 0x400000, PGSIZE);
+  measure ("hash_sector_fnv", fnv_hash, 1, 1);
+  measure ("hash_sector_fib", fib_hash, 1, 1);
+}
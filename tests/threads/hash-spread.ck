@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::bench::bench;
+check_bench (qw(hash_page_fnv hash_page_fib hash_sector_fnv hash_sector_fib));
+pass;
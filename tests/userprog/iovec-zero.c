@@ -0,0 +1,47 @@
+/* Writes and reads a file with writev() and readv() through vectors
+   holding zero-length buffers, some with null bases, which are
+   skipped without ending the transfer. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "scattered and gathered";
+
+void
+test_main (void)
+{
+	size_t size = sizeof data - 1;
+	char head[8], tail[sizeof data];
+	struct iovec out[] = {
+		{ (void *) data, 8 },
+		{ NULL, 0 },
+		{ (void *) data, 0 },
+		{ (void *) (data + 8), size - 8 },
+		{ NULL, 0 },
+	};
+	struct iovec in[] = {
+		{ NULL, 0 },
+		{ head, sizeof head },
+		{ NULL, 0 },
+		{ tail, size - sizeof head },
+	};
+	int fd;
+
+	CHECK (create ("iovec", 0), "create \"iovec\"");
+	CHECK ((fd = open ("iovec")) > 1, "open \"iovec\"");
+	CHECK (writev (fd, out, 0) == 0, "writev no buffers");
+	CHECK (writev (fd, out, sizeof out / sizeof *out) == (int) size,
+			"writev past empty buffers");
+
+	seek (fd, 0);
+	CHECK (readv (fd, in, 1) == 0, "readv an empty buffer");
+	CHECK (readv (fd, in, sizeof in / sizeof *in) == (int) size,
+			"readv past empty buffers");
+	compare_bytes (head, data, sizeof head, 0, "iovec");
+	compare_bytes (tail, data + sizeof head, size - sizeof head,
+			sizeof head, "iovec");
+	msg ("close \"iovec\"");
+	close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(iovec-zero) begin
+(iovec-zero) create "iovec"
+(iovec-zero) open "iovec"
+(iovec-zero) writev no buffers
+(iovec-zero) writev past empty buffers
+(iovec-zero) readv an empty buffer
+(iovec-zero) readv past empty buffers
+(iovec-zero) close "iovec"
+(iovec-zero) end
+iovec-zero: exit(0)
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* A child writes into a pipe and exits.  Its parent, having closed
+   its own write end, reads everything the child wrote and then end
+   of file, once the child's exit has closed the last write end. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char data[] = "down the pipe";
+
+void
+test_main (void)
+{
+	char buf[64];
+	size_t ofs = 0;
+	int fds[2];
+	pid_t pid;
+	int n;
+
+	CHECK (pipe (fds) == 0, "pipe");
+	pid = fork ("child");
+	if (pid == 0) {
+		close (fds[0]);
+		if (write (fds[1], data, sizeof data - 1) != sizeof data - 1)
+			exit (1);
+		exit (0);
+	}
+	close (fds[1]);
+	while ((n = read (fds[0], buf + ofs, sizeof buf - ofs)) > 0)
+		ofs += n;
+	if (n < 0)
+		fail ("read returned %d", n);
+	CHECK (wait (pid) == 0, "wait for child");
+	if (ofs != sizeof data - 1)
+		fail ("read %zu bytes, not %zu", ofs, sizeof data - 1);
+	compare_bytes (buf, data, ofs, 0, "pipe");
+	msg ("read to end of file");
+	CHECK (read (fds[0], buf, sizeof buf) == 0, "read again at end of file");
+}
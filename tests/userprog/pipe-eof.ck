@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-eof) begin
+(pipe-eof) pipe
+child: exit(0)
+(pipe-eof) wait for child
+(pipe-eof) read to end of file
+(pipe-eof) read again at end of file
+(pipe-eof) end
+pipe-eof: exit(0)
+EOF
+pass;
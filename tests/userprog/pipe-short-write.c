@@ -0,0 +1,35 @@
+/* Writes more than a pipe holds while the only reader takes a little
+   and exits.  The write stops short once no read end is left, rather
+   than waiting forever, and a later write writes nothing. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READ_SIZE 100
+
+static char buf[3 * 4096];
+
+void
+test_main (void)
+{
+	int fds[2];
+	pid_t pid;
+	int n;
+
+	CHECK (pipe (fds) == 0, "pipe");
+	pid = fork ("child");
+	if (pid == 0) {
+		char small[READ_SIZE];
+
+		close (fds[1]);
+		exit (read (fds[0], small, sizeof small) == sizeof small ? 0 : 1);
+	}
+	close (fds[0]);
+	n = write (fds[1], buf, sizeof buf);
+	CHECK (wait (pid) == 0, "wait for child");
+	if (n < READ_SIZE || n >= (int) sizeof buf)
+		fail ("wrote %d bytes of %zu", n, sizeof buf);
+	msg ("write stopped short");
+	CHECK (write (fds[1], buf, sizeof buf) == 0, "write with no reader");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-short-write) begin
+(pipe-short-write) pipe
+child: exit(0)
+(pipe-short-write) wait for child
+(pipe-short-write) write stopped short
+(pipe-short-write) write with no reader
+(pipe-short-write) end
+pipe-short-write: exit(0)
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Polls the read end of an empty pipe: first until a timeout, which
+   reports nothing, then with no timeout, which a child writing into
+   the pipe ends, and last after the child's exit closed the only
+   write end, which reports the hang-up. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+	struct pollfd pfd;
+	int fds[2];
+	pid_t pid;
+	char c;
+
+	CHECK (pipe (fds) == 0, "pipe");
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	pfd.revents = -1;
+	CHECK (poll (&pfd, 1, 50) == 0, "poll times out");
+	CHECK (pfd.revents == 0, "no events");
+
+	pid = fork ("child");
+	if (pid == 0) {
+		volatile int spin;
+
+		close (fds[0]);
+		for (spin = 0; spin < 1000000; spin++)
+			continue;
+		exit (write (fds[1], "x", 1) == 1 ? 0 : 1);
+	}
+	close (fds[1]);
+	pfd.revents = 0;
+	if (poll (&pfd, 1, -1) != 1 || !(pfd.revents & POLLIN))
+		fail ("poll returned revents %#x", pfd.revents);
+	if (read (fds[0], &c, 1) != 1 || c != 'x')
+		fail ("read from pipe");
+	if (wait (pid) != 0)
+		fail ("child failed to write");
+	msg ("poll woke up on data");
+
+	pfd.revents = 0;
+	CHECK (poll (&pfd, 1, -1) == 1 && pfd.revents == POLLHUP,
+			"poll sees hang-up");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-pipe) begin
+(poll-pipe) pipe
+(poll-pipe) poll times out
+(poll-pipe) no events
+child: exit(0)
+(poll-pipe) poll woke up on data
+(poll-pipe) poll sees hang-up
+(poll-pipe) end
+poll-pipe: exit(0)
+EOF
+pass;
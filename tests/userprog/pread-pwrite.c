@@ -0,0 +1,36 @@
+/* Reads and writes sample.txt at offsets with pread() and pwrite(),
+   which leave the file position where it was for read(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+	char buf[32];
+	int fd;
+
+	CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+	CHECK (read (fd, buf, 4) == 4, "read 4 bytes");
+
+	CHECK (pread (fd, buf, sizeof buf, 100) == sizeof buf, "pread at 100");
+	compare_bytes (buf, sample + 100, sizeof buf, 100, "sample.txt");
+	CHECK (tell (fd) == 4, "file position stayed");
+
+	CHECK (pwrite (fd, "KAIST", 5, 200) == 5, "pwrite at 200");
+	memcpy (sample + 200, "KAIST", 5);
+	CHECK (tell (fd) == 4, "file position stayed");
+
+	CHECK (pread (fd, buf, sizeof buf, sizeof sample - 11) == 10,
+			"pread across end of file");
+	CHECK (pread (fd, buf, 4, -1) == -1, "pread at a negative offset");
+	CHECK (pwrite (1, "x", 1, 0) == -1, "pwrite to the console");
+
+	CHECK (read (fd, buf, 4) == 4, "read 4 more bytes");
+	compare_bytes (buf, sample + 4, 4, 4, "sample.txt");
+	close (fd);
+	check_file ("sample.txt", sample, sizeof sample - 1);
+}
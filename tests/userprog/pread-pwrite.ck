@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) open "sample.txt"
+(pread-pwrite) read 4 bytes
+(pread-pwrite) pread at 100
+(pread-pwrite) file position stayed
+(pread-pwrite) pwrite at 200
+(pread-pwrite) file position stayed
+(pread-pwrite) pread across end of file
+(pread-pwrite) pread at a negative offset
+(pread-pwrite) pwrite to the console
+(pread-pwrite) read 4 more bytes
+(pread-pwrite) open "sample.txt" for verification
+(pread-pwrite) verified contents of "sample.txt"
+(pread-pwrite) close "sample.txt"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Copies sample.txt into a new file with sendfile(): the first part
+   from the input's own position, which moves along, and the rest
+   from an offset, which moves instead of the position. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HEAD 16
+
+void
+test_main (void)
+{
+	size_t size = sizeof sample - 1;
+	off_t ofs;
+	int in, out;
+
+	CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+	CHECK (create ("copy", 0), "create \"copy\"");
+	CHECK ((out = open ("copy")) > 1, "open \"copy\"");
+
+	CHECK (sendfile (out, in, NULL, HEAD) == HEAD,
+			"sendfile %d bytes from the file position", HEAD);
+	CHECK (tell (in) == HEAD, "file position moved");
+
+	ofs = HEAD;
+	CHECK (sendfile (out, in, &ofs, 4096) == (int) (size - HEAD),
+			"sendfile the rest from an offset");
+	CHECK (ofs == (off_t) size, "offset moved to end of file");
+	CHECK (tell (in) == HEAD, "file position stayed");
+	CHECK (sendfile (out, in, &ofs, 4096) == 0, "sendfile at end of file");
+
+	close (in);
+	close (out);
+	check_file ("copy", sample, size);
+}
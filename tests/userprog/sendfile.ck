@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sendfile) begin
+(sendfile) open "sample.txt"
+(sendfile) create "copy"
+(sendfile) open "copy"
+(sendfile) sendfile 16 bytes from the file position
+(sendfile) file position moved
+(sendfile) sendfile the rest from an offset
+(sendfile) offset moved to end of file
+(sendfile) file position stayed
+(sendfile) sendfile at end of file
+(sendfile) open "copy" for verification
+(sendfile) verified contents of "copy"
+(sendfile) close "copy"
+(sendfile) end
+sendfile: exit(0)
+EOF
+pass;
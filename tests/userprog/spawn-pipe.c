@@ -0,0 +1,35 @@
+/* Spawns child-simple with its standard output on a pipe and reads
+   back what it prints there, while its exit message still goes to
+   the console. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char expected[] = "(child-simple) run\n";
+
+void
+test_main (void)
+{
+	char buf[64];
+	size_t ofs = 0;
+	int fds[2], child_fds[2];
+	pid_t pid;
+	int n;
+
+	CHECK (pipe (fds) == 0, "pipe");
+	child_fds[0] = -1;
+	child_fds[1] = fds[1];
+	pid = spawn ("child-simple", child_fds, 2);
+	if (pid == PID_ERROR)
+		fail ("spawn \"child-simple\"");
+	close (fds[1]);
+	while ((n = read (fds[0], buf + ofs, sizeof buf - ofs)) > 0)
+		ofs += n;
+	CHECK (wait (pid) == 81, "wait for child");
+	if (ofs != sizeof expected - 1)
+		fail ("read %zu bytes, not %zu", ofs, sizeof expected - 1);
+	compare_bytes (buf, expected, ofs, 0, "pipe");
+	msg ("read child's output from pipe");
+}
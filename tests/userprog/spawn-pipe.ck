@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-pipe) begin
+(spawn-pipe) pipe
+child-simple: exit(81)
+(spawn-pipe) wait for child
+(spawn-pipe) read child's output from pipe
+(spawn-pipe) end
+spawn-pipe: exit(0)
+EOF
+pass;
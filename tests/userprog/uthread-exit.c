@@ -0,0 +1,42 @@
+/* A thread other than the process's first calls exit() from deep in
+   its stack.  That ends only the thread: it prints no exit message,
+   runs nothing after the call, and the first thread gets its status
+   from wait() and carries on. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STACK_SIZE 8192
+
+static char stack[STACK_SIZE] __attribute__ ((aligned (16)));
+static volatile int progress;
+
+static void
+nested (int depth)
+{
+	if (depth == 0) {
+		progress = 1;
+		exit (42);
+	}
+	nested (depth - 1);
+	progress = 2;
+}
+
+static void
+worker (void *aux UNUSED)
+{
+	nested (8);
+	progress = 3;
+}
+
+void
+test_main (void)
+{
+	pid_t tid = uthread_create (worker, NULL, stack + STACK_SIZE);
+
+	CHECK (tid != PID_ERROR, "create thread");
+	CHECK (wait (tid) == 42, "wait for thread");
+	CHECK (progress == 1, "thread stopped at exit");
+	msg ("first thread still running");
+}
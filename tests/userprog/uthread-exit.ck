@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread-exit) begin
+(uthread-exit) create thread
+(uthread-exit) wait for thread
+(uthread-exit) thread stopped at exit
+(uthread-exit) first thread still running
+(uthread-exit) end
+uthread-exit: exit(0)
+EOF
+pass;
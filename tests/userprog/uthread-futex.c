@@ -0,0 +1,82 @@
+/* Threads of the process increment a shared counter, each increment
+   a slow read-modify-write, under a mutex built on futex_wait() and
+   futex_wake().  Timer interrupts preempt them inside it, so any
+   increment the mutex let through twice would be lost. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 500
+#define STACK_SIZE 8192
+
+static char stacks[THREAD_CNT][STACK_SIZE] __attribute__ ((aligned (16)));
+
+/* 0 if free, 1 if held, 2 if held and maybe waited for. */
+static int mutex;
+static volatile int counter;
+
+static void
+mutex_lock (void)
+{
+	int c = __sync_val_compare_and_swap (&mutex, 0, 1);
+
+	if (c == 0)
+		return;
+	if (c != 2)
+		c = __sync_lock_test_and_set (&mutex, 2);
+	while (c != 0) {
+		futex_wait (&mutex, 2);
+		c = __sync_lock_test_and_set (&mutex, 2);
+	}
+}
+
+static void
+mutex_unlock (void)
+{
+	if (__sync_fetch_and_sub (&mutex, 1) != 1) {
+		mutex = 0;
+		futex_wake (&mutex, 1);
+	}
+}
+
+static void
+worker (void *aux UNUSED)
+{
+	int i;
+
+	for (i = 0; i < ITER_CNT; i++) {
+		volatile int spin;
+		int value;
+
+		mutex_lock ();
+		value = counter;
+		for (spin = 0; spin < 2000; spin++)
+			continue;
+		counter = value + 1;
+		mutex_unlock ();
+	}
+}
+
+void
+test_main (void)
+{
+	pid_t tids[THREAD_CNT];
+	int i;
+
+	for (i = 0; i < THREAD_CNT; i++) {
+		tids[i] = uthread_create (worker, NULL, stacks[i] + STACK_SIZE);
+		if (tids[i] == PID_ERROR)
+			fail ("create thread %d", i);
+	}
+	msg ("create %d threads", THREAD_CNT);
+	for (i = 0; i < THREAD_CNT; i++)
+		if (wait (tids[i]) != 0)
+			fail ("join thread %d", i);
+	msg ("join %d threads", THREAD_CNT);
+	if (counter != THREAD_CNT * ITER_CNT)
+		fail ("counter is %d, not %d", counter, THREAD_CNT * ITER_CNT);
+	msg ("check counter");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread-futex) begin
+(uthread-futex) create 4 threads
+(uthread-futex) join 4 threads
+(uthread-futex) check counter
+(uthread-futex) end
+uthread-futex: exit(0)
+EOF
+pass;
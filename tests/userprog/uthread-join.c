@@ -0,0 +1,44 @@
+/* Starts threads in the process with uthread_create(), each filling
+   its own slot of an array, and joins them with wait(), which returns
+   the status each passed to exit(), or 0 if its function returned. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define STACK_SIZE 8192
+
+static char stacks[THREAD_CNT][STACK_SIZE] __attribute__ ((aligned (16)));
+static int results[THREAD_CNT];
+
+static void
+worker (void *aux)
+{
+	int i = (intptr_t) aux;
+
+	results[i] = i * i + 1;
+	if (i != 0)
+		exit (i + 10);
+}
+
+void
+test_main (void)
+{
+	pid_t tids[THREAD_CNT];
+	int i;
+
+	for (i = 0; i < THREAD_CNT; i++) {
+		tids[i] = uthread_create (worker, (void *) (intptr_t) i,
+				stacks[i] + STACK_SIZE);
+		CHECK (tids[i] != PID_ERROR, "create thread %d", i);
+	}
+	for (i = 0; i < THREAD_CNT; i++)
+		CHECK (wait (tids[i]) == (i != 0 ? i + 10 : 0), "join thread %d", i);
+	for (i = 0; i < THREAD_CNT; i++)
+		if (results[i] != i * i + 1)
+			fail ("thread %d stored %d, not %d", i, results[i], i * i + 1);
+	msg ("check results");
+	CHECK (wait (tids[0]) == -1, "join thread 0 again");
+}
@@ -0,0 +1,88 @@
+/* Checks that freeing a big block from calloc() gives the top of
+   the heap back, then allocates blocks of many sizes with malloc()
+   and realloc() and checks that their contents stay intact as
+   others are freed and allocated. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 200
+#define BIG_SIZE (64 * 4096)
+
+static char *blocks[BLOCK_CNT];
+
+static size_t
+block_size (size_t i)
+{
+	return i * 37 % 3000 + 1;
+}
+
+static void
+check_block (size_t i)
+{
+	size_t j;
+
+	for (j = 0; j < block_size (i); j++)
+		if (blocks[i][j] != (char) i)
+			fail ("byte %zu of block %zu is wrong", j, i);
+}
+
+void
+test_main (void)
+{
+	char *big, *brk;
+	size_t i;
+
+	big = calloc (BIG_SIZE, 1);
+	CHECK (big != NULL, "calloc big block");
+	for (i = 0; i < BIG_SIZE; i++)
+		if (big[i] != 0)
+			fail ("byte %zu of big block is not 0", i);
+	msg ("check if big block is zero");
+	memset (big, 'x', BIG_SIZE);
+	brk = sbrk (0);
+	free (big);
+	CHECK ((char *) sbrk (0) < brk, "free big block shrinks heap");
+
+	for (i = 0; i < BLOCK_CNT; i++) {
+		blocks[i] = malloc (block_size (i));
+		if (blocks[i] == NULL)
+			fail ("malloc of block %zu failed", i);
+		memset (blocks[i], i, block_size (i));
+	}
+	msg ("malloc %d blocks", BLOCK_CNT);
+
+	for (i = 1; i < BLOCK_CNT; i += 2)
+		free (blocks[i]);
+	for (i = 0; i < BLOCK_CNT; i += 2)
+		check_block (i);
+	msg ("free odd blocks");
+
+	for (i = 1; i < BLOCK_CNT; i += 2) {
+		blocks[i] = malloc (block_size (i));
+		if (blocks[i] == NULL)
+			fail ("malloc of block %zu failed", i);
+		memset (blocks[i], i, block_size (i));
+	}
+	for (i = 0; i < BLOCK_CNT; i++)
+		check_block (i);
+	msg ("malloc odd blocks again");
+
+	for (i = 0; i < BLOCK_CNT; i++) {
+		size_t old_size = block_size (i);
+		size_t j;
+
+		blocks[i] = realloc (blocks[i], old_size * 3);
+		if (blocks[i] == NULL)
+			fail ("realloc of block %zu failed", i);
+		for (j = 0; j < old_size; j++)
+			if (blocks[i][j] != (char) i)
+				fail ("byte %zu of block %zu lost in realloc", j, i);
+		free (blocks[i]);
+	}
+	msg ("realloc and free all blocks");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(heap-malloc) begin
+(heap-malloc) calloc big block
+(heap-malloc) check if big block is zero
+(heap-malloc) free big block shrinks heap
+(heap-malloc) malloc 200 blocks
+(heap-malloc) free odd blocks
+(heap-malloc) malloc odd blocks again
+(heap-malloc) realloc and free all blocks
+(heap-malloc) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Grows the heap with sbrk(), checks that its new pages are loaded
+   only when touched and start out zero, then shrinks it and checks
+   that the pages it shrank out of are gone. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_COUNT 3
+
+void
+test_main (void)
+{
+	char *start = sbrk (0);
+	size_t i, j;
+
+	CHECK (start != NULL, "sbrk (0)");
+	CHECK (sbrk (PAGE_COUNT * PAGE_SIZE) == start,
+			"grow heap by %d pages", PAGE_COUNT);
+	CHECK (sbrk (0) == start + PAGE_COUNT * PAGE_SIZE, "check break");
+	for (i = 0; i < PAGE_COUNT; i++)
+		CHECK (get_phys_addr (start + i * PAGE_SIZE) == 0,
+				"check if page is not loaded");
+
+	for (i = 0; i < PAGE_COUNT * PAGE_SIZE; i++)
+		if (start[i] != 0)
+			fail ("byte %zu of heap is %d, not 0", i, start[i]);
+	msg ("check if heap is zero");
+	for (i = 0; i < PAGE_COUNT; i++)
+		memset (start + i * PAGE_SIZE, i + 1, PAGE_SIZE);
+	for (i = 0; i < PAGE_COUNT; i++)
+		for (j = 0; j < PAGE_SIZE; j++)
+			if (start[i * PAGE_SIZE + j] != (char) (i + 1))
+				fail ("byte %zu of page %zu is wrong", j, i);
+	msg ("check memory content");
+
+	CHECK (sbrk (-(PAGE_COUNT - 1) * PAGE_SIZE)
+			== start + PAGE_COUNT * PAGE_SIZE, "shrink heap to 1 page");
+	CHECK (start[0] == 1 && start[PAGE_SIZE - 1] == 1,
+			"check first page is kept");
+	CHECK (sbrk (-2 * PAGE_SIZE) == NULL, "shrink below start of heap");
+	CHECK (sbrk (0) == start + PAGE_SIZE, "check break");
+	CHECK (sbrk (PAGE_SIZE) == start + PAGE_SIZE, "grow heap by 1 page");
+	CHECK (start[PAGE_SIZE] == 0, "check page is zero again");
+
+	msg ("write past the break");
+	start[2 * PAGE_SIZE] = 1;
+	fail ("should have exited with -1");
+}
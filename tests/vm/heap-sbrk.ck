@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(heap-sbrk) begin
+(heap-sbrk) sbrk (0)
+(heap-sbrk) grow heap by 3 pages
+(heap-sbrk) check break
+(heap-sbrk) check if page is not loaded
+(heap-sbrk) check if page is not loaded
+(heap-sbrk) check if page is not loaded
+(heap-sbrk) check if heap is zero
+(heap-sbrk) check memory content
+(heap-sbrk) shrink heap to 1 page
+(heap-sbrk) check first page is kept
+(heap-sbrk) shrink below start of heap
+(heap-sbrk) check break
+(heap-sbrk) grow heap by 1 page
+(heap-sbrk) check page is zero again
+(heap-sbrk) write past the break
+heap-sbrk: exit(-1)
+EOF
+pass;
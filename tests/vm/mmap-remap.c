@@ -0,0 +1,58 @@
+/* Grows an anonymous mapping in place with mremap(), then, with the
+   page after it taken, moves it and checks that its pages went along
+   without being copied: the first keeps its frame, all keep their
+   contents.  Last, shrinks it and checks that the pages it shrank out
+   of are gone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ADDR ((char *) 0x10000000)
+
+static void
+check_bytes (const char *p, size_t start, size_t end, char c)
+{
+	size_t i;
+
+	for (i = start; i < end; i++)
+		if (p[i] != c)
+			fail ("byte %zu is %d, not %d", i, p[i], c);
+}
+
+void
+test_main (void)
+{
+	char *p, *q;
+	void *phys;
+
+	p = mmap (ADDR, 2 * PAGE_SIZE, 1, MAP_ANON_FD, 0);
+	CHECK (p == ADDR, "mmap 2 pages");
+	memset (p, 'a', 2 * PAGE_SIZE);
+	CHECK (mremap (p, 2 * PAGE_SIZE, 3 * PAGE_SIZE, 0) == p,
+			"grow in place to 3 pages");
+	check_bytes (p, 0, 2 * PAGE_SIZE, 'a');
+	check_bytes (p, 2 * PAGE_SIZE, 3 * PAGE_SIZE, 0);
+	msg ("check contents");
+
+	CHECK (mmap (p + 3 * PAGE_SIZE, PAGE_SIZE, 1, MAP_ANON_FD, 0)
+			!= MAP_FAILED, "mmap the page after");
+	CHECK (mremap (p, 3 * PAGE_SIZE, 4 * PAGE_SIZE, 0) == MAP_FAILED,
+			"grow without MREMAP_MAYMOVE");
+	phys = get_phys_addr (p);
+	q = mremap (p, 3 * PAGE_SIZE, 4 * PAGE_SIZE, MREMAP_MAYMOVE);
+	CHECK (q != MAP_FAILED && q != p, "move to 4 pages");
+	CHECK (get_phys_addr (q) == phys, "check first page kept its frame");
+	check_bytes (q, 0, 2 * PAGE_SIZE, 'a');
+	check_bytes (q, 2 * PAGE_SIZE, 4 * PAGE_SIZE, 0);
+	msg ("check contents");
+	CHECK (get_phys_addr (p) == NULL, "check old address is unmapped");
+
+	CHECK (mremap (q, 4 * PAGE_SIZE, PAGE_SIZE, 0) == q, "shrink to 1 page");
+	CHECK (q[0] == 'a', "check first page is kept");
+	msg ("touch a page shrunk away");
+	q[PAGE_SIZE] = 1;
+	fail ("should have exited with -1");
+}
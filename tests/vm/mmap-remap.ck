@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(mmap-remap) begin
+(mmap-remap) mmap 2 pages
+(mmap-remap) grow in place to 3 pages
+(mmap-remap) check contents
+(mmap-remap) mmap the page after
+(mmap-remap) grow without MREMAP_MAYMOVE
+(mmap-remap) move to 4 pages
+(mmap-remap) check first page kept its frame
+(mmap-remap) check contents
+(mmap-remap) check old address is unmapped
+(mmap-remap) shrink to 1 page
+(mmap-remap) check first page is kept
+(mmap-remap) touch a page shrunk away
+mmap-remap: exit(-1)
+EOF
+pass;
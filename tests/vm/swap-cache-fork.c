@@ -0,0 +1,68 @@
+/* Swaps pages in, writes to them, and forks a child that exits at
+   once, which leaves the pages read-only for copy-on-write and then
+   alone on their frames again.  Then forces them out once more and
+   checks that the writes were not lost: the pages no longer match
+   the swap slots they were read from, so evicting them must write
+   them out.  Pintos has 10 MB of memory for this test. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define CHUNK_SIZE (20 * ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+#define DIRTY_COUNT 64
+
+static char big_chunks[CHUNK_SIZE];
+
+/* Touches every page, which evicts the ones touched longest ago. */
+static void
+sweep (void)
+{
+	size_t i;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		big_chunks[i * PAGE_SIZE + 1] = 1;
+}
+
+void
+test_main (void)
+{
+	size_t i;
+	pid_t pid;
+
+	for (i = 0; i < PAGE_COUNT; i++)
+		big_chunks[i * PAGE_SIZE] = (char) i;
+	msg ("write every page");
+
+	/* The first pages were evicted long ago: swap them back in and
+	   write to them. */
+	for (i = 0; i < DIRTY_COUNT; i++) {
+		if (big_chunks[i * PAGE_SIZE] != (char) i)
+			fail ("page %zu is wrong after swapping in", i);
+		big_chunks[i * PAGE_SIZE] = (char) ~i;
+	}
+	msg ("swap in and write %d pages", DIRTY_COUNT);
+
+	pid = fork ("child");
+	if (pid == 0)
+		exit (0);
+	CHECK (pid > 0, "fork");
+	CHECK (wait (pid) == 0, "wait for child");
+
+	sweep ();
+	msg ("swap them out again");
+
+	for (i = 0; i < PAGE_COUNT; i++) {
+		char expected = i < DIRTY_COUNT ? (char) ~i : (char) i;
+
+		if (big_chunks[i * PAGE_SIZE] != expected)
+			fail ("page %zu is %d, not %d", i, big_chunks[i * PAGE_SIZE],
+					expected);
+	}
+	msg ("check every page");
+}
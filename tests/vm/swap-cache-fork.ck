@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-cache-fork) begin
+(swap-cache-fork) write every page
+(swap-cache-fork) swap in and write 64 pages
+(swap-cache-fork) fork
+(swap-cache-fork) wait for child
+(swap-cache-fork) swap them out again
+(swap-cache-fork) check every page
+(swap-cache-fork) end
+EOF
+pass;
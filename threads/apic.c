@@ -0,0 +1,106 @@
+#include "threads/apic.h"
+#include <debug.h>
+#include "intrinsic.h"
+#include "threads/interrupt.h"
+
+/* Local APIC of the bootstrap processor, in x2APIC mode, where its
+   registers are MSRs: an end of interrupt is one wrmsr, which
+   hypervisors handle without decoding an I/O or MMIO access, rather
+   than the 8259's two port writes.  Processors without x2APIC keep
+   the 8259 and 8254.  See [IA32-v3a] chapter 10, "Advanced
+   Programmable Interrupt Controller".
+
+   External interrupts other than the timer's still come from the
+   8259, through LINT0 in virtual wire mode, and are acknowledged
+   there. */
+
+bool apic_timer_active;
+
+/* MSRs. */
+#define IA32_APIC_BASE 0x1b
+#define APIC_BASE_EXTD (1 << 10)        /* x2APIC mode. */
+#define APIC_BASE_EN (1 << 11)          /* APIC enabled. */
+#define X2APIC_TPR 0x808                /* Task priority. */
+#define X2APIC_EOI 0x80b                /* End of interrupt. */
+#define X2APIC_SVR 0x80f                /* Spurious interrupt vector. */
+#define X2APIC_LVT_TIMER 0x832
+#define X2APIC_LVT_LINT0 0x835
+#define X2APIC_LVT_LINT1 0x836
+#define X2APIC_TIMER_INIT 0x838         /* Timer initial count. */
+#define X2APIC_TIMER_CUR 0x839          /* Timer current count. */
+#define X2APIC_TIMER_DIV 0x83e          /* Timer divide configuration. */
+
+#define SVR_ENABLE (1 << 8)             /* APIC software enable. */
+#define LVT_MASKED (1 << 16)
+#define LVT_PERIODIC (1 << 17)          /* Timer mode. */
+#define LVT_EXTINT (7 << 8)             /* Delivery modes. */
+#define LVT_NMI (4 << 8)
+#define TIMER_DIV_16 0x3
+
+/* Vector of spurious interrupts, which need no end of interrupt. */
+#define SPURIOUS_VEC 0xff
+
+static intr_handler_func spurious_interrupt;
+
+/* Switches the local APIC to x2APIC mode and enables it, keeping the
+   8259 in virtual wire mode on LINT0.  Returns false, changing
+   nothing, if the processor has no x2APIC. */
+bool
+apic_init (void) {
+	uint32_t eax, ebx, ecx, edx;
+	uint64_t base;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & (1 << 21)))
+		return false;
+
+	/* xAPIC mode must be on before x2APIC mode. */
+	base = read_msr (IA32_APIC_BASE);
+	write_msr (IA32_APIC_BASE, base | APIC_BASE_EN);
+	write_msr (IA32_APIC_BASE, base | APIC_BASE_EN | APIC_BASE_EXTD);
+
+	intr_register_int (SPURIOUS_VEC, 0, INTR_OFF, spurious_interrupt,
+			"APIC spurious");
+	write_msr (X2APIC_TPR, 0);
+	write_msr (X2APIC_LVT_LINT0, LVT_EXTINT);
+	write_msr (X2APIC_LVT_LINT1, LVT_NMI);
+	write_msr (X2APIC_LVT_TIMER, LVT_MASKED);
+	write_msr (X2APIC_SVR, SVR_ENABLE | SPURIOUS_VEC);
+	return true;
+}
+
+/* Acknowledges the interrupt the local APIC delivered last. */
+void
+apic_eoi (void) {
+	write_msr (X2APIC_EOI, 0);
+}
+
+/* Starts the timer counting down from COUNT, at a sixteenth of the
+   bus clock, without interrupting, for measuring its rate. */
+void
+apic_timer_oneshot (uint32_t count) {
+	write_msr (X2APIC_TIMER_DIV, TIMER_DIV_16);
+	write_msr (X2APIC_LVT_TIMER, LVT_MASKED);
+	write_msr (X2APIC_TIMER_INIT, count);
+}
+
+/* Makes the timer interrupt at VEC every COUNT sixteenths of the bus
+   clock, from now on. */
+void
+apic_timer_periodic (uint8_t vec, uint32_t count) {
+	ASSERT (count > 0);
+	write_msr (X2APIC_TIMER_DIV, TIMER_DIV_16);
+	write_msr (X2APIC_LVT_TIMER, LVT_PERIODIC | vec);
+	write_msr (X2APIC_TIMER_INIT, count);
+}
+
+/* Returns the timer's current count. */
+uint32_t
+apic_timer_count (void) {
+	return read_msr (X2APIC_TIMER_CUR);
+}
+
+/* A spurious interrupt: ignored. */
+static void
+spurious_interrupt (struct intr_frame *f UNUSED) {
+}
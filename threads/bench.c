@@ -0,0 +1,393 @@
+#include "threads/bench.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Microbenchmarks of the kernel's own primitives, for the "bench"
+   action: each times a loop of one operation with the TSC and prints
+   a line
+
+       bench=NAME iters=N cycles=C cycles_per_op=C/N ns_per_op=...
+
+   in the form tests/bench/bench-compare reads, so that a change to a
+   primitive can be measured apart from the workloads using it.
+   Interrupts stay on, so a timer tick now and then is counted; runs
+   are long enough for that not to matter. */
+
+/* Elements for the list and hash benchmarks. */
+#define ELEM_CNT 1024
+struct elem {
+	struct list_elem list_elem;
+	struct hash_elem hash_elem;
+	unsigned key;
+};
+static struct elem elems[ELEM_CNT];
+#define KEY_CNT (PRI_MAX - PRI_MIN + 1)  /* Keys, as many as priorities. */
+
+/* A benchmark: runs its operation ITERS times, or ITERS times in all
+   over several rounds, with START and STOP taken around the timed
+   part only.  Returns the number of operations timed. */
+struct bench {
+	const char *name;
+	long long (*function) (void);
+};
+
+static uint64_t cycles;                 /* Accumulated by start/stop. */
+static uint64_t start_tsc;
+
+static void
+start (void) {
+	start_tsc = rdtsc ();
+}
+
+static void
+stop (void) {
+	cycles += rdtsc () - start_tsc;
+}
+
+/* Gives the elements keys spread over KEY_CNT the same way on each
+   run, without disturbing the kernel's random numbers. */
+static void
+fill_keys (void) {
+	size_t i;
+
+	for (i = 0; i < ELEM_CNT; i++)
+		elems[i].key = (i * 2654435761u >> 16) % KEY_CNT;
+}
+
+/* malloc() then free() of one block of SIZE bytes, which mostly hits
+   the running thread's magazine of its size class. */
+static long long
+malloc_size (size_t size) {
+	const int iters = 10000;
+	int i;
+
+	free (malloc (size));
+	start ();
+	for (i = 0; i < iters; i++)
+		free (malloc (size));
+	stop ();
+	return iters;
+}
+
+static long long bench_malloc_16 (void) { return malloc_size (16); }
+static long long bench_malloc_64 (void) { return malloc_size (64); }
+static long long bench_malloc_256 (void) { return malloc_size (256); }
+static long long bench_malloc_1024 (void) { return malloc_size (1024); }
+static long long bench_malloc_4096 (void) { return malloc_size (4096); }
+
+/* palloc_get_multiple() then palloc_free_multiple() of CNT pages. */
+static long long
+palloc_pages (size_t cnt) {
+	const int iters = 2000;
+	int i;
+
+	start ();
+	for (i = 0; i < iters; i++) {
+		void *p = palloc_get_multiple (0, cnt);
+
+		if (p == NULL)
+			PANIC ("bench: out of pages");
+		palloc_free_multiple (p, cnt);
+	}
+	stop ();
+	return iters;
+}
+
+static long long bench_palloc_1 (void) { return palloc_pages (1); }
+static long long bench_palloc_8 (void) { return palloc_pages (8); }
+
+static bool
+elem_less (const struct list_elem *a, const struct list_elem *b,
+		void *aux UNUSED) {
+	return list_entry (a, struct elem, list_elem)->key
+		< list_entry (b, struct elem, list_elem)->key;
+}
+
+/* Insertion of ELEM_CNT elements with random keys into one list kept
+   in order, O(n) each. */
+static long long
+bench_list_ordered (void) {
+	struct list list;
+	size_t i;
+
+	fill_keys ();
+	list_init (&list);
+	start ();
+	for (i = 0; i < ELEM_CNT; i++)
+		list_insert_ordered (&list, &elems[i].list_elem, elem_less, NULL);
+	stop ();
+	return ELEM_CNT;
+}
+
+/* The same keys pushed onto one list per key, as the run queues keep
+   threads by priority, O(1) each. */
+static long long
+bench_list_bucketed (void) {
+	static struct list buckets[KEY_CNT];
+	size_t i;
+
+	fill_keys ();
+	for (i = 0; i < KEY_CNT; i++)
+		list_init (&buckets[i]);
+	start ();
+	for (i = 0; i < ELEM_CNT; i++)
+		list_push_back (&buckets[elems[i].key], &elems[i].list_elem);
+	stop ();
+	return ELEM_CNT;
+}
+
+static uint64_t
+elem_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct elem, hash_elem)->key);
+}
+
+static bool
+elem_hash_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct elem, hash_elem)->key
+		< hash_entry (b, struct elem, hash_elem)->key;
+}
+
+/* Fills H, which it initializes, with ELEM_CNT distinct keys. */
+static void
+hash_fill (struct hash *h, bool timed) {
+	size_t i;
+
+	if (!hash_init (h, elem_hash, elem_hash_less, NULL))
+		PANIC ("bench: out of memory");
+	for (i = 0; i < ELEM_CNT; i++)
+		elems[i].key = i * 7919;
+	if (timed)
+		start ();
+	for (i = 0; i < ELEM_CNT; i++)
+		hash_insert (h, &elems[i].hash_elem);
+	if (timed)
+		stop ();
+}
+
+/* hash_insert() of ELEM_CNT keys into a table starting empty,
+   rehashing as it grows. */
+static long long
+bench_hash_insert (void) {
+	const int rounds = 10;
+	struct hash h;
+	int r;
+
+	for (r = 0; r < rounds; r++) {
+		hash_fill (&h, true);
+		hash_destroy (&h, NULL);
+	}
+	return rounds * ELEM_CNT;
+}
+
+/* hash_find() of each key of a full table. */
+static long long
+bench_hash_find (void) {
+	const int rounds = 10;
+	struct elem probe;
+	struct hash h;
+	int r;
+	size_t i;
+
+	hash_fill (&h, false);
+	start ();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < ELEM_CNT; i++) {
+			probe.key = i * 7919;
+			hash_find (&h, &probe.hash_elem);
+		}
+	stop ();
+	hash_destroy (&h, NULL);
+	return rounds * ELEM_CNT;
+}
+
+/* hash_delete() of every key, rehashing as the table shrinks. */
+static long long
+bench_hash_delete (void) {
+	const int rounds = 10;
+	struct hash h;
+	int r;
+	size_t i;
+
+	for (r = 0; r < rounds; r++) {
+		hash_fill (&h, false);
+		start ();
+		for (i = 0; i < ELEM_CNT; i++)
+			hash_delete (&h, &elems[i].hash_elem);
+		stop ();
+		hash_destroy (&h, NULL);
+	}
+	return rounds * ELEM_CNT;
+}
+
+/* bitmap_scan() for a free bit in a map of 64 kB of sectors whose
+   first seven eighths are in use, as a filling free map is. */
+static long long
+bench_bitmap_scan (void) {
+	const size_t bits = 65536;
+	const int iters = 1000;
+	struct bitmap *b = bitmap_create (bits);
+	int i;
+
+	if (b == NULL)
+		PANIC ("bench: out of memory");
+	bitmap_set_multiple (b, 0, bits / 8 * 7, true);
+	start ();
+	for (i = 0; i < iters; i++)
+		if (bitmap_scan (b, 0, 1, false) == BITMAP_ERROR)
+			PANIC ("bench: bitmap full");
+	stop ();
+	bitmap_destroy (b);
+	return iters;
+}
+
+/* lock_acquire() then lock_release() of a lock no one else wants. */
+static long long
+bench_lock (void) {
+	const int iters = 100000;
+	struct lock lock;
+	int i;
+
+	lock_init (&lock);
+	start ();
+	for (i = 0; i < iters; i++) {
+		lock_acquire (&lock);
+		lock_release (&lock);
+	}
+	stop ();
+	return iters;
+}
+
+/* Two semaphores passing control to a second thread and back, two
+   thread switches per round trip. */
+#define PINGPONG_ITERS 10000
+struct pingpong {
+	struct semaphore ping, pong;
+};
+
+static void
+pong_thread (void *pp_) {
+	struct pingpong *pp = pp_;
+	int i;
+
+	for (i = 0; i < PINGPONG_ITERS; i++) {
+		sema_down (&pp->ping);
+		sema_up (&pp->pong);
+	}
+}
+
+static long long
+bench_sema_pingpong (void) {
+	struct pingpong pp;
+	int i;
+
+	sema_init (&pp.ping, 0);
+	sema_init (&pp.pong, 0);
+	if (thread_create ("pong", thread_get_priority (), pong_thread, &pp)
+			== TID_ERROR)
+		PANIC ("bench: can't create thread");
+	start ();
+	for (i = 0; i < PINGPONG_ITERS; i++) {
+		sema_up (&pp.ping);
+		sema_down (&pp.pong);
+	}
+	stop ();
+	return PINGPONG_ITERS;
+}
+
+/* memcpy() and memset() of a page. */
+static long long
+bench_memcpy_4k (void) {
+	const int iters = 2000;
+	uint8_t *p = palloc_get_multiple (PAL_ASSERT, 2);
+	int i;
+
+	start ();
+	for (i = 0; i < iters; i++)
+		memcpy (p, p + PGSIZE, PGSIZE);
+	stop ();
+	palloc_free_multiple (p, 2);
+	return iters;
+}
+
+static long long
+bench_memset_4k (void) {
+	const int iters = 2000;
+	uint8_t *p = palloc_get_page (PAL_ASSERT);
+	int i;
+
+	start ();
+	for (i = 0; i < iters; i++)
+		memset (p, i, PGSIZE);
+	stop ();
+	palloc_free_page (p);
+	return iters;
+}
+
+/* The benchmarks, in the order "bench all" runs them. */
+static const struct bench benches[] = {
+	{"malloc_16", bench_malloc_16},
+	{"malloc_64", bench_malloc_64},
+	{"malloc_256", bench_malloc_256},
+	{"malloc_1024", bench_malloc_1024},
+	{"malloc_4096", bench_malloc_4096},
+	{"palloc_1", bench_palloc_1},
+	{"palloc_8", bench_palloc_8},
+	{"list_ordered", bench_list_ordered},
+	{"list_bucketed", bench_list_bucketed},
+	{"hash_insert", bench_hash_insert},
+	{"hash_find", bench_hash_find},
+	{"hash_delete", bench_hash_delete},
+	{"bitmap_scan", bench_bitmap_scan},
+	{"lock", bench_lock},
+	{"sema_pingpong", bench_sema_pingpong},
+	{"memcpy_4k", bench_memcpy_4k},
+	{"memset_4k", bench_memset_4k},
+};
+
+/* Runs B and prints its result line. */
+static void
+run_one (const struct bench *b) {
+	long long ops;
+	int64_t ns;
+
+	cycles = 0;
+	ops = b->function ();
+	if (ops <= 0)
+		ops = 1;
+	ns = timer_tsc_to_ns (cycles);
+	printf ("bench=%s iters=%lld cycles=%"PRIu64" cycles_per_op=%"PRIu64
+			" ns_per_op=%"PRId64"\n", b->name, ops, cycles, cycles / ops,
+			ns >= 0 ? ns / ops : -1);
+}
+
+/* Runs the benchmark called NAME, or every one if NAME is "all". */
+void
+bench_run (const char *name) {
+	size_t i;
+	bool found = false;
+
+	for (i = 0; i < sizeof benches / sizeof *benches; i++)
+		if (!strcmp (name, "all") || !strcmp (name, benches[i].name)) {
+			run_one (&benches[i]);
+			found = true;
+		}
+	if (!found) {
+		printf ("bench: no benchmark `%s'; there are:", name);
+		for (i = 0; i < sizeof benches / sizeof *benches; i++)
+			printf (" %s", benches[i].name);
+		printf ("\n");
+	}
+}
@@ -0,0 +1,171 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/vaddr.h"
+
+/* Processor discovery, from the MP configuration tables of the
+   Intel MultiProcessor Specification 1.4, which the BIOS leaves in
+   low memory.  Without MP tables, as on a BIOS that predates them,
+   the bootstrap processor is taken to be the only one.
+
+   Processors other than the bootstrap processor are found but not
+   started: the kernel's mutual exclusion is interrupt disabling
+   throughout, which only excludes other threads on the same
+   processor. */
+
+struct cpu cpus[CPU_MAX];
+size_t cpu_cnt;
+uint32_t lapic_paddr;
+
+/* MP floating pointer structure. */
+struct mp_float {
+	char signature[4];          /* "_MP_". */
+	uint32_t config;            /* Physical address of mp_config. */
+	uint8_t length;             /* In 16-byte units: 1. */
+	uint8_t spec_rev;
+	uint8_t checksum;           /* All bytes sum to 0. */
+	uint8_t type;               /* Default configuration, or 0. */
+	uint8_t features[4];
+} __attribute__ ((packed));
+
+/* MP configuration table header. */
+struct mp_config {
+	char signature[4];          /* "PCMP". */
+	uint16_t length;            /* Of the base table, in bytes. */
+	uint8_t version;
+	uint8_t checksum;           /* Base table bytes sum to 0. */
+	char oem_id[8];
+	char product_id[12];
+	uint32_t oem_table;
+	uint16_t oem_length;
+	uint16_t entry_cnt;
+	uint32_t lapic;             /* Physical address of local APICs. */
+	uint16_t ext_length;
+	uint8_t ext_checksum;
+	uint8_t reserved;
+} __attribute__ ((packed));
+
+/* Processor entry of the configuration table. */
+struct mp_processor {
+	uint8_t type;               /* MP_PROCESSOR. */
+	uint8_t apic_id;
+	uint8_t apic_version;
+	uint8_t flags;              /* MP_CPU_*. */
+	uint32_t signature;
+	uint32_t features;
+	uint8_t reserved[8];
+} __attribute__ ((packed));
+
+#define MP_PROCESSOR 0          /* Entry types. */
+#define MP_CPU_ENABLED 0x01     /* Processor entry flags. */
+#define MP_CPU_BSP 0x02
+
+static struct mp_float *mp_search (void);
+static struct mp_float *mp_search_range (uint64_t pa, size_t size);
+static bool checksum_ok (const void *, size_t size);
+
+/* Finds the processors of the machine. */
+void
+cpu_init (void) {
+	struct mp_float *mpf = mp_search ();
+	struct mp_config *conf;
+	uint8_t *entry, *end;
+	size_t i;
+
+	cpu_cnt = 0;
+	conf = mpf != NULL && mpf->config != 0 ? ptov (mpf->config) : NULL;
+	if (conf != NULL && !memcmp (conf->signature, "PCMP", 4)
+			&& checksum_ok (conf, conf->length)) {
+		lapic_paddr = conf->lapic;
+		entry = (uint8_t *) (conf + 1);
+		end = (uint8_t *) conf + conf->length;
+		for (i = 0; i < conf->entry_cnt && entry < end; i++) {
+			if (*entry == MP_PROCESSOR) {
+				struct mp_processor *p = (struct mp_processor *) entry;
+
+				if ((p->flags & MP_CPU_ENABLED) && cpu_cnt < CPU_MAX)
+					cpus[cpu_cnt++] = (struct cpu) {
+						.apic_id = p->apic_id,
+						.bsp = (p->flags & MP_CPU_BSP) != 0,
+						.running = (p->flags & MP_CPU_BSP) != 0,
+					};
+				entry += sizeof *p;
+			} else
+				/* All other base entries are 8 bytes. */
+				entry += 8;
+		}
+	}
+
+	if (cpu_cnt == 0) {
+		cpus[0] = (struct cpu) { .apic_id = 0, .bsp = true, .running = true };
+		cpu_cnt = 1;
+	}
+
+	/* Put the bootstrap processor first, as cpu_id() has it. */
+	for (i = 1; i < cpu_cnt; i++)
+		if (cpus[i].bsp) {
+			struct cpu tmp = cpus[0];
+
+			cpus[0] = cpus[i];
+			cpus[i] = tmp;
+		}
+}
+
+/* Prints the processors found. */
+void
+cpu_print_stats (void) {
+	size_t i, running = 0;
+
+	for (i = 0; i < cpu_cnt; i++)
+		if (cpus[i].running)
+			running++;
+	printf ("CPUs: %zu found, %zu running\n", cpu_cnt, running);
+}
+
+/* Returns the MP floating pointer structure, or a null pointer if
+   there is none.  It is in the first kB of the extended BIOS data
+   area, in the last kB of base memory, or in the BIOS ROM. */
+static struct mp_float *
+mp_search (void) {
+	uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+	uint16_t base_kb = *(uint16_t *) ptov (0x413);
+	struct mp_float *mpf = NULL;
+
+	if (ebda_seg != 0)
+		mpf = mp_search_range ((uint64_t) ebda_seg << 4, 1024);
+	if (mpf == NULL && base_kb != 0)
+		mpf = mp_search_range ((uint64_t) base_kb * 1024 - 1024, 1024);
+	if (mpf == NULL)
+		mpf = mp_search_range (0xf0000, 0x10000);
+	return mpf;
+}
+
+/* Returns the MP floating pointer structure in the SIZE bytes of
+   physical memory at PA, or a null pointer if there is none.  It is
+   16-byte aligned. */
+static struct mp_float *
+mp_search_range (uint64_t pa, size_t size) {
+	uint8_t *p = ptov (pa);
+	uint8_t *end = p + size;
+
+	for (; p + sizeof (struct mp_float) <= end; p += 16) {
+		struct mp_float *mpf = (struct mp_float *) p;
+
+		if (!memcmp (mpf->signature, "_MP_", 4)
+				&& checksum_ok (mpf, mpf->length * 16))
+			return mpf;
+	}
+	return NULL;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0. */
+static bool
+checksum_ok (const void *p_, size_t size) {
+	const uint8_t *p = p_;
+	uint8_t sum = 0;
+
+	while (size-- > 0)
+		sum += *p++;
+	return sum == 0;
+}
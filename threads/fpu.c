@@ -0,0 +1,263 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* x87, SSE and AVX state of user threads.
+
+   The kernel is built with -msoft-float -mno-sse and never touches
+   these registers, so they hold the state of one thread at most, the
+   "owner", and are saved only when another thread wants them.
+   CR0.TS is set whenever the running thread is not the owner, so its
+   first x87 or SIMD instruction raises #NM.  fpu_claim(), called for
+   it, saves the owner's registers in the owner's save area, loads
+   the running thread's, and makes it the owner.  A thread that never
+   uses these registers never gets a save area, and costs a thread
+   switch nothing more than, at times, a write to CR0.
+
+   The save area is XSAVE's, holding every component XCR0 enables,
+   if the processor has XSAVE, and FXSAVE's 512 bytes of x87 and SSE
+   state otherwise.  Without FXSAVE, SIMD instructions keep raising
+   #UD and the thread is killed, as before. */
+
+#define CR0_MP (1 << 1)                 /* Monitor coprocessor. */
+#define CR0_EM (1 << 2)                 /* Emulate the x87. */
+#define CR0_TS (1 << 3)                 /* Task switched. */
+#define CR4_OSFXSR (1 << 9)             /* FXSAVE and SSE enabled. */
+#define CR4_OSXMMEXCPT (1 << 10)        /* SIMD exceptions raise #XF. */
+#define CR4_OSXSAVE (1 << 18)           /* XSAVE and XCR0 enabled. */
+#define CPUID_1_EDX_FXSR (1 << 24)
+#define CPUID_1_ECX_XSAVE (1 << 26)
+#define CPUID_1_ECX_AVX (1 << 28)
+#define XCR0_X87 (1 << 0)               /* State components. */
+#define XCR0_SSE (1 << 1)
+#define XCR0_AVX (1 << 2)
+
+/* Save areas need 16-byte alignment for FXSAVE, 64 for XSAVE. */
+#define AREA_ALIGN 64
+
+/* Control words in a fresh area: every exception masked. */
+#define FCW_INIT 0x037f
+#define MXCSR_INIT 0x1f80
+
+/* Start of the FXSAVE area, and of XSAVE's, which begins likewise. */
+struct fxsave_legacy {
+	uint16_t fcw;
+	uint16_t fsw;
+	uint8_t ftw;
+	uint8_t reserved;
+	uint16_t fop;
+	uint64_t fip;
+	uint64_t fdp;
+	uint32_t mxcsr;
+	uint32_t mxcsr_mask;
+};
+
+static bool fpu_enabled;                /* Have FXSAVE? */
+static bool use_xsave;                  /* Have XSAVE? */
+static uint64_t xcr0;                   /* Components XSAVE saves. */
+static size_t area_size;                /* Bytes in a save area. */
+
+/* Thread whose state is in the registers, or null, and whether
+   CR0.TS is set.  Interrupts are off whenever these are looked at
+   outside fpu_init(). */
+static struct thread *owner;
+static bool ts_set;
+
+/* Statistics. */
+static long long claim_cnt;             /* # of times a thread took the registers. */
+static long long save_cnt;              /* # of times an owner's state was saved. */
+
+static void *area_of (struct thread *);
+static bool area_alloc (struct thread *);
+static void save (struct thread *);
+static void restore (struct thread *);
+static void set_ts (bool);
+
+/* Enables x87 and SSE instructions, and AVX if the processor has
+   XSAVE and AVX, for user threads to claim lazily. */
+void
+fpu_init (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (!(edx & CPUID_1_EDX_FXSR))
+		return;
+	lcr4 (rcr4 () | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	area_size = 512;
+	if (ecx & CPUID_1_ECX_XSAVE) {
+		xcr0 = XCR0_X87 | XCR0_SSE | (ecx & CPUID_1_ECX_AVX ? XCR0_AVX : 0);
+		lcr4 (rcr4 () | CR4_OSXSAVE);
+		__asm __volatile ("xsetbv"
+				: : "c" (0), "a" ((uint32_t) xcr0), "d" ((uint32_t) (xcr0 >> 32)));
+		/* EBX of leaf 0xd is the area size for what XCR0 enables. */
+		cpuid (0xd, &eax, &ebx, &ecx, &edx);
+		area_size = ebx;
+		use_xsave = true;
+	}
+	lcr0 ((rcr0 () & ~CR0_EM) | CR0_MP | CR0_TS);
+	ts_set = true;
+	fpu_enabled = true;
+}
+
+/* Sets CR0.TS for NEXT, which is about to run, unless NEXT owns the
+   registers.  Interrupts must be off. */
+void
+fpu_switch (struct thread *next) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (fpu_enabled)
+		set_ts (next != owner);
+}
+
+/* Gives the running thread the registers, with the state it left in
+   them, for #NM.  Returns false if the processor has no FXSAVE or
+   memory for a save area ran out. */
+bool
+fpu_claim (void) {
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
+
+	if (!fpu_enabled)
+		return false;
+	/* malloc() may sleep, so get the area before turning interrupts
+	   off.  Other threads may take the registers meanwhile. */
+	if (t->fpu == NULL && !area_alloc (t))
+		return false;
+
+	old_level = intr_disable ();
+	set_ts (false);
+	if (owner != t) {
+		if (owner != NULL)
+			save (owner);
+		restore (t);
+		owner = t;
+		claim_cnt++;
+	}
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Gives the running thread, a child being forked, a copy of the
+   state of PARENT, which is waiting for the fork.  Returns false if
+   memory ran out. */
+bool
+fpu_copy (struct thread *parent) {
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
+
+	if (parent->fpu == NULL)
+		return true;
+	if (t->fpu == NULL && !area_alloc (t))
+		return false;
+
+	old_level = intr_disable ();
+	if (owner == parent) {
+		/* The parent keeps the registers; TS is set again once they
+		   are saved, for this thread does not own them. */
+		set_ts (false);
+		save (parent);
+		set_ts (true);
+	}
+	memcpy (area_of (t), area_of (parent), area_size);
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Drops the running thread's state, if any, so that its next x87
+   or SIMD instruction starts from a fresh one.  Called when the
+   thread exits or runs a new program. */
+void
+fpu_release (void) {
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
+
+	if (t->fpu == NULL)
+		return;
+	old_level = intr_disable ();
+	if (owner == t) {
+		owner = NULL;
+		set_ts (true);
+	}
+	intr_set_level (old_level);
+	free (t->fpu);
+	t->fpu = NULL;
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) {
+	if (fpu_enabled)
+		printf ("FPU: %s, %zu-byte areas, %lld claims, %lld saves\n",
+				use_xsave ? "xsave" : "fxsave", area_size, claim_cnt,
+				save_cnt);
+}
+
+/* Returns T's save area, aligned within the block T->fpu. */
+static void *
+area_of (struct thread *t) {
+	return (void *) ROUND_UP ((uintptr_t) t->fpu, AREA_ALIGN);
+}
+
+/* Gives T a save area holding the state the registers have after
+   FNINIT, with every SIMD exception masked as well.  Returns false
+   if memory ran out. */
+static bool
+area_alloc (struct thread *t) {
+	struct fxsave_legacy *legacy;
+
+	t->fpu = malloc (area_size + AREA_ALIGN - 1);
+	if (t->fpu == NULL)
+		return false;
+	/* With XSAVE, the zeroed header marks each component as in its
+	   initial state, except for MXCSR, which XRSTOR loads anyway. */
+	legacy = area_of (t);
+	memset (legacy, 0, area_size);
+	legacy->fcw = FCW_INIT;
+	legacy->mxcsr = MXCSR_INIT;
+	return true;
+}
+
+/* Saves the registers in T's area.  CR0.TS must be clear. */
+static void
+save (struct thread *t) {
+	void *area = area_of (t);
+
+	if (use_xsave)
+		__asm __volatile ("xsave64 (%0)"
+				: : "r" (area), "a" ((uint32_t) xcr0),
+				"d" ((uint32_t) (xcr0 >> 32)) : "memory");
+	else
+		__asm __volatile ("fxsave64 (%0)" : : "r" (area) : "memory");
+	save_cnt++;
+}
+
+/* Loads the registers from T's area.  CR0.TS must be clear. */
+static void
+restore (struct thread *t) {
+	void *area = area_of (t);
+
+	if (use_xsave)
+		__asm __volatile ("xrstor64 (%0)"
+				: : "r" (area), "a" ((uint32_t) xcr0),
+				"d" ((uint32_t) (xcr0 >> 32)) : "memory");
+	else
+		__asm __volatile ("fxrstor64 (%0)" : : "r" (area) : "memory");
+}
+
+/* Sets or clears CR0.TS, if it is not already so. */
+static void
+set_ts (bool ts) {
+	if (ts == ts_set)
+		return;
+	if (ts)
+		lcr0 (rcr0 () | CR0_TS);
+	else
+		__asm __volatile ("clts");
+	ts_set = ts;
+}
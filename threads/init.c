@@ -1,6 +1,7 @@
 #include "threads/init.h"
 #include <console.h>
 #include <debug.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <random.h>
 #include <stddef.h>
@@ -13,17 +14,31 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/bench.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
+#include "threads/pmu.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/rgroup.h"
+#include "threads/scratch.h"
+#include "threads/shrinker.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
+#include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/exec_cache.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -31,9 +46,15 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/replace.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
+#include "devices/block.h"
 #include "devices/disk.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -51,6 +72,21 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* -v: Print how long each phase of boot took? */
+static bool boot_verbose;
+
+/* TSC when main() began, and when each boot phase ended. */
+#define BOOT_PHASE_MAX 16
+static uint64_t boot_tsc;
+static struct boot_phase {
+	const char *name;
+	uint64_t tsc;
+} boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+
+static void boot_phase (const char *name);
+static void print_boot_phases (void);
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
@@ -67,11 +103,13 @@ int main (void) NO_RETURN;
 /* Pintos main program. */
 int
 main (void) {
+	uint64_t start_tsc = rdtsc ();
 	uint64_t mem_end;
 	char **argv;
 
 	/* Clear BSS and get machine's RAM size. */
 	bss_init ();
+	boot_tsc = start_tsc;
 
 	/* Break command line into arguments and parse options. */
 	argv = read_command_line ();
@@ -81,11 +119,19 @@ main (void) {
 	   then enable console locking. */
 	thread_init ();
 	console_init ();
+	boot_phase ("bss, options, thread");
 
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	boot_phase ("palloc, malloc");
 	paging_init (mem_end);
+	boot_phase ("paging");
+	cpu_init ();
+	trace_init ();
+	profile_init ();
+	pmu_init ();
+	fpu_init ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -100,22 +146,40 @@ main (void) {
 #ifdef USERPROG
 	exception_init ();
 	syscall_init ();
+	exec_cache_init ();
+	process_child_info_init ();
+	process_template_init ();
+	futex_init ();
 #endif
+	boot_phase ("cpu, interrupts");
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
 	serial_init_queue ();
+	boot_phase ("scheduler");
 	timer_calibrate ();
+	boot_phase ("timer calibration");
+	workqueue_init ();
+	rcu_init ();
 
 #ifdef FILESYS
 	/* Initialize file system. */
+	block_init ();
 	disk_init ();
+	virtio_blk_init ();
+	ramdisk_init ();
+	block_assign_roles ();
+	boot_phase ("disks");
 	filesys_init (format_filesys);
+	boot_phase ("file system");
 #endif
 
 #ifdef VM
 	vm_init ();
+	boot_phase ("vm");
 #endif
 
+	if (boot_verbose)
+		print_boot_phases ();
 	printf ("Boot complete.\n");
 
 	/* Run actions specified on kernel command line. */
@@ -151,21 +215,39 @@ paging_init (uint64_t mem_end) {
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = (uint64_t) &start;
+	uint64_t text_end = (uint64_t) &_end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	// Every 2 MB of it that lies wholly inside or outside the kernel
+	// text gets a 2 MB page, so that copying and clearing frames
+	// through their kernel addresses takes few TLB entries.  (1 GB
+	// pages would need LOADER_KERN_BASE to be 1 GB-aligned.)
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
-
-		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+		bool text = text_start <= va && va < text_end;
+
+		if (pa % HPGSIZE == 0 && pa + HPGSIZE <= mem_end
+				&& (text ? va + HPGSIZE <= text_end
+					: va >= text_end || va + HPGSIZE <= text_start)
+				&& pml4_set_kernel_huge_page (pml4, va, pa, !text)) {
+			pa += HPGSIZE;
+			continue;
+		}
+
+		perm = PTE_P | PTE_W | PTE_G;
+		if (text)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_enable_pcid ();
+	pml4_share_kernel ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -214,19 +296,79 @@ parse_options (char **argv) {
 			usage ();
 		else if (!strcmp (name, "-q"))
 			power_off_when_done = true;
+		else if (!strcmp (name, "-v"))
+			boot_verbose = true;
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-pio"))
+			disk_pio = true;
+		else if (!strcmp (name, "-defrag"))
+			filesys_defrag = true;
+		else if (!strcmp (name, "-filesys"))
+			block_set_role_name (BLOCK_FILESYS, value);
+		else if (!strcmp (name, "-scratch"))
+			block_set_role_name (BLOCK_SCRATCH, value);
+		else if (!strcmp (name, "-swap"))
+			block_set_role_name (BLOCK_SWAP, value);
+		else if (!strcmp (name, "-ramdisk"))
+			ramdisk_mb = atoi (value);
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-adaptive"))
+			thread_adaptive = true;
+		else if (!strcmp (name, "-kstack")) {
+			int pages = value != NULL ? atoi (value) : 0;
+
+			if (pages < 1 || pages > THREAD_STACK_PAGES_MAX
+					|| (pages & (pages - 1)) != 0)
+				PANIC ("-kstack takes a power of two up to %d",
+						THREAD_STACK_PAGES_MAX);
+			thread_stack_pages = pages;
+		}
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-apic"))
+			timer_apic = true;
+		else if (!strcmp (name, "-trace"))
+			trace_enabled = true;
+		else if (!strcmp (name, "-profile"))
+			profile_enabled = true;
+		else if (!strcmp (name, "-pmu"))
+			pmu_enabled = true;
+		else if (!strcmp (name, "-check")) {
+			if (value == NULL || !debug_checks_parse (value))
+				PANIC ("-check takes list, hash, synch, malloc, thread "
+						"or all, separated by commas");
+		}
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
+		else if (!strcmp (name, "-stk"))
+			process_stack_pages = atoi (value) > 0 ? atoi (value) : 1;
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-vmrp")) {
+			if (value == NULL || !replace_policy_select (value))
+				PANIC ("unknown page replacement policy `%s'", value);
+		}
+		else if (!strcmp (name, "-vmhp"))
+			vm_huge_pages = true;
+		else if (!strcmp (name, "-vmws"))
+			vm_working_set = true;
+		else if (!strcmp (name, "-vmksm"))
+			vm_ksm = true;
+		else if (!strcmp (name, "-zswap"))
+			zswap_max_percent = atoi (value);
+		else if (!strcmp (name, "-swapon")) {
+			if (value == NULL || !vm_swap_add (value))
+				PANIC ("too many swap devices");
+		}
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -247,6 +389,8 @@ run_task (char **argv) {
 		run_test (task);
 	} else {
 		process_wait (process_create_initd (task));
+		/* Its teardown may still touch the file system. */
+		process_reap_flush ();
 	}
 #else
 	run_test (task);
@@ -254,6 +398,21 @@ run_task (char **argv) {
 	printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints what the page allocator, malloc(), and the object caches
+   hold now, and the most they ever held. */
+static void
+run_memstat (char **argv UNUSED) {
+	palloc_print_stats ();
+	malloc_print_stats ();
+	kmem_cache_print_stats ();
+}
+
+/* Runs the kernel microbenchmark ARGV[1], or all of them. */
+static void
+run_bench (char **argv) {
+	bench_run (argv[1]);
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -268,6 +427,8 @@ run_actions (char **argv) {
 	/* Table of supported actions. */
 	static const struct action actions[] = {
 		{"run", 2, run_task},
+		{"memstat", 1, run_memstat},
+		{"bench", 2, run_bench},
 #ifdef FILESYS
 		{"ls", 1, fsutil_ls},
 		{"cat", 2, fsutil_cat},
@@ -301,6 +462,38 @@ run_actions (char **argv) {
 
 }
 
+/* Marks the end of boot phase NAME, the part of main() since the
+   last one. */
+static void
+boot_phase (const char *name) {
+	if (boot_phase_cnt < BOOT_PHASE_MAX) {
+		boot_phases[boot_phase_cnt].name = name;
+		boot_phases[boot_phase_cnt].tsc = rdtsc ();
+		boot_phase_cnt++;
+	}
+}
+
+/* Prints the time each boot phase took, once the timer is
+   calibrated to convert TSC cycles. */
+static void
+print_boot_phases (void) {
+	uint64_t last = boot_tsc;
+	size_t i;
+
+	if (timer_tsc_to_ns (0) < 0) {
+		printf ("Boot phases: no TSC to time them.\n");
+		return;
+	}
+	printf ("Boot phases:\n");
+	for (i = 0; i < boot_phase_cnt; i++) {
+		printf ("  %-22s %'8"PRId64" us\n", boot_phases[i].name,
+				timer_tsc_to_ns (boot_phases[i].tsc - last) / 1000);
+		last = boot_phases[i].tsc;
+	}
+	printf ("  %-22s %'8"PRId64" us\n", "total",
+			timer_tsc_to_ns (last - boot_tsc) / 1000);
+}
+
 /* Prints a kernel command line help message and powers off the
    machine. */
 static void
@@ -314,6 +507,8 @@ usage (void) {
 #else
 			"  run TEST           Run TEST.\n"
 #endif
+			"  memstat            Print kernel memory usage.\n"
+			"  bench NAME         Time kernel primitive NAME, or all of them.\n"
 #ifdef FILESYS
 			"  ls                 List files in the root directory.\n"
 			"  cat FILE           Print FILE to the console.\n"
@@ -325,11 +520,36 @@ usage (void) {
 			"\nOptions:\n"
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
+			"  -v                 Print how long each phase of boot took.\n"
 			"  -f                 Format file system disk during startup.\n"
+			"  -pio               Move disk data by port I/O, not bus-master DMA.\n"
+			"  -defrag            Move scattered file data together while idle.\n"
+			"  -filesys=DEV       Use block device DEV for the file system.\n"
+			"  -scratch=DEV       Use block device DEV as the scratch disk.\n"
+			"  -swap=DEV          Use block device DEV for swap.\n"
+			"  -ramdisk=MB        Make an MB-megabyte RAM disk, ram0.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -adaptive          Adapt time slices to how threads use them.\n"
+			"  -kstack=PAGES      Give each thread PAGES pages of kernel stack.\n"
+			"  -tickless          Skip timer ticks while idle.\n"
+			"  -apic              Drive the timer with the x2APIC, if present.\n"
+			"  -trace             Record events, printed at power off.\n"
+			"  -profile           Sample timer interrupts, printed at power off.\n"
+			"  -pmu               Count cycles, cache and TLB misses per thread.\n"
+			"  -check=CLASS,...   Make the costly checks of CLASS: list, hash,\n"
+			"                     synch, malloc, thread, or all.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+			"  -stk=PAGES         Map PAGES of stack for each new process.\n"
+#endif
+#ifdef VM
+			"  -vmrp=POLICY       Replace pages by POLICY: clock, clock2, 2q.\n"
+			"  -vmhp              Back large anonymous areas with 2 MB pages.\n"
+			"  -vmws              Keep estimated working sets resident.\n"
+			"  -vmksm             Merge anonymous pages of identical contents.\n"
+			"  -zswap=PCT         Cache swap compressed in up to PCT%% of user memory.\n"
+			"  -swapon=DEV[@PRI]  Also swap to DEV, taking PRI shares of slots.\n"
 #endif
 			);
 	power_off ();
@@ -354,14 +574,39 @@ power_off (void) {
 /* Print statistics about Pintos execution. */
 static void
 print_stats (void) {
+	cpu_print_stats ();
+	intr_print_stats ();
 	timer_print_stats ();
 	thread_print_stats ();
+	workqueue_print_stats ();
+	pmu_print_stats ();
+	fpu_print_stats ();
+	scratch_print_stats ();
+	shrinker_print_stats ();
+	rcu_print_stats ();
+	rgroup_print_stats ();
+	run_memstat (NULL);
 #ifdef FILESYS
 	disk_print_stats ();
+	block_print_stats ();
+	defrag_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	syscall_print_stats ();
+	process_print_reap_stats ();
+#endif
+#ifdef VM
+	vm_print_fault_stats ();
+	vm_print_ksm_stats ();
+	vm_print_compact_stats ();
+	zswap_print_stats ();
+#endif
+#ifdef LOCKSTAT
+	lockstat_print_stats ();
 #endif
+	trace_dump ();
+	profile_dump ();
 }
@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/apic.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
@@ -13,6 +14,7 @@
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #endif
 
 /* Number of x86_64 interrupts. */
@@ -103,6 +105,28 @@ static const char *intr_names[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Deferred work.  Handlers do what has to be done with interrupts off
+   and queue the rest with intr_defer().  The outermost external
+   interrupt then runs it with interrupts on; interrupts arriving
+   meanwhile nest, and their own deferred work joins the queue, so the
+   time interrupts stay off no longer grows with the work to do, such
+   as the number of timers due.  Yielding waits for the queue to drain.
+   Interrupts are off whenever DEFERRED is looked at. */
+static struct list deferred;
+static bool in_deferred;        /* Running deferred work? */
+static long long deferred_cnt;  /* # of items run. */
+
+/* Longest time the processor ran with interrupts off, and so could
+   not be preempted, measured from intr_disable() or the entry of an
+   interrupt to intr_enable() or the return to code running with
+   interrupts on.  OFF_TSC is when interrupts last went off, or 0 if
+   no such stretch is being timed. */
+static uint64_t off_tsc;
+static uint64_t off_max;        /* In TSC cycles. */
+
+static inline void off_begin (void);
+static inline void off_end (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -135,7 +159,10 @@ intr_set_level (enum intr_level level) {
 enum intr_level
 intr_enable (void) {
 	enum intr_level old_level = intr_get_level ();
-	ASSERT (!intr_context ());
+	ASSERT (!in_external_intr);
+
+	if (old_level == INTR_OFF)
+		off_end ();
 
 	/* Enable interrupts by setting the interrupt flag.
 
@@ -155,6 +182,8 @@ intr_disable (void) {
 	   See [IA32-v2b] "CLI" and [IA32-v3a] 5.8.1 "Masking Maskable
 	   Hardware Interrupts". */
 	asm volatile ("cli" : : : "memory");
+	if (old_level == INTR_ON)
+		off_begin ();
 
 	return old_level;
 }
@@ -166,6 +195,7 @@ intr_init (void) {
 
 	/* Initialize interrupt controller. */
 	pic_init ();
+	list_init (&deferred);
 
 	/* Initialize IDT. */
 	for (i = 0; i < INTR_CNT; i++) {
@@ -252,11 +282,21 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 	register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Masks external interrupt VEC_NO at the PICs, so that it is no
+   longer delivered. */
+void
+intr_mask_ext (uint8_t vec_no) {
+	uint16_t port = vec_no < 0x28 ? 0x21 : 0xa1;
+
+	ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+	outb (port, inb (port) | (1 << ((vec_no - 0x20) & 7)));
+}
+
+/* Returns true during processing of an external interrupt,
+   deferred work included, and false at all other times. */
 bool
 intr_context (void) {
-	return in_external_intr;
+	return in_external_intr || in_deferred;
 }
 
 /* During processing of an external interrupt, directs the
@@ -268,6 +308,77 @@ intr_yield_on_return (void) {
 	ASSERT (intr_context ());
 	yield_on_return = true;
 }
+
+/* Initializes W to run FUNC (AUX) whenever it is deferred. */
+void
+intr_work_init (struct intr_work *w, intr_work_func *func, void *aux) {
+	ASSERT (func != NULL);
+
+	w->func = func;
+	w->aux = aux;
+	w->pending = false;
+}
+
+/* Queues W to run once the external interrupt being processed
+   returns, unless it is queued already.  W runs once for all the
+   times it was deferred while queued, so it should do whatever work
+   has piled up. */
+void
+intr_defer (struct intr_work *w) {
+	ASSERT (intr_context ());
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (!w->pending) {
+		w->pending = true;
+		list_push_back (&deferred, &w->elem);
+	}
+}
+
+/* Runs the deferred work, with interrupts on, until there is none
+   left.  Called with interrupts off, which it leaves off. */
+static void
+run_deferred (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	in_deferred = true;
+	while (!list_empty (&deferred)) {
+		struct intr_work *w = list_entry (list_pop_front (&deferred),
+				struct intr_work, elem);
+
+		w->pending = false;
+		deferred_cnt++;
+		intr_enable ();
+		w->func (w->aux);
+		intr_disable ();
+	}
+	in_deferred = false;
+}
+
+/* Prints interrupt statistics. */
+void
+intr_print_stats (void) {
+	printf ("Interrupt: %lld deferred work items run\n", deferred_cnt);
+	printf ("Interrupt: off for at most %llu cycles (%lld us) at a stretch\n",
+			(unsigned long long) off_max, timer_tsc_to_ns (off_max) / 1000);
+}
+
+/* Starts timing a stretch with interrupts off. */
+static inline void
+off_begin (void) {
+	off_tsc = rdtsc ();
+}
+
+/* Ends the stretch being timed, if any. */
+static inline void
+off_end (void) {
+	if (off_tsc != 0) {
+		uint64_t cycles = rdtsc () - off_tsc;
+
+		if (cycles > off_max)
+			off_max = cycles;
+		off_tsc = 0;
+	}
+}
 
 /* 8259A Programmable Interrupt Controller. */
 
@@ -337,13 +448,15 @@ intr_handler (struct intr_frame *frame) {
 	   We only handle one at a time (so interrupts must be off)
 	   and they need to be acknowledged on the PIC (see below).
 	   An external interrupt handler cannot sleep. */
+	off_begin ();
 	external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
 	if (external) {
 		ASSERT (intr_get_level () == INTR_OFF);
-		ASSERT (!intr_context ());
+		ASSERT (!in_external_intr);
 
 		in_external_intr = true;
-		yield_on_return = false;
+		if (!in_deferred)
+			yield_on_return = false;
 	}
 
 	/* Invoke the interrupt's handler. */
@@ -367,11 +480,29 @@ intr_handler (struct intr_frame *frame) {
 		ASSERT (intr_context ());
 
 		in_external_intr = false;
-		pic_end_of_interrupt (frame->vec_no);
-
+		if (frame->vec_no == 0x20 && apic_timer_active)
+			apic_eoi ();
+		else
+			pic_end_of_interrupt (frame->vec_no);
+
+		/* Nested in deferred work, which goes on once this returns. */
+		if (in_deferred)
+			return;
+		if (!list_empty (&deferred))
+			run_deferred ();
 		if (yield_on_return)
-			thread_yield ();
+			thread_preempt ();
 	}
+
+#ifdef USERPROG
+	/* A killed process's threads go no further back into user mode. */
+	if (frame->cs == SEL_UCSEG && thread_leader ()->killed) {
+		intr_enable ();
+		process_exit_if_killed ();
+	}
+#endif
+	if (frame->eflags & FLAG_IF)
+		off_end ();
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
@@ -6,14 +6,18 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
+   The size of each request, in bytes, is rounded up to a size
+   class and assigned to the "descriptor" that manages blocks of
+   that size.  There are four classes for each power of 2, at
+   steps of a quarter of it (16, 24, 32, 40, 48, 56, 64, 80, ...),
+   so that no block is more than 25% larger than its request.  The descriptor keeps a list of free blocks.  If
    the free list is nonempty, one of its blocks is used to
    satisfy the request.
 
@@ -32,7 +36,21 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.  Big
+   blocks of a few pages that are freed are kept a while, a few of
+   each size, so that repeated requests for buffers of that size,
+   as realloc() growth makes, need not go to the page allocator
+   each time.
+
+   Objects allocated often, all of the same size, are better kept
+   in an object cache, struct kmem_cache.  A cache carves pages,
+   called "slabs", into objects of exactly its size, so that none of
+   a power of 2 goes to waste, and keeps the indexes of each slab's
+   free objects in the slab's header rather than in the objects.
+   An object can thus be built once by the cache's constructor when
+   its slab is made, and keep its constructed state across frees.
+   free() recognizes objects from caches by their slab header and
+   hands them back to their cache. */
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +58,12 @@ struct desc {
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+
+	/* Statistics, under LOCK.  Blocks in magazines count as in use. */
+	size_t arena_cnt;           /* Arenas allocated. */
+	size_t arena_max;           /* Most arenas ever allocated at once. */
+	size_t block_cnt;           /* Blocks in use. */
+	size_t block_max;           /* Most blocks ever in use at once. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -58,25 +82,127 @@ struct block {
 };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[32];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Freed big blocks of up to BIG_CACHE_PAGES pages, up to
+   BIG_CACHE_DEPTH of each page count, most recently freed last. */
+#define BIG_CACHE_PAGES 8
+#define BIG_CACHE_DEPTH 2
+static struct arena *big_cache[BIG_CACHE_PAGES][BIG_CACHE_DEPTH];
+static size_t big_cache_cnt[BIG_CACHE_PAGES];
+static struct lock big_cache_lock;
+
+/* Pages of big blocks in use, and the most ever in use at once,
+   under big_cache_lock.  Big blocks kept for reuse are not in
+   use. */
+static size_t big_page_cnt;
+static size_t big_page_max;
+
+/* Per-thread magazines: each thread keeps up to MAG_ROUNDS free
+   blocks of each of the descriptors for blocks of up to
+   MAG_MAX_SIZE bytes, which malloc() and free() use without taking
+   any lock or turning interrupts off.  A thread refills an empty
+   magazine, or gives back half of a full one, under the
+   descriptor's lock, so that a thread alternating between
+   allocating and freeing takes it at most once every MAG_ROUNDS / 2
+   calls.  Blocks in magazines count as in use to their arenas. */
+#define MAG_ROUNDS 7
+#define MAG_MAX_SIZE 512
+
+struct magazine {
+	size_t cnt;                 /* Number of blocks in ROUNDS. */
+	struct block *rounds[MAG_ROUNDS]; /* Free blocks, newest last. */
+};
+
+static size_t mag_desc_cnt;     /* Descriptors with magazines. */
+
+static struct block *desc_get_block (struct desc *);
+static void desc_put_block (struct desc *, struct block *);
+static struct magazine *magazine_of (struct desc *);
+static struct arena *big_cache_get (size_t page_cnt);
+static bool big_cache_put (struct arena *);
+static bool big_cache_flush (void);
+static size_t big_cache_count (void);
+static size_t big_cache_scan (size_t nr);
+static size_t slab_count (void);
+static size_t slab_scan (size_t nr);
+static void big_account (size_t page_cnt, bool alloc);
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
+/* Shrinkers of the big blocks kept for reuse and of the empty slab
+   each object cache keeps to allocate from. */
+static struct shrinker big_cache_shrinker = {
+	.name = "malloc", .count = big_cache_count, .scan = big_cache_scan,
+};
+static struct shrinker slab_shrinker = {
+	.name = "slab", .count = slab_count, .scan = slab_scan,
+};
+
+/* Object cache. */
+struct kmem_cache {
+	const char *name;           /* For statistics. */
+	size_t obj_size;            /* Size of each object in bytes. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	size_t obj_ofs;             /* Offset of the first object in a slab. */
+	kmem_ctor *ctor;            /* Builds each object of a new slab. */
+	struct list slabs;          /* Slabs with free objects. */
+	struct lock lock;           /* Lock. */
+	struct list_elem elem;      /* Element in caches. */
+
+	/* Statistics. */
+	size_t slab_cnt;            /* Slabs allocated. */
+	size_t obj_cnt;             /* Objects in use. */
+	size_t obj_max;             /* Most objects ever in use at once. */
+	unsigned long long alloc_cnt; /* Objects allocated so far. */
+};
+
+/* Magic number for detecting slab corruption.  A slab starts with
+   it where an arena has ARENA_MAGIC, which is how free() tells the
+   two apart. */
+#define SLAB_MAGIC 0x51ab0b1e
+
+/* Slab: a page of objects, headed by this structure. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	size_t free_cnt;            /* Number of free objects. */
+	struct list_elem elem;      /* Element in cache's slabs. */
+	uint16_t free[];            /* Indexes of free objects, FREE_CNT. */
+};
+
+/* All object caches. */
+static struct list caches;
+
+static struct slab *obj_to_slab (void *);
+
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) {
-	size_t block_size;
+	size_t block_size, step;
 
-	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
+	/* Below 64 bytes the steps are of 8, to keep blocks aligned. */
+	for (block_size = 16; block_size < PGSIZE / 2; block_size += step) {
 		struct desc *d = &descs[desc_cnt++];
 		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+
+		if (block_size <= MAG_MAX_SIZE)
+			mag_desc_cnt = desc_cnt;
+
+		/* A quarter of the power of 2 at or below BLOCK_SIZE. */
+		for (step = 8; step * 8 <= block_size; step *= 2)
+			continue;
 	}
+	lock_init (&big_cache_lock);
+	list_init (&caches);
+	shrinker_register (&big_cache_shrinker);
+	shrinker_register (&slab_shrinker);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -86,6 +212,7 @@ malloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
+	struct magazine *m;
 
 	/* A null pointer satisfies a request for 0 bytes. */
 	if (size == 0)
@@ -100,9 +227,14 @@ malloc (size_t size) {
 		/* SIZE is too big for any descriptor.
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-		a = palloc_get_multiple (0, page_cnt);
+		a = big_cache_get (page_cnt);
+		if (a == NULL)
+			a = palloc_get_multiple (0, page_cnt);
+		if (a == NULL && big_cache_flush ())
+			a = palloc_get_multiple (0, page_cnt);
 		if (a == NULL)
 			return NULL;
+		big_account (page_cnt, true);
 
 		/* Initialize the arena to indicate a big block of PAGE_CNT
 		   pages, and return it. */
@@ -112,33 +244,22 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
-
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
+	/* Take a block from this thread's magazine, or refill it half
+	   way along with taking one. */
+	m = magazine_of (d);
+	if (m != NULL && m->cnt > 0)
+		return m->rounds[--m->cnt];
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
-
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
+	lock_acquire (&d->lock);
+	b = desc_get_block (d);
+	if (b != NULL && m != NULL)
+		while (m->cnt < MAG_ROUNDS / 2) {
+			struct block *r = desc_get_block (d);
+
+			if (r == NULL)
+				break;
+			m->rounds[m->cnt++] = r;
 		}
-	}
-
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
 	lock_release (&d->lock);
 	return b;
 }
@@ -165,11 +286,15 @@ calloc (size_t a, size_t b) {
 
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
-block_size (void *block) {
+allocated_size (void *block) {
 	struct block *b = block;
-	struct arena *a = block_to_arena (b);
-	struct desc *d = a->desc;
+	struct arena *a;
+	struct desc *d;
 
+	if (obj_to_slab (block) != NULL)
+		return obj_to_slab (block)->cache->obj_size;
+	a = block_to_arena (b);
+	d = a->desc;
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
@@ -187,7 +312,7 @@ realloc (void *old_block, size_t new_size) {
 	} else {
 		void *new_block = malloc (new_size);
 		if (old_block != NULL && new_block != NULL) {
-			size_t old_size = block_size (old_block);
+			size_t old_size = allocated_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
 			free (old_block);
@@ -202,8 +327,17 @@ void
 free (void *p) {
 	if (p != NULL) {
 		struct block *b = p;
-		struct arena *a = block_to_arena (b);
-		struct desc *d = a->desc;
+		struct arena *a;
+		struct desc *d;
+		struct magazine *m;
+
+		if (obj_to_slab (p) != NULL) {
+			/* It's an object from a cache. */
+			kmem_cache_free (obj_to_slab (p)->cache, p);
+			return;
+		}
+		a = block_to_arena (b);
+		d = a->desc;
 
 		if (d != NULL) {
 			/* It's a normal block.  We handle it here. */
@@ -213,45 +347,286 @@ free (void *p) {
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			/* Put the block in this thread's magazine, first giving
+			   half of it back if it is full. */
+			m = magazine_of (d);
+			if (m != NULL && m->cnt < MAG_ROUNDS) {
+				m->rounds[m->cnt++] = b;
+				return;
 			}
 
+			lock_acquire (&d->lock);
+			if (m != NULL)
+				while (m->cnt > MAG_ROUNDS / 2)
+					desc_put_block (d, m->rounds[--m->cnt]);
+			desc_put_block (d, b);
 			lock_release (&d->lock);
 		} else {
-			/* It's a big block.  Free its pages. */
-			palloc_free_multiple (a, a->free_cnt);
+			/* It's a big block.  Keep it for reuse, or free its
+			   pages. */
+			big_account (a->free_cnt, false);
+			if (!big_cache_put (a))
+				palloc_free_multiple (a, a->free_cnt);
 			return;
 		}
 	}
 }
 
+/* Removes and returns a free block of descriptor D, which must be
+   locked, making a new arena if there is none.  Returns a null
+   pointer if memory is not available. */
+static struct block *
+desc_get_block (struct desc *d) {
+	struct block *b;
+	struct arena *a;
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* If the free list is empty, create a new arena. */
+	if (list_empty (&d->free_list)) {
+		size_t i;
+
+		/* Allocate a page. */
+		a = palloc_get_page (0);
+		if (a == NULL)
+			return NULL;
+
+		/* Initialize arena and add its blocks to the free list. */
+		a->magic = ARENA_MAGIC;
+		a->desc = d;
+		a->free_cnt = d->blocks_per_arena;
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_push_back (&d->free_list, &b->free_elem);
+		}
+		if (++d->arena_cnt > d->arena_max)
+			d->arena_max = d->arena_cnt;
+	}
+
+	/* Get a block from free list and return it. */
+	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+	a = block_to_arena (b);
+	a->free_cnt--;
+	if (++d->block_cnt > d->block_max)
+		d->block_max = d->block_cnt;
+	return b;
+}
+
+/* Returns block B to the free list of descriptor D, which must be
+   locked, freeing B's arena if it is then entirely unused. */
+static void
+desc_put_block (struct desc *d, struct block *b) {
+	struct arena *a = block_to_arena (b);
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* Add block to free list. */
+	list_push_front (&d->free_list, &b->free_elem);
+	d->block_cnt--;
+
+	/* If the arena is now entirely unused, free it. */
+	if (++a->free_cnt >= d->blocks_per_arena) {
+		size_t i;
+
+		ASSERT (a->free_cnt == d->blocks_per_arena);
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_remove (&b->free_elem);
+		}
+		palloc_free_page (a);
+		d->arena_cnt--;
+	}
+}
+
+/* Returns the current thread's magazine for descriptor D, or a null
+   pointer if it has none. */
+static struct magazine *
+magazine_of (struct desc *d) {
+	struct thread *t = thread_current ();
+	size_t idx = d - descs;
+
+	return t->magazines != NULL && idx < mag_desc_cnt
+		? &t->magazines[idx] : NULL;
+}
+
+/* Gives thread T, which is being created, its magazines.  T goes
+   without, and so through the descriptors' locks every time, if
+   memory is not available. */
+void
+malloc_thread_init (struct thread *t) {
+	t->magazines = calloc (mag_desc_cnt, sizeof *t->magazines);
+}
+
+/* Returns the blocks in the current thread's magazines to their
+   descriptors, and frees the magazines.  Called as the thread
+   exits. */
+void
+malloc_thread_exit (void) {
+	struct thread *t = thread_current ();
+	struct magazine *mags = t->magazines;
+	size_t i;
+
+	if (mags == NULL)
+		return;
+	t->magazines = NULL;
+	for (i = 0; i < mag_desc_cnt; i++) {
+		struct desc *d = &descs[i];
+
+		if (mags[i].cnt == 0)
+			continue;
+		lock_acquire (&d->lock);
+		while (mags[i].cnt > 0)
+			desc_put_block (d, mags[i].rounds[--mags[i].cnt]);
+		lock_release (&d->lock);
+	}
+	free (mags);
+}
+
+/* Removes and returns the big block of PAGE_CNT pages freed last,
+   or a null pointer if none is kept. */
+static struct arena *
+big_cache_get (size_t page_cnt) {
+	struct arena *a = NULL;
+
+	if (page_cnt > BIG_CACHE_PAGES)
+		return NULL;
+	lock_acquire (&big_cache_lock);
+	if (big_cache_cnt[page_cnt - 1] > 0)
+		a = big_cache[page_cnt - 1][--big_cache_cnt[page_cnt - 1]];
+	lock_release (&big_cache_lock);
+	return a;
+}
+
+/* Keeps big block A, freed, for reuse.  Returns false if there is
+   no room for it. */
+static bool
+big_cache_put (struct arena *a) {
+	size_t page_cnt = a->free_cnt;
+	bool kept = false;
+
+	if (page_cnt > BIG_CACHE_PAGES)
+		return false;
+#ifndef NDEBUG
+	/* Clear the block to help detect use-after-free bugs. */
+	memset (a + 1, 0xcc, PGSIZE * page_cnt - sizeof *a);
+#endif
+	lock_acquire (&big_cache_lock);
+	if (big_cache_cnt[page_cnt - 1] < BIG_CACHE_DEPTH) {
+		big_cache[page_cnt - 1][big_cache_cnt[page_cnt - 1]++] = a;
+		kept = true;
+	}
+	lock_release (&big_cache_lock);
+	return kept;
+}
+
+/* Gives every big block kept back to the page allocator.  Returns
+   true if there were any. */
+static bool
+big_cache_flush (void) {
+	bool any = false;
+	size_t i;
+
+	lock_acquire (&big_cache_lock);
+	for (i = 0; i < BIG_CACHE_PAGES; i++)
+		while (big_cache_cnt[i] > 0) {
+			palloc_free_multiple (big_cache[i][--big_cache_cnt[i]], i + 1);
+			any = true;
+		}
+	lock_release (&big_cache_lock);
+	return any;
+}
+
+/* Returns the number of pages of big blocks kept.  Read without the
+   lock, which a guess does not need. */
+static size_t
+big_cache_count (void) {
+	size_t pages = 0;
+	size_t i;
+
+	for (i = 0; i < BIG_CACHE_PAGES; i++)
+		pages += big_cache_cnt[i] * (i + 1);
+	return pages;
+}
+
+/* Frees big blocks kept, the largest first, until NR pages are
+   freed or none are left.  Returns the number of pages freed. */
+static size_t
+big_cache_scan (size_t nr) {
+	size_t freed = 0;
+	size_t i;
+
+	if (lock_held_by_current_thread (&big_cache_lock)
+			|| !lock_try_acquire (&big_cache_lock))
+		return 0;
+	for (i = BIG_CACHE_PAGES; i-- > 0 && freed < nr; )
+		while (big_cache_cnt[i] > 0 && freed < nr) {
+			palloc_free_multiple (big_cache[i][--big_cache_cnt[i]], i + 1);
+			freed += i + 1;
+		}
+	lock_release (&big_cache_lock);
+	return freed;
+}
+
+/* Counts a big block of PAGE_CNT pages as in use, if ALLOC, or as
+   freed. */
+static void
+big_account (size_t page_cnt, bool alloc) {
+	lock_acquire (&big_cache_lock);
+	if (alloc) {
+		big_page_cnt += page_cnt;
+		if (big_page_cnt > big_page_max)
+			big_page_max = big_page_cnt;
+	} else
+		big_page_cnt -= page_cnt;
+	lock_release (&big_cache_lock);
+}
+
+/* Prints statistics about each descriptor that was ever used and
+   about big blocks. */
+void
+malloc_print_stats (void) {
+	size_t kept = 0;
+	size_t i;
+
+	for (i = 0; i < desc_cnt; i++) {
+		struct desc *d = &descs[i];
+		size_t arenas, arena_max, blocks, block_max;
+
+		lock_acquire (&d->lock);
+		arenas = d->arena_cnt;
+		arena_max = d->arena_max;
+		blocks = d->block_cnt;
+		block_max = d->block_max;
+		lock_release (&d->lock);
+		if (arena_max > 0)
+			printf ("Malloc: %zu-byte blocks: %zu in use, at most %zu; "
+					"%zu arenas of %zu, at most %zu\n", d->block_size,
+					blocks, block_max, arenas, d->blocks_per_arena,
+					arena_max);
+	}
+
+	lock_acquire (&big_cache_lock);
+	for (i = 0; i < BIG_CACHE_PAGES; i++)
+		kept += big_cache_cnt[i] * (i + 1);
+	printf ("Malloc: big blocks: %zu pages in use, at most %zu; "
+			"%zu pages kept\n", big_page_cnt, big_page_max, kept);
+	lock_release (&big_cache_lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
 	struct arena *a = pg_round_down (b);
 
 	/* Check that the arena is valid. */
-	ASSERT (a != NULL);
-	ASSERT (a->magic == ARENA_MAGIC);
+	DEBUG_ASSERT (DEBUG_MALLOC, a != NULL);
+	DEBUG_ASSERT (DEBUG_MALLOC, a->magic == ARENA_MAGIC);
 
 	/* Check that the block is properly aligned for the arena. */
-	ASSERT (a->desc == NULL
+	DEBUG_ASSERT (DEBUG_MALLOC, a->desc == NULL
 			|| (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
-	ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+	DEBUG_ASSERT (DEBUG_MALLOC,
+			a->desc != NULL || pg_ofs (b) == sizeof *a);
 
 	return a;
 }
@@ -259,10 +634,203 @@ block_to_arena (struct block *b) {
 /* Returns the (IDX - 1)'th block within arena A. */
 static struct block *
 arena_to_block (struct arena *a, size_t idx) {
-	ASSERT (a != NULL);
-	ASSERT (a->magic == ARENA_MAGIC);
-	ASSERT (idx < a->desc->blocks_per_arena);
+	DEBUG_ASSERT (DEBUG_MALLOC, a != NULL);
+	DEBUG_ASSERT (DEBUG_MALLOC, a->magic == ARENA_MAGIC);
+	DEBUG_ASSERT (DEBUG_MALLOC, idx < a->desc->blocks_per_arena);
 	return (struct block *) ((uint8_t *) a
 			+ sizeof *a
 			+ idx * a->desc->block_size);
 }
+
+/* Creates and returns an object cache, called NAME, of objects of
+   SIZE bytes each.  If CTOR is nonnull, it is called on each object
+   once, when the slab holding it is made, and objects must be in
+   the state it leaves them in whenever they are freed.  Returns a
+   null pointer if memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor *ctor) {
+	struct kmem_cache *c;
+	size_t n;
+
+	ASSERT (size > 0);
+	size = ROUND_UP (size, sizeof (void *));
+	/* Each object takes SIZE bytes and a free index in the header. */
+	n = (PGSIZE - sizeof (struct slab)) / (size + sizeof (uint16_t));
+	while (n > 0 && ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+				sizeof (void *)) + n * size > PGSIZE)
+		n--;
+	ASSERT (n > 0);
+
+	c = malloc (sizeof *c);
+	if (c == NULL)
+		return NULL;
+	c->name = name;
+	c->obj_size = size;
+	c->objs_per_slab = n;
+	c->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+			sizeof (void *));
+	c->ctor = ctor;
+	list_init (&c->slabs);
+	lock_init (&c->lock);
+	c->slab_cnt = c->obj_cnt = c->obj_max = 0;
+	c->alloc_cnt = 0;
+	list_push_back (&caches, &c->elem);
+	return c;
+}
+
+/* Returns the IDX'th object of slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx) {
+	return (uint8_t *) s + s->cache->obj_ofs + idx * s->cache->obj_size;
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) {
+	struct slab *s;
+
+	lock_acquire (&c->lock);
+
+	/* If no slab has a free object, make a new one. */
+	if (list_empty (&c->slabs)) {
+		size_t i;
+
+		s = palloc_get_page (0);
+		if (s == NULL) {
+			lock_release (&c->lock);
+			return NULL;
+		}
+		s->magic = SLAB_MAGIC;
+		s->cache = c;
+		s->free_cnt = c->objs_per_slab;
+		/* Hand out the lowest indexes first. */
+		for (i = 0; i < c->objs_per_slab; i++) {
+			s->free[i] = c->objs_per_slab - 1 - i;
+			if (c->ctor != NULL)
+				c->ctor (slab_obj (s, i));
+		}
+		list_push_front (&c->slabs, &s->elem);
+		c->slab_cnt++;
+	}
+
+	s = list_entry (list_front (&c->slabs), struct slab, elem);
+	if (--s->free_cnt == 0)
+		list_remove (&s->elem);
+	if (++c->obj_cnt > c->obj_max)
+		c->obj_max = c->obj_cnt;
+	c->alloc_cnt++;
+	lock_release (&c->lock);
+	return slab_obj (s, s->free[s->free_cnt]);
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) {
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+	s = obj_to_slab (obj);
+	ASSERT (s != NULL && s->cache == c);
+	ASSERT (((uint8_t *) obj - (uint8_t *) slab_obj (s, 0)) % c->obj_size == 0);
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless it
+	   has to keep its constructed state. */
+	if (c->ctor == NULL)
+		memset (obj, 0xcc, c->obj_size);
+#endif
+
+	lock_acquire (&c->lock);
+	s->free[s->free_cnt++] = ((uint8_t *) obj - (uint8_t *) slab_obj (s, 0))
+		/ c->obj_size;
+	c->obj_cnt--;
+	if (s->free_cnt == 1)
+		list_push_front (&c->slabs, &s->elem);
+	else if (s->free_cnt == c->objs_per_slab
+			&& (list_front (&c->slabs) != &s->elem
+				|| list_back (&c->slabs) != &s->elem)) {
+		/* Empty, and not the only slab left to allocate from. */
+		list_remove (&s->elem);
+		palloc_free_page (s);
+		c->slab_cnt--;
+	}
+	lock_release (&c->lock);
+}
+
+/* Returns true if C's only slab is empty, the one kmem_cache_free()
+   keeps when it empties.  C must be locked, or the answer a guess. */
+static bool
+slab_kept_empty (struct kmem_cache *c) {
+	struct slab *s;
+
+	if (list_empty (&c->slabs) || c->slab_cnt != 1)
+		return false;
+	s = list_entry (list_front (&c->slabs), struct slab, elem);
+	return s->free_cnt == c->objs_per_slab;
+}
+
+/* Returns the number of object caches keeping an empty slab. */
+static size_t
+slab_count (void) {
+	struct list_elem *e;
+	size_t cnt = 0;
+
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+		cnt += slab_kept_empty (list_entry (e, struct kmem_cache, elem));
+	return cnt;
+}
+
+/* Frees up to NR of the empty slabs object caches keep, skipping
+   caches that are busy.  Returns the number freed. */
+static size_t
+slab_scan (size_t nr) {
+	struct list_elem *e;
+	size_t freed = 0;
+
+	for (e = list_begin (&caches); e != list_end (&caches) && freed < nr;
+			e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		if (lock_held_by_current_thread (&c->lock)
+				|| !lock_try_acquire (&c->lock))
+			continue;
+		if (slab_kept_empty (c)) {
+			struct slab *s = list_entry (list_pop_front (&c->slabs),
+					struct slab, elem);
+
+			palloc_free_page (s);
+			c->slab_cnt--;
+			freed++;
+		}
+		lock_release (&c->lock);
+	}
+	return freed;
+}
+
+/* Prints statistics about each object cache. */
+void
+kmem_cache_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		printf ("Slab: %s: %llu allocs, %zu in use, at most %zu; "
+				"%zu slabs of %zu\n", c->name, c->alloc_cnt, c->obj_cnt,
+				c->obj_max, c->slab_cnt, c->objs_per_slab);
+	}
+}
+
+/* Returns the slab that P is inside, or a null pointer if P was not
+   allocated from an object cache. */
+static struct slab *
+obj_to_slab (void *p) {
+	struct slab *s = pg_round_down (p);
+
+	if (s->magic != SLAB_MAGIC)
+		return NULL;
+	ASSERT (pg_ofs (p) >= s->cache->obj_ofs);
+	return s;
+}
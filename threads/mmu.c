@@ -2,17 +2,231 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers.  With CR4.PCIDE set, the TLB tags its
+ * entries with the PCID in the low bits of CR3, so switching page
+ * tables need not flush it.  PCID 0 is base_pml4's; the others are
+ * handed out to page tables as they are activated, reusing the least
+ * recently activated one.  invlpg only reaches the active PCID, so a
+ * change to a page table that is not active marks its PCID stale
+ * instead, and its next activation flushes it.  Interrupts are off
+ * whenever PCIDS is looked at. */
+#define PCID_CNT 8
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep the new PCID's entries. */
+#define CR4_PCIDE (1 << 17)
+#define CPUID_1_ECX_PCID (1 << 17)
+#define CPUID_1_EDX_PSE (1 << 3)
+#define CPUID_1_EDX_PGE (1 << 13)
+#define CR4_PGE (1 << 7)
+
+/* The kernel half of every pml4, entries from KERN_PML4 up to
+ * kern_pml4_end, points to base_pml4's page directory pointer tables,
+ * which paging_init() fills with every kernel mapping there is, once.
+ * A new pml4 copies those few entries and a dead one leaves them be,
+ * so no kernel table is ever made or freed for a process.  The first
+ * of them also covers the top of user space, below KERN_BASE, where
+ * nothing may be mapped: it would show in every process. */
+#define KERN_PML4 PML4 (KERN_BASE)
+static unsigned kern_pml4_end;
+
+/* Returns true if making page tables for VA would change the shared
+ * kernel half: VA is in it, and base_pml4 is complete. */
+static bool
+in_shared_half (uint64_t va) {
+	return kern_pml4_end != 0 && PML4 (va) >= KERN_PML4;
+}
+
+struct pcid {
+	uint64_t *pml4;                 /* Page table using it, or null. */
+	uint64_t stamp;                 /* When last activated. */
+	bool stale;                     /* TLB may hold outdated entries. */
+};
+
+static struct pcid pcids[PCID_CNT];
+static uint64_t pcid_clock;
+static bool pcid_enabled;
+
+/* Returns the PCID of PML4, or 0 if it has none. */
+static unsigned
+pcid_find (uint64_t *pml4) {
+	for (unsigned id = 1; id < PCID_CNT; id++)
+		if (pcids[id].pml4 == pml4)
+			return id;
+	return 0;
+}
+
+/* Returns the PCID of PML4, taking one for it if it has none. */
+static unsigned
+pcid_get (uint64_t *pml4) {
+	unsigned id = pcid_find (pml4);
+
+	if (id == 0) {
+		id = 1;
+		for (unsigned i = 2; i < PCID_CNT; i++)
+			if (pcids[i].stamp < pcids[id].stamp)
+				id = i;
+		/* Drop what the previous holder left in the TLB. */
+		pcids[id].pml4 = pml4;
+		pcids[id].stale = true;
+	}
+	pcids[id].stamp = ++pcid_clock;
+	return id;
+}
+
+/* Returns true if PML4 is the page table in use. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Makes sure the TLB holds nothing stale for VA in PML4, whose entry
+ * for VA has just changed. */
+static void
+tlb_invalidate (uint64_t *pml4, uint64_t va) {
+	if (pml4_is_active (pml4))
+		invlpg (va);
+	else if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		unsigned id = pcid_find (pml4);
+
+		if (id != 0)
+			pcids[id].stale = true;
+		intr_set_level (old_level);
+	}
+}
+
+/* Starts BATCH, an empty set of pages of PML4 whose entries were
+ * changed but whose TLB entries are not yet invalidated. */
+void
+tlb_batch_init (struct tlb_batch *batch, uint64_t *pml4) {
+	batch->pml4 = pml4;
+	batch->cnt = 0;
+}
+
+/* Returns true if the running thread is the only one using the
+ * active page table.  Other threads of its process share the table,
+ * and its PCID, so switching to one reloads no TLB entries. */
+static bool
+pml4_is_private (void) {
+#ifdef USERPROG
+	return thread_leader ()->thread_cnt <= 1;
+#else
+	return true;
+#endif
+}
+
+/* Adds VA to BATCH.  Only the active page table's invalidations wait
+ * for tlb_batch_flush(), and only while the running thread is its
+ * sole user: the thread does not touch user memory before flushing,
+ * but may sleep in between, and a sibling thread switched in then
+ * would.  Any other page table is marked stale at once, as its owner
+ * may be switched in first. */
+static void
+tlb_batch_add (struct tlb_batch *batch, uint64_t va) {
+	if (!pml4_is_active (batch->pml4)) {
+		tlb_invalidate (batch->pml4, va);
+		return;
+	}
+	if (!pml4_is_private ()) {
+		invlpg (va);
+		return;
+	}
+	if (batch->cnt < TLB_BATCH_MAX)
+		batch->va[batch->cnt] = va;
+	batch->cnt++;
+}
+
+/* Invalidates the TLB entries of the pages in BATCH, which is left
+ * empty: up to TLB_BATCH_MAX pages one by one, more with a single
+ * flush of the whole address space, which is cheaper than that many
+ * invlpgs even though the entries of unchanged pages go too. */
+void
+tlb_batch_flush (struct tlb_batch *batch) {
+	if (batch->cnt > TLB_BATCH_MAX)
+		/* Without CR3_NOFLUSH, reloading CR3 flushes its PCID. */
+		lcr3 (rcr3 ());
+	else
+		for (size_t i = 0; i < batch->cnt; i++)
+			invlpg (batch->va[i]);
+	batch->cnt = 0;
+}
+
+/* Turns on PCIDs if the CPU has them.  Called once base_pml4 is
+ * active, as CR4.PCIDE may only be set while CR3 holds PCID 0. */
+void
+pml4_enable_pcid (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_1_ECX_PCID))
+		return;
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcids[0].pml4 = base_pml4;
+	pcid_enabled = true;
+}
+
+/* Notes that base_pml4 now maps all of the kernel, whose tables the
+ * pml4s made from here on share, and, if the CPU has global pages,
+ * keeps the kernel's mappings, all made with PTE_G, in the TLB across
+ * page table switches.  Called once by paging_init(). */
+void
+pml4_share_kernel (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	for (unsigned i = KERN_PML4; i < PGSIZE / sizeof (uint64_t); i++)
+		if (base_pml4[i] & PTE_P)
+			kern_pml4_end = i + 1;
+
+	cpuid (1, &eax, &ebx, &ecx, &edx);
+	if (edx & CPUID_1_EDX_PGE)
+		lcr4 (rcr4 () | CR4_PGE);
+}
+
+/* Replaces the 2 MB page mapped by PDE, which covers VA, by a page
+ * table mapping the same memory with 4 kB pages with the same flags,
+ * accessed and dirty bits included.  Returns false if out of memory. */
+static bool
+split_pde (uint64_t *pde, const uint64_t va) {
+	uint64_t *pt = palloc_get_page (0);
+	enum intr_level old_level;
+
+	if (pt == NULL)
+		return false;
+
+	/* The CPU may set the accessed or dirty bit of *PDE meanwhile,
+	   but no other thread runs while interrupts are off. */
+	old_level = intr_disable ();
+	if (*pde & PTE_PS) {
+		uint64_t pa = PTE_ADDR (*pde);
+		uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+		for (unsigned i = 0; i < HPG_CNT; i++)
+			pt[i] = (pa + i * PGSIZE) | flags;
+		*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+		invlpg (va & ~(HPGSIZE - 1));
+		pt = NULL;
+	}
+	intr_set_level (old_level);
+
+	if (pt != NULL)
+		palloc_free_page (pt);
+	return true;
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		if (((uint64_t) pte & PTE_P) && ((uint64_t) pte & PTE_PS)
+				&& !split_pde (&pdp[idx], va))
+			return NULL;
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
@@ -60,12 +274,15 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.  Nothing is ever created in the kernel half
+ * once it is shared. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
 	int idx = PML4 (va);
 	int allocated = 0;
+	if (create && in_shared_half (va))
+		return NULL;
 	if (pml4e) {
 		uint64_t *pdpe = (uint64_t *) pml4e[idx];
 		if (!((uint64_t) pdpe & PTE_P)) {
@@ -88,6 +305,52 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the page directory entry for VA in PML4, making the page
+ * directory pointer table and page directory above it if need be.
+ * Returns a null pointer if memory allocation failed; tables made
+ * before that are left empty, to be freed with PML4. */
+static uint64_t *
+pde_create (uint64_t *pml4, const uint64_t va) {
+	uint64_t *table = pml4;
+
+	if (in_shared_half (va))
+		return NULL;
+	for (int level = 0; level < 2; level++) {
+		uint64_t *entry = &table[level == 0 ? PML4 (va) : PDPE (va)];
+
+		if (!(*entry & PTE_P)) {
+			uint64_t *new_page = palloc_get_page (PAL_ZERO);
+			if (new_page == NULL)
+				return NULL;
+			*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (*entry));
+	}
+	return &table[PDX (va)];
+}
+
+/* Returns the entry mapping VA in PML4: its PTE, or its PDE if VA
+ * lies in a 2 MB page.  Unlike pml4e_walk(), never splits a 2 MB
+ * page, so the entry is only good for looking at.  Returns a null
+ * pointer if VA is not mapped. */
+static uint64_t *
+pml4_lookup (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pdpe, *pd, *pde;
+
+	if (!(pml4[PML4 (va)] & PTE_P))
+		return NULL;
+	pdpe = ptov (PTE_ADDR (pml4[PML4 (va)]));
+	if (!(pdpe[PDPE (va)] & PTE_P))
+		return NULL;
+	pd = ptov (PTE_ADDR (pdpe[PDPE (va)]));
+	pde = &pd[PDX (va)];
+	if (!(*pde & PTE_P))
+		return NULL;
+	if (*pde & PTE_PS)
+		return pde;
+	return (uint64_t *) ptov (PTE_ADDR (*pde)) + PTX (va);
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -95,8 +358,15 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 uint64_t *
 pml4_create (void) {
 	uint64_t *pml4 = palloc_get_page (0);
-	if (pml4)
-		memcpy (pml4, base_pml4, PGSIZE);
+	if (pml4) {
+		size_t kern_size = (kern_pml4_end - KERN_PML4) * sizeof *pml4;
+
+		ASSERT (kern_pml4_end != 0);
+		memset (pml4, 0, KERN_PML4 * sizeof *pml4);
+		memcpy (pml4 + KERN_PML4, base_pml4 + KERN_PML4, kern_size);
+		memset (pml4 + kern_pml4_end, 0,
+				PGSIZE - kern_pml4_end * sizeof *pml4);
+	}
 	return pml4;
 }
 
@@ -122,7 +392,7 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && !(((uint64_t) pte) & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -143,6 +413,38 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
+/* Applies FUNC to each entry of PML4 holding a swap slot, all of
+ * them in user space, until FUNC returns false.  Returns false if it
+ * did. */
+bool
+pml4_for_each_swap (uint64_t *pml4, pte_for_each_func *func, void *aux) {
+	uint64_t *pdp, *pd, *pt;
+	unsigned i, j, k;
+
+	if (!(pml4[0] & PTE_P))
+		return true;
+	pdp = ptov (PTE_ADDR (pml4[0]));
+	for (i = 0; i < PGSIZE / sizeof (uint64_t); i++) {
+		if (!(pdp[i] & PTE_P))
+			continue;
+		pd = ptov (PTE_ADDR (pdp[i]));
+		for (j = 0; j < PGSIZE / sizeof (uint64_t); j++) {
+			if (!(pd[j] & PTE_P) || (pd[j] & PTE_PS))
+				continue;
+			pt = ptov (PTE_ADDR (pd[j]));
+			for (k = 0; k < PGSIZE / sizeof (uint64_t); k++) {
+				void *va = (void *) (((uint64_t) i << PDPESHIFT)
+						| ((uint64_t) j << PDXSHIFT)
+						| ((uint64_t) k << PTXSHIFT));
+
+				if (is_swap_pte (pt[k]) && !func (&pt[k], va, aux))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
 /* Apply FUNC to each available pte entries including kernel's. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
@@ -155,13 +457,20 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Frees page table PT and the frames it maps.  The frames' addresses
+ * are gathered over PT's own entries, which are no longer needed, and
+ * given back in one batch. */
 static void
 pt_destroy (uint64_t *pt) {
+	void **frames = (void **) pt;
+	size_t frame_cnt = 0;
+
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
 		if (((uint64_t) pte) & PTE_P)
-			palloc_free_page ((void *) PTE_ADDR (pte));
+			frames[frame_cnt++] = (void *) PTE_ADDR (pte);
 	}
+	palloc_free_pages (frames, frame_cnt);
 	palloc_free_page ((void *) pt);
 }
 
@@ -169,7 +478,9 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && (((uint64_t) pte) & PTE_PS))
+			palloc_free_multiple ((void *) PTE_ADDR (pte), HPG_CNT);
+		else if (((uint64_t) pte) & PTE_P)
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -191,8 +502,20 @@ pml4_destroy (uint64_t *pml4) {
 	if (pml4 == NULL)
 		return;
 	ASSERT (pml4 != base_pml4);
+	ASSERT (!pml4_is_active (pml4));
 
-	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
+	/* The page may come back as another page table. */
+	if (pcid_enabled) {
+		enum intr_level old_level = intr_disable ();
+		unsigned id = pcid_find (pml4);
+
+		if (id != 0)
+			pcids[id].pml4 = NULL;
+		intr_set_level (old_level);
+	}
+
+	/* User space is all in entry 0; the others are the kernel's,
+	 * shared with every pml4. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
@@ -200,10 +523,29 @@ pml4_destroy (uint64_t *pml4) {
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  With PCIDs, the TLB keeps PD's entries from the last
+ * time it was active, unless they went stale meanwhile. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+	uint64_t cr3;
+	unsigned id;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4));
+		return;
+	}
+
+	old_level = intr_disable ();
+	id = pml4 == base_pml4 ? 0 : pcid_get (pml4);
+	cr3 = vtop (pml4) | id;
+	if (!pcids[id].stale)
+		cr3 |= CR3_NOFLUSH;
+	pcids[id].stale = false;
+	lcr3 (cr3);
+	intr_set_level (old_level);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,8 +556,12 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) uaddr);
 
+	if (pte && (*pte & PTE_PS))
+		return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & (HPGSIZE - 1));
+	/* A cleared entry keeps the frame's address, or holds a swap
+	 * slot. */
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -238,11 +584,95 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		uint64_t old = *pte;
+		bool remap = old & PTE_P;
+
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		/* Remapping the same frame, e.g. read-only for copy-on-write,
+		 * keeps the record that it was written: the swap cache, for
+		 * one, counts on it. */
+		if (remap && PTE_ADDR (old) == vtop (kpage))
+			*pte |= old & PTE_D;
+		if (remap)
+			tlb_invalidate (pml4, (uint64_t) upage);
+	}
 	return pte != NULL;
 }
 
+/* Maps the 2 MB of user virtual memory at UPAGE in PML4 to the
+ * HPG_CNT physical frames starting at kernel virtual address KPAGE,
+ * with a single page directory entry.  Both must be aligned to
+ * HPGSIZE.  No page in the range may be mapped, nor have been since
+ * PML4 was created, because a page table already covering the range
+ * is left in place and makes this fail.  The frames are freed
+ * together by pml4_destroy(), unless the mapping is split into 4 kB
+ * pages first, which every function taking a single page does.
+ * Returns true if successful, false if the range is in use or memory
+ * allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t *pde;
+
+	ASSERT ((va & (HPGSIZE - 1)) == 0);
+	ASSERT ((vtop (kpage) & (HPGSIZE - 1)) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pde_create (pml4, va);
+	if (pde == NULL || (*pde & PTE_P))
+		return false;
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
+/* Maps the 2 MB of physical memory at PA at kernel virtual address
+ * VA of PML4, with a single page directory entry, writable if RW.
+ * For paging_init(), which falls back to 4 kB pages if this returns
+ * false: if the CPU has no 2 MB pages or memory allocation failed.
+ * An access to a single page of the range, like a change of its
+ * permissions, splits the mapping as pml4e_walk() does for user
+ * pages; pml4_destroy() never frees kernel mappings. */
+bool
+pml4_set_kernel_huge_page (uint64_t *pml4, uint64_t va, uint64_t pa,
+		bool rw) {
+	static int has_pse = -1;
+	uint64_t *pde;
+
+	ASSERT ((va & (HPGSIZE - 1)) == 0);
+	ASSERT ((pa & (HPGSIZE - 1)) == 0);
+	ASSERT (is_kernel_vaddr ((void *) va));
+
+	if (has_pse < 0) {
+		uint32_t eax, ebx, ecx, edx;
+
+		cpuid (1, &eax, &ebx, &ecx, &edx);
+		has_pse = (edx & CPUID_1_EDX_PSE) != 0;
+	}
+	if (!has_pse)
+		return false;
+
+	pde = pde_create (pml4, va);
+	if (pde == NULL)
+		return false;
+	ASSERT (!(*pde & PTE_P));
+	*pde = pa | PTE_PS | PTE_P | PTE_G | (rw ? PTE_W : 0);
+	return true;
+}
+
+/* If UPAGE lies in a 2 MB page of PML4, maps that page with 4 kB
+ * pages instead.  Returns false if memory allocation failed, true
+ * otherwise. */
+bool
+pml4_split_huge_page (uint64_t *pml4, void *upage) {
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) upage);
+
+	if (pte == NULL || !(*pte & PTE_PS))
+		return true;
+	return pml4e_walk (pml4, (uint64_t) upage, false) != NULL;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -257,18 +687,100 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, (uint64_t) upage);
+	}
+}
+
+/* Like pml4_clear_page() for BATCH's page table, but leaves the TLB
+ * invalidation to tlb_batch_flush(). */
+void
+pml4_clear_page_batched (struct tlb_batch *batch, void *upage) {
+	uint64_t *pte;
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pte = pml4e_walk (batch->pml4, (uint64_t) upage, false);
+
+	if (pte != NULL && (*pte & PTE_P) != 0) {
+		*pte &= ~PTE_P;
+		tlb_batch_add (batch, (uint64_t) upage);
 	}
 }
 
+/* Moves the entry for user page FROM in BATCH's page table, whether
+ * it maps a frame or holds a swap slot, to page TO, which must have
+ * neither, and leaves FROM with none, for mremap().  The entry keeps
+ * its accessed and dirty bits.  FROM's TLB entry is invalidated by
+ * tlb_batch_flush().  Returns false, changing nothing, if memory for
+ * a page table ran out. */
+bool
+pml4_move_page (struct tlb_batch *batch, void *from, void *to) {
+	uint64_t *src, *dst;
+
+	ASSERT (pg_ofs (from) == 0 && pg_ofs (to) == 0);
+	ASSERT (is_user_vaddr (from) && is_user_vaddr (to));
+
+	src = pml4e_walk (batch->pml4, (uint64_t) from, false);
+	if (src == NULL || *src == 0)
+		return true;
+	dst = pml4e_walk (batch->pml4, (uint64_t) to, true);
+	if (dst == NULL)
+		return false;
+	ASSERT (!(*dst & PTE_P) && !is_swap_pte (*dst));
+	*dst = *src;
+	*src = 0;
+	if (*dst & PTE_P)
+		tlb_batch_add (batch, (uint64_t) from);
+	return true;
+}
+
+/* Replaces the entry for UPAGE in PML4, which must not be present,
+ * with one holding swap slot SLOT of the page, writable if RW is
+ * true.  Returns false if memory for a page table ran out. */
+bool
+pml4_set_swap (uint64_t *pml4, void *upage, size_t slot, bool rw) {
+	uint64_t *pte;
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pte = pml4e_walk (pml4, (uint64_t) upage, true);
+	if (pte == NULL)
+		return false;
+	ASSERT (!(*pte & PTE_P));
+	*pte = ((uint64_t) slot << PTXSHIFT) | PTE_SWAP | (rw ? PTE_W : 0);
+	return true;
+}
+
+/* Returns true if the entry for UPAGE in PML4 holds a swap slot,
+ * storing it in *SLOT and whether the page is writable in *RW. */
+bool
+pml4_get_swap (uint64_t *pml4, const void *upage, size_t *slot, bool *rw) {
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) upage);
+
+	if (pte == NULL || (*pte & PTE_PS) || !is_swap_pte (*pte))
+		return false;
+	*slot = PTE_SWAP_SLOT (*pte);
+	*rw = (*pte & PTE_W) != 0;
+	return true;
+}
+
+/* Clears the entry for UPAGE in PML4 if it holds a swap slot. */
+void
+pml4_clear_swap (uint64_t *pml4, const void *upage) {
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) upage);
+
+	if (pte != NULL && !(*pte & PTE_PS) && is_swap_pte (*pte))
+		*pte = 0;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -283,18 +795,42 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		/* A cached entry that is already dirty would let writes
+		   through without setting the bit again. */
+		tlb_invalidate (pml4, (uint64_t) vpage);
+	}
+}
+
+/* Like pml4_set_dirty() for BATCH's page table, but leaves the TLB
+ * invalidation to tlb_batch_flush(). */
+void
+pml4_set_dirty_batched (struct tlb_batch *batch, const void *vpage,
+		bool dirty) {
+	uint64_t *pte = pml4e_walk (batch->pml4, (uint64_t) vpage, false);
+	if (pte) {
+		if (dirty)
+			*pte |= PTE_D;
+		else
+			*pte &= ~(uint32_t) PTE_D;
+		tlb_batch_add (batch, (uint64_t) vpage);
 	}
 }
 
+/* Returns true if PML4 maps virtual page VPAGE present and
+ * writable. */
+bool
+pml4_is_writable (uint64_t *pml4, const void *vpage) {
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
+	return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
  * accessed recently, that is, between the time the PTE was
  * installed and the last time it was cleared.  Returns false if
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -309,7 +845,11 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
+		/* A page table that is not active is left alone: at worst a
+		   cached entry keeps the bit from being set again, and the
+		   page looks older than it is.  Flushing its whole PCID for
+		   every bit the clock clears would cost far more. */
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) vpage);
 	}
 }
@@ -2,15 +2,20 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/shrinker.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -24,13 +29,66 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
-
-/* A memory pool. */
+   kernel pool, but that's just fine for demonstration purposes.
+   Neither half sits idle while the other runs out, though: a pool
+   that cannot satisfy a request borrows from the other.  The user
+   pool lends the kernel all it has free, since the VM can evict to
+   get user pages back, while the kernel pool keeps KERNEL_RESERVE
+   of its pages to itself.  A borrowed page goes back to the pool it
+   came from when freed, as every page does.  Lending to user pages
+   is off under -ul, which is there to make user memory scarce.
+
+   Each pool is a binary buddy allocator.  Free pages form blocks
+   of 2**ORDER pages, aligned to their size in page number, kept on
+   one free list per order.  An allocation splits the smallest
+   block large enough, and a free merges a block with its buddy,
+   the other half of the block twice its size, for as long as the
+   buddy is free too; both take O(log n) steps.  Requests for page
+   counts other than a power of two give back the tail of their
+   block.  A free block's header lives in its own first page.
+
+   Once the pools are fragmented, single pages may be plenty while
+   no run of them is free.  With VM, a request for several pages
+   that fails then has vm_compact() move user pages out of the way,
+   and is tried once more. */
+
+/* Largest block, in pages.  Orders up to 16 cover pools of 256 MB
+   in single blocks. */
+#define MAX_ORDER 16
+
+/* Single pages freed are kept in a stash of up to STASH_CNT pages,
+   and handed out again last in, first out, while their contents are
+   likely still cached.  The stash takes STASH_BATCH pages from the
+   free lists when it runs empty and gives its oldest STASH_BATCH
+   back when it fills up, so most single-page requests never touch
+   the free lists. */
+#define STASH_CNT 64
+#define STASH_BATCH 16
+
+/* A memory pool.  Looked at only with interrupts off: pages are
+   freed by the scheduler, which cannot take locks, and no
+   operation on the free lists takes longer than O(log n). */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	struct list free_lists[MAX_ORDER + 1]; /* Free blocks, by order. */
+
+	void *stash[STASH_CNT];         /* Free single pages, newest last. */
+	size_t stash_cnt;               /* Pages in stash. */
+	uint64_t stash_hits;            /* Single pages taken from stash. */
+	uint64_t stash_misses;          /* Times stash had to be refilled. */
+
+	size_t page_cnt;                /* Usable pages. */
+	size_t used_cnt;                /* Pages handed out and not freed. */
+	size_t used_max;                /* Most pages ever handed out at once. */
+	uint64_t lent_cnt;              /* Pages handed out to the other pool's
+	                                   requests. */
+};
+
+/* Header of a free block, in its first page. */
+struct free_block {
+	struct list_elem elem;          /* Element in a free_lists. */
+	unsigned order;                 /* Block has 2**ORDER pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,8 +96,37 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Part of the kernel pool it never lends to user requests, as a
+   fraction of the pool, and in pages, set by palloc_init(). */
+#define KERNEL_RESERVE_DIV 4
+static size_t kernel_reserve;
+
+/* User pages the idle thread zeroed ahead of need.  They are marked
+   used in the user pool, and handed out first to single-page
+   PAL_USER | PAL_ZERO requests, and last to other single-page user
+   requests.  Looked at only with interrupts off, so that the idle
+   thread needs no lock to add to them. */
+#define PREZERO_CNT 64
+static void *prezeroed[PREZERO_CNT];
+static size_t prezeroed_cnt;
+
+static void *prezeroed_pop (void);
+static void *pools_get (enum palloc_flags, size_t page_cnt, unsigned order,
+		struct pool **);
+static void *pool_get (struct pool *, size_t page_cnt, unsigned order);
+static bool kernel_lends (void);
+static size_t kernel_lendable_cnt (void);
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
+static void init_free_lists (struct pool *);
+static void *pool_alloc (struct pool *, size_t page_cnt, unsigned order);
+static void pool_free (struct pool *, void *pages, size_t page_cnt);
+static unsigned order_for (size_t page_cnt);
+static void *stash_get (struct pool *);
+static void stash_put (struct pool *, void *page);
+static bool stash_drain (struct pool *, size_t cnt);
+static void pool_account (struct pool *, size_t page_cnt, bool alloc);
 
 static bool page_from_pool (const struct pool *, void *page);
 
@@ -232,6 +319,9 @@ split:
 			}
 		}
 	}
+
+	init_free_lists (&kernel_pool);
+	init_free_lists (&user_pool);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -250,28 +340,94 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	kernel_reserve = kernel_pool.page_cnt / KERNEL_RESERVE_DIV;
 	return ext_mem.end;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   otherwise from the kernel pool, or from the other pool if that
+   one is out of them.  If PAL_ZERO is set in FLAGS, then the pages
+   are filled with zeros.  If too few pages are available, returns
+   a null pointer, unless PAL_ASSERT is set in FLAGS, in which case
+   the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
-	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	bool single_user = (flags & PAL_USER) && page_cnt == 1;
+	struct pool *pool = &user_pool;
+	void *pages = NULL;
+	bool zeroed = false;
+	enum intr_level old_level;
+
+	if (single_user && (flags & PAL_ZERO))
+		zeroed = (pages = prezeroed_pop ()) != NULL;
+	if (pages == NULL && page_cnt > 0) {
+		old_level = intr_disable ();
+		pages = pools_get (flags, page_cnt, order_for (page_cnt), &pool);
+		intr_set_level (old_level);
+
+		if (pages == NULL && single_user)
+			zeroed = (pages = prezeroed_pop ()) != NULL;
+	}
+	/* Kernel caches give back what they can spare before this fails,
+	   and before the VM evicts a user page for want of a frame. */
+	if (pages == NULL && page_cnt > 0 && shrink_caches (page_cnt) > 0) {
+		old_level = intr_disable ();
+		pages = pools_get (flags, page_cnt, order_for (page_cnt), &pool);
+		intr_set_level (old_level);
+	}
+#ifdef VM
+	if (pages == NULL && page_cnt > 1 && vm_compact (order_for (page_cnt))) {
+		old_level = intr_disable ();
+		pages = pools_get (flags, page_cnt, order_for (page_cnt), &pool);
+		intr_set_level (old_level);
+	}
+#endif
+
+	if (pages) {
+		old_level = intr_disable ();
+		pool_account (pool, page_cnt, true);
+		intr_set_level (old_level);
+		if ((flags & PAL_ZERO) && !zeroed)
+			memset (pages, 0, PGSIZE * page_cnt);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+
+	return pages;
+}
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+/* Like palloc_get_multiple(), but the first page's kernel virtual
+   address is a multiple of ALIGN pages, which must be a power of
+   two.  Since KERN_BASE is aligned to the largest page size, so is
+   the physical address.  Blocks are aligned to their size, so this
+   only takes a block of at least ALIGN pages. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) {
+	unsigned order = order_for (page_cnt);
+	enum intr_level old_level;
+	struct pool *pool;
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	ASSERT (align != 0 && (align & (align - 1)) == 0);
+
+	if (order < order_for (align))
+		order = order_for (align);
+	old_level = intr_disable ();
+	pages = pools_get (flags, page_cnt, order, &pool);
+	if (pages != NULL)
+		pool_account (pool, page_cnt, true);
+	intr_set_level (old_level);
+#ifdef VM
+	if (pages == NULL && order > 0 && vm_compact (order)) {
+		old_level = intr_disable ();
+		pages = pools_get (flags, page_cnt, order, &pool);
+		if (pages != NULL)
+			pool_account (pool, page_cnt, true);
+		intr_set_level (old_level);
+	}
+#endif
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -284,6 +440,102 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Takes PAGE_CNT pages, in a block of 2**ORDER pages unless a single
+   page will do, for a request of FLAGS from its own pool, or else
+   from the other pool if that one lends them, and stores the pool
+   they came from in *POOL.  Returns a null pointer if neither pool
+   has them.  Interrupts must be off. */
+static void *
+pools_get (enum palloc_flags flags, size_t page_cnt, unsigned order,
+		struct pool **pool) {
+	struct pool *own = flags & PAL_USER ? &user_pool : &kernel_pool;
+	struct pool *other = own == &user_pool ? &kernel_pool : &user_pool;
+	void *pages;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	*pool = own;
+	pages = pool_get (own, page_cnt, order);
+	if (pages != NULL || page_cnt == 0)
+		return pages;
+
+	if (other == &kernel_pool && kernel_lendable_cnt () < page_cnt)
+		return NULL;
+	pages = pool_get (other, page_cnt, order);
+	if (pages != NULL) {
+		other->lent_cnt += page_cnt;
+		*pool = other;
+	}
+	return pages;
+}
+
+/* Takes PAGE_CNT pages from POOL as pools_get() does.  Interrupts
+   must be off. */
+static void *
+pool_get (struct pool *pool, size_t page_cnt, unsigned order) {
+	void *pages;
+
+	if (page_cnt == 1 && order == 0)
+		return stash_get (pool);
+	pages = pool_alloc (pool, page_cnt, order);
+	/* Pages in the stash may be all that keeps blocks apart. */
+	if (pages == NULL && stash_drain (pool, STASH_CNT))
+		pages = pool_alloc (pool, page_cnt, order);
+	return pages;
+}
+
+/* Returns true if the kernel pool lends pages to user requests. */
+static bool
+kernel_lends (void) {
+	return user_page_limit == SIZE_MAX;
+}
+
+/* Returns the number of free pages the kernel pool would lend to
+   user requests now.  Interrupts must be off. */
+static size_t
+kernel_lendable_cnt (void) {
+	size_t free_cnt = kernel_pool.page_cnt - kernel_pool.used_cnt;
+
+	if (!kernel_lends () || free_cnt <= kernel_reserve)
+		return 0;
+	return free_cnt - kernel_reserve;
+}
+
+/* Removes and returns a page zeroed by palloc_prezero(), or a null
+   pointer if there is none. */
+static void *
+prezeroed_pop (void) {
+	enum intr_level old_level = intr_disable ();
+	void *page = prezeroed_cnt > 0 ? prezeroed[--prezeroed_cnt] : NULL;
+
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Zeroes a free user page ahead of need.  Meant for the idle thread,
+   so it never blocks: returns false, doing nothing, if enough pages
+   are zeroed already or if the pool has no free page. */
+bool
+palloc_prezero (void) {
+	enum intr_level old_level;
+	void *page = NULL;
+
+	old_level = intr_disable ();
+	if (prezeroed_cnt < PREZERO_CNT)
+		page = pool_alloc (&user_pool, 1, 0);
+	intr_set_level (old_level);
+	if (page == NULL)
+		return false;
+
+	clear_page (page);
+
+	/* Only this function adds, so there is still room. */
+	old_level = intr_disable ();
+	ASSERT (prezeroed_cnt < PREZERO_CNT);
+	prezeroed[prezeroed_cnt++] = page;
+	intr_set_level (old_level);
+	return true;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -296,11 +548,107 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Returns the first page of a range of pages and stores the number
+   of pages in it into *PAGE_CNT.  Every page palloc_get_page
+   (PAL_USER) returns lies in this range: the user pool, and the
+   kernel pool below it if that lends to user requests. */
+void *
+palloc_user_pool (size_t *page_cnt) {
+	uint8_t *start = user_pool.base;
+	uint8_t *end = start + bitmap_size (user_pool.used_map) * PGSIZE;
+
+	if (kernel_lends () && kernel_pool.base < start)
+		start = kernel_pool.base;
+	*page_cnt = (end - start) / PGSIZE;
+	return start;
+}
+
+/* Returns the number of pages user requests could have at most: the
+   user pool's, and what the kernel pool may lend. */
+size_t
+palloc_user_page_cnt (void) {
+	if (!kernel_lends ())
+		return user_pool.page_cnt;
+	return user_pool.page_cnt + kernel_pool.page_cnt - kernel_reserve;
+}
+
+/* Returns the number of free pages user requests can get, counting
+   those zeroed ahead of need and those the kernel pool would lend. */
+size_t
+palloc_user_free_cnt (void) {
+	enum intr_level old_level = intr_disable ();
+	size_t cnt = user_pool.page_cnt - user_pool.used_cnt
+		+ kernel_lendable_cnt ();
+
+	intr_set_level (old_level);
+	return cnt;
+}
+
+/* Returns true if the page at PAGE is free.  Pages in a stash
+   count as free, as a pool drains its stash before it fails a
+   request for several pages; pages zeroed ahead of need do not.
+   Returns false for a page in neither pool. */
+bool
+palloc_page_is_free (const void *page) {
+	struct pool *pool;
+	enum intr_level old_level;
+	bool free;
+	size_t i;
+
+	ASSERT (pg_ofs (page) == 0);
+	if (page_from_pool (&user_pool, (void *) page))
+		pool = &user_pool;
+	else if (page_from_pool (&kernel_pool, (void *) page))
+		pool = &kernel_pool;
+	else
+		return false;
+
+	old_level = intr_disable ();
+	free = !bitmap_test (pool->used_map, pg_no (page) - pg_no (pool->base));
+	for (i = 0; !free && i < pool->stash_cnt; i++)
+		free = pool->stash[i] == page;
+	intr_set_level (old_level);
+	return free;
+}
+
+/* Returns true if the PAGE_CNT pages at PAGES lie all in one pool,
+   so that they may form a block once free. */
+bool
+palloc_pages_in_pool (const void *pages, size_t page_cnt) {
+	void *last = (uint8_t *) pages + (page_cnt - 1) * PGSIZE;
+
+	ASSERT (page_cnt > 0);
+	return (page_from_pool (&user_pool, (void *) pages)
+			&& page_from_pool (&user_pool, last))
+		|| (page_from_pool (&kernel_pool, (void *) pages)
+			&& page_from_pool (&kernel_pool, last));
+}
+
+/* Copies the page at SRC to the page at DST, both page-aligned. */
+void
+copy_page (void *dst, const void *src) {
+	size_t cnt = PGSIZE / 8;
+
+	ASSERT (pg_ofs (dst) == 0 && pg_ofs (src) == 0);
+	asm volatile ("rep movsq"
+			: "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+}
+
+/* Zeroes the page-aligned PAGE. */
+void
+clear_page (void *page) {
+	size_t cnt = PGSIZE / 8;
+
+	ASSERT (pg_ofs (page) == 0);
+	asm volatile ("rep stosq"
+			: "+D" (page), "+c" (cnt) : "a" (0) : "memory");
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
-	size_t page_idx;
+	enum intr_level old_level;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
@@ -313,13 +661,16 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	else
 		NOT_REACHED ();
 
-	page_idx = pg_no (pages) - pg_no (pool->base);
-
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
-	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	old_level = intr_disable ();
+	pool_account (pool, page_cnt, false);
+	if (page_cnt == 1)
+		stash_put (pool, pages);
+	else
+		pool_free (pool, pages, page_cnt);
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +679,69 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Frees the PAGE_CNT single pages whose addresses are in PAGES, as
+   palloc_free_page() would each, but turning interrupts off once per
+   STASH_BATCH pages.  Pages the stash has no room for go straight
+   back to the free lists, instead of pushing out pages that may
+   still be cached. */
+void
+palloc_free_pages (void **pages, size_t page_cnt) {
+	size_t i = 0;
+
+	while (i < page_cnt) {
+		size_t end = i + STASH_BATCH < page_cnt ? i + STASH_BATCH : page_cnt;
+		enum intr_level old_level;
+
+#ifndef NDEBUG
+		size_t j;
+
+		for (j = i; j < end; j++)
+			memset (pages[j], 0xcc, PGSIZE);
+#endif
+		old_level = intr_disable ();
+		for (; i < end; i++) {
+			struct pool *pool;
+
+			ASSERT (pg_ofs (pages[i]) == 0);
+			if (page_from_pool (&user_pool, pages[i]))
+				pool = &user_pool;
+			else if (page_from_pool (&kernel_pool, pages[i]))
+				pool = &kernel_pool;
+			else
+				NOT_REACHED ();
+			pool_account (pool, 1, false);
+			if (pool->stash_cnt < STASH_CNT)
+				pool->stash[pool->stash_cnt++] = pages[i];
+			else
+				pool_free (pool, pages[i], 1);
+		}
+		intr_set_level (old_level);
+	}
+}
+
+/* Prints statistics about page allocation. */
+void
+palloc_print_stats (void) {
+	static const struct {
+		const char *name;
+		struct pool *pool;
+	} pools[] = {{"kernel", &kernel_pool}, {"user", &user_pool}};
+	size_t i;
+
+	for (i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *p = pools[i].pool;
+		enum intr_level old_level = intr_disable ();
+		size_t page_cnt = p->page_cnt, used = p->used_cnt, max = p->used_max;
+		uint64_t hits = p->stash_hits, misses = p->stash_misses;
+		uint64_t lent = p->lent_cnt;
+
+		intr_set_level (old_level);
+		printf ("Palloc: %s pool %zu of %zu pages free, at most %zu used, "
+				"%llu lent; stash %llu hits, %llu misses\n", pools[i].name,
+				page_cnt - used, page_cnt, max, lent, hits, misses);
+	}
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -337,7 +751,6 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
 
-	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
 
@@ -356,3 +769,213 @@ page_from_pool (const struct pool *pool, void *page) {
 	size_t end_page = start_page + bitmap_size (pool->used_map);
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static unsigned
+order_for (size_t page_cnt) {
+	unsigned order = 0;
+
+	while (((size_t) 1 << order) < page_cnt)
+		order++;
+	return order;
+}
+
+/* Returns the header of the block at page number PAGE_NO. */
+static struct free_block *
+block_at (size_t page_no) {
+	return (struct free_block *) (page_no << PGBITS);
+}
+
+/* Adds the block of 2**ORDER pages at page number PAGE_NO to the
+   free lists of POOL. */
+static void
+free_list_push (struct pool *pool, size_t page_no, unsigned order) {
+	struct free_block *b = block_at (page_no);
+
+	b->order = order;
+	list_push_front (&pool->free_lists[order], &b->elem);
+}
+
+/* Returns true if the block of 2**ORDER pages at page number PAGE_NO
+   lies in POOL, and is on its free lists. */
+static bool
+block_is_free (const struct pool *pool, size_t page_no, unsigned order) {
+	size_t start = pg_no (pool->base);
+	size_t end = start + bitmap_size (pool->used_map);
+
+	/* A free page aligned to its block lies in a free block no larger,
+	   since a larger one would take in the block being freed, so it
+	   is the first page of that block. */
+	return page_no >= start && page_no + ((size_t) 1 << order) <= end
+		&& !bitmap_test (pool->used_map, page_no - start)
+		&& block_at (page_no)->order == order;
+}
+
+/* Takes a block of 2**ORDER pages from POOL, splitting a larger one
+   if need be, and returns its first PAGE_CNT pages, giving the rest
+   back.  Returns a null pointer if POOL has no block large enough.
+   Interrupts must be off. */
+static void *
+pool_alloc (struct pool *pool, size_t page_cnt, unsigned order) {
+	size_t start = pg_no (pool->base);
+	struct free_block *b;
+	size_t page_no;
+	unsigned k;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (page_cnt <= (size_t) 1 << order);
+	for (k = order; k <= MAX_ORDER; k++)
+		if (!list_empty (&pool->free_lists[k]))
+			break;
+	if (k > MAX_ORDER)
+		return NULL;
+
+	b = list_entry (list_pop_front (&pool->free_lists[k]),
+			struct free_block, elem);
+	page_no = pg_no (b);
+	/* Keep the lower half, freeing the upper one. */
+	while (k > order) {
+		k--;
+		free_list_push (pool, page_no + ((size_t) 1 << k), k);
+	}
+	bitmap_set_multiple (pool->used_map, page_no - start, (size_t) 1 << order,
+			true);
+	pool_free (pool, (uint8_t *) b + PGSIZE * page_cnt,
+			((size_t) 1 << order) - page_cnt);
+	return b;
+}
+
+/* Returns the block of 2**ORDER pages at page number PAGE_NO, which
+   must be in use, to POOL, merging it with its buddies. */
+static void
+block_free (struct pool *pool, size_t page_no, unsigned order) {
+	size_t start = pg_no (pool->base);
+	size_t first = page_no, cnt = (size_t) 1 << order;
+
+	while (order < MAX_ORDER) {
+		size_t buddy = page_no ^ ((size_t) 1 << order);
+
+		if (!block_is_free (pool, buddy, order))
+			break;
+		list_remove (&block_at (buddy)->elem);
+		if (buddy < page_no)
+			page_no = buddy;
+		order++;
+	}
+	bitmap_set_multiple (pool->used_map, first - start, cnt, false);
+	free_list_push (pool, page_no, order);
+}
+
+/* Returns the PAGE_CNT pages in use at PAGES to POOL, as the fewest
+   blocks each aligned to its size.  Interrupts must be off. */
+static void
+pool_free (struct pool *pool, void *pages, size_t page_cnt) {
+	size_t page_no = pg_no (pages);
+	size_t end = page_no + page_cnt;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (bitmap_all (pool->used_map, page_no - pg_no (pool->base),
+				page_cnt));
+	while (page_no < end) {
+		unsigned order = 0;
+
+		while (order < MAX_ORDER
+				&& page_no % ((size_t) 2 << order) == 0
+				&& page_no + ((size_t) 2 << order) <= end)
+			order++;
+		block_free (pool, page_no, order);
+		page_no += (size_t) 1 << order;
+	}
+}
+
+/* Puts the free pages of POOL, as populate_pools() left them in its
+   used_map, on its free lists. */
+static void
+init_free_lists (struct pool *pool) {
+	size_t cnt = bitmap_size (pool->used_map);
+	size_t idx = 0, end;
+	enum intr_level old_level;
+	unsigned order;
+
+	for (order = 0; order <= MAX_ORDER; order++)
+		list_init (&pool->free_lists[order]);
+
+	old_level = intr_disable ();
+	while ((idx = bitmap_scan (pool->used_map, idx, 1, false)) != BITMAP_ERROR) {
+		end = bitmap_scan (pool->used_map, idx, 1, true);
+		if (end == BITMAP_ERROR)
+			end = cnt;
+		bitmap_set_multiple (pool->used_map, idx, end - idx, true);
+		pool_free (pool, pool->base + PGSIZE * idx, end - idx);
+		pool->page_cnt += end - idx;
+		idx = end;
+	}
+	intr_set_level (old_level);
+}
+
+/* Takes a single page from the stash of POOL, refilling it first
+   if it is empty.  Returns a null pointer if POOL has no free page.
+   Interrupts must be off. */
+static void *
+stash_get (struct pool *pool) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (pool->stash_cnt > 0) {
+		pool->stash_hits++;
+		return pool->stash[--pool->stash_cnt];
+	}
+
+	pool->stash_misses++;
+	while (pool->stash_cnt < STASH_BATCH) {
+		void *page = pool_alloc (pool, 1, 0);
+
+		if (page == NULL)
+			break;
+		pool->stash[pool->stash_cnt++] = page;
+	}
+	return pool->stash_cnt > 0 ? pool->stash[--pool->stash_cnt] : NULL;
+}
+
+/* Puts PAGE, a single page of POOL, in the stash of POOL, returning
+   the oldest pages stashed to POOL first if the stash is full.
+   Interrupts must be off. */
+static void
+stash_put (struct pool *pool, void *page) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (pool->stash_cnt == STASH_CNT)
+		stash_drain (pool, STASH_BATCH);
+	pool->stash[pool->stash_cnt++] = page;
+}
+
+/* Returns the oldest CNT pages, or all if fewer, of the stash of
+   POOL to POOL.  Returns true if there were any.  Interrupts must be
+   off. */
+static bool
+stash_drain (struct pool *pool, size_t cnt) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (cnt > pool->stash_cnt)
+		cnt = pool->stash_cnt;
+	for (i = 0; i < cnt; i++)
+		pool_free (pool, pool->stash[i], 1);
+	pool->stash_cnt -= cnt;
+	memmove (pool->stash, pool->stash + cnt,
+			sizeof *pool->stash * pool->stash_cnt);
+	return cnt > 0;
+}
+
+/* Counts PAGE_CNT pages of POOL as handed out, if ALLOC, or as given
+   back.  Pages in the stash, or zeroed ahead of need, count as
+   free.  Interrupts must be off. */
+static void
+pool_account (struct pool *pool, size_t page_cnt, bool alloc) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (alloc) {
+		pool->used_cnt += page_cnt;
+		if (pool->used_cnt > pool->used_max)
+			pool->used_max = pool->used_cnt;
+	} else {
+		ASSERT (pool->used_cnt >= page_cnt);
+		pool->used_cnt -= page_cnt;
+	}
+}
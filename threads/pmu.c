@@ -0,0 +1,197 @@
+#include "threads/pmu.h"
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* Performance counters.  With -pmu, and an Intel processor with
+   architectural performance monitoring, the counters are programmed
+   once at boot to count the events PMU_* in user and kernel mode
+   and left running.  At each thread switch, what they counted since
+   the last switch goes to the thread switched from, and to the
+   totals, so no counter is ever saved or reloaded: a thread's tally
+   is the sum of what it saw while running. */
+
+/* Model-specific registers of architectural performance monitoring. */
+#define MSR_PMC0 0xc1                   /* General-purpose counters. */
+#define MSR_PERFEVTSEL0 0x186           /* Their event selects. */
+#define MSR_FIXED_CTR0 0x309            /* Fixed counters, version 2+. */
+#define MSR_FIXED_CTR_CTRL 0x38d
+#define MSR_PERF_GLOBAL_CTRL 0x38f
+
+/* Event select bits. */
+#define EVTSEL_USR (1 << 16)            /* Count in user mode. */
+#define EVTSEL_OS (1 << 17)             /* Count in kernel mode. */
+#define EVTSEL_EN (1 << 22)             /* Enable. */
+
+bool pmu_enabled;
+
+/* How each event is counted.  MSR is 0 for an event not counted. */
+struct pmu_counter {
+	uint32_t msr;                       /* Counter to read. */
+	uint64_t mask;                      /* Its width, as a mask. */
+};
+static struct pmu_counter counters[PMU_CNT];
+
+/* Architectural events, for general-purpose counters: event number,
+   unit mask, and the bit of CPUID leaf 0xa's EBX that is set if the
+   processor lacks it.  DTLB misses are not architectural; the event
+   is the one most Intel cores since Nehalem share, and has no bit. */
+static const struct {
+	uint8_t event, umask;
+	int missing_bit;
+} events[PMU_CNT] = {
+	[PMU_CYCLES] = {0x3c, 0x00, 0},
+	[PMU_INSTRUCTIONS] = {0xc0, 0x00, 1},
+	[PMU_LLC_REFS] = {0x2e, 0x4f, 3},
+	[PMU_LLC_MISSES] = {0x2e, 0x41, 4},
+	[PMU_BRANCH_MISSES] = {0xc5, 0x00, 6},
+	[PMU_DTLB_MISSES] = {0x08, 0x01, -1},
+};
+
+static const char *event_names[PMU_CNT] = {
+	[PMU_CYCLES] = "cycles",
+	[PMU_INSTRUCTIONS] = "instructions",
+	[PMU_LLC_REFS] = "LLC references",
+	[PMU_LLC_MISSES] = "LLC misses",
+	[PMU_BRANCH_MISSES] = "branch misses",
+	[PMU_DTLB_MISSES] = "DTLB misses",
+};
+
+/* Counter readings at the last thread switch, and the totals. */
+static uint64_t last[PMU_CNT];
+static uint64_t totals[PMU_CNT];
+
+/* Programs the counters, if -pmu was given and the processor has
+   architectural performance monitoring.  Cycles and instructions
+   take the fixed counters, if there are any, leaving the others more
+   general-purpose counters. */
+void
+pmu_init (void) {
+	uint32_t eax, ebx, ecx, edx;
+	unsigned version, gp_cnt, fixed_cnt, next_gp = 0;
+	uint64_t global = 0, fixed_ctrl = 0;
+	size_t i;
+
+	if (!pmu_enabled)
+		return;
+	cpuid (0, &eax, &ebx, &ecx, &edx);
+	if (eax >= 0xa)
+		cpuid (0xa, &eax, &ebx, &ecx, &edx);
+	else
+		eax = 0;
+	version = eax & 0xff;
+	if (version == 0) {
+		printf ("pmu: no architectural performance monitoring\n");
+		pmu_enabled = false;
+		return;
+	}
+	gp_cnt = (eax >> 8) & 0xff;
+	fixed_cnt = version >= 2 ? edx & 0x1f : 0;
+
+	for (i = 0; i < PMU_CNT; i++) {
+		if (events[i].missing_bit >= 0 && (ebx >> events[i].missing_bit) & 1)
+			continue;
+		if ((i == PMU_INSTRUCTIONS || i == PMU_CYCLES) && fixed_cnt >= 2) {
+			/* Fixed counter 0 counts instructions, 1 cycles. */
+			unsigned idx = i == PMU_INSTRUCTIONS ? 0 : 1;
+
+			counters[i].msr = MSR_FIXED_CTR0 + idx;
+			counters[i].mask = (1ull << ((edx >> 5) & 0xff)) - 1;
+			fixed_ctrl |= 0x3ull << (4 * idx);
+			global |= 1ull << (32 + idx);
+		} else if (next_gp < gp_cnt) {
+			write_msr (MSR_PERFEVTSEL0 + next_gp, events[i].event
+					| events[i].umask << 8 | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+			counters[i].msr = MSR_PMC0 + next_gp;
+			counters[i].mask = (1ull << ((eax >> 16) & 0xff)) - 1;
+			global |= 1ull << next_gp;
+			next_gp++;
+		}
+	}
+	if (version >= 2) {
+		write_msr (MSR_FIXED_CTR_CTRL, fixed_ctrl);
+		write_msr (MSR_PERF_GLOBAL_CTRL, global);
+	}
+	for (i = 0; i < PMU_CNT; i++)
+		if (counters[i].msr != 0)
+			last[i] = read_msr (counters[i].msr);
+}
+
+/* Adds what the counters counted since the last call to COUNTS, and
+   starts counting afresh.  Interrupts must be off. */
+static void
+pmu_take (uint64_t counts[PMU_CNT]) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	for (i = 0; i < PMU_CNT; i++)
+		if (counters[i].msr != 0) {
+			uint64_t now = read_msr (counters[i].msr);
+			uint64_t delta = (now - last[i]) & counters[i].mask;
+
+			counts[i] += delta;
+			totals[i] += delta;
+			last[i] = now;
+		}
+}
+
+/* Charges the events counted since the last switch to PREV, the
+   thread being switched from.  Called by schedule(). */
+void
+pmu_switch (struct thread *prev) {
+	if (pmu_enabled)
+		pmu_take (prev->pmu);
+}
+
+/* Stores in COUNTS the events the current thread has counted, if
+   SELF, else those of the whole system, PMU_NONE for the ones that
+   are not counted.  Returns false if the counters are not in use. */
+bool
+pmu_read (uint64_t counts[PMU_CNT], bool self) {
+	struct thread *t = thread_current ();
+	enum intr_level old_level;
+	size_t i;
+
+	if (!pmu_enabled)
+		return false;
+	old_level = intr_disable ();
+	pmu_take (t->pmu);
+	for (i = 0; i < PMU_CNT; i++)
+		counts[i] = counters[i].msr == 0 ? PMU_NONE
+			: self ? t->pmu[i] : totals[i];
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Prints the events counted by the whole system, and the rates of
+   the misses. */
+void
+pmu_print_stats (void) {
+	uint64_t counts[PMU_CNT];
+	const char *sep = "";
+	size_t i;
+
+	if (!pmu_read (counts, false))
+		return;
+	printf ("PMU:");
+	for (i = 0; i < PMU_CNT; i++)
+		if (counts[i] != PMU_NONE) {
+			printf ("%s %llu %s", sep, (unsigned long long) counts[i],
+					event_names[i]);
+			sep = ",";
+		}
+	printf ("\n");
+	if (counts[PMU_CYCLES] != PMU_NONE && counts[PMU_INSTRUCTIONS] != PMU_NONE
+			&& counts[PMU_CYCLES] != 0)
+		printf ("PMU: %llu.%02llu instructions per cycle\n",
+				(unsigned long long) (counts[PMU_INSTRUCTIONS]
+					/ counts[PMU_CYCLES]),
+				(unsigned long long) (counts[PMU_INSTRUCTIONS] * 100
+					/ counts[PMU_CYCLES] % 100));
+	if (counts[PMU_LLC_REFS] != PMU_NONE && counts[PMU_LLC_MISSES] != PMU_NONE
+			&& counts[PMU_LLC_REFS] != 0)
+		printf ("PMU: %llu%% of LLC references missed\n",
+				(unsigned long long) (counts[PMU_LLC_MISSES] * 100
+					/ counts[PMU_LLC_REFS]));
+}
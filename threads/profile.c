@@ -0,0 +1,147 @@
+#include "threads/profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Sampling profiler.  Each timer interrupt records the interrupted
+   instruction, the return addresses found by following the frame
+   pointers from there if it was kernel code, and the running
+   thread's name, spaces made underscores, into the running processor's ring of samples,
+   overwriting the oldest once the ring is full.  At power off the
+   samples are folded, identical ones counted together, and printed
+   one line each, beginning "profile:", for utils/profile to
+   symbolize into a flat profile or folded stacks. */
+
+/* Pages of samples per processor. */
+#define PROFILE_PAGES 64
+#define PROFILE_SAMPLE_CNT \
+	(PROFILE_PAGES * PGSIZE / sizeof (struct profile_sample))
+
+bool profile_enabled;
+
+/* A processor's ring.  HEAD counts every sample ever taken; the last
+   PROFILE_SAMPLE_CNT of them are kept, sample I at
+   samples[I % PROFILE_SAMPLE_CNT]. */
+struct profile_ring {
+	struct profile_sample *samples;
+	uint64_t head;
+};
+
+static struct profile_ring rings[CPU_MAX];
+
+/* Makes a ring for each running processor, if profiling is enabled.
+   Profiling is turned off if memory runs out. */
+void
+profile_init (void) {
+	size_t i;
+
+	if (!profile_enabled)
+		return;
+	for (i = 0; i < cpu_cnt; i++) {
+		if (!cpus[i].running)
+			continue;
+		rings[i].samples = palloc_get_multiple (PAL_ZERO, PROFILE_PAGES);
+		if (rings[i].samples == NULL) {
+			printf ("profile: out of memory, profiling disabled\n");
+			profile_enabled = false;
+			return;
+		}
+	}
+}
+
+/* Records where the timer interrupt described by F came in.  Called
+   with interrupts off. */
+void
+profile_sample (const struct intr_frame *f) {
+	struct thread *t = thread_running ();
+	struct profile_ring *ring = &rings[cpu_id ()];
+	struct profile_sample *s;
+	size_t depth = 0;
+	char *p;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (ring->samples == NULL)
+		return;
+	s = &ring->samples[ring->head++ % PROFILE_SAMPLE_CNT];
+	memset (s, 0, sizeof *s);
+	s->user = (f->cs & 3) != 0;
+	strlcpy (s->name, t->name, sizeof s->name);
+	for (p = s->name; *p != '\0'; p++)
+		if (*p == ' ')
+			*p = '_';
+	s->pcs[depth++] = f->rip;
+
+	/* Kernel code keeps its frame pointers on this thread's stack,
+	   the page the interrupt came in on.  User stacks are not
+	   trusted, so user samples hold the rip alone. */
+	if (!s->user) {
+		const uintptr_t *frame = (const uintptr_t *) f->R.rbp;
+
+		while (depth < PROFILE_DEPTH && frame != NULL
+				&& pg_round_down (frame) == (void *) t
+				&& (uintptr_t) frame % sizeof *frame == 0
+				&& pg_ofs (frame) <= PGSIZE - 2 * sizeof *frame
+				&& frame[1] != 0) {
+			s->pcs[depth++] = frame[1];
+			if ((const uintptr_t *) frame[0] <= frame)
+				break;
+			frame = (const uintptr_t *) frame[0];
+		}
+	}
+}
+
+/* Orders samples so that identical ones are adjacent. */
+static int
+compare_samples (const void *a_, const void *b_) {
+	const struct profile_sample *a = a_, *b = b_;
+	int cmp = a->user - b->user;
+
+	if (cmp == 0)
+		cmp = strcmp (a->name, b->name);
+	if (cmp == 0)
+		cmp = memcmp (a->pcs, b->pcs, sizeof a->pcs);
+	return cmp;
+}
+
+/* Prints the samples kept in every ring, folded, as
+   "profile: COUNT k|u NAME PC;PC;...", the interrupted rip first
+   and the PCs in hexadecimal.  Sorts the rings in the process. */
+void
+profile_dump (void) {
+	size_t i;
+
+	if (!profile_enabled)
+		return;
+	for (i = 0; i < CPU_MAX; i++) {
+		struct profile_ring *ring = &rings[i];
+		size_t cnt, j;
+
+		if (ring->samples == NULL)
+			continue;
+		cnt = ring->head < PROFILE_SAMPLE_CNT ? ring->head : PROFILE_SAMPLE_CNT;
+		printf ("Profile: CPU %zu, %llu samples, %zu kept\n", i,
+				(unsigned long long) ring->head, cnt);
+		qsort (ring->samples, cnt, sizeof *ring->samples, compare_samples);
+		for (j = 0; j < cnt; ) {
+			const struct profile_sample *s = &ring->samples[j];
+			size_t run, d;
+
+			for (run = 1; j + run < cnt
+					&& compare_samples (s, &ring->samples[j + run]) == 0; run++)
+				continue;
+			printf ("profile: %zu %c %s ", run, s->user ? 'u' : 'k',
+					s->name[0] != '\0' ? s->name : "-");
+			for (d = 0; d < PROFILE_DEPTH && s->pcs[d] != 0; d++)
+				printf ("%s%llx", d > 0 ? ";" : "",
+						(unsigned long long) s->pcs[d]);
+			printf ("\n");
+			j += run;
+		}
+	}
+}
@@ -0,0 +1,218 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Read-copy-update.
+
+   A reader is never preempted and never sleeps, so a processor
+   that switches threads, or takes a timer tick outside a reader, has
+   no reader left from before: it has passed a quiescent state.  A
+   grace period starts when a writer needs one and ends once every
+   running processor has passed a quiescent state since, and then no
+   reader can still see what was unpublished before it started.
+   thread_preempt() called in a reader, as the timer does, waits for
+   rcu_read_unlock() to switch.
+
+   Callbacks of call_rcu() are run by a work item once the grace
+   period they wait for is over.  One grace period at a time is under
+   way; writers that come during one wait for the next, which starts
+   as soon as it ends.  All the state is looked at with interrupts
+   off. */
+
+/* Grace periods started and ended.  One is under way while they
+   differ. */
+static uint64_t gp_started;
+static uint64_t gp_done;
+
+/* Processors yet to pass a quiescent state in the grace period under
+   way, one bit per index in cpus[]. */
+static uint32_t qs_waiting;
+
+/* Another grace period is wanted once the one under way ends. */
+static bool gp_wanted;
+
+/* Callbacks waiting, in order of grace period, and the work item
+   running them. */
+static struct list callbacks;
+static struct work rcu_work;
+static bool ready;
+
+/* Statistics. */
+static unsigned long long callbacks_run;
+static unsigned long long syncs;
+
+static void rcu_run_callbacks (void *aux UNUSED);
+
+/* Initializes RCU.  Called once the work queue runs, before anything
+   calls call_rcu(). */
+void
+rcu_init (void) {
+	list_init (&callbacks);
+	work_init (&rcu_work, rcu_run_callbacks, NULL, PRI_DEFAULT);
+	ready = true;
+}
+
+/* Starts a grace period.  Interrupts must be off. */
+static void
+gp_start (void) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	gp_started++;
+	gp_wanted = false;
+	qs_waiting = 0;
+	for (i = 0; i < cpu_cnt; i++)
+		if (cpus[i].running)
+			qs_waiting |= 1u << i;
+	if (qs_waiting == 0)
+		gp_done = gp_started;
+}
+
+/* Returns the grace period whose end guarantees that every reader
+   under way now is done, starting one if none is under way.
+   Interrupts must be off. */
+static uint64_t
+gp_request (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (gp_started == gp_done) {
+		gp_start ();
+		return gp_started;
+	}
+	gp_wanted = true;
+	return gp_started + 1;
+}
+
+/* Begins a read-side critical section.  Sections nest.  Until the
+   matching rcu_read_unlock(), the running thread is not preempted,
+   and it must not sleep. */
+void
+rcu_read_lock (void) {
+	thread_current ()->rcu_nesting++;
+	barrier ();
+}
+
+/* Ends a read-side critical section, yielding if the thread was to
+   be preempted in it. */
+void
+rcu_read_unlock (void) {
+	struct thread *t = thread_current ();
+
+	barrier ();
+	ASSERT (t->rcu_nesting > 0);
+	if (--t->rcu_nesting == 0 && t->rcu_resched) {
+		t->rcu_resched = false;
+		if (intr_context ())
+			intr_yield_on_return ();
+		else if (intr_get_level () == INTR_ON)
+			thread_preempt ();
+	}
+}
+
+/* Returns true if the running thread is in a read-side critical
+   section. */
+bool
+rcu_read_lock_held (void) {
+	return thread_current ()->rcu_nesting > 0;
+}
+
+/* Waits until every read-side critical section under way has ended.
+   Must not be called in one, nor in an interrupt handler. */
+void
+synchronize_rcu (void) {
+	enum intr_level old_level;
+	uint64_t gp;
+
+	ASSERT (!intr_context ());
+	ASSERT (!rcu_read_lock_held ());
+
+	old_level = intr_disable ();
+	gp = gp_request ();
+	syncs++;
+	/* Each yield passes this processor through a quiescent state. */
+	while (gp_done < gp)
+		thread_yield ();
+	intr_set_level (old_level);
+}
+
+/* Calls FUNC (HEAD) from a worker thread once every read-side
+   critical section under way has ended.  May be called from an
+   interrupt handler. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func) {
+	enum intr_level old_level;
+
+	ASSERT (ready);
+	ASSERT (func != NULL);
+
+	head->func = func;
+	old_level = intr_disable ();
+	head->gp = gp_request ();
+	list_push_back (&callbacks, &head->elem);
+	intr_set_level (old_level);
+	/* A tick later, so that callbacks made meanwhile go together. */
+	work_queue_delayed (&rcu_work, 1);
+}
+
+/* Records that this processor passed a quiescent state, as no
+   read-side critical section is under way on it, and ends the grace
+   period under way if it was the last processor to.  Called by the
+   scheduler at each switch, and at each timer tick that interrupts
+   no reader.  Interrupts must be off. */
+void
+rcu_quiescent (void) {
+	uint32_t bit = 1u << cpu_id ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (gp_started == gp_done || !(qs_waiting & bit))
+		return;
+	qs_waiting &= ~bit;
+	if (qs_waiting == 0) {
+		gp_done = gp_started;
+		if (gp_wanted)
+			gp_start ();
+	}
+}
+
+/* Runs the callbacks whose grace period is over, and comes back
+   later for the others. */
+static void
+rcu_run_callbacks (void *aux UNUSED) {
+	struct list done;
+	enum intr_level old_level;
+	bool more;
+
+	list_init (&done);
+	old_level = intr_disable ();
+	while (!list_empty (&callbacks)) {
+		struct rcu_head *head = list_entry (list_front (&callbacks),
+				struct rcu_head, elem);
+
+		if (head->gp > gp_done)
+			break;
+		list_push_back (&done, list_pop_front (&callbacks));
+	}
+	more = !list_empty (&callbacks);
+	intr_set_level (old_level);
+
+	while (!list_empty (&done)) {
+		struct rcu_head *head = list_entry (list_pop_front (&done),
+				struct rcu_head, elem);
+
+		head->func (head);
+		callbacks_run++;
+	}
+	if (more)
+		work_queue_delayed (&rcu_work, 1);
+}
+
+/* Prints RCU statistics. */
+void
+rcu_print_stats (void) {
+	printf ("RCU: %llu grace periods, %llu callbacks run, "
+			"%llu synchronize calls\n", (unsigned long long) gp_done,
+			callbacks_run, syncs);
+}
@@ -0,0 +1,257 @@
+#include "threads/rgroup.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
+
+/* Resource groups.
+
+   Each group's use of the processor and of the disks is counted in
+   virtual time, which runs slower the higher its weight: a timer
+   tick costs VTIME_SCALE / CPU_WEIGHT, a sector VTIME_SCALE /
+   IO_WEIGHT.  Picking the group furthest behind, as the scheduler
+   and the disk drivers do among equals, then gives each group time
+   in proportion to its weight, as long as it has work to do.
+
+   A group that had none catches up, when work comes back, to no
+   more than CPU_LAG or IO_LAG behind the virtual clock, the time of
+   the group last picked, so that sitting idle does not earn it the
+   processor or a disk to itself for long.  Virtual times are looked
+   at with interrupts off. */
+#define VTIME_SCALE ((uint64_t) RGROUP_WEIGHT_DEFAULT << 10)
+#define CPU_LAG (4 << 10)       /* A time slice at the default weight. */
+#define IO_LAG (64 << 10)       /* 32 kB at the default weight. */
+
+struct rgroup rgroups[RGROUP_MAX] = {
+	[0] = {
+		.id = 0,
+		.name = "root",
+		.cpu_weight = RGROUP_WEIGHT_DEFAULT,
+		.io_weight = RGROUP_WEIGHT_DEFAULT,
+	},
+};
+
+/* Groups in use, rgroups[0] up to this.  Only grows. */
+int rgroup_cnt = 1;
+
+static uint64_t cpu_vclock;
+static uint64_t io_vclock;
+
+/* Serializes rgroup_create() and rgroup_join(). */
+static struct lock rgroup_lock;
+static bool ready;
+
+/* Returns the group named NAME, or a null pointer. */
+static struct rgroup *
+rgroup_find (const char *name) {
+	int i;
+
+	for (i = 0; i < rgroup_cnt; i++)
+		if (!strcmp (rgroups[i].name, name))
+			return &rgroups[i];
+	return NULL;
+}
+
+/* Makes a group named NAME with the given weights, each between 1
+   and RGROUP_WEIGHT_MAX, and whose processes may keep no more than
+   FRAME_MAX frames resident, any number if 0.  If there is a group
+   named NAME already, sets its instead.  Returns the group's id, or
+   -1 if a weight is out of range, NAME is empty or too long, or
+   there are RGROUP_MAX groups already. */
+int
+rgroup_create (const char *name, unsigned cpu_weight, unsigned io_weight,
+		size_t frame_max) {
+	enum intr_level old_level;
+	struct rgroup *g;
+
+	if (cpu_weight < 1 || cpu_weight > RGROUP_WEIGHT_MAX
+			|| io_weight < 1 || io_weight > RGROUP_WEIGHT_MAX
+			|| name[0] == '\0' || strlen (name) >= sizeof g->name)
+		return -1;
+
+	old_level = intr_disable ();
+	if (!ready) {
+		lock_init (&rgroup_lock);
+		ready = true;
+	}
+	intr_set_level (old_level);
+
+	lock_acquire (&rgroup_lock);
+	g = rgroup_find (name);
+	if (g == NULL) {
+		if (rgroup_cnt == RGROUP_MAX) {
+			lock_release (&rgroup_lock);
+			return -1;
+		}
+		g = &rgroups[rgroup_cnt];
+		memset (g, 0, sizeof *g);
+		g->id = rgroup_cnt;
+		strlcpy (g->name, name, sizeof g->name);
+	}
+	old_level = intr_disable ();
+	g->cpu_weight = cpu_weight;
+	g->io_weight = io_weight;
+	g->frame_max = frame_max;
+	if (g->id == rgroup_cnt) {
+		/* Starts out even with the groups at work. */
+		g->cpu_vtime = cpu_vclock;
+		g->io_vtime = io_vclock;
+		rgroup_cnt++;
+	}
+	intr_set_level (old_level);
+	lock_release (&rgroup_lock);
+	return g->id;
+}
+
+/* Moves T, which is new or whose process is being moved, into G.
+   Thread counts are kept by disabling interrupts. */
+void
+rgroup_attach (struct thread *t, struct rgroup *g) {
+	enum intr_level old_level = intr_disable ();
+
+	if (t->rgroup != NULL)
+		t->rgroup->thread_cnt--;
+	t->rgroup = g;
+	g->thread_cnt++;
+	intr_set_level (old_level);
+}
+
+#ifdef USERPROG
+/* thread_foreach() function that moves T into group G_ if it is a
+   thread of the running process. */
+static void
+join_thread (struct thread *t, void *g_) {
+	struct rgroup *g = g_;
+
+	if (t->leader == thread_leader () && t->rgroup != g)
+		rgroup_attach (t, g);
+}
+#endif
+
+/* Moves the running process, all its threads, into the group with
+   id ID, with the frames it has resident.  The processes and threads
+   it starts from then on are in that group too.  Returns false if
+   there is no such group. */
+bool
+rgroup_join (int id) {
+	struct rgroup *g;
+
+	if (id < 0 || id >= rgroup_cnt)
+		return false;
+	if (!ready)
+		return true;            /* Only the root group, which has all. */
+	g = &rgroups[id];
+
+	lock_acquire (&rgroup_lock);
+#ifdef USERPROG
+#ifdef VM
+	/* The leader's group holds its frames: move them over with it. */
+	vm_rgroup_move (thread_leader (), g);
+#endif
+	enum intr_level old_level = intr_disable ();
+	thread_foreach (join_thread, g);
+	intr_set_level (old_level);
+#else
+	rgroup_attach (thread_current (), g);
+#endif
+	lock_release (&rgroup_lock);
+	return true;
+}
+
+/* Stores in STATS the statistics, RGROUP_STAT_*, of the group with
+   id ID.  Returns false if there is no such group. */
+bool
+rgroup_read_stats (int id, uint64_t stats[RGROUP_STAT_CNT]) {
+	enum intr_level old_level;
+	struct rgroup *g;
+
+	if (id < 0 || id >= rgroup_cnt)
+		return false;
+	g = &rgroups[id];
+	old_level = intr_disable ();
+	stats[RGROUP_STAT_CPU_WEIGHT] = g->cpu_weight;
+	stats[RGROUP_STAT_IO_WEIGHT] = g->io_weight;
+	stats[RGROUP_STAT_FRAME_MAX] = g->frame_max;
+	stats[RGROUP_STAT_THREADS] = g->thread_cnt;
+	stats[RGROUP_STAT_CPU_TICKS] = g->cpu_ticks;
+	stats[RGROUP_STAT_FRAMES] = g->frames;
+	stats[RGROUP_STAT_EVICTIONS] = g->evictions;
+	stats[RGROUP_STAT_IO_REQUESTS] = g->io_requests;
+	stats[RGROUP_STAT_IO_SECTORS] = g->io_sectors;
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Charges G, whose thread was running, for a timer tick.  Called
+   from the timer interrupt. */
+void
+rgroup_cpu_charge (struct rgroup *g) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	g->cpu_ticks++;
+	g->cpu_vtime += VTIME_SCALE / g->cpu_weight;
+}
+
+/* Notes that the scheduler picked a thread of G, the group furthest
+   behind among those ready, moving the virtual clock up to it. */
+void
+rgroup_cpu_picked (struct rgroup *g) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (g->cpu_vtime > cpu_vclock)
+		cpu_vclock = g->cpu_vtime;
+}
+
+/* Notes that a thread of G is ready to run, catching G up with the
+   virtual clock if it fell too far behind while idle. */
+void
+rgroup_cpu_ready (struct rgroup *g) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (g->cpu_vtime + CPU_LAG < cpu_vclock)
+		g->cpu_vtime = cpu_vclock - CPU_LAG;
+}
+
+/* Charges G for a block request of SEC_CNT sectors that a driver
+   starts, and moves the virtual clock up to it. */
+void
+rgroup_io_charge (struct rgroup *g, size_t sec_cnt) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (g->io_vtime > io_vclock)
+		io_vclock = g->io_vtime;
+	g->io_requests++;
+	g->io_sectors += sec_cnt;
+	g->io_vtime += VTIME_SCALE * sec_cnt / g->io_weight;
+}
+
+/* Notes that G submitted a block request, catching it up with the
+   virtual clock if it fell too far behind while idle. */
+void
+rgroup_io_submitted (struct rgroup *g) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (g->io_vtime + IO_LAG < io_vclock)
+		g->io_vtime = io_vclock - IO_LAG;
+}
+
+/* Prints resource group statistics. */
+void
+rgroup_print_stats (void) {
+	int i;
+
+	for (i = 0; i < rgroup_cnt; i++) {
+		struct rgroup *g = &rgroups[i];
+
+		printf ("Group %d (%s): weights %u cpu, %u I/O; %u threads, "
+				"%llu ticks; %zu frames", g->id, g->name, g->cpu_weight,
+				g->io_weight, g->thread_cnt,
+				(unsigned long long) g->cpu_ticks, g->frames);
+		if (g->frame_max != 0)
+			printf (" of %zu, %llu evicted at the limit", g->frame_max,
+					(unsigned long long) g->evictions);
+		printf ("; %llu I/O requests, %llu sectors\n",
+				(unsigned long long) g->io_requests,
+				(unsigned long long) g->io_sectors);
+	}
+}
@@ -0,0 +1,119 @@
+#include "threads/scratch.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Scratch arena: per-thread memory for the temporaries of a system
+   call, such as the kernel copy of a path or the bounce buffer of a
+   read, which would otherwise cost a trip through the page
+   allocator, and its lock, on every call.
+
+   Each thread gets SCRATCH_PAGES pages on its first scratch_alloc()
+   and keeps them until it exits.  Allocation bumps a pointer, and
+   the whole arena is given back at once by scratch_reset(), which
+   the system call handler calls as each call returns.  Only the
+   latest allocation can be given back earlier, with scratch_free();
+   freeing anything else does nothing until the reset.  Being
+   per-thread, none of this needs a lock, but it must not be used
+   from interrupt handlers. */
+
+/* Allocations are aligned to this. */
+#define SCRATCH_ALIGN 16
+
+/* Statistics. */
+static long long scratch_allocs;        /* # of allocations. */
+static long long scratch_failures;      /* # that did not fit. */
+static size_t scratch_deepest;          /* Most bytes in use at once. */
+
+/* Returns SIZE bytes of the running thread's scratch arena, or a
+   null pointer if they do not fit in what is left of it or memory
+   for the arena runs out.  They last until scratch_reset() at the
+   latest. */
+void *
+scratch_alloc (size_t size) {
+	struct thread *t = thread_current ();
+	size_t rounded = ROUND_UP (size, SCRATCH_ALIGN);
+	void *p;
+
+	ASSERT (!intr_context ());
+	if (t->scratch == NULL) {
+		t->scratch = palloc_get_multiple (0, SCRATCH_PAGES);
+		if (t->scratch == NULL)
+			return NULL;
+	}
+	if (rounded > SCRATCH_PAGES * PGSIZE - t->scratch_used) {
+		scratch_failures++;
+		return NULL;
+	}
+	p = t->scratch + t->scratch_used;
+	t->scratch_last = t->scratch_used;
+	t->scratch_used += rounded;
+	if (t->scratch_used > scratch_deepest)
+		scratch_deepest = t->scratch_used;
+	scratch_allocs++;
+	return p;
+}
+
+/* Shrinks P, the latest allocation, to SIZE bytes, giving back the
+   rest.  Does nothing if P is not the latest allocation. */
+void
+scratch_trim (void *p, size_t size) {
+	struct thread *t = thread_current ();
+
+	if (p != NULL && p == t->scratch + t->scratch_last
+			&& t->scratch_last < t->scratch_used)
+		t->scratch_used = t->scratch_last + ROUND_UP (size, SCRATCH_ALIGN);
+}
+
+/* Gives back P if it is the latest allocation.  Does nothing
+   otherwise, or if P is null. */
+void
+scratch_free (void *p) {
+	struct thread *t = thread_current ();
+
+	if (p != NULL && p == t->scratch + t->scratch_last
+			&& t->scratch_last < t->scratch_used)
+		t->scratch_used = t->scratch_last;
+}
+
+/* Returns true if P is in the running thread's scratch arena. */
+bool
+scratch_owns (const void *p) {
+	struct thread *t = thread_current ();
+
+	return t->scratch != NULL && (const uint8_t *) p >= t->scratch
+		&& (const uint8_t *) p < t->scratch + SCRATCH_PAGES * PGSIZE;
+}
+
+/* Gives back everything allocated in the running thread's arena. */
+void
+scratch_reset (void) {
+	struct thread *t = thread_current ();
+
+	t->scratch_used = 0;
+	t->scratch_last = 0;
+}
+
+/* Frees the running thread's arena.  Called when it exits. */
+void
+scratch_release (void) {
+	struct thread *t = thread_current ();
+
+	palloc_free_multiple (t->scratch, SCRATCH_PAGES);
+	t->scratch = NULL;
+	scratch_reset ();
+}
+
+/* Prints scratch arena statistics. */
+void
+scratch_print_stats (void) {
+	if (scratch_allocs != 0 || scratch_failures != 0)
+		printf ("Scratch: %lld allocations, %lld did not fit, "
+				"at most %zu bytes in use\n", scratch_allocs, scratch_failures,
+				scratch_deepest);
+}
@@ -0,0 +1,101 @@
+#include "threads/shrinker.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Kernel caches that give memory back under pressure.
+
+   Caches keep memory they could do without, as long as nobody else
+   wants it.  palloc_get_multiple() calls shrink_caches() when it is
+   about to fail, and the swap daemon before it evicts user pages, so
+   that what the caches hold is always given up before a user page
+   is written out or an allocation fails.  Each shrinker is asked for
+   its share of the pages wanted, in proportion to how many it says it
+   can free. */
+
+/* Registered shrinkers, set up by the first registration, which
+   comes from boot, as do all others. */
+static struct list shrinkers;
+static bool ready;
+
+/* Held while shrinking, by one thread at a time: another thread
+   short of memory meanwhile lets the first finish rather than
+   shrinking the same caches twice. */
+static struct lock shrink_lock;
+
+static unsigned long long shrink_cnt;   /* Calls that shrank anything. */
+
+/* Adds S to the shrinkers. */
+void
+shrinker_register (struct shrinker *s) {
+	enum intr_level old_level = intr_disable ();
+
+	if (!ready) {
+		list_init (&shrinkers);
+		lock_init (&shrink_lock);
+		ready = true;
+	}
+	s->freed = 0;
+	list_push_back (&shrinkers, &s->elem);
+	intr_set_level (old_level);
+}
+
+/* Asks the shrinkers to free PAGE_CNT pages between them, each in
+   proportion to what it can free, and returns the number they freed.
+   Does nothing, returning 0, where a shrinker could not take a lock:
+   in an interrupt handler, with interrupts off, or while another
+   thread is shrinking already. */
+size_t
+shrink_caches (size_t page_cnt) {
+	struct list_elem *e;
+	size_t total = 0, freed = 0;
+
+	if (!ready || intr_context ()
+			|| intr_get_level () == INTR_OFF
+			|| lock_held_by_current_thread (&shrink_lock)
+			|| !lock_try_acquire (&shrink_lock))
+		return 0;
+
+	for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+			e = list_next (e))
+		total += list_entry (e, struct shrinker, elem)->count ();
+	if (total > 0)
+		for (e = list_begin (&shrinkers); e != list_end (&shrinkers)
+				&& freed < page_cnt; e = list_next (e)) {
+			struct shrinker *s = list_entry (e, struct shrinker, elem);
+			size_t cnt = s->count ();
+			size_t nr;
+
+			if (cnt == 0)
+				continue;
+			/* Round up, so that a small share is not lost. */
+			nr = (cnt * page_cnt + total - 1) / total;
+			if (nr > cnt)
+				nr = cnt;
+			nr = s->scan (nr);
+			s->freed += nr;
+			freed += nr;
+		}
+	if (freed > 0)
+		shrink_cnt++;
+	lock_release (&shrink_lock);
+	return freed;
+}
+
+/* Prints what each shrinker gave back. */
+void
+shrinker_print_stats (void) {
+	struct list_elem *e;
+
+	if (!ready || shrink_cnt == 0)
+		return;
+	printf ("Shrinkers: %llu calls freed pages:", shrink_cnt);
+	for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+			e = list_next (e)) {
+		struct shrinker *s = list_entry (e, struct shrinker, elem);
+
+		printf (" %s %llu", s->name, s->freed);
+	}
+	printf ("\n");
+}
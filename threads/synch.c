@@ -29,8 +29,25 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "intrinsic.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+
+#ifdef LOCKSTAT
+static void lockstat_acquired (struct lock *, bool contended, uint64_t wait);
+static void lockstat_released (struct lock *);
+#endif
+
+/* States of a lock.  Taking a free lock and releasing one nobody
+   waits for are single compare-and-swaps, so the common,
+   uncontended case neither disables interrupts nor touches the
+   waiters list.  Under contention, waiters queue with interrupts
+   off, and the releaser hands the lock straight to the one with
+   the highest priority. */
+#define LOCK_FREE 0
+#define LOCK_HELD 1             /* Held, nobody waiting. */
+#define LOCK_CONTENDED 2        /* Held, with waiters. */
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -43,10 +60,33 @@
    thread, if any). */
 void
 sema_init (struct semaphore *sema, unsigned value) {
-	ASSERT (sema != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, sema != NULL);
 
 	sema->value = value;
 	list_init (&sema->waiters);
+	sema->owner = NULL;
+	sema->donation.max_priority = -1;
+	sema->donation.heap_parent = NULL;
+	sema->donation.heap_left = sema->donation.heap_right = NULL;
+}
+
+/* Makes OWNER, or nobody if OWNER is null, the thread that is to up
+   SEMA next, as one used as a completion event is: a thread waiting
+   for SEMA then donates its priority to OWNER, as it would to the
+   holder of a lock, so that threads of middle priority cannot hold
+   up the completion.  The next sema_up() ends the ownership, which
+   must end before OWNER exits. */
+void
+sema_set_owner (struct semaphore *sema, struct thread *owner) {
+	enum intr_level old_level;
+
+	DEBUG_ASSERT (DEBUG_SYNCH, sema != NULL);
+
+	old_level = intr_disable ();
+	thread_disown_sema (sema);
+	if (owner != NULL)
+		thread_own_sema (owner, sema);
+	intr_set_level (old_level);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -61,13 +101,18 @@ void
 sema_down (struct semaphore *sema) {
 	enum intr_level old_level;
 
-	ASSERT (sema != NULL);
-	ASSERT (!intr_context ());
+	DEBUG_ASSERT (DEBUG_SYNCH, sema != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, !intr_context ());
 
 	old_level = intr_disable ();
 	while (sema->value == 0) {
 		/*semaphore의 waiting list에 insert하는 방식을 push_back 방식에서 priority ordered로 변경 */
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, thread_compare_priority,0);
+		// 기다리는 동안 우선순위가 바뀌면 waiter_requeue()가 자리를 옮기도록 semaphore를 기록
+		thread_current ()->wait_on_sema = sema;
+		thread_prio_insert_ordered (&sema->waiters, thread_current ());
+		// up할 owner가 정해져 있다면 lock holder에게처럼 우선순위를 양도
+		if (sema->owner != NULL && !thread_mlfqs)
+			donate_priority (thread_current ());
 		thread_block ();
 	}
 	sema->value--;
@@ -84,7 +129,7 @@ sema_try_down (struct semaphore *sema) {
 	enum intr_level old_level;
 	bool success;
 
-	ASSERT (sema != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, sema != NULL);
 
 	old_level = intr_disable ();
 	if (sema->value > 0)
@@ -107,14 +152,19 @@ void
 sema_up (struct semaphore *sema) {
 	enum intr_level old_level;
 
-	ASSERT (sema != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, sema != NULL);
 
 	old_level = intr_disable ();
+	/* 완료를 알리는 up이므로 owner가 받던 donation을 거둠 */
+	if (sema->owner != NULL)
+		thread_disown_sema (sema);
 	if (!list_empty (&sema->waiters)){
-		/* waiting중 priority 변경 가능성이 있기 때문에, semaphore waiting list를 내림차순으로 sorting 한다. */
-		list_sort(&sema->waiters, thread_compare_priority,0);	
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-					struct thread, elem));
+		/* waiting중 priority가 바뀌면 그때 자리를 옮기므로, 맨 앞이 늘 가장 높은 priority다. */
+		struct thread *t = list_entry (list_pop_front (&sema->waiters),
+				struct thread, elem);
+
+		t->wait_on_sema = NULL;
+		thread_unblock (t);
 		}
 
 	sema->value++;
@@ -174,11 +224,37 @@ sema_test_helper (void *sema_) {
    onerous, it's a good sign that a semaphore should be used,
    instead of a lock. */
 void
-lock_init (struct lock *lock) {
-	ASSERT (lock != NULL);
+(lock_init) (struct lock *lock) {
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
 
 	lock->holder = NULL;
-	sema_init (&lock->semaphore, 1);
+	lock->state = LOCK_FREE;
+	list_init (&lock->waiters);
+	lock->donation.max_priority = -1;
+	lock->donation.heap_parent = NULL;
+	lock->donation.heap_left = lock->donation.heap_right = NULL;
+#ifdef LOCKSTAT
+	lock->stat = NULL;
+#endif
+}
+
+/* Records the current thread as the holder of LOCK, which it has
+   just taken by the fast path.  A thread that blocked on LOCK before
+   the holder was recorded found nobody to donate its priority to, so
+   donate it on that thread's behalf now. */
+static void
+lock_set_holder (struct lock *lock) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	lock->holder = curr;
+	if (lock->state != LOCK_CONTENDED || thread_mlfqs)
+		return;
+	old_level = intr_disable ();
+	if (!list_empty (&lock->waiters))
+		donate_priority (list_entry (list_front (&lock->waiters),
+					struct thread, elem));
+	intr_set_level (old_level);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -191,26 +267,52 @@ lock_init (struct lock *lock) {
    we need to sleep. */
 void
 lock_acquire (struct lock *lock) {
-	ASSERT (lock != NULL);
-	ASSERT (!intr_context ());
-	ASSERT (!lock_held_by_current_thread (lock));
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, !intr_context ());
+	DEBUG_ASSERT (DEBUG_SYNCH, !lock_held_by_current_thread (lock));
 
-	// lock 획득 전, 누군가 lock을 가지고 있다면 priority를 양도
 	struct thread *curr = thread_current ();
-	if (lock->holder) {
-		// 우선순위를 양도하는 목적인 lock을 기록
-		curr->wait_on_lock = lock;
-		// 우선순위를 양도하는 thread의 donations에 current thread를 연결
-		list_insert_ordered (&lock->holder->donations, &curr->donation_elem, thread_compare_donate_priority, 0);
-		// 우선순위를 양도
-		donate_priority ();
+	enum intr_level old_level;
+
+	if (cmpxchgl (&lock->state, LOCK_FREE, LOCK_HELD) == LOCK_FREE) {
+		lock_set_holder (lock);
+#ifdef LOCKSTAT
+		lockstat_acquired (lock, false, 0);
+#endif
+		return;
 	}
-	// lock 획득 요청
-	sema_down (&lock->semaphore);
 
-	// lock 획득 후, wait_on_lock 초기화
-	curr->wait_on_lock = NULL;
-	lock->holder = curr;
+	// wait_on_lock을 기록한 뒤 waiters에 들어가기까지를 donation이 보지 않도록 interrupt를 막음
+	old_level = intr_disable ();
+	if (lock->state == LOCK_FREE) {
+		lock->state = LOCK_HELD;
+		lock->holder = curr;
+#ifdef LOCKSTAT
+		lockstat_acquired (lock, false, 0);
+#endif
+	} else {
+#ifdef LOCKSTAT
+		uint64_t start = rdtsc ();
+#endif
+		lock->state = LOCK_CONTENDED;
+		trace (TRACE_LOCK_WAIT, 0, (uintptr_t) lock,
+				lock->holder != NULL ? lock->holder->tid : 0);
+		// 4.4BSD scheduler에서는 priority donation을 하지 않음
+		if (!thread_mlfqs) {
+			// 우선순위를 양도하는 목적인 lock을 기록
+			curr->wait_on_lock = lock;
+			// 우선순위를 양도
+			donate_priority (curr);
+		}
+		thread_prio_insert_ordered (&lock->waiters, curr);
+		// lock_release()가 lock을 넘겨줄 때까지 잠듦
+		thread_block ();
+		DEBUG_ASSERT (DEBUG_SYNCH, lock->holder == curr);
+#ifdef LOCKSTAT
+		lockstat_acquired (lock, true, rdtsc () - start);
+#endif
+	}
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -221,15 +323,57 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
-	bool success;
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, !lock_held_by_current_thread (lock));
+
+	if (cmpxchgl (&lock->state, LOCK_FREE, LOCK_HELD) != LOCK_FREE)
+		return false;
+	lock_set_holder (lock);
+#ifdef LOCKSTAT
+	lockstat_acquired (lock, false, 0);
+#endif
+	return true;
+}
 
-	ASSERT (lock != NULL);
-	ASSERT (!lock_held_by_current_thread (lock));
+/* Releases LOCK, which must be owned by the current thread,
+   handing it to its highest-priority waiter, if any, without
+   yielding to it.  Returns true if LOCK had a waiter. */
+static bool
+lock_hand_off (struct lock *lock) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+	struct thread *next;
 
-	success = sema_try_down (&lock->semaphore);
-	if (success)
-		lock->holder = thread_current ();
-	return success;
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, lock_held_by_current_thread (lock));
+
+#ifdef LOCKSTAT
+	lockstat_released (lock);
+#endif
+	/* Nobody waits, so nobody donated for LOCK either. */
+	lock->holder = NULL;
+	if (cmpxchgl (&lock->state, LOCK_HELD, LOCK_FREE) == LOCK_HELD)
+		return false;
+
+	old_level = intr_disable ();
+	lock->holder = curr;
+	if (!thread_mlfqs) {
+		remove_with_lock (lock);
+		refresh_priority ();
+	} else
+		/* Priorities changed while waiting. */
+		thread_prio_sort (&lock->waiters);
+
+	// 가장 우선순위가 높은 대기자에게 lock을 바로 넘겨줌
+	next = list_entry (list_pop_front (&lock->waiters), struct thread, elem);
+	next->wait_on_lock = NULL;
+	lock->holder = next;
+	lock->state = list_empty (&lock->waiters) ? LOCK_HELD : LOCK_CONTENDED;
+	if (!thread_mlfqs)
+		thread_hold_lock (next, lock);
+	thread_unblock (next);
+	intr_set_level (old_level);
+	return true;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
@@ -240,14 +384,13 @@ lock_try_acquire (struct lock *lock) {
    handler. */
 void
 lock_release (struct lock *lock) {
-	ASSERT (lock != NULL);
-	ASSERT (lock_held_by_current_thread (lock));
-
-	remove_with_lock (lock);
-	refresh_priority ();
+	enum intr_level old_level;
 
-	lock->holder = NULL;
-	sema_up (&lock->semaphore);
+	if (lock_hand_off (lock)) {
+		old_level = intr_disable ();
+		test_max_priority ();
+		intr_set_level (old_level);
+	}
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -255,23 +398,105 @@ lock_release (struct lock *lock) {
    a lock would be racy.) */
 bool
 lock_held_by_current_thread (const struct lock *lock) {
-	ASSERT (lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
 
 	return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
-	struct semaphore semaphore;         /* This semaphore. */
-};
+/* Initializes RW.  Any number of readers may hold a readers-writer
+   lock at once, or a single writer.
+
+   Readers and writers get in through RW's inner lock, in priority
+   order, donating to whoever holds it.  A writer keeps the inner
+   lock while it waits for the readers in to leave, so that none
+   get in after it: writers are preferred over readers that come
+   later.  Readers in do not receive donations. */
+void
+(rwlock_init) (struct rwlock *rw) {
+	DEBUG_ASSERT (DEBUG_SYNCH, rw != NULL);
+
+	lock_init (&rw->lock);
+	rw->readers = 0;
+	rw->draining = false;
+	sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it.  The current thread must not hold RW already.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	DEBUG_ASSERT (DEBUG_SYNCH, rw != NULL);
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	rw->readers++;
+	intr_set_level (old_level);
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	DEBUG_ASSERT (DEBUG_SYNCH, rw != NULL);
+
+	old_level = intr_disable ();
+	DEBUG_ASSERT (DEBUG_SYNCH, rw->readers > 0);
+	if (--rw->readers == 0 && rw->draining) {
+		rw->draining = false;
+		sema_up (&rw->drained);
+	}
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds it.
+   The current thread must not hold RW already.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	enum intr_level old_level;
+	bool wait;
+
+	DEBUG_ASSERT (DEBUG_SYNCH, rw != NULL);
+
+	lock_acquire (&rw->lock);
+	old_level = intr_disable ();
+	wait = rw->draining = rw->readers > 0;
+	intr_set_level (old_level);
+	if (wait)
+		sema_down (&rw->drained);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	DEBUG_ASSERT (DEBUG_SYNCH, rwlock_held_for_write (rw));
+
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) {
+	DEBUG_ASSERT (DEBUG_SYNCH, rw != NULL);
+
+	return lock_held_by_current_thread (&rw->lock) && rw->readers == 0;
+}
 
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
 void
 cond_init (struct condition *cond) {
-	ASSERT (cond != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, cond != NULL);
 
 	list_init (&cond->waiters);
 }
@@ -298,71 +523,213 @@ cond_init (struct condition *cond) {
    we need to sleep. */
 void
 cond_wait (struct condition *cond, struct lock *lock) {
-	struct semaphore_elem waiter;
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
 
-	ASSERT (cond != NULL);
-	ASSERT (lock != NULL);
-	ASSERT (!intr_context ());
-	ASSERT (lock_held_by_current_thread (lock));
+	DEBUG_ASSERT (DEBUG_SYNCH, cond != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, !intr_context ());
+	DEBUG_ASSERT (DEBUG_SYNCH, lock_held_by_current_thread (lock));
 
-	sema_init (&waiter.semaphore, 0); /* 새롭게 선언된 semaphore value 0으로 초기화 및 list member 초기화*/
-	list_insert_ordered(&cond->waiters, &waiter.elem, sema_compare_priority, 0);
-	/* cond_wait에 진입한 서로 다른 thread는 각각 새로운 semaphore에 속하게 되며 해당 semaphore를 관리하는 list가 cond->waiters */
-	/*기존 push back 방식에서 cond waiters 의 element에 대응하는 쓰레드간의 priority 순서로 insert하는 방식으로 변경*/
+	// lock을 놓은 뒤 waiters에 들어가기까지 signal을 놓치지 않도록 interrupt를 막음
+	// - lock을 놓으며 donation이 사라진 뒤의 priority 순서로 들어감
+	old_level = intr_disable ();
+	lock_hand_off (lock);
+	curr->wait_on_cond = cond;
+	thread_prio_insert_ordered (&cond->waiters, curr);
+	// cond_signal()이 lock의 waiters로 옮기고, lock_release()가 lock을 넘겨줄 때까지 잠듦
+	thread_block ();
+	DEBUG_ASSERT (DEBUG_SYNCH, lock->holder == curr);
+#ifdef LOCKSTAT
+	lockstat_acquired (lock, false, 0);
+#endif
+	intr_set_level (old_level);
+}
 
-	lock_release (lock);
-	sema_down (&waiter.semaphore); 
-	lock_acquire (lock);
+/* Moves the highest-priority thread waiting on COND to the
+   waiters of LOCK, which the current thread holds, so that it
+   wakes up holding LOCK once the current thread releases it.
+   Interrupts must be off. */
+static void
+cond_wake_one (struct condition *cond, struct lock *lock) {
+	struct thread *t;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (thread_mlfqs)
+		/* Priorities changed while waiting. */
+		thread_prio_sort (&cond->waiters);
+	t = list_entry (list_pop_front (&cond->waiters), struct thread, elem);
+	t->wait_on_cond = NULL;
+
+	// lock_acquire()에서 기다리게 된 것처럼 lock의 waiters에 넣고 우선순위를 양도
+	lock->state = LOCK_CONTENDED;
+	if (!thread_mlfqs) {
+		t->wait_on_lock = lock;
+		donate_priority (t);
+	}
+	thread_prio_insert_ordered (&lock->waiters, t);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
 
+   The waiter with the highest priority is at the front of COND's
+   waiters.  Rather than running only to block again on LOCK, it
+   is queued on LOCK directly, and runs once it is handed LOCK.
+
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void
-cond_signal (struct condition *cond, struct lock *lock UNUSED) {
-	ASSERT (cond != NULL);
-	ASSERT (lock != NULL);
-	ASSERT (!intr_context ());
-	ASSERT (lock_held_by_current_thread (lock));
-
-	if (!list_empty (&cond->waiters)){
-		/* waiting중 priority 변경 가능성이 있기 때문에, semaphore waiting list를 내림차순으로 sorting 한다. */
-		list_sort(&cond->waiters, sema_compare_priority,0);
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
-	}
+cond_signal (struct condition *cond, struct lock *lock) {
+	enum intr_level old_level;
+
+	DEBUG_ASSERT (DEBUG_SYNCH, cond != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, !intr_context ());
+	DEBUG_ASSERT (DEBUG_SYNCH, lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
+	if (!list_empty (&cond->waiters))
+		cond_wake_one (cond, lock);
+	intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
    LOCK).  LOCK must be held before calling this function.
+   They wake up one at a time, as LOCK is handed from each to the
+   next, instead of all at once only to contend for it.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void
 cond_broadcast (struct condition *cond, struct lock *lock) {
-	ASSERT (cond != NULL);
-	ASSERT (lock != NULL);
+	enum intr_level old_level;
+
+	DEBUG_ASSERT (DEBUG_SYNCH, cond != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, lock != NULL);
+	DEBUG_ASSERT (DEBUG_SYNCH, !intr_context ());
+	DEBUG_ASSERT (DEBUG_SYNCH, lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	while (!list_empty (&cond->waiters))
-		cond_signal (cond, lock);
+		cond_wake_one (cond, lock);
+	intr_set_level (old_level);
 }
 
-/* semaphore element 구조체의 list elem 멤버를 인자로 받아 나머지 멤버인 semaphore에 속하는
-	thread의 prioity 사이의 우선순위 비교.*/
-bool sema_compare_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
-{
-	struct semaphore_elem *a_sema = list_entry (a, struct semaphore_elem, elem); /*member로 structure 구하기*/
-	struct semaphore_elem *b_sema = list_entry (b, struct semaphore_elem, elem); 
+#ifdef LOCKSTAT
+/* Most lock_init() call sites kept apart; locks initialized at
+   others go uncounted. */
+#define LOCKSTAT_SITE_MAX 256
 
-	struct list *waiter_a_sema = &(a_sema->semaphore.waiters);  /*stucture -> the other member's member(list) 값 구하기*/
-	struct list *waiter_b_sema = &(b_sema->semaphore.waiters);
+static struct lock_stat sites[LOCKSTAT_SITE_MAX];
+static size_t site_cnt;
 
-	return list_entry(list_begin(waiter_a_sema), struct thread, elem)->priority	 /* 구한 list 의 begain thread의 priority 사이 대소비교 */
-		> list_entry(list_begin(waiter_b_sema),struct thread, elem)->priority;
-}
\ No newline at end of file
+/* Initializes LOCK, as lock_init(), with its statistics kept with
+   those of the other locks initialized at line LINE of FILE. */
+void
+lock_init_at (struct lock *lock, const char *file, int line) {
+	enum intr_level old_level;
+	size_t i;
+
+	(lock_init) (lock);
+
+	old_level = intr_disable ();
+	for (i = 0; i < site_cnt; i++)
+		if (sites[i].line == line && (sites[i].file == file
+					|| !strcmp (sites[i].file, file)))
+			break;
+	if (i == site_cnt && site_cnt < LOCKSTAT_SITE_MAX) {
+		sites[i].file = file;
+		sites[i].line = line;
+		site_cnt++;
+	}
+	if (i < site_cnt)
+		lock->stat = &sites[i];
+	intr_set_level (old_level);
+}
+
+/* Initializes RW, as rwlock_init(), with the statistics of its inner
+   lock kept by line LINE of FILE. */
+void
+rwlock_init_at (struct rwlock *rw, const char *file, int line) {
+	(rwlock_init) (rw);
+	lock_init_at (&rw->lock, file, line);
+}
+
+/* Counts a priority donation to the holder of LOCK. */
+void
+lockstat_donated (struct lock *lock) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (lock->stat != NULL)
+		lock->stat->donations++;
+}
+
+/* Counts an acquisition of LOCK by the current thread, which waited
+   WAIT cycles for it if CONTENDED. */
+static void
+lockstat_acquired (struct lock *lock, bool contended, uint64_t wait) {
+	struct lock_stat *s = lock->stat;
+	enum intr_level old_level;
+
+	if (s == NULL)
+		return;
+	old_level = intr_disable ();
+	s->acquired++;
+	if (contended) {
+		s->contended++;
+		s->wait_cycles += wait;
+	}
+	lock->acquire_tsc = rdtsc ();
+	intr_set_level (old_level);
+}
+
+/* Accounts for the time LOCK was held, as the current thread lets it
+   go. */
+static void
+lockstat_released (struct lock *lock) {
+	struct lock_stat *s = lock->stat;
+	uint64_t hold;
+	enum intr_level old_level;
+
+	if (s == NULL)
+		return;
+	hold = rdtsc () - lock->acquire_tsc;
+	old_level = intr_disable ();
+	if (hold > s->max_hold_cycles)
+		s->max_hold_cycles = hold;
+	intr_set_level (old_level);
+}
+
+/* Prints the statistics of every lock_init() site whose locks were
+   acquired, those waited for longest first. */
+void
+lockstat_print_stats (void) {
+	struct lock_stat *order[LOCKSTAT_SITE_MAX];
+	size_t cnt = 0;
+	size_t i, j;
+
+	for (i = 0; i < site_cnt; i++) {
+		struct lock_stat *s = &sites[i];
+
+		if (s->acquired == 0)
+			continue;
+		for (j = cnt++; j > 0 && order[j - 1]->wait_cycles < s->wait_cycles; j--)
+			order[j] = order[j - 1];
+		order[j] = s;
+	}
+
+	printf ("Locks, by cycles waited: acquired, contended, cycles "
+			"waited, max cycles held, donations\n");
+	for (i = 0; i < cnt; i++)
+		printf ("  %s:%d: %llu %llu %llu %llu %llu\n",
+				order[i]->file, order[i]->line,
+				(unsigned long long) order[i]->acquired,
+				(unsigned long long) order[i]->contended,
+				(unsigned long long) order[i]->wait_cycles,
+				(unsigned long long) order[i]->max_hold_cycles,
+				(unsigned long long) order[i]->donations);
+}
+#endif /* LOCKSTAT */
@@ -2,8 +2,22 @@ threads_SRC  = threads/init.c		# Main program.
 threads_SRC += threads/thread.c		# Thread management core.
 threads_SRC += threads/interrupt.c	# Interrupt core.
 threads_SRC += threads/intr-stubs.S	# Interrupt stubs.
+threads_SRC += threads/switch.S	# Thread switch.
 threads_SRC += threads/synch.c		# Synchronization.
 threads_SRC += threads/palloc.c		# Page allocator.
 threads_SRC += threads/malloc.c		# Subpage allocator.
 threads_SRC += threads/start.S		# Startup code.
 threads_SRC += threads/mmu.c		    # Memory management unit related things.
+threads_SRC += threads/cpu.c		# Processor discovery.
+threads_SRC += threads/apic.c		# Local APIC.
+threads_SRC += threads/trace.c		# Event tracing.
+threads_SRC += threads/profile.c	# Sampling profiler.
+threads_SRC += threads/pmu.c		# Performance counters.
+threads_SRC += threads/workqueue.c	# Kernel work queue.
+threads_SRC += threads/fpu.c		# Lazy x87 and SIMD state.
+threads_SRC += threads/waitq.c		# Wait queues for poll().
+threads_SRC += threads/scratch.c	# Per-thread scratch arenas.
+threads_SRC += threads/shrinker.c	# Kernel caches shrunk under memory pressure.
+threads_SRC += threads/rcu.c		# Read-copy-update.
+threads_SRC += threads/bench.c		# Microbenchmarks of the kernel's primitives.
+threads_SRC += threads/rgroup.c		# Resource groups.
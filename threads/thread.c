@@ -2,14 +2,24 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/rcu.h"
+#include "threads/rgroup.h"
+#include "threads/scratch.h"
+#include "threads/malloc.h"
+#include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -24,14 +34,26 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* List of process in THREAD_BLOCK state */
-static struct list sleep_list;
-// sleep_list에서 awake되는 시점이 가장 빠른 thread의 awake_ticks 시점
-static int64_t next_tick_to_awake; 
+/* Run queue of a processor: processes in THREAD_READY state, that
+   is, processes that are ready to run but not actually running, in
+   one FIFO list per priority, and those of the deadline class,
+   earliest deadline first, which run ahead of them all.  Each
+   processor takes from its own and, when that is empty, steals from
+   the busiest other one, so that threads on different processors do
+   not contend for one queue.  A deadline thread out of budget is in
+   no queue until its next period. */
+struct runq {
+	struct list dl_queue;       /* Deadline class, by dl_deadline. */
+	struct list queues[PRI_MAX + 1];
+	uint64_t mask;              /* Bit P set if queues[P] is not empty. */
+	size_t cnt;                 /* Threads in the queues. */
+};
+static struct runq runqs[CPU_MAX];
+static size_t ready_cnt;        /* Threads in all run queues. */
+
+/* List of all processes.  Processes are added to this list
+   when they are created and removed when they exit. */
+static struct list all_list;
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -45,15 +67,53 @@ static struct lock tid_lock;
 /* Thread destruction requests */
 static struct list destruction_req;
 
+/* Blocks of threads destroyed lately, for new threads to take
+   without a trip to the page allocator or zeroing them.  Only
+   struct thread has to be cleared, which init_thread() does.
+   Interrupts are off whenever these are looked at. */
+#define THREAD_CACHE_CNT 8
+static struct thread *thread_cache[THREAD_CACHE_CNT];
+static size_t thread_cache_cnt;
+static struct thread *thread_block_get (void);
+static void thread_block_put (struct thread *);
+
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static uint64_t sched_totals[SCHED_STAT_CNT]; /* Of all threads. */
+static size_t stack_deepest;    /* Most kernel stack bytes a thread used. */
+static long long threads_created;  /* # of threads created... */
+static long long threads_recycled; /* ...in the block of a dead one. */
+
+/* Pages of each thread's block.  See thread.h. */
+size_t thread_stack_pages = 1;
+
+/* Deadline class.  Admitted threads may together take this many
+   1/1024ths of each processor, leaving the rest to the others. */
+#define DL_BW_SHIFT 10
+#define DL_BW_MAX 972           /* About 95%. */
+static uint64_t dl_total_bw;    /* Of the admitted threads. */
+static long long dl_throttles;  /* # of times a budget ran out. */
+static long long dl_misses;     /* # of deadlines run past with budget left. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Adaptive time slices, with -adaptive.  A thread preempted at the
+   end of its slice gets one twice as long next time, up to
+   SLICE_MAX ticks, so that CPU-bound threads switch less.  One that
+   blocks before using half of its slice gets one half as long, down
+   to SLICE_MIN.  A thread whose slice is below TIME_SLICE, having
+   blocked early of late, is "interactive": woken, it goes to the
+   front of its priority's run queue, and preempts a running thread
+   of its priority whose slice is TIME_SLICE or more. */
+#define SLICE_MIN 1
+#define SLICE_MAX 32
+bool thread_adaptive;
+static long long boosts;        /* # of wakeups of interactive threads. */
+
 /* Donation. */
 #define DONATE_MAX_DEPTH 8		/* maximum number of depth to donate */
 
@@ -62,12 +122,42 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* 4.4BSD scheduler: estimate of the number of threads ready to run
+   over the past minute. */
+static fixed_t load_avg;
+
+static void ready_push (struct thread *);
+static struct thread *ready_pop (void);
+static void ready_requeue (struct thread *, int old_priority);
+static void waiter_requeue (struct thread *);
+static int ready_max_priority (void);
+static struct runq *ready_steal_from (void);
+static struct thread *ready_steal (void);
+static struct thread *runq_pop (struct runq *, int pri);
+static bool ready_preempts (const struct thread *);
+static bool ready_boost_preempts (struct runq *, const struct thread *);
+static bool dl_set (struct thread *, int64_t runtime, int64_t deadline,
+		int64_t period);
+static void dl_refill (struct thread *, int64_t start);
+static void dl_tick (struct thread *);
+static void dl_wakeup (struct thread *);
+static void dl_replenish (void *t_);
+static void mlfqs_tick (void);
+
+/* Deadline threads of a run queue's dl_queue by ascending deadline:
+   dl_insert_ordered() puts a thread after those of its deadline. */
+#define DL_EARLIER(A, B) ((A)->dl_deadline < (B)->dl_deadline)
+LIST_ORDERED_DEFINE (dl, struct thread, elem, DL_EARLIER)
+static void mlfqs_update_priority (struct thread *);
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static void do_schedule(int status);
+static void sched_account_wakeup (struct thread *);
+static void sched_account_switch (struct thread *curr, struct thread *next);
 static void schedule (void);
 static tid_t allocate_tid (void);
 
@@ -76,10 +166,15 @@ static tid_t allocate_tid (void);
 
 /* Returns the running thread.
  * Read the CPU's stack pointer `rsp', and then round that
- * down to the start of a page.  Since `struct thread' is
- * always at the beginning of a page and the stack pointer is
- * somewhere in the middle, this locates the curent thread. */
-#define running_thread() ((struct thread *) (pg_round_down (rrsp ())))
+ * down to the start of a thread block.  Since `struct thread' is
+ * always at the beginning of a block aligned to its size and the
+ * stack pointer is somewhere in the middle, this locates the
+ * curent thread.  The initial thread's single page lies at
+ * LOADER_KERN_BASE, which is aligned more than any block. */
+#define running_thread() \
+	((struct thread *) (rrsp () & ~(thread_stack_pages * PGSIZE - 1)))
+
+static size_t stack_depth (const struct thread *);
 
 
 // Global descriptor table for the thread_start.
@@ -115,15 +210,21 @@ thread_init (void) {
 
 	/* Init the globla thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
+	for (int cpu = 0; cpu < CPU_MAX; cpu++) {
+		list_init (&runqs[cpu].dl_queue);
+		for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+			list_init (&runqs[cpu].queues[pri]);
+	}
+	list_init (&all_list);
 	list_init (&destruction_req);
-	list_init (&sleep_list);
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
 	initial_thread->tid = allocate_tid ();
+	if (thread_mlfqs)
+		mlfqs_update_priority (initial_thread);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -158,16 +259,157 @@ thread_tick (void) {
 	else
 		kernel_ticks++;
 
-	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	if (thread_mlfqs)
+		mlfqs_tick ();
+	if (t->dl_runtime > 0)
+		dl_tick (t);
+	if (t != idle_thread)
+		rgroup_cpu_charge (t->rgroup);
+
+	/* A tick outside an RCU reader is a quiescent state. */
+	if (t->rcu_nesting == 0)
+		rcu_quiescent ();
+
+	/* Enforce preemption.  Ticks the idle thread slept through are
+	   counted from timer_idle_exit(), outside the interrupt. */
+	if (++thread_ticks >= t->slice && intr_context ())
 		intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, then the switches counted and the
+   nonzero buckets of the wakeup-to-run latency histogram, each as
+   its bound in log2 cycles and count. */
 void
 thread_print_stats (void) {
+	size_t b;
+
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+	printf ("Thread: %llu voluntary, %llu involuntary switches, "
+			"%llu wakeups; latency",
+			(unsigned long long) sched_totals[SCHED_VOLUNTARY],
+			(unsigned long long) sched_totals[SCHED_INVOLUNTARY],
+			(unsigned long long) sched_totals[SCHED_WAKEUPS]);
+	for (b = 0; b < SCHED_HIST_CNT; b++)
+		if (sched_totals[SCHED_HIST + b] != 0)
+			printf (" %s%zu:%llu", b == SCHED_HIST_CNT - 1 ? ">" : "<",
+					b == SCHED_HIST_CNT - 1 ? 9 + b : 10 + b,
+					(unsigned long long) sched_totals[SCHED_HIST + b]);
+	printf ("\n");
+	printf ("Thread: deepest kernel stack %zu of %zu bytes\n",
+			stack_deepest, thread_stack_pages * PGSIZE - sizeof (struct thread));
+	printf ("Thread: %lld created, %lld in recycled blocks\n",
+			threads_created, threads_recycled);
+	printf ("Thread: deadline class at %llu/%d of a processor, "
+			"%lld budgets used up, %lld deadlines missed\n",
+			(unsigned long long) dl_total_bw, 1 << DL_BW_SHIFT,
+			dl_throttles, dl_misses);
+	if (thread_adaptive)
+		printf ("Thread: %lld wakeups of interactive threads\n", boosts);
+}
+
+/* Returns a block for a new thread, a recycled one if there is
+   one, else a fresh zeroed one, or a null pointer if memory runs
+   out. */
+static struct thread *
+thread_block_get (void) {
+	enum intr_level old_level = intr_disable ();
+	struct thread *t = NULL;
+
+	threads_created++;
+	if (thread_cache_cnt > 0) {
+		t = thread_cache[--thread_cache_cnt];
+		threads_recycled++;
+	}
+	intr_set_level (old_level);
+	if (t == NULL)
+		t = palloc_get_aligned (PAL_ZERO, thread_stack_pages,
+				thread_stack_pages);
+	return t;
+}
+
+/* Keeps the block of T, a thread gone or never started, for a new
+   thread, or frees it if enough are kept.  Interrupts must be
+   off. */
+static void
+thread_block_put (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (thread_cache_cnt < THREAD_CACHE_CNT)
+		thread_cache[thread_cache_cnt++] = t;
+	else
+		palloc_free_multiple (t, thread_stack_pages);
+}
+
+/* Returns the number of bytes of kernel stack T, a thread that is
+   done running, ever used: a block starts out zeroed, so that is
+   up to the lowest nonzero word above struct thread.  In a recycled
+   block, that may be from an earlier thread, whose depth counted
+   already. */
+static size_t
+stack_depth (const struct thread *t) {
+	const uint64_t *top = (const uint64_t *) ((uintptr_t) t
+			+ thread_stack_pages * PGSIZE);
+	const uint64_t *p = (const uint64_t *) ROUND_UP ((uintptr_t) (t + 1),
+			sizeof *p);
+
+	while (p < top && *p == 0)
+		p++;
+	return (uintptr_t) top - (uintptr_t) p;
+}
+
+/* Adds V to statistic IDX of T and of all threads. */
+static void
+sched_add (struct thread *t, size_t idx, uint64_t v) {
+	t->sched[idx] += v;
+	sched_totals[idx] += v;
+}
+
+/* Accounts for T, blocked until now, being made ready. */
+static void
+sched_account_wakeup (struct thread *t) {
+	uint64_t now = rdtsc ();
+
+	sched_add (t, t->blocked_on_lock ? SCHED_LOCK : SCHED_BLOCK,
+			now - t->state_tsc);
+	sched_add (t, SCHED_WAKEUPS, 1);
+	t->state_tsc = now;
+	t->woken = true;
+}
+
+/* Accounts for the switch from CURR, which has run until now, to
+   NEXT, which was ready or is the idle thread.  A thread that waited
+   to run since it was woken adds that wait to the latency histogram:
+   bucket 0 counts waits under 2**10 cycles, bucket I > 0 those of at
+   least 2**(9+I) and under 2**(10+I), and the last also all longer
+   ones. */
+static void
+sched_account_switch (struct thread *curr, struct thread *next) {
+	uint64_t now = rdtsc ();
+
+	sched_add (curr, SCHED_RUN, now - curr->state_tsc);
+	sched_add (curr, curr->status == THREAD_READY && curr->preempted
+			? SCHED_INVOLUNTARY : SCHED_VOLUNTARY, 1);
+	curr->state_tsc = now;
+	curr->preempted = false;
+	curr->blocked_on_lock = curr->wait_on_lock != NULL;
+
+	if (next != idle_thread) {
+		uint64_t wait = now - next->state_tsc;
+
+		sched_add (next, SCHED_READY, wait);
+		if (next->woken) {
+			uint64_t c = wait >> 10;
+			size_t bucket = 0;
+
+			while (c != 0 && bucket < SCHED_HIST_CNT - 1) {
+				c >>= 1;
+				bucket++;
+			}
+			sched_add (next, SCHED_HIST + bucket, 1);
+		}
+	}
+	next->woken = false;
+	next->state_tsc = now;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -190,47 +432,82 @@ thread_create (const char *name, int priority,
 		thread_func *function, void *aux) {
 	// function: thread가 생성된 뒤 그 thread의 context에서 수행할 업무(thread routine)
 	// aux: function에 넘길 인자
+	struct switch_threads_frame *sf;
 	struct thread *t;
 	tid_t tid;
 
 	ASSERT (function != NULL);
 
 	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	t = thread_block_get ();
 	if (t == NULL)
 		return TID_ERROR;
+#ifdef USERPROG
+	struct child_info *child_info = process_child_info_create ();
+	if (child_info == NULL) {
+		enum intr_level old_level = intr_disable ();
+		thread_block_put (t);
+		intr_set_level (old_level);
+		return TID_ERROR;
+	}
+#endif
 
 	/* Initialize thread. */
 	init_thread (t, name, priority);
+	t->affinity = thread_current ()->affinity;
+	t->timer_slack_ns = thread_current ()->timer_slack_ns;
+	rgroup_attach (t, thread_current ()->rgroup);
 	tid = t->tid = allocate_tid ();
+	malloc_thread_init (t);
 
 	/* parent-child 관계 
-		- 현재 thread의 chilren list에 새로 생성된 thread 추가 (FIFO 방식)
+		- 현재 thread의 children에 새로 생성된 thread의 종료 정보 추가
 	*/
 	struct thread *parent = thread_current();
-	list_push_back(&parent->children, &t->child_elem);
+#ifdef USERPROG
+	t->child_info = child_info;
+	process_add_child (child_info, t);
+#endif
+
+	/* The 4.4BSD scheduler ignores PRIORITY: the child starts out as
+	   nice and as busy as its parent. */
+	if (thread_mlfqs) {
+		enum intr_level old_level = intr_disable ();
+		t->nice = parent->nice;
+		t->recent_cpu = parent->recent_cpu;
+		mlfqs_update_priority (t);
+		intr_set_level (old_level);
+	}
 
 	/* file descriptor 관련
-		- palloc을 활용해 kernel memory fool에 FDT 생성
-		- next_fd를 2로 초기화: 0은 STDIN, 1은 STDOUT
+		- struct thread 안의 작은 FDT로 시작: 모자라면 process_add_file에서 늘림
+		- 0은 STDIN, 1은 STDOUT으로 사용 중 표시
 	 */
-	// printf("[thread_create]  %d, %d, %p \n", PAL_ZERO, FDT_PAGE_CNT, t->fdt);
-	t->fdt = (struct file**) palloc_get_multiple(PAL_ZERO, FDT_PAGE_CNT);
-	t->fdt[0] = 10; // dummy value 
-	t->fdt[1] = 11; // dummy value
-	t->next_fd = 2; // 다음에 들어갈 파일의 fd값
+	t->fdt = t->fdt_inline;
+	t->fdt_cnt = FDT_INLINE_CNT;
+	t->fdt_map = &t->fdt_inline_map;
+	t->fdt_cow = &t->fdt_inline_cow;
+	t->fdt[0] = FDT_STDIN;
+	t->fdt[1] = FDT_STDOUT;
+	t->fdt_inline_map = 0x3;
 	t->max_fd = 1;  // 파일이 들어간 fd의 최대값
+#ifdef VM
+	/* stack limit은 fork, spawn한 child에게 물려줌 */
+	t->stack_limit = thread_leader ()->stack_limit;
+#endif
 
-	/* Call the kernel_thread if it scheduled.
-	 * Note) rdi is 1st argument, and rsi is 2nd argument. */
-	t->tf.rip = (uintptr_t) kernel_thread;
-	t->tf.R.rdi = (uint64_t) function;
-	t->tf.R.rsi = (uint64_t) aux;
-	t->tf.ds = SEL_KDSEG;
-	t->tf.es = SEL_KDSEG;
-	t->tf.ss = SEL_KDSEG;
-	t->tf.cs = SEL_KCSEG;
-	t->tf.eflags = FLAG_IF;
+	/* Have the first switch_threads() to T return into switch_entry(),
+	   which calls kernel_thread (FUNCTION, AUX), at the top of the
+	   stack. */
+	sf = (struct switch_threads_frame *) ((uintptr_t) t
+			+ thread_stack_pages * PGSIZE) - 1;
+	*sf = (struct switch_threads_frame) {
+		.rbx = (uint64_t) kernel_thread,
+		.r12 = (uint64_t) function,
+		.r13 = (uint64_t) aux,
+		.rip = switch_entry,
+	};
+	t->ksp = (uintptr_t) sf;
 
 	/* Add to run queue. */
 	thread_unblock (t);
@@ -270,10 +547,15 @@ thread_unblock (struct thread *t) {
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
 
-	// unblock될 때 우선순위를 정렬되어 ready_list에 스레드를 추가할 수 있게
-	// list_push_back (&ready_list, &t->elem);
-	list_insert_ordered (&ready_list, &t->elem, thread_compare_priority, 0);
+	if (t->dl_runtime > 0)
+		dl_wakeup (t);
+	t->boosted = thread_adaptive && t->dl_runtime == 0
+		&& t->slice < TIME_SLICE;
+	if (t->boosted)
+		boosts++;
+	ready_push (t);
 
+	sched_account_wakeup (t);
 	t->status = THREAD_READY;
 	intr_set_level (old_level);
 }
@@ -284,6 +566,14 @@ thread_name (void) {
 	return thread_current ()->name;
 }
 
+/* Returns the thread whose block holds the stack the caller runs
+   on, without checking that it is a running thread: for code
+   that may run while a thread is being switched out. */
+struct thread *
+thread_running (void) {
+	return running_thread ();
+}
+
 /* Returns the running thread.
    This is running_thread() plus a couple of sanity checks.
    See the big comment at the top of thread.h for details. */
@@ -293,15 +583,26 @@ thread_current (void) {
 
 	/* Make sure T is really a thread.
 	   If either of these assertions fire, then your thread may
-	   have overflowed its stack.  Each thread has less than 4 kB
-	   of stack, so a few big automatic arrays or moderate
-	   recursion can cause stack overflow. */
-	ASSERT (is_thread (t));
-	ASSERT (t->status == THREAD_RUNNING);
+	   have overflowed its stack.  Each thread has less than
+	   thread_stack_pages * 4 kB of stack, so a few big automatic
+	   arrays or moderate recursion can cause stack overflow.
+	   Made only with -check=thread, as this is called all over. */
+	DEBUG_ASSERT (DEBUG_THREAD, is_thread (t));
+	DEBUG_ASSERT (DEBUG_THREAD, t->status == THREAD_RUNNING);
 
 	return t;
 }
 
+#ifdef USERPROG
+/* Returns the leader of the running thread's process, the thread
+   holding the state its threads share: the running thread itself
+   unless it was made by uthread_create(). */
+struct thread *
+thread_leader (void) {
+	return thread_current ()->leader;
+}
+#endif
+
 /* Returns the running thread's tid. */
 tid_t
 thread_tid (void) {
@@ -317,10 +618,16 @@ thread_exit (void) {
 #ifdef USERPROG
 	process_exit ();
 #endif
+	fpu_release ();
+	scratch_release ();
+	malloc_thread_exit ();
 
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
+	dl_set (thread_current (), 0, 0, 0);
+	thread_current ()->rgroup->thread_cnt--;
+	list_remove (&thread_current ()->all_elem);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -336,22 +643,107 @@ thread_yield (void) {
 
 	old_level = intr_disable ();
 	if (curr != idle_thread)
-	// ready_list에 삽입되는 부분을 변경해줌
-		list_insert_ordered (&ready_list, &curr->elem, thread_compare_priority, 0);
-		// list_push_back (&ready_list, &curr->elem);
+		ready_push (curr);
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
 
-/* 가장 먼저 awake해야 하는 thread가 awake되어야 하는 시각을 업데이트 (setter) */
-void update_next_tick_to_awake(int64_t ticks) { 
-	// 질문: next_tick_to_awake를 초기 설정을 하지 않아도 되려나?
-	next_tick_to_awake = (next_tick_to_awake > ticks) ? ticks : next_tick_to_awake;
+/* Yields the CPU as thread_yield() does, because a thread of higher
+   priority is ready or the time slice is over: an involuntary
+   switch, as the scheduling statistics count it. */
+void
+thread_preempt (void) {
+	struct thread *curr = thread_current ();
+
+	/* An RCU reader yields at the end of its section instead. */
+	if (curr->rcu_nesting > 0) {
+		curr->rcu_resched = true;
+		return;
+	}
+	curr->preempted = true;
+	thread_yield ();
 }
 
-/* 가장 먼저 awake해야 하는 thread가 awake되어야 하는 시각을 반환 (getter) */
-int64_t get_next_tick_to_awake(void) {
-	return next_tick_to_awake;
+/* Preemption point for loops that run long in the kernel: yields,
+   as a preemption, if a thread that should run instead is ready or
+   the time slice is used up, and otherwise returns at once.  The
+   timer preempts kernel code running with interrupts on anyway, so
+   yielding here is safe wherever a timer interrupt would be; the
+   point is to yield at once, rather than at the next tick, once a
+   wakeup with interrupts off has made a more urgent thread ready.
+   Does nothing with interrupts off or in an interrupt. */
+void
+thread_resched (void) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+	bool due;
+
+	if (intr_get_level () == INTR_OFF || intr_context ()
+			|| curr == idle_thread)
+		return;
+	old_level = intr_disable ();
+	due = thread_ticks >= curr->slice || ready_preempts (curr);
+	intr_set_level (old_level);
+	if (due)
+		thread_preempt ();
+}
+
+/* Invoke function 'func' on all threads, passing along 'aux'.
+   This function must be called with interrupts off. */
+void
+thread_foreach (thread_action_func *func, void *aux) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, all_elem);
+		func (t, aux);
+	}
+}
+
+/* Stores in STATS the scheduling statistics, SCHED_*, of the
+   thread whose tid is TID, the running thread if TID is 0, or of
+   all threads if TID is negative.  Returns false if there is no
+   thread TID. */
+bool
+thread_sched_stats (tid_t tid, uint64_t stats[SCHED_STAT_CNT]) {
+	struct thread *t = NULL;
+	enum intr_level old_level = intr_disable ();
+
+	if (tid == 0)
+		t = thread_current ();
+	else if (tid > 0) {
+		struct list_elem *e;
+
+		for (e = list_begin (&all_list); e != list_end (&all_list);
+				e = list_next (e))
+			if (list_entry (e, struct thread, all_elem)->tid == tid) {
+				t = list_entry (e, struct thread, all_elem);
+				break;
+			}
+		if (t == NULL) {
+			intr_set_level (old_level);
+			return false;
+		}
+	}
+	memcpy (stats, t != NULL ? t->sched : sched_totals,
+			SCHED_STAT_CNT * sizeof *stats);
+	/* Count the running thread's time slice so far. */
+	if (t != NULL && t->status == THREAD_RUNNING)
+		stats[SCHED_RUN] += rdtsc () - t->state_tsc;
+	intr_set_level (old_level);
+	return true;
+}
+
+/* timer_func that wakes T, sleeping in thread_sleep(). */
+static void
+thread_wake (void *t) {
+	thread_unblock (t);
+	if (thread_adaptive && intr_context ()
+			&& ready_preempts (thread_current ()))
+		intr_yield_on_return ();
 }
 
 /* thread를 ticks까지 재우는 함수 */
@@ -364,10 +756,12 @@ void thread_sleep(int64_t ticks) {
 	// 현재 thread를 잠재우기 위해 가져옴 (이 때, idle thread는 sleep되지 않아야 함)
 	cur = thread_current();
 	ASSERT(cur != idle_thread);
-	// awake 함수가 실행될 시점 tick을 update
-	update_next_tick_to_awake(cur->wakeup_tick = ticks);
-	// 현재 thread를 sleep_list에 삽입함
-	list_push_back(&sleep_list, &cur->elem);
+	// ticks 시점에 timer interrupt가 thread_wake()로 깨우도록 timer wheel에 등록
+	// timer slack 안에서는 늦게 깨워도 되므로 다른 thread와 같은 tick에 모아서 깨움
+	// (deadline class thread는 늦으면 안 되므로 slack 없이)
+	timer_event_init (&cur->sleep_event, thread_wake, cur);
+	timer_event_add_slack (&cur->sleep_event, ticks, cur->dl_runtime > 0 ? 0
+			: cur->timer_slack_ns / (1000000000 / TIMER_FREQ));
 	// 현재 thread의 상태를 block으로 변경 (scheduling까지 진행)
 	thread_block();
 
@@ -375,36 +769,6 @@ void thread_sleep(int64_t ticks) {
 	intr_set_level(old_level);
 }
 
-/* sleep_list에서 깨워야 하는 thread들을 모두 깨움 */
-void thread_awake(int64_t curr_tick) {
-	// next_tick_to_awake를 최대값으로 설정
-	next_tick_to_awake = INT64_MAX;
-	// sleep_list에 있는 첫 번째 thread로 e 초기 설정 (정확히는 첫 번째 thread의 elem)
-	struct list_elem *e;
-	e = list_begin(&sleep_list);
-	// e가 thread의 끝(tail)에 닿을 때까지 순서대로 확인
-	while (e != list_end(&sleep_list)) {
-		// e로 thread의 주소값 확보
-		struct thread *t = list_entry(e, struct thread, elem);
-		// thread가 일어나야할 시점이 현재 시점보다 작거나 같은 경우,
-		// 즉 thread가 일어나야할 시점에 이른 경우
-		if (curr_tick >= t-> wakeup_tick) {
-			// 해당 thread를 sleep_list에서 제거
-			e = list_remove(&t->elem);
-			// 해당 thread의 상태를 ready로 바꾸고 ready_list에 추가
-			thread_unblock(t);
-		} 
-		// thread가 아직 일어나야할 시점이 아닌 경우
-		else {
-			// e를 다음 thread로 변경
-			e = list_next(e);
-			// 해당 thread의 일어나야할 시점으로 next_tick_to_awake 업데이트
-			update_next_tick_to_awake(t->wakeup_tick);
-		}
-	}
-
-}
-
 /* 우선순위를 정렬하기 위해 비교함수 정의 */
 bool 
 thread_compare_priority (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
@@ -412,91 +776,232 @@ thread_compare_priority (const struct list_elem *a, const struct list_elem *b, v
 			> list_entry (b, struct thread, elem)->priority;
 }
 
-/* donations를 우선순위 기준으로 정렬하기 위한 비교 함수 정의 */
-bool
-thread_compare_donate_priority (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
-	return list_entry (a, struct thread, donation_elem) -> priority 
-			> list_entry (b, struct thread, donation_elem)-> priority;
-}
-
-/* ready_list에서 가장 높은 우선순위를 가진 스레드(head)가 현재 current_thread(CPU 점유중인)인 스레드보다 높으면
+/* run queue에서 가장 높은 우선순위가 현재 current_thread(CPU 점유중인)인 스레드보다 높으면
 	CPU점유를 양보하는 함수 */
-// test_max_priority 함수는 스레드가 새로 생성돼서 ready_list에 추가되거나 현재 실행중인 스레드의 우선순위가 재조정될 때 호출
+// test_max_priority 함수는 스레드가 새로 생성돼서 run queue에 추가되거나 현재 실행중인 스레드의 우선순위가 재조정될 때 호출
 // 즉, 스레드를 새로 생성하는 함수인 thread_create에서 현재 스레드의 우선순위를 재조정하는 thread_set_priority() 내부에 test_max_priority()를 추가
 void
 test_max_priority (void) {
-	if (!intr_context() 
-		&& !list_empty (&ready_list) 
-		&& thread_current()->priority < list_entry(list_front(&ready_list), struct thread, elem)->priority){
-		thread_yield();
+	if (!intr_context() && ready_preempts (thread_current ())){
+		thread_preempt();
+	}
+}
+
+/* Merges the donations skew heaps A and B, by max_priority, and
+   returns the root. */
+static struct donation *
+donation_merge (struct donation *a, struct donation *b) {
+	struct donation *m;
+
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (a->max_priority < b->max_priority) {
+		m = a;
+		a = b;
+		b = m;
 	}
+	m = donation_merge (a->heap_right, b);
+	a->heap_right = a->heap_left;
+	a->heap_left = m;
+	m->heap_parent = a;
+	return a;
+}
+
+/* Adds D to T's donations. */
+static void
+donation_insert (struct thread *t, struct donation *d) {
+	d->heap_parent = d->heap_left = d->heap_right = NULL;
+	t->donations = donation_merge (t->donations, d);
+	t->donations->heap_parent = NULL;
+}
+
+/* Removes D from T's donations. */
+static void
+donation_remove (struct thread *t, struct donation *d) {
+	struct donation *parent = d->heap_parent;
+	struct donation *sub = donation_merge (d->heap_left, d->heap_right);
+
+	if (sub != NULL)
+		sub->heap_parent = parent;
+	if (parent == NULL)
+		t->donations = sub;
+	else if (parent->heap_left == d)
+		parent->heap_left = sub;
+	else
+		parent->heap_right = sub;
 }
 
-/* current thread를 시작으로 필요한 범위까지 우선순위를 양도 */
+/* T의 우선순위를 init_priority와 donations heap의 root가 가진 max_priority 중 높은 값으로 다시 계산
+ - 바뀌었다면 T가 있는 run queue나 waiters에서 자리를 옮김 */
+static void
+priority_recompute (struct thread *t) {
+	int old_priority = t->priority;
+
+	t->priority = t->init_priority;
+	if (t->donations != NULL && t->donations->max_priority > t->priority)
+		t->priority = t->donations->max_priority;
+	if (t->priority == old_priority)
+		return;
+	if (t->status == THREAD_READY)
+		ready_requeue (t, old_priority);
+	else if (t->status == THREAD_BLOCKED)
+		waiter_requeue (t);
+}
+
+/* T를 시작으로 필요한 범위까지 우선순위를 양도
+ - 기다리는 lock 또는 owner가 있는 semaphore의 max_priority를 올리고, holder(owner)의 donations heap에서 위치를 조정
+ - 우선순위가 더 이상 오르지 않는 thread에서 멈추므로, 바뀌는 부분만 갱신됨 */
 void
-donate_priority (void) {
-	struct thread *curr = thread_current ();
+donate_priority (struct thread *t) {
+	struct thread *curr = t;
 	int depth;
+
+	ASSERT (intr_get_level () == INTR_OFF);
 	// 최대 DONATE_MAX_DEPTH 까지 우선순위를 양도 
 	for (depth = 0; depth < DONATE_MAX_DEPTH; depth++) {
-		// thread가 기다리는 lock이 있는지 확인
-		if (!curr->wait_on_lock) break;
-		// 기다리는 lock의 holder를 찾아, holder의 우선순위를 업데이트
-		// - 이 때, holder의 우선순위 보다 현재 thread의 우선순위가 높은 경우에만 업데이트 필요
-		struct thread *holder = curr->wait_on_lock->holder;
-		if (holder->priority < curr->priority) {
-			holder->priority = curr->priority;
-		}
+		struct donation *d;
+		struct thread *holder;
+		int old_priority;
+
+		// 기다리는 lock, 또는 up할 owner가 정해진 semaphore가 있어야 진행
+		if (curr->wait_on_lock != NULL) {
+			d = &curr->wait_on_lock->donation;
+			holder = curr->wait_on_lock->holder;
+		} else if (curr->wait_on_sema != NULL) {
+			d = &curr->wait_on_sema->donation;
+			holder = curr->wait_on_sema->owner;
+		} else
+			break;
+		// 그 대기자 중 가장 높은 우선순위가 바뀌는 경우에만 진행
+		// - holder가 없다면 lock이 막 반환되어 곧 curr가 가져갈 참이거나,
+		//   fast path로 막 lock을 얻은 thread가 아직 holder를 기록하기 전:
+		//   그 thread가 기록한 뒤 curr 대신 양도함 (lock_set_holder 참고)
+		if (holder == NULL || d->max_priority >= curr->priority)
+			break;
+		// donation은 대기자가 있을 때만 holder의 donations에 들어 있음
+		if (d->max_priority >= 0)
+			donation_remove (holder, d);
+		d->max_priority = curr->priority;
+		donation_insert (holder, d);
+
+		if (holder->priority >= curr->priority)
+			break;
+		old_priority = holder->priority;
+		holder->priority = curr->priority;
+#ifdef LOCKSTAT
+		if (curr->wait_on_lock != NULL)
+			lockstat_donated (curr->wait_on_lock);
+#endif
+		// holder가 ready 상태라면 새 우선순위의 run queue로 옮기고,
+		// 다른 lock, condition variable, semaphore를 기다리는 중이라면 그 waiters에서 자리를 옮김
+		if (holder->status == THREAD_READY)
+			ready_requeue (holder, old_priority);
+		else if (holder->status == THREAD_BLOCKED)
+			waiter_requeue (holder);
 		// holder를 curr로 업데이트해 초점 이동
 		curr = holder;
 	}
 }
 
-/* current thread의 donations에서 lock이 반환되기를 기다리고 있던 thread를 제거
+/* 우선순위가 바뀐 blocked thread T를 기다리는 곳의 waiters에서 새 자리로 옮김
+ - waiters가 늘 우선순위 순이므로, 깨우는 쪽은 정렬 없이 맨 앞을 꺼내면 됨 */
+static void
+waiter_requeue (struct thread *t) {
+	struct list *waiters;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t->status == THREAD_BLOCKED);
+	if (t->wait_on_lock != NULL)
+		waiters = &t->wait_on_lock->waiters;
+	else if (t->wait_on_cond != NULL)
+		waiters = &t->wait_on_cond->waiters;
+	else if (t->wait_on_sema != NULL)
+		waiters = &t->wait_on_sema->waiters;
+	else
+		return;
+	list_remove (&t->elem);
+	thread_prio_insert_ordered (waiters, t);
+}
+
+/* T가 넘겨받은 LOCK에 대기자가 남아 있다면 donations에 넣고, 그 우선순위를 양도받음
+ - LOCK의 waiters는 우선순위 순으로 유지되므로 맨 앞이 가장 높음 */
+void
+thread_hold_lock (struct thread *t, struct lock *lock) {
+	struct list *waiters = &lock->waiters;
+	struct donation *d = &lock->donation;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (list_empty (waiters)) {
+		d->max_priority = -1;
+		return;
+	}
+	d->max_priority = list_entry (list_front (waiters), struct thread, elem)->priority;
+	donation_insert (t, d);
+	// t는 막 lock을 받은 참이라 우선순위가 오르기만 함
+	if (d->max_priority > t->priority)
+		t->priority = d->max_priority;
+}
+
+/* current thread의 donations에서 반환할 lock의 donation을 제거
 - 이 함수는 current thread가 lock을 release하는 시점에 실행됨 */
 void
 remove_with_lock (struct lock *lock) {
-	struct list_elem *e;
-	struct thread *curr = thread_current ();
-	// 현재 thread의 donations들 중 반환할 lock을 기다리고 있던 thread를 삭제
-	for (e = list_begin (&curr->donations); 
-		e != list_end (&curr->donations); 
-		e = list_next (e)) {
-			struct thread *t = list_entry (e, struct thread, donation_elem);
-			if (t->wait_on_lock == lock) {
-				list_remove (&t->donation_elem);
-			}
-	}
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (lock->donation.max_priority >= 0)
+		donation_remove (thread_current (), &lock->donation);
+	lock->donation.max_priority = -1;
+}
+
+/* T를 SEMA를 up할 owner로 정함: 이미 기다리는 thread가 있다면 가장 높은 우선순위를 바로 양도받음
+ - fork나 exit처럼 어느 thread가 끝내 줄지 정해진 완료 대기에 쓰임 */
+void
+thread_own_sema (struct thread *t, struct semaphore *sema) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (sema->owner == NULL);
+	sema->owner = t;
+	if (thread_mlfqs || list_empty (&sema->waiters))
+		return;
+	// waiters는 우선순위 순이므로 맨 앞의 thread만 양도하면 됨
+	donate_priority (list_entry (list_front (&sema->waiters), struct thread, elem));
+}
+
+/* SEMA의 owner를 없애고, owner가 받던 donation을 거둠 */
+void
+thread_disown_sema (struct semaphore *sema) {
+	struct thread *owner = sema->owner;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	sema->owner = NULL;
+	if (owner == NULL || sema->donation.max_priority < 0)
+		return;
+	donation_remove (owner, &sema->donation);
+	sema->donation.max_priority = -1;
+	priority_recompute (owner);
 }
 
 /* current thread의 우선순위를 업데이트하는 함수 
- - 본래의 priority와 donations에 있는 우선순위 중 높은 값으로 업데이트 */
+ - 본래의 priority와 donations heap의 root가 가진 max_priority 중 높은 값으로 업데이트 */
 void
 refresh_priority(void) {
-	struct thread *curr = thread_current ();
-	// 본래의 priority로 1차 업데이트
-	curr->priority = curr->init_priority;
-	// donations 중 우선순위가 가장 높은 thread의 우선순위와 비교하여 2차 업데이트
-	if (!list_empty (&curr->donations)) {
-		// donations을 우선순위 높은 순으로 정렬해 begin의 우선순위 확인 
-		// - 질문: 이미 추가할 때마다 순서를 유지하고 있는데 꼭 해야할까? 
-		//       혹은 어차피 여기서 정렬할거면, 그냥 넣을 때는 맨 뒤에 넣으면 되지 않을까?
-		list_sort (&curr->donations, thread_compare_donate_priority, 0); 
-		struct thread *front = list_entry(list_front (&curr->donations), struct thread, donation_elem);
-		if (front->priority > curr->priority) {
-			curr->priority = front->priority;
-		}
-	}
+	ASSERT (intr_get_level () == INTR_OFF);
+	priority_recompute (thread_current ());
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) {
+	// 4.4BSD scheduler에서는 우선순위를 스스로 계산하므로 무시
+	if (thread_mlfqs)
+		return;
 	// current thread의 priority는 donation에 의해 수정된 상태일 수 있으므로
 	// priority가 아닌 init_priority를 업데이트
+	enum intr_level old_level = intr_disable ();
 	thread_current ()->init_priority = new_priority;
 	// init_priority가 update된 상태에서 다시 refresh를 진행
 	refresh_priority();
+	intr_set_level (old_level);
 	test_max_priority();
 }
 
@@ -506,31 +1011,110 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes its
+   priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
+thread_set_nice (int nice) {
+	enum intr_level old_level;
+
+	ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+	old_level = intr_disable ();
+	thread_current ()->nice = nice;
+	mlfqs_update_priority (thread_current ());
+	intr_set_level (old_level);
+	test_max_priority ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int load_avg_100 = FP_ROUND (load_avg * 100);
+
+	intr_set_level (old_level);
+	return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int recent_cpu_100 = FP_ROUND (thread_current ()->recent_cpu * 100);
+
+	intr_set_level (old_level);
+	return recent_cpu_100;
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values, as
+   PRI_MAX - recent_cpu / 4 - nice * 2, moving T within the run
+   queue if it is ready.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t) {
+	int old_priority = t->priority;
+	int priority;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (t == idle_thread)
+		return;
+	priority = PRI_MAX - FP_TO_INT (t->recent_cpu / 4) - t->nice * 2;
+	if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	else if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	t->priority = t->init_priority = priority;
+	if (priority == old_priority)
+		return;
+	if (t->status == THREAD_READY)
+		ready_requeue (t, old_priority);
+	else if (t->status == THREAD_BLOCKED && t->wait_on_sema != NULL)
+		waiter_requeue (t);
+}
+
+/* Does the 4.4BSD scheduler's bookkeeping for one timer tick: charges
+   the tick to the running thread, updates load_avg and every
+   thread's recent_cpu once a second, and recomputes every thread's
+   priority every fourth tick.  Runs in the timer interrupt, or for
+   ticks the idle thread slept through, from timer_idle_exit(). */
+static void
+mlfqs_tick (void) {
+	struct thread *curr = thread_current ();
+	int64_t ticks = timer_ticks ();
+	struct list_elem *e;
+
+	if (curr != idle_thread)
+		curr->recent_cpu = FP_ADD_INT (curr->recent_cpu, 1);
+
+	if (ticks % TIMER_FREQ == 0) {
+		int ready_threads = ready_cnt + (curr != idle_thread ? 1 : 0);
+		fixed_t decay;
+
+		load_avg = FP_MUL (INT_TO_FP (59) / 60, load_avg)
+			+ INT_TO_FP (ready_threads) / 60;
+		decay = FP_DIV (2 * load_avg, 2 * load_avg + INT_TO_FP (1));
+		for (e = list_begin (&all_list); e != list_end (&all_list);
+				e = list_next (e)) {
+			struct thread *t = list_entry (e, struct thread, all_elem);
+
+			if (t != idle_thread)
+				t->recent_cpu = FP_ADD_INT (FP_MUL (decay, t->recent_cpu),
+						t->nice);
+		}
+	}
+
+	if (ticks % 4 == 0) {
+		for (e = list_begin (&all_list); e != list_end (&all_list);
+				e = list_next (e))
+			mlfqs_update_priority (list_entry (e, struct thread, all_elem));
+		if (intr_context () && ready_preempts (curr))
+			intr_yield_on_return ();
+	}
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -550,9 +1134,14 @@ idle (void *idle_started_ UNUSED) {
 	sema_up (idle_started);
 
 	for (;;) {
+		/* Zero free user pages while nobody needs the CPU. */
+		while (runqs[cpu_id ()].cnt == 0 && palloc_prezero ())
+			continue;
+
 		/* Let someone else run. */
 		intr_disable ();
 		thread_block ();
+		timer_idle_enter ();
 
 		/* Re-enable interrupts and wait for the next one.
 
@@ -567,6 +1156,7 @@ idle (void *idle_started_ UNUSED) {
 		   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
 		   7.11.1 "HLT Instruction". */
 		asm volatile ("sti; hlt" : : : "memory");
+		timer_idle_exit ();
 	}
 }
 
@@ -592,23 +1182,407 @@ init_thread (struct thread *t, const char *name, int priority) {
 	memset (t, 0, sizeof *t);
 	t->status = THREAD_BLOCKED;
 	strlcpy (t->name, name, sizeof t->name);
-	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
 	t->priority = priority;
+	t->slice = TIME_SLICE;
 	t->magic = THREAD_MAGIC;
 
 	// donation 관련 멤버 초기 설정
 	t->init_priority = priority;  // 변하지 않고, 변경된 priority를 되돌릴 때 사용됨
 	t->wait_on_lock = NULL;	       
-	list_init (&t->donations);
+	t->wait_on_cond = NULL;
+	t->wait_on_sema = NULL;
+	t->donations = NULL;
 
 	/* parent child 관계 관련 */
-	list_init(&t->children);		/* children list 생성 */
-	sema_init(&t->fork_sema, 0);	/* parent가 down한 뒤 child(current thread)가 up */
-	sema_init(&t->wait_sema, 0);	/* parent가 down한 뒤 child(current thread)가 up */
-	sema_init(&t->free_sema, 0);	/* child(current thread)가 down한 뒤 parent가 up */
+	list_init(&t->exited_children);
+	sema_init(&t->child_exit_sema, 0);
 
 	/* 실행 중인 파일 관련 */
 	t->running_file = NULL;
+	lock_init (&t->fdt_lock);
+#ifdef USERPROG
+	t->leader = t;
+	t->thread_cnt = 1;
+	sema_init (&t->threads_exited, 0);
+#endif
+
+	t->nice = NICE_DEFAULT;
+	t->recent_cpu = 0;
+	t->cpu = cpu_id ();
+	t->affinity = CPU_MASK_ALL;
+	t->timer_slack_ns = TIMER_SLACK_DEFAULT_NS;
+	timer_event_init (&t->dl_timer, dl_replenish, t);
+	t->state_tsc = rdtsc ();
+#ifdef VM
+	t->stack_limit = STACK_LIMIT_DEFAULT;
+	lock_init (&t->spt.lock);
+	t->io_ring = NULL;
+	t->io_ring_entries = 0;
+#endif
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&all_list, &t->all_elem);
+	t->rgroup = rgroup_root;
+	rgroup_root->thread_cnt++;
+	intr_set_level (old_level);
+}
+
+/* Returns true if T may run on cpus[CPU]. */
+static bool
+cpu_allowed (const struct thread *t, int cpu) {
+	return cpus[cpu].running && (t->affinity & (1u << cpu)) != 0;
+}
+
+/* Appends T, which is ready, to the run queue of its priority on the
+   processor it last ran on, or on the first one it may run on if it
+   may not run there.  A deadline thread goes in by its deadline
+   instead, unless it is out of budget. */
+static void
+ready_push (struct thread *t) {
+	struct runq *rq;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (!cpu_allowed (t, t->cpu)) {
+		t->cpu = 0;
+		for (size_t cpu = 0; cpu < cpu_cnt; cpu++)
+			if (cpu_allowed (t, cpu)) {
+				t->cpu = cpu;
+				break;
+			}
+	}
+	rq = &runqs[t->cpu];
+	if (t->dl_runtime > 0) {
+		if (t->dl_throttled)
+			return;
+		dl_insert_ordered (&rq->dl_queue, t);
+	} else {
+		if (rgroup_active ())
+			rgroup_cpu_ready (t->rgroup);
+		if (t->boosted)
+			list_push_front (&rq->queues[t->priority], &t->elem);
+		else
+			list_push_back (&rq->queues[t->priority], &t->elem);
+		rq->mask |= 1ULL << t->priority;
+	}
+	rq->cnt++;
+	ready_cnt++;
+}
+
+/* Moves T, which is ready, from the run queue of OLD_PRIORITY to the
+   one of its current priority, so that a priority donated to a thread
+   in another processor's queue takes effect there too.  Deadline
+   threads are queued regardless of priority. */
+static void
+ready_requeue (struct thread *t, int old_priority) {
+	struct runq *rq = &runqs[t->cpu];
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (t->dl_runtime > 0)
+		return;
+	list_remove (&t->elem);
+	if (list_empty (&rq->queues[old_priority]))
+		rq->mask &= ~(1ULL << old_priority);
+	rq->cnt--;
+	ready_cnt--;
+	ready_push (t);
+}
+
+/* Removes and returns the thread that has waited longest among the
+   threads of priority PRI in RQ, which must have one.  With resource
+   groups, that is among those of the group furthest behind in its
+   share of the processor. */
+static struct thread *
+runq_pop (struct runq *rq, int pri) {
+	struct list *q = &rq->queues[pri];
+	struct list_elem *e = list_front (q);
+
+	if (rgroup_active ()) {
+		struct list_elem *i;
+
+		for (i = list_next (e); i != list_end (q); i = list_next (i))
+			if (rgroup_cpu_before (list_entry (i, struct thread, elem)->rgroup,
+						list_entry (e, struct thread, elem)->rgroup))
+				e = i;
+		rgroup_cpu_picked (list_entry (e, struct thread, elem)->rgroup);
+	}
+	list_remove (e);
+
+	if (list_empty (&rq->queues[pri]))
+		rq->mask &= ~(1ULL << pri);
+	rq->cnt--;
+	ready_cnt--;
+	return list_entry (e, struct thread, elem);
+}
+
+/* Removes and returns the deadline thread with the earliest deadline
+   in the running processor's run queue, or, if there is none, the
+   thread that has waited longest among the ready threads of the
+   highest priority there.  That run queue must not be empty. */
+static struct thread *
+ready_pop (void) {
+	struct runq *rq = &runqs[cpu_id ()];
+
+	if (!list_empty (&rq->dl_queue)) {
+		rq->cnt--;
+		ready_cnt--;
+		return list_entry (list_pop_front (&rq->dl_queue), struct thread, elem);
+	}
+	return runq_pop (rq, ready_max_priority ());
+}
+
+/* Returns true if a thread in the running processor's run queue
+   should run instead of CURR: a deadline thread with an earlier
+   deadline than CURR's, if CURR is one with budget left, or else any
+   deadline thread or one of higher priority. */
+static bool
+ready_preempts (const struct thread *curr) {
+	struct runq *rq = &runqs[cpu_id ()];
+
+	if (!list_empty (&rq->dl_queue)) {
+		struct thread *t = list_entry (list_front (&rq->dl_queue),
+				struct thread, elem);
+
+		return curr->dl_runtime == 0 || curr->dl_throttled
+			|| t->dl_deadline < curr->dl_deadline;
+	}
+	if (curr->dl_runtime > 0 && !curr->dl_throttled)
+		return false;
+	if (rq->mask == 0)
+		return false;
+	if (ready_max_priority () > curr->priority)
+		return true;
+	return ready_boost_preempts (rq, curr);
+}
+
+/* Returns true if the thread at the front of CURR's priority in RQ is
+   an interactive thread just woken, and CURR is not interactive.
+   See the comment on SLICE_MIN. */
+static bool
+ready_boost_preempts (struct runq *rq, const struct thread *curr) {
+	struct list *q = &rq->queues[curr->priority];
+
+	return curr != idle_thread && curr->slice >= TIME_SLICE
+		&& !list_empty (q)
+		&& list_entry (list_front (q), struct thread, elem)->boosted;
+}
+
+/* Returns the highest priority with a ready thread in the running
+   processor's run queue, with a single bsr on its mask.  That run
+   queue must have a thread outside the deadline class. */
+static int
+ready_max_priority (void) {
+	struct runq *rq = &runqs[cpu_id ()];
+
+	ASSERT (rq->mask != 0);
+	return bsrq (rq->mask);
+}
+
+/* Returns the run queue with the most threads other than the running
+   processor's, or a null pointer if they are all empty. */
+static struct runq *
+ready_steal_from (void) {
+	struct runq *busiest = NULL;
+
+	for (size_t cpu = 0; cpu < cpu_cnt; cpu++)
+		if (cpu != cpu_id () && runqs[cpu].cnt > 0
+				&& (busiest == NULL || runqs[cpu].cnt > busiest->cnt))
+			busiest = &runqs[cpu];
+	return busiest;
+}
+
+/* Removes and returns the deadline thread of the earliest deadline
+   or else the highest priority thread of the busiest other run queue
+   that may run on the running processor, or a null pointer if there
+   is none. */
+static struct thread *
+ready_steal (void) {
+	struct runq *rq = ready_steal_from ();
+	struct list_elem *e;
+	int pri;
+
+	if (rq == NULL)
+		return NULL;
+	for (e = list_begin (&rq->dl_queue); e != list_end (&rq->dl_queue);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, elem);
+
+		if (cpu_allowed (t, cpu_id ())) {
+			list_remove (e);
+			rq->cnt--;
+			ready_cnt--;
+			t->cpu = cpu_id ();
+			return t;
+		}
+	}
+	for (pri = PRI_MAX; pri >= PRI_MIN; pri--) {
+		if (!(rq->mask & (1ULL << pri)))
+			continue;
+		for (e = list_begin (&rq->queues[pri]); e != list_end (&rq->queues[pri]);
+				e = list_next (e)) {
+			struct thread *t = list_entry (e, struct thread, elem);
+
+			if (cpu_allowed (t, cpu_id ())) {
+				list_remove (e);
+				if (list_empty (&rq->queues[pri]))
+					rq->mask &= ~(1ULL << pri);
+				rq->cnt--;
+				ready_cnt--;
+				t->cpu = cpu_id ();
+				return t;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Sets the processors the running thread may run on to MASK, bit I
+   for cpus[I].  Returns false, leaving them unchanged, if MASK allows
+   no running processor. */
+bool
+thread_set_affinity (unsigned mask) {
+	struct thread *curr = thread_current ();
+	unsigned old_mask = curr->affinity;
+	size_t cpu;
+
+	curr->affinity = mask;
+	for (cpu = 0; cpu < cpu_cnt; cpu++)
+		if (cpu_allowed (curr, cpu))
+			break;
+	if (cpu == cpu_cnt) {
+		curr->affinity = old_mask;
+		return false;
+	}
+	/* Move off a processor no longer allowed. */
+	if (!cpu_allowed (curr, curr->cpu))
+		thread_yield ();
+	return true;
+}
+
+/* Moves the running thread into the deadline class, which runs ahead
+   of every priority, earliest deadline first: in every PERIOD ticks
+   from now on, it may run for RUNTIME ticks, which it is to get
+   within DEADLINE ticks of the start of the period.  Once it has
+   used them up it waits for the next period, so that it takes no
+   more than its share of the processor.  RUNTIME of 0 moves it back
+   to its priority.  Returns false, leaving it as it was, unless
+   0 < RUNTIME <= DEADLINE <= PERIOD, or if admitting it would take
+   the class past DL_BW_MAX of the processors. */
+bool
+thread_set_deadline (int64_t runtime, int64_t deadline, int64_t period) {
+	enum intr_level old_level = intr_disable ();
+	bool success = dl_set (thread_current (), runtime, deadline, period);
+
+	intr_set_level (old_level);
+	if (success)
+		test_max_priority ();
+	return success;
+}
+
+/* Sets how late, in nanoseconds, thread_sleep() may wake the running
+   thread, to NS unless it is negative, and returns the old value.
+   Wakeups due within that much of each other are then coalesced
+   into one tick.  Threads it creates inherit the value. */
+int64_t
+thread_set_timer_slack (int64_t ns) {
+	struct thread *t = thread_current ();
+	int64_t old = t->timer_slack_ns;
+
+	if (ns >= 0)
+		t->timer_slack_ns = ns;
+	return old;
+}
+
+/* Does the work of thread_set_deadline() for T, which is running.
+   Interrupts must be off. */
+static bool
+dl_set (struct thread *t, int64_t runtime, int64_t deadline,
+		int64_t period) {
+	uint64_t old_bw = 0, bw = 0;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (t->dl_runtime > 0)
+		old_bw = DIV_ROUND_UP ((uint64_t) t->dl_runtime << DL_BW_SHIFT,
+				t->dl_period);
+	if (runtime != 0) {
+		if (runtime < 0 || runtime > deadline || deadline > period
+				|| period > INT32_MAX)
+			return false;
+		bw = DIV_ROUND_UP ((uint64_t) runtime << DL_BW_SHIFT, period);
+		if (dl_total_bw - old_bw + bw > DL_BW_MAX * cpu_cnt)
+			return false;
+	}
+	dl_total_bw = dl_total_bw - old_bw + bw;
+	timer_event_cancel (&t->dl_timer);
+	t->dl_throttled = false;
+	t->dl_runtime = runtime;
+	t->dl_rel_deadline = deadline;
+	t->dl_period = period;
+	if (runtime != 0)
+		dl_refill (t, timer_ticks ());
+	return true;
+}
+
+/* Starts a period of deadline thread T at tick START, with its whole
+   budget. */
+static void
+dl_refill (struct thread *t, int64_t start) {
+	t->dl_budget = t->dl_runtime;
+	t->dl_deadline = start + t->dl_rel_deadline;
+	t->dl_next = start + t->dl_period;
+}
+
+/* Charges a timer tick to T, the running deadline thread.  Once its
+   budget is used up, T waits for its next period, unless that has
+   begun already.  T running past its deadline with budget left is a
+   missed deadline, after which it starts over. */
+static void
+dl_tick (struct thread *t) {
+	int64_t now = timer_ticks ();
+
+	if (now >= t->dl_deadline) {
+		dl_misses++;
+		dl_refill (t, now);
+	}
+	if (--t->dl_budget > 0)
+		return;
+	dl_throttles++;
+	if (now >= t->dl_next)
+		dl_refill (t, now);
+	else {
+		t->dl_throttled = true;
+		timer_event_add (&t->dl_timer, t->dl_next);
+	}
+	if (intr_context ())
+		intr_yield_on_return ();
+}
+
+/* Deadline thread T, blocked, is waking up.  If what is left of its
+   budget would have it run at more than its share of the processor
+   before its deadline, or that is past, it starts a new period now,
+   so that sleeping does not let it run late nor beyond its share. */
+static void
+dl_wakeup (struct thread *t) {
+	int64_t now = timer_ticks ();
+
+	if (t->dl_throttled)
+		return;
+	if (now >= t->dl_deadline || t->dl_budget * t->dl_rel_deadline
+			> t->dl_runtime * (t->dl_deadline - now))
+		dl_refill (t, now);
+}
+
+/* timer_func that starts the next period of T, a deadline thread out
+   of budget, and puts it back in its run queue if it is ready. */
+static void
+dl_replenish (void *t_) {
+	struct thread *t = t_;
+
+	dl_refill (t, t->dl_next);
+	t->dl_throttled = false;
+	if (t->status == THREAD_READY) {
+		ready_push (t);
+		if (intr_context () && ready_preempts (thread_current ()))
+			intr_yield_on_return ();
+	}
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -618,10 +1592,12 @@ init_thread (struct thread *t, const char *name, int priority) {
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct thread *t;
+
+	if (runqs[cpu_id ()].cnt > 0)
+		return ready_pop ();
+	t = ready_steal ();
+	return t != NULL ? t : idle_thread;
 }
 
 /* Use iretq to launch the thread */
@@ -652,73 +1628,23 @@ do_iret (struct intr_frame *tf) {
 			: : "g" ((uint64_t) tf) : "memory");
 }
 
-/* Switching the thread by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
+/* Switches from the running thread to TH, which is not running.
 
-   At this function's invocation, we just switched from thread
-   PREV, the new thread is already running, and interrupts are
-   still disabled.
+   At this function's invocation, TH's page tables and status are
+   already set up, and interrupts are disabled.  Only what a call
+   preserves, the callee-saved registers and the stack pointer, is
+   saved and restored by switch_threads(), so a switch between two
+   kernel threads costs a few pushes and pops instead of a whole
+   intr_frame and an iretq.  A thread returns from here once another
+   one switches back to it.  iretq is only used to enter user mode,
+   by do_iret().
 
    It's not safe to call printf() until the thread switch is
-   complete.  In practice that means that printf()s should be
-   added at the end of the function. */
+   complete. */
 static void
 thread_launch (struct thread *th) {
-	uint64_t tf_cur = (uint64_t) &running_thread ()->tf;
-	uint64_t tf = (uint64_t) &th->tf;
 	ASSERT (intr_get_level () == INTR_OFF);
-
-	/* The main switching logic.
-	 * We first restore the whole execution context into the intr_frame
-	 * and then switching to the next thread by calling do_iret.
-	 * Note that, we SHOULD NOT use any stack from here
-	 * until switching is done. */
-	__asm __volatile (
-			/* Store registers that will be used. */
-			"push %%rax\n"
-			"push %%rbx\n"
-			"push %%rcx\n"
-			/* Fetch input once */
-			"movq %0, %%rax\n"
-			"movq %1, %%rcx\n"
-			"movq %%r15, 0(%%rax)\n"
-			"movq %%r14, 8(%%rax)\n"
-			"movq %%r13, 16(%%rax)\n"
-			"movq %%r12, 24(%%rax)\n"
-			"movq %%r11, 32(%%rax)\n"
-			"movq %%r10, 40(%%rax)\n"
-			"movq %%r9, 48(%%rax)\n"
-			"movq %%r8, 56(%%rax)\n"
-			"movq %%rsi, 64(%%rax)\n"
-			"movq %%rdi, 72(%%rax)\n"
-			"movq %%rbp, 80(%%rax)\n"
-			"movq %%rdx, 88(%%rax)\n"
-			"pop %%rbx\n"              // Saved rcx
-			"movq %%rbx, 96(%%rax)\n"
-			"pop %%rbx\n"              // Saved rbx
-			"movq %%rbx, 104(%%rax)\n"
-			"pop %%rbx\n"              // Saved rax
-			"movq %%rbx, 112(%%rax)\n"
-			"addq $120, %%rax\n"
-			"movw %%es, (%%rax)\n"
-			"movw %%ds, 8(%%rax)\n"
-			"addq $32, %%rax\n"
-			"call __next\n"         // read the current rip.
-			"__next:\n"
-			"pop %%rbx\n"
-			"addq $(out_iret -  __next), %%rbx\n"
-			"movq %%rbx, 0(%%rax)\n" // rip
-			"movw %%cs, 8(%%rax)\n"  // cs
-			"pushfq\n"
-			"popq %%rbx\n"
-			"mov %%rbx, 16(%%rax)\n" // eflags
-			"mov %%rsp, 24(%%rax)\n" // rsp
-			"movw %%ss, 32(%%rax)\n"
-			"mov %%rcx, %%rdi\n"
-			"call do_iret\n"
-			"out_iret:\n"
-			: : "g"(tf_cur), "g" (tf) : "memory"
-			);
+	switch_threads (&running_thread ()->ksp, th->ksp);
 }
 
 /* Schedules a new process. At entry, interrupts must be off.
@@ -729,10 +1655,20 @@ static void
 do_schedule(int status) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (thread_current()->status == THREAD_RUNNING);
+	/* RCU readers must not sleep. */
+	ASSERT (thread_current ()->rcu_nesting == 0);
+	/* An interrupt that woke a thread may switch away from the idle
+	   thread before idle() gets to account for skipped ticks. */
+	if (thread_current () == idle_thread)
+		timer_idle_exit ();
 	while (!list_empty (&destruction_req)) {
 		struct thread *victim =
 			list_entry (list_pop_front (&destruction_req), struct thread, elem);
-		palloc_free_page(victim);
+		size_t depth = stack_depth (victim);
+
+		if (depth > stack_deepest)
+			stack_deepest = depth;
+		thread_block_put (victim);
 	}
 	thread_current ()->status = status;
 	schedule ();
@@ -746,10 +1682,28 @@ schedule (void) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
+	/* The stack grew down into struct thread. */
+	if (curr->magic != THREAD_MAGIC)
+		PANIC ("kernel stack overflow in thread `%.*s'",
+				(int) sizeof curr->name, curr->name);
+	/* No RCU reader is left on this processor. */
+	rcu_quiescent ();
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
 
-	/* Start new time slice. */
+	/* Resize the time slice of a thread that used it all or blocked
+	   early, and start a new one. */
+	if (thread_adaptive && curr != idle_thread) {
+		if (curr->status == THREAD_READY && curr->preempted
+				&& thread_ticks >= curr->slice)
+			curr->slice = curr->slice * 2 < SLICE_MAX
+				? curr->slice * 2 : SLICE_MAX;
+		else if (curr->status == THREAD_BLOCKED
+				&& thread_ticks * 2 < curr->slice)
+			curr->slice = curr->slice / 2 > SLICE_MIN
+				? curr->slice / 2 : SLICE_MIN;
+	}
+	next->boosted = false;
 	thread_ticks = 0;
 
 #ifdef USERPROG
@@ -770,6 +1724,11 @@ schedule (void) {
 			list_push_back (&destruction_req, &curr->elem);
 		}
 
+		trace (TRACE_SWITCH, 0, next->tid, 0);
+		pmu_switch (curr);
+		fpu_switch (next);
+		sched_account_switch (curr, next);
+
 		/* Before switching the thread, we first save the information
 		 * of current running. */
 		thread_launch (next);
@@ -0,0 +1,113 @@
+#include "threads/trace.h"
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Event tracing.  Each processor records into its own ring of
+   fixed-size records, with interrupts off for the few stores it
+   takes and no lock, overwriting the oldest records once the ring is
+   full.  The rings are printed over the console at power off, one
+   line per record beginning "trace:", for the host to pick out of the
+   output. */
+
+/* Pages of records per processor. */
+#define TRACE_PAGES 8
+#define TRACE_REC_CNT (TRACE_PAGES * PGSIZE / sizeof (struct trace_rec))
+
+bool trace_enabled;
+
+/* A processor's ring.  HEAD counts every record ever made; the last
+   TRACE_REC_CNT of them are kept, record I at recs[I % TRACE_REC_CNT]. */
+struct trace_ring {
+	struct trace_rec *recs;
+	uint64_t head;
+};
+
+static struct trace_ring rings[CPU_MAX];
+
+static const char *event_names[TRACE_EVENT_CNT] = {
+	[TRACE_SWITCH] = "switch",
+	[TRACE_LOCK_WAIT] = "lock-wait",
+	[TRACE_FAULT] = "fault",
+	[TRACE_EVICT] = "evict",
+	[TRACE_DISK] = "disk",
+	[TRACE_SYSCALL] = "syscall",
+};
+
+/* Makes a ring for each running processor, if tracing is enabled.
+   Tracing is turned off if memory runs out. */
+void
+trace_init (void) {
+	size_t i;
+
+	if (!trace_enabled)
+		return;
+	for (i = 0; i < cpu_cnt; i++) {
+		if (!cpus[i].running)
+			continue;
+		rings[i].recs = palloc_get_multiple (PAL_ZERO, TRACE_PAGES);
+		if (rings[i].recs == NULL) {
+			printf ("trace: out of memory, tracing disabled\n");
+			trace_enabled = false;
+			return;
+		}
+	}
+}
+
+/* Records EVENT with ARG, A and B in the running processor's ring. */
+void
+trace_record (enum trace_event event, uint16_t arg, uint64_t a, uint64_t b) {
+	/* Not thread_current(), which objects to a thread in the middle
+	   of being switched out. */
+	struct thread *t = thread_running ();
+	struct trace_ring *ring = &rings[cpu_id ()];
+	enum intr_level old_level;
+	struct trace_rec *rec;
+
+	if (ring->recs == NULL)
+		return;
+	old_level = intr_disable ();
+	rec = &ring->recs[ring->head++ % TRACE_REC_CNT];
+	rec->tsc = rdtsc ();
+	rec->event = event;
+	rec->arg = arg;
+	rec->tid = t->tid;
+	rec->a = a;
+	rec->b = b;
+	intr_set_level (old_level);
+}
+
+/* Prints the records kept in every ring, oldest first, as
+   "trace: CPU TSC EVENT TID ARG A B", the numbers other than TID in
+   hexadecimal. */
+void
+trace_dump (void) {
+	size_t i;
+
+	if (!trace_enabled)
+		return;
+	for (i = 0; i < CPU_MAX; i++) {
+		struct trace_ring *ring = &rings[i];
+		uint64_t n;
+
+		if (ring->recs == NULL)
+			continue;
+		printf ("Trace: CPU %zu, %llu records, %llu kept\n", i,
+				(unsigned long long) ring->head,
+				(unsigned long long) (ring->head < TRACE_REC_CNT
+					? ring->head : TRACE_REC_CNT));
+		n = ring->head < TRACE_REC_CNT ? 0 : ring->head - TRACE_REC_CNT;
+		for (; n < ring->head; n++) {
+			const struct trace_rec *rec = &ring->recs[n % TRACE_REC_CNT];
+
+			printf ("trace: %zu %llx %s %d %x %llx %llx\n", i,
+					(unsigned long long) rec->tsc, event_names[rec->event],
+					rec->tid, rec->arg, (unsigned long long) rec->a,
+					(unsigned long long) rec->b);
+		}
+	}
+}
@@ -0,0 +1,130 @@
+#include "threads/waitq.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+static void poller_wake (struct poller *);
+static void poller_timeout (void *p_);
+
+/* Initializes Q with no pollers. */
+void
+waitq_init (struct waitq *q) {
+	list_init (&q->entries);
+}
+
+/* Wakes every poller on Q.  May be called from an interrupt
+   handler. */
+void
+waitq_wake (struct waitq *q) {
+	enum intr_level old_level = intr_disable ();
+	struct list_elem *e;
+
+	for (e = list_begin (&q->entries); e != list_end (&q->entries);
+			e = list_next (e))
+		poller_wake (list_entry (e, struct waitq_entry, elem)->poller);
+	test_max_priority ();
+	intr_set_level (old_level);
+}
+
+/* Wakes every poller on Q and takes it off Q, which is going away.
+   Their later poller_remove() calls find them on no queue. */
+void
+waitq_destroy (struct waitq *q) {
+	enum intr_level old_level = intr_disable ();
+
+	while (!list_empty (&q->entries)) {
+		struct waitq_entry *e = list_entry (list_pop_front (&q->entries),
+				struct waitq_entry, elem);
+
+		poller_wake (e->poller);
+		e->poller = NULL;
+	}
+	test_max_priority ();
+	intr_set_level (old_level);
+}
+
+/* Initializes E as on no queue. */
+void
+waitq_entry_init (struct waitq_entry *e) {
+	e->poller = NULL;
+}
+
+/* Initializes P, for the running thread. */
+void
+poller_init (struct poller *p) {
+	p->thread = NULL;
+	p->woken = false;
+	p->timed_out = false;
+	timer_event_init (&p->timer, poller_timeout, p);
+}
+
+/* Adds E, for P, to Q.  E must be removed with poller_remove()
+   before P goes away.  Q takes it off itself if it goes first. */
+void
+poller_add (struct poller *p, struct waitq_entry *e, struct waitq *q) {
+	enum intr_level old_level = intr_disable ();
+
+	e->poller = p;
+	list_push_back (&q->entries, &e->elem);
+	intr_set_level (old_level);
+}
+
+/* Removes E from the queue poller_add() put it on, if it was put on
+   one since waitq_entry_init() and is still on it. */
+void
+poller_remove (struct waitq_entry *e) {
+	enum intr_level old_level = intr_disable ();
+
+	/* The queue may have been destroyed meanwhile. */
+	if (e->poller != NULL) {
+		list_remove (&e->elem);
+		e->poller = NULL;
+	}
+	intr_set_level (old_level);
+}
+
+/* Sleeps until a queue P is on is woken, unless one was since the
+   last call, or until timer_ticks() reaches DEADLINE, if it is not
+   negative.  Returns false if it returned for the deadline. */
+bool
+poller_wait (struct poller *p, int64_t deadline) {
+	enum intr_level old_level = intr_disable ();
+	bool woken;
+
+	if (!p->woken && deadline >= 0 && deadline <= timer_ticks ())
+		p->timed_out = true;
+	if (!p->woken && !p->timed_out) {
+		if (deadline >= 0)
+			timer_event_add (&p->timer, deadline);
+		p->thread = thread_current ();
+		thread_block ();
+		timer_event_cancel (&p->timer);
+	}
+	woken = p->woken;
+	p->woken = false;
+	intr_set_level (old_level);
+	return woken || !p->timed_out;
+}
+
+/* Wakes P.  Interrupts must be off. */
+static void
+poller_wake (struct poller *p) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	p->woken = true;
+	if (p->thread != NULL) {
+		thread_unblock (p->thread);
+		p->thread = NULL;
+	}
+}
+
+/* timer_func for a poller's deadline. */
+static void
+poller_timeout (void *p_) {
+	struct poller *p = p_;
+
+	p->timed_out = true;
+	if (p->thread != NULL) {
+		thread_unblock (p->thread);
+		p->thread = NULL;
+	}
+}
@@ -0,0 +1,223 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Number of worker threads.  Items that sleep on I/O, like
+   write-back and eviction, hold a worker meanwhile, so there are a
+   few of them even with one processor. */
+#define WORKER_CNT 4
+
+/* Queued items, highest priority first and in queueing order among
+   equals, and a count of them for the workers to sleep on.  An item
+   cancelled while queued leaves its count behind, which the worker
+   taking it shrugs off.  Interrupts are off whenever these are
+   looked at. */
+static struct list queue;
+static struct semaphore queue_sema;
+
+/* Statistics. */
+static long long works_run;     /* # of times an item was run. */
+static long long works_delayed; /* # of times an item was delayed. */
+
+static void worker (void *aux UNUSED);
+static bool work_enqueue (struct work *);
+static void work_timer_fire (void *w_);
+static void work_wake_flushers (struct work *);
+static bool work_priority_more (const struct list_elem *a_,
+		const struct list_elem *b_, void *aux UNUSED);
+
+/* Starts the worker threads.  Called once the scheduler runs. */
+void
+workqueue_init (void) {
+	char name[16];
+	int i;
+
+	list_init (&queue);
+	sema_init (&queue_sema, 0);
+	for (i = 0; i < WORKER_CNT; i++) {
+		snprintf (name, sizeof name, "kworker/%d", i);
+		if (thread_create (name, PRI_DEFAULT, worker, NULL) == TID_ERROR)
+			PANIC ("workqueue_init: worker creation failed");
+	}
+}
+
+/* Prints work queue statistics. */
+void
+workqueue_print_stats (void) {
+	printf ("Workqueue: %lld items run, %lld delayed\n",
+			works_run, works_delayed);
+}
+
+/* Initializes W to call FUNC (AUX) at thread priority PRIORITY
+   whenever it is queued. */
+void
+work_init (struct work *w, work_func *func, void *aux, int priority) {
+	ASSERT (func != NULL);
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	w->func = func;
+	w->aux = aux;
+	w->priority = priority;
+	w->pending = w->running = w->rerun = false;
+	timer_event_init (&w->timer, work_timer_fire, w);
+	w->flusher_cnt = 0;
+	sema_init (&w->flushed, 0);
+}
+
+/* Queues W to run on a worker as soon as one is free, or, if it is
+   running, to run once more after that.  A delay set by
+   work_queue_delayed() is cut short.  Returns false if W was
+   already going to run without a delay. */
+bool
+work_queue (struct work *w) {
+	enum intr_level old_level = intr_disable ();
+	bool queued;
+
+	timer_event_cancel (&w->timer);
+	queued = work_enqueue (w);
+	intr_set_level (old_level);
+	return queued;
+}
+
+/* Queues W once TICKS timer ticks have passed, or right away if
+   TICKS is not positive.  Returns false, leaving W as it was, if W
+   was already queued or delayed. */
+bool
+work_queue_delayed (struct work *w, int64_t ticks) {
+	enum intr_level old_level;
+	bool delayed;
+
+	if (ticks <= 0)
+		return work_queue (w);
+
+	old_level = intr_disable ();
+	delayed = !w->pending && !w->rerun && !w->timer.pending;
+	if (delayed) {
+		timer_event_add (&w->timer, timer_ticks () + ticks);
+		works_delayed++;
+	}
+	intr_set_level (old_level);
+	return delayed;
+}
+
+/* Keeps W from running again, if it was queued or delayed, and
+   returns true if it was.  Does not wait for W to finish if it is
+   running; use work_flush() for that. */
+bool
+work_cancel (struct work *w) {
+	enum intr_level old_level = intr_disable ();
+	bool cancelled = timer_event_cancel (&w->timer);
+
+	if (w->pending) {
+		list_remove (&w->elem);
+		w->pending = false;
+		cancelled = true;
+	}
+	if (w->rerun) {
+		w->rerun = false;
+		cancelled = true;
+	}
+	work_wake_flushers (w);
+	intr_set_level (old_level);
+	return cancelled;
+}
+
+/* Waits until W is neither queued, delayed nor running.  An item
+   that keeps queueing itself has to be cancelled first. */
+void
+work_flush (struct work *w) {
+	enum intr_level old_level = intr_disable ();
+
+	if (work_is_busy (w)) {
+		w->flusher_cnt++;
+		intr_set_level (old_level);
+		sema_down (&w->flushed);
+	} else
+		intr_set_level (old_level);
+}
+
+/* Returns true if W is queued, delayed or running. */
+bool
+work_is_busy (const struct work *w) {
+	return w->pending || w->running || w->rerun || w->timer.pending;
+}
+
+/* Worker thread: runs queued items, forever. */
+static void
+worker (void *aux UNUSED) {
+	for (;;) {
+		enum intr_level old_level;
+		struct work *w;
+
+		sema_down (&queue_sema);
+		old_level = intr_disable ();
+		if (list_empty (&queue)) {
+			intr_set_level (old_level);
+			continue;
+		}
+		w = list_entry (list_pop_front (&queue), struct work, elem);
+		w->pending = false;
+		w->running = true;
+		do {
+			w->rerun = false;
+			works_run++;
+			intr_set_level (old_level);
+
+			thread_set_priority (w->priority);
+			w->func (w->aux);
+
+			old_level = intr_disable ();
+		} while (w->rerun);
+		w->running = false;
+		work_wake_flushers (w);
+		intr_set_level (old_level);
+		thread_set_priority (PRI_DEFAULT);
+	}
+}
+
+/* Does the work of work_queue(), but for the delay.  Interrupts
+   must be off. */
+static bool
+work_enqueue (struct work *w) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (w->pending || w->rerun)
+		return false;
+	if (w->running)
+		w->rerun = true;
+	else {
+		w->pending = true;
+		list_insert_ordered (&queue, &w->elem, work_priority_more, NULL);
+		sema_up (&queue_sema);
+	}
+	return true;
+}
+
+/* Queues W, whose delay is over.  Runs in the timer interrupt. */
+static void
+work_timer_fire (void *w_) {
+	work_enqueue (w_);
+}
+
+/* Lets the threads in work_flush() on W go, if W is idle.
+   Interrupts must be off. */
+static void
+work_wake_flushers (struct work *w) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (work_is_busy (w))
+		return;
+	for (; w->flusher_cnt > 0; w->flusher_cnt--)
+		sema_up (&w->flushed);
+}
+
+/* Orders items by descending priority.  list_insert_ordered()
+   puts an item after those of its priority. */
+static bool
+work_priority_more (const struct list_elem *a_,
+		const struct list_elem *b_, void *aux UNUSED) {
+	const struct work *a = list_entry (a_, struct work, elem);
+	const struct work *b = list_entry (b_, struct work, elem);
+
+	return a->priority > b->priority;
+}
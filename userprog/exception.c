@@ -2,6 +2,9 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "intrinsic.h"
@@ -12,6 +15,7 @@
 static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -47,7 +51,7 @@ exception_init (void) {
 	intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
 	intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
 	intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-	intr_register_int (7, 0, INTR_ON, kill,
+	intr_register_int (7, 0, INTR_ON, device_not_available,
 			"#NM Device Not Available Exception");
 	intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
 	intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
@@ -88,6 +92,7 @@ kill (struct intr_frame *f) {
 			//printf ("%s: dying due to interrupt %#04llx (%s).\n",
 					//thread_name (), f->vec_no, intr_name (f->vec_no));
 			//intr_dump_frame (f);
+			process_exit_if_killed ();
 			thread_exit ();
 
 		case SEL_KCSEG:
@@ -107,6 +112,15 @@ kill (struct intr_frame *f) {
 	}
 }
 
+/* Handler for #NM, raised by the first x87 or SIMD instruction a
+   thread runs while another thread's state is in the registers.
+   Kills the process if it cannot have them. */
+static void
+device_not_available (struct intr_frame *f) {
+	if (f->cs != SEL_UCSEG || !fpu_claim ())
+		kill (f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -153,6 +167,10 @@ page_fault (struct intr_frame *f) {
 	/* Count page faults. */
 	page_fault_cnt++;
 
+	/* A kernel access to user memory that faulted fails by itself. */
+	if (!user && uaccess_fixup (f))
+		return;
+
 	/* If the fault is true fault, show info and exit. */
 	// printf ("Page fault at %p: %s error %s page in %s context.\n",
 	// 		fault_addr,
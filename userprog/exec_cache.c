@@ -0,0 +1,161 @@
+/* exec_cache.c: Cache of executables' validated ELF headers.
+ *
+ * load() reads and checks the ELF header and every program header of
+ * the executable it loads.  Programs are often run many times over,
+ * so the result, the entry point and the PT_LOAD segments, is kept
+ * here by the sector of the executable's inode, and later loads of
+ * the same file skip the header I/O and validation.  The inode layer
+ * drops the entry of a file whenever it is written or its sector is
+ * freed.
+ *
+ * Lookups, one per exec, far outnumber changes, so they take no lock:
+ * they read the entries under RCU, and changes replace entries whole. */
+
+#include "userprog/exec_cache.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+
+/* Number of executables remembered. */
+#define EXEC_CACHE_CNT 8
+
+/* A cached image.  Never changed once published in a slot: an entry
+ * is replaced by a new one, and freed after an RCU grace period, so
+ * that lookups read the slots with no lock. */
+struct exec_entry {
+	struct rcu_head rcu;        /* For freeing after readers are done. */
+	disk_sector_t sector;       /* Sector of the executable's inode. */
+	uint64_t last_used;         /* Value of use_clock at the last hit. */
+	struct exec_image image;
+};
+
+/* The cached images, or null pointers.  Read under rcu_read_lock(),
+ * changed only with exec_cache_lock held. */
+static struct exec_entry *slots[EXEC_CACHE_CNT];
+static struct lock exec_cache_lock;
+
+/* Stamps hits for replacing the least recently used entry.  Bumped
+ * by readers with no lock, so two hits may share a stamp, which only
+ * blurs the order. */
+static uint64_t use_clock;
+
+/* Bumped by every invalidation, so that an image read while its file
+ * was being written is not cached. */
+static uint64_t generation;
+
+/* Initializes the exec cache. */
+void
+exec_cache_init (void) {
+	lock_init (&exec_cache_lock);
+}
+
+/* Frees the entry whose rcu_head is HEAD. */
+static void
+free_entry (struct rcu_head *head) {
+	free ((uint8_t *) head - offsetof (struct exec_entry, rcu));
+}
+
+/* Returns the index of the slot holding the entry for SECTOR, or -1
+ * if there is none.  Must be called under rcu_read_lock() or with
+ * exec_cache_lock held. */
+static int
+find_slot (disk_sector_t sector) {
+	int i;
+
+	for (i = 0; i < EXEC_CACHE_CNT; i++) {
+		struct exec_entry *x = rcu_dereference (slots[i]);
+
+		if (x != NULL && x->sector == sector)
+			return i;
+	}
+	return -1;
+}
+
+/* Copies the cached image of the executable whose inode is at SECTOR
+ * into *IMAGE and returns true.  Returns false if there is none,
+ * storing in *GEN the value to pass to exec_cache_insert() once the
+ * image has been read from the file. */
+bool
+exec_cache_lookup (disk_sector_t sector, struct exec_image *image,
+		uint64_t *gen) {
+	struct exec_entry *x = NULL;
+	int i;
+
+	/* Read before looking, so that an invalidation after the miss
+	 * keeps the image read from being cached. */
+	*gen = generation;
+	barrier ();
+	rcu_read_lock ();
+	i = find_slot (sector);
+	if (i >= 0) {
+		x = rcu_dereference (slots[i]);
+		*image = x->image;
+		x->last_used = ++use_clock;
+	}
+	rcu_read_unlock ();
+	return x != NULL;
+}
+
+/* Caches IMAGE as that of the executable whose inode is at SECTOR,
+ * replacing the least recently used entry.  Does nothing if the
+ * cache has been invalidated since the lookup that returned GEN, or
+ * if memory is short. */
+void
+exec_cache_insert (disk_sector_t sector, const struct exec_image *image,
+		uint64_t gen) {
+	struct exec_entry *x, *old;
+	int i, victim = 0;
+
+	ASSERT (image->segment_cnt <= EXEC_SEGMENT_MAX);
+
+	x = malloc (sizeof *x);
+	if (x == NULL)
+		return;
+	x->sector = sector;
+	x->last_used = ++use_clock;
+	x->image = *image;
+
+	lock_acquire (&exec_cache_lock);
+	if (gen != generation) {
+		lock_release (&exec_cache_lock);
+		free (x);
+		return;
+	}
+	victim = find_slot (sector);
+	for (i = 0; victim < 0 && i < EXEC_CACHE_CNT; i++)
+		if (slots[i] == NULL)
+			victim = i;
+	if (victim < 0) {
+		victim = 0;
+		for (i = 1; i < EXEC_CACHE_CNT; i++)
+			if (slots[i]->last_used < slots[victim]->last_used)
+				victim = i;
+	}
+	old = slots[victim];
+	rcu_assign_pointer (slots[victim], x);
+	lock_release (&exec_cache_lock);
+
+	if (old != NULL)
+		call_rcu (&old->rcu, free_entry);
+}
+
+/* Forgets the image of the file whose inode is at SECTOR, if any. */
+void
+exec_cache_invalidate (disk_sector_t sector) {
+	struct exec_entry *old = NULL;
+	int i;
+
+	lock_acquire (&exec_cache_lock);
+	generation++;
+	i = find_slot (sector);
+	if (i >= 0) {
+		old = slots[i];
+		rcu_assign_pointer (slots[i], NULL);
+	}
+	lock_release (&exec_cache_lock);
+
+	if (old != NULL)
+		call_rcu (&old->rcu, free_entry);
+}
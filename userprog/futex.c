@@ -0,0 +1,158 @@
+/* futex.c: Waiting on a word of user memory, for locks in user space
+ * that enter the kernel only under contention.
+ *
+ * futex_wait() puts the caller to sleep if the word still holds the
+ * value it expects, and futex_wake() wakes sleepers on a word.  The
+ * check and the sleep are atomic with respect to wakes, so a waker
+ * that changes the word and then wakes cannot slip in between.
+ *
+ * A word is named by its address space and address, except in a
+ * shared memory segment, where it is named by the segment and its
+ * offset in it, so that processes attaching the segment anywhere
+ * meet on the same word.  Waiters are kept in a fixed table of
+ * buckets hashed by name, each with a lock, and are woken highest
+ * priority first.  Nothing tells the kernel which thread holds a
+ * user lock, so waiters cannot donate their priority to it. */
+
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/syscall.h"
+#include "userprog/uaccess.h"
+#include "vm/vm.h"
+
+#define FUTEX_BUCKET_CNT 64
+
+/* Name of a futex word. */
+struct futex_key {
+	const void *space;          /* Page table or shared memory segment. */
+	uintptr_t ofs;              /* Address in it. */
+};
+
+/* A thread in futex_wait(), on its stack. */
+struct futex_waiter {
+	struct futex_key key;
+	struct thread *thread;
+	struct semaphore sema;      /* Up'd by futex_wake(). */
+	struct list_elem elem;      /* Element in its bucket's waiters. */
+};
+
+struct futex_bucket {
+	struct lock lock;
+	struct list waiters;
+};
+
+static struct futex_bucket buckets[FUTEX_BUCKET_CNT];
+
+static bool futex_key_of (const int *uaddr, struct futex_key *);
+static struct futex_bucket *futex_bucket (const struct futex_key *);
+
+/* Initializes the futex buckets to no waiters. */
+void
+futex_init (void) {
+	size_t i;
+
+	for (i = 0; i < FUTEX_BUCKET_CNT; i++) {
+		lock_init (&buckets[i].lock);
+		list_init (&buckets[i].waiters);
+	}
+}
+
+/* Sleeps until woken by futex_wake() on the word at UADDR, if it
+ * holds EXPECTED, and returns 0.  Returns -1 at once if it does not
+ * or UADDR is not aligned.  Kills the process if UADDR is not mapped. */
+int
+futex_wait (int *uaddr, int expected) {
+	struct futex_waiter waiter;
+	struct futex_bucket *b;
+	int value;
+
+	if (!futex_key_of (uaddr, &waiter.key))
+		return -1;
+	b = futex_bucket (&waiter.key);
+
+	lock_acquire (&b->lock);
+	if (!copy_from_user (&value, uaddr, sizeof value)) {
+		lock_release (&b->lock);
+		_exit (-1);
+	}
+	if (value != expected) {
+		lock_release (&b->lock);
+		return -1;
+	}
+	waiter.thread = thread_current ();
+	sema_init (&waiter.sema, 0);
+	list_push_back (&b->waiters, &waiter.elem);
+	lock_release (&b->lock);
+
+	sema_down (&waiter.sema);
+	return 0;
+}
+
+/* Wakes up to N of the threads waiting on the word at UADDR, highest
+ * priority first, and returns how many it woke. */
+int
+futex_wake (int *uaddr, int n) {
+	struct futex_key key;
+	struct futex_bucket *b;
+	int woken = 0;
+
+	if (!futex_key_of (uaddr, &key))
+		return 0;
+	b = futex_bucket (&key);
+
+	lock_acquire (&b->lock);
+	while (woken < n) {
+		struct futex_waiter *best = NULL;
+		struct list_elem *e;
+
+		for (e = list_begin (&b->waiters); e != list_end (&b->waiters);
+				e = list_next (e)) {
+			struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+			if (w->key.space == key.space && w->key.ofs == key.ofs
+					&& (best == NULL
+						|| w->thread->priority > best->thread->priority))
+				best = w;
+		}
+		if (best == NULL)
+			break;
+		list_remove (&best->elem);
+		sema_up (&best->sema);
+		woken++;
+	}
+	lock_release (&b->lock);
+	return woken;
+}
+
+/* Stores the name of the word at UADDR in *KEY.  Returns false if
+ * UADDR is not a user address aligned to a word. */
+static bool
+futex_key_of (const int *uaddr, struct futex_key *key) {
+	struct thread *t = thread_leader ();
+	struct page *page;
+
+	if ((uintptr_t) uaddr % sizeof *uaddr != 0 || !is_user_vaddr (uaddr))
+		return false;
+	vm_lock ();
+	page = spt_find_page (&t->spt, (void *) uaddr);
+	if (page != NULL && page_get_type (page) == VM_SHM) {
+		key->space = page->shm.shm;
+		key->ofs = page->shm.idx * PGSIZE + pg_ofs (uaddr);
+	} else {
+		key->space = t->pml4;
+		key->ofs = (uintptr_t) uaddr;
+	}
+	vm_unlock ();
+	return true;
+}
+
+/* Returns the bucket of the word named KEY. */
+static struct futex_bucket *
+futex_bucket (const struct futex_key *key) {
+	return &buckets[(hash_ptr (key->space) ^ hash_u64 (key->ofs))
+		% FUTEX_BUCKET_CNT];
+}
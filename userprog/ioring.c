@@ -0,0 +1,157 @@
+/* ioring.c: Batched system calls through a ring in user memory.
+ *
+ * A process sets up at most one ring, a range of its own anonymous
+ * pages holding a struct io_ring followed by ENTRIES submission and
+ * ENTRIES completion entries.  It queues operations by writing
+ * submissions and advancing sq_tail, then has the kernel run up to a
+ * number of them with a single io_enter(), which posts a completion
+ * for each.  The kernel trusts nothing in the ring but the entries, so
+ * it keeps the ring's address and size here and copies every field in
+ * and out of user memory. */
+
+#include "userprog/ioring.h"
+#include <debug.h>
+#include <round.h>
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "user/syscall.h"
+#include "userprog/syscall.h"
+#include "userprog/uaccess.h"
+#include "vm/vm.h"
+#include "vm/vma.h"
+
+static int io_ring_do (const struct io_sqe *);
+
+/* Bytes taken by a ring of ENTRIES entries, and offsets in it of the
+ * submissions and completions. */
+#define SQES_OFS ROUND_UP (sizeof (struct io_ring), sizeof (uint64_t))
+#define CQES_OFS(ENTRIES) (SQES_OFS + (ENTRIES) * sizeof (struct io_sqe))
+#define RING_SIZE(ENTRIES) \
+	(CQES_OFS (ENTRIES) + (ENTRIES) * sizeof (struct io_cqe))
+
+/* Maps a ring of ENTRIES entries, a power of two up to
+ * IORING_MAX_ENTRIES, at ADDR in the current process, and returns
+ * ADDR.  Returns a null pointer if the process already has a ring, the
+ * arguments are bad, the pages from ADDR are in use or memory runs
+ * out. */
+void *
+io_ring_setup (void *addr, unsigned entries) {
+	struct thread *t = thread_leader ();
+	struct supplemental_page_table *spt = &t->spt;
+	size_t length = RING_SIZE (entries);
+	struct io_ring ring;
+	uint8_t *va;
+
+	if (t->io_ring != NULL || entries == 0 || entries > IORING_MAX_ENTRIES
+			|| (entries & (entries - 1)) != 0)
+		return NULL;
+	if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+			|| !is_user_vaddr ((uint8_t *) addr + length))
+		return NULL;
+	if (!vma_range_is_free (spt, addr, length)
+			|| vm_stack_reserved (addr, length))
+		return NULL;
+
+	for (va = addr; va < (uint8_t *) addr + length; va += PGSIZE)
+		if (!vm_alloc_page (VM_ANON, va, true)) {
+			while (va > (uint8_t *) addr) {
+				va -= PGSIZE;
+				spt_remove_page (spt, spt_find_page (spt, va));
+			}
+			return NULL;
+		}
+
+	ring = (struct io_ring) {
+		.entries = entries,
+		.sqes = (struct io_sqe *) ((uint8_t *) addr + SQES_OFS),
+		.cqes = (struct io_cqe *) ((uint8_t *) addr + CQES_OFS (entries)),
+	};
+	if (!copy_to_user (addr, &ring, sizeof ring))
+		return NULL;
+	t->io_ring = addr;
+	t->io_ring_entries = entries;
+	return addr;
+}
+
+/* Runs up to TO_SUBMIT of the operations queued in the current
+ * process's ring, in order, posting a completion for each, and
+ * returns the number run.  Stops early when the submissions run out
+ * or the completions fill up.  Returns -1 if the process has no ring.
+ * A bad pointer in the ring or in an operation kills the process, as
+ * it would in the system call. */
+int
+io_ring_enter (unsigned to_submit) {
+	struct thread *t = thread_leader ();
+	struct io_ring *ring = t->io_ring;
+	unsigned mask = t->io_ring_entries - 1;
+	struct io_sqe *sqes = (struct io_sqe *) ((uint8_t *) ring + SQES_OFS);
+	struct io_cqe *cqes = (struct io_cqe *) ((uint8_t *) ring
+			+ CQES_OFS (t->io_ring_entries));
+	struct io_ring hdr;
+	unsigned done;
+
+	if (ring == NULL)
+		return -1;
+	if (!copy_from_user (&hdr, ring, sizeof hdr))
+		_exit (-1);
+
+	for (done = 0; done < to_submit && hdr.sq_head != hdr.sq_tail
+			&& hdr.cq_tail - hdr.cq_head <= mask; done++) {
+		struct io_sqe sqe;
+		struct io_cqe cqe;
+
+		if (!copy_from_user (&sqe, &sqes[hdr.sq_head & mask], sizeof sqe))
+			_exit (-1);
+		cqe.user_data = sqe.user_data;
+		cqe.res = io_ring_do (&sqe);
+		if (!copy_to_user (&cqes[hdr.cq_tail & mask], &cqe, sizeof cqe))
+			_exit (-1);
+		hdr.sq_head++;
+		hdr.cq_tail++;
+
+		/* Publish each one as it completes, so the user may reap
+		 * completions of a long batch from another thread. */
+		if (!copy_to_user (&ring->sq_head, &hdr.sq_head, sizeof hdr.sq_head)
+				|| !copy_to_user (&ring->cq_tail, &hdr.cq_tail,
+					sizeof hdr.cq_tail))
+			_exit (-1);
+	}
+	return done;
+}
+
+/* Gives CHILD, just forked from PARENT, the ring PARENT has.  Its
+ * pages were copied with the rest of the address space. */
+void
+io_ring_fork (struct thread *child, const struct thread *parent) {
+	child->io_ring = parent->io_ring;
+	child->io_ring_entries = parent->io_ring_entries;
+}
+
+/* Forgets T's ring, whose pages are gone with its address space. */
+void
+io_ring_reset (struct thread *t) {
+	t->io_ring = NULL;
+	t->io_ring_entries = 0;
+}
+
+/* Runs SQE and returns its result, as the system call would. */
+static int
+io_ring_do (const struct io_sqe *sqe) {
+	switch (sqe->op) {
+		case IORING_OP_READ:
+			return _read (sqe->fd, sqe->buf, sqe->len);
+		case IORING_OP_WRITE:
+			return _write (sqe->fd, sqe->buf, sqe->len);
+		case IORING_OP_PREAD:
+			return _pread (sqe->fd, sqe->buf, sqe->len, sqe->offset);
+		case IORING_OP_PWRITE:
+			return _pwrite (sqe->fd, sqe->buf, sqe->len, sqe->offset);
+		case IORING_OP_OPEN:
+			return _open (sqe->buf);
+		case IORING_OP_CLOSE:
+			_close (sqe->fd);
+			return 0;
+		default:
+			return -1;
+	}
+}
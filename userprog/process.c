@@ -5,28 +5,135 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/exec_cache.h"
 #include "userprog/gdt.h"
+#include "userprog/ioring.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/scratch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
+#include "user/syscall.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
 
 static void process_cleanup (void);
+static bool process_reap_begin (struct thread *);
+static void process_reap (struct thread *);
 static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
-static struct thread *get_child_process(tid_t child_tid);
+static void __do_spawn (void *);
+static void __do_uthread (void *);
+static void process_wait_threads (struct thread *leader);
+static void process_leave (struct thread *);
+static bool inherit_fds (struct thread *parent, const int *fds, int fd_cnt);
+static struct child_info *get_child_process(tid_t child_tid);
+static void child_info_release (struct child_info *);
+
+/* Object cache of struct child_info. */
+static struct kmem_cache *child_info_slab;
+
+/* Deferred teardown.  An exiting process closes its files and writes
+ * back its mappings, which others may be waiting to see, then
+ * publishes its exit status, and only then frees its address space
+ * and closes its executable, at the lowest priority, so that the
+ * parent's wait() does not include that time.  At most REAP_MAX
+ * processes tear down so at a time, by interrupts off; more exit the
+ * old way, so that dead processes never hold much memory. */
+#define REAP_MAX 8
+static unsigned reaping;
+static unsigned long long reaped;
+
+/* Initializes the object cache of struct child_info.  Must be called
+ * before the first thread_create(). */
+void
+process_child_info_init (void) {
+	child_info_slab = kmem_cache_create ("child_info",
+			sizeof (struct child_info), NULL);
+	if (child_info_slab == NULL)
+		PANIC ("process_child_info_init: out of memory");
+}
+
+/* Hashes and orders struct child_info by tid, for a parent's
+ * children. */
+static uint64_t
+child_info_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct child_info *info = hash_entry (e, struct child_info, elem);
+
+	return hash_int (info->tid);
+}
+
+static bool
+child_info_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct child_info, elem)->tid
+		< hash_entry (b, struct child_info, elem)->tid;
+}
+
+/* Returns a new struct child_info for a thread the current thread is
+ * about to create, holding references for it and for its parent, or
+ * a null pointer if memory is not available. */
+struct child_info *
+process_child_info_create (void) {
+	struct thread *curr = thread_current ();
+	struct child_info *info;
+
+	/* children은 첫 자식을 만들 때 초기화 */
+	if (curr->children.slots == NULL
+			&& !hash_init (&curr->children, child_info_hash, child_info_less,
+				NULL))
+		return NULL;
+	info = kmem_cache_alloc (child_info_slab);
+	if (info != NULL) {
+		info->tid = TID_ERROR;
+		info->exit_status = 0;
+		info->started = false;
+		sema_init (&info->fork_sema, 0);
+		sema_init (&info->exit_sema, 0);
+		info->ref_cnt = 2;
+		info->parent = curr;
+	}
+	return info;
+}
+
+/* Adds INFO, made by process_child_info_create(), to the current
+ * thread's children as that of the new thread CHILD.  CHILD owns the
+ * semaphores the parent waits on for it, so that the parent donates
+ * its priority to CHILD while it waits. */
+void
+process_add_child (struct child_info *info, struct thread *child) {
+	info->tid = child->tid;
+	hash_insert (&thread_current ()->children, &info->elem);
+	sema_set_owner (&info->fork_sema, child);
+	sema_set_owner (&info->exit_sema, child);
+}
+
+/* Drops a reference to INFO, freeing it with the last one.  The
+ * parent and the child may drop theirs at the same time. */
+static void
+child_info_release (struct child_info *info) {
+	enum intr_level old_level = intr_disable ();
+	bool last = --info->ref_cnt == 0;
+
+	intr_set_level (old_level);
+	if (last)
+		kmem_cache_free (child_info_slab, info);
+}
 
 /* General process initializer for initd and other process. */
 static void
@@ -76,44 +183,287 @@ initd (void *f_name) {
 	NOT_REACHED ();
 }
 
+/* process_fork()이 새 thread에 넘기는 인자
+	- child가 처음 실행되는 시점에는 parent의 register 상태가 fork가 요청된 시점과 다를 수 있으므로,
+	  fork가 요청된 시점의 상태를 보관해두었다가 child가 본인의 reg로 가져감
+	- fork 동안에만 필요하므로 struct thread가 아닌 malloc으로 할당: parent는 child가 복사를
+	  마칠 때까지 기다린 뒤 해제 */
+struct fork_aux {
+	struct thread *parent;
+	struct intr_frame if_;      /* fork가 요청된 시점의 parent register 상태 */
+	uint64_t retval;            /* child에서 system call의 return value */
+	struct template *template;  /* child가 template으로 남는다면 그 template */
+};
+
+/* process template: 초기화를 마친 process를 얼려둔 것
+	- template_create를 부른 process를 fork한 child가 user mode로 돌아가지 않고 kernel에서 잠든 채로 남음
+	- template_spawn은 load나 초기화 코드 없이 이 child를 다시 fork해서 worker를 만듦 (주소 공간은 COW로 공유)
+	- worker는 template_spawn을 부른 thread의 child가 되고, template_create에서 1을 반환받은 것처럼 시작함
+	- template의 thread는 template_destroy가 STOP을 up하면 종료됨
+ */
+struct template {
+	char name[16];
+	struct thread *leader;      /* 잠들어 있는 template process */
+	struct intr_frame if_;      /* worker가 시작할 register 상태 */
+	struct lock lock;           /* worker를 복사하는 동안 잡음: destroy가 기다림 */
+	struct semaphore stop;      /* template_destroy가 up */
+	struct list_elem elem;      /* templates에 연결되는 노드 */
+};
+
+/* 이름이 있는 template들: templates_lock으로 보호 */
+static struct list templates;
+static struct lock templates_lock;
+
+static tid_t fork_from (const char *name, struct thread *parent,
+		const struct intr_frame *if_, uint64_t retval, struct template *);
+static struct template *template_find (const char *name);
+
 /* Clones the current process as `name`. Returns the new process's thread id, or
  * TID_ERROR if the thread cannot be created. */
 tid_t
 process_fork (const char *name, struct intr_frame *if_) {
 	/* Clone current thread to new thread.*/
-	// parent(현재 thread)의 상태를 parent_if에 보관 (나중에 child가 사용할 것)
-	struct thread *curr = thread_current();
-	memcpy(&curr->parent_if, if_, sizeof(struct intr_frame));
-	// child thread 생성 (child thread가 수행할 __do_fork와 그 함수에 전달할 인자 curr)
-	tid_t child_tid = thread_create (name, PRI_DEFAULT, __do_fork, curr);
-	if (child_tid == TID_ERROR)
+	/* 주소 공간과 fd는 process의 leader에게서 복사 (register 상태는 현재 thread의 것) */
+	return fork_from (name, thread_leader (), if_, 0, NULL);
+}
+
+/* PARENT process를 NAME으로 복사한 child를 현재 thread의 child로 만들기
+	- child는 IF_의 register 상태에서 system call이 RETVAL을 반환한 것처럼 시작함
+	- TEMPLATE이 NULL이 아니면 child는 user mode로 돌아가지 않고 TEMPLATE으로 남음
+	- child가 복사를 마칠 때까지 기다렸다가, 실패하면 child를 회수하고 TID_ERROR 반환
+ */
+static tid_t
+fork_from (const char *name, struct thread *parent,
+		const struct intr_frame *if_, uint64_t retval,
+		struct template *template) {
+	// parent의 상태를 fork_aux에 보관 (나중에 child가 사용할 것)
+	struct fork_aux *aux = malloc (sizeof *aux);
+	if (aux == NULL)
 		return TID_ERROR;
-	// child_tid 로 thread 가져오기 (이 때는 NULL일 수 없음)
-	struct thread *child = get_child_process(child_tid);
+	aux->parent = parent;
+	memcpy (&aux->if_, if_, sizeof (struct intr_frame));
+	aux->retval = retval;
+	aux->template = template;
+	// child thread 생성 (child thread가 수행할 __do_fork와 그 함수에 전달할 인자 aux)
+	tid_t child_tid = thread_create (name, PRI_DEFAULT, __do_fork, aux);
+	if (child_tid == TID_ERROR) {
+		free (aux);
+		return TID_ERROR;
+	}
+	// child_tid 로 child의 종료 정보 가져오기 (이 때는 NULL일 수 없음)
+	struct child_info *child = get_child_process(child_tid);
 
-	// child가 생성 완료될 때까지 대기
+	// child가 생성 완료될 때까지 대기: 이후 child는 AUX를 쓰지 않음
 	sema_down(&child->fork_sema);
-	// child 생성 중에 오류가 발생하지는 않았는지 체크
-	if (child->exit_status == -1) // TODO: __do_fork에서 exit_status를 변경하기
+	free (aux);
+	// child 생성 중에 오류가 발생하지는 않았는지 체크: 실패한 child는 바로 회수
+	if (!child->started) {
+		process_wait (child_tid);
 		return TID_ERROR;
+	}
 
 	return child_tid;
 }
 
-/* children list에서 특정 child thread의 주소값 가져오기 */
-struct thread *get_child_process(tid_t child_tid) {
-	struct thread *curr = thread_current();
-	struct thread *child;
-	struct list *children = &curr->children;
+/* template 목록 초기화: 첫 template_create 전에 불려야 함 */
+void
+process_template_init (void) {
+	list_init (&templates);
+	lock_init (&templates_lock);
+}
+
+/* 이름이 NAME인 template 찾기: templates_lock을 잡은 채로 불러야 함 */
+static struct template *
+template_find (const char *name) {
 	struct list_elem *e;
-	for (e = list_begin(children); e != list_end(children); e = list_next(e)) {
-		child = list_entry(e, struct thread, child_elem);
-		if (child->tid == child_tid) {
-			return child; 
-		}
+
+	ASSERT (lock_held_by_current_thread (&templates_lock));
+	for (e = list_begin (&templates); e != list_end (&templates); e = list_next (e)) {
+		struct template *t = list_entry (e, struct template, elem);
+		if (!strcmp (t->name, name))
+			return t;
 	}
 	return NULL;
+}
+
+/* 현재 process를 얼린 template NAME 만들기 (struct template 참고)
+	- IF_는 template_create가 요청된 시점의 register 상태: worker는 여기서 1을 반환받음
+	- 성공하면 0, 같은 이름의 template이 있거나 메모리가 모자라면 -1 반환
+ */
+int
+process_template_create (const char *name, struct intr_frame *if_) {
+	struct template *t = malloc (sizeof *t);
+	if (t == NULL)
+		return -1;
+	strlcpy (t->name, name, sizeof t->name);
+	lock_init (&t->lock);
+	sema_init (&t->stop, 0);
+
+	/* 실패한 child는 T를 등록하지 않았으므로 여기서 해제 */
+	if (fork_from (t->name, thread_leader (), if_, 0, t) == TID_ERROR) {
+		free (t);
+		return -1;
+	}
+	return 0;
+}
+
+/* template NAME에서 worker를 복제해 현재 thread의 child로 만들기
+	- load도 초기화 코드도 다시 실행하지 않음: fork처럼 주소 공간과 fd를 template에게서 복사
+	- worker의 thread id, template이 없거나 복사에 실패하면 TID_ERROR 반환
+ */
+tid_t
+process_template_spawn (const char *name) {
+	struct template *t;
+	tid_t tid;
+
+	lock_acquire (&templates_lock);
+	t = template_find (name);
+	if (t == NULL) {
+		lock_release (&templates_lock);
+		return TID_ERROR;
+	}
+	/* T->lock을 잡은 동안에는 destroy되지 않음 */
+	lock_acquire (&t->lock);
+	lock_release (&templates_lock);
+	tid = fork_from (t->name, t->leader, &t->if_, 1, NULL);
+	lock_release (&t->lock);
+	return tid;
+}
+
+/* template NAME을 없애고 그 process를 종료시키기: 없으면 false 반환
+	- 이미 만들어진 worker는 영향을 받지 않음 */
+bool
+process_template_destroy (const char *name) {
+	struct template *t;
+
+	lock_acquire (&templates_lock);
+	t = template_find (name);
+	if (t != NULL)
+		list_remove (&t->elem);
+	lock_release (&templates_lock);
+	if (t == NULL)
+		return false;
 
+	/* 복사 중인 worker가 있다면 끝날 때까지 기다린 뒤 깨움: T는 template이 해제 */
+	lock_acquire (&t->lock);
+	lock_release (&t->lock);
+	sema_up (&t->stop);
+	return true;
+}
+
+/* process_spawn()이 새 thread에 넘기는 인자 */
+struct spawn_aux {
+	struct thread *parent;
+	char *cmd_line;             /* palloc으로 생성된 page: child가 해제 */
+	const int *fds;             /* inherit_fds 참고 */
+	int fd_cnt;
+};
+
+/* CMD_LINE을 실행하는 새 process 만들기: fork + exec와 같지만 주소 공간을 복사하지 않음
+	- CMD_LINE은 palloc으로 생성된 page이며 성공 여부와 관계없이 해제됨
+	- child의 fd는 FDS와 FD_CNT에 따라 parent에게서 물려받음 (inherit_fds 참고)
+	- child가 load를 마칠 때까지 기다렸다가, 실패하면 child를 회수하고 TID_ERROR 반환
+ */
+tid_t
+process_spawn (char *cmd_line, const int *fds, int fd_cnt) {
+	struct spawn_aux aux = {thread_leader (), cmd_line, fds, fd_cnt};
+	char name[16];
+	char *save_ptr;
+
+	/* 새로 생성되는 thread의 이름을 실행하려는 프로그램명으로 */
+	strlcpy (name, cmd_line, sizeof name);
+	strtok_r (name, " ", &save_ptr);
+
+	tid_t child_tid = thread_create (name, PRI_DEFAULT, __do_spawn, &aux);
+	if (child_tid == TID_ERROR) {
+		palloc_free_page (cmd_line);
+		return TID_ERROR;
+	}
+	struct child_info *child = get_child_process(child_tid);
+
+	// child가 load를 마칠 때까지 대기
+	sema_down(&child->fork_sema);
+	if (!child->started) {
+		process_wait (child_tid);
+		return TID_ERROR;
+	}
+	return child_tid;
+}
+
+/* process_uthread_create()가 새 thread에 넘기는 인자: 새 thread가 해제 */
+struct uthread_aux {
+	struct thread *leader;
+	struct intr_frame if_;      /* 새 thread가 user mode로 시작할 register 상태 */
+};
+
+/* 현재 process에 ENTRY (ARG0, ARG1)을 user stack의 꼭대기 STACK에서 실행하는 thread 만들기
+	- 새 thread는 process의 leader가 가진 주소 공간, fd, I/O ring을 함께 씀 (thread_leader)
+	- 현재 thread의 child로 등록되므로 wait으로 종료 상태를 받을 수 있음
+	- leader의 thread_cnt는 thread를 만들기 전에 늘려, leader가 먼저 종료되더라도
+	  새 thread가 끝날 때까지 주소 공간을 정리하지 않게 함 (process_exit 참고)
+ */
+tid_t
+process_uthread_create (void *entry, uint64_t arg0, uint64_t arg1, void *stack) {
+	struct thread *leader = thread_leader ();
+	struct uthread_aux *aux = malloc (sizeof *aux);
+	enum intr_level old_level;
+	tid_t tid;
+
+	if (aux == NULL)
+		return TID_ERROR;
+	aux->leader = leader;
+	memset (&aux->if_, 0, sizeof aux->if_);
+	aux->if_.ds = aux->if_.es = aux->if_.ss = SEL_UDSEG;
+	aux->if_.cs = SEL_UCSEG;
+	aux->if_.eflags = FLAG_IF | FLAG_MBS;
+	aux->if_.rip = (uintptr_t) entry;
+	aux->if_.R.rdi = arg0;
+	aux->if_.R.rsi = arg1;
+	/* ENTRY가 call된 직후처럼: return 주소 자리를 비운 16 byte 정렬 */
+	aux->if_.rsp = ((uintptr_t) stack & ~(uintptr_t) 0xf) - sizeof (void *);
+
+	old_level = intr_disable ();
+	leader->thread_cnt++;
+	intr_set_level (old_level);
+	tid = thread_create (thread_name (), PRI_DEFAULT, __do_uthread, aux);
+	if (tid == TID_ERROR) {
+		old_level = intr_disable ();
+		leader->thread_cnt--;
+		sema_up (&leader->threads_exited);
+		intr_set_level (old_level);
+		free (aux);
+	}
+	return tid;
+}
+
+/* children에서 특정 child의 종료 정보 가져오기: tid로 hash table 검색 */
+static struct child_info *get_child_process(tid_t child_tid) {
+	struct thread *curr = thread_current();
+	struct child_info key;
+	struct hash_elem *e;
+
+	if (curr->children.slots == NULL)
+		return NULL;
+	key.tid = child_tid;
+	e = hash_find(&curr->children, &key.elem);
+	return e != NULL ? hash_entry(e, struct child_info, elem) : NULL;
+}
+
+/* 종료된 CHILD를 회수: children과 exited_children에서 제거하고 reference 반납
+	- exit_status 반환
+	- child의 thread page는 이미 해제되었거나 곧 해제됨
+*/
+static int reap_child(struct child_info *child) {
+	struct thread *curr = thread_current();
+	int exit_status = child->exit_status;
+	enum intr_level old_level;
+
+	hash_delete(&curr->children, &child->elem);
+	old_level = intr_disable();
+	list_remove(&child->exit_elem);
+	intr_set_level(old_level);
+	child_info_release(child);
+	return exit_status;
 }
 
 #ifndef VM
@@ -149,7 +499,7 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	/* 4. TODO: Duplicate parent's page to the new page and
 	 *    TODO: check whether parent's page is writable or not (set WRITABLE
 	 *    TODO: according to the result). */
-	memcpy (newpage, parent_page, PGSIZE);
+	copy_page (newpage, parent_page);
 	writable = is_writable(pte);
 
 	/* 5. Add new page to child's page table at address VA with WRITABLE
@@ -164,23 +514,76 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 }
 #endif
 
+/* 현재 process(child)의 fd를 PARENT에게서 물려받기
+	- FDS가 NULL이면 fork처럼 PARENT의 fd를 모두 같은 번호로
+	- 아니면 FD_CNT개의 fd i가 PARENT의 fd FDS[i]를 가리킴 (FDS[i]가 -1이면 닫힌 채로)
+	- file은 duplicate하여 위치를 따로 가짐: PARENT에서 공유된 file은 child에서도 공유
+	- 메모리가 모자라면 false 반환 (물려받은 fd는 process_exit에서 닫힘)
+ */
+static bool
+inherit_fds (struct thread *parent, const int *fds, int fd_cnt) {
+	struct thread *current = thread_current ();
+	int cnt = fds != NULL ? fd_cnt : parent->max_fd + 1;
+
+	if (!process_grow_fdt (cnt)) {
+		return false;
+	}
+	for (int i = 0; i < cnt; i++) {
+		int src = fds != NULL ? fds[i] : i;
+		struct file *orig_file = src >= 0 && src < (int) parent->fdt_cnt ? parent->fdt[src] : NULL;
+		struct file *file = NULL;
+
+		if (orig_file == NULL || orig_file == FDT_STDIN || orig_file == FDT_STDOUT) {
+			file = orig_file;
+		} else {
+			/* 공유된 file은 앞에서 이미 duplicate한 것을 공유 (공유되지 않은 file은 찾지 않음) */
+			if (fds != NULL || file_is_shared (orig_file)) {
+				for (int j = 0; j < i && file == NULL; j++) {
+					int prev = fds != NULL ? fds[j] : j;
+					if (prev >= 0 && prev < (int) parent->fdt_cnt
+							&& parent->fdt[prev] == orig_file && current->fdt[j] != NULL) {
+						file = file_dup (current->fdt[j]);
+					}
+				}
+			}
+			if (file == NULL) {
+				file = file_duplicate (orig_file);
+			}
+			if (file == NULL) {
+				return false;
+			}
+		}
+
+		current->fdt[i] = file;
+		if (file != NULL) {
+			current->fdt_map[i / 64] |= (uint64_t) 1 << (i % 64);
+			if (i > current->max_fd) {
+				current->max_fd = i;
+			}
+		} else if (i >= 2) {
+			current->fdt_map[i / 64] &= ~((uint64_t) 1 << (i % 64));
+		}
+	}
+	return true;
+}
+
 /* A thread function that copies parent's execution context.
- * Hint) parent->tf does not hold the userland context of the process.
+ * Hint) parent's struct thread does not hold the userland context of the process.
  *       That is, you are required to pass second argument of process_fork to
  *       this function. */
 static void
-__do_fork (void *aux) {
+__do_fork (void *aux_) {
+	struct fork_aux *aux = aux_;
 	struct intr_frame if_;
-	struct thread *parent = (struct thread *) aux;
+	struct thread *parent = aux->parent;
 	struct thread *current = thread_current ();
-	/* TODO: somehow pass the parent_if. (i.e. process_fork()'s if_) */
-	struct intr_frame *parent_if;
-	parent_if = &parent->parent_if;	
+	struct intr_frame *parent_if = &aux->if_;
+	struct template *template = aux->template;
 	bool succ = true;
 
 	/* 1. Read the cpu context to local stack. */
 	memcpy (&if_, parent_if, sizeof (struct intr_frame));
-	if_.R.rax = 0; // syscall fork's return value for child process
+	if_.R.rax = aux->retval; // syscall fork's return value for child process
 
 	/* 2. Duplicate PT */
 	current->pml4 = pml4_create();
@@ -190,59 +593,124 @@ __do_fork (void *aux) {
 	process_activate (current);
 #ifdef VM
 	supplemental_page_table_init (&current->spt);
-	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
+	/* parent의 다른 thread가 복사 중에 주소 공간을 바꾸지 않도록 */
+	lock_acquire (&parent->spt.lock);
+	succ = supplemental_page_table_copy (&current->spt, &parent->spt);
+	io_ring_fork (current, parent);
+	lock_release (&parent->spt.lock);
+	if (!succ)
 		goto error;
 #else
 	if (!pml4_for_each (parent->pml4, duplicate_pte, parent))
 		goto error;
 #endif
+	/* parent의 FPU/SSE 레지스터 상태도 복사 */
+	if (!fpu_copy (parent))
+		goto error;
 
 	/* TODO: Your code goes here.
 	 * TODO: Hint) To duplicate the file object, use `file_duplicate`
 	 * TODO:       in include/filesys/file.h. Note that parent should not return
 	 * TODO:       from the fork() until this function successfully duplicates
 	 * TODO:       the resources of parent.
-	 * 부모의 file descriptor table을 복사
-	 * 이 때, thread_create에서 fdt와 next_fd는 초기화가 된 상태
-	 * 그러므로 parent의 fdt와 next_fd를 가져와 붙여주어야 함
+	 * 부모의 file descriptor table을 함께 쓰기
+	 * 파일마다 file_duplicate하지 않고 process_share_fdt로 FDT를 함께 가리키기만 함
+	 * 어느 쪽이든 FDT를 바꾸거나 파일을 처음 쓸 때 그 process의 FDT와 file이 복사됨 (userprog/syscall.c)
 	 * */
 
 	// multi-oom 통과를 위해 아래 라인이 추가되어야 함. 왜?
-	if (parent->next_fd == FDT_ENTRY_MAX) {
-		// printf("[__do_fork] max fail.. why??\n");
+	lock_acquire (&parent->fdt_lock);
+	succ = process_next_fd (parent) < FDT_ENTRY_MAX && process_share_fdt (parent, current);
+	lock_release (&parent->fdt_lock);
+	if (!succ) {
 		goto error;
 	}
 
-	// next_fd, max_fd 가져오기
-	current->next_fd = parent->next_fd;	
-	current->max_fd = parent->max_fd;	
-
-	// fdt 가져오기: parent fdt의 file들을 current fdt에서 duplicate (아직 dup 를 고려하지 않음)
-	struct file *orig_file;
-	for (int i = 0; i <= parent->max_fd; i++) {
-		orig_file = parent->fdt[i];
-		if (i < 2) {
-			current->fdt[i] = orig_file;			
-		} else if (orig_file != NULL) {
-			current->fdt[i] = (struct file*) file_duplicate(orig_file);
+	process_init ();
+
+	/* template으로 남는다면 이름을 등록: 같은 이름이 이미 있으면 실패 */
+	if (template != NULL) {
+		lock_acquire (&templates_lock);
+		succ = template_find (template->name) == NULL;
+		if (succ) {
+			template->leader = current;
+			template->if_ = if_;
+			template->if_.R.rax = 1;
+			list_push_back (&templates, &template->elem);
 		}
+		lock_release (&templates_lock);
+		if (!succ)
+			goto error;
 	}
 
-
-	process_init ();
-
 	/* child process가 생성 완료되었음을 parent에게 전달 */
-	sema_up(&current->fork_sema);
+	current->child_info->started = true;
+	sema_up(&current->child_info->fork_sema);
+
+	/* template은 destroy될 때까지 잠들었다가 종료: 주소 공간은 process_exit에서 정리 */
+	if (template != NULL) {
+		sema_down (&template->stop);
+		free (template);
+		current->exit_status = 0;
+		return;
+	}
 
 	/* Finally, switch to the newly created process. */
 	if (succ)
 		do_iret (&if_);
 error:
 	current->exit_status = TID_ERROR;
-	sema_up(&current->fork_sema);
+	sema_up(&current->child_info->fork_sema);
 	// thread_exit (); // thread_handler가 실행 종료되면, thread_exit()이 kernel_thread에서 실행됨 
 }
 
+/* A thread function that runs a thread of AUX's leader's process in
+ * user mode, for process_uthread_create(). */
+static void
+__do_uthread (void *aux_) {
+	struct uthread_aux *aux = aux_;
+	struct thread *current = thread_current ();
+	struct intr_frame if_ = aux->if_;
+
+	current->leader = aux->leader;
+	current->pml4 = aux->leader->pml4;
+	free (aux);
+	process_activate (current);
+	do_iret (&if_);
+}
+
+/* A thread function that loads a new process for process_spawn(),
+ * whose arguments AUX points to, into a fresh address space. */
+static void
+__do_spawn (void *aux_) {
+	struct spawn_aux *aux = aux_;
+	struct thread *current = thread_current ();
+	struct intr_frame if_;
+	bool success;
+
+	if_.ds = if_.es = if_.ss = SEL_UDSEG;
+	if_.cs = SEL_UCSEG;
+	if_.eflags = FLAG_IF | FLAG_MBS;
+
+#ifdef VM
+	supplemental_page_table_init (&current->spt);
+#endif
+	process_init ();
+	lock_acquire (&aux->parent->fdt_lock);
+	success = inherit_fds (aux->parent, aux->fds, aux->fd_cnt);
+	lock_release (&aux->parent->fdt_lock);
+	success = success && load (aux->cmd_line, &if_);
+	palloc_free_page (aux->cmd_line);
+
+	/* parent에게 load 결과를 전달: 이후 AUX는 사라질 수 있음 */
+	if (!success)
+		current->exit_status = TID_ERROR;
+	current->child_info->started = success;
+	sema_up (&current->child_info->fork_sema);
+	if (success)
+		do_iret (&if_);
+}
+
 /* Switch the current execution context to the f_name.
  * Returns -1 on fail. 
 	initd에서도 process_exec를 사용하고 있으므로, initd에서 활용하는 방식과 통일되어야 함
@@ -266,6 +734,8 @@ process_exec (void *f_name) {
 	/* We first kill the current context */
 	//printf("\n\nprocess_exec 입니다. process_cleanup 진입 전입니다.\n\n");
 	process_cleanup ();
+	io_ring_reset (thread_current ());
+	fpu_release ();
 	//printf("\n\nsupplemental_page_table_init 진입 전입니다.\n\n");
 	supplemental_page_table_init (&thread_current () -> spt);
 	// printf("[process_exec] before load: %s\n", file_name);
@@ -273,8 +743,11 @@ process_exec (void *f_name) {
 	//printf("\n\n load 진입 전입니다.\n\n");
 	success = load (file_name, &_if);
 	// printf("[process_exec] after load %d\n", success);
-	/* If load failed, quit. */
-	palloc_free_page (file_name);
+	/* If load failed, quit.
+		- exec()의 FILE_NAME은 scratch arena에 있음 (copy_in_string): syscall_handler로 돌아가지 않으므로 여기서 arena를 비움 */
+	if (!scratch_owns (file_name))
+		palloc_free_page (file_name);
+	scratch_reset ();
 	if (!success)
 		return -1;
 	/* Start switched process. */
@@ -297,25 +770,62 @@ process_wait (tid_t child_tid) {
 	 * XXX:       to add infinite loop here before
 	 * XXX:       implementing the process_wait. */
 
-	/* child_tid가 현재 thread의 자식인지 확인 */
-	struct thread *child;
+	/* child_tid가 현재 thread의 자식인지 확인
+		- 이미 wait한 child는 children에 없음
+	*/
+	struct child_info *child;
 	child = get_child_process(child_tid);
 	if (child == NULL)
 		return TID_ERROR;
-	/* 이미 child_tid를 wait하는 상태인지 확인 */
-	if (list_size(&child->wait_sema.waiters) != 0)
-		return TID_ERROR;
-	/* child의 wait_sema를 down하여 대기 상태로 진입 */
-	sema_down(&child->wait_sema);
-	/* child의 exit_status 확인 */
-	int exit_status = child->exit_status;
-	/* current의 children에서 child 제거 */
-	list_remove(&child->child_elem);
-	/* child의 free_sema를 up시켜 child가 회수 완료되었음을 알림
-		- thread_exit() 등의 작업은 free_sema를 획득한 child에서 마저 처리됨
-	 */
-	sema_up(&child->free_sema);
-	return exit_status;
+	/* child의 exit_sema를 down하여 child가 종료될 때까지 대기 */
+	sema_down(&child->exit_sema);
+	/* child의 exit_status 확인한 뒤 회수 */
+	return reap_child(child);
+}
+
+/* 자식 중 가장 먼저 종료된 것을 기다려 회수하고 그 tid 반환
+	- STATUS가 NULL이 아니면 *STATUS에 exit_status 저장
+	- 기다릴 자식이 없으면 곧바로 TID_ERROR 반환
+	- child_exit_sema는 종료된 자식마다 한 번 up되며, process_wait가 먼저 회수한 자식 몫은 건너뜀
+*/
+tid_t
+process_wait_any (int *status) {
+	struct thread *curr = thread_current();
+
+	for (;;) {
+		struct child_info *child = NULL;
+		enum intr_level old_level;
+
+		if (curr->children.slots == NULL || hash_empty(&curr->children))
+			return TID_ERROR;
+		sema_down(&curr->child_exit_sema);
+		old_level = intr_disable();
+		if (!list_empty(&curr->exited_children))
+			child = list_entry(list_front(&curr->exited_children),
+					struct child_info, exit_elem);
+		intr_set_level(old_level);
+		if (child != NULL) {
+			tid_t tid = child->tid;
+			int exit_status = reap_child(child);
+
+			if (status != NULL)
+				*status = exit_status;
+			return tid;
+		}
+	}
+}
+
+/* 종료하는 parent가 회수하지 않은 child의 종료 정보를 놓음
+	- child가 종료 시 parent의 exited_children을 건드리지 않도록 parent를 NULL로
+*/
+static void
+orphan_child (struct hash_elem *e, void *aux UNUSED) {
+	struct child_info *child = hash_entry(e, struct child_info, elem);
+	enum intr_level old_level = intr_disable();
+
+	child->parent = NULL;
+	intr_set_level(old_level);
+	child_info_release(child);
 }
 
 /* Exit the process. This function is called by thread_exit (). 
@@ -324,36 +834,191 @@ process_wait (tid_t child_tid) {
 void
 process_exit (void) {
 	struct thread *curr = thread_current ();
+	bool reap = false;
 	/* TODO: Your code goes here.
 	 * TODO: Implement process termination message (see
 	 * TODO: project2/process_termination.html).
 	 * TODO: We recommend you to implement process resource cleanup here. */
-	// fdt에서 열려있는 파일 닫기
-	struct file *file;
-	for (int fd = 0; fd <= curr->max_fd; fd++) {
-		_close(fd);
-
-		// file = curr->fdt[i];
-		// if (i < 2) {
-		// 	curr->fdt[i] = NULL; // TODO			
-		// } else {
-		// 	file_close(file);
-		// }
+	/* process의 자원은 leader가 정리: uthread_create로 만든 thread는 자원을 함께 쓰기만 하므로,
+		leader는 그 thread들이 모두 종료될 때까지 기다림 */
+	if (curr->leader == curr) {
+		process_wait_threads (curr);
+		// fork한 process와 함께 쓰던 fdt는 놓기만 하고, 남은 파일 닫기
+		struct file *file;
+		lock_acquire (&curr->fdt_lock);
+		process_release_fdt (curr);
+		lock_release (&curr->fdt_lock);
+		for (int fd = 0; fd <= curr->max_fd; fd++) {
+			_close(fd);
+
+			// file = curr->fdt[i];
+			// if (i < 2) {
+			// 	curr->fdt[i] = NULL; // TODO			
+			// } else {
+			// 	file_close(file);
+			// }
+		}
+		// fdt에 할당된 kernel 영역의 메모리 회수하기
+		process_free_fdt (curr);
+#ifdef VM
+		/* The parent may read the mapped files once it has the status. */
+		supplemental_page_table_unmap (&curr->spt);
+#endif
+		reap = process_reap_begin (curr);
+		if (!reap) {
+			/* Tear down the address space first: its text pages may be
+			 * shared through the VM text cache, which names executables
+			 * by inode sector and so needs the inode kept open while they
+			 * are mapped. */
+			process_cleanup ();
+			// 실행 중이던 파일이 있다면 종료하기
+			file_close(curr->running_file);
+		} else if (curr->running_file != NULL) {
+			/* The parent may write the executable once it has the
+			 * status, while the text pages are still mapped: keep them
+			 * from being shared from then on.  The file stays open
+			 * until process_reap(), for the text cache's sake. */
+#ifdef VM
+			vm_text_forget (inode_get_inumber (
+						file_get_inode (curr->running_file)));
+#endif
+			file_allow_write (curr->running_file);
+		}
 	}
-	// fdt에 할당된 kernel 영역의 메모리 회수하기
-	palloc_free_multiple(curr->fdt, FDT_PAGE_CNT);
-	// 실행 중이던 파일이 있다면 종료하기
-	file_close(curr->running_file);
 
-	process_cleanup ();
+	/* 아직 wait하지 않은 children의 종료 정보 reference 반납 */
+	if (curr->children.slots != NULL)
+		hash_destroy(&curr->children, orphan_child);
 
-	/* parent가 현재 thread를 wait하고 있었다면, 종료되었음을 알림 
+	/* 종료 정보를 남기고, parent가 현재 thread를 wait하고 있었다면 종료되었음을 알림
 		- parent가 wait을 걸기 전에 child가 먼저 종료되었을 수도 있음
-	*/ 
-	sema_up(&curr->wait_sema);
-	/* parent가 현재 thread를 회수할 때까지 thread_exit하지 않고 기다림 (exit_status를 전달하기 위함) */
-	sema_down(&curr->free_sema);
-	/* parent가 회수한 뒤 thread_exit의 남은 부분이 실행됨 */
+		- parent가 살아 있다면 parent의 exited_children에 추가 (wait_any에서 사용)
+		- parent를 기다리지 않고 곧바로 thread_exit의 남은 부분이 실행됨
+	*/
+	struct child_info *info = curr->child_info;
+	if (info != NULL) {
+		enum intr_level old_level = intr_disable();
+		info->exit_status = curr->exit_status;
+		if (info->parent != NULL) {
+			list_push_back(&info->parent->exited_children, &info->exit_elem);
+			sema_up(&info->parent->child_exit_sema);
+		}
+		intr_set_level(old_level);
+		// fork_sema를 up하지 않는 kernel thread도 있으므로, 종료하기 전에 owner에서 물러남
+		sema_set_owner (&info->fork_sema, NULL);
+		sema_up(&info->exit_sema);
+		child_info_release(info);
+		curr->child_info = NULL;
+	}
+	if (curr->leader != curr)
+		process_leave (curr);
+	if (reap)
+		process_reap (curr);
+}
+
+/* Kills the process LEADER leads: each of its threads exits with
+ * status -1 the next time it heads back to user mode, a thread
+ * blocked in the kernel once it wakes up. */
+void
+process_kill (struct thread *leader) {
+	ASSERT (leader->leader == leader);
+	leader->killed = true;
+}
+
+/* Exits with status -1 if the current thread's process was killed.
+ * Called on the way back to user mode. */
+void
+process_exit_if_killed (void) {
+	if (thread_leader ()->killed)
+		_exit (-1);
+}
+
+/* LEADER가 자기 process의 다른 thread들이 모두 종료될 때까지 기다림
+	- 그 thread들은 LEADER의 주소 공간과 fd를 쓰고 있으므로, 그동안 정리하면 안 됨
+*/
+static void
+process_wait_threads (struct thread *leader) {
+	enum intr_level old_level = intr_disable ();
+
+	while (leader->thread_cnt > 1)
+		sema_down (&leader->threads_exited);
+	intr_set_level (old_level);
+}
+
+/* uthread_create로 만든 CURR가 process에서 빠짐: 이후 leader가 주소 공간을 정리할 수 있음
+	- leader가 pml4를 해제하기 전에 CURR는 그것을 쓰지 않아야 하므로 먼저 kernel 것으로 전환
+	- thread_cnt를 줄인 뒤에는 leader가 사라질 수 있으므로 건드리지 않음
+*/
+static void
+process_leave (struct thread *curr) {
+	struct thread *leader = curr->leader;
+	enum intr_level old_level = intr_disable ();
+
+	curr->pml4 = NULL;
+	pml4_activate (NULL);
+	curr->leader = curr;
+	leader->thread_cnt--;
+	sema_up (&leader->threads_exited);
+	intr_set_level (old_level);
+}
+
+/* Returns true if CURR, an exiting process, may leave its teardown
+ * for process_reap() after its exit status is out, counting it among
+ * those reaping if so. */
+static bool
+process_reap_begin (struct thread *curr) {
+	enum intr_level old_level;
+	bool defer;
+
+	if (curr->pml4 == NULL)
+		return false;
+	old_level = intr_disable ();
+	defer = reaping < REAP_MAX;
+	if (defer)
+		reaping++;
+	intr_set_level (old_level);
+	return defer;
+}
+
+/* Tears down CURR, whose exit status is out, at the lowest priority,
+ * as process_exit() would have before publishing it. */
+static void
+process_reap (struct thread *curr) {
+	enum intr_level old_level;
+
+	if (thread_mlfqs)
+		thread_set_nice (NICE_MAX);
+	else
+		thread_set_priority (PRI_MIN);
+	process_cleanup ();
+	file_close (curr->running_file);
+	curr->running_file = NULL;
+
+	old_level = intr_disable ();
+	ASSERT (reaping > 0);
+	reaping--;
+	reaped++;
+	intr_set_level (old_level);
+}
+
+/* Returns true if any exited process is still tearing down. */
+bool
+process_reaping (void) {
+	return reaping > 0;
+}
+
+/* Waits for the exited processes still tearing down to finish. */
+void
+process_reap_flush (void) {
+	while (process_reaping ())
+		timer_sleep (1);
+}
+
+/* Prints how many exits left their teardown to after their exit
+ * status was out. */
+void
+process_print_reap_stats (void) {
+	printf ("Process: %llu teardowns after exit\n", reaped);
 }
 
 /* Free the current process's resources. */
@@ -447,8 +1112,24 @@ struct ELF64_PHDR {
 #define ELF ELF64_hdr
 #define Phdr ELF64_PHDR
 
-static bool setup_stack (struct intr_frame *if_);
+/* Most stack pages load() maps up front: the process's stack limit
+ * under VM, which stack growth enforces. */
+#ifdef VM
+#define STACK_PAGE_MAX (thread_current ()->stack_limit / PGSIZE)
+#else
+#define STACK_PAGE_MAX ((1 << 20) / PGSIZE)
+#endif
+
+/* Stack pages mapped for each new process, unless its PT_STACK or
+ * arguments ask for more.  Set with -stk on the kernel command line. */
+size_t process_stack_pages = 1;
+
+static bool setup_stack (struct intr_frame *if_, size_t page_cnt);
+static size_t argv_block_size (char **argv, int argc);
 static bool validate_segment (const struct Phdr *, struct file *);
+static bool read_image (struct file *, const char *file_name,
+		struct exec_image *, bool load);
+static bool load_image (struct file *, const struct exec_image *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
 		bool writable);
@@ -460,11 +1141,12 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 load (const char *file_name, struct intr_frame *if_) {
 	struct thread *t = thread_current ();
-	struct ELF ehdr;
+	struct exec_image image;
 	struct file *file = NULL;
-	off_t file_ofs;
+	disk_sector_t sector;
+	uint64_t gen;
+	size_t stack_pages;
 	bool success = false;
-	int i;
 
 	/* Allocate and activate page directory. */
 	t->pml4 = pml4_create ();
@@ -499,8 +1181,63 @@ load (const char *file_name, struct intr_frame *if_) {
 	t->running_file = file;
 	file_deny_write(file);
 
+	/* Load FILE's segments.  Its headers need only be read and
+	 * validated if the exec cache does not have them. */
+	sector = inode_get_inumber (file_get_inode (file));
+	if (exec_cache_lookup (sector, &image, &gen)) {
+		if (!load_image (file, &image))
+			goto done;
+	} else {
+		if (!read_image (file, file_name, &image, true))
+			goto done;
+		if (image.segment_cnt <= EXEC_SEGMENT_MAX)
+			exec_cache_insert (sector, &image, gen);
+	}
+#ifdef VM
+	/* The heap starts out empty, right after the segments. */
+	vm_heap_init ((void *) image.end);
+#endif
+
+	/* Set up stack, mapping the pages asked for up front, and at least
+	 * enough for the arguments. */
+	stack_pages = process_stack_pages;
+	if (DIV_ROUND_UP (image.stack_size, PGSIZE) > stack_pages)
+		stack_pages = DIV_ROUND_UP (image.stack_size, PGSIZE);
+	if (DIV_ROUND_UP (argv_block_size (argv, argc), PGSIZE) > stack_pages)
+		stack_pages = DIV_ROUND_UP (argv_block_size (argv, argc), PGSIZE);
+	if (stack_pages > STACK_PAGE_MAX)
+		stack_pages = STACK_PAGE_MAX;
+	//printf("\n\n setup_stack진입 전입니다\n\n");
+	if (!setup_stack (if_, stack_pages))
+		goto done;
+
+	/* Start address. */
+	if_->rip = image.entry;
+
+	/* TODO: Your code goes here.
+	 * TODO: Implement argument passing (see project2/argument_passing.html). */
+	argument_stack(argv, argc, if_);
+	// hex_dump(if_->rsp, if_->rsp, USER_STACK - if_->rsp, true); 
+	success = true;
+done:
+	/* We arrive here whether the load is successful or not. */
+	// file_close (file); // process_exit() 시점에 종료되도록 변경
+	return success;
+}
+
+/* Reads and verifies the ELF header of FILE, named FILE_NAME, and its
+ * PT_LOAD program headers into *IMAGE.  Only the first
+ * EXEC_SEGMENT_MAX segments are stored, though segment_cnt counts them
+ * all.  If LOAD, also loads each segment as it is validated.  Returns true if successful, false
+ * if FILE is not an executable load() can run or loading fails. */
+static bool
+read_image (struct file *file, const char *file_name,
+		struct exec_image *image, bool load) {
+	struct ELF ehdr;
+	int i;
+
 	/* Read and verify executable header. */
-	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+	if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
 			|| memcmp (ehdr.e_ident, "\177ELF\2\1\1", 7)
 			|| ehdr.e_type != 2
 			|| ehdr.e_machine != 0x3E // amd64
@@ -508,137 +1245,141 @@ load (const char *file_name, struct intr_frame *if_) {
 			|| ehdr.e_phentsize != sizeof (struct Phdr)
 			|| ehdr.e_phnum > 1024) {
 		printf ("load: %s: error loading executable\n", file_name);
-		goto done;
+		return false;
 	}
+	image->entry = ehdr.e_entry;
+	image->stack_size = 0;
+	image->end = 0;
+	image->segment_cnt = 0;
 
 	/* Read program headers. */
-	file_ofs = ehdr.e_phoff;
 	for (i = 0; i < ehdr.e_phnum; i++) {
+		struct exec_segment seg;
 		struct Phdr phdr;
+		uint64_t page_offset;
+		off_t file_ofs = ehdr.e_phoff + i * sizeof phdr;
 
 		if (file_ofs < 0 || file_ofs > file_length (file))
-			goto done;
-		file_seek (file, file_ofs);
-
-		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
-		file_ofs += sizeof phdr;
+			return false;
+		if (file_read_at (file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
+			return false;
 		switch (phdr.p_type) {
 			case PT_NULL:
 			case PT_NOTE:
 			case PT_PHDR:
-			case PT_STACK:
 			default:
 				/* Ignore this segment. */
 				break;
+			case PT_STACK:
+				/* A hint, from the linker's -z stack-size, of how much
+				 * stack to map up front. */
+				image->stack_size = phdr.p_memsz;
+				break;
 			case PT_DYNAMIC:
 			case PT_INTERP:
 			case PT_SHLIB:
-				goto done;
+				return false;
 			case PT_LOAD:
-				if (validate_segment (&phdr, file)) {
-					bool writable = (phdr.p_flags & PF_W) != 0;
-					uint64_t file_page = phdr.p_offset & ~PGMASK;
-					uint64_t mem_page = phdr.p_vaddr & ~PGMASK;
-					uint64_t page_offset = phdr.p_vaddr & PGMASK;
-					uint32_t read_bytes, zero_bytes;
-					if (phdr.p_filesz > 0) {
-						/* Normal segment.
-						 * Read initial part from disk and zero the rest. */
-						read_bytes = page_offset + phdr.p_filesz;
-						zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-								- read_bytes);
-					} else {
-						/* Entirely zero.
-						 * Don't read anything from disk. */
-						read_bytes = 0;
-						zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-					}
-					if (!load_segment (file, file_page, (void *) mem_page,
-								read_bytes, zero_bytes, writable))
-						goto done;
+				if (!validate_segment (&phdr, file))
+					return false;
+				seg.writable = (phdr.p_flags & PF_W) != 0;
+				seg.file_page = phdr.p_offset & ~PGMASK;
+				seg.mem_page = phdr.p_vaddr & ~PGMASK;
+				page_offset = phdr.p_vaddr & PGMASK;
+				if (phdr.p_filesz > 0) {
+					/* Normal segment.
+					 * Read initial part from disk and zero the rest. */
+					seg.read_bytes = page_offset + phdr.p_filesz;
+					seg.zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+							- seg.read_bytes);
+				} else {
+					/* Entirely zero.
+					 * Don't read anything from disk. */
+					seg.read_bytes = 0;
+					seg.zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
 				}
-				else
-					goto done;
+				if (load && !load_segment (file, seg.file_page,
+							(void *) seg.mem_page, seg.read_bytes,
+							seg.zero_bytes, seg.writable))
+					return false;
+				if (seg.mem_page + seg.read_bytes + seg.zero_bytes > image->end)
+					image->end = seg.mem_page + seg.read_bytes + seg.zero_bytes;
+				if (image->segment_cnt < EXEC_SEGMENT_MAX)
+					image->segments[image->segment_cnt] = seg;
+				image->segment_cnt++;
 				break;
 		}
 	}
+	return true;
+}
 
-	/* Set up stack. */
-	//printf("\n\n setup_stack진입 전입니다\n\n");
-	if (!setup_stack (if_))
-		goto done;
+/* Loads the segments of IMAGE, read from FILE by read_image(). */
+static bool
+load_image (struct file *file, const struct exec_image *image) {
+	size_t i;
 
-	/* Start address. */
-	if_->rip = ehdr.e_entry;
+	ASSERT (image->segment_cnt <= EXEC_SEGMENT_MAX);
+	for (i = 0; i < image->segment_cnt; i++) {
+		const struct exec_segment *seg = &image->segments[i];
 
-	/* TODO: Your code goes here.
-	 * TODO: Implement argument passing (see project2/argument_passing.html). */
-	argument_stack(argv, argc, if_);
-	// hex_dump(if_->rsp, if_->rsp, USER_STACK - if_->rsp, true); 
-	success = true;
-done:
-	/* We arrive here whether the load is successful or not. */
-	// file_close (file); // process_exit() 시점에 종료되도록 변경
-	return success;
+		if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+					seg->read_bytes, seg->zero_bytes, seg->writable))
+			return false;
+	}
+	return true;
+}
+
+/* Returns the bytes of the strings of ARGV, which strtok_r() left one
+ * after another in a single buffer, from the first to the null
+ * terminator of the last. */
+static size_t
+argv_strings_size (char **argv, int argc) {
+	ASSERT (argc > 0);
+	return argv[argc - 1] + strlen (argv[argc - 1]) + 1 - argv[0];
+}
+
+/* Returns the bytes argument_stack() pushes for ARGV. */
+static size_t
+argv_block_size (char **argv, int argc) {
+	return ROUND_UP (argv_strings_size (argv, argc), sizeof (char *))
+		+ (argc + 2) * sizeof (char *);
 }
 
 /*
 	실행할 파일의 stack(esp)에 인자를 전달하는 함수
-	- parse: 프로그램 이름과 인자가 저장되어 있는 메모리 공간
-	- count: 인자의 개수
-	- esp: 스택 포인터를 가리키는 주소 값
+	- argv: strtok_r()이 나눈 인자들, 한 버퍼 안에 차례로 놓여 있음
+	- argc: 인자의 개수
+	- if_: rsp, rdi, rsi를 설정할 interrupt frame
+	- 문자열들은 memcpy 한 번으로 옮기고, 주소값만 옮긴 거리만큼 고쳐 줌
 */
 void argument_stack(char **argv, const int argc, struct intr_frame *if_) {
-	// printf("[argument_stack] %d, %p\n", argc, (char *) if_->rsp); // 0x47480000
 	uintptr_t rsp = if_->rsp;
-	/* 프로그램 이름 및 인자(문자열) push */
-	for (int i = argc-1; i >= 0; i--) {
-		// printf("  argv[%d] %ld, %s\n", i, strlen(argv[i]), (char *) argv[i]);
-		rsp -= strlen(argv[i]) + 1; // rsp를 이동시켜 공간을 확보, '\0'을 위해 추가
-		memcpy((char *) rsp, argv[i], strlen(argv[i]) + 1); // 확보된 공간에 문자열 추가
-		argv[i] = (char *) rsp; // 스택에 추가된 문자열의 주소값을 보관 (argv 재활용)
-		// printf("  argument: %p, %s, %p\n", (char *) rsp, (char *) rsp, (char *) argv[i]);
-	}
-
-	/* word alignment push
-		- 현재 rsp 위치까지 데이터가 차 있음
-		- rsp의 바로 아래 byte부터 rsp % 8개 만큼 0으로 채우면 8byte 패딩을 만들 수 있음
-		- stack bottom (7,6,5==rsp,0,0,0,0,0)
-	 */
-	while (rsp % 8 != 0) {
-		rsp--;
-		// rsp는 그냥 interger이기 때문에, 먼저 1byte 주소값으로 casting을 해준 뒤 역변환을 통해 그 byte 자리에 0을 넣음
-		*(char *)rsp = (char)0; // 여기서는 1byte
-		// printf("  padding: %p, %c\n", (char *)rsp, *(char *) rsp);
-	}
-
-	/* 프로그램 이름 및 인자 주소들 push */
-	// 포인터의 크기 계산
-	size_t PTR_SIZE = sizeof(char *);
-	// printf("  size of pointer: %ld\n", PTR_SIZE);
-	// argv[argc] 위치에 0 삽입
-	rsp -= PTR_SIZE;
-	*(char **)rsp = (char *)0; // 여기서는 8 bytes
-	// argv[0] ~ argv[argc-1]에 각 문자열의 주소값 저장
-	for (int j=argc-1; j>=0; j--) {
-		rsp -= PTR_SIZE;
-		// 여기서 *(char *) 로 처리하면 에러 발생! 왜? 8byte가 아닌 1byte로 처리되기 때문
-		// rsp부터 sizeof(char *) 크기 만큼, 즉 주소값 크기 만큼의 자리에 argv[j]를 넣겠다는 의미
-		// 여기서 rsp는 (char *)에 대한 주소값이므로, *(char **)
-		*(char **)rsp = argv[j]; 
-		// printf("  at %p, %p (%p)\n", (char *)rsp, *(char **)rsp, (char *) argv[j]);
-	}
-	/* fake address(0) 저장 */
-	rsp -= PTR_SIZE;
-	*(char **)rsp = (char *)0; // 여기서도 8 bytes
-	// printf("  fake address: %p, %p\n", (char *)rsp, *(char **)rsp);
+	size_t size = argv_strings_size (argv, argc);
+	char **uargv;
+	ptrdiff_t delta;
+
+	/* 프로그램 이름 및 인자(문자열) push: 버퍼째 한 번에 복사 */
+	rsp -= size;
+	memcpy ((char *) rsp, argv[0], size);
+	delta = (char *) rsp - argv[0];
+
+	/* word alignment push: 8byte 경계까지 한 번에 0으로 채움 */
+	memset ((char *) ROUND_DOWN (rsp, 8), 0, rsp % 8);
+	rsp = ROUND_DOWN (rsp, 8);
+
+	/* fake address(0), argv[0] ~ argv[argc-1], argv[argc](0) push */
+	rsp -= (argc + 2) * sizeof (char *);
+	uargv = (char **) rsp + 1;
+	for (int i = 0; i < argc; i++)
+		uargv[i] = argv[i] + delta;
+	uargv[argc] = NULL;
+	*(char **) rsp = NULL;
 
 	if_->rsp = rsp;
 	/* argc (문자열의 개수 저장) push */
 	if_->R.rdi = argc;
 	/* argv (문자열을 가리키는 주소들의 배열을 가리킴) push*/ 
-	if_->R.rsi = rsp + PTR_SIZE; // fake return address 위치를 빼주어야 함
+	if_->R.rsi = (uint64_t) uargv;
 }
 
 /* Checks whether PHDR describes a valid, loadable segment in
@@ -749,21 +1490,23 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the USER_STACK */
+/* Create a stack by mapping PAGE_CNT zeroed pages below USER_STACK */
 static bool
-setup_stack (struct intr_frame *if_) {
-	uint8_t *kpage;
-	bool success = false;
+setup_stack (struct intr_frame *if_, size_t page_cnt) {
+	size_t i;
 
-	kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-	if (kpage != NULL) {
-		success = install_page (((uint8_t *) USER_STACK) - PGSIZE, kpage, true);
-		if (success)
-			if_->rsp = USER_STACK;
-		else
+	for (i = 1; i <= page_cnt; i++) {
+		uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+
+		if (kpage == NULL)
+			return false;
+		if (!install_page (((uint8_t *) USER_STACK) - i * PGSIZE, kpage, true)) {
 			palloc_free_page (kpage);
+			return false;
+		}
 	}
-	return success;
+	if_->rsp = USER_STACK;
+	return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -789,6 +1532,12 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Pages of a segment loaded ahead of a fault on the page before
+ * them: many for code, which runs straight through, and few for data,
+ * which is touched more sparsely. */
+#define FAULT_AROUND_TEXT 8
+#define FAULT_AROUND_DATA 2
+
 static bool
 lazy_load_segment (struct page *page, void *aux) {
 	/* Load the segment from the file */
@@ -796,21 +1545,27 @@ lazy_load_segment (struct page *page, void *aux) {
 	/* VA is available when calling this function. */
 	struct load_info* li = (struct load_info *) aux;
 	if (page == NULL) return false;
-	ASSERT(li ->page_read_bytes <=PGSIZE);
-	ASSERT(li -> page_zero_bytes <= PGSIZE);
-	/* Load this page. */
-	if (li -> page_read_bytes > 0) {
-		file_seek (li -> file, li -> ofs);
-		if (file_read (li -> file, page -> va, li -> page_read_bytes) != (off_t) li -> page_read_bytes) {
-			vm_dealloc_page (page);
-			free (li);
-			return false;
-		}
-	}
-	memset (page -> va + li -> page_read_bytes, 0, li -> page_zero_bytes);
-	file_close (li -> file);
-	free (li);
-	return true;
+	off_t ofs;
+	size_t read_bytes;
+	load_info_page (li, page -> va, &ofs, &read_bytes);
+	bool success = true;
+	/* Load this page.  On failure the page is left to its owner's
+	 * supplemental page table, which frees it when the process dies.
+	 * The file is shared by the whole segment, so its position is not
+	 * used. */
+	if (read_bytes > 0
+			&& file_read_at (li -> file, page -> va, read_bytes, ofs) != (off_t) read_bytes)
+		success = false;
+	if (success)
+		memset (page -> va + read_bytes, 0, PGSIZE - read_bytes);
+	/* A read-only page stays a copy of the executable, which eviction
+	 * drops instead of swapping out; it keeps LI's reference for
+	 * reading the page again. */
+	if (success && !page -> writable)
+		page -> anon.text = li;
+	else
+		load_info_release (li);
+	return success;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -834,46 +1589,48 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	off_t read_ofs = ofs;
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct load_info *aux = malloc (sizeof (struct load_info));
-		aux -> file = file_reopen(file);
-		aux -> ofs = read_ofs;
-		aux -> page_read_bytes = page_read_bytes;
-		aux -> page_zero_bytes = page_zero_bytes;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, (void *) aux)) {
-			free (aux);
-			return false;
-		}
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		read_ofs += PGSIZE;
+	/* The segment's pages are created from its area on first touch. */
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return false;
+	vma -> start = upage;
+	vma -> end = upage + read_bytes + zero_bytes;
+	vma -> type = VM_ANON;
+	vma -> writable = writable;
+	vma -> init = lazy_load_segment;
+	vma -> file = file_reopen (file);
+	vma -> ofs = ofs;
+	vma -> read_bytes = read_bytes;
+	vma -> fault_around = writable ? FAULT_AROUND_DATA : FAULT_AROUND_TEXT;
+	vma -> li = NULL;
+	vma -> advice = MADV_NORMAL;
+	vma -> mmap = false;
+	if (vma -> file == NULL || !vma_insert (spt, vma)) {
+		file_close (vma -> file);
+		free (vma);
+		return false;
 	}
 	return true;
 }
 
-/* Create a PAGE of stack at the USER_STACK. Return true on success. */
+/* Create PAGE_CNT pages of stack below the USER_STACK, claimed right
+ * away so that the process does not fault them in one at a time.
+ * Return true on success. */
 static bool
-setup_stack (struct intr_frame *if_) {
-	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
-
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-	if (!vm_alloc_page (VM_ANON | VM_STACK, stack_bottom ,true)) return false;;
-	if (!vm_claim_page(stack_bottom)) return false;
-	memset(stack_bottom, 0, PGSIZE);
+setup_stack (struct intr_frame *if_, size_t page_cnt) {
+	size_t i;
+
+	for (i = 1; i <= page_cnt; i++) {
+		void *va = (uint8_t *) USER_STACK - i * PGSIZE;
+
+		if (!vm_alloc_page (VM_ANON | VM_STACK, va, true))
+			return false;
+		thread_current ()->spt.stack_bottom = va;
+		if (!vm_claim_page (va))
+			return false;
+		memset (va, 0, PGSIZE);
+	}
 
 	if_ -> rsp = USER_STACK;
 
@@ -1,34 +1,59 @@
 #include "userprog/syscall.h"
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/loader.h"
 #include "userprog/gdt.h"
 #include "userprog/process.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
 #include "user/syscall.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/pipe.h"
+#include "filesys/procfs.h"
+#include "filesys/tmpfs.h"
 #include "threads/init.h"
 #include "lib/string.h"
 #include "lib/kernel/stdio.h"
 #include "lib/kernel/list.h"
+#include "devices/block.h"
 #include "devices/input.h"
+#include "devices/timer.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
+#include "threads/rgroup.h"
+#include "threads/scratch.h"
 #include "threads/malloc.h"
+#include <round.h>
 #include "vm/file.h"
+#include "userprog/uaccess.h"
+#include "userprog/ioring.h"
+#include "userprog/futex.h"
+#include "threads/waitq.h"
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
+uint64_t syscall_fast_handler (uint64_t, uint64_t, uint64_t, uint64_t nr);
 
-static void* mmap_s (void *addr, size_t length, int writable, int fd, off_t offset);
+static void* mmap_s (void *addr, size_t length, int flags, int fd, off_t offset);
 static void munmap_s (void* addr);
+static void *mremap_s (void *old, size_t old_len, size_t new_len, int flags);
+static void *shmat_s (void *addr, size_t length, int key);
+
+/* fdt_share의 ref_cnt와, fdt_cow bit가 켜진 file의 ref_cnt를 바꿀 때 잡는 lock
+	- 그런 file은 여러 process의 FDT가 가리키므로 각 process의 fdt_lock만으로는 부족함
+	- fdt_lock을 잡은 채로 잡음
+*/
+static struct lock fdt_share_lock;
 
-struct thread_file* get_tf(int fd);
 /* System call.
  *
  * Previously system call services was handled by the interrupt handler
@@ -53,9 +78,217 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-	/* initiate filesys_lock */
-	lock_init(&filesys_lock);
+	lock_init (&fdt_share_lock);
+}
+
+/* System call handlers: each decodes its arguments from F and stores
+ * its return value, if any, in F->R.rax. */
+static void sys_halt (struct intr_frame *f UNUSED) { _halt (); }
+static void sys_exit (struct intr_frame *f) { _exit (f->R.rdi); }
+static void sys_fork (struct intr_frame *f) { f->R.rax = _fork ((char *) f->R.rdi, f); }
+static void sys_exec (struct intr_frame *f) { f->R.rax = _exec ((char *) f->R.rdi); }
+static void sys_wait (struct intr_frame *f) { f->R.rax = _wait ((tid_t) f->R.rdi); }
+static void sys_wait_any (struct intr_frame *f) { f->R.rax = _wait_any ((int *) f->R.rdi); }
+static void sys_create (struct intr_frame *f) { f->R.rax = _create ((char *) f->R.rdi, f->R.rsi); }
+static void sys_remove (struct intr_frame *f) { f->R.rax = _remove ((char *) f->R.rdi); }
+static void sys_open (struct intr_frame *f) { f->R.rax = _open ((char *) f->R.rdi); }
+static void sys_open_flags (struct intr_frame *f) { f->R.rax = _open_flags ((char *) f->R.rdi, f->R.rsi); }
+static void sys_filesize (struct intr_frame *f) { f->R.rax = _filesize (f->R.rdi); }
+static void sys_read (struct intr_frame *f) { f->R.rax = _read (f->R.rdi, (char *) f->R.rsi, f->R.rdx); }
+static void sys_write (struct intr_frame *f) { f->R.rax = _write (f->R.rdi, (char *) f->R.rsi, f->R.rdx); }
+static void sys_seek (struct intr_frame *f) { _seek (f->R.rdi, f->R.rsi); }
+static void sys_tell (struct intr_frame *f) { f->R.rax = _tell (f->R.rdi); }
+static void sys_close (struct intr_frame *f) { _close (f->R.rdi); }
+static void sys_dup2 (struct intr_frame *f) { f->R.rax = _dup2 (f->R.rdi, f->R.rsi); }
+static void sys_mount (struct intr_frame *f) { f->R.rax = _mount ((char *) f->R.rdi, f->R.rsi, f->R.rdx); }
+static void sys_umount (struct intr_frame *f) { f->R.rax = _umount ((char *) f->R.rdi); }
+static void sys_symlink (struct intr_frame *f) { f->R.rax = _symlink ((char *) f->R.rdi, (char *) f->R.rsi); }
+static void sys_getdents (struct intr_frame *f) {
+	f->R.rax = _getdents ((char *) f->R.rdi, (unsigned *) f->R.rsi, (struct dirent *) f->R.rdx, f->R.r10);
+}
+static void sys_dirstat (struct intr_frame *f) {
+	f->R.rax = _dirstat ((char *) f->R.rdi, (unsigned *) f->R.rsi, (struct dirstat *) f->R.rdx, f->R.r10);
+}
+static void sys_pipe (struct intr_frame *f) { f->R.rax = _pipe ((int *) f->R.rdi); }
+static void sys_poll (struct intr_frame *f) { f->R.rax = _poll ((struct pollfd *) f->R.rdi, f->R.rsi, f->R.rdx); }
+static void sys_fsync (struct intr_frame *f) { f->R.rax = _fsync (f->R.rdi); }
+/* 주소 공간을 바꾸는 system call은 vm_lock() 안에서: 같은 process의 다른 thread와 겹치지 않도록 */
+static void sys_mmap (struct intr_frame *f) {
+	vm_lock ();
+	f->R.rax = (uint64_t) mmap_s ((void*) f->R.rdi, (size_t) f->R.rsi, (int) f->R.rdx, (int) f->R.r10, (off_t) f->R.r8);
+	vm_unlock ();
+}
+static void sys_munmap (struct intr_frame *f) { vm_lock (); munmap_s ((void*) f->R.rdi); vm_unlock (); }
+static void sys_mremap (struct intr_frame *f) {
+	vm_lock ();
+	f->R.rax = (uint64_t) mremap_s ((void *) f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10);
+	vm_unlock ();
+}
+static void sys_shmat (struct intr_frame *f) {
+	vm_lock ();
+	f->R.rax = (uint64_t) shmat_s ((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+	vm_unlock ();
+}
+static void sys_shmdt (struct intr_frame *f) { vm_lock (); shm_detach ((void *) f->R.rdi); vm_unlock (); }
+static void sys_madvise (struct intr_frame *f) {
+	vm_lock ();
+	f->R.rax = vm_madvise ((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+	vm_unlock ();
+}
+static void sys_sbrk (struct intr_frame *f) { vm_lock (); f->R.rax = (uint64_t) vm_sbrk (f->R.rdi); vm_unlock (); }
+static void sys_stack_limit (struct intr_frame *f) { vm_lock (); f->R.rax = vm_set_stack_limit (f->R.rdi); vm_unlock (); }
+static void sys_frame_quota (struct intr_frame *f) { f->R.rax = vm_set_frame_quota (f->R.rdi, f->R.rsi); }
+static void sys_rss (struct intr_frame *f) { f->R.rax = vm_rss (); }
+static void sys_fault_stats (struct intr_frame *f) {
+	f->R.rax = _fault_stats ((struct fault_stat *) f->R.rdi, f->R.rsi, f->R.rdx);
+}
+static void sys_pmu_stats (struct intr_frame *f) {
+	f->R.rax = _pmu_stats ((uint64_t *) f->R.rdi, f->R.rsi, f->R.rdx);
+}
+static void sys_sched_stats (struct intr_frame *f) {
+	f->R.rax = _sched_stats (f->R.rdi, (uint64_t *) f->R.rsi, f->R.rdx);
+}
+static void sys_disk_stats (struct intr_frame *f) {
+	f->R.rax = _disk_stats ((const char *) f->R.rdi, (uint64_t *) f->R.rsi, f->R.rdx);
+}
+static void sys_futex_wait (struct intr_frame *f) { f->R.rax = futex_wait ((int *) f->R.rdi, f->R.rsi); }
+static void sys_futex_wake (struct intr_frame *f) { f->R.rax = futex_wake ((int *) f->R.rdi, f->R.rsi); }
+static void sys_io_setup (struct intr_frame *f) {
+	vm_lock ();
+	f->R.rax = (uint64_t) io_ring_setup ((void *) f->R.rdi, f->R.rsi);
+	vm_unlock ();
+}
+static void sys_sched_deadline (struct intr_frame *f) {
+	f->R.rax = thread_set_deadline (f->R.rdi, f->R.rsi, f->R.rdx);
 }
+static void sys_uthread_create (struct intr_frame *f) {
+	f->R.rax = _uthread_create ((void *) f->R.rdi, f->R.rsi, f->R.rdx, (void *) f->R.r10);
+}
+static void sys_timer_slack (struct intr_frame *f) { f->R.rax = thread_set_timer_slack (f->R.rdi); }
+static void sys_rgroup_create (struct intr_frame *f) {
+	f->R.rax = _rgroup_create ((const char *) f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10);
+}
+static void sys_rgroup_join (struct intr_frame *f) { f->R.rax = rgroup_join (f->R.rdi); }
+static void sys_rgroup_stats (struct intr_frame *f) {
+	f->R.rax = _rgroup_stats (f->R.rdi, (uint64_t *) f->R.rsi, f->R.rdx);
+}
+static void sys_io_enter (struct intr_frame *f) { f->R.rax = io_ring_enter (f->R.rdi); }
+static void sys_clock_ns (struct intr_frame *f) { f->R.rax = timer_ns (); }
+static void sys_pread (struct intr_frame *f) { f->R.rax = _pread (f->R.rdi, (void *) f->R.rsi, f->R.rdx, f->R.r10); }
+static void sys_pwrite (struct intr_frame *f) { f->R.rax = _pwrite (f->R.rdi, (void *) f->R.rsi, f->R.rdx, f->R.r10); }
+static void sys_readv (struct intr_frame *f) { f->R.rax = _readv (f->R.rdi, (struct iovec *) f->R.rsi, f->R.rdx); }
+static void sys_writev (struct intr_frame *f) { f->R.rax = _writev (f->R.rdi, (struct iovec *) f->R.rsi, f->R.rdx); }
+static void sys_sendfile (struct intr_frame *f) {
+	f->R.rax = _sendfile (f->R.rdi, f->R.rsi, (off_t *) f->R.rdx, f->R.r10);
+}
+static void sys_spawn (struct intr_frame *f) { f->R.rax = _spawn ((char *) f->R.rdi, (int *) f->R.rsi, f->R.rdx); }
+static void sys_template_create (struct intr_frame *f) { f->R.rax = _template_create ((char *) f->R.rdi, f); }
+static void sys_template_spawn (struct intr_frame *f) { f->R.rax = _template_spawn ((char *) f->R.rdi); }
+static void sys_template_destroy (struct intr_frame *f) { f->R.rax = _template_destroy ((char *) f->R.rdi); }
+static void sys_syscall_stats (struct intr_frame *f) {
+	f->R.rax = _syscall_stats ((struct syscall_stat *) f->R.rdi, f->R.rsi);
+}
+
+/* A system call, indexed by number in syscalls[]. */
+struct syscall {
+	const char *name;
+	void (*func) (struct intr_frame *);
+};
+
+static const struct syscall syscalls[SYS_CNT] = {
+	[SYS_HALT] = {"halt", sys_halt},                   /* Halt the operating system. */
+	[SYS_EXIT] = {"exit", sys_exit},                   /* Terminate this process. */
+	[SYS_FORK] = {"fork", sys_fork},                   /* Clone current process. */
+	[SYS_EXEC] = {"exec", sys_exec},                   /* Switch current process. */
+	[SYS_WAIT] = {"wait", sys_wait},                   /* Wait for a child process to die. */
+	[SYS_CREATE] = {"create", sys_create},             /* Create a file. */
+	[SYS_REMOVE] = {"remove", sys_remove},             /* Delete a file. */
+	[SYS_OPEN] = {"open", sys_open},                   /* Open a file. */
+	[SYS_FILESIZE] = {"filesize", sys_filesize},       /* Obtain a file's size. */
+	[SYS_READ] = {"read", sys_read},                   /* Read from a file. */
+	[SYS_WRITE] = {"write", sys_write},                /* Write to a file. */
+	[SYS_SEEK] = {"seek", sys_seek},                   /* Change position in a file. */
+	[SYS_TELL] = {"tell", sys_tell},                   /* Report current position in a file. */
+	[SYS_CLOSE] = {"close", sys_close},                /* Close a file. */
+	[SYS_MMAP] = {"mmap", sys_mmap},                   /* Map a file into memory. */
+	[SYS_MUNMAP] = {"munmap", sys_munmap},             /* Remove a memory mapping. */
+	[SYS_DUP2] = {"dup2", sys_dup2},                   /* Duplicate the file descriptor. */
+	[SYS_MOUNT] = {"mount", sys_mount},                /* Mount a file system. */
+	[SYS_UMOUNT] = {"umount", sys_umount},             /* Unmount a file system. */
+	[SYS_CLOCK_NS] = {"clock_ns", sys_clock_ns},       /* Nanoseconds since boot. */
+	[SYS_PREAD] = {"pread", sys_pread},                /* Read from a file at an offset. */
+	[SYS_PWRITE] = {"pwrite", sys_pwrite},             /* Write to a file at an offset. */
+	[SYS_READV] = {"readv", sys_readv},                /* Read from a file into buffers. */
+	[SYS_WRITEV] = {"writev", sys_writev},             /* Write to a file from buffers. */
+	[SYS_SPAWN] = {"spawn", sys_spawn},                /* Start a new process. */
+	[SYS_STACK_LIMIT] = {"stack_limit", sys_stack_limit}, /* Set the most the stack may grow to. */
+	[SYS_WAIT_ANY] = {"wait_any", sys_wait_any},       /* Wait for any child process to die. */
+	[SYS_SYSCALL_STATS] = {"syscall_stats", sys_syscall_stats}, /* Read system call statistics. */
+	[SYS_SENDFILE] = {"sendfile", sys_sendfile},       /* Copy between file descriptors. */
+	[SYS_PIPE] = {"pipe", sys_pipe},                   /* Create a pipe. */
+	[SYS_FSYNC] = {"fsync", sys_fsync},                /* Write a file's changes to disk. */
+	[SYS_SHMAT] = {"shmat", sys_shmat},                /* Attach a shared memory segment. */
+	[SYS_SHMDT] = {"shmdt", sys_shmdt},                /* Detach a shared memory segment. */
+	[SYS_MADVISE] = {"madvise", sys_madvise},          /* Advise on the use of memory. */
+	[SYS_FRAME_QUOTA] = {"frame_quota", sys_frame_quota}, /* Set the frames to keep and to hold. */
+	[SYS_RSS] = {"rss", sys_rss},                      /* Number of frames resident. */
+	[SYS_FAULT_STATS] = {"fault_stats", sys_fault_stats}, /* Read page fault statistics. */
+	[SYS_IO_SETUP] = {"io_setup", sys_io_setup},       /* Map an I/O ring. */
+	[SYS_IO_ENTER] = {"io_enter", sys_io_enter},       /* Run operations queued in the I/O ring. */
+	[SYS_PMU_STATS] = {"pmu_stats", sys_pmu_stats},    /* Read performance counters. */
+	[SYS_SCHED_STATS] = {"sched_stats", sys_sched_stats},  /* Read scheduling statistics. */
+	[SYS_DISK_STATS] = {"disk_stats", sys_disk_stats},  /* Read disk statistics. */
+	[SYS_FUTEX_WAIT] = {"futex_wait", sys_futex_wait},  /* Sleep on a word of memory. */
+	[SYS_FUTEX_WAKE] = {"futex_wake", sys_futex_wake},  /* Wake sleepers on a word of memory. */
+	[SYS_UTHREAD_CREATE] = {"uthread_create", sys_uthread_create},  /* Start a thread in the current process. */
+	[SYS_SCHED_DEADLINE] = {"sched_deadline", sys_sched_deadline},  /* Join or leave the deadline class. */
+	[SYS_SBRK] = {"sbrk", sys_sbrk},                   /* Grow or shrink the heap. */
+	[SYS_OPEN_FLAGS] = {"open_flags", sys_open_flags},  /* Open a file with flags. */
+	[SYS_TEMPLATE_CREATE] = {"template_create", sys_template_create},  /* Freeze the process as a template. */
+	[SYS_TEMPLATE_SPAWN] = {"template_spawn", sys_template_spawn},  /* Start a worker from a template. */
+	[SYS_TEMPLATE_DESTROY] = {"template_destroy", sys_template_destroy},  /* End a template. */
+	[SYS_GETDENTS] = {"getdents", sys_getdents},       /* Read many directory entries. */
+	[SYS_SYMLINK] = {"symlink", sys_symlink},          /* Create a symbolic link. */
+	[SYS_POLL] = {"poll", sys_poll},                   /* Wait for file descriptors to be ready. */
+	[SYS_MREMAP] = {"mremap", sys_mremap},             /* Resize or move a memory mapping. */
+	[SYS_TIMER_SLACK] = {"timer_slack", sys_timer_slack},  /* Set how late sleeps may end. */
+	[SYS_RGROUP_CREATE] = {"rgroup_create", sys_rgroup_create},  /* Make or set a resource group. */
+	[SYS_RGROUP_JOIN] = {"rgroup_join", sys_rgroup_join},  /* Move the process to a resource group. */
+	[SYS_RGROUP_STATS] = {"rgroup_stats", sys_rgroup_stats},  /* Read resource group statistics. */
+	[SYS_DIRSTAT] = {"dirstat", sys_dirstat},          /* Read many directory entries with their metadata. */
+};
+
+/* Fast system calls: ones that only take integers, touch no user
+ * memory and need nothing else of the caller's state, so that
+ * syscall_entry can skip building an intr_frame for them and save
+ * only the registers the user expects back.  Indexed by number, null
+ * for the others; syscall_entry looks a call up here first. */
+typedef uint64_t syscall_fast_func (uint64_t, uint64_t, uint64_t);
+
+static uint64_t fast_filesize (uint64_t fd, uint64_t a2 UNUSED, uint64_t a3 UNUSED) { return _filesize (fd); }
+static uint64_t fast_seek (uint64_t fd, uint64_t pos, uint64_t a3 UNUSED) { _seek (fd, pos); return 0; }
+static uint64_t fast_tell (uint64_t fd, uint64_t a2 UNUSED, uint64_t a3 UNUSED) { return _tell (fd); }
+static uint64_t fast_dup2 (uint64_t oldfd, uint64_t newfd, uint64_t a3 UNUSED) { return _dup2 (oldfd, newfd); }
+static uint64_t fast_clock_ns (uint64_t a1 UNUSED, uint64_t a2 UNUSED, uint64_t a3 UNUSED) { return timer_ns (); }
+static uint64_t fast_rss (uint64_t a1 UNUSED, uint64_t a2 UNUSED, uint64_t a3 UNUSED) { return vm_rss (); }
+static uint64_t fast_timer_slack (uint64_t ns, uint64_t a2 UNUSED, uint64_t a3 UNUSED) {
+	return thread_set_timer_slack (ns);
+}
+
+const size_t syscall_fast_cnt = SYS_CNT;
+syscall_fast_func *const syscall_fast[SYS_CNT] = {
+	[SYS_FILESIZE] = fast_filesize,
+	[SYS_SEEK] = fast_seek,
+	[SYS_TELL] = fast_tell,
+	[SYS_DUP2] = fast_dup2,
+	[SYS_CLOCK_NS] = fast_clock_ns,
+	[SYS_RSS] = fast_rss,
+	[SYS_TIMER_SLACK] = fast_timer_slack,
+};
+
+/* Per-system call statistics, in TSC cycles.  A call that does not
+ * return, like exit or a successful exec, is counted but not timed. */
+static struct syscall_stat stats[SYS_CNT];
 
 /* The main system call interface */
 void
@@ -63,171 +296,621 @@ syscall_handler (struct intr_frame *f) {
 	// TODO: Your implementation goes here.
 	// printf("[syscall_handler] start : %lld, (%lld, %lld, %lld, %lld, %lld, %lld)\n", 
 		// f->R.rax, f->R.rdi,f->R.rsi,f->R.rdx,f->R.r10,f->R.r8,f->R.r9);
-	switch(f->R.rax) {
-		case SYS_HALT:                   /* Halt the operating system. */
-			_halt ();
-			break;
+	uint64_t nr = f->R.rax;
+	struct syscall_stat *st;
+	enum intr_level old_level;
+	uint64_t start, cycles;
 
-		case SYS_EXIT:				  	 /* Terminate this process. */
-			_exit (f->R.rdi);
-			break;
+#ifdef VM
+	/* user stack pointer 저장: system call 중 user stack에서 page fault가 나면
+		stack growth 여부를 이것으로 판단 (vm_try_handle_fault) */
+	thread_current ()->saved_sp = f->rsp;
+#endif
+	if (nr >= SYS_CNT || syscalls[nr].func == NULL) {
+		printf("  DEFAULT do nothing..\n");
+		_exit(TID_ERROR);
+	}
 
-		case SYS_FORK:                   /* Clone current process. */
-			f->R.rax = _fork ((char *) f->R.rdi, f);
-			break;
+	st = &stats[nr];
+	old_level = intr_disable ();
+	st->count++;
+	intr_set_level (old_level);
 
-		case SYS_EXEC:                   /* Switch current process. */
-			f->R.rax = _exec ((char *) f->R.rdi);
-			break;
+	start = rdtsc ();
+	syscalls[nr].func (f);
+	/* system call 동안 쓴 scratch arena는 돌아갈 때 한 번에 비움 */
+	scratch_reset ();
+	cycles = rdtsc () - start;
+	trace (TRACE_SYSCALL, nr, cycles, 0);
 
-		case SYS_WAIT:                   /* Wait for a child process to die. */
-			f->R.rax = _wait((tid_t) f->R.rdi);
-			break;
+	old_level = intr_disable ();
+	st->cycles += cycles;
+	if (cycles > st->max_cycles)
+		st->max_cycles = cycles;
+	intr_set_level (old_level);
 
-		case SYS_CREATE:                 /* Create a file. */
-			f->R.rax = _create((char *) f->R.rdi, f->R.rsi);
-			break;
+	process_exit_if_killed ();
+	// printf("[syscall_handler] end   : %lld \n", f->R.rax);
+}
 
-		case SYS_REMOVE:                 /* Delete a file. */
-			f->R.rax = _remove((char *) f->R.rdi);
-			break;
+/* fast system call 처리: syscall_entry가 intr_frame 없이 바로 부름
+	- NR은 syscall_fast[]에 있는 번호, 인자 A1~A3, 반환값이 user의 rax
+	- 통계는 syscall_handler와 같이 셈
+*/
+uint64_t
+syscall_fast_handler (uint64_t a1, uint64_t a2, uint64_t a3, uint64_t nr) {
+	struct syscall_stat *st = &stats[nr];
+	enum intr_level old_level;
+	uint64_t start, cycles, ret;
 
-		case SYS_OPEN:                   /* Open a file. */
-			f->R.rax = _open((char *) f->R.rdi);
-			break;
+	old_level = intr_disable ();
+	st->count++;
+	intr_set_level (old_level);
 
-		case SYS_FILESIZE:               /* Obtain a file's size. */
-			f->R.rax = _filesize(f->R.rdi);
-			break;
+	start = rdtsc ();
+	ret = syscall_fast[nr] (a1, a2, a3);
+	cycles = rdtsc () - start;
+	trace (TRACE_SYSCALL, nr, cycles, 0);
 
-		case SYS_READ:                   /* Read from a file. */
-			f->R.rax = _read(f->R.rdi, (char *) f->R.rsi, f->R.rdx);
-			break;
+	old_level = intr_disable ();
+	st->cycles += cycles;
+	if (cycles > st->max_cycles)
+		st->max_cycles = cycles;
+	intr_set_level (old_level);
+	process_exit_if_killed ();
+	return ret;
+}
 
-		case SYS_WRITE:                  /* Write to a file. */
-			f->R.rax = _write(f->R.rdi, (char *) f->R.rsi, f->R.rdx);
-			break;
+/* 지금까지의 system call 통계를 user BUF에 복사
+	- BUF[i]는 번호가 i인 system call의 통계, CNT칸까지만 복사
+	- system call의 개수(SYS_CNT) 반환
+*/
+int _syscall_stats (struct syscall_stat *buf, int cnt) {
+	struct syscall_stat copy[SYS_CNT];
+	enum intr_level old_level;
 
-		case SYS_SEEK:                   /* Change position in a file. */
-			_seek(f->R.rdi, f->R.rsi);
-			break;
+	if (cnt < 0) {
+		return -1;
+	}
+	if (cnt > SYS_CNT) {
+		cnt = SYS_CNT;
+	}
+	old_level = intr_disable ();
+	memcpy (copy, stats, sizeof copy);
+	intr_set_level (old_level);
+	if (!copy_to_user (buf, copy, cnt * sizeof *copy)) {
+		_exit(-1);
+	}
+	return SYS_CNT;
+}
 
-		case SYS_TELL:                   /* Report current position in a file. */
-			f->R.rax = _tell(f->R.rdi);
-			break;
+/* page fault 통계를 user BUF에 복사
+	- SELF이면 현재 process의 통계, 아니면 system 전체의 통계
+	- BUF[i]는 class i(FAULT_*)의 통계, CNT칸까지만 복사
+	- class의 개수(FAULT_CLASS_CNT) 반환
+*/
+int _fault_stats (struct fault_stat *buf, int cnt, bool self) {
+	struct fault_stat copy[FAULT_CLASS_CNT];
 
-		case SYS_CLOSE:                  /* Close a file. */
-			_close(f->R.rdi);
-			break;
-		case SYS_MMAP:
-			f->R.rax = (uint64_t) mmap_s ((void*) f->R.rdi, (size_t) f->R.rsi, (int) f->R.rdx, (int) f->R.r10, (off_t) f->R.r8);
-			break;
-		case SYS_MUNMAP:
-			munmap_s ((void*) f->R.rdi);
-			break;
-		default:
-			printf("  DEFAULT do nothing..\n");
-			_exit(TID_ERROR);
+	if (cnt < 0) {
+		return -1;
 	}
+	if (cnt > FAULT_CLASS_CNT) {
+		cnt = FAULT_CLASS_CNT;
+	}
+	vm_fault_stats (copy, self);
+	if (!copy_to_user (buf, copy, cnt * sizeof *copy)) {
+		_exit(-1);
+	}
+	return FAULT_CLASS_CNT;
+}
 
+/* performance counter 값들을 user BUF에 복사
+	- SELF이면 현재 thread가 센 값, 아니면 system 전체의 값
+	- BUF[i]는 event i(PMU_*)의 값, 세지 못하는 event는 PMU_NONE, CNT칸까지만 복사
+	- event의 개수(PMU_CNT) 반환, counter를 쓰지 않으면(-pmu 없음) -1
+*/
+int _pmu_stats (uint64_t *buf, int cnt, bool self) {
+	uint64_t copy[PMU_CNT];
 
-	// printf("[syscall_handler] end   : %lld \n", f->R.rax);
+	if (cnt < 0 || !pmu_read (copy, self)) {
+		return -1;
+	}
+	if (cnt > PMU_CNT) {
+		cnt = PMU_CNT;
+	}
+	if (!copy_to_user (buf, copy, cnt * sizeof *copy)) {
+		_exit(-1);
+	}
+	return PMU_CNT;
 }
 
-/* system call에 인자로 들어온 주소값의 유효성을 검사 
-	- a null pointer, 
-	- a pointer to unmapped virtual memory, 
-	- or a pointer to kernel virtual address space (above KERN_BASE)
+/* thread TID의 scheduling 통계를 user BUF에 복사
+	- TID가 0이면 현재 thread, 음수이면 system 전체의 값
+	- BUF[i]는 통계 i(SCHED_*)의 값, 시간은 TSC cycle, CNT칸까지만 복사
+	- 통계의 개수(SCHED_STAT_CNT) 반환, CNT가 음수이거나 TID thread가 없으면 -1
 */
-void check_address(const char *uaddr) {
-	struct thread *curr = thread_current();
-	if (uaddr == NULL 
-		|| !is_user_vaddr(uaddr) 
-		|| pml4_get_page(curr->pml4, uaddr) == NULL) {
-			_exit(-1);
+int _sched_stats (tid_t tid, uint64_t *buf, int cnt) {
+	uint64_t copy[SCHED_STAT_CNT];
+
+	if (cnt < 0 || !thread_sched_stats (tid, copy)) {
+		return -1;
+	}
+	if (cnt > SCHED_STAT_CNT) {
+		cnt = SCHED_STAT_CNT;
+	}
+	if (!copy_to_user (buf, copy, cnt * sizeof *copy)) {
+		_exit(-1);
+	}
+	return SCHED_STAT_CNT;
+}
+
+/* 이름이 NAME인 resource group을 만들거나, 이미 있으면 그 설정을 바꿈 (threads/rgroup.c)
+	- group의 id 반환, NAME이 잘못됐거나 설정이 범위를 벗어나면 -1
+*/
+int _rgroup_create (const char *name, unsigned cpu_weight, unsigned io_weight,
+		size_t frame_max) {
+	char *kname = copy_in_string (name);
+	int id;
+
+	if (kname == NULL) {
+		return -1;
+	}
+	id = rgroup_create (kname, cpu_weight, io_weight, frame_max);
+	scratch_free (kname);
+	return id;
+}
+
+/* id가 ID인 resource group의 통계를 user BUF에 복사
+	- BUF[i]는 통계 i(RGROUP_STAT_*)의 값, CNT칸까지만 복사
+	- 통계의 개수(RGROUP_STAT_CNT) 반환, CNT가 음수이거나 그런 group이 없으면 -1
+*/
+int _rgroup_stats (int id, uint64_t *buf, int cnt) {
+	uint64_t copy[RGROUP_STAT_CNT];
+
+	if (cnt < 0 || !rgroup_read_stats (id, copy)) {
+		return -1;
+	}
+	if (cnt > RGROUP_STAT_CNT) {
+		cnt = RGROUP_STAT_CNT;
+	}
+	if (!copy_to_user (buf, copy, cnt * sizeof *copy)) {
+		_exit(-1);
+	}
+	return RGROUP_STAT_CNT;
+}
+
+/* 이름이 NAME인 block device(예: "hd0:1", "hd1:0p1", "vd0")의 통계를 user BUF에 복사
+	- BUF[i]는 통계 i(DISK_STAT_*)의 값, CNT칸까지만 복사
+	- 통계의 개수(DISK_STAT_CNT) 반환, CNT가 음수이거나 그런 device가 없으면 -1
+*/
+int _disk_stats (const char *name, uint64_t *buf, int cnt) {
+	uint64_t copy[DISK_STAT_CNT];
+	char *kname;
+	bool found;
+
+	if (cnt < 0) {
+		return -1;
+	}
+	kname = copy_in_string (name);
+	if (kname == NULL) {
+		return -1;
+	}
+	found = block_read_stats (kname, copy);
+	scratch_free (kname);
+	if (!found) {
+		return -1;
+	}
+	if (cnt > DISK_STAT_CNT) {
+		cnt = DISK_STAT_CNT;
+	}
+	if (!copy_to_user (buf, copy, cnt * sizeof *copy)) {
+		_exit(-1);
+	}
+	return DISK_STAT_CNT;
+}
+
+/* Prints statistics of the system calls made. */
+void
+syscall_print_stats (void) {
+	size_t i;
+
+	printf ("System calls: count, average and maximum cycles\n");
+	for (i = 0; i < SYS_CNT; i++) {
+		const struct syscall_stat *st = &stats[i];
+
+		if (st->count > 0)
+			printf ("  %-14s %10"PRIu64" %12"PRIu64" %12"PRIu64"\n",
+					syscalls[i].name, st->count, st->cycles / st->count,
+					st->max_cycles);
+	}
+}
+
+/* system call에 인자로 들어온 user 문자열을 현재 thread의 scratch arena에 복사
+	- 잘못된 주소값(a null pointer, unmapped/kernel virtual memory)이면 process 종료
+	- page보다 긴 문자열이면 NULL 반환
+	- page table을 미리 확인하지 않음: 접근 중 page fault가 나면 copy가 실패함 (userprog/uaccess.c)
+	- page 크기로 받아 복사한 뒤 문자열 길이로 줄임: 문자열 여러 개를 받아도 arena가 모자라지 않음
+	- 반환한 문자열은 scratch_free로 해제하거나, system call이 끝날 때 scratch_reset으로 함께 해제됨
+*/
+char *copy_in_string (const char *ustr) {
+	char *kstr = scratch_alloc (PGSIZE);
+	int64_t len;
+	if (kstr == NULL) {
+		return NULL;
+	}
+	len = strncpy_from_user (kstr, ustr, PGSIZE);
+	if (len < 0) {
+		scratch_free (kstr);
+		_exit(-1);
+	}
+	if (len == PGSIZE) {
+		scratch_free (kstr);
+		return NULL;
+	}
+	scratch_trim (kstr, len + 1);
+	return kstr;
+}
+
+/* system call에 인자로 들어온 buffer가 user 영역에 있는지 확인
+	- 매핑 여부는 실제 copy에서 확인됨
+*/
+static void check_buffer (const void *ubuf, unsigned size) {
+	if (ubuf == NULL || !is_user_vaddr (ubuf)
+		|| (uintptr_t) ubuf + size < (uintptr_t) ubuf
+		|| (uintptr_t) ubuf + size > KERN_BASE) {
+		_exit(-1);
+	}
+}
+
+/* fork한 process들이 함께 쓰는 FDT (process_share_fdt 참고)
+	- 함께 쓰는 동안에는 아무도 바꾸지 않음: 바꾸거나 안의 파일을 쓰려는 process가 fdt_unshare로 먼저 자기 FDT를 가짐
+	- 부모의 FDT가 struct thread 안에 있었으면 fdt_inline으로 옮겨 두고, 아니면 할당된 배열을 그대로 가져옴
+*/
+struct fdt_share {
+	unsigned ref_cnt;					/* 함께 쓰는 process 수 */
+	struct file **fdt;
+	uint64_t *fdt_map;
+	uint64_t *fdt_cow;
+	size_t fdt_cnt;
+	struct file *fdt_inline[FDT_INLINE_CNT];
+	uint64_t fdt_inline_map;
+	uint64_t fdt_inline_cow;
+};
+
+#define FDT_BIT(FD) ((uint64_t) 1 << ((FD) % 64))
+
+/* T가 S를 가리키게 하기 */
+static void fdt_attach (struct thread *t, struct fdt_share *s) {
+	t->fdt_share = s;
+	t->fdt = s->fdt;
+	t->fdt_map = s->fdt_map;
+	t->fdt_cow = s->fdt_cow;
+	t->fdt_cnt = s->fdt_cnt;
+}
+
+/* fork할 때 PARENT의 FDT를 CHILD와 함께 쓰기: 파일 수와 상관없이 O(1)
+	- PARENT의 fdt_lock을 잡고 부름
+	- 메모리가 모자라면 false 반환
+*/
+bool process_share_fdt (struct thread *parent, struct thread *child) {
+	struct fdt_share *s = parent->fdt_share;
+	if (s == NULL) {
+		s = malloc (sizeof *s);
+		if (s == NULL) {
+			return false;
+		}
+		s->ref_cnt = 1;
+		s->fdt_cnt = parent->fdt_cnt;
+		if (parent->fdt == parent->fdt_inline) {
+			memcpy (s->fdt_inline, parent->fdt_inline, sizeof s->fdt_inline);
+			s->fdt_inline_map = parent->fdt_inline_map;
+			s->fdt_inline_cow = parent->fdt_inline_cow;
+			s->fdt = s->fdt_inline;
+			s->fdt_map = &s->fdt_inline_map;
+			s->fdt_cow = &s->fdt_inline_cow;
+		} else {
+			s->fdt = parent->fdt;
+			s->fdt_map = parent->fdt_map;
+			s->fdt_cow = parent->fdt_cow;
+		}
+		fdt_attach (parent, s);
+	}
+	lock_acquire (&fdt_share_lock);
+	s->ref_cnt++;
+	lock_release (&fdt_share_lock);
+	fdt_attach (child, s);
+	child->max_fd = parent->max_fd;
+	return true;
+}
+
+/* T가 FDT를 다른 process와 함께 쓰고 있으면 자기 FDT 갖기
+	- 마지막으로 남은 process는 그대로 가짐
+	- 아니면 배열만 복사하고 file은 file_dup으로 함께 가리킴: 그 file은 양쪽에서 fdt_cow bit를 켜 두고,
+		처음 쓸 때 fdt_own에서 duplicate
+	- T의 fdt_lock을 잡고 부름, 메모리가 모자라면 false 반환
+*/
+static bool fdt_unshare (struct thread *t) {
+	struct fdt_share *s = t->fdt_share;
+	struct file **fdt = t->fdt_inline;
+	uint64_t *map = &t->fdt_inline_map;
+	uint64_t *cow = &t->fdt_inline_cow;
+	size_t words;
+	int fd;
+
+	if (s == NULL) {
+		return true;
+	}
+	words = DIV_ROUND_UP (s->fdt_cnt, 64);
+	lock_acquire (&fdt_share_lock);
+	if (s->ref_cnt == 1) {
+		if (s->fdt == s->fdt_inline) {
+			memcpy (fdt, s->fdt, sizeof t->fdt_inline);
+			*map = *s->fdt_map;
+			*cow = *s->fdt_cow;
+		} else {
+			fdt = s->fdt;
+			map = s->fdt_map;
+			cow = s->fdt_cow;
+		}
+		lock_release (&fdt_share_lock);
+		free (s);
+	} else {
+		if (s->fdt_cnt > FDT_INLINE_CNT) {
+			fdt = malloc (s->fdt_cnt * sizeof *fdt);
+			map = malloc (words * sizeof *map);
+			cow = malloc (words * sizeof *cow);
+			if (fdt == NULL || map == NULL || cow == NULL) {
+				lock_release (&fdt_share_lock);
+				free (fdt);
+				free (map);
+				free (cow);
+				return false;
+			}
+		}
+		memcpy (fdt, s->fdt, s->fdt_cnt * sizeof *fdt);
+		memcpy (map, s->fdt_map, words * sizeof *map);
+		for (fd = 0; fd <= t->max_fd; fd++) {
+			if (fdt[fd] != NULL && fdt[fd] != FDT_STDIN && fdt[fd] != FDT_STDOUT) {
+				file_dup (fdt[fd]);
+				s->fdt_cow[fd / 64] |= FDT_BIT (fd);
+			}
 		}
-	struct page *page = spt_find_page (&thread_current() -> spt, uaddr);
+		memcpy (cow, s->fdt_cow, words * sizeof *cow);
+		s->ref_cnt--;
+		lock_release (&fdt_share_lock);
+	}
+	t->fdt_share = NULL;
+	t->fdt = fdt;
+	t->fdt_map = map;
+	t->fdt_cow = cow;
+	t->fdt_cnt = s->fdt_cnt;
+	return true;
+}
+
+/* T의 fd 자리의 file을 T만 쓰는 file로 만들어 반환하기
+	- fdt_cow bit가 켜져 있으면 다른 process의 FDT도 가리키고 있을 수 있으므로 file_duplicate
+	- dup2로 같은 file을 가리키던 T의 다른 fd도 함께 바꿔 위치를 계속 공유함
+	- 다른 process가 이미 놓았으면 복사 없이 bit만 끔
+	- T의 FDT는 함께 쓰는 중이 아니어야 함, 메모리가 모자라면 NULL 반환
+*/
+static struct file *fdt_own (struct thread *t, int fd) {
+	struct file *file = t->fdt[fd];
+	struct file *copy = file;
+	unsigned aliases = 0;
+	int i;
+
+	if (!(t->fdt_cow[fd / 64] & FDT_BIT (fd))) {
+		return file;
+	}
+	lock_acquire (&fdt_share_lock);
+	for (i = 0; i <= t->max_fd; i++) {
+		aliases += t->fdt[i] == file;
+	}
+	if (file_ref_cnt (file) > aliases) {
+		copy = file_duplicate (file);
+		if (copy == NULL) {
+			lock_release (&fdt_share_lock);
+			return NULL;
+		}
+	}
+	for (i = 0; i <= t->max_fd; i++) {
+		if (t->fdt[i] == file) {
+			t->fdt_cow[i / 64] &= ~FDT_BIT (i);
+			if (copy != file) {
+				t->fdt[i] = --aliases == 0 ? copy : file_dup (copy);
+				file_close (file);
+			}
+		}
+	}
+	lock_release (&fdt_share_lock);
+	return copy;
+}
+
+/* 종료하는 process T의 FDT 정리 준비
+	- 다른 process와 함께 쓰고 있으면 파일은 건드리지 않고 놓기만 함: 빈 FDT가 되어 닫을 파일이 없음
+	- T의 fdt_lock을 잡고 부름
+*/
+void process_release_fdt (struct thread *t) {
+	struct fdt_share *s = t->fdt_share;
+	if (s == NULL) {
+		return;
+	}
+	lock_acquire (&fdt_share_lock);
+	if (s->ref_cnt > 1) {
+		s->ref_cnt--;
+		lock_release (&fdt_share_lock);
+		t->fdt_share = NULL;
+		memset (t->fdt_inline, 0, sizeof t->fdt_inline);
+		t->fdt_inline_map = t->fdt_inline_cow = 0;
+		t->fdt = t->fdt_inline;
+		t->fdt_map = &t->fdt_inline_map;
+		t->fdt_cow = &t->fdt_inline_cow;
+		t->fdt_cnt = FDT_INLINE_CNT;
+		t->max_fd = 1;
+		return;
+	}
+	lock_release (&fdt_share_lock);
+	fdt_unshare (t);
 }
 
-struct thread_file*
-get_tf(int fd){
-	struct thread* t = thread_current ();
-	if (!list_empty (&t->open_file)){
-		for (struct list_elem* i = list_front(&t->open_file); i!=list_end(&t->open_file); i = list_next(i) ){
-			struct thread_file* thread_file = list_entry (i, struct thread_file, elem);
-			if (fd == thread_file->fd) return thread_file;
+/* T의 FDT에서 가장 작은 빈 fd 찾기: 빈 칸이 없으면 fdt_cnt 반환
+	- fdt_map의 word 하나에 fd 64개가 들어가므로 FDT_ENTRY_MAX개라도 word 24개만 확인
+ */
+int process_next_fd (struct thread *t) {
+	size_t i;
+
+	for (i = 0; i * 64 < t->fdt_cnt; i++) {
+		if (~t->fdt_map[i] != 0) {
+			size_t fd = i * 64 + __builtin_ctzll (~t->fdt_map[i]);
+			return fd < t->fdt_cnt ? (int) fd : (int) t->fdt_cnt;
 		}
 	}
-	return NULL;
+	return t->fdt_cnt;
+}
+
+/* 현재 process의 FDT를 CNT칸 이상으로 늘리기
+	- 두 배씩 늘리되 FDT_ENTRY_MAX를 넘지 않음
+	- 메모리가 모자라면 FDT를 그대로 두고 false 반환
+	- 다른 thread가 있을 수 있으면 fdt_lock을 잡고 부름
+	- 다른 process와 함께 쓰는 FDT이면 안 됨 (fdt_unshare 먼저)
+ */
+bool process_grow_fdt (size_t cnt) {
+	struct thread *curr = thread_leader ();
+	size_t new_cnt = curr->fdt_cnt;
+	size_t words, new_words;
+	struct file **fdt;
+	uint64_t *map, *cow;
+
+	if (cnt <= curr->fdt_cnt) {
+		return true;
+	}
+	if (cnt > FDT_ENTRY_MAX) {
+		return false;
+	}
+	while (new_cnt < cnt) {
+		new_cnt *= 2;
+	}
+	if (new_cnt > FDT_ENTRY_MAX) {
+		new_cnt = FDT_ENTRY_MAX;
+	}
+
+	words = DIV_ROUND_UP (curr->fdt_cnt, 64);
+	new_words = DIV_ROUND_UP (new_cnt, 64);
+	fdt = calloc (new_cnt, sizeof *fdt);
+	map = calloc (new_words, sizeof *map);
+	cow = calloc (new_words, sizeof *cow);
+	if (fdt == NULL || map == NULL || cow == NULL) {
+		free (fdt);
+		free (map);
+		free (cow);
+		return false;
+	}
+	memcpy (fdt, curr->fdt, curr->fdt_cnt * sizeof *fdt);
+	memcpy (map, curr->fdt_map, words * sizeof *map);
+	memcpy (cow, curr->fdt_cow, words * sizeof *cow);
+
+	process_free_fdt (curr);
+	curr->fdt = fdt;
+	curr->fdt_map = map;
+	curr->fdt_cow = cow;
+	curr->fdt_cnt = new_cnt;
+	return true;
+}
+
+/* T의 FDT가 struct thread 밖에 할당되어 있으면 해제하기 (안의 파일은 닫지 않음)
+	- 다른 process와 함께 쓰는 FDT이면 안 됨
+ */
+void process_free_fdt (struct thread *t) {
+	ASSERT (t->fdt_share == NULL);
+	if (t->fdt != t->fdt_inline) {
+		free (t->fdt);
+		free (t->fdt_map);
+		free (t->fdt_cow);
+	}
+	t->fdt = t->fdt_inline;
+	t->fdt_map = &t->fdt_inline_map;
+	t->fdt_cow = &t->fdt_inline_cow;
+	t->fdt_cnt = FDT_INLINE_CNT;
 }
 
 /* 파일 객체의 주소값을 FDT에 추가하기 */
 int process_add_file (struct file *file) {
-	/* 현재 thread의 fdt와 next_fd 확인
-		- FDT에 추가 가능한 파일 개수가 가득 찼는지 확인
+	/* 현재 thread의 가장 작은 빈 fd 찾기
+		- 빈 칸이 없으면 FDT를 늘림: FDT에 추가 가능한 파일 개수가 가득 찼거나 메모리가 모자라면 실패
 	*/
-	struct thread *curr = thread_current();
-	if (curr->next_fd >= FDT_ENTRY_MAX) {
-		return TID_ERROR;	
+	struct thread *curr = thread_leader();
+	lock_acquire(&curr->fdt_lock);
+	int fd = process_next_fd (curr);
+	if (!fdt_unshare (curr) || (fd >= (int) curr->fdt_cnt && !process_grow_fdt (fd + 1))) {
+		lock_release(&curr->fdt_lock);
+		return TID_ERROR;
 	}
-	/* 현재 thread의 fdt에 새로운 파일 추가 */
-	int fd = curr->next_fd;
+	/* 현재 process의 fdt에 새로운 파일 추가 */
 	curr->fdt[fd] = file;
+	curr->fdt_map[fd / 64] |= (uint64_t) 1 << (fd % 64);
 	/* max_fd 업데이트: 새로운 파일의 fd값과 비교하여 max_fd값 설정 */
 	if (fd > curr->max_fd) {
 		curr->max_fd = fd;
 	}
-	/* next_fd 업데이트: 다음 빈 칸을 찾아 next_fd로 설정
-		- process_close_file에서의 처리에 의해 기존 next_fd 보다 작은 fd에는 모두 채워져 있으므로
-		- 한 칸 씩 위로 올라가며 빈 칸을 찾음
-	 */
-	while (curr->next_fd < FDT_ENTRY_MAX && curr->fdt[curr->next_fd]) {
-		curr->next_fd++;
-	}
-
+	lock_release(&curr->fdt_lock);
 	return fd;
 }
 
 /* FDT에서 fd값으로 파일의 주소값 가져오기 */
 struct file *process_get_file (int fd) {
-	/* fd 값이 유효한지 확인 */
-	if (fd < 0 || fd >= FDT_ENTRY_MAX) {
-		return NULL;
-	}
-	/* 현재 thread의 fdt에서 fd 위치에 값이 있는지 확인 */
-	struct file *file = thread_current()->fdt[fd];
-	if (file == NULL) {
-		return NULL;
+	struct thread *curr = thread_leader();
+	struct file *file = NULL;
+	lock_acquire(&curr->fdt_lock);
+	/* fd 값이 유효한지 확인하고, 현재 process의 fdt에서 fd 위치의 값 가져오기
+		- stdin, stdout이 아니면 fork한 process와 함께 쓰던 FDT와 file을 여기서 처음 복사함
+	*/
+	if (fd >= 0 && fd < (int) curr->fdt_cnt) {
+		file = curr->fdt[fd];
+		if (file != NULL && file != FDT_STDIN && file != FDT_STDOUT) {
+			file = fdt_unshare (curr) ? fdt_own (curr, fd) : NULL;
+		}
 	}
+	lock_release(&curr->fdt_lock);
 	return file;
 }
 
-/* FDT에서 fd값으로 파일의 주소값 제거하기 */
-void process_close_file (int fd) {
-	/* fd 값이 유효한지 확인
-		- 일단 stdin, stdout은 삭제 불가 처리
-	 */
-	if (fd >= FDT_ENTRY_MAX) {
-		return;
+/* FDT에서 fd값으로 파일의 주소값 제거하고 반환하기
+	- 같은 fd를 두 thread가 함께 닫아도 파일은 한 쪽에서만 반환됨
+ */
+struct file *process_close_file (int fd) {
+	struct thread *curr = thread_leader();
+	struct file *file;
+	lock_acquire(&curr->fdt_lock);
+	/* fd 값이 유효한지 확인 */
+	if (fd < 0 || fd >= (int) curr->fdt_cnt || !fdt_unshare (curr)) {
+		lock_release(&curr->fdt_lock);
+		return NULL;
 	}
-	/* sdt에서 값 제거 */
-	struct thread *curr = thread_current();
+	/* fdt에서 값 제거
+		- 다른 process의 FDT도 가리키는 file이면 여기서 놓고 NULL 반환
+	*/
+	file = curr->fdt[fd];
 	curr->fdt[fd] = NULL;
-	/* stdin과 stdout를 삭제하더라도 next_fd가 0,1 자리에는 들어오지 못하도록 비워둠 (is it right?) */
-	if (fd < 2) {
-		return;
-	}
-	/* next_fd 업데이트
-		- next_fd를 전체 비어있는 fd 중 가장 작은 값으로 유지
-		- 즉, next_fd 아래의 값은 모두 채워져 있음
-	 */
-	if (fd < curr->next_fd) {
-		curr->next_fd = fd;
+	if (curr->fdt_cow[fd / 64] & FDT_BIT (fd)) {
+		curr->fdt_cow[fd / 64] &= ~FDT_BIT (fd);
+		lock_acquire (&fdt_share_lock);
+		file_close (file);
+		lock_release (&fdt_share_lock);
+		file = NULL;
 	}
-	/* max_fd 업데이트: 맨 마지막 파일을 삭제한 경우 */
-	if (fd >= curr->max_fd) {
-		curr->max_fd--;
+	/* stdin과 stdout를 삭제하더라도 0,1 자리에는 다른 파일이 들어오지 못하도록 사용 중으로 남겨둠 */
+	if (fd >= 2) {
+		curr->fdt_map[fd / 64] &= ~((uint64_t) 1 << (fd % 64));
+		/* max_fd 업데이트: 맨 마지막 파일을 삭제한 경우 남은 파일 중 가장 큰 fd로 */
+		if (fd == curr->max_fd) {
+			while (curr->max_fd > 1 && curr->fdt[curr->max_fd] == NULL) {
+				curr->max_fd--;
+			}
+		}
 	}
+	lock_release(&curr->fdt_lock);
+	return file;
 }
 
 void _halt (void) {
@@ -237,34 +920,38 @@ void _halt (void) {
 void _exit (int status) {
 	struct thread *curr = thread_current();
 	curr->exit_status = status;	
-	/* process가 종료되었다는 문장 출력 */
-	printf("%s: exit(%d)\n", thread_name(), curr->exit_status);
+	/* process가 종료되었다는 문장 출력: uthread_create로 만든 thread는 그 thread만 끝나므로 출력하지 않음 */
+	if (curr->leader == curr) {
+		printf("%s: exit(%d)\n", thread_name(), curr->exit_status);
+	}
 	thread_exit();
 }
 
 tid_t _fork (const char* thread_name, struct intr_frame *if_) {
-	check_address(thread_name);
-	return process_fork(thread_name, if_);
+	char *name = copy_in_string(thread_name);
+	if (name == NULL) {
+		return TID_ERROR;
+	}
+	tid_t tid = process_fork(name, if_);
+	scratch_free (name);
+	return tid;
 }
 
 int _exec (const char *file_name) {
-	/* 잘못된 주소값인지 확인 */
-	check_address(file_name);
-
 	/* Make a copy of FILE_NAME.
 	 * Otherwise there's a race between the caller and load().
 	 	- file_name을 그대로 process_exec의 인자로 넘기면 파일을 load하지 못하고 오류 발생
 		- process_exec에서 파일 load 전에 process_cleanup()으로 현재 context를 지워버리기 때문
-		- process_exec에서 파일 load가 잘 되기 위해서 실행할 파일의 이름을 palloc으로 생성된 별도의 페이지에 담아주어야 함
-		- (process_exec에서도 파일 load 이후 palloc_free_page (file_name)로 fn_copy가 담겼던 페이지를 처리해준다는 점 확인)
+		- process_exec에서 파일 load가 잘 되기 위해서 실행할 파일의 이름을 user memory가 아닌 kernel memory에 담아주어야 함
+		- copy_in_string은 scratch arena에 복사함: process_exec는 user로 돌아가기 직전에 arena를 비움 (syscall_handler로 돌아오지 않으므로)
+		- copy_in_string이 잘못된 주소값인지도 확인
 	*/
-	char *fn_copy;
-	fn_copy = palloc_get_page (PAL_ZERO);
+	/* 주소 공간을 바꾸므로 다른 thread가 있는 process에서는 실패 */
+	if (thread_current ()->leader != thread_current () || thread_current ()->thread_cnt > 1)
+		return TID_ERROR;
+	char *fn_copy = copy_in_string(file_name);
 	if (fn_copy == NULL)
 		return TID_ERROR;
-	// printf("[_exec] before copy %d, %s // %p\n", strlen(file_name), file_name, fn_copy);
-	strlcpy (fn_copy, file_name, strlen(file_name) + 1);
-	// printf("[_exec] after  copy %d, %s\n", strlen(fn_copy), fn_copy);
 
 	/* 프로그램 실행 */
 	if (process_exec(fn_copy) < 0)
@@ -273,80 +960,567 @@ int _exec (const char *file_name) {
 	NOT_REACHED();
 }
 
+/* 현재 process에 ENTRY (ARG0, ARG1)을 STACK에서 실행하는 thread 만들기
+	- 새 thread는 주소 공간, fd, I/O ring을 현재 process와 공유함 (process_uthread_create 참고)
+	- STACK은 user stack의 꼭대기: user가 마련한 영역이며, 잘못되었으면 새 thread가 fault로 종료됨
+*/
+tid_t _uthread_create (void *entry, uint64_t arg0, uint64_t arg1, void *stack) {
+	if (entry == NULL || !is_user_vaddr (entry) || stack == NULL || !is_user_vaddr (stack)) {
+		return TID_ERROR;
+	}
+	return process_uthread_create (entry, arg0, arg1, stack);
+}
+
+/* fork + exec를 한 번에: 주소 공간을 복사하지 않고 CMD_LINE을 실행하는 child 만들기
+	- FDS가 NULL이면 fork처럼 모든 fd를 물려줌
+	- 아니면 child의 fd i (i < FD_CNT)가 현재 process의 fd FDS[i]를 가리킴 (-1이면 닫힌 채로)
+*/
+tid_t _spawn (const char *cmd_line, const int *fds, int fd_cnt) {
+	int *kfds = NULL;
+	if (fds != NULL) {
+		if (fd_cnt < 0 || fd_cnt > FDT_ENTRY_MAX) {
+			return TID_ERROR;
+		}
+		/* FD_CNT가 0이어도 NULL과 구분되도록 한 칸은 할당 */
+		kfds = malloc ((fd_cnt > 0 ? fd_cnt : 1) * sizeof *kfds);
+		if (kfds == NULL) {
+			return TID_ERROR;
+		}
+		if (!copy_from_user (kfds, fds, fd_cnt * sizeof *kfds)) {
+			free (kfds);
+			_exit(-1);
+		}
+	}
+	/* child가 CMD를 해제하므로 scratch arena가 아닌 palloc page에 옮김 */
+	char *kcmd = copy_in_string(cmd_line);
+	char *cmd = kcmd != NULL ? palloc_get_page (0) : NULL;
+	if (cmd == NULL) {
+		free (kfds);
+		return TID_ERROR;
+	}
+	strlcpy (cmd, kcmd, PGSIZE);
+	scratch_free (kcmd);
+	tid_t tid = process_spawn(cmd, kfds, fd_cnt);
+	free (kfds);
+	return tid;
+}
+
+/* 현재 process를 template NAME으로 얼려두기 (process_template_create 참고)
+	- worker는 IF_의 상태에서 1을 반환받고 시작함
+	- 다른 thread가 있는 process는 그 thread들이 template에 없으므로 실패
+*/
+int _template_create (const char *name, struct intr_frame *if_) {
+	if (thread_current ()->leader != thread_current () || thread_current ()->thread_cnt > 1) {
+		return -1;
+	}
+	char *kname = copy_in_string(name);
+	if (kname == NULL) {
+		return -1;
+	}
+	int result = process_template_create(kname, if_);
+	scratch_free (kname);
+	return result;
+}
+
+/* template NAME에서 worker를 만들어 현재 thread의 child로 (process_template_spawn 참고) */
+tid_t _template_spawn (const char *name) {
+	char *kname = copy_in_string(name);
+	if (kname == NULL) {
+		return TID_ERROR;
+	}
+	tid_t tid = process_template_spawn(kname);
+	scratch_free (kname);
+	return tid;
+}
+
+/* template NAME을 없애기: 이미 만들어진 worker는 그대로 */
+bool _template_destroy (const char *name) {
+	char *kname = copy_in_string(name);
+	if (kname == NULL) {
+		return false;
+	}
+	bool success = process_template_destroy(kname);
+	scratch_free (kname);
+	return success;
+}
+
 int _wait (tid_t pid) {
 	// printf("[_wait] pid %d\n", pid);
 	return process_wait(pid);
 }
 
+/* 자식 중 가장 먼저 종료된 것을 회수하고 그 pid 반환
+	- STATUS가 NULL이 아니면 그 exit_status를 *STATUS에 저장
+	- 자식이 없으면 -1 반환
+*/
+tid_t _wait_any (int *status) {
+	int exit_status;
+	tid_t tid = process_wait_any(&exit_status);
+	if (tid != TID_ERROR && status != NULL
+			&& !copy_to_user (status, &exit_status, sizeof exit_status)) {
+		_exit(-1);
+	}
+	return tid;
+}
+
 bool _create (const char *file_name, unsigned initial_size) {
-	check_address(file_name);
-	return filesys_create(file_name, initial_size);
+	char *name = copy_in_string(file_name);
+	if (name == NULL) {
+		return false;
+	}
+	bool success = filesys_create(name, initial_size);
+	scratch_free (name);
+	return success;
 }
 
 bool _remove (const char *file_name) {
-	check_address(file_name);
-	return filesys_remove(file_name);
+	char *name = copy_in_string(file_name);
+	if (name == NULL) {
+		return false;
+	}
+	bool success = filesys_remove(name);
+	scratch_free (name);
+	return success;
+}
+
+/* TARGET을 가리키는 symbolic link LINKPATH를 만들기 (filesys_symlink 참고)
+	- TARGET은 없어도 되고, LINKPATH를 open할 때마다 따라감
+	- 성공하면 0, 실패하면 -1 반환
+*/
+int _symlink (const char *target, const char *linkpath) {
+	char *ktarget = copy_in_string(target);
+	if (ktarget == NULL) {
+		return -1;
+	}
+	char *klink = copy_in_string(linkpath);
+	if (klink == NULL) {
+		scratch_free (ktarget);
+		return -1;
+	}
+	bool success = filesys_symlink(ktarget, klink);
+	scratch_free (klink);
+	scratch_free (ktarget);
+	return success ? 0 : -1;
+}
+
+/* PATH에 file system을 mount
+	- CHAN_NO가 MOUNT_TMPFS면 memory에 file을 두는 빈 tmpfs를 root directory의 이름 PATH에 mount
+	- 그 안의 file NAME은 "PATH/NAME"으로 create, open, remove
+	- CHAN_NO가 MOUNT_PROCFS면 kernel 통계를 읽기 전용 file로 보여 주는 procfs를 PATH에 mount: open할 때마다 새로 그림
+	- disk의 file system은 하나뿐이라 disk(CHAN_NO, DEV_NO)는 mount할 수 없음
+	- 성공하면 0, 실패하면 -1 반환
+*/
+int _mount (const char *path, int chan_no, int dev_no UNUSED) {
+	if (chan_no != MOUNT_TMPFS && chan_no != MOUNT_PROCFS) {
+		return -1;
+	}
+	char *name = copy_in_string(path);
+	if (name == NULL) {
+		return -1;
+	}
+	bool success = chan_no == MOUNT_TMPFS ? tmpfs_mount(name) : procfs_mount(name);
+	scratch_free (name);
+	return success ? 0 : -1;
+}
+
+/* PATH에 mount된 file system을 unmount
+	- tmpfs의 file은 모두 지워짐: 열려 있는 file은 닫힐 때까지 쓸 수 있음
+	- procfs는 열려 있는 file을 닫을 때까지 읽을 수 있음
+	- 성공하면 0, PATH에 mount된 것이 없으면 -1 반환
+*/
+int _umount (const char *path) {
+	char *name = copy_in_string(path);
+	if (name == NULL) {
+		return -1;
+	}
+	bool success = tmpfs_umount(name) || procfs_umount(name);
+	scratch_free (name);
+	return success ? 0 : -1;
+}
+
+/* user 문자열 PATH가 directory를 가리키면 true
+	- directory는 아직 root("/")뿐
+*/
+static bool is_dir_path (const char *path) {
+	const char *p;
+	char *name = copy_in_string(path);
+	if (name == NULL) {
+		return false;
+	}
+	for (p = name; *p == '/'; p++)
+		continue;
+	bool is_root = *name == '/' && (*p == '\0' || !strcmp (p, "."));
+	scratch_free (name);
+	return is_root;
+}
+
+/* dir_read_batch가 entry 하나마다 부르는 함수: INFO의 file로 user의 ENTRY 한 칸을 채우고, ENTRY에 쓸 수 없으면 false */
+typedef bool dir_fill_func (const struct dir_info *info, void *entry);
+
+/* directory PATH의 entry를 *POS부터 CNT개까지, 한 칸에 ENTRY_SIZE byte인 user ENTRIES에 FILL로 채우고 *POS를 그 뒤로 옮기기
+	- entry 하나마다 system call과 disk read를 하는 readdir과 달리, 한 번에 여러 sector씩 읽음 (dir_read_entries)
+	- directory는 아직 root("/")뿐
+	- 채운 entry 수 반환: 더 없으면 0, PATH가 directory가 아니거나 CNT가 음수이면 -1
+*/
+static int dir_read_batch (const char *path, unsigned *pos, void *entries,
+		size_t entry_size, int cnt, dir_fill_func *fill) {
+	struct dir_info *infos;
+	struct dir *dir;
+	unsigned kpos;
+	int total = 0;
+
+	if (cnt < 0 || !is_dir_path (path)) {
+		return -1;
+	}
+	if (!copy_from_user (&kpos, pos, sizeof kpos)) {
+		_exit(-1);
+	}
+
+	infos = scratch_alloc (PGSIZE);
+	dir = dir_open_root ();
+	if (infos == NULL || dir == NULL) {
+		scratch_free (infos);
+		dir_close (dir);
+		return -1;
+	}
+	dir_seek (dir, kpos);
+	while (total < cnt) {
+		size_t want = PGSIZE / sizeof *infos;
+		size_t n, i;
+
+		if (want > (size_t) (cnt - total)) {
+			want = cnt - total;
+		}
+		n = dir_read_entries (dir, infos, want);
+		for (i = 0; i < n; i++) {
+			if (!fill (&infos[i], (char *) entries + (total + i) * entry_size)) {
+				scratch_free (infos);
+				dir_close (dir);
+				_exit(-1);
+			}
+		}
+		total += n;
+		if (n < want) {
+			break;
+		}
+	}
+	kpos = dir_tell (dir);
+	scratch_free (infos);
+	dir_close (dir);
+	if (!copy_to_user (pos, &kpos, sizeof kpos)) {
+		_exit(-1);
+	}
+	return total;
+}
+
+/* INFO의 file의 DT_* 종류를 반환하고 *LENGTH에 길이 저장
+	- file을 열지 않고 열린 inode나 buffer cache의 disk inode에서 읽음 (inode_stat)
+	- inode를 읽을 수 없으면 길이 0인 일반 file로 침
+*/
+static uint8_t dir_entry_stat (const struct dir_info *info, off_t *length) {
+	bool symlink;
+	if (!inode_stat (info->inumber, length, &symlink)) {
+		*length = 0;
+		symlink = false;
+	}
+	return symlink ? DT_LNK : DT_REG;
+}
+
+static bool getdents_fill (const struct dir_info *info, void *entry) {
+	struct dirent e;
+	off_t length;
+
+	memset (&e, 0, sizeof e);
+	e.inumber = info->inumber;
+	e.type = dir_entry_stat (info, &length);
+	strlcpy (e.name, info->name, sizeof e.name);
+	return copy_to_user (entry, &e, sizeof e);
+}
+
+static bool dirstat_fill (const struct dir_info *info, void *entry) {
+	struct dirstat e;
+
+	memset (&e, 0, sizeof e);
+	e.inumber = info->inumber;
+	e.type = dir_entry_stat (info, &e.length);
+	strlcpy (e.name, info->name, sizeof e.name);
+	return copy_to_user (entry, &e, sizeof e);
+}
+
+/* directory PATH의 entry를 *POS부터 CNT개까지 user ENTRIES에 채우기 (dir_read_batch 참고) */
+int _getdents (const char *path, unsigned *pos, struct dirent *entries, int cnt) {
+	return dir_read_batch (path, pos, entries, sizeof *entries, cnt, getdents_fill);
+}
+
+/* getdents처럼 directory PATH의 entry를 *POS부터 CNT개까지 user ENTRIES에 채우되, 각 file의 길이와 종류까지 함께
+	- file마다 open + filesize + close를 하는 대신 한 번에: struct file을 만들지 않고,
+	  inode도 열지 않은 채 열린 inode나 buffer cache의 disk inode에서 읽음 (inode_stat)
+*/
+int _dirstat (const char *path, unsigned *pos, struct dirstat *entries, int cnt) {
+	return dir_read_batch (path, pos, entries, sizeof *entries, cnt, dirstat_fill);
 }
 
 int _open (const char *file_name) {
-	check_address(file_name);
-	struct file* file;
-	lock_acquire(&filesys_lock);
-	file = filesys_open(file_name);
-	lock_release(&filesys_lock);
+	return _open_flags (file_name, 0);
+}
 
+/* FLAGS(O_*)를 주고 파일 열기
+	- O_DIRECT: sector 전체를 읽고 쓸 때 buffer cache를 거치지 않고 disk와 user buffer의 frame 사이에서 곧바로 옮김 (direct_io 참고)
+	- 모르는 flag가 있으면 실패
+*/
+int _open_flags (const char *file_name, int flags) {
+	if (flags & ~O_DIRECT) {
+		return TID_ERROR;
+	}
+	char *name = copy_in_string(file_name);
+	if (name == NULL) {
+		return TID_ERROR;
+	}
+	struct file* file;
+	file = filesys_open(name);
+	scratch_free (name);
 
 	if (file == NULL) {
 		return TID_ERROR;
 	}
+	if (flags & O_DIRECT) {
+		file_set_direct (file, true);
+	}
 	int fd = process_add_file(file);
 
 	if (fd == TID_ERROR) {
-		lock_acquire(&filesys_lock);
 		file_close (file);
-		lock_release(&filesys_lock);
 	}
 	return fd;
 }
 
+#ifdef VM
+/* direct_io가 한 번에 고정하는 user buffer의 최대 크기 */
+#define DIRECT_IO_MAX (64 * PGSIZE)
+
+/* O_DIRECT로 연 FILE과 user buffer UBUF 사이에서 SIZE 바이트를 곧바로 옮기기: WRITE이면 파일에 쓰고 아니면 읽음
+	- UBUF의 page를 DIRECT_IO_MAX씩 한꺼번에 불러와 frame에 고정하고 (vm_pin_range) frame의 kernel 주소로 읽고 씀
+	  : 옮기는 중에는 page fault도 eviction도 없고 KBUF를 거치는 복사도 없음
+	- 고정하는 동안 vm_lock을 잡아 같은 process의 다른 thread가 buffer를 unmap하지 못하게 함
+	- POS는 read_to_user와 같음
+	- 옮긴 바이트 수 반환: 처음 부분을 고정할 수 없으면 -1을 반환해 호출한 쪽이 KBUF를 거쳐 옮기게 하고, 그 뒤 부분이면 거기서 멈춤
+*/
+static int direct_io (struct file *file, void *ubuf, unsigned size, off_t *pos,
+		bool write) {
+	uint64_t *pml4 = thread_leader ()->pml4;
+	off_t ofs = pos != NULL ? *pos : file_tell (file);
+	unsigned done = 0;
+	bool short_io = false;
+	while (done < size && !short_io) {
+		uint8_t *window = (uint8_t *) ubuf + done;
+		unsigned window_size = size - done < DIRECT_IO_MAX ? size - done : DIRECT_IO_MAX;
+		vm_lock ();
+		/* 파일을 읽으면 buffer에 써야 함 */
+		if (!vm_pin_range (window, window_size, !write)) {
+			vm_unlock ();
+			if (done == 0) {
+				return -1;
+			}
+			break;
+		}
+		for (unsigned moved = 0; moved < window_size; ) {
+			uint8_t *uaddr = window + moved;
+			unsigned chunk = PGSIZE - pg_ofs (uaddr);
+			if (chunk > window_size - moved) {
+				chunk = window_size - moved;
+			}
+			void *kva = pml4_get_page (pml4, uaddr);
+			unsigned n = write ? file_write_at (file, kva, chunk, ofs) : file_read_at (file, kva, chunk, ofs);
+			ofs += n;
+			moved += n;
+			done += n;
+			if (n < chunk) {
+				short_io = true;
+				break;
+			}
+		}
+		vm_unpin_range (window, window_size);
+		vm_unlock ();
+	}
+	if (pos != NULL) {
+		*pos = ofs;
+	} else {
+		file_seek (file, ofs);
+	}
+	return done;
+}
+#endif
+
+/* FILE에서 SIZE 바이트를 읽어 user buffer UBUF로 복사하기
+	- POS가 NULL이면 파일의 현재 위치에서, 아니면 *POS에서 읽고 *POS를 옮김
+	- KBUF(page 하나)에 page 크기씩 읽은 뒤 복사: 파일을 읽는 동안에는 user memory에 접근하지 않으므로 page fault가 나지 않음
+	- 읽은 바이트 수 반환: SIZE보다 적으면 파일 끝 (STDIN이면 줄 끝 또는 '\0')
+	- UBUF에 쓸 수 없으면 process 종료
+*/
+static unsigned read_to_user (struct file *file, char *kbuf, void *ubuf,
+		unsigned size, off_t *pos) {
+	unsigned readcnt = 0;
+#ifdef VM
+	/* O_DIRECT: KBUF를 거치지 않고 UBUF의 frame으로 곧바로 읽음 */
+	if (file != FDT_STDIN && file_is_direct (file)) {
+		int n = direct_io (file, ubuf, size, pos, false);
+		if (n >= 0) {
+			return n;
+		}
+	}
+#endif
+	while (readcnt < size) {
+		unsigned chunk = size - readcnt < PGSIZE ? size - readcnt : PGSIZE;
+		unsigned n = 0;
+		bool eof = false;
+		/* fd가 STDIN인 경우 처리 */
+		if (file == FDT_STDIN) {
+			/* 한 줄(또는 CHUNK 바이트)이 모일 때까지 한 번만 기다림 */
+			n = input_getline ((uint8_t *) kbuf, chunk);
+			eof = n < chunk || kbuf[n - 1] == '\n' || kbuf[n - 1] == '\r'
+				|| kbuf[n - 1] == '\0';
+		}
+		/* 그 외의 파일 처리 */
+		else {
+			n = pos != NULL ? file_read_at(file, kbuf, chunk, *pos) : file_read(file, kbuf, chunk);
+			/* pipe는 있는 만큼만 읽고 돌아감: 더 기다리면 이미 읽은 것을 늦게 돌려주게 됨 */
+			eof = n < chunk || file_is_pipe(file);
+			if (pos != NULL) {
+				*pos += n;
+			}
+		}
+		if (!copy_to_user ((char *) ubuf + readcnt, kbuf, n)) {
+			scratch_free (kbuf);
+			_exit(-1);
+		}
+		readcnt += n;
+		if (eof) {
+			break;
+		}
+	}
+	return readcnt;
+}
+
+/* user buffer UBUF의 SIZE 바이트를 FILE에 쓰기
+	- POS, KBUF는 read_to_user와 같음
+	- 쓴 바이트 수 반환: SIZE보다 적으면 더 쓸 수 없음
+	- UBUF를 읽을 수 없으면 process 종료
+*/
+static unsigned write_from_user (struct file *file, char *kbuf,
+		const void *ubuf, unsigned size, off_t *pos) {
+	unsigned writecnt = 0;
+#ifdef VM
+	/* O_DIRECT: KBUF를 거치지 않고 UBUF의 frame에서 곧바로 씀 */
+	if (file != FDT_STDOUT && file_is_direct (file)) {
+		int n = direct_io (file, (void *) ubuf, size, pos, true);
+		if (n >= 0) {
+			return n;
+		}
+	}
+#endif
+	while (writecnt < size) {
+		unsigned chunk = size - writecnt < PGSIZE ? size - writecnt : PGSIZE;
+		unsigned n;
+		if (!copy_from_user (kbuf, (const char *) ubuf + writecnt, chunk)) {
+			scratch_free (kbuf);
+			_exit(-1);
+		}
+		/* fd가 STDOUT인 경우 처리 */
+		if (file == FDT_STDOUT) {
+			putbuf(kbuf, chunk);
+			n = chunk;
+		}
+		/* 그 외의 파일 처리 */
+		else {
+			n = pos != NULL ? file_write_at(file, kbuf, chunk, *pos) : file_write(file, kbuf, chunk);
+			if (pos != NULL) {
+				*pos += n;
+			}
+		}
+		writecnt += n;
+		if (n < chunk) {
+			break;
+		}
+	}
+	return writecnt;
+}
+
 int _read (int fd, void *buffer, unsigned size) {
 	/* buffer로 들어온 주소값이 유효한지 확인 */
-	check_address(buffer);
+	check_buffer(buffer, size);
 	/* 현재 thread의 FDT에서 fd 값이 유효한지 확인 */
 	struct file *file = process_get_file(fd);
-	if (file == NULL) {
+	if (file == NULL || file == FDT_STDOUT) {
 		return TID_ERROR;
 	}
-	/* readcnt 초기화 */
-	int readcnt = 0;
-	/* fd가 STDIN인 경우 처리 */
-	if (fd == 0) {
-		char key;
-		char *buf = buffer;
-		for (int i=0; i<size; i++) {
-			key = input_getc();
-			*buf++ = key;
-			readcnt++;
-			if (key == '\0') {
-				break;
-			}
-		}
-		return readcnt;
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
+		return TID_ERROR;
 	}
-	/* fd가 STDOUT인 경우 처리 */ 
-	else if (fd == 1) {
+	int readcnt = read_to_user(file, kbuf, buffer, size, NULL);
+	scratch_free (kbuf);
+	return readcnt;
+}
+
+/* 파일의 위치를 바꾸지 않고 OFFSET에서 읽기: seek + read를 system call 한 번으로 */
+int _pread (int fd, void *buffer, unsigned size, off_t offset) {
+	check_buffer(buffer, size);
+	struct file *file = process_get_file(fd);
+	if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe(file) || offset < 0) {
 		return TID_ERROR;
 	}
-	/* 그 외의 파일 처리 */
-	lock_acquire(&filesys_lock);
-	readcnt = file_read(file, buffer, size);
-	lock_release(&filesys_lock);
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
+		return TID_ERROR;
+	}
+	int readcnt = read_to_user(file, kbuf, buffer, size, &offset);
+	scratch_free (kbuf);
+	return readcnt;
+}
+
+/* IOV의 IOVCNT개 buffer에 차례로 읽기: buffer 하나를 다 채우지 못하면 멈춤 */
+int _readv (int fd, const struct iovec *iov, int iovcnt) {
+	struct file *file = process_get_file(fd);
+	if (file == NULL || file == FDT_STDOUT || iovcnt < 0 || iovcnt > IOV_MAX) {
+		return TID_ERROR;
+	}
+	if (iovcnt == 0) {
+		return 0;
+	}
+	check_buffer(iov, iovcnt * sizeof *iov);
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
+		return TID_ERROR;
+	}
+	int readcnt = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		struct iovec v;
+		if (!copy_from_user (&v, &iov[i], sizeof v)) {
+			scratch_free (kbuf);
+			_exit(-1);
+		}
+		if (v.iov_len > (size_t) (INT_MAX - readcnt)) {
+			scratch_free (kbuf);
+			return TID_ERROR;
+		}
+		// 길이가 0인 iovec은 iov_base가 NULL이어도 되므로 검사하지 않고 건너뜀
+		if (v.iov_len == 0) {
+			continue;
+		}
+		check_buffer(v.iov_base, v.iov_len);
+		unsigned n = read_to_user(file, kbuf, v.iov_base, v.iov_len, NULL);
+		readcnt += n;
+		if (n < v.iov_len) {
+			break;
+		}
+	}
+	scratch_free (kbuf);
 	return readcnt;
 }
 
 int _filesize (int fd) {
 	struct file* file = process_get_file(fd);
-	if (file == NULL) {
+	if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe(file)) {
 		return TID_ERROR;
 	}
 	return file_length(file);
@@ -355,80 +1529,389 @@ int _filesize (int fd) {
 
 int _write (int fd, const void *buffer, unsigned size) {
 	/* buffer로 들어온 주소값이 유효한지 확인 */
-	check_address(buffer);
+	check_buffer(buffer, size);
 	/* 현재 thread의 FDT에서 fd 값이 유효한지 확인 */
 	struct file *file = process_get_file(fd);
-	if (file == NULL) {
+	if (file == NULL || file == FDT_STDIN) {
 		return TID_ERROR;
 	}
-	/* writecnt 초기화 */
-	int writecnt = 0;
-	/* fd가 STDIN인 경우 처리 */
-	if (fd == 0) {
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
+		return TID_ERROR;
+	}
+	int writecnt = write_from_user(file, kbuf, buffer, size, NULL);
+	scratch_free (kbuf);
+	return writecnt;
+}
+
+/* 파일의 위치를 바꾸지 않고 OFFSET에 쓰기 */
+int _pwrite (int fd, const void *buffer, unsigned size, off_t offset) {
+	check_buffer(buffer, size);
+	struct file *file = process_get_file(fd);
+	if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe(file) || offset < 0) {
+		return TID_ERROR;
+	}
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
 		return TID_ERROR;
 	}
-	/* fd가 STDOUT인 경우 처리 */ 
-	else if (fd == 1) {
-		putbuf(buffer, size);
-		return size;
+	int writecnt = write_from_user(file, kbuf, buffer, size, &offset);
+	scratch_free (kbuf);
+	return writecnt;
+}
+
+/* IOV의 IOVCNT개 buffer를 차례로 쓰기: buffer 하나를 다 쓰지 못하면 멈춤 */
+int _writev (int fd, const struct iovec *iov, int iovcnt) {
+	struct file *file = process_get_file(fd);
+	if (file == NULL || file == FDT_STDIN || iovcnt < 0 || iovcnt > IOV_MAX) {
+		return TID_ERROR;
+	}
+	if (iovcnt == 0) {
+		return 0;
+	}
+	check_buffer(iov, iovcnt * sizeof *iov);
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
+		return TID_ERROR;
+	}
+	int writecnt = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		struct iovec v;
+		if (!copy_from_user (&v, &iov[i], sizeof v)) {
+			scratch_free (kbuf);
+			_exit(-1);
+		}
+		if (v.iov_len > (size_t) (INT_MAX - writecnt)) {
+			scratch_free (kbuf);
+			return TID_ERROR;
+		}
+		// 길이가 0인 iovec은 iov_base가 NULL이어도 되므로 검사하지 않고 건너뜀
+		if (v.iov_len == 0) {
+			continue;
+		}
+		check_buffer(v.iov_base, v.iov_len);
+		unsigned n = write_from_user(file, kbuf, v.iov_base, v.iov_len, NULL);
+		writecnt += n;
+		if (n < v.iov_len) {
+			break;
+		}
 	}
-	/* 그 외의 파일 처리 */
-	lock_acquire(&filesys_lock);
-	writecnt = file_write(file, buffer, size);
-	lock_release(&filesys_lock);
+	scratch_free (kbuf);
 	return writecnt;
 }
 
+/* fd 하나의 준비된 event 구하기 (poll_fds에서 사용)
+	- E가 NULL이 아니면 그 fd의 객체(pipe, console 입력)가 준비될 때 P를 깨우도록 E를 wait queue에 먼저 올림
+	- 열려 있지 않은 fd는 POLLNVAL, STDOUT은 늘 POLLOUT
+*/
+static int poll_fd (int fd, struct poller *p, struct waitq_entry *e) {
+	struct file *file = process_get_file(fd);
+	if (file == NULL) {
+		return POLLNVAL;
+	}
+	if (file == FDT_STDIN) {
+		return input_poll (p, e) ? POLLIN : 0;
+	}
+	if (file == FDT_STDOUT) {
+		return POLLOUT;
+	}
+	return file_poll (file, p, e);
+}
+
+/* FDS의 NFDS개 fd 가운데 준비된 것이 있을 때까지, 또는 TIMEOUT ms가 지날 때까지 잠들기 (TIMEOUT이 음수면 끝없이)
+	- 처음 훑을 때 fd마다 waitq_entry를 그 객체의 wait queue에 올려 두고, 준비된 것이 없으면 poller_wait로 잠듦
+	- pipe에 data나 빈 자리가 생기거나 끝이 닫힐 때, console에 한 줄이 들어올 때 깨어나 다시 훑음: busy polling 없음
+	- 시간 제한은 timer wheel의 timer_event로: 깨어나면 마지막으로 한 번 더 훑고 끝냄
+	- fd마다 revents를 채우고 event가 있는 fd 수 반환, 시간이 다 되면 0, NFDS가 POLL_MAX보다 크면 -1
+	- FDS에 접근할 수 없으면 process 종료
+*/
+int _poll (struct pollfd *fds, unsigned nfds, int timeout) {
+	if (nfds > POLL_MAX) {
+		return -1;
+	}
+	struct pollfd *kfds = scratch_alloc (PGSIZE);
+	struct waitq_entry *entries = nfds > 0 ? malloc (nfds * sizeof *entries) : NULL;
+	if (kfds == NULL || (nfds > 0 && entries == NULL)) {
+		scratch_free (kfds);
+		free (entries);
+		return -1;
+	}
+	if (!copy_from_user (kfds, fds, nfds * sizeof *kfds)) {
+		scratch_free (kfds);
+		free (entries);
+		_exit(-1);
+	}
+
+	int64_t deadline = timeout < 0 ? -1 : timer_ticks () + DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ, 1000);
+	struct poller p;
+	bool first = true;
+	bool timed_out = false;
+	int ready;
+	unsigned i;
+	poller_init (&p);
+	for (i = 0; i < nfds; i++) {
+		waitq_entry_init (&entries[i]);
+	}
+	for (;;) {
+		ready = 0;
+		for (i = 0; i < nfds; i++) {
+			kfds[i].revents = 0;
+			if (kfds[i].fd < 0) {
+				continue;
+			}
+			int events = poll_fd (kfds[i].fd, &p, first ? &entries[i] : NULL);
+			kfds[i].revents = events & (kfds[i].events | POLLERR | POLLHUP | POLLNVAL);
+			if (kfds[i].revents != 0) {
+				ready++;
+			}
+		}
+		first = false;
+		if (ready > 0 || timeout == 0 || timed_out) {
+			break;
+		}
+		timed_out = !poller_wait (&p, deadline);
+	}
+	for (i = 0; i < nfds; i++) {
+		poller_remove (&entries[i]);
+	}
+	free (entries);
+
+	bool ok = copy_to_user (fds, kfds, nfds * sizeof *kfds);
+	scratch_free (kfds);
+	if (!ok) {
+		_exit(-1);
+	}
+	return ready;
+}
+
+/* IN_FD의 파일에서 OUT_FD로 COUNT 바이트를 곧바로 옮기기: read + write를 user buffer 없이
+	- OFFSET이 NULL이면 IN_FD의 현재 위치에서 읽고 위치를 옮김
+	- 아니면 *OFFSET에서 읽고 *OFFSET을 옮김 (IN_FD의 위치는 그대로)
+	- OUT_FD는 STDOUT이거나 파일 (파일의 현재 위치에 씀), IN_FD는 pipe일 수 없음
+	- kernel page 하나를 거쳐 inode_read_at, inode_write_at으로 buffer cache끼리 복사
+	- 옮긴 바이트 수 반환: COUNT보다 적으면 IN_FD의 끝이거나 OUT_FD에 더 쓸 수 없음
+*/
+int _sendfile (int out_fd, int in_fd, off_t *offset, unsigned count) {
+	struct file *out = process_get_file(out_fd);
+	struct file *in = process_get_file(in_fd);
+	if (out == NULL || out == FDT_STDIN || in == NULL || in == FDT_STDIN || in == FDT_STDOUT || file_is_pipe(in)) {
+		return TID_ERROR;
+	}
+	off_t pos;
+	if (offset != NULL) {
+		if (!copy_from_user (&pos, offset, sizeof pos)) {
+			_exit(-1);
+		}
+		if (pos < 0) {
+			return TID_ERROR;
+		}
+	} else {
+		pos = file_tell(in);
+	}
+	if (count > INT_MAX) {
+		count = INT_MAX;
+	}
+	char *kbuf = scratch_alloc (PGSIZE);
+	if (kbuf == NULL) {
+		return TID_ERROR;
+	}
+	unsigned sent = 0;
+	while (sent < count) {
+		unsigned chunk = count - sent < PGSIZE ? count - sent : PGSIZE;
+		unsigned n = file_read_at(in, kbuf, chunk, pos);
+		unsigned written;
+		if (n == 0) {
+			break;
+		}
+		if (out == FDT_STDOUT) {
+			putbuf(kbuf, n);
+			written = n;
+		} else {
+			written = file_write(out, kbuf, n);
+		}
+		/* 쓴 만큼만 읽은 것으로 침 */
+		pos += written;
+		sent += written;
+		if (written < chunk) {
+			break;
+		}
+	}
+	scratch_free (kbuf);
+	if (offset != NULL) {
+		if (!copy_to_user (offset, &pos, sizeof pos)) {
+			_exit(-1);
+		}
+	} else {
+		file_seek(in, pos);
+	}
+	return sent;
+}
+
 void _close (int fd) {
-	if (fd >= 2) {
-		struct file *file = process_get_file(fd);
-		lock_acquire(&filesys_lock);
+	struct file *file = process_close_file(fd);
+	if (file != FDT_STDIN && file != FDT_STDOUT) {
 		file_close(file);
-		lock_release(&filesys_lock);
 	}
-	process_close_file(fd);
+}
+
+/* oldfd가 가리키는 파일을 newfd도 가리키게 하기
+	- newfd에 열려 있던 파일은 먼저 닫음
+	- 두 fd는 같은 file 객체를 공유하므로 위치도 공유함
+ */
+int _dup2 (int oldfd, int newfd) {
+	struct thread *curr = thread_leader();
+	struct file *file = process_get_file(oldfd);
+	if (file == NULL || newfd < 0) {
+		return TID_ERROR;
+	}
+	if (oldfd == newfd) {
+		return newfd;
+	}
+	/* FDT 밖의 newfd는 열려 있지 않으므로 먼저 닫아도 됨 */
+	_close(newfd);
+	lock_acquire(&curr->fdt_lock);
+	if (!fdt_unshare (curr) || (newfd >= (int) curr->fdt_cnt && !process_grow_fdt (newfd + 1))) {
+		lock_release(&curr->fdt_lock);
+		return TID_ERROR;
+	}
+	/* 그 사이 다른 thread가 fork했으면 file을 다른 process도 가리킬 수 있음: oldfd의 fdt_cow bit를 따라감 */
+	if (file != FDT_STDIN && file != FDT_STDOUT) {
+		lock_acquire (&fdt_share_lock);
+		file_dup (file);
+		if (oldfd < (int) curr->fdt_cnt && curr->fdt[oldfd] == file
+				&& (curr->fdt_cow[oldfd / 64] & FDT_BIT (oldfd))) {
+			curr->fdt_cow[newfd / 64] |= FDT_BIT (newfd);
+		}
+		lock_release (&fdt_share_lock);
+	}
+	curr->fdt[newfd] = file;
+	curr->fdt_map[newfd / 64] |= (uint64_t) 1 << (newfd % 64);
+	if (newfd > curr->max_fd) {
+		curr->max_fd = newfd;
+	}
+	lock_release(&curr->fdt_lock);
+	return newfd;
+}
+
+/* pipe를 만들어 읽는 쪽 fd를 FDS[0]에, 쓰는 쪽 fd를 FDS[1]에 넣기
+	- 두 끝은 file이므로 read, write, close, dup2, fork가 파일처럼 동작함
+	- 실패하면 만든 것을 모두 되돌리고 -1 반환
+*/
+int _pipe (int *fds) {
+	int kfds[2] = {-1, -1};
+	struct pipe *pipe = pipe_create();
+	if (pipe == NULL) {
+		return TID_ERROR;
+	}
+	/* file_open_pipe는 실패하면 넘겨받은 끝을 닫음: 두 끝이 모두 닫히면 pipe가 해제됨 */
+	struct file *ends[2];
+	ends[0] = file_open_pipe(pipe, false);
+	if (ends[0] == NULL) {
+		pipe_close(pipe, true);
+		return TID_ERROR;
+	}
+	ends[1] = file_open_pipe(pipe, true);
+	if (ends[1] == NULL) {
+		file_close(ends[0]);
+		return TID_ERROR;
+	}
+	for (int i = 0; i < 2; i++) {
+		kfds[i] = process_add_file(ends[i]);
+		if (kfds[i] == TID_ERROR) {
+			if (i == 1) {
+				process_close_file(kfds[0]);
+			}
+			file_close(ends[0]);
+			file_close(ends[1]);
+			return TID_ERROR;
+		}
+	}
+	if (!copy_to_user (fds, kfds, sizeof kfds)) {
+		_close(kfds[0]);
+		_close(kfds[1]);
+		_exit(-1);
+	}
+	return 0;
+}
+
+/* FD의 파일에 쓴 내용과 길이 등 메타데이터를 디스크까지 내려보냄
+	- inode의 길이와 extent는 닫을 때까지 메모리에만 있으므로 먼저 inode를 buffer cache에 씀
+	- pipe, 표준 입출력, 잘못된 fd는 -1 반환
+*/
+int _fsync (int fd) {
+	struct file *file = process_get_file(fd);
+	if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe(file)) {
+		return -1;
+	}
+	inode_sync(file_get_inode(file));
+	return 0;
 }
 
 void _seek (int fd, unsigned position) {
-	if (fd < 2) return;
 	struct file *file = process_get_file(fd);
-	if (file == NULL) return;
-	lock_acquire(&filesys_lock);
+	if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe(file)) return;
 	file_seek(file, position);
-	lock_release(&filesys_lock);
 }
 
 unsigned _tell (int fd) {
-	if (fd < 2) return;
 	struct file *file = process_get_file(fd);
-	if (file == NULL) return;
-	unsigned position;
-	lock_acquire(&filesys_lock);
-	position = file_tell(file);
-	lock_release(&filesys_lock);
-	return position;
+	if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe(file)) return;
+	return file_tell(file);
 }
 
 static void*
-mmap_s (void *addr, size_t length, int writable, int fd, off_t offset){
+mmap_s (void *addr, size_t length, int flags, int fd, off_t offset){
 	//Handle all parameter error and pass it to do_mmap
+	// FLAGS의 bit 0은 writable 여부, 나머지는 MAP_POPULATE 같은 flag
+	// FD가 MAP_ANON_FD이면 file 없이 0으로 채워진 anonymous page를 map
 	if (addr == 0 || (!is_user_vaddr(addr))) return NULL;
 	if ((uint64_t)addr % PGSIZE != 0) return NULL;
 	if (offset % PGSIZE != 0) return NULL;
 	if ((uint64_t)addr + length == 0) return NULL;
 	if (!is_user_vaddr((uint64_t)addr + length)) return NULL;
-	for (uint64_t i = (uint64_t) addr; i < (uint64_t) addr + length; i += PGSIZE){
-		if (spt_find_page (&thread_current() -> spt, (void*) i)!=NULL) return NULL;
-	}
-	struct thread_file* tf = get_tf (fd);
-	if (tf == NULL) return NULL;
-	if (tf->std == 0 || tf->std == 1) return NULL;
+	if (!vma_range_is_free (&thread_leader ()->spt, addr, length)) return NULL;
+	if (vm_stack_reserved (addr, length)) return NULL;
+	struct file* file = NULL;
+	if (fd != MAP_ANON_FD) {
+		file = process_get_file (fd);
+		if (file == NULL || file == FDT_STDIN || file == FDT_STDOUT || file_is_pipe (file)) return NULL;
+	} else if (offset != 0) return NULL;
 	if (length == 0) return NULL;
-	struct file* file = tf->file;
-	return do_mmap(addr, length, writable, file, offset);
+	if (do_mmap (addr, length, flags & 1, file, offset) == NULL) return NULL;
+	// MAP_POPULATE: 첫 접근마다 fault를 내는 대신 지금 한 번에 모두 load
+	if (flags & MAP_POPULATE)
+		vm_populate (addr, length);
+	return addr;
 }
 
 static void
 munmap_s (void* addr){
 	do_munmap(addr);
+}
+
+/* OLD에 mmap한 OLD_LEN 바이트의 영역을 NEW_LEN 바이트로 늘리거나 줄임
+	- 뒤의 주소가 비어 있으면 제자리에서 늘리고, 아니면 MREMAP_MAYMOVE일 때만 옮김
+	- 옮길 때도 page의 내용은 복사하지 않고 page table entry와 spt의 page만 옮김
+	- OLD와 OLD_LEN이 mmap한 영역 하나와 맞지 않거나 실패하면 NULL 반환
+*/
+static void *
+mremap_s (void *old, size_t old_len, size_t new_len, int flags) {
+	if (old == NULL || !is_user_vaddr (old) || pg_ofs (old) != 0) return NULL;
+	if (new_len == 0 || (flags & ~MREMAP_MAYMOVE) != 0) return NULL;
+	return do_mremap (old, old_len, new_len, flags);
+}
+
+/* ADDR에 LENGTH 바이트만큼 KEY의 공유 메모리 세그먼트를 붙임
+	- 세그먼트가 없으면 LENGTH 바이트로 새로 만들고, 있으면 LENGTH 이상이어야 함
+	- ADDR 검사는 mmap과 같음. 실패하면 NULL 반환
+*/
+static void *
+shmat_s (void *addr, size_t length, int key) {
+	if (addr == 0 || (!is_user_vaddr(addr))) return NULL;
+	if ((uint64_t)addr % PGSIZE != 0) return NULL;
+	if (length == 0 || (uint64_t)addr + length < (uint64_t)addr) return NULL;
+	if (!is_user_vaddr((uint64_t)addr + length)) return NULL;
+	if (!vma_range_is_free (&thread_leader ()->spt, addr, length)) return NULL;
+	if (vm_stack_reserved (addr, length)) return NULL;
+	return shm_attach (addr, key, length);
 }
\ No newline at end of file
@@ -4,3 +4,7 @@ userprog_SRC += userprog/syscall-entry.S # System call entry.
 userprog_SRC += userprog/syscall.c	# System call handler.
 userprog_SRC += userprog/gdt.c		# GDT initialization.
 userprog_SRC += userprog/tss.c		# TSS management.
+userprog_SRC += userprog/uaccess.c	# Copying to and from user memory.
+userprog_SRC += userprog/exec_cache.c	# Cache of executable headers.
+userprog_SRC += userprog/ioring.c	# Batched system calls.
+userprog_SRC += userprog/futex.c	# User-space lock waits.
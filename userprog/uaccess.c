@@ -0,0 +1,126 @@
+/* uaccess.c: Copying to and from user memory.
+ *
+ * The kernel touches user memory only through these functions.
+ * They check that the range lies below KERN_BASE, then simply
+ * access it, without looking up the page tables first.  A page
+ * fault on the access goes to the page fault handler as usual, which
+ * may load the page.  If it cannot, the access is not a kernel bug:
+ * the instruction that faulted is listed in the exception table,
+ * and the handler resumes at the fixup address listed with it,
+ * which makes the copy report failure. */
+
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* An exception table entry: a fault at INSN resumes at FIXUP. */
+struct ex_entry {
+	uint64_t insn;
+	uint64_t fixup;
+};
+
+/* Exception table, put together by the linker. */
+extern const struct ex_entry _start_ex_table[], _end_ex_table[];
+
+/* Assembler for an exception table entry for label FROM, whose fixup
+ * is label TO. */
+#define EX_ENTRY(FROM, TO)                      \
+	".pushsection .ex_table, \"a\"\n"           \
+	".balign 8\n"                               \
+	".quad " #FROM ", " #TO "\n"                \
+	".popsection\n"
+
+/* Returns true if the SIZE bytes at UADDR all lie in user space. */
+static bool
+is_user_range (const void *uaddr, size_t size) {
+	uintptr_t start = (uintptr_t) uaddr;
+
+	return start + size >= start && start + size <= KERN_BASE;
+}
+
+/* Copies SIZE bytes from SRC to DST, one of which is in user
+ * memory.  Returns the number of bytes left uncopied because of a
+ * fault; the CPU leaves the count of a "rep movsb" in RCX when it
+ * faults. */
+static size_t
+copy_user (void *dst, const void *src, size_t size) {
+	asm volatile ("1: rep movsb\n"
+	              "2:\n"
+	              EX_ENTRY (1b, 2b)
+	              : "+D" (dst), "+S" (src), "+c" (size)
+	              :
+	              : "memory");
+	return size;
+}
+
+/* Reads the byte at user address USRC into *BYTE.  Returns false if
+ * it faults. */
+static bool
+get_user_byte (const uint8_t *usrc, uint8_t *byte) {
+	int ok;
+	uint8_t b;
+
+	asm volatile ("xorl %0, %0\n"
+	              "1: movb %2, %1\n"
+	              "movl $1, %0\n"
+	              "2:\n"
+	              EX_ENTRY (1b, 2b)
+	              : "=&r" (ok), "=&q" (b)
+	              : "m" (*usrc));
+	if (ok)
+		*byte = b;
+	return ok;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns false if
+ * any of them is not in valid user memory; DST may then have been
+ * written in part. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size) {
+	return is_user_range (usrc, size) && copy_user (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns false if
+ * any of them is not in valid, writable user memory; UDST may then
+ * have been written in part. */
+bool
+copy_to_user (void *udst, const void *src, size_t size) {
+	return is_user_range (udst, size) && copy_user (udst, src, size) == 0;
+}
+
+/* Copies the string at user address USRC into DST, which has room
+ * for SIZE bytes, null terminator included.  Returns the length of
+ * the string, or SIZE if it does not fit, in which case DST is not
+ * terminated.  Returns -1 if the string runs into invalid memory. */
+int64_t
+strncpy_from_user (char *dst, const char *usrc, size_t size) {
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (!is_user_range (usrc + i, 1)
+				|| !get_user_byte ((const uint8_t *) usrc + i,
+					(uint8_t *) dst + i))
+			return -1;
+		if (dst[i] == '\0')
+			return i;
+	}
+	return size;
+}
+
+/* Handles a page fault in the kernel that could not be resolved, F
+ * being its frame.  If the faulting instruction is a user memory
+ * access listed in the exception table, makes F resume at its fixup
+ * and returns true.  Otherwise, returns false: the fault is a kernel
+ * bug. */
+bool
+uaccess_fixup (struct intr_frame *f) {
+	const struct ex_entry *e;
+
+	for (e = _start_ex_table; e < _end_ex_table; e++)
+		if (e->insn == f->rip) {
+			f->rip = e->fixup;
+			return true;
+		}
+	return false;
+}
@@ -2,20 +2,70 @@
 
 #include "vm/vm.h"
 #include <bitmap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
+#include "threads/interrupt.h"
 #include "threads/mmu.h"
-#include "include/devices/disk.h"
+#include "threads/synch.h"
+#include "devices/block.h"
+#include "filesys/file.h"
+#include "vm/zswap.h"
 
 #define CEILING(x, y) (((x) + (y) - 1) / (y))
 #define SECTORS_PER_PAGE CEILING(PGSIZE, DISK_SECTOR_SIZE)
 /* DO NOT MODIFY BELOW LINE */
-static struct disk *swap_disk;
+static struct block_device *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
 
+/* Most swap areas, and the priority of one named without any. */
+#define SWAP_AREA_MAX 4
+#define SWAP_PRI_DEFAULT 1
+
+/* A swap area: a block device holding SLOTS' slots, one page
+ * (SECTORS_PER_PAGE sectors) each, numbered from BASE on in the
+ * slot numbers of all areas.  A set bit means the slot holds a
+ * swapped-out page.  The first area is SWAP_DISK's; -swapon adds
+ * more. */
+struct swap_area {
+	struct block_device *dev;
+	size_t base;                /* Number of the first slot. */
+	struct bitmap *slots;
+	size_t cursor;              /* Slot after the run allocated last. */
+	int priority;               /* Share of the slots allocated here. */
+	int credit;                 /* For weighted round robin. */
+};
+
+/* Protected by swap_lock once vm_anon_init() has run. */
+static struct swap_area swap_areas[SWAP_AREA_MAX];
+static size_t swap_area_cnt;
+static size_t swap_slot_cnt;    /* Slots in all areas. */
+static struct lock swap_lock;
+
+/* Devices named by -swapon, as DEV[@PRI]. */
+static const char *swap_names[SWAP_AREA_MAX - 1];
+static size_t swap_name_cnt;
+
+/* Swap cache: anonymous pages swapped in whose slots still hold the
+ * same bytes, oldest first.  Protected by swap_lock. */
+static struct list swap_cache;
+
+/* Statistics. */
+static unsigned long long cache_hit_cnt;    /* Evictions with no write. */
+static unsigned long long cache_drop_cnt;   /* Slots freed to make room. */
+
+static void swap_area_add (struct block_device *, int priority);
+static void swap_activate (const char *spec);
+static struct swap_area *slot_area (size_t slot_idx);
+
+static void slot_write (size_t slot_idx, const void *kva);
+static void slot_read (size_t slot_idx, void *kva);
+
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
 	.swap_in = anon_swap_in,
@@ -27,7 +77,96 @@ static const struct page_operations anon_ops = {
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
+	size_t i;
+
+	swap_disk = block_get_role (BLOCK_SWAP);
+	lock_init (&swap_lock);
+	list_init (&swap_cache);
+	/* Without a swap disk anonymous pages simply cannot be evicted. */
+	if (swap_disk != NULL)
+		swap_area_add (swap_disk, SWAP_PRI_DEFAULT);
+	for (i = 0; i < swap_name_cnt; i++)
+		swap_activate (swap_names[i]);
+	zswap_init (swap_slot_cnt);
+}
 
+/* Adds SPEC, DEV or DEV@PRI, to the devices to swap to besides the
+ * swap disk, with priority PRI, 1 by default.  Slots are allocated
+ * on each device in proportion to its priority, so that swapping
+ * goes on to several disks at once.  Called while the command line
+ * is parsed, before vm_anon_init(); SPEC must stay around.  Returns
+ * false if too many devices were named. */
+bool
+vm_swap_add (const char *spec) {
+	if (swap_name_cnt >= sizeof swap_names / sizeof *swap_names)
+		return false;
+	swap_names[swap_name_cnt++] = spec;
+	return true;
+}
+
+/* Adds an area of all of DEV with PRIORITY.  Without memory for its
+ * bitmap, DEV is not used. */
+static void
+swap_area_add (struct block_device *dev, int priority) {
+	struct swap_area *a = &swap_areas[swap_area_cnt];
+	size_t cnt = block_size (dev) / SECTORS_PER_PAGE;
+
+	ASSERT (swap_area_cnt < SWAP_AREA_MAX);
+	if (cnt == 0 || (a->slots = bitmap_create (cnt)) == NULL)
+		return;
+	a->dev = dev;
+	a->base = swap_slot_cnt;
+	a->cursor = 0;
+	a->priority = priority;
+	a->credit = 0;
+	swap_slot_cnt += cnt;
+	swap_area_cnt++;
+}
+
+/* Adds an area for SPEC, as given to vm_swap_add(). */
+static void
+swap_activate (const char *spec) {
+	const char *at = strchr (spec, '@');
+	size_t len = at != NULL ? (size_t) (at - spec) : strlen (spec);
+	int priority = at != NULL ? atoi (at + 1) : SWAP_PRI_DEFAULT;
+	struct block_device *dev;
+	char name[16];
+	size_t i;
+	int role;
+
+	if (len >= sizeof name)
+		PANIC ("%s: no such block device", spec);
+	memcpy (name, spec, len);
+	name[len] = '\0';
+	dev = block_get_by_name (name);
+	if (dev == NULL)
+		PANIC ("%s: no such block device", name);
+	if (priority < 1)
+		PANIC ("%s: swap priority must be positive", spec);
+	for (role = 0; role < BLOCK_ROLE_CNT; role++)
+		if (block_get_role (role) == dev)
+			PANIC ("%s: already in use", name);
+	for (i = 0; i < swap_area_cnt; i++)
+		if (swap_areas[i].dev == dev)
+			PANIC ("%s: already in use", name);
+	swap_area_add (dev, priority);
+}
+
+/* Returns the area holding SLOT_IDX. */
+static struct swap_area *
+slot_area (size_t slot_idx) {
+	size_t i;
+
+	for (i = swap_area_cnt; i-- > 0;)
+		if (slot_idx >= swap_areas[i].base)
+			return &swap_areas[i];
+	NOT_REACHED ();
+}
+
+/* Returns the first sector of SLOT_IDX, in area A. */
+static disk_sector_t
+slot_sector (const struct swap_area *a, size_t slot_idx) {
+	return (slot_idx - a->base) * SECTORS_PER_PAGE;
 }
 
 /* Initialize the file mapping */
@@ -37,30 +176,450 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 	if (type & VM_STACK) page->operations = &anon_ops;
 	struct anon_page *anon_page = &page->anon;
-	anon_page->owner = thread_current ();
-	// anon_page->swap_slot_idx = INVALID_SLOT_IDX;
+	anon_page->owner = thread_leader ();
+	anon_page->swap_slot_idx = INVALID_SLOT_IDX;
+	anon_page->text = NULL;
+	anon_page->cache_slot_idx = INVALID_SLOT_IDX;
+	return true;
+}
+
+/* Returns the executable segment PAGE, an anonymous page, holds an
+ * unchanged copy of, or a null pointer if PAGE is not such a page. */
+struct load_info *
+anon_text (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_ANON)
+		return NULL;
+	return page->anon.text;
+}
+
+/* Reads PAGE, a dropped page of a read-only executable segment, back
+ * from the executable into KVA.  Returns false if the read fails. */
+static bool
+text_read (struct page *page, void *kva) {
+	struct load_info *li = page->anon.text;
+	size_t read_bytes;
+	off_t ofs;
+
+	load_info_page (li, page->va, &ofs, &read_bytes);
+	if (read_bytes > 0
+			&& file_read_at (li->file, kva, read_bytes, ofs) != (off_t) read_bytes)
+		return false;
+	memset ((uint8_t *) kva + read_bytes, 0, PGSIZE - read_bytes);
+	return true;
+}
+
+/* Copies the contents PAGE has in its swap slot, or in the
+ * executable if it was dropped, to KVA, leaving the slot in place.
+ * Used by fork to duplicate a swapped-out page.  Returns false if
+ * reading the executable fails. */
+bool
+anon_swap_copy (struct page *page, void *kva) {
+	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->swap_slot_idx == INVALID_SLOT_IDX)
+		return anon_page->text != NULL && text_read (page, kva);
+	slot_read (anon_page->swap_slot_idx, kva);
+	return true;
+}
+
+/* Writes the page at KVA to SLOT_IDX: into the compressed cache if
+ * it takes the page, else to the swap disk. */
+static void
+slot_write (size_t slot_idx, const void *kva) {
+	if (!zswap_store (slot_idx, kva)) {
+		struct swap_area *a = slot_area (slot_idx);
+
+		block_write_multiple (a->dev, slot_sector (a, slot_idx),
+				SECTORS_PER_PAGE, kva);
+	}
+}
+
+/* Reads SLOT_IDX into the page at KVA, from wherever slot_write()
+ * put it. */
+static void
+slot_read (size_t slot_idx, void *kva) {
+	if (!zswap_load (slot_idx, kva)) {
+		struct swap_area *a = slot_area (slot_idx);
+
+		block_read_multiple (a->dev, slot_sector (a, slot_idx),
+				SECTORS_PER_PAGE, kva);
+	}
+}
+
+/* Returns SLOT_IDX to the pool of free swap slots.  The caller
+ * holds swap_lock. */
+static void
+slot_release (size_t slot_idx) {
+	struct swap_area *a = slot_area (slot_idx);
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	zswap_invalidate (slot_idx);
+	ASSERT (bitmap_test (a->slots, slot_idx - a->base));
+	bitmap_reset (a->slots, slot_idx - a->base);
+}
+
+/* Returns SLOT_IDX to the pool of free swap slots. */
+static void
+swap_slot_free (size_t slot_idx) {
+	lock_acquire (&swap_lock);
+	slot_release (slot_idx);
+	lock_release (&swap_lock);
+}
+
+/* Frees the slot in the swap cache for ANON_PAGE, if any.  The
+ * caller holds swap_lock. */
+static void
+cache_release (struct anon_page *anon_page) {
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	if (anon_page->cache_slot_idx == INVALID_SLOT_IDX)
+		return;
+	list_remove (&anon_page->cache_elem);
+	slot_release (anon_page->cache_slot_idx);
+	anon_page->cache_slot_idx = INVALID_SLOT_IDX;
+}
+
+/* Frees every slot in the swap cache, for swap is full.  Returns
+ * true if there were any.  The caller holds swap_lock. */
+static bool
+cache_shrink (void) {
+	bool any = !list_empty (&swap_cache);
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	while (!list_empty (&swap_cache)) {
+		struct anon_page *anon_page = list_entry (list_front (&swap_cache),
+				struct anon_page, cache_elem);
+
+		cache_release (anon_page);
+		cache_drop_cnt++;
+	}
+	return any;
+}
+
+
+/* Reads the N swapped-out pages in PAGES into the frames at KVAS,
+ * those the compressed cache has by decompressing them and the rest
+ * with all of the reads queued on the disk at once.
+ * Each slot stays allocated, in the swap cache, as a copy of its
+ * page: until the page is dirtied, evicting it again needs no write.
+ * The slot is freed once an eviction finds the page dirty, or when
+ * swap fills up. */
+static void
+swap_read (struct page **pages, void **kvas, size_t n) {
+	struct block_request reqs[SWAP_CLUSTER_MAX];
+	bool on_disk[SWAP_CLUSTER_MAX];
+	size_t i;
+
+	ASSERT (n <= SWAP_CLUSTER_MAX);
+	for (i = 0; i < n; i++) {
+		size_t slot_idx = pages[i]->anon.swap_slot_idx;
+		struct swap_area *a;
+
+		on_disk[i] = !zswap_load (slot_idx, kvas[i]);
+		if (!on_disk[i])
+			continue;
+		a = slot_area (slot_idx);
+		block_request_init (&reqs[i], a->dev, slot_sector (a, slot_idx),
+				SECTORS_PER_PAGE, kvas[i], false);
+		block_submit (&reqs[i]);
+	}
+	for (i = 0; i < n; i++) {
+		if (on_disk[i])
+			block_wait (&reqs[i]);
+	}
+	lock_acquire (&swap_lock);
+	for (i = 0; i < n; i++) {
+		struct anon_page *anon_page = &pages[i]->anon;
+
+		ASSERT (anon_page->cache_slot_idx == INVALID_SLOT_IDX);
+		anon_page->cache_slot_idx = anon_page->swap_slot_idx;
+		anon_page->swap_slot_idx = INVALID_SLOT_IDX;
+		list_push_back (&swap_cache, &anon_page->cache_elem);
+	}
+	lock_release (&swap_lock);
+}
+
+/* Returns true if PAGE is an anonymous page that has not been
+ * written to since it was swapped in, so that its slot in the swap
+ * cache still holds its bytes.  Unlocked, so only a hint. */
+bool
+anon_swap_cached (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_ANON
+			|| page->anon.cache_slot_idx == INVALID_SLOT_IDX)
+		return false;
+	return !pml4_is_dirty (page->anon.owner->pml4, page->va);
+}
+
+/* Evicts PAGE, resident and in the swap cache, without writing it,
+ * if it has not been written to since it was swapped in.  Otherwise
+ * frees its stale slot and returns false. */
+static bool
+cache_swap_out (struct page *page) {
+	struct anon_page *anon_page = &page->anon;
+	enum intr_level old_level;
+	bool clean;
+
+	lock_acquire (&swap_lock);
+	if (anon_page->cache_slot_idx == INVALID_SLOT_IDX) {
+		lock_release (&swap_lock);
+		return false;
+	}
+	/* With interrupts off, the owner cannot write to the page between
+	 * the check and the unmap. */
+	old_level = intr_disable ();
+	clean = !pml4_is_dirty (anon_page->owner->pml4, page->va);
+	if (clean) {
+		pml4_clear_page (anon_page->owner->pml4, page->va);
+		list_remove (&anon_page->cache_elem);
+		anon_page->swap_slot_idx = anon_page->cache_slot_idx;
+		anon_page->cache_slot_idx = INVALID_SLOT_IDX;
+		page->frame = NULL;
+		anon_page->owner->spt.swapped++;
+		cache_hit_cnt++;
+	}
+	intr_set_level (old_level);
+	if (!clean)
+		cache_release (anon_page);
+	lock_release (&swap_lock);
+	return clean;
+}
+
+/* Writes the N resident pages in PAGES to the N swap slots starting
+ * at SLOT_IDX, those the compressed cache takes into it and the rest
+ * with all of the writes queued on the disk at once, and unmaps
+ * them.
+ * The owner may keep running, and writing to a page, while its write
+ * is in flight.  A page is unmapped only once a whole write has gone
+ * by without the page being dirtied again; with interrupts off, the
+ * owner cannot sneak in between the check and the unmap. */
+static void
+swap_write (struct page **pages, size_t n, size_t slot_idx) {
+	struct block_request reqs[SWAP_CLUSTER_MAX];
+	bool on_disk[SWAP_CLUSTER_MAX];
+	struct swap_area *a = slot_area (slot_idx);
+	struct tlb_batch batch;
+	size_t i;
+
+	ASSERT (n <= SWAP_CLUSTER_MAX);
+	for (i = 0; i < n; i++) {
+		struct page *page = pages[i];
+
+		ASSERT (page->frame != NULL);
+		pml4_set_dirty (page->anon.owner->pml4, page->va, false);
+		on_disk[i] = !zswap_store (slot_idx + i, page->frame->kva);
+		if (!on_disk[i])
+			continue;
+		block_request_init (&reqs[i], a->dev, slot_sector (a, slot_idx + i),
+				SECTORS_PER_PAGE, page->frame->kva, true);
+		block_submit (&reqs[i]);
+	}
+	for (i = 0; i < n; i++)
+		if (on_disk[i])
+			block_wait (&reqs[i]);
+
+	/* The pages of a cluster share an owner. */
+	tlb_batch_init (&batch, pages[0]->anon.owner->pml4);
+	for (i = 0; i < n; i++) {
+		struct page *page = pages[i];
+		uint64_t *pml4 = page->anon.owner->pml4;
+
+		for (;;) {
+			enum intr_level old_level = intr_disable ();
+			bool dirty = pml4_is_dirty (pml4, page->va);
+
+			if (!dirty) {
+				pml4_clear_page_batched (&batch, page->va);
+				page->anon.swap_slot_idx = slot_idx + i;
+				page->frame = NULL;
+				page->anon.owner->spt.swapped++;
+			}
+			intr_set_level (old_level);
+			if (!dirty)
+				break;
+
+			pml4_set_dirty (pml4, page->va, false);
+			slot_write (slot_idx + i, page->frame->kva);
+		}
+	}
+	tlb_batch_flush (&batch);
+}
+
+/* Allocates N contiguous slots in area A, next-fit from the run
+ * allocated last there, as slots freed behind it are often too
+ * scattered for a cluster.  Returns the first one, or BITMAP_ERROR
+ * if there is no such run. */
+static size_t
+area_slot_alloc (struct swap_area *a, size_t n) {
+	size_t idx;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+	idx = bitmap_scan_and_flip_next_fit (a->slots, a->cursor, n, false);
+	if (idx == BITMAP_ERROR)
+		return BITMAP_ERROR;
+	a->cursor = (idx + n) % bitmap_size (a->slots);
+	return a->base + idx;
+}
+
+/* Allocates N contiguous swap slots, all in one area, and returns
+ * the first one, or BITMAP_ERROR if no area has such a run.  Areas
+ * take turns by smooth weighted round robin, each getting runs in
+ * proportion to its priority, so that the writes of clusters in a
+ * row, and the later reads of them, go to different disks, on
+ * different channels if that is how they are attached.  Once the
+ * area whose turn it is fills up, the others take its runs. */
+static size_t
+swap_slot_alloc (size_t n) {
+	struct swap_area *pick = NULL;
+	size_t slot_idx = BITMAP_ERROR;
+	int total = 0;
+	size_t i;
+
+	lock_acquire (&swap_lock);
+retry:
+	for (i = 0; i < swap_area_cnt; i++) {
+		struct swap_area *a = &swap_areas[i];
+
+		a->credit += a->priority;
+		total += a->priority;
+		if (pick == NULL || a->credit > pick->credit)
+			pick = a;
+	}
+	if (pick != NULL) {
+		pick->credit -= total;
+		slot_idx = area_slot_alloc (pick, n);
+	}
+	for (i = 0; slot_idx == BITMAP_ERROR && i < swap_area_cnt; i++)
+		if (&swap_areas[i] != pick)
+			slot_idx = area_slot_alloc (&swap_areas[i], n);
+	if (slot_idx == BITMAP_ERROR && cache_shrink ())
+		goto retry;
+	lock_release (&swap_lock);
+	return slot_idx;
+}
+
+/* Returns the swap slot holding PAGE, or INVALID_SLOT_IDX if PAGE is
+ * not an anonymous page in swap. */
+size_t
+anon_swap_slot (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_ANON)
+		return INVALID_SLOT_IDX;
+	return page->anon.swap_slot_idx;
+}
+
+/* Swaps in the N swapped-out anonymous pages in PAGES to the frames
+ * at KVAS, overlapping the reads.  Used to read around a faulting
+ * page whose neighbours were swapped out with it. */
+void
+anon_swap_in_cluster (struct page **pages, void **kvas, size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		ASSERT (anon_swap_slot (pages[i]) != INVALID_SLOT_IDX);
+	swap_read (pages, kvas, n);
+}
+
+/* Swaps out the N resident anonymous pages in PAGES, which must be
+ * virtually adjacent and in ascending order, to as many contiguous
+ * swap slots, so that a later read-around finds them together.
+ * Returns false, swapping out nothing, if no such run of free slots
+ * exists. */
+bool
+anon_swap_out_cluster (struct page **pages, size_t n) {
+	size_t slot_idx;
+	size_t i;
+
+	/* Pages written to since they were swapped in get new slots. */
+	lock_acquire (&swap_lock);
+	for (i = 0; i < n; i++)
+		cache_release (&pages[i]->anon);
+	lock_release (&swap_lock);
+	slot_idx = swap_slot_alloc (n);
+	if (slot_idx == BITMAP_ERROR)
+		return false;
+	swap_write (pages, n, slot_idx);
 	return true;
 }
 
+/* Swap slots for pages that are not anonymous pages of one process,
+ * like those of shared memory segments, which keep track of their
+ * slots themselves. */
+
+/* Allocates a swap slot and returns it, or INVALID_SLOT_IDX if swap
+ * is full. */
+size_t
+anon_slot_alloc (void) {
+	size_t slot_idx = swap_slot_alloc (1);
+
+	return slot_idx != BITMAP_ERROR ? slot_idx : INVALID_SLOT_IDX;
+}
+
+/* Writes the page at KVA to SLOT_IDX. */
+void
+anon_slot_write (size_t slot_idx, const void *kva) {
+	slot_write (slot_idx, kva);
+}
+
+/* Reads SLOT_IDX into the page at KVA, leaving the slot in place. */
+void
+anon_slot_read (size_t slot_idx, void *kva) {
+	slot_read (slot_idx, kva);
+}
+
+/* Frees SLOT_IDX. */
+void
+anon_slot_free (size_t slot_idx) {
+	swap_slot_free (slot_idx);
+}
+
+/* Prints statistics of the swap cache. */
+void
+anon_print_stats (void) {
+	if (cache_hit_cnt != 0 || cache_drop_cnt != 0)
+		printf ("Swap cache: %llu evictions without a write, "
+				"%llu slots freed for room\n", cache_hit_cnt, cache_drop_cnt);
+}
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
-	struct anon_page *anon_page = &page->anon;
+	if (page->anon.swap_slot_idx == INVALID_SLOT_IDX)
+		return page->anon.text != NULL && text_read (page, kva);
+	swap_read (&page, &kva, 1);
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by writing contents to the swap disk.
+ * A page of a read-only executable segment is the same as the
+ * executable's bytes, which the file system keeps, so it is only
+ * unmapped, and anon_swap_in() reads it from the executable again. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	if (page->anon.text != NULL) {
+		enum intr_level old_level = intr_disable ();
+
+		pml4_clear_page (page->anon.owner->pml4, page->va);
+		page->frame = NULL;
+		intr_set_level (old_level);
+		return true;
+	}
+	if (cache_swap_out (page))
+		return true;
+	return anon_swap_out_cluster (&page, 1);
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
-	// if (page -> frame!= NULL){
-	// 	list_remove (&page->frame->elem);
-	// 	free(page->frame);
-	// }
+	struct anon_page *anon_page = &page->anon;
 
+	if (anon_page->swap_slot_idx != INVALID_SLOT_IDX)
+		swap_slot_free (anon_page->swap_slot_idx);
+	if (anon_page->cache_slot_idx != INVALID_SLOT_IDX) {
+		lock_acquire (&swap_lock);
+		cache_release (anon_page);
+		lock_release (&swap_lock);
+	}
+	if (anon_page->text != NULL)
+		load_info_release (anon_page->text);
+	if (page->frame != NULL)
+		vm_free_frame (page);
 }
@@ -3,9 +3,15 @@
 #include "vm/vm.h"
 #include "threads/vaddr.h"
 #include "vm/file.h"
+#include <round.h>
 #include <string.h>
+#include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/interrupt.h"
 #include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "user/syscall.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -18,20 +24,40 @@ static const struct page_operations file_ops = {
 	.destroy = file_backed_destroy,
 	.type = VM_FILE,
 };
-//Record of mmap, store mmap_file_info
-static struct list mmap_file_list;
-
-struct mmap_file_info{
-	struct list_elem elem;
-	uint64_t start;
-	// start addr of final page
-	uint64_t end;
-};
+static void mmap_writeback (struct mmap_region *region, size_t first,
+		struct tlb_batch *batch);
+static void mmap_drop_pages (struct supplemental_page_table *,
+		struct mmap_region *, size_t first, struct tlb_batch *);
+static bool mmap_move_pages (struct supplemental_page_table *,
+		struct mmap_region *, uint8_t *to);
+static bool mmap_range_usable (struct supplemental_page_table *,
+		void *addr, size_t length);
+static void mmap_region_resize (struct supplemental_page_table *,
+		struct mmap_region *, void *addr, size_t page_cnt);
+static void mmap_write (struct file *, const void *, off_t size, off_t ofs);
+static void mmap_write_user (struct file *, const void *, off_t size,
+		off_t ofs);
+static off_t mmap_page_bytes (struct page *page);
+
+struct kmem_cache *mmap_info_slab;
+
+/* Runs of dirty pages are written back through this buffer, WB_PAGES
+ * pages at a time: as many as two requests of the most sectors, which
+ * the disk driver is handed at once.  wb_lock serializes its use. */
+#define WB_PAGES (2 * DISK_REQUEST_MAX_SECTORS * DISK_SECTOR_SIZE / PGSIZE)
+static uint8_t *wb_buffer;
+static struct lock wb_lock;
 
 /* The initializer of file vm */
 void
 vm_file_init (void) {
-	// list_init (&mmap_file_list);
+	/* Mapped regions are kept per process, in its spt. */
+	mmap_info_slab = kmem_cache_create ("mmap_info", sizeof (struct mmap_info),
+			NULL);
+	if (mmap_info_slab == NULL)
+		PANIC ("vm_file_init: out of memory");
+	wb_buffer = palloc_get_multiple (PAL_ASSERT, WB_PAGES);
+	lock_init (&wb_lock);
 }
 
 
@@ -51,72 +77,454 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_read_at (file_page->file, kva, file_page->size, file_page->ofs)
+			!= file_page->size)
+		return false;
+	memset ((uint8_t *) kva + file_page->size, 0, PGSIZE - file_page->size);
+	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  A frame of
+ * the file cache is taken from all the mappings sharing it at once,
+ * with a single write-back. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+	struct frame *frame = page->frame;
+	off_t bytes = mmap_page_bytes (page);
+
+	/* As with anonymous pages, unmap only after a write-back during
+	 * which no mapping dirtied the page again.  The frame is out of
+	 * the file cache, so no mapping joins meanwhile. */
+	for (;;) {
+		enum intr_level old_level;
+		struct list_elem *e;
+		bool dirty = false;
+
+		if (frame_test_and_clear_dirty (frame))
+			mmap_write (file_page->file, frame->kva, bytes, file_page->ofs);
+
+		old_level = intr_disable ();
+		for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+				e = list_next (e)) {
+			struct page *p = list_entry (e, struct page, frame_elem);
+
+			dirty |= pml4_is_dirty (p->owner->pml4, p->va);
+		}
+		if (!dirty)
+			for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+					e = list_next (e)) {
+				struct page *p = list_entry (e, struct page, frame_elem);
+
+				pml4_clear_page (p->owner->pml4, p->va);
+				p->frame = NULL;
+			}
+		intr_set_level (old_level);
+		if (!dirty)
+			return true;
+	}
 }
 
-/* Destory the file backed page. PAGE will be freed by the caller. */
+/* Destory the file backed page. PAGE will be freed by the caller.
+ * The file belongs to PAGE's mapped region, which closes it. */
 static void
 file_backed_destroy (struct page *page) {
-	// TODO: On mmap_exit sometimes empty file content
 	struct file_page *file_page = &page->file;
-	//if dirty, write back to file
-	if (pml4_is_dirty (thread_current() -> pml4, page -> va)){
-		file_seek (file_page->file, file_page->ofs);
-		file_write (file_page->file, page->va, file_page->size);
+	//if dirty, write back to file; a swapped-out page already was
+	if (page->frame != NULL && pml4_is_dirty (page->owner->pml4, page->va)) {
+		/* Write the page back for the mappings sharing it too. */
+		frame_test_and_clear_dirty (page->frame);
+		mmap_write (file_page->file, page->frame->kva, mmap_page_bytes (page),
+				file_page->ofs);
 	}
-	file_close (file_page->file);
 
-	if (page->frame != NULL) {
-		list_remove (&page->frame->elem);
-		free (page->frame);
-	}
+	if (page->frame != NULL)
+		vm_free_frame (page);
 }
 
 //Use to lazy load mmap
 static bool
 lazy_load_file (struct page* page, void* aux){
 	struct mmap_info* mi = (struct mmap_info*) aux;
-	file_seek (mi->file, mi->offset);
-	page -> file.size = file_read (mi->file, page->va, mi->read_bytes);
+	page -> file.size = file_read_at (mi->file, page->va, mi->read_bytes,
+			mi->offset);
 	page -> file.ofs = mi->offset;
 	if (page->file.size != PGSIZE){
 		memset (page->va + page->file.size, 0, PGSIZE - page->file.size);
 	}
-	pml4_set_dirty (thread_current()->pml4, page->va, false);
+	pml4_set_dirty (thread_leader ()->pml4, page->va, false);
 	free(mi);
 	return true;
 }
 
-/* Do the mmap */
+/* Do the mmap.
+ * Maps LENGTH bytes of FILE from OFFSET at ADDR as a region of its own
+ * that do_munmap() removes as a whole, or, if FILE is a null pointer,
+ * LENGTH bytes of zeros, which are anonymous pages that go to swap.  A
+ * page's struct page is only created when the page is first touched.
+ * Returns ADDR, or a null pointer if memory runs out or the region
+ * would overlap another. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
 	//assume all parameter errors are handled in syscall.c
-	off_t ofs;
-	uint64_t read_bytes;
-	for (uint64_t i = 0; i < length; i += PGSIZE){
-		struct mmap_info* mi = malloc (sizeof (struct mmap_info));
-		ofs = offset + i;
-		read_bytes = length - i >= PGSIZE ? PGSIZE : length -i;
-		mi->file = file_reopen (file);
-		mi->offset = ofs;
-		mi->read_bytes = read_bytes;
-		vm_alloc_page_with_initializer (VM_FILE, (void*) ((uint64_t) addr + i), writable, lazy_load_file, (void*) mi);
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct mmap_region *region = malloc (sizeof *region);
+
+	if (region == NULL)
+		return NULL;
+	region->addr = addr;
+	region->file = NULL;
+	if (file != NULL) {
+		region->file = file_reopen (file);
+		if (region->file == NULL) {
+			free (region);
+			return NULL;
+		}
 	}
-	struct mmap_file_info* mfi = malloc (sizeof (struct mmap_file_info));
-	mfi->start = (uint64_t) addr;
-	mfi->end = (uint64_t) pg_round_down((uint64_t) addr + length -1);
-	list_push_back(&mmap_file_list, &mfi->elem);
+	region->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	region->vma.start = addr;
+	region->vma.end = (uint8_t *) addr + region->page_cnt * PGSIZE;
+	region->vma.type = file != NULL ? VM_FILE : VM_ANON;
+	region->vma.writable = writable;
+	region->vma.init = file != NULL ? lazy_load_file : vm_load_zero;
+	region->vma.file = region->file;
+	region->vma.ofs = offset;
+	region->vma.read_bytes = file != NULL ? length : 0;
+	region->vma.fault_around = 0;
+	region->vma.li = NULL;
+	region->vma.advice = MADV_NORMAL;
+	region->vma.mmap = true;
+	if (!vma_insert (spt, &region->vma)) {
+		file_close (region->file);
+		free (region);
+		return NULL;
+	}
+	list_push_back (&spt->mmaps, &region->elem);
 	return addr;
 }
 
+/* Maps in the current thread, at the same addresses, every anonymous
+ * region that SRC, the spt of its parent, has mapped, for fork.  The
+ * pages themselves are copied with the rest of the parent's.  Returns
+ * false if memory runs out. */
+bool
+mmap_copy (struct supplemental_page_table *src) {
+	struct list_elem *e;
+
+	for (e = list_begin (&src->mmaps); e != list_end (&src->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+
+		if (region->file == NULL
+				&& do_mmap (region->addr, region->page_cnt * PGSIZE,
+					region->vma.writable, NULL, 0) == NULL)
+			return false;
+	}
+	return true;
+}
+
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->mmaps); e != list_end (&spt->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+
+		if (region->addr == addr) {
+			mmap_region_unmap (spt, region);
+			return;
+		}
+	}
+}
+
+/* Resizes the region mapped at OLD, of OLD_LEN bytes, to NEW_LEN
+ * bytes without copying a page, for mremap().  A region that shrinks
+ * loses the pages past its new end as with munmap().  One that grows
+ * does so in place if the pages after it are free, or else, if FLAGS
+ * has MREMAP_MAYMOVE, moves to the first free range after it that is
+ * large enough: its pages, loaded or not, go along with their page
+ * table entries, keeping their frames and swap slots.  A file region
+ * that grows maps that much more of its file.
+ * Returns the region's address, or a null pointer, leaving the region
+ * as it was, if OLD and OLD_LEN are not those of a region, there is no
+ * room for it, or memory runs out. */
+void *
+do_mremap (void *old, size_t old_len, size_t new_len, int flags) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	size_t new_cnt = DIV_ROUND_UP (new_len, PGSIZE);
+	struct mmap_region *region = NULL;
+	struct list_elem *e;
+	uint8_t *end, *to;
+
+	for (e = list_begin (&spt->mmaps); e != list_end (&spt->mmaps);
+			e = list_next (e))
+		if (list_entry (e, struct mmap_region, elem)->addr == old) {
+			region = list_entry (e, struct mmap_region, elem);
+			break;
+		}
+	if (region == NULL || DIV_ROUND_UP (old_len, PGSIZE) != region->page_cnt
+			|| new_cnt == 0)
+		return NULL;
+
+	end = (uint8_t *) region->addr + region->page_cnt * PGSIZE;
+	if (new_cnt < region->page_cnt) {
+		struct tlb_batch batch;
+
+		spt_freeze (spt);
+		tlb_batch_init (&batch, thread_leader ()->pml4);
+		mmap_writeback (region, new_cnt, &batch);
+		mmap_drop_pages (spt, region, new_cnt, &batch);
+		tlb_batch_flush (&batch);
+		spt_thaw (spt);
+		to = region->addr;
+	} else if (new_cnt == region->page_cnt
+			|| mmap_range_usable (spt, end,
+				(new_cnt - region->page_cnt) * PGSIZE))
+		to = region->addr;
+	else if (flags & MREMAP_MAYMOVE) {
+		to = vma_find_gap (spt, end, new_cnt * PGSIZE);
+		if (to == NULL || !mmap_range_usable (spt, to, new_cnt * PGSIZE)
+				|| !mmap_move_pages (spt, region, to))
+			return NULL;
+	} else
+		return NULL;
+
+	mmap_region_resize (spt, region, to, new_cnt);
+	if (region->file != NULL)
+		region->vma.read_bytes = new_len;
+	return to;
+}
+
+/* Returns true if the LENGTH bytes at ADDR may be mapped: they are in
+ * user space, overlap nothing, and are not kept for the stack. */
+static bool
+mmap_range_usable (struct supplemental_page_table *spt, void *addr,
+		size_t length) {
+	return (uint8_t *) addr + length > (uint8_t *) addr
+		&& is_user_vaddr ((uint8_t *) addr + length)
+		&& vma_range_is_free (spt, addr, length)
+		&& !vm_stack_reserved (addr, length);
+}
+
+/* Makes REGION of SPT cover the PAGE_CNT pages at ADDR, which must be
+ * free apart from REGION itself. */
+static void
+mmap_region_resize (struct supplemental_page_table *spt,
+		struct mmap_region *region, void *addr, size_t page_cnt) {
+	bool ok;
+
+	vma_remove (spt, &region->vma);
+	region->addr = addr;
+	region->page_cnt = page_cnt;
+	region->vma.start = addr;
+	region->vma.end = (uint8_t *) addr + page_cnt * PGSIZE;
+	/* The pages not yet loaded find their offsets from the start. */
+	if (region->vma.li != NULL)
+		region->vma.li->start = addr;
+	ok = vma_insert (spt, &region->vma);
+	ASSERT (ok);
+}
+
+/* Moves the pages of REGION of SPT, which is of the current thread,
+ * to the free range at TO: their page table entries, then their
+ * struct pages.  Returns false, leaving the pages where they were,
+ * if memory for a page table ran out. */
+static bool
+mmap_move_pages (struct supplemental_page_table *spt,
+		struct mmap_region *region, uint8_t *to) {
+	uint8_t *from = region->addr;
+	struct tlb_batch batch;
+	size_t i;
+
+	/* Keep the eviction of a page from looking it up meanwhile. */
+	spt_freeze (spt);
+	tlb_batch_init (&batch, thread_leader ()->pml4);
+	for (i = 0; i < region->page_cnt; i++)
+		if (!pml4_move_page (&batch, from + i * PGSIZE, to + i * PGSIZE)) {
+			while (i-- > 0)
+				pml4_move_page (&batch, to + i * PGSIZE, from + i * PGSIZE);
+			tlb_batch_flush (&batch);
+			spt_thaw (spt);
+			return false;
+		}
+	for (i = 0; i < region->page_cnt; i++) {
+		struct page *page = spt_find_page (spt, from + i * PGSIZE);
+
+		if (page != NULL) {
+			hash_delete (spt->page_table, &page->hash_elem);
+			page->va = to + i * PGSIZE;
+			hash_insert (spt->page_table, &page->hash_elem);
+		}
+	}
+	tlb_batch_flush (&batch);
+	spt_thaw (spt);
+	return true;
+}
+
+/* Removes REGION, a mapped region of the current thread, from SPT:
+ * writes its dirty pages back, unmaps and frees its pages, and
+ * closes its file. */
+void
+mmap_region_unmap (struct supplemental_page_table *spt,
+		struct mmap_region *region) {
+	struct thread *curr = thread_leader ();
+	struct tlb_batch batch;
+
+	/* Keep the region's pages from being evicted, and so written back
+	 * on their own, until they are gone.  Their TLB entries are
+	 * invalidated together at the end. */
+	spt_freeze (spt);
+	tlb_batch_init (&batch, curr->pml4);
+	mmap_writeback (region, 0, &batch);
+	mmap_drop_pages (spt, region, 0, &batch);
+	tlb_batch_flush (&batch);
+	vma_remove (spt, &region->vma);
+	spt_thaw (spt);
+
+	/* An anonymous region's pages shared the load_info of its area. */
+	if (region->vma.li != NULL)
+		load_info_release (region->vma.li);
+	file_close (region->file);
+	list_remove (&region->elem);
+	free (region);
+}
+
+/* Unmaps and frees the pages of REGION of SPT, which is frozen, from
+ * page FIRST of the region on, once written back.  Invalidating their
+ * TLB entries is left to BATCH. */
+static void
+mmap_drop_pages (struct supplemental_page_table *spt,
+		struct mmap_region *region, size_t first, struct tlb_batch *batch) {
+	struct thread *curr = thread_leader ();
+	size_t i;
+
+	ASSERT (spt_is_frozen (spt));
+	for (i = first; i < region->page_cnt; i++) {
+		void *va = (uint8_t *) region->addr + i * PGSIZE;
+		struct page *page = spt_find_page (spt, va);
+		void *kva;
+
+		if (page == NULL) {
+			vm_drop_swapped (va);
+			continue;
+		}
+		kva = page->frame != NULL ? page->frame->kva : NULL;
+		hash_delete (spt->page_table, &page->hash_elem);
+		vm_dealloc_page (page);
+		/* The frame was emptied but is still mapped, unless another
+		 * mapping of the file page shares it. */
+		if (kva != NULL && pml4_get_page (curr->pml4, va) != NULL) {
+			pml4_clear_page_batched (batch, va);
+			palloc_free_page (kva);
+		}
+	}
+}
+
+/* Returns true if PAGE is a loaded, resident file page that was
+ * written since it was last written back. */
+static bool
+mmap_page_dirty (struct page *page) {
+	return page != NULL && page->operations->type == VM_FILE
+		&& page->frame != NULL && pml4_is_dirty (page->owner->pml4, page->va);
+}
+
+/* Writes the dirty pages of REGION back to its file, from page FIRST
+ * of the region on, each run of adjacent dirty pages with a single
+ * write.  The region maps its file in order, so runs go out in order
+ * of file offset.  The data is read
+ * through the region's own virtual addresses, which stay mapped as
+ * the caller has frozen the spt.  Invalidating the TLB
+ * entries of the pages cleaned is left to BATCH. */
+static void
+mmap_writeback (struct mmap_region *region, size_t first,
+		struct tlb_batch *batch) {
+	struct thread *curr = thread_leader ();
+	size_t i = first;
+
+	ASSERT (spt_is_frozen (&curr->spt));
+	while (i < region->page_cnt) {
+		struct page *first = NULL;
+		off_t bytes = 0;
+		size_t run;
+
+		for (run = 0; i + run < region->page_cnt; run++) {
+			struct page *page = spt_find_page (&curr->spt,
+					(uint8_t *) region->addr + (i + run) * PGSIZE);
+
+			if (!mmap_page_dirty (page))
+				break;
+			if (first == NULL)
+				first = page;
+			pml4_set_dirty_batched (batch, page->va, false);
+			/* Write the page back for the mappings sharing it too. */
+			if (page->frame->ref_cnt > 1)
+				frame_test_and_clear_dirty (page->frame);
+			bytes += mmap_page_bytes (page);
+			/* A short page ends the data, and so the run. */
+			if (mmap_page_bytes (page) != PGSIZE) {
+				run++;
+				break;
+			}
+		}
+		if (run == 0) {
+			i++;
+			continue;
+		}
+		mmap_write_user (region->file, first->va, bytes, first->file.ofs);
+		i += run;
+	}
+}
+
+/* Returns the number of bytes of PAGE, a resident file page, to
+ * write back: those of its mapping, or, if it shares a file cache
+ * frame, all of the file's bytes in the page, which the other
+ * mappings may have written. */
+static off_t
+mmap_page_bytes (struct page *page) {
+	off_t bytes;
+
+	if (page->frame->ref_cnt == 1)
+		return page->file.size;
+	bytes = file_length (page->file.file) - page->file.ofs;
+	return bytes < 0 ? 0 : bytes < PGSIZE ? bytes : PGSIZE;
+}
+
+/* Writes the SIZE bytes of a mapping of FILE at BUFFER, a frame's
+ * kernel address, back to FILE at OFS.  Unlike file_write_at(),
+ * leaves the file cache alone: they come from its own frames or from
+ * frames no longer in it.  Whole sectors go straight to the disk
+ * rather than through the buffer cache. */
+static void
+mmap_write (struct file *file, const void *buffer, off_t size, off_t ofs) {
+	inode_write_direct (file_get_inode (file), buffer, size, ofs);
+}
+
+/* Like mmap_write(), but for BUFFER in the running process's own
+ * mapping, which may run over many pages.  They are gathered into
+ * wb_buffer, to go to the disk in transfers of many sectors each
+ * rather than a page or a sector at a time. */
+static void
+mmap_write_user (struct file *file, const void *buffer_, off_t size,
+		off_t ofs) {
+	const uint8_t *buffer = buffer_;
+
+	lock_acquire (&wb_lock);
+	while (size > 0) {
+		off_t chunk = size < WB_PAGES * PGSIZE ? size : WB_PAGES * PGSIZE;
+
+		memcpy (wb_buffer, buffer, chunk);
+		if (inode_write_direct (file_get_inode (file), wb_buffer, chunk, ofs)
+				!= chunk)
+			break;
+		buffer += chunk;
+		size -= chunk;
+		ofs += chunk;
+	}
+	lock_release (&wb_lock);
 }
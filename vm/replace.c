@@ -0,0 +1,322 @@
+/* replace.c: Page replacement policies for the frame table. */
+
+#include "vm/replace.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "lib/kernel/hash.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Frame table handed to the policy's init(). */
+static struct frame *table;
+static size_t table_cnt;
+static size_t hand;             /* Next table index a clock inspects. */
+
+/* Sets the accessed bit of FRAME's primary mapping, so that a clock
+ * gives it a second chance. */
+static void
+frame_mark_accessed (struct frame *frame) {
+	struct page *page = frame->page;
+
+	pml4_set_accessed (page->owner->pml4, page->va, true);
+}
+
+/* Returns true if FRAME may be evicted now.  Clearing the accessed
+ * bits comes first so that frames shared copy-on-write age like any
+ * other, though they are never evicted.  Frames the owners' quotas
+ * protect keep their bits. */
+static bool
+clock_pick (struct frame *frame) {
+	return frame->evictable && frame_quota_evictable (frame)
+		&& !frame_test_and_clear_accessed (frame)
+		&& frame_is_evictable_shared (frame);
+}
+
+/* Clock: one hand sweeps the frame table, giving recently accessed
+ * frames a second chance. */
+
+static void
+clock_init (struct frame *table_, size_t cnt) {
+	table = table_;
+	table_cnt = cnt;
+	hand = 0;
+}
+
+static void
+clock_insert (struct frame *frame UNUSED) {
+}
+
+static void
+clock_remove (struct frame *frame UNUSED) {
+}
+
+static struct frame *
+clock_select_victim (void) {
+	/* Two full turns clear every accessed bit, so a victim turns up
+	 * within them unless every frame is shared or busy. */
+	size_t budget = 2 * table_cnt;
+
+	while (budget-- > 0) {
+		struct frame *f = &table[hand];
+		hand = (hand + 1) % table_cnt;
+
+		if (clock_pick (f))
+			return f;
+	}
+	return NULL;
+}
+
+static const struct replace_policy clock_policy = {
+	.name = "clock",
+	.init = clock_init,
+	.insert = clock_insert,
+	.access = frame_mark_accessed,
+	.remove = clock_remove,
+	.select_victim = clock_select_victim,
+};
+
+/* Two-handed clock: a front hand clears accessed bits and a back hand,
+ * SPREAD frames behind it, evicts frames not accessed since.  Unlike
+ * the single hand, which may go a whole turn between clearing a bit
+ * and checking it, the spread bounds how long a page has to prove
+ * itself, so large memories do not degrade to FIFO. */
+
+static size_t spread;           /* Distance between the hands. */
+
+static void
+clock2_init (struct frame *table_, size_t cnt) {
+	clock_init (table_, cnt);
+	spread = cnt / 4 > 0 ? cnt / 4 : 1;
+}
+
+static struct frame *
+clock2_select_victim (void) {
+	size_t budget = 2 * table_cnt;
+
+	while (budget-- > 0) {
+		struct frame *front = &table[hand];
+		struct frame *back = &table[(hand + table_cnt - spread) % table_cnt];
+		hand = (hand + 1) % table_cnt;
+
+		if (front->evictable)
+			frame_test_and_clear_accessed (front);
+		if (clock_pick (back))
+			return back;
+	}
+	return NULL;
+}
+
+static const struct replace_policy clock2_policy = {
+	.name = "clock2",
+	.init = clock2_init,
+	.insert = clock_insert,
+	.access = frame_mark_accessed,
+	.remove = clock_remove,
+	.select_victim = clock2_select_victim,
+};
+
+/* 2Q (Johnson and Shasha): frames of pages faulted in for the first
+ * time enter A1in, a FIFO.  Pages leaving A1in are remembered in
+ * A1out, which holds identities only.  A page faulted in again while
+ * A1out remembers it has proven itself and enters Am, a clock.
+ * Reclaiming from A1in while it holds more than KIN frames lets pages
+ * touched only once, such as those of a scan, pass through without
+ * evicting the working set in Am. */
+
+enum twoq_queue {
+	QUEUE_NONE,                 /* Not evictable. */
+	QUEUE_A1IN,                 /* In a1in. */
+	QUEUE_AM,                   /* In am. */
+};
+
+/* An identity remembered in A1out. */
+struct ghost {
+	struct thread *owner;       /* Null if unused. */
+	void *va;
+	struct list_elem elem;      /* Element in a ghost_buckets list. */
+};
+
+static struct list a1in;
+static struct list am;
+static size_t a1in_cnt;
+static size_t am_cnt;
+static size_t kin;              /* Share of A1in, in frames. */
+
+/* A1out: ring of KOUT ghosts, hashed into GHOST_BUCKETS. */
+static struct ghost *ghosts;
+static size_t kout;
+static size_t ghost_next;       /* Oldest ghost, reused next. */
+static struct list *ghost_buckets;
+
+static void
+twoq_init (struct frame *table_, size_t cnt) {
+	size_t i;
+
+	clock_init (table_, cnt);
+	list_init (&a1in);
+	list_init (&am);
+	a1in_cnt = am_cnt = 0;
+	kin = cnt / 4 > 0 ? cnt / 4 : 1;
+
+	kout = cnt / 2 > 0 ? cnt / 2 : 1;
+	ghosts = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP (kout * sizeof *ghosts, PGSIZE));
+	ghost_buckets = palloc_get_multiple (PAL_ASSERT,
+			DIV_ROUND_UP (kout * sizeof *ghost_buckets, PGSIZE));
+	for (i = 0; i < kout; i++)
+		list_init (&ghost_buckets[i]);
+	ghost_next = 0;
+}
+
+/* Returns the A1out bucket for the page at VA of OWNER. */
+static struct list *
+ghost_bucket (struct thread *owner, void *va) {
+	uint64_t h = hash_ptr (owner) ^ hash_ptr (va);
+
+	return &ghost_buckets[h % kout];
+}
+
+/* Remembers PAGE in A1out, forgetting the oldest ghost. */
+static void
+ghost_remember (struct page *page) {
+	struct ghost *g = &ghosts[ghost_next];
+
+	ghost_next = (ghost_next + 1) % kout;
+	if (g->owner != NULL)
+		list_remove (&g->elem);
+	g->owner = page->owner;
+	g->va = page->va;
+	list_push_front (ghost_bucket (g->owner, g->va), &g->elem);
+}
+
+/* Returns true if A1out remembers PAGE, and forgets it. */
+static bool
+ghost_forget (struct page *page) {
+	struct list *bucket = ghost_bucket (page->owner, page->va);
+	struct list_elem *e;
+
+	for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e)) {
+		struct ghost *g = list_entry (e, struct ghost, elem);
+
+		if (g->owner == page->owner && g->va == page->va) {
+			list_remove (&g->elem);
+			g->owner = NULL;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+twoq_insert (struct frame *frame) {
+	if (ghost_forget (frame->page)) {
+		frame->replace_queue = QUEUE_AM;
+		list_push_back (&am, &frame->replace_elem);
+		am_cnt++;
+	} else {
+		frame->replace_queue = QUEUE_A1IN;
+		list_push_back (&a1in, &frame->replace_elem);
+		a1in_cnt++;
+	}
+}
+
+/* References to frames in A1in are ignored: a page touched several
+ * times right after being faulted in is not thereby hot. */
+static void
+twoq_access (struct frame *frame) {
+	if (frame->replace_queue == QUEUE_AM)
+		frame_mark_accessed (frame);
+}
+
+static void
+twoq_remove (struct frame *frame) {
+	if (frame->replace_queue == QUEUE_A1IN)
+		a1in_cnt--;
+	else if (frame->replace_queue == QUEUE_AM)
+		am_cnt--;
+	else
+		return;
+	list_remove (&frame->replace_elem);
+	frame->replace_queue = QUEUE_NONE;
+}
+
+/* Returns the oldest unshared frame of A1in that quotas allow, remembering its page in
+ * A1out, or a null pointer if there is none. */
+static struct frame *
+a1in_select_victim (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&a1in); e != list_end (&a1in); e = list_next (e)) {
+		struct frame *f = list_entry (e, struct frame, replace_elem);
+
+		if (frame_is_evictable_shared (f) && frame_quota_evictable (f)) {
+			ghost_remember (f->page);
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/* Runs the clock over Am, rotating frames that get a second chance
+ * to the back. */
+static struct frame *
+am_select_victim (void) {
+	size_t budget = 2 * am_cnt;
+
+	while (budget-- > 0) {
+		struct frame *f = list_entry (list_front (&am), struct frame,
+				replace_elem);
+
+		if (clock_pick (f))
+			return f;
+		list_push_back (&am, list_pop_front (&am));
+	}
+	return NULL;
+}
+
+static struct frame *
+twoq_select_victim (void) {
+	struct frame *victim = NULL;
+
+	if (a1in_cnt > kin || am_cnt == 0)
+		victim = a1in_select_victim ();
+	if (victim == NULL)
+		victim = am_select_victim ();
+	if (victim == NULL)
+		victim = a1in_select_victim ();
+	return victim;
+}
+
+static const struct replace_policy twoq_policy = {
+	.name = "2q",
+	.init = twoq_init,
+	.insert = twoq_insert,
+	.access = twoq_access,
+	.remove = twoq_remove,
+	.select_victim = twoq_select_victim,
+};
+
+static const struct replace_policy *policies[] = {
+	&clock_policy,
+	&clock2_policy,
+	&twoq_policy,
+};
+
+const struct replace_policy *replace_policy = &clock_policy;
+
+/* Makes the policy called NAME the one in use.  Returns false if
+ * there is no such policy.  Must be called before vm_init(). */
+bool
+replace_policy_select (const char *name) {
+	size_t i;
+
+	for (i = 0; i < sizeof policies / sizeof *policies; i++)
+		if (!strcmp (policies[i]->name, name)) {
+			replace_policy = policies[i];
+			return true;
+		}
+	return false;
+}
@@ -0,0 +1,292 @@
+/* shm.c: Anonymous shared memory segments, attached by key. */
+
+#include "vm/vm.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/shm.h"
+
+static bool shm_swap_in (struct page *page, void *kva);
+static bool shm_swap_out (struct page *page);
+static void shm_destroy (struct page *page);
+
+static const struct page_operations shm_ops = {
+	.swap_in = shm_swap_in,
+	.swap_out = shm_swap_out,
+	.destroy = shm_destroy,
+	.type = VM_SHM,
+};
+
+/* All segments, and their attach_cnt.  Segments are few, so a list
+ * will do. */
+static struct list shms;
+static struct lock shm_lock;
+
+static struct shm *shm_get (int key, size_t page_cnt);
+static void shm_put (struct shm *);
+
+/* Initializes the shared memory segments to none. */
+void
+vm_shm_init (void) {
+	list_init (&shms);
+	lock_init (&shm_lock);
+}
+
+/* Attaches the segment named KEY at ADDR, for LENGTH bytes, making it
+ * with that many if there is no such segment, and returns ADDR.
+ * Returns a null pointer if the segment is smaller than LENGTH or
+ * memory runs out.  The caller has checked that the pages from ADDR
+ * are free. */
+void *
+shm_attach (void *addr, int key, size_t length) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+	struct shm_region *region = malloc (sizeof *region);
+	size_t i;
+
+	if (region == NULL)
+		return NULL;
+	region->addr = addr;
+	region->page_cnt = 0;
+	region->shm = shm_get (key, page_cnt);
+	if (region->shm == NULL) {
+		free (region);
+		return NULL;
+	}
+	list_push_back (&spt->shms, &region->elem);
+
+	for (i = 0; i < page_cnt; i++) {
+		struct page *page = kmem_cache_alloc (page_slab);
+
+		if (page == NULL) {
+			shm_region_detach (spt, region);
+			return NULL;
+		}
+		*page = (struct page) {
+			.operations = &shm_ops,
+			.va = (uint8_t *) addr + i * PGSIZE,
+			.frame = NULL,
+			.writable = true,
+			.owner = thread_leader (),
+			.shm = (struct shm_page) {
+				.shm = region->shm,
+				.idx = i,
+			},
+		};
+		spt_insert_page (spt, page);
+		region->page_cnt++;
+	}
+	return addr;
+}
+
+/* Detaches the segment the current thread attached at ADDR, if any. */
+void
+shm_detach (void *addr) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->shms); e != list_end (&spt->shms);
+			e = list_next (e)) {
+		struct shm_region *region = list_entry (e, struct shm_region, elem);
+
+		if (region->addr == addr) {
+			shm_region_detach (spt, region);
+			return;
+		}
+	}
+}
+
+/* Removes REGION, a segment attached by the current thread, from
+ * SPT: unmaps and frees its pages and drops the attachment. */
+void
+shm_region_detach (struct supplemental_page_table *spt,
+		struct shm_region *region) {
+	size_t i;
+
+	/* Keep the pages from being evicted while they go away. */
+	spt_freeze (spt);
+	for (i = 0; i < region->page_cnt; i++) {
+		struct page *page = spt_find_page (spt,
+				(uint8_t *) region->addr + i * PGSIZE);
+
+		hash_delete (spt->page_table, &page->hash_elem);
+		vm_dealloc_page (page);
+	}
+	spt_thaw (spt);
+
+	shm_put (region->shm);
+	list_remove (&region->elem);
+	free (region);
+}
+
+/* Attaches to the current thread every segment that SRC, the spt of
+ * its parent, has attached, at the same addresses, for fork.
+ * Returns false if memory runs out. */
+bool
+shm_copy (struct supplemental_page_table *src) {
+	struct list_elem *e;
+
+	for (e = list_begin (&src->shms); e != list_end (&src->shms);
+			e = list_next (e)) {
+		struct shm_region *region = list_entry (e, struct shm_region, elem);
+
+		if (shm_attach (region->addr, region->shm->key,
+					region->page_cnt * PGSIZE) == NULL)
+			return false;
+	}
+	return true;
+}
+
+/* Returns the segment named KEY with a new attachment, making one
+ * of PAGE_CNT pages if there is none.  Returns a null pointer if the
+ * segment has fewer pages or memory runs out. */
+static struct shm *
+shm_get (int key, size_t page_cnt) {
+	struct shm *shm = NULL;
+	struct list_elem *e;
+	size_t i;
+
+	lock_acquire (&shm_lock);
+	for (e = list_begin (&shms); e != list_end (&shms); e = list_next (e))
+		if (list_entry (e, struct shm, elem)->key == key) {
+			shm = list_entry (e, struct shm, elem);
+			break;
+		}
+	if (shm == NULL) {
+		shm = malloc (sizeof *shm);
+		if (shm != NULL) {
+			shm->frames = calloc (page_cnt, sizeof *shm->frames);
+			shm->slots = malloc (page_cnt * sizeof *shm->slots);
+		}
+		if (shm == NULL || shm->frames == NULL || shm->slots == NULL) {
+			if (shm != NULL) {
+				free (shm->frames);
+				free (shm->slots);
+				free (shm);
+			}
+			lock_release (&shm_lock);
+			return NULL;
+		}
+		shm->key = key;
+		shm->page_cnt = page_cnt;
+		shm->attach_cnt = 0;
+		lock_init (&shm->lock);
+		for (i = 0; i < page_cnt; i++)
+			shm->slots[i] = INVALID_SLOT_IDX;
+		list_push_back (&shms, &shm->elem);
+	} else if (shm->page_cnt < page_cnt)
+		shm = NULL;
+	if (shm != NULL)
+		shm->attach_cnt++;
+	lock_release (&shm_lock);
+	return shm;
+}
+
+/* Drops an attachment of SHM, freeing it with the last one.  No page
+ * maps its frames by then. */
+static void
+shm_put (struct shm *shm) {
+	size_t i;
+
+	lock_acquire (&shm_lock);
+	if (--shm->attach_cnt > 0) {
+		lock_release (&shm_lock);
+		return;
+	}
+	list_remove (&shm->elem);
+	lock_release (&shm_lock);
+
+	for (i = 0; i < shm->page_cnt; i++) {
+		if (shm->frames[i] != NULL)
+			palloc_free_page (shm->frames[i]->kva);
+		if (shm->slots[i] != INVALID_SLOT_IDX)
+			anon_slot_free (shm->slots[i]);
+	}
+	free (shm->frames);
+	free (shm->slots);
+	free (shm);
+}
+
+/* Loads PAGE's contents into the new frame at KVA: from swap if the
+ * segment's page was swapped out, else zeros.  The caller holds the
+ * segment's lock. */
+static bool
+shm_swap_in (struct page *page, void *kva) {
+	struct shm *shm = page->shm.shm;
+	size_t idx = page->shm.idx;
+
+	ASSERT (lock_held_by_current_thread (&shm->lock));
+	if (shm->slots[idx] != INVALID_SLOT_IDX) {
+		anon_slot_read (shm->slots[idx], kva);
+		anon_slot_free (shm->slots[idx]);
+		shm->slots[idx] = INVALID_SLOT_IDX;
+	} else
+		memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Swaps the segment page in PAGE's frame out, taking the frame from
+ * every process mapping it.  Returns false if swap is full. */
+static bool
+shm_swap_out (struct page *page) {
+	struct shm *shm = page->shm.shm;
+	size_t idx = page->shm.idx;
+	struct frame *frame = page->frame;
+	size_t slot_idx = anon_slot_alloc ();
+
+	if (slot_idx == INVALID_SLOT_IDX)
+		return false;
+
+	/* Faults on the page wait until it is in swap.  As with other
+	 * anonymous pages, it is unmapped only after a write during which
+	 * no process dirtied it again. */
+	lock_acquire (&shm->lock);
+	for (;;) {
+		enum intr_level old_level;
+		struct list_elem *e;
+		bool dirty = false;
+
+		frame_test_and_clear_dirty (frame);
+		anon_slot_write (slot_idx, frame->kva);
+
+		old_level = intr_disable ();
+		for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+				e = list_next (e)) {
+			struct page *p = list_entry (e, struct page, frame_elem);
+
+			dirty |= pml4_is_dirty (p->owner->pml4, p->va);
+		}
+		if (!dirty)
+			for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+					e = list_next (e)) {
+				struct page *p = list_entry (e, struct page, frame_elem);
+
+				pml4_clear_page (p->owner->pml4, p->va);
+				p->frame = NULL;
+			}
+		intr_set_level (old_level);
+		if (!dirty)
+			break;
+	}
+	shm->frames[idx] = NULL;
+	shm->slots[idx] = slot_idx;
+	lock_release (&shm->lock);
+	return true;
+}
+
+/* Destroys PAGE, an attached segment page.  The frame, if any, stays
+ * with the segment. */
+static void
+shm_destroy (struct page *page) {
+	struct shm *shm = page->shm.shm;
+
+	lock_acquire (&shm->lock);
+	if (page->frame != NULL)
+		vm_free_frame (page);
+	lock_release (&shm->lock);
+}
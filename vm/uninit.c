@@ -62,8 +62,12 @@ uninit_initialize (struct page *page, void *kva) {
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	/* If you don't have anything to do, just return. */
-	if (page->uninit.aux != NULL) free (page->uninit.aux);
-	return;
+	/* An executable segment page shares its load_info. */
+	if (page->uninit.aux == NULL)
+		return;
+	if (VM_TYPE (page->uninit.type) == VM_ANON)
+		load_info_release (page->uninit.aux);
+	else
+		free (page->uninit.aux);
 }
 
@@ -3,18 +3,184 @@
 #include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/replace.h"
 #include "lib/kernel/hash.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
+#include "filesys/inode.h"
+#include "filesys/tmpfs.h"
 #include "intrinsic.h"
+#include "user/syscall.h"
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/rgroup.h"
+#include "threads/trace.h"
+#include "threads/shrinker.h"
+#include "threads/workqueue.h"
 #include "threads/vaddr.h"
+#include "userprog/process.h"
 
-static struct list frame_list;
-static struct list_elem *clock_elem;
+/* Frame table: one entry per page user pages may come from, so the
+ * entry for a user page at KVA is frame_table[(KVA - frame_base) /
+ * PGSIZE].  Pages of the range the kernel has keep empty entries. */
+static struct frame *frame_table;
+static size_t frame_cnt;
+static uint8_t *frame_base;
+/* Protects the frame table's reverse maps and the replace_policy. */
 static struct lock clock_lock;
 
-static struct lock spt_kill_lock;
+/* Evictions in flight of frames mapped by more than one page, which
+ * every spt_freeze() waits out, and signalled under clock_lock as any
+ * eviction finishes. */
+static unsigned shared_evicting;
+static struct condition eviction_done;
+
+struct kmem_cache *page_slab;
+struct kmem_cache *load_info_slab;
+
+bool vm_huge_pages;
+bool vm_working_set;
+bool vm_ksm;
+
+/* Limits the replacement policy's choice of victim, by clock_lock: to
+ * frames of QUOTA_OWNER if it is not null, or of processes in
+ * QUOTA_GROUP if it is not null, otherwise, if QUOTA_STRICT, to frames
+ * of processes holding more than their quota floor. */
+static struct thread *quota_owner;
+static struct rgroup *quota_group;
+static bool quota_strict = true;
+
+/* Out-of-memory killer.  When no frame can be freed, as swap is full
+ * and every frame left is unevictable, vm_get_frame() kills the
+ * process holding the most frames instead of failing, and waits up to
+ * OOM_WAIT_TICKS for its frames to come back before trying again. */
+#define OOM_WAIT_TICKS (TIMER_FREQ / 2)
+static unsigned long long oom_kills;
+static bool vm_oom_kill (void);
+
+/* Swapped-out pages of anonymous areas are packed into their page
+ * table entries, and their struct page freed, once SWAP_PACK_BATCH of
+ * a process's pages, and an eighth of its table, went out since the
+ * last packing, making a packing's walk of the table cheap per page. */
+#define SWAP_PACK_BATCH 64
+
+/* Times vm_pin_range() loads its pages before giving up on them
+ * staying in memory. */
+#define PIN_TRIES 4
+
+/* Pages vm_release_frames() goes through before letting go of
+ * clock_lock for a moment. */
+#define RELEASE_BATCH 64
+static unsigned long long swap_packed;
+static void vm_pack_swapped (struct supplemental_page_table *spt);
+static pte_for_each_func spt_copy_swapped, spt_free_swapped;
+
+/* Page faults taken by every process, by class, and the classes'
+ * names.  Updated with interrupts off. */
+static struct fault_stat all_faults[FAULT_CLASS_CNT];
+static const char *fault_class_names[FAULT_CLASS_CNT] = {
+	[FAULT_ZERO] = "zero-fill",
+	[FAULT_EXEC] = "exec load",
+	[FAULT_MMAP] = "mmap load",
+	[FAULT_SWAP] = "swap-in",
+	[FAULT_STACK] = "stack",
+	[FAULT_COW] = "copy-on-write",
+	[FAULT_INVALID] = "invalid",
+};
+
+/* Swap daemon: a work item that evicts frames in the background once
+ * fewer than KSWAPD_LOW user pages are free, until KSWAPD_HIGH are,
+ * so that a fault usually finds a free frame instead of writing a
+ * victim out itself.  Never queued if the user pool is too small for
+ * the watermarks to mean anything. */
+static struct work kswapd_work;
+static size_t kswapd_low;
+static size_t kswapd_high;
+static void kswapd (void *aux UNUSED);
+
+/* Working set estimates are sampled once per this many victims. */
+#define WSS_SAMPLE_PERIOD 32
+static unsigned victim_cnt;
+
+/* The zero frame: a page of zeros that anonymous pages not yet
+ * written map read-only, so that reading them costs no memory.  The
+ * first write gives such a page a frame of its own, in vm_handle_wp().
+ * Never evicted, and never goes back to the user pool. */
+static struct frame *zero_frame;
+
+/* Text cache: frames holding read-only executable pages, by
+ * text_key, for processes running the same executable to share.
+ * Protected by clock_lock. */
+static struct hash text_cache;
+static uint64_t text_hash (const struct hash_elem *f_, void *aux UNUSED);
+static bool text_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED);
+
+/* File cache: frames holding mapped file pages, by file_key, for
+ * every mapping of the page to share and for read() and write() to
+ * go through while any is resident.  Only frames holding all of
+ * their file's bytes in the page, with zeros past its end, are
+ * entered, so the frame of a page is the same whatever mapping
+ * loaded it.  Protected by clock_lock. */
+static struct hash file_cache;
+static uint64_t file_cache_hash (const struct hash_elem *f_, void *aux UNUSED);
+static bool file_cache_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED);
+
+/* Same-page merging daemon: a work item that every KSM_SLEEP_MS looks
+ * at the next KSM_SCAN_BATCH frames of the frame table, and maps each anonymous
+ * page, alone on its frame, whose contents did not change since its
+ * last look onto a stable frame of the same contents, read-only, as
+ * fork shares frames.  A write to such a page gets it a copy of its
+ * own in vm_handle_wp().  Pages with no match become stable frames
+ * themselves.  Started only with vm_ksm. */
+#define KSM_SCAN_BATCH 64
+#define KSM_SLEEP_MS 20
+static struct work ksm_work;
+static size_t ksm_cursor;
+static void ksmd (void *aux UNUSED);
+static void ksm_scan_frame (struct frame *frame);
+
+/* Stable table: frames mapped read-only by every page mapping them,
+ * by contents, starting with the zero frame.  Protected by
+ * clock_lock. */
+static struct hash ksm_stable;
+static uint64_t ksm_stable_hash (const struct hash_elem *f_, void *aux UNUSED);
+static bool ksm_stable_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED);
+
+/* Frames scanned and pages merged by the daemon. */
+static uint64_t ksm_scanned;
+static uint64_t ksm_merged;
+
+/* Memory compaction: when a request for a run of pages fails while
+ * enough single pages are free, vm_compact() picks the aligned block
+ * of the run's size that the fewest user pages keep from being free,
+ * and moves those pages elsewhere, copying each to a new frame and
+ * remapping its page there, as same-page merging does.  Only
+ * anonymous pages alone on their frames are moved; a block holding
+ * any other page in use is not picked.  A request that cannot wait,
+ * as it comes with interrupts off or under clock_lock, queues the
+ * compaction as a work item for the next such request instead.
+ * COMPACT_TRIES blocks are tried at most per compaction. */
+#define COMPACT_TRIES 4
+static bool compact_ready;
+static struct lock compact_lock;
+static struct work compact_work;
+static unsigned compact_order;  /* Largest order queued, by interrupts
+                                   off. */
+static void kcompactd (void *aux UNUSED);
+static bool vm_compact_run (unsigned order);
+static unsigned long long compact_runs;
+static unsigned long long compact_freed;
+static unsigned long long compact_moved;
+
+static struct frame *frame_lookup (void *kva);
+static void frame_reset (struct frame *frame);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -22,19 +188,50 @@ void
 vm_init (void) {
 	vm_anon_init ();
 	vm_file_init ();
+	vm_shm_init ();
 #ifdef EFILESYS  /* For project 4 */
 	pagecache_init ();
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
-	lock_init(&spt_kill_lock);
-	list_init (&frame_list);
-	clock_elem = NULL;
+	cond_init (&eviction_done);
+	page_slab = kmem_cache_create ("page", sizeof (struct page), NULL);
+	load_info_slab = kmem_cache_create ("load_info", sizeof (struct load_info),
+			NULL);
+	if (page_slab == NULL || load_info_slab == NULL)
+		PANIC ("vm_init: out of memory");
+	frame_base = palloc_user_pool (&frame_cnt);
+	frame_table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+			DIV_ROUND_UP (frame_cnt * sizeof *frame_table, PGSIZE));
+	replace_policy->init (frame_table, frame_cnt);
 	lock_init (&clock_lock);
+	hash_init (&text_cache, text_hash, text_less, NULL);
+	hash_init (&file_cache, file_cache_hash, file_cache_less, NULL);
+	hash_init (&ksm_stable, ksm_stable_hash, ksm_stable_less, NULL);
+
+	void *zero = palloc_get_page (PAL_USER | PAL_ZERO | PAL_ASSERT);
+	zero_frame = frame_lookup (zero);
+	zero_frame->kva = zero;
+	frame_reset (zero_frame);
+	zero_frame->ksm_hash = hash_bytes (zero, PGSIZE);
+	zero_frame->merged = true;
+	hash_insert (&ksm_stable, &zero_frame->ksm_elem);
+
+	kswapd_low = palloc_user_page_cnt () / 64;
+	kswapd_high = palloc_user_page_cnt () / 32;
+	work_init (&kswapd_work, kswapd, NULL, PRI_DEFAULT);
+	/* Merging is for idle time. */
+	work_init (&ksm_work, ksmd, NULL, PRI_MIN);
+	if (vm_ksm)
+		work_queue (&ksm_work);
+	lock_init (&compact_lock);
+	work_init (&compact_work, kcompactd, NULL, PRI_DEFAULT);
+	compact_ready = true;
 }
 
 
+
 /* Get the type of the page. This function is useful if you want to know the
  * type of the page after it will be initialized.
  * This function is fully implemented now. */
@@ -50,16 +247,50 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner, struct rgroup *group,
+		unsigned **guard);
+static void vm_evict_done (unsigned *guard);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static struct frame *vm_evict_frame (struct thread *owner, struct rgroup *group);
+static void vm_sample_working_sets (void);
+static bool vm_page_is_fresh (struct page *page);
+static size_t vm_gather_swap_cluster (struct frame *victim,
+		struct frame **cluster);
+static void vm_swap_read_around (struct page *page, size_t slot_idx);
+static size_t vm_fault_around_cnt (struct page *page);
+static void vm_fault_around (struct page *page, size_t cnt);
+static bool vm_map_zero (struct page *page);
+static bool vm_try_huge (struct supplemental_page_table *spt, void *addr,
+		bool *success);
+static bool vm_demote_frame (struct frame *frame);
+static bool vm_demote_any (void);
+
+static bool vm_text_key (struct page *page, struct text_key *key);
+static bool vm_share_text (struct page *page, const struct text_key *key);
+static void vm_text_insert (struct frame *frame, const struct text_key *key);
+static bool vm_claim_shm (struct page *page);
+static size_t vm_advise_around (struct page *page, size_t around);
+static void vm_advise_fault (struct page *page);
+static void vm_prefetch_range (struct vma *vma, uint8_t *start, uint8_t *end);
+static void vm_drop_range (struct supplemental_page_table *spt,
+		uint8_t *start, uint8_t *end);
+static bool vm_handle_fault (struct intr_frame *f, void *addr, bool user,
+		bool write, bool not_present, int *cls);
+static int vm_fault_class (struct page *page);
+static void vm_fault_record (int cls, uint64_t cycles);
+static bool vm_file_key (struct page *page, struct file_key *key);
+static bool vm_share_file (struct page *page, const struct file_key *key);
+static void vm_file_insert (struct frame *frame, const struct file_key *key);
 
 static uint64_t page_hash (const struct hash_elem *p_, void *aux UNUSED);
 static bool page_less (const struct hash_elem *a_,
            const struct hash_elem *b_, void *aux UNUSED);
+static uint64_t page_va_hash (void *va);
+
+/* spt_lookup (page_table, va): the page of an SPT at VA, page-aligned,
+ * with page_hash() and page_less() inlined. */
+HASH_FIND_DEFINE (spt_lookup, struct page, hash_elem, void *, va, page_va_hash)
 
-static struct list_elem *list_next_cycle (struct list *lst,
-    struct list_elem *elem);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -68,7 +299,7 @@ bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
 
-	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
 	bool writable_aux = writable;
 
 	/* Check wheter the upage is already occupied or not. */
@@ -79,7 +310,9 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 		ASSERT(type != VM_UNINIT);
 		/* Insert the page into the spt. */
-		struct page* page = malloc (sizeof (struct page));
+		struct page* page = kmem_cache_alloc (page_slab);
+		if (page == NULL)
+			return false;
 		if (VM_TYPE(type) == VM_ANON){
 			uninit_new (page, upage, init, type, aux, anon_initializer);
 		}
@@ -88,6 +321,7 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		}
 
 		page -> writable = writable_aux;
+		page -> owner = thread_leader ();
 		spt_insert_page (spt, page);
 
 		return true;
@@ -98,14 +332,11 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
 spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page page;
 	/* TODO: Fill this function. */
-	page.va = pg_round_down (va);
-	struct hash_elem *e = hash_find (spt -> page_table, &page.hash_elem);
-	if (e == NULL) {
+	struct page *result = spt_lookup (spt -> page_table, pg_round_down (va));
+	if (result == NULL) {
 		return NULL;
 	}
-	struct page *result = hash_entry (e, struct page, hash_elem);
 	ASSERT((va < result -> va + PGSIZE) && va >= result -> va);
 
 	return result;
@@ -126,235 +357,2723 @@ spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 	return true;
 }
 
-static struct list_elem *
-list_next_cycle (struct list *lst, struct list_elem *elem) {
-      struct list_elem *cand_elem = elem;
-      if (cand_elem == list_back (lst))
-	    // Repeat from the front
-	    cand_elem = list_front (lst);
-      else
-	    cand_elem = list_next (cand_elem);
-      return cand_elem;
+/* Returns the thread whose supplemental page table is SPT. */
+static struct thread *
+spt_thread (struct supplemental_page_table *spt) {
+	return (struct thread *) ((uint8_t *) spt - offsetof (struct thread, spt));
 }
 
-/* Get the struct frame, that will be evicted. */
-static struct frame *
-vm_get_victim (void) {
-	struct frame *candidate = NULL;
-	struct thread *curr = thread_current ();
+/* Packs the swapped-out pages of SPT, the current process's, that
+ * lie in anonymous areas into their page table entries and frees
+ * their struct page; vma_materialize() makes them again when they are
+ * next touched.  The stack's pages, outside any area, stay. */
+static void
+vm_pack_swapped (struct supplemental_page_table *spt) {
+	uint64_t *pml4 = thread_leader ()->pml4;
+	struct hash_iterator i;
+	struct list packed;
 
-	lock_acquire (&clock_lock);
-	struct list_elem *cand_elem = clock_elem;
-	if (cand_elem == NULL && !list_empty (&frame_list)) {
-		cand_elem = list_front(&frame_list);
+	spt->swapped = 0;
+	list_init (&packed);
+	/* With no eviction in flight, a page without a frame keeps its
+	 * slot, and its frame_elem is free to collect it with. */
+	spt_freeze (spt);
+	hash_first (&i, spt->page_table);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page,
+				hash_elem);
+		struct vma *vma;
+
+		if (page->operations->type != VM_ANON || page->frame != NULL
+				|| page->anon.swap_slot_idx == INVALID_SLOT_IDX)
+			continue;
+		vma = vma_find (spt, page->va);
+		if (vma != NULL && VM_TYPE (vma->type) == VM_ANON)
+			list_push_back (&packed, &page->frame_elem);
 	}
-	while (cand_elem != NULL) {
-		candidate = list_entry (cand_elem, struct frame, elem);
-		if (!pml4_is_accessed (curr->pml4, candidate->page->va)) {
-			break;
-		}
-		pml4_set_accessed (curr->pml4, candidate->page->va, false);
+	while (!list_empty (&packed)) {
+		struct page *page = list_entry (list_pop_front (&packed),
+				struct page, frame_elem);
 
-		cand_elem = list_next_cycle (&frame_list, cand_elem);
+		if (!pml4_set_swap (pml4, page->va, page->anon.swap_slot_idx,
+					page->writable))
+			continue;
+		page->anon.swap_slot_idx = INVALID_SLOT_IDX;
+		hash_delete (spt->page_table, &page->hash_elem);
+		vm_dealloc_page (page);
+		swap_packed++;
 	}
+	spt_thaw (spt);
+}
 
-	clock_elem = list_next_cycle (&frame_list, cand_elem);
-	list_remove (cand_elem);
-	lock_release (&clock_lock);
+/* Makes the page at VA of the current process, whose supplemental
+ * page table is SPT, a swapped-out anonymous page in swap slot SLOT
+ * again, out of the page table entry it was packed into.  Returns the
+ * page, or a null pointer, keeping the entry, if memory runs out. */
+struct page *
+vm_page_from_swap (struct supplemental_page_table *spt, void *va,
+		size_t slot, bool writable) {
+	struct thread *curr = thread_leader ();
+	struct page *page = kmem_cache_alloc (page_slab);
 
-	return candidate;
+	if (page == NULL)
+		return NULL;
+	*page = (struct page) {
+		.va = va,
+		.writable = writable,
+		.owner = curr,
+	};
+	anon_initializer (page, VM_ANON, NULL);
+	page->anon.swap_slot_idx = slot;
+	pml4_clear_swap (curr->pml4, va);
+	spt_insert_page (spt, page);
+	return page;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
-static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	if (victim == NULL) {
-		return NULL;
-	}
-	
-	// swap out the victim and return the evicted frame
-	struct page *page = victim->page;
-	bool swap_done = swap_out (page);
-	if (!swap_done) PANIC("Swap is full\n");
+/* Frees the swap slot of the page at VA of the current process if the
+ * page was packed into its page table entry. */
+void
+vm_drop_swapped (void *va) {
+	uint64_t *pml4 = thread_leader ()->pml4;
+	size_t slot;
+	bool rw;
 
-	// clear Frame
-	victim->page = NULL;
-	memset (victim->kva, 0, PGSIZE);
-	return victim;
+	if (pml4_get_swap (pml4, va, &slot, &rw)) {
+		pml4_clear_swap (pml4, va);
+		anon_slot_free (slot);
+	}
 }
 
-/* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+/* Returns the frame table entry for the user pool page at KVA. */
 static struct frame *
-vm_get_frame (void) {
-	struct frame *frame = malloc(sizeof (struct frame));
-	frame->kva = palloc_get_page (PAL_USER);
+frame_lookup (void *kva) {
+	size_t idx = ((uint8_t *) kva - frame_base) / PGSIZE;
+
+	ASSERT (pg_ofs (kva) == 0);
+	ASSERT ((uint8_t *) kva >= frame_base && idx < frame_cnt);
+	return &frame_table[idx];
+}
+
+/* Resets FRAME, whose page is about to return to the user pool or
+ * be reused, to hold no pages. */
+static void
+frame_reset (struct frame *frame) {
 	frame->page = NULL;
-	
-	// implement swap case
-	if (frame->kva == NULL) {
-		free (frame);
-		frame = vm_evict_frame();
+	frame->ref_cnt = 0;
+	frame->evictable = false;
+	frame->huge = false;
+	frame->pin_cnt = 0;
+	list_init (&frame->pages);
+}
+
+/* Counts DELTA more frames resident in the process of OWNER, its
+ * leader, and in its resource group.  Caller must hold clock_lock. */
+static inline void
+rss_add (struct thread *owner, int delta) {
+	owner->spt.rss += delta;
+	owner->rgroup->frames += delta;
+}
+
+/* Takes FRAME out of the replacement policy's consideration.
+ * Caller must hold clock_lock. */
+static void
+frame_unregister (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	if (frame->evictable) {
+		replace_policy->remove (frame);
+		rss_add (frame->page->owner, -1);
+	}
+	frame->evictable = false;
+	/* Its contents are about to go away. */
+	if (frame->text) {
+		hash_delete (&text_cache, &frame->text_elem);
+		frame->text = false;
+	}
+	if (frame->cached) {
+		hash_delete (&file_cache, &frame->file_elem);
+		frame->cached = false;
+	}
+	if (frame->merged) {
+		hash_delete (&ksm_stable, &frame->ksm_elem);
+		frame->merged = false;
 	}
-	ASSERT (frame->kva != NULL);
-	return frame;
 }
 
-/* Growing the stack. */
+/* Adds PAGE to FRAME's reverse map, the list of pages whose owners'
+ * page tables map FRAME.  The first page added becomes FRAME's primary
+ * mapping, the one eviction works on.  Caller must hold clock_lock if
+ * other threads can see FRAME. */
 static void
-vm_stack_growth (void *addr) {
-	void *stack_bottom = pg_round_down (addr);
-	size_t req_stack_size = USER_STACK - (uintptr_t)stack_bottom;
-	if (req_stack_size > (1 << 20)) PANIC("Stack limit exceeded!\n"); // 1MB
-
-	// Alloc page from tested region to previous claimed stack page.
-	void *growing_stack_bottom = stack_bottom;
-	while ((uintptr_t) growing_stack_bottom < USER_STACK &&
-		vm_alloc_page (VM_ANON | VM_STACK, growing_stack_bottom, true)) {
-	      growing_stack_bottom += PGSIZE;
-	};
-	vm_claim_page (stack_bottom); // Lazy load requested stack page only
+frame_add_page (struct frame *frame, struct page *page) {
+	if (frame->ref_cnt++ == 0)
+		frame->page = page;
+	list_push_back (&frame->pages, &page->frame_elem);
+	page->frame = frame;
 }
 
-/* Handle the fault on write_protected page */
-static bool
-vm_handle_wp (struct page *page UNUSED) {
+/* Drops PAGE's mapping of FRAME and returns the number of pages still
+ * mapping it.  If PAGE was the primary mapping, the next sharer takes
+ * over.  Only anonymous pages and file cache pages are ever shared.  Caller must hold
+ * clock_lock if other threads can see FRAME. */
+static int
+frame_remove_page (struct frame *frame, struct page *page) {
+	ASSERT (page->frame == frame);
+	list_remove (&page->frame_elem);
+	page->frame = NULL;
+	if (--frame->ref_cnt > 0 && frame->page == page) {
+		frame->page = list_entry (list_front (&frame->pages), struct page,
+				frame_elem);
+		/* The frame counts toward the resident set of its primary
+		 * mapping's owner. */
+		if (frame->evictable) {
+			rss_add (page->owner, -1);
+			rss_add (frame->page->owner, 1);
+		}
+	}
+	return frame->ref_cnt;
 }
 
-/* Return true on success */
+/* Returns true if any page table mapping FRAME has accessed it since
+ * the last call, and clears the accessed bits in all of them.
+ * Caller must hold clock_lock. */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct thread *curr = thread_current ();
-	struct supplemental_page_table *spt = &curr->spt;
-	/* Validate the fault */
-	if (is_kernel_vaddr (addr) && user) return false;
-	void *stack_bottom = pg_round_down (curr->saved_sp);
-	if (write && (stack_bottom - PGSIZE <= addr &&
-	      (uintptr_t) addr < USER_STACK)) {
-	  /* Allow stack growth writing below single PGSIZE range
-	   * of current stack bottom inferred from stack pointer. */
-	  vm_stack_growth (addr);
-	  return true;
-	}
-	struct page* page = spt_find_page (spt, addr);
-	if (page == NULL) return false;
-	// if (write && !not_present) return vm_handle_wp (page);
-	return vm_do_claim_page (page);
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_accessed (pml4, page->va)) {
+			accessed = true;
+			pml4_set_accessed (pml4, page->va, false);
+		}
 	}
-/* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
-void
-vm_dealloc_page (struct page *page) {
-	destroy (page);
-	free (page);
+	return accessed;
 }
 
-/* Claim the page that allocate on VA. */
+/* Returns true if FRAME's sharing does not keep it from being
+ * evicted: it has a single mapping, or it is a file cache frame or a
+ * shared memory segment's, whose mappings are all written back and
+ * unmapped together, and no page table mapping it is frozen.  Caller
+ * must hold clock_lock. */
 bool
-vm_claim_page (void *va) {
-	//printf("\n\n vm_claim_page진입입니다\n\n");
-	struct page *page = spt_find_page (&thread_current () ->spt, va);
-	if (page == NULL) return false;
-	return vm_do_claim_page (page);
+frame_is_evictable_shared (const struct frame *frame) {
+	struct list *pages = (struct list *) &frame->pages;
+	struct list_elem *e;
+
+	if (frame->ref_cnt != 1 && !frame->cached
+			&& page_get_type (frame->page) != VM_SHM)
+		return false;
+	if (frame->pin_cnt > 0)
+		return false;
+	/* Nor may a page table mapping it be frozen. */
+	for (e = list_begin (pages); e != list_end (pages); e = list_next (e))
+		if (list_entry (e, struct page, frame_elem)->owner->spt.frozen > 0)
+			return false;
+	return true;
 }
 
-/* Claim the PAGE and set up the mmu. */
-static bool
-vm_do_claim_page (struct page *page) {
-	struct thread *curr = thread_current ();
-	//printf("\n\n vm_get_frame진입 전입니다\n\n");
-	struct frame *frame = vm_get_frame ();
-	/* Set links */
-	ASSERT (frame != NULL);
-	ASSERT (page != NULL);
-	frame->page = page;
-	page->frame = frame;
+/* Returns true if the frame quotas let FRAME be evicted now: FRAME's
+ * owner is the process being held to its maximum, if any, or in the
+ * resource group being held to its limit, if any, or else
+ * holds more frames than its quota floor, the larger of its minimum
+ * and, with vm_working_set, its working set estimate.  Caller must
+ * hold clock_lock. */
+bool
+frame_quota_evictable (const struct frame *frame) {
+	struct thread *owner = frame->page->owner;
+	size_t floor = owner->spt.rss_min;
 
-	/* Insert page table entry to map page's VA to frame's PA. */
-	if (!pml4_set_page (curr -> pml4, page -> va, frame->kva, page -> writable))
-		return false;
-	return swap_in (page, frame->kva);
+	if (quota_owner != NULL)
+		return owner == quota_owner;
+	if (quota_group != NULL)
+		return owner->rgroup == quota_group;
+	if (vm_working_set && owner->spt.wss > floor)
+		floor = owner->spt.wss;
+	return !quota_strict || owner->spt.rss > floor;
 }
 
-static uint64_t
-page_hash (const struct hash_elem *p_, void *aux UNUSED) {
-  const struct page *p = hash_entry (p_, struct page, hash_elem);
-  return hash_bytes (&p->va, sizeof p->va);
+/* Returns true if any page table mapping FRAME has written to it
+ * since the last call, and clears the dirty bits in all of them, so
+ * that a single write-back covers every mapping. */
+bool
+frame_test_and_clear_dirty (struct frame *frame) {
+	bool dirty = false;
+	struct list_elem *e;
+
+	lock_acquire (&clock_lock);
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_dirty (pml4, page->va)) {
+			dirty = true;
+			pml4_set_dirty (pml4, page->va, false);
+		}
+	}
+	lock_release (&clock_lock);
+	return dirty;
 }
 
-static bool
-page_less (const struct hash_elem *a_,
-           const struct hash_elem *b_, void *aux UNUSED) {
-  const struct page *a = hash_entry (a_, struct page, hash_elem);
-  const struct page *b = hash_entry (b_, struct page, hash_elem);
+/* Makes FRAME, which now holds a page, a candidate for eviction. */
+static void
+vm_register_frame (struct frame *frame) {
+	lock_acquire (&clock_lock);
+	frame->evictable = true;
+	rss_add (frame->page->owner, 1);
+	replace_policy->insert (frame);
+	lock_release (&clock_lock);
+}
 
-  return a->va < b->va;
+/* Detaches PAGE, which is being destroyed, from its frame.
+ * If other pages still share the frame, it is the zero frame or it
+ * belongs to a shared memory segment, PAGE's mapping is removed from
+ * its owner's page table so that tearing the table down does not
+ * free memory still in use.  Otherwise the frame is emptied; its
+ * memory stays mapped in the owner's page table and is released
+ * with it. */
+void
+vm_free_frame (struct page *page) {
+	struct frame *frame = page->frame;
+	bool keep = frame == zero_frame;
+	bool shm = page_get_type (page) == VM_SHM;
+	int ref_cnt;
+
+	if (!keep && !shm && !frame->evictable && frame->ref_cnt == 1
+			&& !frame->huge && !frame->text && !frame->cached
+			&& page->owner->spt.frozen > 0) {
+		/* Taken off the policy by vm_release_frames() as its owner is
+		 * torn down: no other thread looks at it any more. */
+		ref_cnt = frame_remove_page (frame, page);
+		frame_reset (frame);
+		return;
+	}
+
+	lock_acquire (&clock_lock);
+	ref_cnt = frame_remove_page (frame, page);
+	if (ref_cnt == 0 && !keep) {
+		frame_unregister (frame);
+		frame_reset (frame);
+	}
+	lock_release (&clock_lock);
+
+	if (ref_cnt > 0 || keep || shm)
+		pml4_clear_page (page->owner->pml4, page->va);
 }
 
-/* Initialize new supplemental page table */
+/* Get the struct frame, that will be evicted: one of OWNER's, if
+ * OWNER is not null, else one of GROUP's processes', if GROUP is not
+ * null, else preferably one whose owner holds more than its quota
+ * floor.  Returns a null pointer if there is none.
+ * Otherwise counts the eviction as in flight in the counter *GUARD
+ * points to, which the caller passes to vm_evict_done() once the
+ * frame's pages are out. */
+static struct frame *
+vm_get_victim (struct thread *owner, struct rgroup *group,
+		unsigned **guard) {
+	struct frame *candidate;
+
+	lock_acquire (&clock_lock);
+	if (vm_working_set && ++victim_cnt % WSS_SAMPLE_PERIOD == 0)
+		vm_sample_working_sets ();
+	quota_owner = owner;
+	quota_group = group;
+	candidate = replace_policy->select_victim ();
+	if (candidate == NULL && owner == NULL && group == NULL) {
+		/* Every process is within its quota: take from any. */
+		quota_strict = false;
+		candidate = replace_policy->select_victim ();
+		/* Break up a 2 MB page rather than fail. */
+		if (candidate == NULL && vm_demote_any ())
+			candidate = replace_policy->select_victim ();
+		quota_strict = true;
+	}
+	quota_owner = NULL;
+	quota_group = NULL;
+	if (candidate != NULL) {
+		if (group != NULL)
+			group->evictions++;
+		frame_unregister (candidate);
+		*guard = candidate->ref_cnt == 1
+			&& page_get_type (candidate->page) != VM_SHM
+			? &candidate->page->owner->spt.evicting : &shared_evicting;
+		(**guard)++;
+	}
+	lock_release (&clock_lock);
+
+	return candidate;
+}
+
+/* Ends an eviction counted in GUARD by vm_get_victim(), letting the
+ * spt_freeze() calls waiting for it go on. */
+static void
+vm_evict_done (unsigned *guard) {
+	lock_acquire (&clock_lock);
+	ASSERT (*guard > 0);
+	(*guard)--;
+	cond_broadcast (&eviction_done, &clock_lock);
+	lock_release (&clock_lock);
+}
+
+/* Takes the current process's address space for a system call that
+ * changes it, keeping its other threads' page faults and such calls
+ * out until vm_unlock(). */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
-	struct hash* page_table = malloc(sizeof (struct hash));
-	hash_init(page_table, page_hash, page_less, NULL);
-	spt -> page_table = page_table;
+vm_lock (void) {
+	lock_acquire (&thread_leader ()->spt.lock);
 }
 
-/* Copy supplemental page table from src to dst */
+/* Ends vm_lock(). */
+void
+vm_unlock (void) {
+	lock_release (&thread_leader ()->spt.lock);
+}
+
+/* Keeps the frames mapped by SPT from being picked for eviction until
+ * the matching spt_thaw(), after waiting for the evictions of them
+ * already under way.  Only evictions touching SPT, or shared frames,
+ * are waited for, so processes tear down their pages in parallel. */
+void
+spt_freeze (struct supplemental_page_table *spt) {
+	lock_acquire (&clock_lock);
+	spt->frozen++;
+	while (spt->evicting > 0 || shared_evicting > 0)
+		cond_wait (&eviction_done, &clock_lock);
+	lock_release (&clock_lock);
+}
+
+/* Undoes an spt_freeze() of SPT. */
+void
+spt_thaw (struct supplemental_page_table *spt) {
+	lock_acquire (&clock_lock);
+	ASSERT (spt->frozen > 0);
+	spt->frozen--;
+	lock_release (&clock_lock);
+}
+
+/* Returns true if SPT is frozen. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst,
-		struct supplemental_page_table *src) {
-	/*Iterate Source spt hash table*/
+spt_is_frozen (const struct supplemental_page_table *spt) {
+	return spt->frozen > 0;
+}
+
+/* Takes the unshared 4 kB frames mapped by SPT, which is frozen and
+ * about to be torn down, off the replacement policy and the caches,
+ * all under one acquisition of clock_lock, so that vm_free_frame()
+ * then empties each without it. */
+static void
+vm_release_frames (struct supplemental_page_table *spt) {
 	struct hash_iterator i;
-	hash_first (&i, src -> page_table);
+	size_t cnt = 0;
+
+	ASSERT (spt_is_frozen (spt));
+	lock_acquire (&clock_lock);
+	hash_first (&i, spt->page_table);
 	while (hash_next (&i)) {
-		struct page *page = hash_entry (hash_cur (&i), struct page, hash_elem);
+		struct page *page = hash_entry (hash_cur (&i), struct page,
+				hash_elem);
+		struct frame *frame = page->frame;
 
-		/*Handle UNINIT page*/
-		if (page -> operations -> type == VM_UNINIT){
-			vm_initializer* init = page ->uninit.init;
-			bool writable = page -> writable;
-			int type = page ->uninit.type;
-			if (type & VM_ANON){
-				struct load_info* li = malloc (sizeof (struct load_info));
-				li -> file = file_duplicate (((struct load_info *) page -> uninit .aux)->file);
-				li -> page_read_bytes = ((struct load_info *) page -> uninit .aux)->page_read_bytes;
-				li -> page_zero_bytes = ((struct load_info *) page -> uninit .aux)->page_zero_bytes;
-				li -> ofs = ((struct load_info *) page -> uninit .aux)->ofs;
-				vm_alloc_page_with_initializer (type, page -> va, writable, init, (void*) li);
-			}
-			else if (type & VM_FILE){
-				//Do_nothing(it should not inherit mmap)
+		if (frame != NULL && frame != zero_frame && frame->ref_cnt == 1
+				&& !frame->huge && page_get_type (page) != VM_SHM)
+			frame_unregister (frame);
+		/* Let faulting threads have the lock now and then.  Only this
+		 * thread changes SPT's table, and its frames, frozen, are not
+		 * evicted meanwhile. */
+		if (++cnt % RELEASE_BATCH == 0) {
+			lock_release (&clock_lock);
+			thread_resched ();
+			lock_acquire (&clock_lock);
+		}
+	}
+	lock_release (&clock_lock);
+}
+
+/* Estimates the working set of every process with frames on the
+ * replacement policy as the number of them whose pages were accessed
+ * since the policy last cleared their accessed bits, which is how
+ * long a page has to prove itself.  Caller must hold clock_lock. */
+static void
+vm_sample_working_sets (void) {
+	size_t idx;
+
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	for (idx = 0; idx < frame_cnt; idx++)
+		if (frame_table[idx].evictable)
+			frame_table[idx].page->owner->spt.wss = 0;
+	for (idx = 0; idx < frame_cnt; idx++) {
+		struct frame *f = &frame_table[idx];
+		struct list_elem *e;
+
+		if (!f->evictable)
+			continue;
+		for (e = list_begin (&f->pages); e != list_end (&f->pages);
+				e = list_next (e)) {
+			struct page *p = list_entry (e, struct page, frame_elem);
+
+			if (pml4_is_accessed (p->owner->pml4, p->va)) {
+				f->page->owner->spt.wss++;
+				break;
 			}
+		}
+	}
+}
+
+/* Collects into CLUSTER the frames of a run of virtually adjacent,
+ * resident, not recently accessed anonymous pages of VICTIM's owner
+ * that includes VICTIM, in ascending address order, and takes them
+ * out of the clock.  VICTIM itself must already be out of it.
+ * Returns the number of frames collected, at least 1. */
+static size_t
+vm_gather_swap_cluster (struct frame *victim, struct frame **cluster) {
+	/* Neighbours by page distance from VICTIM, -(MAX-1)...(MAX-1). */
+	struct frame *near[2 * SWAP_CLUSTER_MAX - 1] = { NULL };
+	const int mid = SWAP_CLUSTER_MAX - 1;
+	struct thread *owner = victim->page->owner;
+	size_t idx;
+	int lo, hi, i;
+
+	/* A dropped executable page, or one clean in the swap cache,
+	 * costs no write to cluster. */
+	if (page_get_type (victim->page) != VM_ANON
+			|| anon_text (victim->page) != NULL
+			|| anon_swap_cached (victim->page)) {
+		cluster[0] = victim;
+		return 1;
+	}
+	near[mid] = victim;
+
+	lock_acquire (&clock_lock);
+	for (idx = 0; idx < frame_cnt; idx++) {
+		struct frame *f = &frame_table[idx];
+		intptr_t dist;
+
+		if (!f->evictable)
+			continue;
+		dist = ((intptr_t) f->page->va - (intptr_t) victim->page->va)
+			/ PGSIZE;
+
+		if (f->page->owner == owner && dist != 0 && f->ref_cnt == 1
+				&& dist > -SWAP_CLUSTER_MAX && dist < SWAP_CLUSTER_MAX
+				&& page_get_type (f->page) == VM_ANON
+				&& anon_text (f->page) == NULL
+				&& !anon_swap_cached (f->page)
+				&& !pml4_is_accessed (owner->pml4, f->page->va))
+			near[mid + dist] = f;
+	}
+
+	/* Grow the run forward first, as sequential access is the common
+	 * case, then backward. */
+	lo = hi = mid;
+	while (hi - lo + 1 < SWAP_CLUSTER_MAX) {
+		if (hi + 1 < 2 * SWAP_CLUSTER_MAX - 1 && near[hi + 1] != NULL)
+			hi++;
+		else if (lo > 0 && near[lo - 1] != NULL)
+			lo--;
+		else
+			break;
+	}
+	for (i = lo; i <= hi; i++)
+		if (i != mid)
+			frame_unregister (near[i]);
+	lock_release (&clock_lock);
+
+	for (i = lo; i <= hi; i++)
+		cluster[i - lo] = near[i];
+	return hi - lo + 1;
+}
+
+/* Evict one page, OWNER's if OWNER is not null, else one of GROUP's
+ * processes' if GROUP is not null, and return the corresponding
+ * frame.
+ * Return NULL on error.*/
+static struct frame *
+vm_evict_frame (struct thread *owner, struct rgroup *group) {
+	/* The victim's owners cannot tear down its pages until the victim
+	 * is written out, as spt_freeze() waits for the GUARD count.
+	 * Evictions only exclude teardown, not each other, as each takes
+	 * its own victim off the policy. */
+	unsigned *guard;
+	struct frame *victim = vm_get_victim (owner, group, &guard);
+	if (victim == NULL)
+		return NULL;
+	
+	// swap out the victim and return the evicted frame
+	struct page *page = victim->page;
+	trace (TRACE_EVICT, 0, (uintptr_t) page->va, page->owner->tid);
+	struct frame *cluster[SWAP_CLUSTER_MAX];
+	size_t cluster_cnt = vm_gather_swap_cluster (victim, cluster);
+	if (cluster_cnt > 1) {
+		/* Swap out the victim's cold neighbours along with it, into
+		 * adjacent slots.  The victim's frame is reused; the others go
+		 * back to the user pool. */
+		struct page *pages[SWAP_CLUSTER_MAX];
+		size_t i;
 
+		for (i = 0; i < cluster_cnt; i++)
+			pages[i] = cluster[i]->page;
+		if (anon_swap_out_cluster (pages, cluster_cnt)) {
+			for (i = 0; i < cluster_cnt; i++)
+				if (cluster[i] != victim) {
+					frame_reset (cluster[i]);
+					palloc_free_page (cluster[i]->kva);
+				}
+			vm_evict_done (guard);
+			goto clear;
 		}
-		
-		/* Handle ANON/FILE page*/
-		else if (page_get_type(page) == VM_ANON){
-			if (!vm_alloc_page (page -> operations -> type, page -> va, page -> writable))
-				return false;
-			struct page* new_page = spt_find_page (&thread_current () -> spt, page -> va);
-			if (!vm_do_claim_page (new_page))
-				return false;
-			memcpy (new_page -> frame -> kva, page -> frame -> kva, PGSIZE);
+		for (i = 0; i < cluster_cnt; i++)
+			if (cluster[i] != victim)
+				vm_register_frame (cluster[i]);
+	}
+	if (!swap_out (page)) {
+		/* Out of swap: keep the page, and let the faulting process
+		 * fail instead of the whole kernel. */
+		vm_register_frame (victim);
+		vm_evict_done (guard);
+		return NULL;
+	}
+	vm_evict_done (guard);
+
+clear:
+	/* No need to zero the frame: whatever fills it next, be it swap,
+	 * a file or a copy, writes all of it, and vm_get_frame() zeroes it
+	 * for those that do not. */
+	frame_reset (victim);
+	return victim;
+}
+
+/* palloc() and get frame. If there is no available page, evict the page
+ * and return it. That is, if the user pool memory is full, this function
+ * evicts the frame to get the available memory space, and if nothing
+ * can be evicted, e.g. because swap is full, kills the largest other
+ * process.  Returns NULL only if the current process is the largest
+ * or has been killed.
+ * If ZERO, the frame is filled with zeros; the idle thread keeps a few
+ * free frames zeroed for that. */
+static struct frame *
+vm_get_frame (bool zero) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct rgroup *group = thread_leader ()->rgroup;
+	struct frame *frame;
+	void *kva;
+
+	/* A process at its maximum pays for the frame with one of its own,
+	 * if it has any the policy may take, and one of a resource group
+	 * at its limit with one of the group's. */
+	if (spt->rss_max != 0 && spt->rss >= spt->rss_max) {
+		frame = vm_evict_frame (thread_leader (), NULL);
+		if (frame != NULL) {
+			if (zero)
+				clear_page (frame->kva);
+			return frame;
 		}
-		else if (page_get_type(page) == VM_FILE){
-			//Do nothing(it should not inherit mmap)
+	}
+	if (group->frame_max != 0 && group->frames >= group->frame_max) {
+		frame = vm_evict_frame (NULL, group);
+		if (frame != NULL) {
+			if (zero)
+				clear_page (frame->kva);
+			return frame;
 		}
 	}
-	return true;
+
+	kva = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+	if (kswapd_low > 0 && palloc_user_free_cnt () < kswapd_low)
+		work_queue (&kswapd_work);
+	// implement swap case
+	while (kva == NULL) {
+		/* A killed process gets no more frames. */
+		if (thread_leader ()->killed)
+			return NULL;
+		frame = vm_evict_frame (NULL, NULL);
+		if (frame != NULL) {
+			if (zero)
+				clear_page (frame->kva);
+			return frame;
+		}
+		/* With nothing to evict, tmpfs data may give up a frame, and
+		 * failing that, the largest process all of its own. */
+		if (!tmpfs_reclaim () && !vm_oom_kill ())
+			return NULL;
+		kva = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+	}
+
+	frame = frame_lookup (kva);
+	frame->kva = kva;
+	frame_reset (frame);
+	return frame;
 }
 
+/* Keeps in *AUX, a struct thread **, the leader among it and T with
+ * the largest resident set, of processes not killed yet.  Reads rss
+ * under the frame table's lock. */
 static void
-spt_destroy (struct hash_elem *e, void *aux UNUSED){
-	struct page *page = hash_entry (e, struct page, hash_elem);
-	ASSERT (page != NULL);
-	destroy (page);
-	free (page);
+vm_oom_pick (struct thread *t, void *aux) {
+	struct thread **best = aux;
+
+	if (t->leader != t || t->pml4 == NULL || t->killed
+			|| t->status == THREAD_DYING || t->spt.rss == 0)
+		return;
+	if (*best == NULL || t->spt.rss > (*best)->spt.rss)
+		*best = t;
+}
+
+/* Kills the process with the most frames, unless that is the current
+ * one, which is left to fail its own allocation, and waits a while
+ * for it to give its frames back.  Returns false if no other process
+ * was killed. */
+static bool
+vm_oom_kill (void) {
+	struct thread *victim = NULL;
+	enum intr_level old_level;
+	int i;
+
+	/* Exited processes still tearing down give their frames back
+	 * anyway.  The wait is bounded, as one may need a lock the
+	 * current thread holds: if it runs out, a process is killed
+	 * after all. */
+	for (i = 0; i < OOM_WAIT_TICKS && process_reaping (); i++)
+		timer_sleep (1);
+	if (i > 0 && !process_reaping ())
+		return true;
+	lock_acquire (&clock_lock);
+	old_level = intr_disable ();
+	thread_foreach (vm_oom_pick, &victim);
+	if (victim != NULL && victim != thread_leader ()) {
+		process_kill (victim);
+		oom_kills++;
+	} else
+		victim = NULL;
+	intr_set_level (old_level);
+	lock_release (&clock_lock);
+	if (victim == NULL)
+		return false;
+
+	/* VICTIM may be gone by now. */
+	for (i = 0; i < OOM_WAIT_TICKS && palloc_user_free_cnt () == 0; i++)
+		timer_sleep (1);
+	return true;
+}
+
+/* Swap daemon.  Every frame it evicts goes back to the user pool for
+ * the next fault to take; writing it out, if dirty, is the daemon's
+ * wait rather than the faulting thread's. */
+static void
+kswapd (void *aux UNUSED) {
+	/* Kernel caches' spare pages go first, and the kernel pool lends
+	 * them to the user pool. */
+	if (palloc_user_free_cnt () < kswapd_high)
+		shrink_caches (kswapd_high - palloc_user_free_cnt ());
+	while (palloc_user_free_cnt () < kswapd_high) {
+		struct frame *frame = vm_evict_frame (NULL, NULL);
+
+		if (frame == NULL)
+			break;
+		palloc_free_page (frame->kva);
+	}
+}
+
+/* Same-page merging daemon: scans a batch, then queues itself again
+ * for after a pause. */
+static void
+ksmd (void *aux UNUSED) {
+	size_t i;
+
+	for (i = 0; i < KSM_SCAN_BATCH && i < frame_cnt; i++) {
+		ksm_scan_frame (&frame_table[ksm_cursor]);
+		ksm_cursor = (ksm_cursor + 1) % frame_cnt;
+	}
+	work_queue_delayed (&ksm_work,
+			DIV_ROUND_UP (KSM_SLEEP_MS * TIMER_FREQ, 1000));
+}
+
+/* Merges the page of FRAME, if it is an anonymous page alone on its
+ * frame, into a stable frame of the same contents, and frees FRAME.
+ * If there is none and FRAME has not changed since the last scan,
+ * makes FRAME a stable frame. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	struct frame *stable = NULL;
+	struct hash_elem *e;
+	struct page *page;
+	uint64_t *pml4;
+	unsigned *guard;
+	uint64_t hash;
+	bool accessed, dirty;
+
+	/* Take the frame off the policy, and keep its owner from tearing
+	 * it down, as eviction does. */
+	lock_acquire (&clock_lock);
+	if (!frame->evictable || frame->ref_cnt != 1 || frame->huge
+			|| frame->text || frame->cached || frame->merged
+			|| page_get_type (frame->page) != VM_ANON
+			|| frame->page->owner->spt.frozen > 0 || frame->pin_cnt > 0) {
+		lock_release (&clock_lock);
+		return;
+	}
+	frame_unregister (frame);
+	page = frame->page;
+	guard = &page->owner->spt.evicting;
+	(*guard)++;
+	lock_release (&clock_lock);
+	ksm_scanned++;
+
+	/* Pages written to since the last scan are likely to be written to
+	 * again: leave them writable. */
+	hash = hash_bytes (frame->kva, PGSIZE);
+	if (hash != frame->ksm_hash) {
+		frame->ksm_hash = hash;
+		vm_register_frame (frame);
+		vm_evict_done (guard);
+		return;
+	}
+
+	/* Once read-only, the contents hold still until the owner's write
+	 * fault, which waits on GUARD. */
+	pml4 = page->owner->pml4;
+	accessed = pml4_is_accessed (pml4, page->va);
+	dirty = pml4_is_dirty (pml4, page->va);
+	pml4_set_page (pml4, page->va, frame->kva, false);
+	frame->ksm_hash = hash_bytes (frame->kva, PGSIZE);
+
+	lock_acquire (&clock_lock);
+	e = hash_insert (&ksm_stable, &frame->ksm_elem);
+	if (e != NULL) {
+		stable = hash_entry (e, struct frame, ksm_elem);
+		pml4_set_page (pml4, page->va, stable->kva, false);
+		/* Written since it was swapped in, its swap cache slot is
+		 * stale: the stable frame's mapping must say so too. */
+		if (dirty)
+			pml4_set_dirty (pml4, page->va, true);
+		frame_remove_page (frame, page);
+		frame_add_page (stable, page);
+		ksm_merged++;
+	} else
+		frame->merged = true;
+	pml4_set_accessed (pml4, page->va, accessed);
+	lock_release (&clock_lock);
+
+	if (stable != NULL) {
+		frame_reset (frame);
+		palloc_free_page (frame->kva);
+	} else
+		vm_register_frame (frame);
+	vm_evict_done (guard);
+}
+
+/* Hash function for the stable table. */
+static uint64_t
+ksm_stable_hash (const struct hash_elem *f_, void *aux UNUSED) {
+	return hash_entry (f_, struct frame, ksm_elem)->ksm_hash;
+}
+
+/* Orders stable frames by hash, then by contents. */
+static bool
+ksm_stable_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, ksm_elem);
+	const struct frame *b = hash_entry (b_, struct frame, ksm_elem);
+
+	if (a->ksm_hash != b->ksm_hash)
+		return a->ksm_hash < b->ksm_hash;
+	return memcmp (a->kva, b->kva, PGSIZE) < 0;
+}
+
+/* Prints how many pages same-page merging saved, if it ran. */
+void
+vm_print_ksm_stats (void) {
+	if (!vm_ksm)
+		return;
+	printf ("Same-page merging: %"PRIu64" frames scanned, %"PRIu64
+			" pages merged, %zu stable frames\n",
+			ksm_scanned, ksm_merged, hash_size (&ksm_stable));
+}
+
+/* Frees a block of 2**ORDER pages, aligned to its size, by moving
+ * the user pages in the way of one elsewhere, and returns true if it
+ * did.  Called by the page allocator when a request for such a block
+ * fails.  If the current thread cannot wait for compaction, queues it
+ * in the background and returns false. */
+bool
+vm_compact (unsigned order) {
+	enum intr_level old_level;
+	bool freed;
+
+	if (!compact_ready || order == 0)
+		return false;
+	if (intr_context () || intr_get_level () == INTR_OFF
+			|| lock_held_by_current_thread (&clock_lock)
+			|| lock_held_by_current_thread (&compact_lock)) {
+		old_level = intr_disable ();
+		if (order > compact_order)
+			compact_order = order;
+		intr_set_level (old_level);
+		work_queue (&compact_work);
+		return false;
+	}
+
+	lock_acquire (&compact_lock);
+	freed = vm_compact_run (order);
+	lock_release (&compact_lock);
+	return freed;
+}
+
+/* Compaction daemon: compacts for the largest order asked for since
+ * it last ran. */
+static void
+kcompactd (void *aux UNUSED) {
+	enum intr_level old_level = intr_disable ();
+	unsigned order = compact_order;
+
+	compact_order = 0;
+	intr_set_level (old_level);
+	if (order > 0) {
+		lock_acquire (&compact_lock);
+		vm_compact_run (order);
+		lock_release (&compact_lock);
+	}
+}
+
+/* Returns true if FRAME holds a page that compaction may move: an
+ * anonymous page alone on the frame, which is on the replacement
+ * policy and in no cache.  Caller must hold clock_lock. */
+static bool
+frame_is_movable (const struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	return frame->evictable && frame->ref_cnt == 1 && !frame->huge
+		&& !frame->text && !frame->cached && !frame->merged
+		&& frame->pin_cnt == 0 && frame != zero_frame
+		&& page_get_type (frame->page) == VM_ANON
+		&& frame->page->owner->spt.frozen == 0;
+}
+
+/* Returns the first page of the block of 2**ORDER pages of the frame
+ * table that moving the fewest pages would free, storing their
+ * number in *MOVE_CNT, or a null pointer if every block holds a page
+ * in use that cannot be moved, or none in use at all.  Caller must hold clock_lock. */
+static uint8_t *
+vm_compact_pick (unsigned order, size_t *move_cnt) {
+	size_t cnt = (size_t) 1 << order;
+	size_t first = ROUND_UP (pg_no (frame_base), cnt) - pg_no (frame_base);
+	uint8_t *best = NULL;
+	size_t idx, i;
+
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	*move_cnt = SIZE_MAX;
+	for (idx = first; idx + cnt <= frame_cnt; idx += cnt) {
+		uint8_t *block = frame_base + idx * PGSIZE;
+		size_t moves = 0;
+
+		if (!palloc_pages_in_pool (block, cnt))
+			continue;
+		for (i = 0; i < cnt && moves < *move_cnt; i++) {
+			if (palloc_page_is_free (block + i * PGSIZE))
+				continue;
+			if (!frame_is_movable (&frame_table[idx + i]))
+				break;
+			moves++;
+		}
+		/* A block free already was no use to the failed request. */
+		if (i == cnt && moves > 0 && moves < *move_cnt) {
+			best = block;
+			*move_cnt = moves;
+		}
+	}
+	return best;
+}
+
+/* Moves the page on FRAME to a free frame outside the LEN bytes at
+ * BLOCK, and frees FRAME.  Free pages inside BLOCK it comes across
+ * are pushed onto *HELD, linked through their first word, for the
+ * caller to free once BLOCK is empty.  Returns false, leaving the
+ * page where it is, if the page can no longer be moved or there is no
+ * frame to move it to. */
+static bool
+vm_migrate_frame (struct frame *frame, uint8_t *block, size_t len,
+		void **held) {
+	struct frame *dst;
+	struct page *page;
+	uint64_t *pml4;
+	unsigned *guard;
+	bool writable, dirty, accessed;
+	enum intr_level old_level;
+	uint8_t *kva;
+
+	/* Get the new frame first: no page of BLOCK will do. */
+	while ((kva = palloc_get_page (PAL_USER)) != NULL
+			&& kva >= block && kva < block + len) {
+		*(void **) kva = *held;
+		*held = kva;
+	}
+	if (kva == NULL)
+		return false;
+	dst = frame_lookup (kva);
+	dst->kva = kva;
+	frame_reset (dst);
+
+	/* Take the frame off the policy, and keep its owner from tearing
+	 * it down, as eviction does. */
+	lock_acquire (&clock_lock);
+	if (!frame_is_movable (frame)) {
+		lock_release (&clock_lock);
+		palloc_free_page (kva);
+		return false;
+	}
+	frame_unregister (frame);
+	page = frame->page;
+	guard = &page->owner->spt.evicting;
+	(*guard)++;
+	lock_release (&clock_lock);
+
+	/* Once read-only, the contents hold still until the owner's write
+	 * fault, which waits on GUARD.  Nothing writes the page between
+	 * reading its dirty bit and dropping it, with interrupts off. */
+	pml4 = page->owner->pml4;
+	old_level = intr_disable ();
+	writable = pml4_is_writable (pml4, page->va);
+	dirty = pml4_is_dirty (pml4, page->va);
+	accessed = pml4_is_accessed (pml4, page->va);
+	pml4_set_page (pml4, page->va, frame->kva, false);
+	intr_set_level (old_level);
+
+	copy_page (dst->kva, frame->kva);
+	pml4_set_page (pml4, page->va, dst->kva, writable);
+	pml4_set_dirty (pml4, page->va, dirty);
+	pml4_set_accessed (pml4, page->va, accessed);
+
+	lock_acquire (&clock_lock);
+	frame_remove_page (frame, page);
+	frame_add_page (dst, page);
+	dst->ksm_hash = frame->ksm_hash;
+	lock_release (&clock_lock);
+
+	vm_register_frame (dst);
+	vm_evict_done (guard);
+	frame_reset (frame);
+	palloc_free_page (frame->kva);
+	return true;
+}
+
+/* Does the work of vm_compact() for a block of 2**ORDER pages.
+ * Caller must hold compact_lock. */
+static bool
+vm_compact_run (unsigned order) {
+	size_t len = PGSIZE << order;
+	int tries;
+
+	ASSERT (lock_held_by_current_thread (&compact_lock));
+	compact_runs++;
+	for (tries = 0; tries < COMPACT_TRIES; tries++) {
+		void *held = NULL;
+		size_t move_cnt, idx;
+		uint8_t *block;
+		bool moved = true;
+
+		lock_acquire (&clock_lock);
+		block = vm_compact_pick (order, &move_cnt);
+		lock_release (&clock_lock);
+		if (block == NULL)
+			return false;
+
+		/* Pages of the block may have been taken, or their frames
+		 * changed, since the pick: those that are in use and cannot
+		 * be moved now end this try. */
+		for (idx = 0; idx < len / PGSIZE && moved; idx++) {
+			uint8_t *kva = block + idx * PGSIZE;
+
+			if (palloc_page_is_free (kva))
+				continue;
+			moved = vm_migrate_frame (frame_lookup (kva), block, len, &held);
+			if (moved)
+				compact_moved++;
+		}
+		while (held != NULL) {
+			void *next = *(void **) held;
+
+			palloc_free_page (held);
+			held = next;
+		}
+		if (moved) {
+			compact_freed++;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Prints how often compaction ran, how many blocks it freed and how
+ * many pages it moved to free them, if it ever ran. */
+void
+vm_print_compact_stats (void) {
+	if (compact_runs == 0)
+		return;
+	printf ("Compaction: %llu runs, %llu blocks freed, %llu pages moved\n",
+			compact_runs, compact_freed, compact_moved);
+}
+
+/* Growing the stack down to the page of ADDR, which lies below the
+ * current stack bottom.  Only the pages between the two are
+ * registered, and only ADDR's is claimed.  Returns false, so that the
+ * process is killed, if ADDR is past the current process's stack
+ * limit, that is, in the guard page or beyond, or if memory runs
+ * out. */
+static bool
+vm_stack_growth (void *addr) {
+	struct thread *curr = thread_leader ();
+	struct supplemental_page_table *spt = &curr->spt;
+	uint8_t *new_bottom = pg_round_down (addr);
+
+	ASSERT (new_bottom < (uint8_t *) spt->stack_bottom);
+	if ((uintptr_t) new_bottom < USER_STACK - curr->stack_limit)
+		return false;
+
+	/* Downward, so that the stack stays contiguous if memory runs
+	 * out on the way. */
+	while ((uint8_t *) spt->stack_bottom > new_bottom) {
+		uint8_t *va = (uint8_t *) spt->stack_bottom - PGSIZE;
+
+		if (!vm_alloc_page (VM_ANON | VM_STACK, va, true))
+			return false;
+		spt->stack_bottom = va;
+	}
+	return vm_claim_page (new_bottom); // Lazy load requested stack page only
+}
+
+/* Returns true if any of the LENGTH bytes at ADDR lies where the
+ * current process's stack may grow, or in the guard page below it.
+ * Mappings are kept out of there. */
+bool
+vm_stack_reserved (const void *addr, size_t length) {
+	uintptr_t lo = USER_STACK - thread_leader ()->stack_limit - PGSIZE;
+
+	return (uintptr_t) addr + length > lo && (uintptr_t) addr < USER_STACK;
+}
+
+/* Sets the current process's stack limit to LIMIT bytes, rounded up to
+ * whole pages.  Returns false, leaving it unchanged, if LIMIT is
+ * above STACK_LIMIT_MAX, below the stack the thread already has, or
+ * if the space it reserves is in use. */
+bool
+vm_set_stack_limit (size_t limit) {
+	struct thread *curr = thread_leader ();
+	struct supplemental_page_table *spt = &curr->spt;
+	uintptr_t lo, stack_bottom;
+
+	limit = ROUND_UP (limit, PGSIZE);
+	if (limit == 0 || limit > STACK_LIMIT_MAX)
+		return false;
+	lo = USER_STACK - limit;
+	stack_bottom = (uintptr_t) spt->stack_bottom;
+	if (lo > stack_bottom)
+		return false;
+	if (!vma_range_is_free (spt, (void *) (lo - PGSIZE),
+				stack_bottom - (lo - PGSIZE)))
+		return false;
+	curr->stack_limit = limit;
+	return true;
+}
+
+/* Pages of the heap loaded ahead of a fault on the page before them:
+ * malloc() hands memory out from the bottom up. */
+#define HEAP_FAULT_AROUND 2
+
+/* Starts the current process's heap, empty, at START, the end of its
+ * executable. */
+void
+vm_heap_init (void *start) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+
+	ASSERT (spt->heap == NULL);
+	spt->heap_start = spt->brk = pg_round_up (start);
+}
+
+/* Moves the current process's program break by INCREMENT bytes, and
+ * returns its old value.  Pages the heap grows into are created
+ * zeroed as they are touched; pages it shrinks out of are freed.
+ * Returns a null pointer, leaving the break as it was, if it would
+ * go below the start of the heap or into space in use or reserved
+ * for the stack, or memory runs out.  The caller holds vm_lock(). */
+void *
+vm_sbrk (intptr_t increment) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	uint8_t *start = spt->heap_start;
+	uint8_t *old_brk = spt->brk;
+	uint8_t *new_brk = old_brk + increment;
+	uint8_t *old_end = pg_round_up (old_brk);
+	uint8_t *new_end;
+
+	ASSERT (lock_held_by_current_thread (&spt->lock));
+	if (start == NULL
+			|| (increment < 0 && (size_t) -increment > (size_t) (old_brk - start))
+			|| (increment > 0 && (new_brk < old_brk || !is_user_vaddr (new_brk))))
+		return NULL;
+	new_end = pg_round_up (new_brk);
+
+	if (new_end > old_end) {
+		if (!vma_range_is_free (spt, old_end, new_end - old_end)
+				|| vm_stack_reserved (old_end, new_end - old_end))
+			return NULL;
+		if (spt->heap == NULL) {
+			struct vma *vma = malloc (sizeof *vma);
+
+			if (vma == NULL)
+				return NULL;
+			*vma = (struct vma) {
+				.start = start,
+				.end = new_end,
+				.type = VM_ANON,
+				.writable = true,
+				.init = vm_load_zero,
+				.file = NULL,
+				.fault_around = HEAP_FAULT_AROUND,
+				.advice = MADV_NORMAL,
+			};
+			if (!vma_insert (spt, vma)) {
+				free (vma);
+				return NULL;
+			}
+			spt->heap = vma;
+		} else
+			spt->heap->end = new_end;
+	} else if (new_end < old_end) {
+		uint8_t *va;
+
+		/* Keep the pages from being evicted while they go away. */
+		spt_freeze (spt);
+		for (va = new_end; va < old_end; va += PGSIZE) {
+			struct page *page = spt_find_page (spt, va);
+
+			if (page != NULL) {
+				hash_delete (spt->page_table, &page->hash_elem);
+				vm_dealloc_page (page);
+			} else
+				vm_drop_swapped (va);
+		}
+		spt_thaw (spt);
+		if (new_end == start) {
+			vma_remove (spt, spt->heap);
+			if (spt->heap->li != NULL)
+				load_info_release (spt->heap->li);
+			free (spt->heap);
+			spt->heap = NULL;
+		} else
+			spt->heap->end = new_end;
+	}
+	spt->brk = new_brk;
+	return old_brk;
+}
+
+/* Loads PAGE, of an area with no file, which starts out zero. */
+bool
+vm_load_zero (struct page *page, void *aux) {
+	load_info_release (aux);
+	memset (page->va, 0, PGSIZE);
+	return true;
+}
+
+/* Sets the current process's frame quotas: MIN frames are kept
+ * resident under memory pressure while other processes have more
+ * than theirs to give, and no more than MAX are held, or any number
+ * if MAX is 0.  Returns false, leaving them unchanged, if MIN is
+ * above MAX. */
+bool
+vm_set_frame_quota (size_t min, size_t max) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+
+	if (max != 0 && min > max)
+		return false;
+	lock_acquire (&clock_lock);
+	spt->rss_min = min;
+	spt->rss_max = max;
+	lock_release (&clock_lock);
+	return true;
+}
+
+/* Moves the process of LEADER into resource group GROUP, with the
+ * frames it has resident. */
+void
+vm_rgroup_move (struct thread *leader, struct rgroup *group) {
+	lock_acquire (&clock_lock);
+	leader->rgroup->frames -= leader->spt.rss;
+	group->frames += leader->spt.rss;
+	rgroup_attach (leader, group);
+	lock_release (&clock_lock);
+}
+
+/* Returns the number of frames in the current process's resident
+ * set. */
+size_t
+vm_rss (void) {
+	return thread_leader ()->spt.rss;
+}
+
+/* Handle the fault on write_protected page.
+ * PAGE is writable but was mapped read-only because fork or same-page
+ * merging shares its frame copy-on-write.  The last page left on a
+ * frame simply gets write access back; otherwise PAGE gets a private
+ * copy. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct thread *curr = thread_leader ();
+	struct frame *copy = NULL;
+	struct frame *old;
+	bool success = true;
+	bool shared, zeroed, retry = false;
+
+	if (!page->writable)
+		return false;
+
+	/* Get the copy's frame first, as eviction may have to wait for
+	 * the freeze below to end. */
+	lock_acquire (&clock_lock);
+	shared = page->frame != NULL
+		&& (page->frame->ref_cnt > 1 || page->frame == zero_frame);
+	/* A page leaves the zero frame only here, so it stays on it. */
+	zeroed = page->frame == zero_frame;
+	lock_release (&clock_lock);
+	if (shared && (copy = vm_get_frame (zeroed)) == NULL)
+		return false;
+
+	/* Keep the frame from being evicted while it is copied.  The other
+	 * sharers may go away meanwhile, but PAGE's mapping keeps the
+	 * frame's memory. */
+	spt_freeze (&curr->spt);
+	old = page->frame;
+	if (old != NULL) {
+		lock_acquire (&clock_lock);
+		if ((old->ref_cnt > 1 || old == zero_frame) && copy == NULL)
+			/* Merged since the check above: the retried write faults
+			 * again and makes the copy. */
+			retry = true;
+		else if (old->ref_cnt > 1 || old == zero_frame) {
+			if (!zeroed)
+				copy_page (copy->kva, old->kva);
+			frame_remove_page (old, page);
+			frame_add_page (copy, page);
+		} else {
+			/* The contents are about to change. */
+			if (old->merged) {
+				hash_delete (&ksm_stable, &old->ksm_elem);
+				old->merged = false;
+			}
+			if (old->evictable && replace_policy->access != NULL)
+				replace_policy->access (old);
+		}
+		lock_release (&clock_lock);
+		if (!retry) {
+			success = pml4_set_page (curr->pml4, page->va, page->frame->kva,
+					true);
+			invlpg ((uint64_t) page->va);
+		}
+	}
+	/* Otherwise the page was evicted meanwhile; the retried access
+	 * faults it back in. */
+	spt_thaw (&curr->spt);
+
+	if (copy != NULL) {
+		if (page->frame == copy)
+			vm_register_frame (copy);
+		else {
+			frame_reset (copy);
+			palloc_free_page (copy->kva);
+		}
+	}
+	return success;
+}
+
+/* Return true on success */
+bool
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
+		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
+	uint64_t start = rdtsc ();
+	struct lock *lock = &thread_leader ()->spt.lock;
+	/* A fault in a system call that holds the lock is under it. */
+	bool locked = !lock_held_by_current_thread (lock);
+	int cls = FAULT_INVALID;
+	bool success;
+	uint64_t cycles;
+
+	if (locked) {
+		struct supplemental_page_table *spt = &thread_leader ()->spt;
+
+		lock_acquire (lock);
+		/* A system call holding the lock may be walking the table. */
+		if (spt->swapped >= SWAP_PACK_BATCH
+				&& spt->swapped >= hash_size (spt->page_table) / 8)
+			vm_pack_swapped (spt);
+	}
+	success = vm_handle_fault (f, addr, user, write, not_present, &cls);
+	if (locked)
+		lock_release (lock);
+	cycles = rdtsc () - start;
+
+	if (!success)
+		cls = FAULT_INVALID;
+	vm_fault_record (cls, cycles);
+	trace (TRACE_FAULT, cls, (uintptr_t) addr, cycles);
+	return success;
+}
+
+/* Does the work of vm_try_handle_fault(), storing the class of the
+ * fault in *CLS. */
+static bool
+vm_handle_fault (struct intr_frame *f, void *addr, bool user, bool write,
+		bool not_present, int *cls) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	/* Validate the fault */
+	if (is_kernel_vaddr (addr) && user) return false;
+	/* A kernel fault comes from a system call, whose entry saved the
+	 * user's stack pointer. */
+	void *sp_page = pg_round_down (user ? f->rsp
+			: thread_current ()->saved_sp);
+	if (write && not_present && (sp_page - PGSIZE <= addr &&
+	      addr < spt->stack_bottom) && vm_stack_reserved (addr, 1)) {
+	  /* Allow stack growth writing below single PGSIZE range
+	   * of current stack bottom inferred from stack pointer. */
+	  *cls = FAULT_STACK;
+	  return vm_stack_growth (addr);
+	}
+	struct page* page = spt_find_page (spt, addr);
+	bool success;
+	*cls = FAULT_ZERO;
+	if (page == NULL && vm_try_huge (spt, addr, &success)) return success;
+	if (page == NULL) page = vma_materialize (spt, addr);
+	if (page == NULL) return false;
+	*cls = FAULT_COW;
+	if (write && !not_present) return vm_handle_wp (page);
+	*cls = FAULT_ZERO;
+	if (!write && vm_map_zero (page)) return true;
+	*cls = vm_fault_class (page);
+	size_t around = vm_advise_around (page, vm_fault_around_cnt (page));
+	if (!vm_do_claim_page (page))
+		return false;
+	vm_fault_around (page, around);
+	vm_advise_fault (page);
+	return true;
+	}
+
+/* Returns the class of a fault on PAGE, which is not resident. */
+static int
+vm_fault_class (struct page *page) {
+	const struct shm_page *sp = &page->shm;
+
+	switch (page_get_type (page)) {
+		case VM_FILE:
+			return FAULT_MMAP;
+		case VM_SHM:
+			return sp->shm->slots[sp->idx] != INVALID_SLOT_IDX
+				? FAULT_SWAP : FAULT_ZERO;
+		default:
+			if (anon_swap_slot (page) != INVALID_SLOT_IDX)
+				return FAULT_SWAP;
+			if ((page->operations->type == VM_UNINIT
+						&& page->uninit.init != NULL)
+					|| anon_text (page) != NULL)
+				return FAULT_EXEC;
+			return FAULT_ZERO;
+	}
+}
+
+/* Adds CYCLES to statistics ST. */
+static void
+fault_stat_add (struct fault_stat *st, uint64_t cycles) {
+	uint64_t c = cycles >> 10;
+	size_t bucket = 0;
+
+	while (c != 0 && bucket < FAULT_HIST_CNT - 1) {
+		c >>= 1;
+		bucket++;
+	}
+	st->count++;
+	st->cycles += cycles;
+	if (cycles > st->max_cycles)
+		st->max_cycles = cycles;
+	st->hist[bucket]++;
+}
+
+/* Counts a fault of class CLS that took CYCLES to handle, for the
+ * system and the current thread. */
+static void
+vm_fault_record (int cls, uint64_t cycles) {
+	struct fault_stat *mine = thread_leader ()->spt.faults;
+	enum intr_level old_level = intr_disable ();
+
+	fault_stat_add (&all_faults[cls], cycles);
+	if (mine != NULL)
+		fault_stat_add (&mine[cls], cycles);
+	intr_set_level (old_level);
+}
+
+/* Copies the statistics of the faults, FAULT_CLASS_CNT classes, taken
+ * by the current thread if SELF or else by every process, into BUF. */
+void
+vm_fault_stats (struct fault_stat *buf, bool self) {
+	struct fault_stat *src = self ? thread_leader ()->spt.faults : all_faults;
+	enum intr_level old_level;
+
+	if (src == NULL) {
+		memset (buf, 0, FAULT_CLASS_CNT * sizeof *buf);
+		return;
+	}
+	old_level = intr_disable ();
+	memcpy (buf, src, FAULT_CLASS_CNT * sizeof *buf);
+	intr_set_level (old_level);
+}
+
+/* Prints the statistics STATS of page faults, FAULT_CLASS_CNT
+ * classes: count, average and maximum cycles per class, then the
+ * nonzero buckets of the latency histogram, each as its bound in log2
+ * cycles and count. */
+static void
+print_faults (const struct fault_stat *stats) {
+	size_t i, b;
+
+	printf ("Page faults: count, average and maximum cycles\n");
+	for (i = 0; i < FAULT_CLASS_CNT; i++) {
+		const struct fault_stat *st = &stats[i];
+
+		if (st->count == 0)
+			continue;
+		printf ("  %-14s %10"PRIu64" %12"PRIu64" %12"PRIu64"\n",
+				fault_class_names[i], st->count, st->cycles / st->count,
+				st->max_cycles);
+		printf ("   ");
+		for (b = 0; b < FAULT_HIST_CNT; b++)
+			if (st->hist[b] != 0)
+				printf (" %s%zu:%"PRIu64, b == FAULT_HIST_CNT - 1 ? ">" : "<",
+						b == FAULT_HIST_CNT - 1 ? 9 + b : 10 + b, st->hist[b]);
+		printf ("\n");
+	}
+}
+
+/* Prints statistics of the page faults taken by every process. */
+void
+vm_print_fault_stats (void) {
+	print_faults (all_faults);
+	if (oom_kills != 0)
+		printf ("Out of memory: %llu processes killed\n", oom_kills);
+	if (swap_packed != 0)
+		printf ("Swap: %llu pages packed into page table entries\n",
+				swap_packed);
+	anon_print_stats ();
+}
+
+/* Prints the resident set of the current process, its working set
+ * estimate and frame quota, and statistics of the page faults it
+ * took. */
+void
+vm_print_process_stats (void) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct fault_stat faults[FAULT_CLASS_CNT];
+
+	printf ("Memory: %zu frames resident, working set %zu, "
+			"quota %zu to %zu\n", spt->rss, spt->wss, spt->rss_min,
+			spt->rss_max);
+	vm_fault_stats (faults, true);
+	print_faults (faults);
+}
+/* Free the page.
+ * DO NOT MODIFY THIS FUNCTION. */
+void
+vm_dealloc_page (struct page *page) {
+	destroy (page);
+	free (page);
+}
+
+/* Claim the page that allocate on VA. */
+bool
+vm_claim_page (void *va) {
+	//printf("\n\n vm_claim_page진입입니다\n\n");
+	struct page *page = spt_find_page (&thread_leader () ->spt, va);
+	if (page == NULL) return false;
+	return vm_do_claim_page (page);
+}
+
+/* Claim the PAGE and set up the mmu. */
+static bool
+vm_do_claim_page (struct page *page) {
+	struct thread *curr = thread_leader ();
+	struct text_key key;
+	bool text = vm_text_key (page, &key);
+	struct file_key file_key;
+	bool cached = vm_file_key (page, &file_key);
+
+	if (page_get_type (page) == VM_SHM)
+		return vm_claim_shm (page);
+	if (text && vm_share_text (page, &key))
+		return true;
+	if (cached && vm_share_file (page, &file_key))
+		return true;
+	//printf("\n\n vm_get_frame진입 전입니다\n\n");
+	struct frame *frame = vm_get_frame (vm_page_is_fresh (page));
+	/* Set links */
+	if (frame == NULL)
+		return false;
+	ASSERT (page != NULL);
+	frame_add_page (frame, page);
+
+	/* Insert page table entry to map page's VA to frame's PA. */
+	if (!pml4_set_page (curr -> pml4, page -> va, frame->kva, page -> writable))
+		return false;
+	size_t slot_idx = anon_swap_slot (page);
+	if (!swap_in (page, frame->kva))
+		return false;
+	if (text)
+		vm_text_insert (frame, &key);
+	if (cached)
+		vm_file_insert (frame, &file_key);
+	/* Only now may the frame be chosen as a victim. */
+	vm_register_frame (frame);
+	if (slot_idx != INVALID_SLOT_IDX)
+		vm_swap_read_around (page, slot_idx);
+	return true;
+}
+
+/* Maps PAGE, a page of the current thread, to a frame the user pool
+ * has free, without evicting anything.  Returns the frame, which the
+ * caller fills and then registers or gives back with
+ * vm_unmap_spare_frame(), or a null pointer if none is free. */
+static struct frame *
+vm_map_spare_frame (struct page *page) {
+	struct frame *frame;
+	void *kva = palloc_get_page (PAL_USER);
+
+	if (kva == NULL)
+		return NULL;
+	if (!pml4_set_page (thread_leader ()->pml4, page->va, kva,
+				page->writable)) {
+		palloc_free_page (kva);
+		return NULL;
+	}
+	frame = frame_lookup (kva);
+	frame->kva = kva;
+	frame_reset (frame);
+	frame_add_page (frame, page);
+	return frame;
+}
+
+/* Undoes vm_map_spare_frame() for PAGE and FRAME. */
+static void
+vm_unmap_spare_frame (struct page *page, struct frame *frame) {
+	pml4_clear_page (thread_leader ()->pml4, page->va);
+	frame_remove_page (frame, page);
+	frame_reset (frame);
+	palloc_free_page (frame->kva);
+}
+
+/* Returns the number of pages to load ahead of PAGE when it faults:
+ * the fault-around count its segment asked for if PAGE is a not yet
+ * loaded executable segment page, otherwise 0. */
+static size_t
+vm_fault_around_cnt (struct page *page) {
+	struct load_info *li;
+
+	if (page->operations->type != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON
+			|| page->uninit.init == NULL)
+		return 0;
+	li = page->uninit.aux;
+	return li->fault_around;
+}
+
+/* Having just loaded PAGE, an executable segment page, also loads
+ * up to CNT of the pages right after it in the same segment, so that
+ * running through a segment does not cost a fault per page.  Stops at
+ * the first page already loaded, at the end of the segment, and when
+ * no frame is free without evicting. */
+static void
+vm_fault_around (struct page *page, size_t cnt) {
+	struct thread *curr = thread_leader ();
+	size_t i;
+
+	for (i = 1; i <= cnt; i++) {
+		void *va = (uint8_t *) page->va + i * PGSIZE;
+		struct page *near;
+		struct frame *frame;
+		struct text_key key;
+		bool text;
+
+		if (!is_user_vaddr (va))
+			break;
+		near = spt_find_page (&curr->spt, va);
+		if (near == NULL)
+			near = vma_materialize (&curr->spt, va);
+		if (near == NULL || near->writable != page->writable
+				|| vm_fault_around_cnt (near) == 0)
+			break;
+		if (vm_map_zero (near))
+			continue;
+		text = vm_text_key (near, &key);
+		if (text && vm_share_text (near, &key))
+			continue;
+		frame = vm_map_spare_frame (near);
+		if (frame == NULL)
+			break;
+		if (!swap_in (near, frame->kva)) {
+			vm_unmap_spare_frame (near, frame);
+			break;
+		}
+		if (text)
+			vm_text_insert (frame, &key);
+		vm_register_frame (frame);
+	}
+}
+
+/* Returns true if PAGE is a not yet loaded anonymous page without an
+ * initializer, which starts out as a frame of zeros. */
+static bool
+vm_page_is_fresh (struct page *page) {
+	return page->operations->type == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* If PAGE is a not yet loaded anonymous page that would load as all
+ * zeros, one of nothing but BSS or one without an initializer, maps it
+ * read-only to the zero frame and returns true.  Otherwise returns
+ * false. */
+static bool
+vm_map_zero (struct page *page) {
+	struct load_info *li;
+
+	if (page->operations->type != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON)
+		return false;
+	li = page->uninit.init != NULL ? page->uninit.aux : NULL;
+	if (li != NULL) {
+		off_t ofs;
+		size_t read_bytes;
+
+		load_info_page (li, page->va, &ofs, &read_bytes);
+		if (read_bytes != 0)
+			return false;
+	}
+	if (!pml4_set_page (thread_leader ()->pml4, page->va, zero_frame->kva,
+				false))
+		return false;
+
+	/* Turn PAGE into the anonymous page loading would have made of
+	 * it, without running its initializer. */
+	page->uninit.page_initializer (page, page->uninit.type, zero_frame->kva);
+	lock_acquire (&clock_lock);
+	frame_add_page (zero_frame, page);
+	lock_release (&clock_lock);
+	if (li != NULL)
+		load_info_release (li);
+	return true;
+}
+
+/* Tries to handle a fault at ADDR, for which SPT has no page, by
+ * backing the whole 2 MB-aligned block around ADDR with a single 2 MB
+ * page.  That takes huge pages to be enabled, the block to lie in one
+ * writable anonymous area with none of its pages created yet, and 2 MB
+ * of aligned contiguous memory to be free.  Then all pages of the block
+ * are created and loaded at once, and, if that worked, *SUCCESS is set
+ * to true.  Returns false if the fault was not handled at all and is
+ * left to the 4 kB path.
+ *
+ * The frames of the block are never evicted.  If the frame table
+ * runs out of victims, or a page of the block is shared, the 2 MB page
+ * is split into 4 kB pages that are evicted like any other. */
+static bool
+vm_try_huge (struct supplemental_page_table *spt, void *addr,
+		bool *success) {
+	uint8_t *base = (uint8_t *) ((uint64_t) addr & ~(HPGSIZE - 1));
+	struct vma *vma;
+	uint8_t *kva;
+	size_t i;
+
+	if (!vm_huge_pages)
+		return false;
+	vma = vma_find (spt, addr);
+	/* The heap shrinks, and mappings go away, a page at a time. */
+	if (vma == NULL || VM_TYPE (vma->type) != VM_ANON || !vma->writable
+			|| vma == spt->heap || vma->mmap
+			|| base < (uint8_t *) vma->start
+			|| base + HPGSIZE > (uint8_t *) vma->end)
+		return false;
+	for (i = 0; i < HPG_CNT; i++)
+		if (spt_find_page (spt, base + i * PGSIZE) != NULL)
+			return false;
+	kva = palloc_get_aligned (PAL_USER, HPG_CNT, HPG_CNT);
+	if (kva == NULL)
+		return false;
+	if (!pml4_set_huge_page (thread_leader ()->pml4, base, kva, true)) {
+		palloc_free_multiple (kva, HPG_CNT);
+		return false;
+	}
+
+	/* From here on the memory belongs to the page table, which frees
+	 * it when the process exits, even if loading a page fails. */
+	*success = false;
+	for (i = 0; i < HPG_CNT; i++) {
+		struct page *page = vma_materialize (spt, base + i * PGSIZE);
+		struct frame *frame = frame_lookup (kva + i * PGSIZE);
+
+		frame->kva = kva + i * PGSIZE;
+		frame_reset (frame);
+		if (page == NULL)
+			return true;
+		frame_add_page (frame, page);
+		if (!swap_in (page, frame->kva))
+			return true;
+	}
+
+	lock_acquire (&clock_lock);
+	for (i = 0; i < HPG_CNT; i++)
+		frame_table[(kva - frame_base) / PGSIZE + i].huge = true;
+	lock_release (&clock_lock);
+	*success = true;
+	return true;
+}
+
+/* Splits the 2 MB page mapping FRAME into 4 kB pages and makes the
+ * frames of those that are loaded candidates for eviction.  Returns
+ * false if memory ran out.  Caller must hold clock_lock. */
+static bool
+vm_demote_frame (struct frame *frame) {
+	struct page *page = frame->page;
+	size_t ofs = ((uint64_t) page->va & (HPGSIZE - 1)) / PGSIZE;
+	struct frame *first = frame - ofs;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	ASSERT (frame->huge);
+	if (!pml4_split_huge_page (page->owner->pml4, page->va))
+		return false;
+	for (i = 0; i < HPG_CNT; i++) {
+		struct frame *f = first + i;
+
+		f->huge = false;
+		if (f->ref_cnt > 0) {
+			f->evictable = true;
+			rss_add (f->page->owner, 1);
+			replace_policy->insert (f);
+		}
+	}
+	return true;
+}
+
+/* Splits some 2 MB page into 4 kB pages.  Returns false if there is
+ * none or memory ran out.  Caller must hold clock_lock. */
+static bool
+vm_demote_any (void) {
+	size_t idx;
+
+	for (idx = 0; idx < frame_cnt; idx++)
+		if (frame_table[idx].huge && frame_table[idx].ref_cnt > 0)
+			return vm_demote_frame (&frame_table[idx]);
+	return false;
+}
+
+/* If PAGE is a not yet loaded page of a read-only executable
+ * segment, or one dropped by eviction, stores the name of its
+ * contents in *KEY and returns true.  Otherwise returns false. */
+static bool
+vm_text_key (struct page *page, struct text_key *key) {
+	struct load_info *li;
+
+	if (page->writable)
+		return false;
+	if (vm_fault_around_cnt (page) != 0)
+		li = page->uninit.aux;
+	else if ((li = anon_text (page)) == NULL)
+		return false;
+	key->inumber = inode_get_inumber (file_get_inode (li->file));
+	load_info_page (li, page->va, &key->ofs, &key->read_bytes);
+	return true;
+}
+
+/* Maps PAGE, a not yet loaded or dropped page named KEY, to the
+ * frame that the text cache holds for KEY, without reading the
+ * executable.  Returns false if the text cache has no such frame. */
+static bool
+vm_share_text (struct page *page, const struct text_key *key) {
+	struct frame probe;
+	struct hash_elem *e;
+	bool success = false;
+
+	probe.text_key = *key;
+	lock_acquire (&clock_lock);
+	e = hash_find (&text_cache, &probe.text_elem);
+	if (e != NULL) {
+		struct frame *frame = hash_entry (e, struct frame, text_elem);
+
+		if (pml4_set_page (thread_leader ()->pml4, page->va, frame->kva,
+					false)) {
+			/* Turn PAGE into the anonymous page loading would have
+			 * made of it, which keeps LI's reference. */
+			if (page->operations->type == VM_UNINIT) {
+				struct load_info *li = page->uninit.aux;
+
+				page->uninit.page_initializer (page, page->uninit.type,
+						frame->kva);
+				page->anon.text = li;
+			}
+			frame_add_page (frame, page);
+			success = true;
+		}
+	}
+	lock_release (&clock_lock);
+
+	return success;
+}
+
+/* Enters FRAME, just loaded with the executable page named KEY and
+ * not yet registered, into the text cache, unless another frame got
+ * there first. */
+static void
+vm_text_insert (struct frame *frame, const struct text_key *key) {
+	lock_acquire (&clock_lock);
+	frame->text_key = *key;
+	frame->text = hash_insert (&text_cache, &frame->text_elem) == NULL;
+	lock_release (&clock_lock);
+}
+
+/* Takes the frames holding pages of the executable whose inode is at
+ * sector INUMBER out of the text cache, as it may be written while
+ * they are still mapped.  The processes mapping them keep them, but
+ * processes started later load the executable afresh. */
+void
+vm_text_forget (disk_sector_t inumber) {
+	size_t idx;
+
+	lock_acquire (&clock_lock);
+	if (!hash_empty (&text_cache))
+		for (idx = 0; idx < frame_cnt; idx++) {
+			struct frame *frame = &frame_table[idx];
+
+			if (frame->text && frame->text_key.inumber == inumber) {
+				hash_delete (&text_cache, &frame->text_elem);
+				frame->text = false;
+			}
+		}
+	lock_release (&clock_lock);
+}
+
+static uint64_t
+text_hash (const struct hash_elem *f_, void *aux UNUSED) {
+	const struct frame *f = hash_entry (f_, struct frame, text_elem);
+	const struct text_key *k = &f->text_key;
+
+	return hash_int (k->inumber) ^ hash_int (k->ofs)
+		^ hash_int (k->read_bytes);
+}
+
+static bool
+text_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED) {
+	const struct text_key *a = &hash_entry (a_, struct frame, text_elem)->text_key;
+	const struct text_key *b = &hash_entry (b_, struct frame, text_elem)->text_key;
+
+	if (a->inumber != b->inumber)
+		return a->inumber < b->inumber;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Pages read ahead of, and let go behind, a fault in an area used
+ * sequentially. */
+#define SEQUENTIAL_WINDOW 8
+
+/* Applies ADVICE, one of the MADV_* advice, to the LENGTH bytes of
+ * the current thread's memory at ADDR, all of which must lie in
+ * areas: executable segments or mapped files.  MADV_SEQUENTIAL and
+ * MADV_RANDOM, and MADV_NORMAL undoing them, apply to the whole of
+ * every area they touch.  Returns 0 if successful, -1 otherwise. */
+int
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	uint8_t *start = addr;
+	uint8_t *end = start + length;
+	struct vma *vma;
+	uint8_t *p;
+
+	if (pg_ofs (addr) != 0 || end < start
+			|| advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+	for (p = start; p < end; p = vma->end) {
+		vma = vma_find (spt, p);
+		if (vma == NULL)
+			return -1;
+	}
+
+	for (p = start; p < end; ) {
+		uint8_t *stop;
+
+		vma = vma_find (spt, p);
+		stop = (uint8_t *) vma->end < end ? vma->end : end;
+
+		if (advice == MADV_WILLNEED)
+			vm_prefetch_range (vma, p, stop);
+		else if (advice == MADV_DONTNEED)
+			vm_drop_range (spt, p, stop);
+		else
+			vma->advice = advice;
+		p = stop;
+	}
+	return 0;
+}
+
+/* Returns the number of pages to load ahead of PAGE when it faults,
+ * AROUND by default, as the advice for its area has it. */
+static size_t
+vm_advise_around (struct page *page, size_t around) {
+	struct vma *vma = vma_find (&thread_leader ()->spt, page->va);
+
+	if (vma == NULL || around == 0)
+		return around;
+	if (vma->advice == MADV_RANDOM)
+		return 0;
+	if (vma->advice == MADV_SEQUENTIAL && around < SEQUENTIAL_WINDOW)
+		return SEQUENTIAL_WINDOW;
+	return around;
+}
+
+/* Having just faulted PAGE in, reads the file data of the pages
+ * after it ahead and lets the page well behind it age out first, if
+ * its area is used sequentially. */
+static void
+vm_advise_fault (struct page *page) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct vma *vma = vma_find (spt, page->va);
+	uint8_t *va = page->va;
+	uint8_t *ahead;
+	struct page *behind;
+
+	if (vma == NULL || vma->advice != MADV_SEQUENTIAL)
+		return;
+	ahead = va + PGSIZE * (SEQUENTIAL_WINDOW + 1);
+	vm_prefetch_range (vma, va + PGSIZE,
+			ahead < (uint8_t *) vma->end ? ahead : vma->end);
+
+	/* Drop behind: a page the scan has moved past looks unused. */
+	if ((size_t) (va - (uint8_t *) vma->start) < PGSIZE * SEQUENTIAL_WINDOW)
+		return;
+	behind = spt_find_page (spt, va - PGSIZE * SEQUENTIAL_WINDOW);
+	if (behind != NULL && behind->frame != NULL) {
+		lock_acquire (&clock_lock);
+		if (behind->frame->evictable)
+			frame_test_and_clear_accessed (behind->frame);
+		lock_release (&clock_lock);
+	}
+}
+
+/* Asks for the file data of the pages of VMA from START up to END to
+ * be read into the buffer cache in the background. */
+static void
+vm_prefetch_range (struct vma *vma, uint8_t *start, uint8_t *end) {
+	size_t ofs = start - (uint8_t *) vma->start;
+	size_t bytes = end - start;
+
+	if (vma->file == NULL || start >= end || ofs >= vma->read_bytes)
+		return;
+	if (bytes > vma->read_bytes - ofs)
+		bytes = vma->read_bytes - ofs;
+	inode_readahead (file_get_inode (vma->file), vma->ofs + ofs, bytes);
+}
+
+/* Loads the pages of the current process from ADDR, which is page
+ * aligned, for LENGTH bytes, all in one area, right away rather than
+ * each on its first touch.  The file data of the range is asked for
+ * first, all at once, so that it is read in a few large requests
+ * rather than a page per fault.  If memory runs out, the rest of the
+ * pages are left to load on their first touch.  The caller holds
+ * vm_lock(). */
+void
+vm_populate (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	struct vma *vma = vma_find (spt, addr);
+	uint8_t *end = (uint8_t *) addr + length;
+	uint8_t *va;
+
+	ASSERT (lock_held_by_current_thread (&spt->lock));
+	ASSERT (pg_ofs (addr) == 0);
+	if (vma == NULL)
+		return;
+	if (end > (uint8_t *) vma->end)
+		end = vma->end;
+	vm_prefetch_range (vma, addr, end);
+	for (va = addr; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page == NULL)
+			page = vma_materialize (spt, va);
+		if (page == NULL
+				|| (page->frame == NULL && !vm_do_claim_page (page)))
+			break;
+	}
+}
+
+/* Brings in the page of the current process, whose supplemental page
+ * table is SPT, at VA for vm_pin_range(), with a private frame
+ * mapped writable if WRITE.  Returns false if the page does not exist
+ * or memory runs out. */
+static bool
+vm_pin_fault (struct supplemental_page_table *spt, void *va, bool write) {
+	struct page *page = spt_find_page (spt, va);
+
+	if (page == NULL)
+		page = vma_materialize (spt, va);
+	if (page == NULL || (write && !page->writable))
+		return false;
+	if (page->frame == NULL && !vm_do_claim_page (page))
+		return false;
+	if (write && !pml4_is_writable (thread_leader ()->pml4, va))
+		return vm_handle_wp (page);
+	return true;
+}
+
+/* Returns true if PAGE can be pinned as it is: it has a frame, one of
+ * its own, mapped writable, if WRITE. */
+static bool
+vm_pin_ready (struct page *page, bool write) {
+	return page != NULL && page->frame != NULL
+		&& (!write || pml4_is_writable (thread_leader ()->pml4, page->va));
+}
+
+/* Pins the pages of the current process holding the SIZE bytes at
+ * ADDR, a system call's buffer, to their frames, loading them first
+ * all together, so that the kernel can reach the buffer through the
+ * frames' kernel addresses with no page fault and no eviction under
+ * way.  With WRITE, each page gets a frame of its own, as it will be
+ * written through it, and is marked dirty.  Pinned frames are neither
+ * evicted nor merged until vm_unpin_range().  Returns false, pinning
+ * nothing, if a page of the range does not exist, as part of the stack
+ * not yet grown into, is read-only with WRITE, or does not stay in
+ * memory.  The caller holds vm_lock() until vm_unpin_range(), so that
+ * no other thread of the process unmaps the pages meanwhile. */
+bool
+vm_pin_range (const void *addr, size_t size, bool write) {
+	struct thread *curr = thread_leader ();
+	struct supplemental_page_table *spt = &curr->spt;
+	uint8_t *start = pg_round_down (addr);
+	uint8_t *end = (uint8_t *) addr + size;
+	uint8_t *va;
+	int tries;
+
+	ASSERT (lock_held_by_current_thread (&spt->lock));
+	if (size == 0)
+		return true;
+
+	/* Pages evicted between loading and pinning are loaded again, the
+	 * pinning done with no eviction of the process's frames in flight. */
+	for (tries = 0; tries < PIN_TRIES; tries++) {
+		struct vma *vma = NULL;
+		bool ready = true;
+
+		for (va = start; va < end; va += PGSIZE) {
+			if (vma == NULL || va >= (uint8_t *) vma->end) {
+				vma = vma_find (spt, va);
+				if (vma != NULL && tries == 0)
+					vm_prefetch_range (vma, va, end < (uint8_t *) vma->end
+							? end : (uint8_t *) vma->end);
+			}
+			if (!vm_pin_fault (spt, va, write))
+				return false;
+		}
+
+		spt_freeze (spt);
+		for (va = start; va < end && ready; va += PGSIZE)
+			ready = vm_pin_ready (spt_find_page (spt, va), write);
+		if (ready) {
+			lock_acquire (&clock_lock);
+			for (va = start; va < end; va += PGSIZE) {
+				struct page *page = spt_find_page (spt, va);
+
+				page->frame->pin_cnt++;
+				/* 2 MB pages are never written back. */
+				if (write && !page->frame->huge)
+					pml4_set_dirty (curr->pml4, va, true);
+			}
+			lock_release (&clock_lock);
+		}
+		spt_thaw (spt);
+		if (ready)
+			return true;
+	}
+	return false;
+}
+
+/* Undoes a successful vm_pin_range() of the same SIZE bytes at
+ * ADDR. */
+void
+vm_unpin_range (const void *addr, size_t size) {
+	struct supplemental_page_table *spt = &thread_leader ()->spt;
+	uint8_t *end = (uint8_t *) addr + size;
+	uint8_t *va;
+
+	if (size == 0)
+		return;
+	lock_acquire (&clock_lock);
+	for (va = pg_round_down (addr); va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		ASSERT (page != NULL && page->frame != NULL
+				&& page->frame->pin_cnt > 0);
+		page->frame->pin_cnt--;
+	}
+	lock_release (&clock_lock);
+}
+
+/* Drops the pages of SPT, the current thread's, from START up to END,
+ * all in areas, writing dirty file pages back.  They are made afresh
+ * from their areas when next touched.  Parts of 2 MB pages are left
+ * alone. */
+static void
+vm_drop_range (struct supplemental_page_table *spt, uint8_t *start,
+		uint8_t *end) {
+	struct thread *curr = thread_leader ();
+	struct tlb_batch batch;
+	uint8_t *va;
+
+	spt_freeze (spt);
+	tlb_batch_init (&batch, curr->pml4);
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+		void *kva;
+
+		if (page == NULL)
+			vm_drop_swapped (va);
+		if (page == NULL || (page->frame != NULL && page->frame->huge))
+			continue;
+		kva = page->frame != NULL ? page->frame->kva : NULL;
+		hash_delete (spt->page_table, &page->hash_elem);
+		vm_dealloc_page (page);
+		/* The frame was emptied but is still mapped, unless it is
+		 * shared. */
+		if (kva != NULL && pml4_get_page (curr->pml4, va) != NULL) {
+			pml4_clear_page_batched (&batch, va);
+			palloc_free_page (kva);
+		}
+	}
+	tlb_batch_flush (&batch);
+	spt_thaw (spt);
+}
+
+/* Claims PAGE, a page of a shared memory segment: maps the frame
+ * holding the segment's page if another process brought it in, and
+ * otherwise a new frame with the page loaded. */
+static bool
+vm_claim_shm (struct page *page) {
+	struct shm *shm = page->shm.shm;
+	size_t idx = page->shm.idx;
+	struct frame *fresh = NULL;
+	struct frame *frame;
+	bool first, success;
+
+	lock_acquire (&shm->lock);
+	frame = shm->frames[idx];
+	if (frame == NULL) {
+		/* Get the frame without the segment's lock, as eviction may
+		 * take it. */
+		lock_release (&shm->lock);
+		fresh = vm_get_frame (false);
+		if (fresh == NULL)
+			return false;
+		lock_acquire (&shm->lock);
+		frame = shm->frames[idx];
+		if (frame == NULL) {
+			frame = fresh;
+			fresh = NULL;
+			swap_in (page, frame->kva);
+			shm->frames[idx] = frame;
+		}
+	}
+
+	lock_acquire (&clock_lock);
+	first = frame->ref_cnt == 0;
+	frame_add_page (frame, page);
+	lock_release (&clock_lock);
+	success = pml4_set_page (thread_leader ()->pml4, page->va, frame->kva,
+			page->writable);
+	/* A frame no process maps is not evictable. */
+	if (first)
+		vm_register_frame (frame);
+	lock_release (&shm->lock);
+
+	if (fresh != NULL) {
+		frame_reset (fresh);
+		palloc_free_page (fresh->kva);
+	}
+	return success;
+}
+
+/* If PAGE is a not resident page of a mapped file that covers all of
+ * the file's bytes in the page, stores the name of the page in *KEY
+ * and returns true.  Otherwise returns false. */
+static bool
+vm_file_key (struct page *page, struct file_key *key) {
+	struct file *file;
+	off_t ofs, bytes;
+
+	if (page->operations->type == VM_UNINIT
+			&& VM_TYPE (page->uninit.type) == VM_FILE) {
+		struct mmap_info *mi = page->uninit.aux;
+
+		file = mi->file;
+		ofs = mi->offset;
+		bytes = mi->read_bytes;
+	} else if (page->operations->type == VM_FILE && page->frame == NULL) {
+		file = page->file.file;
+		ofs = page->file.ofs;
+		bytes = page->file.size;
+	} else
+		return false;
+	if (bytes < PGSIZE && ofs + bytes < file_length (file))
+		return false;
+	key->inumber = inode_get_inumber (file_get_inode (file));
+	key->ofs = ofs;
+	return true;
+}
+
+/* Maps PAGE, a not resident file page named KEY, to the frame that
+ * the file cache holds for KEY, without reading the file.  Returns
+ * false if the file cache has no such frame. */
+static bool
+vm_share_file (struct page *page, const struct file_key *key) {
+	struct mmap_info *mi = NULL;
+	off_t size = 0;
+	struct hash_elem *e;
+	struct frame probe;
+	bool success = false;
+
+	if (page->operations->type == VM_UNINIT) {
+		/* The size lazy_load_file() would have read. */
+		mi = page->uninit.aux;
+		size = file_length (mi->file) - mi->offset;
+		if (size > (off_t) mi->read_bytes)
+			size = mi->read_bytes;
+		if (size < 0)
+			size = 0;
+	}
+
+	probe.file_key = *key;
+	lock_acquire (&clock_lock);
+	e = hash_find (&file_cache, &probe.file_elem);
+	if (e != NULL) {
+		struct frame *frame = hash_entry (e, struct frame, file_elem);
+
+		if (pml4_set_page (thread_leader ()->pml4, page->va, frame->kva,
+					page->writable)) {
+			if (mi != NULL) {
+				/* Turn PAGE into the file page loading would have made
+				 * of it. */
+				page->uninit.page_initializer (page, page->uninit.type,
+						frame->kva);
+				page->file.ofs = key->ofs;
+				page->file.size = size;
+			}
+			frame_add_page (frame, page);
+			success = true;
+		}
+	}
+	lock_release (&clock_lock);
+
+	if (success && mi != NULL)
+		free (mi);
+	return success;
+}
+
+/* Enters FRAME, just loaded with the file page named KEY and not yet
+ * registered, into the file cache, unless another frame got there
+ * first. */
+static void
+vm_file_insert (struct frame *frame, const struct file_key *key) {
+	lock_acquire (&clock_lock);
+	frame->file_key = *key;
+	frame->cached = hash_insert (&file_cache, &frame->file_elem) == NULL;
+	lock_release (&clock_lock);
+}
+
+/* Returns the frame the file cache holds for the page at OFS of the
+ * file whose inode is at sector INUMBER, or a null pointer.  Caller
+ * must hold clock_lock. */
+static struct frame *
+file_cache_find (disk_sector_t inumber, off_t ofs) {
+	struct frame probe;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&clock_lock));
+	probe.file_key.inumber = inumber;
+	probe.file_key.ofs = ofs;
+	e = hash_find (&file_cache, &probe.file_elem);
+	return e != NULL ? hash_entry (e, struct frame, file_elem) : NULL;
+}
+
+/* Replaces the bytes of BUFFER, which holds the SIZE bytes at OFS of
+ * the file whose inode is at sector INUMBER as just read, with those
+ * of them the file cache holds, which a mapping may have changed. */
+void
+vm_file_cache_read (disk_sector_t inumber, void *buffer_, off_t size,
+		off_t ofs) {
+	uint8_t *buffer = buffer_;
+	uint8_t *bounce = NULL;
+	off_t page_ofs;
+
+	if (size <= 0 || hash_empty (&file_cache))
+		return;
+	for (page_ofs = ROUND_DOWN (ofs, PGSIZE); page_ofs < ofs + size;
+			page_ofs += PGSIZE) {
+		off_t start = page_ofs > ofs ? page_ofs : ofs;
+		off_t end = page_ofs + PGSIZE < ofs + size ? page_ofs + PGSIZE
+			: ofs + size;
+		struct frame *frame;
+
+		/* BUFFER may be user memory, which must not fault while
+		 * clock_lock is held. */
+		if (bounce == NULL && (bounce = palloc_get_page (0)) == NULL)
+			return;
+		lock_acquire (&clock_lock);
+		frame = file_cache_find (inumber, page_ofs);
+		if (frame != NULL)
+			memcpy (bounce, (uint8_t *) frame->kva + (start - page_ofs),
+					end - start);
+		lock_release (&clock_lock);
+		if (frame != NULL)
+			memcpy (buffer + (start - ofs), bounce, end - start);
+	}
+	palloc_free_page (bounce);
+}
+
+/* Copies into the frames the file cache holds for them the SIZE
+ * bytes of BUFFER just written at OFS of the file whose inode is at
+ * sector INUMBER, so that mappings of the file see them. */
+void
+vm_file_cache_write (disk_sector_t inumber, const void *buffer_, off_t size,
+		off_t ofs) {
+	const uint8_t *buffer = buffer_;
+	uint8_t *bounce = NULL;
+	off_t page_ofs;
+
+	if (size <= 0 || hash_empty (&file_cache))
+		return;
+	for (page_ofs = ROUND_DOWN (ofs, PGSIZE); page_ofs < ofs + size;
+			page_ofs += PGSIZE) {
+		off_t start = page_ofs > ofs ? page_ofs : ofs;
+		off_t end = page_ofs + PGSIZE < ofs + size ? page_ofs + PGSIZE
+			: ofs + size;
+		struct frame *frame;
+
+		if (bounce == NULL && (bounce = palloc_get_page (0)) == NULL)
+			return;
+		memcpy (bounce, buffer + (start - ofs), end - start);
+		lock_acquire (&clock_lock);
+		frame = file_cache_find (inumber, page_ofs);
+		if (frame != NULL)
+			memcpy ((uint8_t *) frame->kva + (start - page_ofs), bounce,
+					end - start);
+		lock_release (&clock_lock);
+	}
+	palloc_free_page (bounce);
+}
+
+static uint64_t
+file_cache_hash (const struct hash_elem *f_, void *aux UNUSED) {
+	const struct frame *f = hash_entry (f_, struct frame, file_elem);
+
+	return hash_int (f->file_key.inumber) ^ hash_int (f->file_key.ofs);
+}
+
+static bool
+file_cache_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED) {
+	const struct file_key *a = &hash_entry (a_, struct frame, file_elem)->file_key;
+	const struct file_key *b = &hash_entry (b_, struct frame, file_elem)->file_key;
+
+	if (a->inumber != b->inumber)
+		return a->inumber < b->inumber;
+	return a->ofs < b->ofs;
+}
+
+/* Having just swapped PAGE in from SLOT_IDX, speculatively swaps in
+ * PAGE's neighbours that were swapped out into the slots next to it,
+ * as long as free frames are available without evicting anything. */
+static void
+vm_swap_read_around (struct page *page, size_t slot_idx) {
+	struct thread *curr = thread_leader ();
+	struct page *pages[SWAP_CLUSTER_MAX];
+	void *kvas[SWAP_CLUSTER_MAX];
+	struct frame *frames[SWAP_CLUSTER_MAX];
+	size_t n = 0;
+	size_t i;
+	int dist;
+
+	for (dist = -(SWAP_CLUSTER_MAX - 1);
+			dist < SWAP_CLUSTER_MAX && n < SWAP_CLUSTER_MAX - 1; dist++) {
+		void *va = (uint8_t *) page->va + dist * PGSIZE;
+		struct page *near;
+
+		if (dist == 0 || (dist < 0 && (size_t) -dist > slot_idx)
+				|| !is_user_vaddr (va))
+			continue;
+		near = spt_find_page (&curr->spt, va);
+		if (near == NULL || near->frame != NULL
+				|| anon_swap_slot (near) != slot_idx + dist)
+			continue;
+
+		struct frame *frame = vm_map_spare_frame (near);
+		if (frame == NULL)
+			break;
+		pages[n] = near;
+		kvas[n] = frame->kva;
+		frames[n] = frame;
+		n++;
+	}
+	if (n == 0)
+		return;
+
+	anon_swap_in_cluster (pages, kvas, n);
+	for (i = 0; i < n; i++)
+		vm_register_frame (frames[i]);
+}
+
+/* Hash of a page of the SPT at VA, for page_hash() and
+ * spt_lookup(). */
+static uint64_t
+page_va_hash (void *va) {
+  return hash_ptr (va);
+}
+
+static uint64_t
+page_hash (const struct hash_elem *p_, void *aux UNUSED) {
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return page_va_hash (p->va);
+}
+
+static bool
+page_less (const struct hash_elem *a_,
+           const struct hash_elem *b_, void *aux UNUSED) {
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->va < b->va;
+}
+
+/* Initialize new supplemental page table */
+void
+supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+	struct hash* page_table = malloc(sizeof (struct hash));
+	hash_init(page_table, page_hash, page_less, NULL);
+	spt -> page_table = page_table;
+	list_init (&spt->mmaps);
+	list_init (&spt->shms);
+	vma_tree_init (spt);
+	spt->stack_bottom = (void *) USER_STACK;
+	spt->heap_start = spt->brk = NULL;
+	spt->heap = NULL;
+	spt->rss = spt->wss = 0;
+	spt->rss_min = spt->rss_max = 0;
+	spt->frozen = spt->evicting = 0;
+	spt->swapped = 0;
+	spt->faults = calloc (FAULT_CLASS_CNT, sizeof *spt->faults);
+}
+
+/* Gives the current thread a copy-on-write mapping of SRC, a resident
+ * anonymous page of another process: both processes map SRC's frame
+ * read-only until one of them writes to it.  Returns false if SRC is
+ * not resident, in which case the caller must copy it. */
+static bool
+vm_share_page (struct page *src) {
+	struct thread *curr = thread_leader ();
+	struct page *dst;
+	bool success = false;
+
+	dst = kmem_cache_alloc (page_slab);
+	if (dst == NULL)
+		return false;
+
+	/* With no eviction of the parent's frames in flight, a page with a
+	 * frame keeps it. */
+	spt_freeze (&src->owner->spt);
+	if (src->frame != NULL) {
+		struct frame *frame = src->frame;
+		bool split;
+
+		/* Only 4 kB pages can be made read-only one at a time. */
+		lock_acquire (&clock_lock);
+		split = !frame->huge || vm_demote_frame (frame);
+		lock_release (&clock_lock);
+		if (!split) {
+			spt_thaw (&src->owner->spt);
+			kmem_cache_free (page_slab, dst);
+			return false;
+		}
+
+		*dst = *src;
+		dst->owner = curr;
+		dst->anon.owner = curr;
+		dst->anon.swap_slot_idx = INVALID_SLOT_IDX;
+		dst->anon.text = NULL;
+		dst->anon.cache_slot_idx = INVALID_SLOT_IDX;
+		if (pml4_set_page (curr->pml4, dst->va, frame->kva, false)) {
+			/* A copy of the executable in the parent is one in the
+			 * child too, of the child's own area. */
+			if (src->anon.text != NULL) {
+				struct vma *vma = vma_find (&curr->spt, dst->va);
+
+				dst->anon.text = vma != NULL ? vma_load_info (vma) : NULL;
+			}
+			pml4_set_page (src->owner->pml4, src->va, frame->kva, false);
+			lock_acquire (&clock_lock);
+			frame_add_page (frame, dst);
+			lock_release (&clock_lock);
+			spt_insert_page (&curr->spt, dst);
+			success = true;
+		}
+	}
+	spt_thaw (&src->owner->spt);
+
+	if (!success)
+		kmem_cache_free (page_slab, dst);
+	return success;
+}
+
+/* Copy supplemental page table from src to dst */
+bool
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	/* Areas first, as they may not overlap pages already present.
+	 * Mapped regions of files are not inherited; anonymous ones are,
+	 * and so are shared memory segments, attached afresh. */
+	struct list_elem *e;
+	dst->stack_bottom = src->stack_bottom;
+	dst->heap_start = src->heap_start;
+	dst->brk = src->brk;
+	dst->rss_min = src->rss_min;
+	dst->rss_max = src->rss_max;
+	for (e = list_begin (&src->vmas); e != list_end (&src->vmas);
+			e = list_next (e)) {
+		struct vma *vma = list_entry (e, struct vma, elem);
+		struct vma *copy;
+
+		/* Mapped regions are copied by mmap_copy(). */
+		if (vma->mmap)
+			continue;
+		copy = malloc (sizeof *copy);
+		if (copy == NULL)
+			return false;
+		*copy = *vma;
+		copy->li = NULL;
+		copy->file = vma->file != NULL ? file_duplicate (vma->file) : NULL;
+		if ((vma->file != NULL && copy->file == NULL)
+				|| !vma_insert (dst, copy)) {
+			file_close (copy->file);
+			free (copy);
+			return false;
+		}
+		if (vma == src->heap)
+			dst->heap = copy;
+	}
+
+	if (!shm_copy (src) || !mmap_copy (src))
+		return false;
+
+	/*Iterate Source spt hash table*/
+	struct hash_iterator i;
+	hash_first (&i, src -> page_table);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, hash_elem);
+
+		thread_resched ();
+		/*Handle UNINIT page*/
+		if (page -> operations -> type == VM_UNINIT){
+			vm_initializer* init = page ->uninit.init;
+			bool writable = page -> writable;
+			int type = page ->uninit.type;
+			if (type & VM_ANON){
+				/* Share the load_info of the child's copy of the area. */
+				struct vma *vma = vma_find (dst, page -> va);
+				struct load_info* li = vma != NULL ? vma_load_info (vma) : NULL;
+				if (li == NULL)
+					return false;
+				if (!vm_alloc_page_with_initializer (type, page -> va, writable, init, (void*) li)) {
+					load_info_release (li);
+					return false;
+				}
+			}
+			else if (type & VM_FILE){
+				//Do_nothing(it should not inherit mmap)
+			}
+
+		}
+		
+		/* Handle ANON/FILE page*/
+		else if (page_get_type(page) == VM_ANON && vm_share_page (page))
+			continue;
+		else if (page_get_type(page) == VM_ANON){
+			if (!vm_alloc_page (page -> operations -> type, page -> va, page -> writable))
+				return false;
+			struct page* new_page = spt_find_page (&thread_leader () -> spt, page -> va);
+			if (!vm_do_claim_page (new_page))
+				return false;
+			if (page -> frame != NULL)
+				copy_page (new_page -> frame -> kva, page -> frame -> kva);
+			else if (!anon_swap_copy (page, new_page -> frame -> kva))
+				return false;
+		}
+		else if (page_get_type(page) == VM_FILE){
+			//Do nothing(it should not inherit mmap)
+		}
+	}
+	/* And the pages packed into the parent's page table entries. */
+	return pml4_for_each_swap (spt_thread (src)->pml4, spt_copy_swapped,
+			NULL);
+}
+
+/* Gives the current thread, a child being forked, a copy of the
+ * swapped-out page at VA whose slot the parent's entry PTE holds. */
+static bool
+spt_copy_swapped (uint64_t *pte, void *va, void *aux UNUSED) {
+	struct page *page;
+
+	if (!vm_alloc_page (VM_ANON, va, (*pte & PTE_W) != 0))
+		return false;
+	page = spt_find_page (&thread_leader ()->spt, va);
+	if (!vm_do_claim_page (page))
+		return false;
+	anon_slot_read (PTE_SWAP_SLOT (*pte), page->frame->kva);
+	return true;
+}
+
+/* Frees the swap slot a page packed into entry PTE holds. */
+static bool
+spt_free_swapped (uint64_t *pte, void *va UNUSED, void *aux UNUSED) {
+	anon_slot_free (PTE_SWAP_SLOT (*pte));
+	*pte = 0;
+	return true;
+}
+
+static void
+spt_destroy (struct hash_elem *e, void *aux UNUSED){
+	struct page *page = hash_entry (e, struct page, hash_elem);
+	ASSERT (page != NULL);
+	destroy (page);
+	kmem_cache_free (page_slab, page);
+	thread_resched ();
+}
+
+/* Unmaps SPT's mapped regions, writing back their dirty pages, and
+ * detaches its shared memory segments, as its process exits: what
+ * others see of it is then as it will stay, though the rest of SPT
+ * is still to be torn down. */
+void
+supplemental_page_table_unmap (struct supplemental_page_table *spt) {
+	if (spt->page_table == NULL)
+		return;
+	/* Unmap regions first, to write back their dirty pages in runs. */
+	while (!list_empty (&spt->mmaps))
+		mmap_region_unmap (spt, list_entry (list_front (&spt->mmaps),
+					struct mmap_region, elem));
+	while (!list_empty (&spt->shms))
+		shm_region_detach (spt, list_entry (list_front (&spt->shms),
+					struct shm_region, elem));
 }
 
 /* Free the resource hold by the supplemental page table */
@@ -362,9 +3081,29 @@ void
 supplemental_page_table_kill (struct supplemental_page_table *spt) {
 	/* Destroy all the supplemental_page_table hold by thread and
 	 * writeback all the modified contents to the storage. */
+	free (spt->faults);
+	spt->faults = NULL;
 	if (spt->page_table == NULL) return;
-	lock_acquire(&spt_kill_lock);
+	supplemental_page_table_unmap (spt);
+	/* Only this process's own evictions are waited for, and its frames
+	 * leave the policy in one go: exits run in parallel. */
+	spt_freeze (spt);
+	vm_release_frames (spt);
 	hash_destroy (spt->page_table, spt_destroy);
 	free (spt->page_table);
-	lock_release(&spt_kill_lock);
+	spt_thaw (spt);
+	if (spt_thread (spt)->pml4 != NULL)
+		pml4_for_each_swap (spt_thread (spt)->pml4, spt_free_swapped, NULL);
+
+	/* What is left are the areas of executable segments and the heap. */
+	spt->heap = NULL;
+	while (!list_empty (&spt->vmas)) {
+		struct vma *vma = list_entry (list_front (&spt->vmas), struct vma,
+				elem);
+		vma_remove (spt, vma);
+		if (vma->li != NULL)
+			load_info_release (vma->li);
+		file_close (vma->file);
+		free (vma);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+/* vma.c: Virtual memory areas, kept per process in a treap. */
+
+#include "vm/vm.h"
+#include <debug.h>
+#include <random.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "vm/vma.h"
+
+static void split (struct vma *t, void *key, struct vma **l, struct vma **r);
+static struct vma *merge (struct vma *l, struct vma *r);
+static struct vma *floor_vma (struct vma *t, void *va, bool strict);
+
+/* Initializes SPT's areas to none. */
+void
+vma_tree_init (struct supplemental_page_table *spt) {
+	spt->vma_root = NULL;
+	list_init (&spt->vmas);
+}
+
+/* Inserts VMA, whose fields other than the treap's are set, into SPT.
+ * Returns false, leaving SPT unchanged, if VMA overlaps an area it
+ * already has. */
+bool
+vma_insert (struct supplemental_page_table *spt, struct vma *vma) {
+	struct vma *l, *r;
+
+	ASSERT (pg_ofs (vma->start) == 0 && pg_ofs (vma->end) == 0);
+	ASSERT (vma->start < vma->end);
+	if (!vma_range_is_free (spt, vma->start,
+				(uint8_t *) vma->end - (uint8_t *) vma->start))
+		return false;
+
+	vma->left = vma->right = NULL;
+	vma->prio = random_ulong ();
+	split (spt->vma_root, vma->start, &l, &r);
+	spt->vma_root = merge (merge (l, vma), r);
+	list_push_back (&spt->vmas, &vma->elem);
+	return true;
+}
+
+/* Removes VMA from SPT.  Pages created from it are left alone. */
+void
+vma_remove (struct supplemental_page_table *spt, struct vma *vma) {
+	struct vma *l, *m, *r;
+
+	split (spt->vma_root, vma->start, &l, &r);
+	split (r, (uint8_t *) vma->start + 1, &m, &r);
+	ASSERT (m == vma);
+	spt->vma_root = merge (l, r);
+	list_remove (&vma->elem);
+}
+
+/* Returns SPT's area containing VA, or a null pointer if none does. */
+struct vma *
+vma_find (struct supplemental_page_table *spt, void *va) {
+	struct vma *vma = floor_vma (spt->vma_root, va, false);
+
+	return vma != NULL && va < vma->end ? vma : NULL;
+}
+
+/* Returns true if no page of the LENGTH bytes at ADDR is in use in SPT,
+ * whether by an area or by a page outside any area, like the stack's.
+ * Costs O(log n) in the number of areas, plus the smaller of the
+ * number of pages in the range and in SPT. */
+bool
+vma_range_is_free (struct supplemental_page_table *spt, void *addr,
+		size_t length) {
+	uint8_t *start = pg_round_down (addr);
+	uint8_t *end = (uint8_t *) addr + length;
+	struct vma *vma;
+
+	/* The area starting last before END is the only one that can
+	 * overlap, as areas do not overlap each other. */
+	vma = floor_vma (spt->vma_root, end, true);
+	if (vma != NULL && (uint8_t *) vma->end > start)
+		return false;
+
+	if ((size_t) (end - start) / PGSIZE < hash_size (spt->page_table)) {
+		uint8_t *va;
+
+		for (va = start; va < end; va += PGSIZE)
+			if (spt_find_page (spt, va) != NULL)
+				return false;
+	} else {
+		struct hash_iterator i;
+
+		hash_first (&i, spt->page_table);
+		while (hash_next (&i)) {
+			struct page *page = hash_entry (hash_cur (&i), struct page,
+					hash_elem);
+
+			if ((uint8_t *) page->va >= start && (uint8_t *) page->va < end)
+				return false;
+		}
+	}
+	return true;
+}
+
+/* Returns the lowest page-aligned address at or after ADDR from which
+ * LENGTH bytes are free in SPT, as vma_range_is_free() has it, or a
+ * null pointer if there is none in user space.  Areas in the way are
+ * stepped over whole; pages outside any area, one at a time. */
+void *
+vma_find_gap (struct supplemental_page_table *spt, void *addr,
+		size_t length) {
+	uint8_t *start = pg_round_up (addr);
+
+	while (start + length > start && is_user_vaddr (start + length)) {
+		struct vma *vma = floor_vma (spt->vma_root, start + length, true);
+
+		if (vma != NULL && (uint8_t *) vma->end > start)
+			start = vma->end;
+		else if (vma_range_is_free (spt, start, length))
+			return start;
+		else
+			start += PGSIZE;
+	}
+	return NULL;
+}
+
+/* Creates the page at VA of the current thread, whose supplemental
+ * page table is SPT, from the area containing VA, and returns it.
+ * Returns a null pointer if no area contains VA or memory runs out. */
+struct page *
+vma_materialize (struct supplemental_page_table *spt, void *va) {
+	struct vma *vma = vma_find (spt, va);
+	size_t page_ofs, read_bytes, slot;
+	void *aux;
+	bool rw;
+
+	if (vma == NULL)
+		return NULL;
+	va = pg_round_down (va);
+	page_ofs = (uint8_t *) va - (uint8_t *) vma->start;
+	read_bytes = vma->read_bytes > page_ofs ? vma->read_bytes - page_ofs : 0;
+	if (read_bytes > PGSIZE)
+		read_bytes = PGSIZE;
+
+	/* A packed swapped-out page comes back as it was. */
+	if (VM_TYPE (vma->type) == VM_ANON
+			&& pml4_get_swap (thread_leader ()->pml4, va, &slot, &rw))
+		return vm_page_from_swap (spt, va, slot, rw);
+
+	if (VM_TYPE (vma->type) == VM_FILE) {
+		struct mmap_info *mi = kmem_cache_alloc (mmap_info_slab);
+
+		if (mi == NULL)
+			return NULL;
+		mi->file = vma->file;
+		mi->offset = vma->ofs + page_ofs;
+		mi->read_bytes = read_bytes;
+		aux = mi;
+	} else {
+		aux = vma_load_info (vma);
+		if (aux == NULL)
+			return NULL;
+	}
+
+	if (!vm_alloc_page_with_initializer (vma->type, va, vma->writable,
+				vma->init, aux)) {
+		if (VM_TYPE (vma->type) != VM_FILE)
+			load_info_release (aux);
+		else
+			free (aux);
+		return NULL;
+	}
+	return spt_find_page (spt, va);
+}
+
+/* Returns the load_info of VMA, a VM_ANON area, with a new reference
+ * for a page to hold, making it on first use.  Returns a null
+ * pointer if memory is not available. */
+struct load_info *
+vma_load_info (struct vma *vma) {
+	struct load_info *li = vma->li;
+
+	ASSERT (VM_TYPE (vma->type) == VM_ANON);
+	if (li == NULL) {
+		li = kmem_cache_alloc (load_info_slab);
+		if (li == NULL)
+			return NULL;
+		li->file = vma->file != NULL ? file_dup (vma->file) : NULL;
+		li->ofs = vma->ofs;
+		li->start = vma->start;
+		li->read_bytes = vma->read_bytes;
+		li->fault_around = vma->fault_around;
+		li->ref_cnt = 1;
+		vma->li = li;
+	}
+	li->ref_cnt++;
+	return li;
+}
+
+/* Drops a reference to LI, freeing it with the last one. */
+void
+load_info_release (struct load_info *li) {
+	ASSERT (li->ref_cnt > 0);
+	if (--li->ref_cnt == 0) {
+		file_close (li->file);
+		kmem_cache_free (load_info_slab, li);
+	}
+}
+
+/* Stores in *OFS the offset in LI's file of the page at VA, and in
+ * *READ_BYTES the number of its bytes to read from there.  The rest
+ * of the page is zero. */
+void
+load_info_page (const struct load_info *li, const void *va, off_t *ofs,
+		size_t *read_bytes) {
+	size_t page_ofs = (const uint8_t *) va - (const uint8_t *) li->start;
+
+	*ofs = li->ofs + page_ofs;
+	*read_bytes = li->read_bytes > page_ofs ? li->read_bytes - page_ofs : 0;
+	if (*read_bytes > PGSIZE)
+		*read_bytes = PGSIZE;
+}
+
+/* Splits treap T into L, the areas starting before KEY, and R, the
+ * others. */
+static void
+split (struct vma *t, void *key, struct vma **l, struct vma **r) {
+	if (t == NULL)
+		*l = *r = NULL;
+	else if (t->start < key) {
+		split (t->right, key, &t->right, r);
+		*l = t;
+	} else {
+		split (t->left, key, l, &t->left);
+		*r = t;
+	}
+}
+
+/* Joins treaps L and R, all of whose areas start before R's. */
+static struct vma *
+merge (struct vma *l, struct vma *r) {
+	if (l == NULL)
+		return r;
+	if (r == NULL)
+		return l;
+	if (l->prio > r->prio) {
+		l->right = merge (l->right, r);
+		return l;
+	} else {
+		r->left = merge (l, r->left);
+		return r;
+	}
+}
+
+/* Returns the area of treap T starting last at or before VA, or
+ * strictly before VA if STRICT. */
+static struct vma *
+floor_vma (struct vma *t, void *va, bool strict) {
+	struct vma *best = NULL;
+
+	while (t != NULL)
+		if (t->start < va || (!strict && t->start == va)) {
+			best = t;
+			t = t->right;
+		} else
+			t = t->left;
+	return best;
+}
@@ -0,0 +1,321 @@
+/* zswap.c: A compressed cache of swap slots in memory.
+ *
+ * A page written to a swap slot is first offered here.  If it
+ * compresses to at most half a page and the pool has room, it is kept
+ * in kernel memory under its slot and never reaches the swap disk;
+ * reading the slot back decompresses it.  Otherwise it goes to disk
+ * as before.  A page that is one 64-bit word repeated, a zeroed page
+ * most often, is kept as that word alone.
+ *
+ * The compressor is a small LZ77 of the LZ4 kind: a sequence is a
+ * token byte, whose high nibble is the number of literals and low
+ * nibble the match length less MIN_MATCH, 15 in either meaning that
+ * more length bytes follow, then the literals, then the match's
+ * 2-byte little-endian offset back into the output.  The last
+ * sequence has literals only. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Shortest match worth a sequence. */
+#define MIN_MATCH 4
+
+/* The compressor's hash table has 2**HASH_BITS entries. */
+#define HASH_BITS 12
+
+/* Largest entry kept, header included; anything bigger saves too
+ * little to be worth it. */
+#define ZSWAP_MAX_SIZE (PGSIZE / 2)
+
+unsigned zswap_max_percent = 20;
+
+/* A page kept compressed. */
+struct zswap_entry {
+	uint16_t len;               /* Bytes of DATA, or 0 if the page is
+	                               FILL repeated. */
+	uint64_t fill;
+	uint8_t data[];             /* LEN bytes of compressed page. */
+};
+
+/* Entries by swap slot, null for a slot not kept here, and the
+ * memory they take.  ZSWAP_LOCK protects these, the statistics and
+ * the compressor's buffers. */
+static struct zswap_entry **entries;
+static size_t entry_cnt;
+static size_t pool_bytes;
+static size_t pool_max;
+static struct lock zswap_lock;
+
+/* Compressor's buffers: positions of recent 4-byte strings by hash,
+ * which are checked against the page, so need no clearing between
+ * pages, and the output. */
+static uint16_t hash_table[1 << HASH_BITS];
+static uint8_t scratch[ZSWAP_MAX_SIZE];
+
+/* Statistics. */
+static uint64_t stored_cnt;     /* Pages stored. */
+static uint64_t same_cnt;       /* ...of which kept as one word. */
+static uint64_t loaded_cnt;     /* Pages read back. */
+static uint64_t reject_cnt;     /* Pages that did not compress enough. */
+static uint64_t full_cnt;       /* Pages turned away by a full pool. */
+static size_t stored_bytes;     /* Bytes of the pages now stored. */
+
+static void drop (size_t slot_idx);
+static bool same_filled (const void *kva, uint64_t *fill);
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t cap);
+static void lz_decompress (const uint8_t *src, size_t len, uint8_t *dst);
+
+/* Sets up the cache for a swap disk of SLOT_CNT page-sized slots. */
+void
+zswap_init (size_t slot_cnt) {
+	lock_init (&zswap_lock);
+	if (zswap_max_percent == 0 || slot_cnt == 0)
+		return;
+	pool_max = (uint64_t) palloc_user_page_cnt () * PGSIZE
+		* zswap_max_percent / 100;
+	entries = calloc (slot_cnt, sizeof *entries);
+	if (entries != NULL)
+		entry_cnt = slot_cnt;
+}
+
+/* Keeps the page at KVA compressed as the contents of SLOT_IDX, in
+ * place of whatever was kept for it.  Returns false, keeping nothing,
+ * if the page does not compress well enough or the pool is full; the
+ * caller then writes it to disk. */
+bool
+zswap_store (size_t slot_idx, const void *kva) {
+	struct zswap_entry *e;
+	uint64_t fill = 0;
+	size_t len = 0;
+
+	if (entries == NULL)
+		return false;
+	ASSERT (slot_idx < entry_cnt);
+	lock_acquire (&zswap_lock);
+	drop (slot_idx);
+	if (!same_filled (kva, &fill)) {
+		len = lz_compress (kva, scratch, ZSWAP_MAX_SIZE - sizeof *e);
+		if (len == 0) {
+			reject_cnt++;
+			lock_release (&zswap_lock);
+			return false;
+		}
+	}
+	if (pool_bytes + sizeof *e + len > pool_max
+			|| (e = malloc (sizeof *e + len)) == NULL) {
+		full_cnt++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+	e->len = len;
+	e->fill = fill;
+	memcpy (e->data, scratch, len);
+	entries[slot_idx] = e;
+	pool_bytes += sizeof *e + len;
+	stored_bytes += PGSIZE;
+	stored_cnt++;
+	if (len == 0)
+		same_cnt++;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Decompresses what is kept for SLOT_IDX into the page at KVA,
+ * keeping it.  Returns false if nothing is, in which case the slot's
+ * contents are on disk. */
+bool
+zswap_load (size_t slot_idx, void *kva) {
+	struct zswap_entry *e;
+
+	if (entries == NULL)
+		return false;
+	ASSERT (slot_idx < entry_cnt);
+	lock_acquire (&zswap_lock);
+	e = entries[slot_idx];
+	if (e != NULL) {
+		if (e->len == 0) {
+			uint64_t *p = kva;
+			size_t i;
+
+			for (i = 0; i < PGSIZE / sizeof *p; i++)
+				p[i] = e->fill;
+		} else
+			lz_decompress (e->data, e->len, kva);
+		loaded_cnt++;
+	}
+	lock_release (&zswap_lock);
+	return e != NULL;
+}
+
+/* Forgets what is kept for SLOT_IDX, which is being freed. */
+void
+zswap_invalidate (size_t slot_idx) {
+	if (entries == NULL)
+		return;
+	ASSERT (slot_idx < entry_cnt);
+	lock_acquire (&zswap_lock);
+	drop (slot_idx);
+	lock_release (&zswap_lock);
+}
+
+/* Prints zswap statistics. */
+void
+zswap_print_stats (void) {
+	if (entries == NULL)
+		return;
+	printf ("zswap: %"PRIu64" pages stored (%"PRIu64" same-filled), "
+			"%"PRIu64" loaded, %"PRIu64" rejected, %"PRIu64" pool full\n",
+			stored_cnt, same_cnt, loaded_cnt, reject_cnt, full_cnt);
+	printf ("zswap: %zu kB of pages in %zu kB of %zu kB pool\n",
+			stored_bytes / 1024, pool_bytes / 1024, pool_max / 1024);
+}
+
+/* Frees the entry of SLOT_IDX, if any.  The caller holds zswap_lock. */
+static void
+drop (size_t slot_idx) {
+	struct zswap_entry *e = entries[slot_idx];
+
+	if (e != NULL) {
+		pool_bytes -= sizeof *e + e->len;
+		stored_bytes -= PGSIZE;
+		free (e);
+		entries[slot_idx] = NULL;
+	}
+}
+
+/* Returns true if the page at KVA is one 64-bit word repeated,
+ * storing the word in *FILL. */
+static bool
+same_filled (const void *kva, uint64_t *fill) {
+	const uint64_t *p = kva;
+	size_t i;
+
+	for (i = 1; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != p[0])
+			return false;
+	*fill = p[0];
+	return true;
+}
+
+static inline uint32_t
+read32 (const uint8_t *p) {
+	uint32_t v;
+
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Appends to DST at OP a sequence of the LIT_LEN literals at LIT and
+ * a match of MATCH_LEN bytes OFFSET back, or no match if MATCH_LEN is
+ * 0.  Returns the new end of DST, or 0 if it would pass CAP. */
+static size_t
+emit (uint8_t *dst, size_t op, size_t cap, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t ml = match_len != 0 ? match_len - MIN_MATCH : 0;
+	size_t need = 1 + lit_len + (lit_len >= 15 ? (lit_len - 15) / 255 + 1 : 0)
+		+ (match_len != 0 ? 2 + (ml >= 15 ? (ml - 15) / 255 + 1 : 0) : 0);
+	size_t rest;
+
+	if (op + need > cap)
+		return 0;
+	dst[op++] = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+	if (lit_len >= 15) {
+		for (rest = lit_len - 15; rest >= 255; rest -= 255)
+			dst[op++] = 255;
+		dst[op++] = rest;
+	}
+	memcpy (dst + op, lit, lit_len);
+	op += lit_len;
+	if (match_len != 0) {
+		dst[op++] = offset & 0xff;
+		dst[op++] = offset >> 8;
+		if (ml >= 15) {
+			for (rest = ml - 15; rest >= 255; rest -= 255)
+				dst[op++] = 255;
+			dst[op++] = rest;
+		}
+	}
+	return op;
+}
+
+/* Compresses the page at SRC into DST and returns the compressed
+ * length, or 0 if it would be more than CAP bytes.  The caller holds
+ * zswap_lock, for the hash table. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap) {
+	size_t ip = 0, anchor = 0, op = 0;
+
+	while (ip + MIN_MATCH <= PGSIZE) {
+		uint32_t v = read32 (src + ip);
+		uint32_t h = (v * 2654435761u) >> (32 - HASH_BITS);
+		size_t ref = hash_table[h];
+		size_t len = MIN_MATCH;
+
+		hash_table[h] = ip;
+		if (ref >= ip || read32 (src + ref) != v) {
+			ip++;
+			continue;
+		}
+		while (ip + len < PGSIZE && src[ref + len] == src[ip + len])
+			len++;
+		op = emit (dst, op, cap, src + anchor, ip - anchor, ip - ref, len);
+		if (op == 0)
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (anchor < PGSIZE)
+		op = emit (dst, op, cap, src + anchor, PGSIZE - anchor, 0, 0);
+	return op;
+}
+
+/* Reads a length continued past 15 from SRC at *IP. */
+static size_t
+read_len (const uint8_t *src, size_t *ip) {
+	size_t len = 0;
+	uint8_t b;
+
+	do
+		len += b = src[(*ip)++];
+	while (b == 255);
+	return len;
+}
+
+/* Decompresses the LEN bytes at SRC, made by lz_compress(), into the
+ * page at DST. */
+static void
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst) {
+	size_t ip = 0, op = 0;
+
+	while (op < PGSIZE) {
+		uint8_t token = src[ip++];
+		size_t lit_len = token >> 4;
+		size_t match_len = (token & 15) + MIN_MATCH;
+		size_t offset;
+
+		if (lit_len == 15)
+			lit_len += read_len (src, &ip);
+		ASSERT (op + lit_len <= PGSIZE && ip + lit_len <= len);
+		memcpy (dst + op, src + ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (op == PGSIZE)
+			break;
+
+		offset = src[ip] | src[ip + 1] << 8;
+		ip += 2;
+		if ((token & 15) == 15)
+			match_len += read_len (src, &ip);
+		ASSERT (offset > 0 && offset <= op && op + match_len <= PGSIZE);
+		for (; match_len > 0; match_len--, op++)
+			dst[op] = dst[op - offset];
+	}
+	ASSERT (ip == len);
+}